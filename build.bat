@@ -61,9 +61,9 @@ if %errorlevel% equ 0 (
     :: Direct MSVC compilation
     cd ..
     
-    set SOURCES=src\main.cpp src\overlay_window.cpp src\audio_capture.cpp src\screen_capture.cpp src\http_client.cpp src\ai_service.cpp src\text_to_speech.cpp src\meeting_assistant.cpp
+    set SOURCES=src\main.cpp src\overlay_window.cpp src\audio_capture.cpp src\screen_capture.cpp src\http_client.cpp src\ai_service.cpp src\text_to_speech.cpp src\meeting_assistant.cpp src\jpeg_encoder.cpp src\base64.cpp src\resampler.cpp src\audio_preprocessor.cpp src\audio_ring.cpp src\vad.cpp src\utterance_segmenter.cpp src\transcription_pipeline.cpp src\flac_encoder.cpp src\json.cpp src\sse_parser.cpp src\cancellation_token.cpp src\event_loop.cpp src\retry_policy.cpp src\response_cache.cpp src\rolling_summary.cpp src\image_preprocessor.cpp src\frame_index.cpp src\image_buffer.cpp src\capture_backend.cpp src\text_recognizer.cpp src\connection_pool.cpp src\http_transport.cpp src\winhttp_transport.cpp src\dxgi_capture.cpp src\gdi_capture.cpp
     set INCLUDES=/Isrc
-    set LIBS=user32.lib gdi32.lib dwmapi.lib ole32.lib uuid.lib winhttp.lib sapi.lib
+    set LIBS=user32.lib gdi32.lib dwmapi.lib ole32.lib uuid.lib winhttp.lib d3d11.lib dxgi.lib sapi.lib
     set DEFINES=/DWINVER=0x0A00 /D_WIN32_WINNT=0x0A00 /DUNICODE /D_UNICODE /DNOMINMAX
     set FLAGS=/EHsc /W4 /O2 /std:c++17 /MT
     
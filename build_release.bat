@@ -67,6 +67,32 @@ for %%f in (
     text_to_speech
     meeting_assistant
     tray_icon
+    jpeg_encoder
+    base64
+    resampler
+    audio_preprocessor
+    audio_ring
+    vad
+    utterance_segmenter
+    transcription_pipeline
+    flac_encoder
+    json
+    sse_parser
+    cancellation_token
+    event_loop
+    retry_policy
+    response_cache
+    rolling_summary
+    image_preprocessor
+    frame_index
+    image_buffer
+    capture_backend
+    text_recognizer
+    connection_pool
+    http_transport
+    winhttp_transport
+    dxgi_capture
+    gdi_capture
     main
 ) do (
     echo   Compiling %%f.cpp...
@@ -86,11 +112,11 @@ echo.
 echo [3/3] Linking...
 
 set OBJS=
-for %%f in (overlay_window audio_capture screen_capture http_client ai_service text_to_speech meeting_assistant tray_icon main) do (
+for %%f in (overlay_window audio_capture screen_capture http_client ai_service text_to_speech meeting_assistant tray_icon jpeg_encoder base64 resampler audio_preprocessor audio_ring vad utterance_segmenter transcription_pipeline flac_encoder json sse_parser cancellation_token event_loop retry_policy response_cache rolling_summary image_preprocessor frame_index image_buffer capture_backend text_recognizer connection_pool http_transport winhttp_transport dxgi_capture gdi_capture main) do (
     set "OBJS=!OBJS! %BUILD_DIR%\%%f.obj"
 )
 
-set LIBS=user32.lib gdi32.lib dwmapi.lib ole32.lib uuid.lib winhttp.lib sapi.lib shell32.lib
+set LIBS=user32.lib gdi32.lib dwmapi.lib ole32.lib uuid.lib winhttp.lib d3d11.lib dxgi.lib sapi.lib shell32.lib
 set LFLAGS=/SUBSYSTEM:WINDOWS /ENTRY:wWinMainCRTStartup /LTCG /OPT:REF /OPT:ICF /MANIFEST:EMBED
 
 link /nologo %LFLAGS% %OBJS% "%BUILD_DIR%\resources.res" %LIBS% /OUT:"%BUILD_DIR%\InvisibleOverlay.exe"
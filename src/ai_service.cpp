@@ -1,9 +1,53 @@
 #include "ai_service.h"
-#include <iomanip>
-#include <sstream>
+#include "base64.h"
+#include "json.h"
+#include "sse_parser.h"
 
 namespace invisible {
 
+namespace {
+
+// Groq API endpoints (OpenAI compatible)
+const wchar_t *const kChatEndpoint =
+    L"https://api.groq.com/openai/v1/chat/completions";
+const wchar_t *const kTranscriptionEndpoint =
+    L"https://api.groq.com/openai/v1/audio/transcriptions";
+
+// What to do with a screen capture when the caller gives no prompt
+const char *const kVisionPrompt =
+    "You are an expert assistant. Read the text/question in this image "
+    "and provide the DIRECT ANSWER. Do NOT describe or summarize what "
+    "you see. Just answer the question or solve the problem shown. "
+    "If it's a coding question, provide the code solution in c++ if no "
+    "language is specified. "
+    "If it's a multiple choice question, state the correct option and "
+    "explain why. "
+    "Be precise and helpful.";
+
+// The same for the text read off a capture (OCR may garble a character)
+const char *const kScreenTextPrompt =
+    "You are an expert assistant. The text below was read from the user's "
+    "screen by OCR, so a character here and there may be wrong. Provide "
+    "the DIRECT ANSWER to the question or problem it shows. Do NOT "
+    "describe or summarize it. "
+    "If it's a coding question, provide the code solution in c++ if no "
+    "language is specified. "
+    "If it's a multiple choice question, state the correct option and "
+    "explain why. "
+    "Be precise and helpful.";
+
+} // namespace
+
+// Encoded audio on its way to Whisper. The body borrows `audio` or `flac`,
+// so an async upload keeps the whole struct alive until it completes.
+struct OpenAIService::AudioUpload {
+  std::vector<BYTE> audio; // PCM owned by an async call
+  std::vector<BYTE> flac;
+  HttpBody file;
+  const char *fileName = "audio.wav";
+  const char *mimeType = "audio/wav";
+};
+
 // -----------------------------------------------------------------------------
 // Constructor / Destructor
 // -----------------------------------------------------------------------------
@@ -24,17 +68,29 @@ bool OpenAIService::Initialize(const AIServiceConfig &config) {
   }
 
   if (config.apiKey.empty()) {
-    lastError_ = "API key is required";
+    SetError("API key is required");
     return false;
   }
 
   config_ = config;
 
-  if (!httpClient_.Initialize()) {
-    lastError_ = "Failed to initialize HTTP client";
+  HttpClientConfig httpConfig;
+  httpConfig.http2 = config.http2;
+  if (!httpClient_.Initialize(httpConfig)) {
+    SetError("Failed to initialize HTTP client");
     return false;
   }
 
+  cache_.reset();
+  if (config.cacheResponses) {
+    ResponseCacheConfig cacheConfig;
+    cacheConfig.maxBytes = config.cacheMaxBytes;
+    cache_ = std::make_unique<ResponseCache>(cacheConfig);
+    if (!config.cachePath.empty()) {
+      cache_->Load(config.cachePath);
+    }
+  }
+
   initialized_ = true;
   OutputDebugStringW(L"[GroqService] Initialized successfully\n");
   return true;
@@ -43,6 +99,13 @@ bool OpenAIService::Initialize(const AIServiceConfig &config) {
 void OpenAIService::Shutdown() {
   std::lock_guard<std::mutex> lock(mutex_);
   httpClient_.Shutdown();
+
+  // No call is left to add answers now
+  if (initialized_ && cache_ && !config_.cachePath.empty()) {
+    if (!cache_->Save(config_.cachePath)) {
+      OutputDebugStringW(L"[GroqService] Could not save response cache\n");
+    }
+  }
   initialized_ = false;
 }
 
@@ -50,216 +113,293 @@ void OpenAIService::Shutdown() {
 // JSON Helpers
 // -----------------------------------------------------------------------------
 
-std::string OpenAIService::EscapeJson(const std::string &str) {
-  std::ostringstream escaped;
-  for (char c : str) {
-    switch (c) {
-    case '"':
-      escaped << "\\\"";
-      break;
-    case '\\':
-      escaped << "\\\\";
-      break;
-    case '\b':
-      escaped << "\\b";
-      break;
-    case '\f':
-      escaped << "\\f";
-      break;
-    case '\n':
-      escaped << "\\n";
-      break;
-    case '\r':
-      escaped << "\\r";
-      break;
-    case '\t':
-      escaped << "\\t";
-      break;
-    default:
-      if (static_cast<unsigned char>(c) < 0x20) {
-        escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0')
-                << (int)c;
-      } else {
-        escaped << c;
-      }
-    }
-  }
-  return escaped.str();
+// Error body shape shared by the chat, vision and Whisper endpoints:
+// {"error":{"message":"..."}}
+static std::string ParseErrorMessage(const std::string &response) {
+  std::string message;
+  JsonGetString(response, {"error", "message"}, message);
+  return message;
 }
 
-// Build Groq API payload (OpenAI compatible format)
-std::string
-OpenAIService::BuildChatPayload(const std::vector<ChatMessage> &messages) {
-  std::ostringstream json;
-  json << "{";
-  json << "\"model\":\"llama-3.3-70b-versatile\","; // Groq's best free model
-  json << "\"max_tokens\":" << config_.maxTokens << ",";
-  json << "\"temperature\":" << std::fixed << std::setprecision(1)
-       << config_.temperature << ",";
-  json << "\"messages\":[";
+// "HTTP 429: message" for an error response, or the transport's error
+// when no response came back
+static std::string DescribeHttpError(const HttpResponse &response) {
+  if (response.statusCode == 0 && !response.error.empty()) {
+    return WideToUtf8(response.error);
+  }
+  std::string error = "HTTP " + std::to_string(response.statusCode);
+  std::string apiMessage = ParseErrorMessage(response.body);
+  if (!apiMessage.empty()) {
+    error += ": " + apiMessage;
+  }
+  return error;
+}
 
-  for (size_t i = 0; i < messages.size(); ++i) {
-    if (i > 0)
-      json << ",";
-    json << "{\"role\":\"" << EscapeJson(messages[i].role) << "\",";
-    json << "\"content\":\"" << EscapeJson(messages[i].content) << "\"}";
+static std::string ParseChatResponse(const std::string &response,
+                                     std::string &error) {
+  // OpenAI/Groq response format: {"choices":[{"message":{"content":"..."}}]}
+  std::string content;
+  if (JsonGetString(response, {"choices", 0, "message", "content"}, content)) {
+    return content;
   }
 
-  json << "]}";
-  return json.str();
+  error = ParseErrorMessage(response);
+  if (error.empty())
+    error = "Failed to parse response";
+  return "";
 }
 
-std::string OpenAIService::ParseChatResponse(const std::string &response) {
-  // OpenAI/Groq response format: {"choices":[{"message":{"content":"..."}}]}
-  size_t contentPos = response.find("\"content\":");
-  if (contentPos == std::string::npos) {
-    // Check for error
-    size_t errorPos = response.find("\"error\":");
-    if (errorPos != std::string::npos) {
-      size_t msgPos = response.find("\"message\":", errorPos);
-      if (msgPos != std::string::npos) {
-        size_t start = response.find('"', msgPos + 10) + 1;
-        size_t end = response.find('"', start);
-        if (start != std::string::npos && end != std::string::npos) {
-          lastError_ = response.substr(start, end - start);
-          return "";
-        }
-      }
-    }
-    lastError_ = "Failed to parse response";
+// Answer text of a chat or vision call; `error` set on failure
+static std::string ChatResult(const HttpResponse &response, const char *api,
+                              std::string &error) {
+  if (!response.IsSuccess()) {
+    error = DescribeHttpError(response);
+    OutputDebugStringA(("[GroqService] " + std::string(api) +
+                        " error: " + response.body + "\n")
+                           .c_str());
     return "";
   }
+  return ParseChatResponse(response.body, error);
+}
 
-  // Find the content value
-  size_t start = response.find('"', contentPos + 10) + 1;
-  if (start == std::string::npos)
+// Transcribed text of a Whisper call; `error` set on failure
+static std::string TranscriptionResult(const HttpResponse &response,
+                                       std::string &error) {
+  if (!response.IsSuccess()) {
+    error = DescribeHttpError(response);
+    OutputDebugStringA(
+        ("[GroqService] Whisper API error: " + response.body + "\n").c_str());
     return "";
+  }
 
-  // Find end of content (handle escaped quotes)
-  std::string result;
-  bool escaped = false;
-  for (size_t i = start; i < response.length(); ++i) {
-    char c = response[i];
-    if (escaped) {
-      switch (c) {
-      case 'n':
-        result += '\n';
-        break;
-      case 'r':
-        result += '\r';
-        break;
-      case 't':
-        result += '\t';
-        break;
-      case '"':
-        result += '"';
-        break;
-      case '\\':
-        result += '\\';
-        break;
-      case '/':
-        result += '/';
-        break;
-      case 'u': {
-        // Handle \uXXXX unicode escapes (e.g. \u003c = '<', \u003e = '>')
-        if (i + 4 < response.length()) {
-          std::string hex = response.substr(i + 1, 4);
-          unsigned int codepoint = 0;
-          bool valid = true;
-          for (char h : hex) {
-            codepoint <<= 4;
-            if (h >= '0' && h <= '9')
-              codepoint |= (h - '0');
-            else if (h >= 'a' && h <= 'f')
-              codepoint |= (h - 'a' + 10);
-            else if (h >= 'A' && h <= 'F')
-              codepoint |= (h - 'A' + 10);
-            else {
-              valid = false;
-              break;
-            }
-          }
-          if (valid) {
-            if (codepoint < 0x80) {
-              result += (char)codepoint;
-            } else if (codepoint < 0x800) {
-              result += (char)(0xC0 | (codepoint >> 6));
-              result += (char)(0x80 | (codepoint & 0x3F));
-            } else {
-              result += (char)(0xE0 | (codepoint >> 12));
-              result += (char)(0x80 | ((codepoint >> 6) & 0x3F));
-              result += (char)(0x80 | (codepoint & 0x3F));
-            }
-            i += 4; // Skip the 4 hex digits
-          }
-        }
-        break;
-      }
-      default:
-        result += c;
+  // Groq supports Whisper! Looking for: {"text":"<text>"}
+  std::string text;
+  if (!JsonGetString(response.body, {"text"}, text)) {
+    error = "Failed to parse Whisper response";
+    return "";
+  }
+  return text;
+}
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Streaming Chat Reader
+// Turns the server-sent events of a streamed completion into the answer
+// text, passing each delta on as it arrives. Shared by ChatStream() and
+// ChatStreamAsync(); it must stay in place while the request runs.
+// -----------------------------------------------------------------------------
+
+class ChatStreamReader {
+public:
+  explicit ChatStreamReader(ChatDeltaCallback onDelta)
+      : onDelta_(std::move(onDelta)),
+        parser_([this](const SseEvent &event) { return OnEvent(event); }) {}
+
+  // Disable copy
+  ChatStreamReader(const ChatStreamReader &) = delete;
+  ChatStreamReader &operator=(const ChatStreamReader &) = delete;
+
+  // HttpChunkCallback for the response body
+  bool Feed(const char *data, size_t size) {
+    // A server that ignores "stream" answers with plain JSON; keep the
+    // start of the body until the first event proves it is SSE
+    if (parser_.GetEventCount() == 0 && plainBody_.size() < 65536)
+      plainBody_.append(data, size);
+    return parser_.Feed(data, size);
+  }
+
+  // The answer once the request is over: the full text, or what arrived
+  // before it was cancelled or cut off (with `error` set)
+  std::string Finish(const HttpResponse &response, std::string &error) {
+    if (!response.IsSuccess()) {
+      error = DescribeHttpError(response);
+      OutputDebugStringA(
+          ("[GroqService] API error: " + response.body + "\n").c_str());
+      return "";
+    }
+    if (cancelled_ || response.error == L"Cancelled") {
+      error = "Response cancelled";
+      return content_;
+    }
+    if (!streamError_.empty()) {
+      error = streamError_;
+      return content_;
+    }
+    if (!response.error.empty()) {
+      error = WideToUtf8(response.error);
+      return content_;
+    }
+    if (!done_ && parser_.GetEventCount() == 0) {
+      return ParseChatResponse(plainBody_, error);
+    }
+    return content_;
+  }
+
+private:
+  // Each event carries {"choices":[{"delta":{"content":"..."}}]}; the
+  // stream ends with "data: [DONE]"
+  bool OnEvent(const SseEvent &event) {
+    if (event.data == "[DONE]") {
+      done_ = true;
+      return false;
+    }
+    std::string delta;
+    if (JsonGetString(event.data, {"choices", 0, "delta", "content"},
+                      delta)) {
+      if (delta.empty())
+        return true;
+      content_ += delta;
+      if (onDelta_ && !onDelta_(delta, content_)) {
+        cancelled_ = true;
+        return false;
       }
-      escaped = false;
-    } else if (c == '\\') {
-      escaped = true;
-    } else if (c == '"') {
-      break;
-    } else {
-      result += c;
+      return true;
     }
+    streamError_ = ParseErrorMessage(event.data);
+    return streamError_.empty(); // Role-only or usage events carry no text
+  }
+
+  ChatDeltaCallback onDelta_;
+  SseParser parser_;
+  std::string content_;
+  std::string streamError_;
+  std::string plainBody_;
+  bool done_ = false;
+  bool cancelled_ = false;
+};
+
+} // namespace
+
+// Build Groq API payload (OpenAI compatible format)
+std::string
+OpenAIService::BuildChatPayload(const std::vector<ChatMessage> &messages,
+                                bool stream) {
+  size_t contentBytes = 0;
+  for (const auto &message : messages) {
+    contentBytes += message.role.size() + message.content.size() + 32;
   }
 
-  return result;
+  std::string payload;
+  payload.reserve(contentBytes + 128);
+
+  JsonWriter json(payload);
+  json.BeginObject();
+  json.Key("model");
+  json.String("llama-3.3-70b-versatile"); // Groq's best free model
+  json.Key("max_tokens");
+  json.Int(config_.maxTokens);
+  json.Key("temperature");
+  json.Double(config_.temperature, 2);
+  if (stream) {
+    json.Key("stream");
+    json.Bool(true);
+  }
+  json.Key("messages");
+  json.BeginArray();
+  for (const auto &message : messages) {
+    json.BeginObject();
+    json.Key("role");
+    json.String(message.role);
+    json.Key("content");
+    json.String(message.content);
+    json.EndObject();
+  }
+  json.EndArray();
+  json.EndObject();
+  return payload;
 }
 
-std::string OpenAIService::ParseWhisperResponse(const std::string &response) {
-  // Groq supports Whisper! Looking for: "text":"<text>"
-  size_t textPos = response.find("\"text\":");
-  if (textPos == std::string::npos) {
-    lastError_ = "Failed to parse Whisper response";
-    return "";
+std::map<std::wstring, std::wstring>
+OpenAIService::BuildHeaders(bool json) const {
+  std::map<std::wstring, std::wstring> headers;
+  headers[L"Authorization"] =
+      L"Bearer " + std::wstring(config_.apiKey.begin(), config_.apiKey.end());
+  if (json) {
+    headers[L"Content-Type"] = L"application/json";
   }
+  return headers;
+}
 
-  size_t start = response.find('"', textPos + 7) + 1;
-  size_t end = response.find('"', start);
+void OpenAIService::ChatCacheKeys(const std::vector<ChatMessage> &messages,
+                                  ResponseCacheKey &key,
+                                  ResponseCacheKey &loose) {
+  key = ResponseCache::MakeKey(BuildChatPayload(messages));
+  loose = ResponseCacheKey();
 
-  if (start == std::string::npos || end == std::string::npos) {
-    return "";
+  // The question is the last user message
+  size_t question = messages.size();
+  while (question > 0 && messages[question - 1].role != "user") {
+    --question;
+  }
+  if (question == 0) {
+    return;
   }
 
-  // Handle escaped characters
-  std::string result;
-  bool escaped = false;
-  for (size_t i = start; i < end; ++i) {
-    char c = response[i];
-    if (escaped) {
-      switch (c) {
-      case 'n':
-        result += '\n';
-        break;
-      case 'r':
-        result += '\r';
-        break;
-      case 't':
-        result += '\t';
-        break;
-      case '"':
-        result += '"';
-        break;
-      case '\\':
-        result += '\\';
-        break;
-      default:
-        result += c;
-      }
-      escaped = false;
-    } else if (c == '\\') {
-      escaped = true;
-    } else {
-      result += c;
+  // The system messages (prompt, summary, transcript) and the question,
+  // normalized. Earlier exchanges are left out: every answer, a cached one
+  // too, joins the conversation history, so with them in the key the same
+  // question asked twice would never match.
+  std::vector<ChatMessage> asked;
+  for (size_t i = 0; i + 1 < question; ++i) {
+    if (messages[i].role == "system") {
+      asked.push_back(messages[i]);
     }
   }
+  asked.push_back(messages[question - 1]);
+  if (config_.cacheNormalizeQuestions) {
+    asked.back().content =
+        ResponseCache::NormalizeQuestion(asked.back().content);
+  }
+  loose = ResponseCache::MakeKey(BuildChatPayload(asked));
+  if (loose == key) {
+    loose = ResponseCacheKey(); // Nothing left out, nothing normalized
+  }
+}
 
-  return result;
+void OpenAIService::CacheAnswer(const ResponseCacheKey &key,
+                                const ResponseCacheKey &loose,
+                                const std::string &content,
+                                const std::string &error,
+                                std::chrono::steady_clock::time_point started) {
+  // Cut-short streams and failures are not answers
+  if (!cache_ || key.IsEmpty() || !error.empty() || content.empty()) {
+    return;
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started);
+  cache_->Insert(key, loose, content, static_cast<uint32_t>(elapsed.count()));
+}
+
+HttpAsyncOptions OpenAIService::AsyncOptions(HttpPriority priority) const {
+  HttpAsyncOptions options;
+  options.priority = priority;
+  options.timeoutMs = config_.requestTimeoutMs;
+  options.retry.maxAttempts = config_.maxAttempts;
+  if (priority == HttpPriority::High) {
+    options.retry.hedgeAfterMs = config_.chatHedgeAfterMs; // Chat only
+  }
+  return options;
+}
+
+std::string
+OpenAIService::Await(const std::function<void(AICompletion)> &start) {
+  std::promise<std::string> promise;
+  std::future<std::string> result = promise.get_future();
+  start([&promise](const std::string &text, const std::string &) {
+    promise.set_value(text);
+  });
+  return result.get();
+}
+
+void OpenAIService::Report(const AICompletion &done, const std::string &text,
+                           const std::string &error) {
+  if (!error.empty()) {
+    SetError(error);
+  }
+  if (done) {
+    done(text, error);
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -285,41 +425,109 @@ std::string OpenAIService::Query(const std::string &userMessage,
 }
 
 std::string OpenAIService::Chat(const std::vector<ChatMessage> &messages) {
-  if (!initialized_) {
-    lastError_ = "Service not initialized";
-    return "";
+  return Await([&](AICompletion done) { ChatAsync(messages, std::move(done)); });
+}
+
+std::string OpenAIService::ChatStream(const std::vector<ChatMessage> &messages,
+                                      const ChatDeltaCallback &onDelta) {
+  return Await([&](AICompletion done) {
+    ChatStreamAsync(messages, onDelta, std::move(done));
+  });
+}
+
+// -----------------------------------------------------------------------------
+// Chat / Query (asynchronous)
+// -----------------------------------------------------------------------------
+
+void OpenAIService::QueryAsync(const std::string &userMessage,
+                               const std::string &context, AICompletion done) {
+  std::vector<ChatMessage> messages;
+  messages.push_back({"system", config_.systemPrompt});
+  if (!context.empty()) {
+    messages.push_back({"system", "Meeting context: " + context});
   }
+  messages.push_back({"user", userMessage});
 
-  std::string payload = BuildChatPayload(messages);
+  ChatAsync(messages, std::move(done));
+}
 
-  // Groq API endpoint (OpenAI compatible)
-  std::wstring endpoint = L"https://api.groq.com/openai/v1/chat/completions";
+void OpenAIService::ChatAsync(const std::vector<ChatMessage> &messages,
+                              AICompletion done, HttpPriority priority,
+                              ChatCaching caching) {
+  if (!initialized_) {
+    Report(done, "", "Service not initialized");
+    return;
+  }
 
-  std::map<std::wstring, std::wstring> headers;
-  headers[L"Authorization"] =
-      L"Bearer " + std::wstring(config_.apiKey.begin(), config_.apiKey.end());
-  headers[L"Content-Type"] = L"application/json";
+  // Without keys the answer is neither looked up nor stored
+  ResponseCacheKey key, loose;
+  if (cache_ && caching != ChatCaching::Off) {
+    std::string cached;
+    if (caching == ChatCaching::Loose) {
+      ChatCacheKeys(messages, key, loose);
+    } else {
+      key = ResponseCache::MakeKey(BuildChatPayload(messages));
+    }
+    if (cache_->Lookup(key, loose, cached)) {
+      Report(done, cached, "");
+      return;
+    }
+  }
 
-  HttpResponse response = httpClient_.PostJson(endpoint, payload, headers);
+  httpClient_.PostJsonAsync(
+      kChatEndpoint, BuildChatPayload(messages), BuildHeaders(true),
+      AsyncOptions(priority),
+      [this, key, loose, started = std::chrono::steady_clock::now(),
+       done = std::move(done)](HttpResponse response) {
+        std::string error;
+        std::string content = ChatResult(response, "API", error);
+        CacheAnswer(key, loose, content, error, started);
+        Report(done, content, error);
+      });
+}
 
-  if (!response.IsSuccess()) {
-    // Parse the error message
-    std::string errorMsg = "HTTP " + std::to_string(response.statusCode);
-    size_t msgPos = response.body.find("\"message\":");
-    if (msgPos != std::string::npos) {
-      size_t start = response.body.find('"', msgPos + 10) + 1;
-      size_t end = response.body.find('"', start);
-      if (start != std::string::npos && end != std::string::npos) {
-        errorMsg += ": " + response.body.substr(start, end - start);
+void OpenAIService::ChatStreamAsync(const std::vector<ChatMessage> &messages,
+                                    ChatDeltaCallback onDelta,
+                                    AICompletion done,
+                                    std::shared_ptr<CancellationToken> cancel) {
+  if (!initialized_) {
+    Report(done, "", "Service not initialized");
+    return;
+  }
+
+  // A remembered answer arrives as a single delta
+  ResponseCacheKey key, loose;
+  if (cache_) {
+    std::string cached;
+    ChatCacheKeys(messages, key, loose);
+    if (cache_->Lookup(key, loose, cached)) {
+      if (onDelta) {
+        onDelta(cached, cached);
       }
+      Report(done, cached, "");
+      return;
     }
-    lastError_ = errorMsg;
-    OutputDebugStringA(
-        ("[GroqService] API error: " + response.body + "\n").c_str());
-    return "";
   }
 
-  return ParseChatResponse(response.body);
+  std::map<std::wstring, std::wstring> headers = BuildHeaders(true);
+  headers[L"Accept"] = L"text/event-stream";
+
+  auto reader = std::make_shared<ChatStreamReader>(std::move(onDelta));
+  HttpAsyncOptions options = AsyncOptions(HttpPriority::High);
+  options.cancel = std::move(cancel);
+  options.onChunk = [reader](const char *data, size_t size) {
+    return reader->Feed(data, size);
+  };
+
+  httpClient_.PostJsonAsync(
+      kChatEndpoint, BuildChatPayload(messages, true), headers, options,
+      [this, reader, key, loose, started = std::chrono::steady_clock::now(),
+       done = std::move(done)](HttpResponse response) {
+        std::string error;
+        std::string content = reader->Finish(response, error);
+        CacheAnswer(key, loose, content, error, started);
+        Report(done, content, error);
+      });
 }
 
 // -----------------------------------------------------------------------------
@@ -341,6 +549,24 @@ std::string OpenAIService::ExtractActionItems(const std::string &transcript) {
       transcript);
 }
 
+void OpenAIService::SummarizeAsync(const std::string &transcript,
+                                   AICompletion done) {
+  QueryAsync("Please provide a concise summary of this meeting transcript. "
+             "Include key discussion points and any decisions made. "
+             "Format as bullet points.\n\nTranscript:\n" +
+                 transcript,
+             "", std::move(done));
+}
+
+void OpenAIService::ExtractActionItemsAsync(const std::string &transcript,
+                                            AICompletion done) {
+  QueryAsync("Extract all action items from this meeting transcript. "
+             "For each action item, identify who is responsible if mentioned. "
+             "Format as a numbered list.\n\nTranscript:\n" +
+                 transcript,
+             "", std::move(done));
+}
+
 std::string OpenAIService::AnswerQuestion(const std::string &question,
                                           const std::string &transcript) {
   // Build a targeted prompt that makes it clear we want an ANSWER
@@ -359,10 +585,9 @@ std::string OpenAIService::AnswerQuestion(const std::string &question,
 // Speech-to-Text
 // -----------------------------------------------------------------------------
 
-std::vector<BYTE> OpenAIService::ConvertToWav(const std::vector<BYTE> &pcmData,
-                                              UINT32 sampleRate,
-                                              UINT16 channels,
-                                              UINT16 bitsPerSample) {
+std::string OpenAIService::BuildWavHeader(size_t dataSize, UINT32 sampleRate,
+                                          UINT16 channels,
+                                          UINT16 bitsPerSample) {
   // WAV file header
   struct WavHeader {
     char riff[4] = {'R', 'I', 'F', 'F'};
@@ -386,51 +611,75 @@ std::vector<BYTE> OpenAIService::ConvertToWav(const std::vector<BYTE> &pcmData,
   header.bitsPerSample = bitsPerSample;
   header.blockAlign = channels * bitsPerSample / 8;
   header.byteRate = sampleRate * header.blockAlign;
-  header.dataSize = (UINT32)pcmData.size();
+  header.dataSize = (UINT32)dataSize;
   header.fileSize = sizeof(WavHeader) - 8 + header.dataSize;
 
-  std::vector<BYTE> wavData;
-  wavData.reserve(sizeof(WavHeader) + pcmData.size());
+  return std::string(reinterpret_cast<const char *>(&header), sizeof(header));
+}
 
-  const BYTE *headerBytes = reinterpret_cast<const BYTE *>(&header);
-  wavData.insert(wavData.end(), headerBytes, headerBytes + sizeof(WavHeader));
-  wavData.insert(wavData.end(), pcmData.begin(), pcmData.end());
+bool OpenAIService::PrepareAudio(const std::vector<BYTE> &audioData,
+                                 UINT32 sampleRate, UINT16 channels,
+                                 UINT16 bitsPerSample, AudioUpload &upload) {
+  // 16-bit PCM goes up as lossless FLAC; the upload dominates latency on
+  // slow links. Anything else (or an encoder refusal) falls back to WAV.
+  size_t frameBytes = (size_t)channels * sizeof(INT16);
+  if (config_.compressAudio && bitsPerSample == 16 && frameBytes > 0 &&
+      audioData.size() >= frameBytes) {
+    if (flacEncoder_.EncodePcm16(
+            reinterpret_cast<const int16_t *>(audioData.data()),
+            audioData.size() / frameBytes, sampleRate, channels,
+            upload.flac)) {
+      upload.file.Append(upload.flac.data(), upload.flac.size());
+      upload.fileName = "audio.flac";
+      upload.mimeType = "audio/flac";
+      return true;
+    }
+  }
 
-  return wavData;
+  // WAV: a 44-byte header, then the PCM sent straight from the caller's
+  // buffer (no joined copy)
+  if (audioData.empty()) {
+    return false;
+  }
+  upload.file.Append(
+      BuildWavHeader(audioData.size(), sampleRate, channels, bitsPerSample));
+  upload.file.Append(audioData.data(), audioData.size());
+  return true;
 }
 
 std::string OpenAIService::Transcribe(const std::vector<BYTE> &audioData,
                                       UINT32 sampleRate, UINT16 channels,
                                       UINT16 bitsPerSample) {
   if (!initialized_) {
-    lastError_ = "Service not initialized";
+    SetError("Service not initialized");
     return "";
   }
 
-  // Convert PCM to WAV
-  std::vector<BYTE> wavData =
-      ConvertToWav(audioData, sampleRate, channels, bitsPerSample);
-  return TranscribeWav(wavData);
+  // Borrows the caller's PCM: Await() returns only after the call is over
+  auto upload = std::make_shared<AudioUpload>();
+  if (!PrepareAudio(audioData, sampleRate, channels, bitsPerSample,
+                    *upload)) {
+    return "";
+  }
+  return Await([&](AICompletion done) {
+    PostTranscriptionAsync(upload, std::move(done));
+  });
 }
 
 std::string OpenAIService::TranscribeWav(const std::vector<BYTE> &wavData) {
   if (!initialized_) {
-    lastError_ = "Service not initialized";
+    SetError("Service not initialized");
     return "";
   }
 
-  if (wavData.empty()) {
-    return "";
-  }
-
-  // Groq Whisper API endpoint
-  std::wstring endpoint =
-      L"https://api.groq.com/openai/v1/audio/transcriptions";
-
-  std::map<std::wstring, std::wstring> headers;
-  headers[L"Authorization"] =
-      L"Bearer " + std::wstring(config_.apiKey.begin(), config_.apiKey.end());
+  auto upload = std::make_shared<AudioUpload>();
+  upload->file.Append(wavData.data(), wavData.size());
+  return Await([&](AICompletion done) {
+    PostTranscriptionAsync(upload, std::move(done));
+  });
+}
 
+std::map<std::string, std::string> OpenAIService::TranscriptionFields() {
   std::map<std::string, std::string> fields;
   fields["model"] = "whisper-large-v3-turbo"; // Faster + accurate
   fields["response_format"] = "json";
@@ -438,95 +687,185 @@ std::string OpenAIService::TranscribeWav(const std::vector<BYTE> &wavData) {
   fields["prompt"] =
       "This is a technical interview or meeting discussion. "
       "Transcribe clearly with proper punctuation and formatting.";
+  return fields;
+}
 
-  HttpResponse response = httpClient_.PostMultipart(
-      endpoint, fields, "audio.wav", "file", wavData, "audio/wav", headers);
+void OpenAIService::TranscribeAsync(std::vector<BYTE> audioData,
+                                    UINT32 sampleRate, UINT16 channels,
+                                    UINT16 bitsPerSample, AICompletion done) {
+  if (!initialized_) {
+    Report(done, "", "Service not initialized");
+    return;
+  }
 
-  if (!response.IsSuccess()) {
-    lastError_ = "HTTP error: " + std::to_string(response.statusCode);
-    OutputDebugStringA(
-        ("[GroqService] Whisper API error: " + response.body + "\n").c_str());
-    return "";
+  // The call owns the PCM and the encoded file until it completes
+  auto upload = std::make_shared<AudioUpload>();
+  upload->audio = std::move(audioData);
+  if (!PrepareAudio(upload->audio, sampleRate, channels, bitsPerSample,
+                    *upload)) {
+    Report(done, "", "");
+    return;
+  }
+  PostTranscriptionAsync(std::move(upload), std::move(done));
+}
+
+void OpenAIService::PostTranscriptionAsync(
+    std::shared_ptr<AudioUpload> upload, AICompletion done) {
+  if (upload->file.Empty()) {
+    Report(done, "", "");
+    return;
   }
 
-  return ParseWhisperResponse(response.body);
+  httpClient_.PostMultipartAsync(
+      kTranscriptionEndpoint, TranscriptionFields(), upload->fileName, "file",
+      std::move(upload->file), upload->mimeType, BuildHeaders(false),
+      AsyncOptions(HttpPriority::Normal),
+      [this, upload, done = std::move(done)](HttpResponse response) {
+        std::string error;
+        std::string text = TranscriptionResult(response, error);
+        Report(done, text, error);
+      });
 }
 
 // -----------------------------------------------------------------------------
 // Vision - Analyze Image with AI
 // -----------------------------------------------------------------------------
 
-std::string OpenAIService::AnalyzeImage(const std::string &base64ImageData,
+std::string
+OpenAIService::BuildVisionPayload(const std::vector<BYTE> &jpegData,
+                                  const std::string &prompt) {
+  std::string userPrompt = prompt.empty() ? kVisionPrompt : prompt;
+
+  // Base64-encode the image straight into the payload buffer
+  std::string payload;
+  payload.reserve(userPrompt.size() + Base64EncodedLength(jpegData.size()) +
+                  256);
+
+  JsonWriter json(payload);
+  json.BeginObject();
+  json.Key("model");
+  json.String("meta-llama/llama-4-scout-17b-16e-instruct");
+  json.Key("max_tokens");
+  json.Int(2048);
+  json.Key("temperature");
+  json.Double(0.3);
+  json.Key("messages");
+  json.BeginArray();
+  json.BeginObject();
+  json.Key("role");
+  json.String("user");
+  json.Key("content");
+  json.BeginArray();
+  json.BeginObject();
+  json.Key("type");
+  json.String("text");
+  json.Key("text");
+  json.String(userPrompt);
+  json.EndObject();
+  json.BeginObject();
+  json.Key("type");
+  json.String("image_url");
+  json.Key("image_url");
+  json.BeginObject();
+  json.Key("url");
+  json.BeginRawString();
+  payload += "data:image/jpeg;base64,";
+  Base64EncodeAppend(jpegData.data(), jpegData.size(), payload);
+  json.EndRawString();
+  json.EndObject();
+  json.EndObject();
+  json.EndArray();
+  json.EndObject();
+  json.EndArray();
+  json.EndObject();
+  return payload;
+}
+
+std::string OpenAIService::AnalyzeImage(const std::vector<BYTE> &jpegData,
                                         const std::string &prompt) {
   if (!initialized_) {
-    lastError_ = "Service not initialized";
+    SetError("Service not initialized");
     return "";
   }
 
-  if (base64ImageData.empty()) {
-    lastError_ = "No image data provided";
+  if (jpegData.empty()) {
+    SetError("No image data provided");
     return "";
   }
 
-  // Build vision payload with image
-  std::string userPrompt =
-      prompt.empty()
-          ? "You are an expert assistant. Read the text/question in this image "
-            "and provide the DIRECT ANSWER. Do NOT describe or summarize what "
-            "you see. Just answer the question or solve the problem shown. "
-            "If it's a coding question, provide the code solution in c++ if no "
-            "language is specified. "
-            "If it's a multiple choice question, state the correct option and "
-            "explain why. "
-            "Be precise and helpful."
-          : prompt;
-
-  std::ostringstream json;
-  json << "{";
-  json << "\"model\":\"meta-llama/llama-4-scout-17b-16e-instruct\",";
-  json << "\"max_tokens\":2048,";
-  json << "\"temperature\":0.3,";
-  json << "\"messages\":[";
-  json << "{\"role\":\"user\",\"content\":[";
-  json << "{\"type\":\"text\",\"text\":\"" << EscapeJson(userPrompt) << "\"},";
-  json << "{\"type\":\"image_url\",\"image_url\":{";
-  json << "\"url\":\"data:image/jpeg;base64," << base64ImageData << "\"";
-  json << "}}";
-  json << "]}";
-  json << "]}";
-
-  std::string payload = json.str();
-
-  // Groq API endpoint
-  std::wstring endpoint = L"https://api.groq.com/openai/v1/chat/completions";
+  std::string payload = BuildVisionPayload(jpegData, prompt);
+  return Await([&](AICompletion done) {
+    PostVisionAsync(std::move(payload), std::move(done));
+  });
+}
 
-  std::map<std::wstring, std::wstring> headers;
-  headers[L"Authorization"] =
-      L"Bearer " + std::wstring(config_.apiKey.begin(), config_.apiKey.end());
-  headers[L"Content-Type"] = L"application/json";
+void OpenAIService::AnalyzeImageAsync(std::vector<BYTE> jpegData,
+                                      const std::string &prompt,
+                                      AICompletion done) {
+  if (!initialized_) {
+    Report(done, "", "Service not initialized");
+    return;
+  }
 
-  OutputDebugStringA("[GroqService] Sending image to vision API...\n");
+  if (jpegData.empty()) {
+    Report(done, "", "No image data provided");
+    return;
+  }
 
-  HttpResponse response = httpClient_.PostJson(endpoint, payload, headers);
+  // The image is base64-copied into the payload; the JPEG can go now
+  std::string payload = BuildVisionPayload(jpegData, prompt);
+  jpegData.clear();
+  jpegData.shrink_to_fit();
+  PostVisionAsync(std::move(payload), std::move(done));
+}
 
-  if (!response.IsSuccess()) {
-    std::string errorMsg = "HTTP " + std::to_string(response.statusCode);
-    size_t msgPos = response.body.find("\"message\":");
-    if (msgPos != std::string::npos) {
-      size_t start = response.body.find('"', msgPos + 10) + 1;
-      size_t end = response.body.find('"', start);
-      if (start != std::string::npos && end != std::string::npos) {
-        errorMsg += ": " + response.body.substr(start, end - start);
-      }
+void OpenAIService::AnalyzeScreenTextAsync(const std::string &screenText,
+                                           const std::string &prompt,
+                                           AICompletion done) {
+  if (screenText.empty()) {
+    Report(done, "", "No screen text provided");
+    return;
+  }
+
+  std::string userPrompt = prompt.empty() ? kScreenTextPrompt : prompt;
+  userPrompt += "\n\nScreen text:\n```\n";
+  userPrompt += screenText;
+  userPrompt += "\n```";
+
+  // As with the image, only an exact match will do: the normalized
+  // question drops case and indentation, which carry meaning in code
+  std::vector<ChatMessage> messages;
+  messages.push_back({"user", std::move(userPrompt)});
+  ChatAsync(messages, std::move(done), HttpPriority::High, ChatCaching::Exact);
+}
+
+void OpenAIService::PostVisionAsync(std::string payload, AICompletion done) {
+  // The same image and prompt: only an exact match will do
+  ResponseCacheKey key;
+  if (cache_) {
+    std::string cached;
+    key = ResponseCache::MakeKey(payload);
+    if (cache_->Lookup(key, ResponseCacheKey(), cached)) {
+      Report(done, cached, "");
+      return;
     }
-    lastError_ = errorMsg;
-    OutputDebugStringA(
-        ("[GroqService] Vision API error: " + response.body + "\n").c_str());
-    return "";
   }
 
-  OutputDebugStringA("[GroqService] Vision response received\n");
-  return ParseChatResponse(response.body);
+  OutputDebugStringA("[GroqService] Sending image to vision API...\n");
+
+  httpClient_.PostJsonAsync(
+      kChatEndpoint, std::move(payload), BuildHeaders(true),
+      AsyncOptions(HttpPriority::Low),
+      [this, key, started = std::chrono::steady_clock::now(),
+       done = std::move(done)](HttpResponse response) {
+        std::string error;
+        std::string content = ChatResult(response, "Vision API", error);
+        if (error.empty()) {
+          OutputDebugStringA("[GroqService] Vision response received\n");
+        }
+        CacheAnswer(key, ResponseCacheKey(), content, error, started);
+        Report(done, content, error);
+      });
 }
 
 } // namespace invisible
@@ -1,8 +1,15 @@
 #pragma once
 
+#include "flac_encoder.h"
 #include "http_client.h"
+#include "response_cache.h"
 #include "utils.h"
+#include <chrono>
+#include <filesystem>
 #include <functional>
+#include <future>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -20,6 +27,36 @@ struct AIServiceConfig {
   int maxTokens = 1024;
   float temperature = 0.7f;
 
+  // Upload 16-bit speech as lossless FLAC (about half the bytes of WAV)
+  bool compressAudio = true;
+
+  // Ask for HTTP/2 (off by default). On Windows WinHTTP negotiates it and
+  // only passes each call's priority to the server as a hint. The transport
+  // that orders request frames by priority is POSIX-only and runs in the
+  // Linux tests, never in the shipped app.
+  bool http2 = false;
+
+  // Deadline for each call, time queued and retries included (0 = none)
+  uint32_t requestTimeoutMs = 120000;
+
+  // Attempts per call: 429/5xx answers and dropped connections are retried
+  // with jittered backoff, or after the server's Retry-After
+  uint32_t maxAttempts = 3;
+
+  // Race a duplicate chat request against one that has not started to
+  // answer after this long (0 = off; a hedge that fires costs tokens)
+  uint32_t chatHedgeAfterMs = 0;
+
+  // Answer a chat or vision request that was already made from memory
+  // instead of the API. A question matches one asked before over the same
+  // prompt and transcript whatever was asked in between (the conversation
+  // history is not part of its key), and with cacheNormalizeQuestions one
+  // that differs only in case, spacing or closing "?!." does too.
+  bool cacheResponses = true;
+  size_t cacheMaxBytes = 4 * 1024 * 1024;
+  bool cacheNormalizeQuestions = true;
+  std::filesystem::path cachePath; // Kept between runs if set
+
   // System prompt for meeting assistant behavior
   std::string systemPrompt =
       "You are an expert interview and meeting assistant. When given a "
@@ -42,6 +79,24 @@ struct ChatMessage {
   std::string content;
 };
 
+// Streaming chat: called with each new piece of the answer and the text so
+// far. Return false to cancel the request.
+using ChatDeltaCallback =
+    std::function<bool(const std::string &delta, const std::string &content)>;
+
+// Result of an asynchronous call: the text (empty on failure, or what
+// arrived before a stream was cut short) and, if something went wrong,
+// the error. Runs on one of the HTTP client's event loop threads, or on the
+// calling thread when the answer comes from the response cache.
+using AICompletion =
+    std::function<void(const std::string &text, const std::string &error)>;
+
+// How a chat request uses the response cache: answered from an exact match
+// or the same question asked before (Loose), from an exact match only
+// (Exact), or not looked up or stored at all (Off: one-off prompts, such as
+// background summary folds, that would only push real answers out)
+enum class ChatCaching { Loose, Exact, Off };
+
 // -----------------------------------------------------------------------------
 // AI Service Interface
 // -----------------------------------------------------------------------------
@@ -116,35 +171,124 @@ public:
                          UINT16 channels, UINT16 bitsPerSample) override;
   std::string TranscribeWav(const std::vector<BYTE> &wavData) override;
 
-  // Vision - analyze image with AI
-  std::string AnalyzeImage(const std::string &base64ImageData,
+  // Chat with the answer streamed token by token (server-sent events).
+  // Returns the full text, or what arrived before cancellation.
+  std::string ChatStream(const std::vector<ChatMessage> &messages,
+                         const ChatDeltaCallback &onDelta);
+
+  // Vision - analyze a JPEG image with AI
+  std::string AnalyzeImage(const std::vector<BYTE> &jpegData,
                            const std::string &prompt = "");
 
-  // Get last error message
-  std::string GetLastError() const { return lastError_; }
+  // Asynchronous variants: they return at once and report through `done`,
+  // so no thread waits on the network. Input is copied or moved into the
+  // call; `cancel` stops a streaming answer wherever it is. Background
+  // chats pass a lower `priority` so they never hold up a question.
+  void ChatAsync(const std::vector<ChatMessage> &messages, AICompletion done,
+                 HttpPriority priority = HttpPriority::High,
+                 ChatCaching caching = ChatCaching::Loose);
+  void QueryAsync(const std::string &userMessage, const std::string &context,
+                  AICompletion done);
+  void SummarizeAsync(const std::string &transcript, AICompletion done);
+  void ExtractActionItemsAsync(const std::string &transcript,
+                               AICompletion done);
+  void ChatStreamAsync(const std::vector<ChatMessage> &messages,
+                       ChatDeltaCallback onDelta, AICompletion done,
+                       std::shared_ptr<CancellationToken> cancel = nullptr);
+  void TranscribeAsync(std::vector<BYTE> audioData, UINT32 sampleRate,
+                       UINT16 channels, UINT16 bitsPerSample,
+                       AICompletion done);
+  void AnalyzeImageAsync(std::vector<BYTE> jpegData, const std::string &prompt,
+                         AICompletion done);
+
+  // Answer from the text of a screen capture read on-device instead of
+  // the image: a chat prompt a fraction of the size, on the chat model
+  void AnalyzeScreenTextAsync(const std::string &screenText,
+                              const std::string &prompt, AICompletion done);
+
+  // Retry and hedging counters of every call so far
+  HttpRetryStats GetRetryStats() const { return httpClient_.GetRetryStats(); }
+
+  // Response cache hits and time saved (all zero if caching is off)
+  ResponseCacheStats GetCacheStats() const {
+    return cache_ ? cache_->GetStats() : ResponseCacheStats();
+  }
+
+  // Get last error message (requests may run on several threads at once)
+  std::string GetLastError() const {
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    return lastError_;
+  }
 
 private:
+  struct AudioUpload;
+
   // Build JSON payload for chat completions
-  std::string BuildChatPayload(const std::vector<ChatMessage> &messages);
+  std::string BuildChatPayload(const std::vector<ChatMessage> &messages,
+                               bool stream = false);
 
-  // Parse response from chat completions
-  std::string ParseChatResponse(const std::string &response);
+  // Build JSON payload for the vision model (image inlined as base64)
+  std::string BuildVisionPayload(const std::vector<BYTE> &jpegData,
+                                 const std::string &prompt);
 
-  // Parse response from Whisper API
-  std::string ParseWhisperResponse(const std::string &response);
+  // Cache keys of a chat request: the exact one, and a loose one of its
+  // system messages and question (normalized) without the earlier
+  // exchanges. The streaming flag is left out of both: either way gives
+  // the same answer.
+  void ChatCacheKeys(const std::vector<ChatMessage> &messages,
+                     ResponseCacheKey &key, ResponseCacheKey &loose);
 
-  // Convert PCM to WAV format
-  std::vector<BYTE> ConvertToWav(const std::vector<BYTE> &pcmData,
-                                 UINT32 sampleRate, UINT16 channels,
-                                 UINT16 bitsPerSample);
+  // Remember a successful answer along with how long it took
+  void CacheAnswer(const ResponseCacheKey &key, const ResponseCacheKey &loose,
+                   const std::string &content, const std::string &error,
+                   std::chrono::steady_clock::time_point started);
+
+  // Authorization (and JSON content type) for every API call
+  std::map<std::wstring, std::wstring> BuildHeaders(bool json) const;
+
+  // WAV header for `dataSize` bytes of PCM (sent ahead of the samples)
+  static std::string BuildWavHeader(size_t dataSize, UINT32 sampleRate,
+                                    UINT16 channels, UINT16 bitsPerSample);
+
+  // Encode PCM as FLAC (or wrap it as WAV) into an upload body that
+  // borrows `audioData`; false if there is nothing to send
+  bool PrepareAudio(const std::vector<BYTE> &audioData, UINT32 sampleRate,
+                    UINT16 channels, UINT16 bitsPerSample,
+                    AudioUpload &upload);
+
+  // Whisper form fields
+  static std::map<std::string, std::string> TranscriptionFields();
+
+  // Upload an encoded audio file to the Whisper endpoint
+  void PostTranscriptionAsync(std::shared_ptr<AudioUpload> upload,
+                              AICompletion done);
+
+  // Send a vision payload to the chat endpoint
+  void PostVisionAsync(std::string payload, AICompletion done);
+
+  // Options for an async call (deadline, retries, chat hedging)
+  HttpAsyncOptions AsyncOptions(HttpPriority priority) const;
+
+  // Start an async call and wait for its text: the synchronous API. Not
+  // from a completion, where it would hold one of the loop's workers.
+  static std::string Await(const std::function<void(AICompletion)> &start);
+
+  // Record a failed call's error (if any) and hand the result to `done`
+  void Report(const AICompletion &done, const std::string &text,
+              const std::string &error);
 
-  // Simple JSON string escaping
-  std::string EscapeJson(const std::string &str);
+  void SetError(const std::string &error) {
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    lastError_ = error;
+  }
 
   HttpClient httpClient_;
+  FlacEncoder flacEncoder_;
+  std::unique_ptr<ResponseCache> cache_; // Null when caching is off
   AIServiceConfig config_;
   bool initialized_ = false;
   std::string lastError_;
+  mutable std::mutex errorMutex_;
   std::mutex mutex_;
 
   // API endpoints
@@ -307,14 +307,14 @@ void AudioCapture::ProcessAudioPacket() {
         if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
             // The audio engine reports this as silence
             // We can either skip it or send zeros
-            std::vector<BYTE> silenceBuffer(bufferSize, 0);
-            AudioBuffer buffer(silenceBuffer.data(), bufferSize, framesAvailable, qpcPosition);
-            handler_->OnAudioData(buffer, format_);
+            packet_.data.assign(bufferSize, 0);
         } else {
             // Normal audio data
-            AudioBuffer buffer(data, bufferSize, framesAvailable, qpcPosition);
-            handler_->OnAudioData(buffer, format_);
+            packet_.data.assign(data, data + bufferSize);
         }
+        packet_.frames = framesAvailable;
+        packet_.timestamp = qpcPosition;
+        handler_->OnAudioData(packet_, format_);
     }
     
     // Release the buffer
@@ -384,61 +384,43 @@ std::vector<std::pair<std::wstring, std::wstring>> AudioCapture::EnumerateOutput
 // AudioBufferQueue Implementation
 // -----------------------------------------------------------------------------
 
-AudioBufferQueue::AudioBufferQueue(size_t maxBuffers)
-    : maxBuffers_(maxBuffers) {}
+static AudioRingConfig MakeRingConfig(size_t slabCount, size_t slabBytes) {
+    AudioRingConfig config;
+    config.slabCount = slabCount;
+    config.slabBytes = slabBytes;
+    return config;
+}
+
+AudioBufferQueue::AudioBufferQueue(size_t maxBuffers, size_t slabBytes)
+    : ring_(MakeRingConfig(maxBuffers, slabBytes)) {}
 
 AudioBufferQueue::~AudioBufferQueue() = default;
 
 void AudioBufferQueue::OnAudioData(const AudioBuffer& buffer, const AudioFormat& format) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    format_ = format;
-    
-    // Drop old buffers if queue is full
-    while (buffers_.size() >= maxBuffers_) {
-        buffers_.pop();
-    }
-    
-    buffers_.push(buffer);
-    cv_.notify_one();
+    // Runs on the capture thread: copy into a slab, or count an overrun
+    ring_.Push(buffer.data.data(), buffer.data.size(), buffer.frames,
+               buffer.timestamp, format);
 }
 
 void AudioBufferQueue::OnCaptureError(HRESULT hr, const wchar_t* context) {
-    std::lock_guard<std::mutex> lock(mutex_);
     lastError_ = hr;
     LogError(context, hr);
 }
 
 bool AudioBufferQueue::PopBuffer(AudioBuffer& buffer, UINT32 timeoutMs) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    if (timeoutMs == INFINITE) {
-        cv_.wait(lock, [this] { return !buffers_.empty(); });
-    } else {
-        if (!cv_.wait_for(lock, std::chrono::milliseconds(timeoutMs),
-                          [this] { return !buffers_.empty(); })) {
-            return false;
-        }
-    }
-    
-    buffer = std::move(buffers_.front());
-    buffers_.pop();
-    return true;
+    UINT32 wait = (timeoutMs == INFINITE) ? AudioRing::WAIT_FOREVER : timeoutMs;
+    return ring_.Pop(buffer, format_, wait);
 }
 
 bool AudioBufferQueue::HasBuffers() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return !buffers_.empty();
+    return !ring_.IsEmpty();
 }
 
 void AudioBufferQueue::Clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::queue<AudioBuffer> empty;
-    std::swap(buffers_, empty);
+    ring_.Clear();
 }
 
 AudioFormat AudioBufferQueue::GetFormat() const {
-    std::lock_guard<std::mutex> lock(mutex_);
     return format_;
 }
 
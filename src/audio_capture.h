@@ -1,5 +1,7 @@
 #pragma once
 
+#include "audio_ring.h"
+#include "audio_types.h"
 #include "utils.h"
 #include <mmdeviceapi.h>
 #include <audioclient.h>
@@ -14,40 +16,6 @@
 
 namespace invisible {
 
-// -----------------------------------------------------------------------------
-// Audio Format Information
-// -----------------------------------------------------------------------------
-
-struct AudioFormat {
-    UINT32 sampleRate = 0;
-    UINT16 bitsPerSample = 0;
-    UINT16 channels = 0;
-    UINT32 blockAlign = 0;
-    UINT32 avgBytesPerSec = 0;
-    bool isFloat = false;
-    
-    std::wstring ToString() const {
-        std::wstringstream ss;
-        ss << sampleRate << L" Hz, " << bitsPerSample << L"-bit, " 
-           << channels << L" ch" << (isFloat ? L" (float)" : L"");
-        return ss.str();
-    }
-};
-
-// -----------------------------------------------------------------------------
-// Audio Buffer
-// -----------------------------------------------------------------------------
-
-struct AudioBuffer {
-    std::vector<BYTE> data;
-    UINT64 timestamp = 0;  // QPC timestamp
-    UINT32 frames = 0;
-    
-    AudioBuffer() = default;
-    AudioBuffer(const BYTE* src, size_t size, UINT32 frameCount, UINT64 ts)
-        : data(src, src + size), timestamp(ts), frames(frameCount) {}
-};
-
 // -----------------------------------------------------------------------------
 // Audio Capture Callback Interface
 // -----------------------------------------------------------------------------
@@ -112,6 +80,10 @@ private:
     // Process captured audio
     void ProcessAudioPacket();
     
+    // Reused for every packet so the capture thread stops allocating
+    // once it has seen the largest packet
+    AudioBuffer packet_;
+    
     // COM interfaces (must be released in order)
     IMMDeviceEnumerator* deviceEnumerator_ = nullptr;
     IMMDevice* device_ = nullptr;
@@ -141,12 +113,16 @@ private:
 };
 
 // -----------------------------------------------------------------------------
-// Simple Audio Buffer Queue (for async processing)
+// Audio Buffer Queue (for async processing)
+// Lock-free hand-off from the capture thread: OnAudioData copies into
+// preallocated slabs and never allocates or blocks. Pop/Clear/GetFormat
+// belong to a single consumer thread.
 // -----------------------------------------------------------------------------
 
 class AudioBufferQueue : public IAudioCaptureHandler {
 public:
-    explicit AudioBufferQueue(size_t maxBuffers = 100);
+    explicit AudioBufferQueue(size_t maxBuffers = 128,
+                              size_t slabBytes = AudioRingConfig().slabBytes);
     ~AudioBufferQueue() override;
     
     // IAudioCaptureHandler implementation
@@ -162,19 +138,19 @@ public:
     // Clear all buffered data
     void Clear();
     
-    // Get the current audio format
+    // Format of the most recently popped buffer
     AudioFormat GetFormat() const;
     
+    // Overrun / occupancy counters
+    AudioRingStats GetStats() const { return ring_.GetStats(); }
+    
     // Get last error (if any)
     HRESULT GetLastError() const { return lastError_; }
     
 private:
-    mutable std::mutex mutex_;
-    std::condition_variable cv_;
-    std::queue<AudioBuffer> buffers_;
+    AudioRing ring_;
     AudioFormat format_;
-    size_t maxBuffers_;
-    HRESULT lastError_ = S_OK;
+    std::atomic<HRESULT> lastError_{S_OK};
 };
 
 } // namespace invisible
@@ -0,0 +1,57 @@
+#include "audio_preprocessor.h"
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Constructor / Destructor
+// -----------------------------------------------------------------------------
+
+AudioPreprocessor::AudioPreprocessor(const AudioPreprocessorConfig &config)
+    : config_(config) {}
+
+AudioPreprocessor::~AudioPreprocessor() = default;
+
+void AudioPreprocessor::Reset() { resampler_.Reset(); }
+
+// -----------------------------------------------------------------------------
+// Conversion
+// -----------------------------------------------------------------------------
+
+size_t AudioPreprocessor::Convert(const AudioBuffer &buffer,
+                                  const AudioFormat &format,
+                                  std::vector<int16_t> &out) {
+  size_t count = Resample(buffer, format);
+  size_t offset = out.size();
+  out.resize(offset + count);
+  ConvertFloatToInt16(resampled_.data(), count, out.data() + offset);
+  return count;
+}
+
+size_t AudioPreprocessor::Resample(const AudioBuffer &buffer,
+                                   const AudioFormat &format) {
+  resampled_.clear();
+  if (format.channels == 0 || format.bitsPerSample < 8 ||
+      buffer.data.empty()) {
+    return 0;
+  }
+
+  if (resampler_.GetInputRate() != format.sampleRate &&
+      !resampler_.Initialize(format.sampleRate, config_.outputRate,
+                             config_.resampler)) {
+    return 0;
+  }
+
+  // Scratch buffers grow to the largest packet once and are then reused
+  size_t frameSize = (format.bitsPerSample / 8) * format.channels;
+  mono_.resize(buffer.data.size() / frameSize);
+  size_t frames =
+      DownmixToMono(buffer.data.data(), buffer.data.size(), format.channels,
+                    format.bitsPerSample, format.isFloat, mono_.data());
+  if (frames == 0) {
+    return 0;
+  }
+
+  return resampler_.Process(mono_.data(), frames, resampled_);
+}
+
+} // namespace invisible
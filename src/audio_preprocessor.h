@@ -0,0 +1,61 @@
+#pragma once
+
+#include "audio_types.h"
+#include "resampler.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Audio Preprocessor Configuration
+// -----------------------------------------------------------------------------
+
+struct AudioPreprocessorConfig {
+  uint32_t outputRate = 16000; // Whisper's native rate
+  ResamplerConfig resampler;
+};
+
+// -----------------------------------------------------------------------------
+// Streaming Audio Preprocessor
+// Converts each capture packet as it arrives (downmix -> resample -> int16)
+// and appends the result to the caller's buffer, so the capture callback
+// hands on ready-to-upload 16 kHz PCM. Filter history carries across
+// packets. Not thread-safe: one producer thread owns the instance.
+// -----------------------------------------------------------------------------
+
+class AudioPreprocessor {
+public:
+  explicit AudioPreprocessor(
+      const AudioPreprocessorConfig &config = AudioPreprocessorConfig());
+  ~AudioPreprocessor();
+
+  // Disable copy
+  AudioPreprocessor(const AudioPreprocessor &) = delete;
+  AudioPreprocessor &operator=(const AudioPreprocessor &) = delete;
+
+  // Drop filter history. Call while the producer is idle.
+  void Reset();
+
+  // Convert one packet and append the samples to `out`. Returns samples
+  // appended (0 for an unsupported format). A sample-rate change restarts
+  // the filter.
+  size_t Convert(const AudioBuffer &buffer, const AudioFormat &format,
+                 std::vector<int16_t> &out);
+
+  uint32_t GetOutputRate() const { return config_.outputRate; }
+  const AudioPreprocessorConfig &GetConfig() const { return config_; }
+
+private:
+  // Downmix and resample one packet into resampled_; returns sample count
+  size_t Resample(const AudioBuffer &buffer, const AudioFormat &format);
+
+  AudioPreprocessorConfig config_;
+
+  Resampler resampler_;
+  std::vector<float> mono_;
+  std::vector<float> resampled_;
+};
+
+} // namespace invisible
@@ -0,0 +1,146 @@
+#include "audio_ring.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Constructor
+// -----------------------------------------------------------------------------
+
+AudioRing::AudioRing(const AudioRingConfig &config)
+    : ring_(std::max<size_t>(config.slabCount, 2)) {
+  slabBytes_ = (std::max<size_t>(config.slabBytes, 1) + CACHE_LINE_SIZE - 1) /
+               CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+  // One arena for every slab, line-aligned so no two slabs share a line
+  arena_.resize(ring_.Capacity() * slabBytes_ + CACHE_LINE_SIZE);
+  uintptr_t base = reinterpret_cast<uintptr_t>(arena_.data());
+  size_t skew = (CACHE_LINE_SIZE - base % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+  for (size_t i = 0; i < ring_.Capacity(); ++i) {
+    ring_.Slot(i).bytes = arena_.data() + skew + i * slabBytes_;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Producer
+// -----------------------------------------------------------------------------
+
+bool AudioRing::Push(const uint8_t *data, size_t size, uint32_t frames,
+                     uint64_t timestamp, const AudioFormat &format) {
+  if (size == 0) {
+    return true;
+  }
+
+  // Split only on frame boundaries so every slab stays decodable
+  size_t frameSize = (frames > 0) ? std::max<size_t>(size / frames, 1) : 1;
+  size_t perSlab = slabBytes_ / frameSize * frameSize;
+  size_t needed = (perSlab > 0) ? (size + perSlab - 1) / perSlab : 0;
+
+  size_t freeSlabs = ring_.FreeSlots();
+  if (needed == 0 || needed > freeSlabs) {
+    droppedPackets_.fetch_add(1, std::memory_order_relaxed);
+    droppedBytes_.fetch_add(size, std::memory_order_relaxed);
+    return false;
+  }
+
+  size_t offset = 0;
+  while (offset < size) {
+    size_t piece = std::min(perSlab, size - offset);
+    Slab *slab = ring_.BeginPush();
+    memcpy(slab->bytes, data + offset, piece);
+    slab->size = piece;
+    slab->frames = static_cast<uint32_t>(piece / frameSize);
+    slab->timestamp = timestamp;
+    slab->format = format;
+    ring_.CommitPush();
+    offset += piece;
+  }
+
+  pushedPackets_.fetch_add(1, std::memory_order_relaxed);
+  size_t occupancy = ring_.Capacity() - freeSlabs + needed;
+  if (occupancy > highWaterSlabs_.load(std::memory_order_relaxed)) {
+    highWaterSlabs_.store(occupancy, std::memory_order_relaxed);
+  }
+
+  // Pairs with the fence in Pop(): either the consumer sees the new slab
+  // before sleeping, or we see it waiting and wake it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumerWaiting_.load(std::memory_order_relaxed)) {
+    waitCV_.notify_one();
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Consumer
+// -----------------------------------------------------------------------------
+
+bool AudioRing::TryPop(AudioBuffer &buffer, AudioFormat &format) {
+  Slab *slab = ring_.Front();
+  if (!slab) {
+    return false;
+  }
+  buffer.data.assign(slab->bytes, slab->bytes + slab->size);
+  buffer.frames = slab->frames;
+  buffer.timestamp = slab->timestamp;
+  format = slab->format;
+  ring_.Pop();
+  return true;
+}
+
+bool AudioRing::Pop(AudioBuffer &buffer, AudioFormat &format,
+                    uint32_t timeoutMs) {
+  if (TryPop(buffer, format)) {
+    return true;
+  }
+  if (timeoutMs == 0) {
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeoutMs);
+  std::unique_lock<std::mutex> lock(waitMutex_);
+
+  while (true) {
+    consumerWaiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (TryPop(buffer, format)) {
+      consumerWaiting_.store(false, std::memory_order_relaxed);
+      return true;
+    }
+
+    // The notify can still land between the check above and the wait below,
+    // so sleep in short slices rather than trusting a single wakeup
+    auto slice = std::chrono::milliseconds(WAIT_SLICE_MS);
+    if (timeoutMs != WAIT_FOREVER) {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        consumerWaiting_.store(false, std::memory_order_relaxed);
+        return false;
+      }
+      auto remaining =
+          std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+      slice = std::min(slice, remaining + std::chrono::milliseconds(1));
+    }
+    waitCV_.wait_for(lock, slice);
+  }
+}
+
+void AudioRing::Clear() {
+  while (ring_.Front()) {
+    ring_.Pop();
+  }
+}
+
+AudioRingStats AudioRing::GetStats() const {
+  AudioRingStats stats;
+  stats.pushedPackets = pushedPackets_.load(std::memory_order_relaxed);
+  stats.droppedPackets = droppedPackets_.load(std::memory_order_relaxed);
+  stats.droppedBytes = droppedBytes_.load(std::memory_order_relaxed);
+  stats.highWaterSlabs = highWaterSlabs_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+} // namespace invisible
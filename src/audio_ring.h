@@ -0,0 +1,98 @@
+#pragma once
+
+#include "audio_types.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Audio Ring Configuration
+// -----------------------------------------------------------------------------
+
+struct AudioRingConfig {
+  size_t slabCount = 128;   // Rounded up to a power of two
+  size_t slabBytes = 16384; // ~42 ms of 48 kHz stereo float per slab
+};
+
+struct AudioRingStats {
+  uint64_t pushedPackets = 0;
+  uint64_t droppedPackets = 0; // Overruns: ring full when the packet arrived
+  uint64_t droppedBytes = 0;
+  size_t highWaterSlabs = 0;   // Peak occupancy seen by the producer
+};
+
+// -----------------------------------------------------------------------------
+// Audio Slab Ring
+// Hands capture packets from the real-time capture thread to one consumer.
+// Packet bytes are copied into preallocated slabs, so Push() never allocates,
+// locks or waits; a packet larger than one slab is split on frame boundaries.
+// When the consumer falls behind, whole packets are dropped and counted.
+// -----------------------------------------------------------------------------
+
+class AudioRing {
+public:
+  static constexpr uint32_t WAIT_FOREVER = 0xFFFFFFFF;
+
+  explicit AudioRing(const AudioRingConfig &config = AudioRingConfig());
+
+  // Disable copy
+  AudioRing(const AudioRing &) = delete;
+  AudioRing &operator=(const AudioRing &) = delete;
+
+  // Producer: copy one packet in. Returns false (and counts an overrun)
+  // when there is not enough free space for all of it.
+  bool Push(const uint8_t *data, size_t size, uint32_t frames,
+            uint64_t timestamp, const AudioFormat &format);
+
+  // Consumer: take the oldest slab, waiting up to `timeoutMs` for one.
+  // `buffer.data` is reassigned in place, so a reused buffer stops
+  // allocating once it has grown to slab size.
+  bool Pop(AudioBuffer &buffer, AudioFormat &format,
+           uint32_t timeoutMs = WAIT_FOREVER);
+
+  // Consumer: drop everything currently queued
+  void Clear();
+
+  bool IsEmpty() const { return ring_.Empty(); }
+  size_t GetQueuedSlabs() const { return ring_.Size(); }
+  size_t GetSlabBytes() const { return slabBytes_; }
+  AudioRingStats GetStats() const;
+
+private:
+  // Bounds the delay if a wakeup races with the consumer going to sleep
+  // (one WASAPI packet period)
+  static constexpr uint32_t WAIT_SLICE_MS = 10;
+
+  struct Slab {
+    uint8_t *bytes = nullptr;
+    size_t size = 0;
+    uint32_t frames = 0;
+    uint64_t timestamp = 0;
+    AudioFormat format;
+  };
+
+  bool TryPop(AudioBuffer &buffer, AudioFormat &format);
+
+  SpscRing<Slab> ring_;
+  std::vector<uint8_t> arena_;
+  size_t slabBytes_ = 0;
+
+  // Producer-written counters
+  std::atomic<uint64_t> pushedPackets_{0};
+  std::atomic<uint64_t> droppedPackets_{0};
+  std::atomic<uint64_t> droppedBytes_{0};
+  std::atomic<size_t> highWaterSlabs_{0};
+
+  // Consumer sleep/wake; the producer only notifies, never locks
+  std::atomic<bool> consumerWaiting_{false};
+  std::mutex waitMutex_;
+  std::condition_variable waitCV_;
+};
+
+} // namespace invisible
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Audio Format Information
+// Platform-neutral so the preprocessing stages build and run off Windows.
+// -----------------------------------------------------------------------------
+
+struct AudioFormat {
+    uint32_t sampleRate = 0;
+    uint16_t bitsPerSample = 0;
+    uint16_t channels = 0;
+    uint32_t blockAlign = 0;
+    uint32_t avgBytesPerSec = 0;
+    bool isFloat = false;
+    
+    std::wstring ToString() const {
+        std::wstringstream ss;
+        ss << sampleRate << L" Hz, " << bitsPerSample << L"-bit, " 
+           << channels << L" ch" << (isFloat ? L" (float)" : L"");
+        return ss.str();
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Audio Buffer
+// -----------------------------------------------------------------------------
+
+struct AudioBuffer {
+    std::vector<uint8_t> data;
+    uint64_t timestamp = 0;  // QPC timestamp
+    uint32_t frames = 0;
+    
+    AudioBuffer() = default;
+    AudioBuffer(const uint8_t* src, size_t size, uint32_t frameCount, uint64_t ts)
+        : data(src, src + size), timestamp(ts), frames(frameCount) {}
+};
+
+} // namespace invisible
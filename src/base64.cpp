@@ -0,0 +1,331 @@
+#include "base64.h"
+#include "simd.h"
+#include <algorithm>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+constexpr char kAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Two output chars per 12-bit index, so the scalar loop does two lookups
+// per 3-byte group instead of four
+struct PairTable {
+  char chars[4096 * 2];
+  constexpr PairTable() : chars() {
+    for (int i = 0; i < 4096; ++i) {
+      chars[i * 2] = kAlphabet[i >> 6];
+      chars[i * 2 + 1] = kAlphabet[i & 63];
+    }
+  }
+};
+
+constexpr PairTable kPairs{};
+
+struct DecodeTable {
+  int8_t values[256];
+  constexpr DecodeTable() : values() {
+    for (int i = 0; i < 256; ++i) {
+      values[i] = -1;
+    }
+    for (int i = 0; i < 64; ++i) {
+      values[static_cast<unsigned char>(kAlphabet[i])] = static_cast<int8_t>(i);
+    }
+  }
+};
+
+constexpr DecodeTable kDecode{};
+
+// -----------------------------------------------------------------------------
+// Encoding Kernels
+// Each kernel encodes whole 3-byte groups and returns the bytes consumed;
+// the caller finishes any remainder with the scalar path.
+// -----------------------------------------------------------------------------
+
+using EncodeBlocksFn = size_t (*)(const uint8_t *src, size_t length,
+                                  char *dst);
+
+size_t EncodeBlocksScalar(const uint8_t *src, size_t length, char *dst) {
+  size_t i = 0;
+  for (; i + 3 <= length; i += 3) {
+    uint32_t v = (static_cast<uint32_t>(src[i]) << 16) |
+                 (static_cast<uint32_t>(src[i + 1]) << 8) | src[i + 2];
+    memcpy(dst, &kPairs.chars[(v >> 12) * 2], 2);
+    memcpy(dst + 2, &kPairs.chars[(v & 0xFFF) * 2], 2);
+    dst += 4;
+  }
+  return i;
+}
+
+void EncodeTail(const uint8_t *src, size_t remaining, char *dst) {
+  if (remaining == 0) {
+    return;
+  }
+  uint32_t v = static_cast<uint32_t>(src[0]) << 16;
+  if (remaining > 1) {
+    v |= static_cast<uint32_t>(src[1]) << 8;
+  }
+  dst[0] = kAlphabet[(v >> 18) & 0x3F];
+  dst[1] = kAlphabet[(v >> 12) & 0x3F];
+  dst[2] = (remaining > 1) ? kAlphabet[(v >> 6) & 0x3F] : '=';
+  dst[3] = '=';
+}
+
+#if INVISIBLE_HAVE_X86
+
+// Spread 12 input bytes into sixteen 6-bit indices (one per output byte)
+INVISIBLE_TARGET("ssse3")
+inline __m128i Reshuffle(__m128i in) {
+  in = _mm_shuffle_epi8(
+      in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+// Map 6-bit indices to ASCII by adding a per-range offset
+INVISIBLE_TARGET("ssse3")
+inline __m128i Translate(__m128i indices) {
+  const __m128i offsets =
+      _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                    '/' - 63, 'A', 0, 0);
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+INVISIBLE_TARGET("ssse3")
+size_t EncodeBlocksSsse3(const uint8_t *src, size_t length, char *dst) {
+  size_t i = 0;
+  // Each step reads 16 bytes but consumes 12
+  for (; i + 16 <= length; i += 12) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), Translate(Reshuffle(in)));
+    dst += 16;
+  }
+  return i;
+}
+
+INVISIBLE_TARGET("avx2")
+size_t EncodeBlocksAvx2(const uint8_t *src, size_t length, char *dst) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4,
+      7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i offsets = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+  size_t i = 0;
+  // Each step reads 28 bytes but consumes 24 (12 per 128-bit lane)
+  for (; i + 28 <= length; i += 24) {
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+    in = _mm256_shuffle_epi8(in, shuffle);
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    __m256i text = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), text);
+    dst += 32;
+  }
+  return i + EncodeBlocksSsse3(src + i, length - i, dst);
+}
+
+#endif
+
+struct EncodeKernel {
+  EncodeBlocksFn encode;
+  const char *name;
+};
+
+// Every kernel this CPU can run, best first
+const std::vector<EncodeKernel> &AvailableKernels() {
+  static const std::vector<EncodeKernel> kernels = [] {
+    std::vector<EncodeKernel> list;
+#if INVISIBLE_HAVE_X86
+    const simd::CpuFeatures &features = simd::GetCpuFeatures();
+    if (features.avx2) {
+      list.push_back({EncodeBlocksAvx2, "avx2"});
+    }
+    if (features.ssse3) {
+      list.push_back({EncodeBlocksSsse3, "ssse3"});
+    }
+#endif
+    list.push_back({EncodeBlocksScalar, "scalar"});
+    return list;
+  }();
+  return kernels;
+}
+
+const EncodeKernel &SelectKernel() {
+  return AvailableKernels().front();
+}
+
+size_t EncodeWith(const EncodeKernel &kernel, const uint8_t *data,
+                  size_t length, char *out) {
+  size_t consumed = kernel.encode(data, length, out);
+  char *dst = out + consumed / 3 * 4;
+
+  size_t rest = EncodeBlocksScalar(data + consumed, length - consumed, dst);
+  consumed += rest;
+  dst += rest / 3 * 4;
+
+  EncodeTail(data + consumed, length - consumed, dst);
+  return Base64EncodedLength(length);
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// One-Shot Encode / Decode
+// -----------------------------------------------------------------------------
+
+size_t Base64Encode(const uint8_t *data, size_t length, char *out) {
+  return EncodeWith(SelectKernel(), data, length, out);
+}
+
+bool Base64EncodeWith(const char *kernel, const uint8_t *data, size_t length,
+                      char *out) {
+  for (const EncodeKernel &k : AvailableKernels()) {
+    if (strcmp(k.name, kernel) == 0) {
+      EncodeWith(k, data, length, out);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Base64EncodeAppend(const uint8_t *data, size_t length, std::string &out) {
+  size_t offset = out.size();
+  out.resize(offset + Base64EncodedLength(length));
+  Base64Encode(data, length, &out[offset]);
+}
+
+bool Base64Decode(const char *text, size_t length, std::vector<uint8_t> &out) {
+  if (length % 4 != 0) {
+    return false;
+  }
+
+  size_t padding = 0;
+  if (length > 0 && text[length - 1] == '=') {
+    ++padding;
+    if (text[length - 2] == '=') {
+      ++padding;
+    }
+  }
+
+  size_t offset = out.size();
+  out.resize(offset + length / 4 * 3 - padding);
+  uint8_t *dst = out.data() + offset;
+
+  for (size_t i = 0; i < length; i += 4) {
+    bool last = (i + 4 == length);
+    uint32_t v = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      char c = text[i + k];
+      int8_t value = kDecode.values[static_cast<unsigned char>(c)];
+      if (value < 0) {
+        if (!(last && c == '=' && k >= 4 - padding)) {
+          out.resize(offset);
+          return false;
+        }
+        value = 0;
+      }
+      v = (v << 6) | static_cast<uint32_t>(value);
+    }
+
+    size_t bytes = last ? 3 - padding : 3;
+    dst[0] = static_cast<uint8_t>(v >> 16);
+    if (bytes > 1) {
+      dst[1] = static_cast<uint8_t>(v >> 8);
+    }
+    if (bytes > 2) {
+      dst[2] = static_cast<uint8_t>(v);
+    }
+    dst += bytes;
+  }
+
+  return true;
+}
+
+const char *Base64EncoderName() { return SelectKernel().name; }
+
+std::vector<const char *> Base64EncoderNames() {
+  std::vector<const char *> names;
+  for (const EncodeKernel &k : AvailableKernels()) {
+    names.push_back(k.name);
+  }
+  return names;
+}
+
+// -----------------------------------------------------------------------------
+// Streaming Encoder
+// -----------------------------------------------------------------------------
+
+Base64StreamEncoder::Base64StreamEncoder(Sink sink) : sink_(std::move(sink)) {}
+
+void Base64StreamEncoder::Update(const uint8_t *data, size_t length) {
+  if (carryLength_ > 0) {
+    while (carryLength_ < 3 && length > 0) {
+      carry_[carryLength_++] = *data++;
+      --length;
+    }
+    if (carryLength_ < 3) {
+      return;
+    }
+    char text[4];
+    Base64Encode(carry_, 3, text);
+    sink_(text, 4);
+    outputLength_ += 4;
+    carryLength_ = 0;
+  }
+
+  size_t whole = length / 3 * 3;
+  if (whole > 0 && buffer_.empty()) {
+    buffer_.resize(Base64EncodedLength(CHUNK_INPUT_BYTES));
+  }
+
+  while (whole > 0) {
+    size_t n = std::min(whole, CHUNK_INPUT_BYTES);
+    size_t written = Base64Encode(data, n, buffer_.data());
+    sink_(buffer_.data(), written);
+    outputLength_ += written;
+    data += n;
+    length -= n;
+    whole -= n;
+  }
+
+  for (size_t i = 0; i < length; ++i) {
+    carry_[carryLength_++] = data[i];
+  }
+}
+
+void Base64StreamEncoder::Finish() {
+  if (carryLength_ > 0) {
+    char text[4];
+    Base64Encode(carry_, carryLength_, text);
+    sink_(text, 4);
+    outputLength_ += 4;
+    carryLength_ = 0;
+  }
+}
+
+} // namespace invisible
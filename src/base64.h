@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Base64 Codec (RFC 4648, padded)
+// Encoding picks AVX2, SSSE3 or a scalar pair-table kernel at runtime.
+// -----------------------------------------------------------------------------
+
+// Number of characters produced for `length` input bytes
+inline size_t Base64EncodedLength(size_t length) { return (length + 2) / 3 * 4; }
+
+// Encode into a caller-supplied buffer that holds at least
+// Base64EncodedLength(length) chars. Returns the number of chars written.
+size_t Base64Encode(const uint8_t *data, size_t length, char *out);
+
+// Encode and append to `out` (single resize, no intermediate string)
+void Base64EncodeAppend(const uint8_t *data, size_t length, std::string &out);
+
+inline std::string Base64Encode(const uint8_t *data, size_t length) {
+  std::string result;
+  Base64EncodeAppend(data, length, result);
+  return result;
+}
+
+// Decode padded base64; fails on any character outside the alphabet
+bool Base64Decode(const char *text, size_t length, std::vector<uint8_t> &out);
+
+// Name of the kernel selected for this CPU ("avx2", "ssse3" or "scalar")
+const char *Base64EncoderName();
+
+// Every kernel this CPU can run, best first (always ends with "scalar")
+std::vector<const char *> Base64EncoderNames();
+
+// Encode with the named kernel instead of the selected one, so tests and
+// benchmarks can compare them. False if this CPU cannot run it.
+bool Base64EncodeWith(const char *kernel, const uint8_t *data, size_t length,
+                      char *out);
+
+// -----------------------------------------------------------------------------
+// Streaming Base64 Encoder
+// Accepts input in arbitrary pieces and hands encoded text to a sink in
+// bounded chunks, so large payloads never need a second full-size buffer.
+// -----------------------------------------------------------------------------
+
+class Base64StreamEncoder {
+public:
+  using Sink = std::function<void(const char *text, size_t length)>;
+
+  explicit Base64StreamEncoder(Sink sink);
+
+  // Disable copy
+  Base64StreamEncoder(const Base64StreamEncoder &) = delete;
+  Base64StreamEncoder &operator=(const Base64StreamEncoder &) = delete;
+
+  // Encode more input; up to two trailing bytes are held until the next call
+  void Update(const uint8_t *data, size_t length);
+
+  // Flush held bytes with padding. The encoder can be reused afterwards.
+  void Finish();
+
+  // Total characters delivered to the sink so far
+  size_t GetOutputLength() const { return outputLength_; }
+
+private:
+  static constexpr size_t CHUNK_INPUT_BYTES = 12288; // -> 16 KB of text
+
+  Sink sink_;
+  uint8_t carry_[3] = {};
+  size_t carryLength_ = 0;
+  size_t outputLength_ = 0;
+  std::vector<char> buffer_;
+};
+
+} // namespace invisible
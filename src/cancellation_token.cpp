@@ -0,0 +1,82 @@
+#include "cancellation_token.h"
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Cancellation Token
+// -----------------------------------------------------------------------------
+
+void CancellationToken::Cancel() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (cancelled_)
+    return;
+  cancelled_ = true;
+  cancelThread_ = std::this_thread::get_id();
+
+  // One callback at a time, each taken out of the map before it runs, so
+  // Unsubscribe() can tell a finished callback from one still running
+  while (!callbacks_.empty()) {
+    auto it = callbacks_.begin();
+    running_ = it->first;
+    Callback callback = std::move(it->second);
+    callbacks_.erase(it);
+
+    lock.unlock();
+    callback();
+    lock.lock();
+
+    running_ = 0;
+    finished_.notify_all();
+  }
+}
+
+bool CancellationToken::IsCancelled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cancelled_;
+}
+
+CancellationToken::SubscriptionId
+CancellationToken::Subscribe(Callback callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!cancelled_) {
+      SubscriptionId id = nextId_++;
+      callbacks_.emplace(id, std::move(callback));
+      return id;
+    }
+  }
+  callback();
+  return 0;
+}
+
+void CancellationToken::Unsubscribe(SubscriptionId id) {
+  if (id == 0)
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (callbacks_.erase(id))
+    return;
+
+  // A callback unsubscribing itself would wait forever
+  if (cancelThread_ == std::this_thread::get_id())
+    return;
+  finished_.wait(lock, [&] { return running_ != id; });
+}
+
+// -----------------------------------------------------------------------------
+// Scoped Subscription
+// -----------------------------------------------------------------------------
+
+ScopedCancellation::ScopedCancellation(std::shared_ptr<CancellationToken> token,
+                                       CancellationToken::Callback callback)
+    : token_(std::move(token)) {
+  if (token_)
+    id_ = token_->Subscribe(std::move(callback));
+}
+
+ScopedCancellation::~ScopedCancellation() {
+  if (token_)
+    token_->Unsubscribe(id_);
+}
+
+} // namespace invisible
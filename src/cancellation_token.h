@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Cancellation Token
+// Shared between whoever may give up on an operation (the caller, a
+// deadline timer, Shutdown) and the code running it. The running side
+// subscribes a callback that interrupts whatever it is blocked on (shuts a
+// socket down, wakes a condition variable, closes a WinHTTP handle) and
+// unsubscribes when it is done; Unsubscribe() waits for a callback that is
+// running on another thread, so the interrupted resource can be released
+// right after it returns.
+// -----------------------------------------------------------------------------
+
+class CancellationToken {
+public:
+  using Callback = std::function<void()>;
+  using SubscriptionId = uint64_t;
+
+  CancellationToken() = default;
+
+  // Disable copy
+  CancellationToken(const CancellationToken &) = delete;
+  CancellationToken &operator=(const CancellationToken &) = delete;
+
+  // Mark cancelled and run every subscribed callback on this thread (once;
+  // later calls do nothing)
+  void Cancel();
+
+  bool IsCancelled() const;
+
+  // Run `callback` on cancellation. Already cancelled: it runs right here
+  // and 0 is returned.
+  SubscriptionId Subscribe(Callback callback);
+
+  // Remove a subscription; if its callback is running on another thread,
+  // wait for it to return. Unknown ids and 0 are ignored.
+  void Unsubscribe(SubscriptionId id);
+
+private:
+  mutable std::mutex mutex_;
+  std::condition_variable finished_; // A callback returned
+  std::map<SubscriptionId, Callback> callbacks_;
+  SubscriptionId nextId_ = 1;
+  SubscriptionId running_ = 0; // Callback Cancel() is running now
+  std::thread::id cancelThread_;
+  bool cancelled_ = false;
+};
+
+// Subscribes a callback for the lifetime of the object (nothing for a null
+// token). Declare it before any lock the callback takes, so it unsubscribes
+// after that lock is released.
+class ScopedCancellation {
+public:
+  ScopedCancellation(std::shared_ptr<CancellationToken> token,
+                     CancellationToken::Callback callback);
+  ~ScopedCancellation();
+
+  // Disable copy
+  ScopedCancellation(const ScopedCancellation &) = delete;
+  ScopedCancellation &operator=(const ScopedCancellation &) = delete;
+
+private:
+  std::shared_ptr<CancellationToken> token_;
+  CancellationToken::SubscriptionId id_ = 0;
+};
+
+} // namespace invisible
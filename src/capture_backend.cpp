@@ -0,0 +1,101 @@
+#include "capture_backend.h"
+#include <algorithm>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+bool SameRect(const ImageRect &a, const ImageRect &b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+ImageRect UnionRects(const ImageRect &a, const ImageRect &b) {
+  int x0 = std::min(a.x, b.x);
+  int y0 = std::min(a.y, b.y);
+  int x1 = std::max(a.x + a.width, b.x + b.width);
+  int y1 = std::max(a.y + a.height, b.y + b.height);
+  return ImageRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Backend Helpers
+// -----------------------------------------------------------------------------
+
+void CopySurfaceRegion(const uint8_t *surface, int surfaceStride,
+                       const ImageRect &region, FrameBufferPool *pool,
+                       CaptureFrame &frame) {
+  const size_t rowBytes = static_cast<size_t>(region.width) * 4;
+  const size_t bytes = rowBytes * region.height;
+  if (frame.pixels.size() != bytes) {
+    frame.pixels.Reset(); // Back to the pool first, so it can be reused
+    frame.pixels = ImageBuffer(pool, bytes);
+  }
+
+  frame.width = region.width;
+  frame.height = region.height;
+  frame.stride = static_cast<int>(rowBytes);
+
+  const uint8_t *src = surface +
+                       static_cast<ptrdiff_t>(region.y) * surfaceStride +
+                       static_cast<ptrdiff_t>(region.x) * 4;
+  uint8_t *dst = frame.pixels.data();
+  for (int y = 0; y < region.height; ++y) {
+    memcpy(dst, src, rowBytes);
+    src += surfaceStride;
+    dst += rowBytes;
+  }
+}
+
+ImageRect IntersectRects(const ImageRect &a, const ImageRect &b) {
+  int x0 = std::max(a.x, b.x);
+  int y0 = std::max(a.y, b.y);
+  int x1 = std::min(a.x + a.width, b.x + b.width);
+  int y1 = std::min(a.y + a.height, b.y + b.height);
+  if (x1 <= x0 || y1 <= y0)
+    return ImageRect{x0, y0, 0, 0};
+  return ImageRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+void DirtyRegionTracker::Add(const ImageRect &rect) {
+  if (rect.width <= 0 || rect.height <= 0)
+    return;
+
+  if (rects_.size() < maxRects_) {
+    rects_.push_back(rect);
+    return;
+  }
+  ImageRect bounds = rect;
+  for (const ImageRect &r : rects_)
+    bounds = UnionRects(bounds, r);
+  rects_.assign(1, bounds);
+}
+
+void DirtyRegionTracker::Invalidate() {
+  rects_.clear();
+  valid_ = false;
+}
+
+void DirtyRegionTracker::Report(const ImageRect &region, CaptureFrame &frame) {
+  frame.dirtyRects.clear();
+  frame.dirtyRectsValid = valid_ && SameRect(region, lastRegion_);
+  if (frame.dirtyRectsValid) {
+    for (const ImageRect &rect : rects_) {
+      ImageRect clipped = IntersectRects(rect, region);
+      if (clipped.width <= 0)
+        continue;
+      clipped.x -= region.x;
+      clipped.y -= region.y;
+      frame.dirtyRects.push_back(clipped);
+    }
+  }
+
+  rects_.clear();
+  lastRegion_ = region;
+  valid_ = true;
+}
+
+} // namespace invisible
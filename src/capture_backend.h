@@ -0,0 +1,86 @@
+#pragma once
+
+#include "image_buffer.h"
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Capture Backend
+// -----------------------------------------------------------------------------
+
+struct CaptureFrame {
+  ImageBuffer pixels; // Top-down BGRA, from the backend's pool
+  int width = 0;
+  int height = 0;
+  int stride = 0; // Bytes per row (width * 4)
+
+  // What changed inside the region since the backend's previous capture,
+  // in frame pixels. Only known when the same region was captured last
+  // time and the backend tracks changes; otherwise assume all of it.
+  std::vector<ImageRect> dirtyRects;
+  bool dirtyRectsValid = false;
+
+  ImageView View() const {
+    return ImageView{pixels.data(), width, height, stride};
+  }
+};
+
+struct CaptureBackendStats {
+  uint64_t captures = 0;
+  uint64_t failures = 0;
+  uint64_t capturedBytes = 0;
+  uint64_t captureMicros = 0; // Time spent in Capture()
+};
+
+class CaptureBackend {
+public:
+  virtual ~CaptureBackend() = default;
+
+  // Short name for logs ("dxgi", "gdi")
+  virtual const char *GetName() const = 0;
+
+  // Copy `region` (screen coordinates) into `frame`, reusing its buffer or
+  // one from the pool. False if the region cannot be captured this way.
+  // Calls must not overlap.
+  virtual bool Capture(const ImageRect &region, CaptureFrame &frame) = 0;
+
+  virtual CaptureBackendStats GetStats() const = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Backend Helpers
+// -----------------------------------------------------------------------------
+
+// Copy `region` of a BGRA surface (surface coordinates, inside it) into
+// `frame` as packed rows. The buffer comes from `pool` if one is given.
+void CopySurfaceRegion(const uint8_t *surface, int surfaceStride,
+                       const ImageRect &region, FrameBufferPool *pool,
+                       CaptureFrame &frame);
+
+// Intersection of two rectangles (width/height 0 if they do not meet)
+ImageRect IntersectRects(const ImageRect &a, const ImageRect &b);
+
+// Changed areas of a surface between two captures. Past maxRects the
+// rectangles are merged into their bounding box.
+class DirtyRegionTracker {
+public:
+  explicit DirtyRegionTracker(size_t maxRects = 64) : maxRects_(maxRects) {}
+
+  void Add(const ImageRect &rect);
+
+  // Everything changed (e.g. the surface was recreated)
+  void Invalidate();
+
+  // Fill frame.dirtyRects for a capture of `region` and start over
+  void Report(const ImageRect &region, CaptureFrame &frame);
+
+private:
+  size_t maxRects_;
+  std::vector<ImageRect> rects_;
+  ImageRect lastRegion_;
+  bool valid_ = false; // lastRegion_ was captured and nothing was lost
+};
+
+} // namespace invisible
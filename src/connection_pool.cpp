@@ -0,0 +1,177 @@
+#include "connection_pool.h"
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Constructor / Destructor
+// -----------------------------------------------------------------------------
+
+ConnectionPool::ConnectionPool(const ConnectionPoolConfig &config,
+                               CloseFn close)
+    : config_(config), close_(std::move(close)) {
+  if (config_.maxPerHost == 0)
+    config_.maxPerHost = 1;
+}
+
+ConnectionPool::~ConnectionPool() { Clear(); }
+
+// -----------------------------------------------------------------------------
+// Acquire / Release
+// -----------------------------------------------------------------------------
+
+ConnectionPool::Connection ConnectionPool::Acquire(const std::string &host,
+                                                   const OpenFn &open,
+                                                   bool *reused) {
+  if (reused)
+    *reused = false;
+
+  std::vector<Connection> expired;
+  Connection connection = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++stats_.acquires;
+    Host &entry = hosts_[host];
+    CollectExpired(entry, Clock::now(), expired);
+
+    // Wait for an idle connection or room to open a new one
+    auto ready = [&] {
+      return !entry.idle.empty() || entry.open < config_.maxPerHost;
+    };
+    if (!ready()) {
+      ++stats_.waits;
+      if (!slotFree_.wait_for(
+              lock, std::chrono::milliseconds(config_.acquireTimeoutMs),
+              ready)) {
+        ++stats_.timeouts;
+        lock.unlock();
+        CloseAll(expired);
+        return nullptr;
+      }
+      CollectExpired(entry, Clock::now(), expired);
+    }
+
+    if (!entry.idle.empty()) {
+      connection = entry.idle.back().connection;
+      entry.idle.pop_back();
+      --stats_.idle;
+      ++stats_.hits;
+      if (reused)
+        *reused = true;
+    } else {
+      ++entry.open; // Reserve the slot while the handshake runs unlocked
+      ++stats_.open;
+    }
+  }
+  CloseAll(expired);
+
+  if (connection)
+    return connection;
+
+  connection = open ? open() : nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (connection) {
+    ++stats_.opened;
+  } else {
+    ++stats_.openFailed;
+    --hosts_[host].open;
+    --stats_.open;
+    slotFree_.notify_all();
+  }
+  return connection;
+}
+
+void ConnectionPool::Release(const std::string &host, Connection connection,
+                             bool reusable) {
+  if (!connection)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Host &entry = hosts_[host];
+    if (reusable) {
+      entry.idle.push_back({connection, Clock::now()});
+      ++stats_.idle;
+      connection = nullptr;
+    } else {
+      --entry.open;
+      --stats_.open;
+      ++stats_.discarded;
+    }
+  }
+  slotFree_.notify_all();
+
+  if (connection && close_)
+    close_(connection);
+}
+
+// -----------------------------------------------------------------------------
+// Eviction
+// -----------------------------------------------------------------------------
+
+void ConnectionPool::CollectExpired(Host &host, Clock::time_point now,
+                                    std::vector<Connection> &expired) {
+  const auto limit = std::chrono::milliseconds(config_.idleTimeoutMs);
+  size_t count = 0;
+  while (count < host.idle.size() && now - host.idle[count].since >= limit) {
+    expired.push_back(host.idle[count].connection);
+    ++count;
+  }
+  if (count == 0)
+    return;
+
+  host.idle.erase(host.idle.begin(), host.idle.begin() + count);
+  host.open -= count;
+  stats_.idle -= count;
+  stats_.open -= count;
+  stats_.evicted += count;
+}
+
+void ConnectionPool::EvictIdle() {
+  std::vector<Connection> expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = Clock::now();
+    for (auto &entry : hosts_)
+      CollectExpired(entry.second, now, expired);
+  }
+  if (!expired.empty())
+    slotFree_.notify_all();
+  CloseAll(expired);
+}
+
+void ConnectionPool::Clear() {
+  std::vector<Connection> idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : hosts_) {
+      Host &host = entry.second;
+      for (const auto &item : host.idle)
+        idle.push_back(item.connection);
+      host.open -= host.idle.size();
+      stats_.idle -= host.idle.size();
+      stats_.open -= host.idle.size();
+      host.idle.clear();
+    }
+  }
+  slotFree_.notify_all();
+  CloseAll(idle);
+}
+
+void ConnectionPool::CloseAll(const std::vector<Connection> &connections) {
+  if (!close_)
+    return;
+  for (Connection connection : connections)
+    close_(connection);
+}
+
+// -----------------------------------------------------------------------------
+// Stats
+// -----------------------------------------------------------------------------
+
+ConnectionPoolStats ConnectionPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+} // namespace invisible
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Connection Pool Configuration
+// -----------------------------------------------------------------------------
+
+struct ConnectionPoolConfig {
+  size_t maxPerHost = 6;             // Open connections per host (busy + idle)
+  uint32_t idleTimeoutMs = 50000;    // Idle connections older than this close
+  uint32_t acquireTimeoutMs = 30000; // Wait for a free slot before failing
+};
+
+struct ConnectionPoolStats {
+  uint64_t acquires = 0;
+  uint64_t hits = 0;      // Served by an idle connection (no handshake)
+  uint64_t opened = 0;    // New connections (one handshake each)
+  uint64_t openFailed = 0;
+  uint64_t evicted = 0;   // Closed after sitting idle too long
+  uint64_t discarded = 0; // Released as not reusable
+  uint64_t waits = 0;     // Acquires that waited for a slot
+  uint64_t timeouts = 0;  // Acquires that gave up waiting
+  size_t open = 0;
+  size_t idle = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Connection Pool
+// Keeps finished connections open per host so the next request can skip the
+// TCP and TLS handshake. The pool never touches the network itself: the
+// transport opens connections through the callback passed to Acquire() and
+// closes them through the one given at construction, so any backend can
+// share the bookkeeping. The most recently used idle connection is handed
+// out first (it is the least likely to have been dropped by the server);
+// connections idle for longer than idleTimeoutMs are closed instead of
+// reused. At most maxPerHost connections exist per host; further
+// Acquire() calls wait for one to be released. (The WinHTTP backend pools
+// connect handles, not sockets: WinHTTP keeps its sockets alive per
+// session itself, so there the pool saves no handshakes and only bounds
+// the requests per host.)
+// -----------------------------------------------------------------------------
+
+class ConnectionPool {
+public:
+  using Connection = void *; // Opaque backend handle, nullptr = none
+  using OpenFn = std::function<Connection()>;
+  using CloseFn = std::function<void(Connection connection)>;
+
+  ConnectionPool(const ConnectionPoolConfig &config, CloseFn close);
+  ~ConnectionPool();
+
+  // Disable copy
+  ConnectionPool(const ConnectionPool &) = delete;
+  ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+  // Take a connection to `host` (any key naming the endpoint, e.g.
+  // "https://api.groq.com:443"), reusing an idle one when possible and
+  // calling `open` otherwise. Returns nullptr if opening fails or no slot
+  // frees up in time. `reused` reports whether it came from the pool.
+  Connection Acquire(const std::string &host, const OpenFn &open,
+                     bool *reused = nullptr);
+
+  // Return a connection. Pass reusable = false when the response was not
+  // read to the end or the transport failed; it is closed instead.
+  void Release(const std::string &host, Connection connection, bool reusable);
+
+  // Close every connection that has been idle longer than idleTimeoutMs
+  void EvictIdle();
+
+  // Close all idle connections (busy ones close when released)
+  void Clear();
+
+  ConnectionPoolStats GetStats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct IdleConnection {
+    Connection connection;
+    Clock::time_point since;
+  };
+
+  struct Host {
+    std::vector<IdleConnection> idle; // Oldest first
+    size_t open = 0;                  // Busy + idle
+  };
+
+  // Move expired idle connections of `host` into `expired` (lock held)
+  void CollectExpired(Host &host, Clock::time_point now,
+                      std::vector<Connection> &expired);
+  void CloseAll(const std::vector<Connection> &connections);
+
+  ConnectionPoolConfig config_;
+  CloseFn close_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable slotFree_;
+  std::map<std::string, Host> hosts_;
+  ConnectionPoolStats stats_;
+};
+
+} // namespace invisible
@@ -0,0 +1,337 @@
+#include "dxgi_capture.h"
+#include <chrono>
+
+namespace invisible {
+
+namespace {
+
+template <typename T> void SafeRelease(T *&ptr) {
+  if (ptr) {
+    ptr->Release();
+    ptr = nullptr;
+  }
+}
+
+bool Contains(const ImageRect &outer, const ImageRect &inner) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.width <= outer.x + outer.width &&
+         inner.y + inner.height <= outer.y + outer.height;
+}
+
+ImageRect FromRect(const RECT &rect) {
+  return ImageRect{static_cast<int>(rect.left), static_cast<int>(rect.top),
+                   static_cast<int>(rect.right - rect.left),
+                   static_cast<int>(rect.bottom - rect.top)};
+}
+
+// Waiting for the first frame of a new duplication
+constexpr UINT kFirstFrameTimeoutMs = 200;
+
+} // namespace
+
+struct DxgiCaptureBackend::Output {
+  IDXGIAdapter1 *adapter = nullptr;
+  IDXGIOutput1 *output = nullptr;
+  ImageRect bounds; // Desktop coordinates
+  DXGI_MODE_ROTATION rotation = DXGI_MODE_ROTATION_UNSPECIFIED;
+
+  ID3D11Device *device = nullptr;
+  ID3D11DeviceContext *context = nullptr;
+  IDXGIOutputDuplication *duplication = nullptr;
+  ID3D11Texture2D *staging = nullptr; // Last desktop image, CPU-readable
+  bool stagingValid = false;
+
+  std::vector<BYTE> metadata; // Dirty/move rectangle scratch
+  DirtyRegionTracker dirty;   // Output coordinates
+};
+
+DxgiCaptureBackend::DxgiCaptureBackend(FrameBufferPool *pool) : pool_(pool) {}
+
+DxgiCaptureBackend::~DxgiCaptureBackend() {
+  for (auto &output : outputs_) {
+    CloseDuplication(*output);
+    SafeRelease(output->staging);
+    SafeRelease(output->context);
+    SafeRelease(output->device);
+    SafeRelease(output->output);
+    SafeRelease(output->adapter);
+  }
+}
+
+bool DxgiCaptureBackend::IsAvailable() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return available_;
+}
+
+CaptureBackendStats DxgiCaptureBackend::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+// -----------------------------------------------------------------------------
+// Capture
+// -----------------------------------------------------------------------------
+
+bool DxgiCaptureBackend::Capture(const ImageRect &region,
+                                 CaptureFrame &frame) {
+  auto start = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (!enumerated_) {
+    enumerated_ = true;
+    if (!EnumerateOutputs()) {
+      LogInfo(L"Desktop Duplication unavailable, capturing with GDI");
+      available_ = false;
+    }
+  }
+  if (!available_ || region.width <= 0 || region.height <= 0) {
+    stats_.failures++;
+    return false;
+  }
+
+  Output *target = nullptr;
+  for (auto &output : outputs_) {
+    if (Contains(output->bounds, region)) {
+      target = output.get();
+      break;
+    }
+  }
+
+  // Spans monitors, or the image would need rotating: GDI handles these
+  if (!target || (target->rotation != DXGI_MODE_ROTATION_IDENTITY &&
+                  target->rotation != DXGI_MODE_ROTATION_UNSPECIFIED)) {
+    stats_.failures++;
+    return false;
+  }
+
+  HRESULT hr = E_FAIL;
+  if (target->duplication || OpenDuplication(*target))
+    hr = UpdateStaging(*target);
+
+  // Mode change, fullscreen switch or secure desktop: start over once
+  if (hr == DXGI_ERROR_ACCESS_LOST) {
+    CloseDuplication(*target);
+    hr = OpenDuplication(*target) ? UpdateStaging(*target) : E_FAIL;
+  }
+  // Reopening may have found the monitor moved or resized
+  if (FAILED(hr) || !Contains(target->bounds, region)) {
+    stats_.failures++;
+    return false;
+  }
+
+  D3D11_MAPPED_SUBRESOURCE mapped = {};
+  hr = target->context->Map(target->staging, 0, D3D11_MAP_READ, 0, &mapped);
+  if (FAILED(hr)) {
+    LogError(L"Desktop Duplication: Map failed", static_cast<DWORD>(hr));
+    stats_.failures++;
+    return false;
+  }
+
+  ImageRect local{region.x - target->bounds.x, region.y - target->bounds.y,
+                  region.width, region.height};
+  CopySurfaceRegion(static_cast<const uint8_t *>(mapped.pData),
+                    static_cast<int>(mapped.RowPitch), local, pool_, frame);
+  target->context->Unmap(target->staging, 0);
+  target->dirty.Report(local, frame);
+
+  stats_.captures++;
+  stats_.capturedBytes += frame.pixels.size();
+  stats_.captureMicros += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Outputs
+// -----------------------------------------------------------------------------
+
+bool DxgiCaptureBackend::EnumerateOutputs() {
+  IDXGIFactory1 *factory = nullptr;
+  if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1),
+                                reinterpret_cast<void **>(&factory)))) {
+    return false;
+  }
+
+  IDXGIAdapter1 *adapter = nullptr;
+  for (UINT a = 0; factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND;
+       ++a) {
+    IDXGIOutput *output = nullptr;
+    for (UINT o = 0; adapter->EnumOutputs(o, &output) != DXGI_ERROR_NOT_FOUND;
+         ++o) {
+      DXGI_OUTPUT_DESC desc;
+      IDXGIOutput1 *output1 = nullptr;
+      if (SUCCEEDED(output->GetDesc(&desc)) && desc.AttachedToDesktop &&
+          SUCCEEDED(output->QueryInterface(
+              __uuidof(IDXGIOutput1), reinterpret_cast<void **>(&output1)))) {
+        auto entry = std::make_unique<Output>();
+        adapter->AddRef();
+        entry->adapter = adapter;
+        entry->output = output1;
+        entry->bounds = FromRect(desc.DesktopCoordinates);
+        entry->rotation = desc.Rotation;
+        outputs_.push_back(std::move(entry));
+      }
+      SafeRelease(output);
+    }
+    SafeRelease(adapter);
+  }
+  SafeRelease(factory);
+  return !outputs_.empty();
+}
+
+bool DxgiCaptureBackend::OpenDuplication(Output &output) {
+  HRESULT hr;
+  if (!output.device) {
+    D3D_FEATURE_LEVEL level;
+    hr = D3D11CreateDevice(output.adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr,
+                           D3D11_CREATE_DEVICE_BGRA_SUPPORT, nullptr, 0,
+                           D3D11_SDK_VERSION, &output.device, &level,
+                           &output.context);
+    if (FAILED(hr)) {
+      LogError(L"Desktop Duplication: D3D11CreateDevice failed",
+               static_cast<DWORD>(hr));
+      return false;
+    }
+  }
+
+  hr = output.output->DuplicateOutput(output.device, &output.duplication);
+  if (FAILED(hr)) {
+    // Unsupported here for good (e.g. the app runs on another GPU than the
+    // monitor); other errors (too many duplications, secure desktop) pass
+    if (hr == DXGI_ERROR_UNSUPPORTED)
+      available_ = false;
+    LogError(L"Desktop Duplication: DuplicateOutput failed",
+             static_cast<DWORD>(hr));
+    return false;
+  }
+
+  // Always delivered as BGRA, whatever the display mode
+  DXGI_OUTDUPL_DESC desc;
+  output.duplication->GetDesc(&desc);
+
+  D3D11_TEXTURE2D_DESC current = {};
+  if (output.staging)
+    output.staging->GetDesc(&current);
+  if (!output.staging || current.Width != desc.ModeDesc.Width ||
+      current.Height != desc.ModeDesc.Height) {
+    SafeRelease(output.staging);
+    D3D11_TEXTURE2D_DESC td = {};
+    td.Width = desc.ModeDesc.Width;
+    td.Height = desc.ModeDesc.Height;
+    td.MipLevels = 1;
+    td.ArraySize = 1;
+    td.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_STAGING;
+    td.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    hr = output.device->CreateTexture2D(&td, nullptr, &output.staging);
+    if (FAILED(hr)) {
+      LogError(L"Desktop Duplication: staging texture failed",
+               static_cast<DWORD>(hr));
+      SafeRelease(output.duplication);
+      return false;
+    }
+  }
+
+  // The monitor may have moved or changed mode while duplication was lost
+  DXGI_OUTPUT_DESC outputDesc;
+  if (SUCCEEDED(output.output->GetDesc(&outputDesc))) {
+    output.bounds = FromRect(outputDesc.DesktopCoordinates);
+    output.rotation = outputDesc.Rotation;
+  }
+
+  output.stagingValid = false;
+  output.dirty.Invalidate();
+  return true;
+}
+
+void DxgiCaptureBackend::CloseDuplication(Output &output) {
+  SafeRelease(output.duplication);
+  output.stagingValid = false;
+  output.dirty.Invalidate();
+}
+
+// -----------------------------------------------------------------------------
+// Frames
+// -----------------------------------------------------------------------------
+
+HRESULT DxgiCaptureBackend::UpdateStaging(Output &output) {
+  // A new duplication's first frame is the whole desktop; it can take a
+  // moment to arrive. After that, no new frame means nothing changed.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    DXGI_OUTDUPL_FRAME_INFO info;
+    IDXGIResource *resource = nullptr;
+    HRESULT hr = output.duplication->AcquireNextFrame(
+        output.stagingValid ? 0 : kFirstFrameTimeoutMs, &info, &resource);
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+      if (output.stagingValid)
+        return S_OK;
+      continue;
+    }
+    if (FAILED(hr))
+      return hr;
+
+    // Only the pointer moved: the staging copy still holds this image
+    if (info.LastPresentTime.QuadPart == 0 && output.stagingValid) {
+      SafeRelease(resource);
+      output.duplication->ReleaseFrame();
+      return S_OK;
+    }
+
+    ID3D11Texture2D *texture = nullptr;
+    hr = resource->QueryInterface(__uuidof(ID3D11Texture2D),
+                                  reinterpret_cast<void **>(&texture));
+    if (SUCCEEDED(hr)) {
+      if (output.stagingValid)
+        CollectDirtyRects(output, info);
+      output.context->CopyResource(output.staging, texture);
+      output.stagingValid = true;
+      SafeRelease(texture);
+    }
+    SafeRelease(resource);
+    output.duplication->ReleaseFrame();
+    return hr;
+  }
+  return DXGI_ERROR_WAIT_TIMEOUT;
+}
+
+void DxgiCaptureBackend::CollectDirtyRects(
+    Output &output, const DXGI_OUTDUPL_FRAME_INFO &info) {
+  if (info.TotalMetadataBufferSize == 0) {
+    output.dirty.Invalidate(); // Changed, but not said where
+    return;
+  }
+  if (output.metadata.size() < info.TotalMetadataBufferSize)
+    output.metadata.resize(info.TotalMetadataBufferSize);
+
+  // Moved areas count as changed at their destination
+  UINT moveBytes = 0;
+  HRESULT hr = output.duplication->GetFrameMoveRects(
+      static_cast<UINT>(output.metadata.size()),
+      reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT *>(output.metadata.data()),
+      &moveBytes);
+  if (FAILED(hr)) {
+    output.dirty.Invalidate();
+    return;
+  }
+  const auto *moves =
+      reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT *>(output.metadata.data());
+  for (UINT i = 0; i < moveBytes / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i)
+    output.dirty.Add(FromRect(moves[i].DestinationRect));
+
+  UINT dirtyBytes = 0;
+  hr = output.duplication->GetFrameDirtyRects(
+      static_cast<UINT>(output.metadata.size()),
+      reinterpret_cast<RECT *>(output.metadata.data()), &dirtyBytes);
+  if (FAILED(hr)) {
+    output.dirty.Invalidate();
+    return;
+  }
+  const auto *dirty = reinterpret_cast<const RECT *>(output.metadata.data());
+  for (UINT i = 0; i < dirtyBytes / sizeof(RECT); ++i)
+    output.dirty.Add(FromRect(dirty[i]));
+}
+
+} // namespace invisible
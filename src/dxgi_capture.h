@@ -0,0 +1,70 @@
+#pragma once
+
+#include "capture_backend.h"
+#include "utils.h"
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// DXGI Desktop Duplication Capture Backend (Windows 8+)
+// Each monitor's desktop image is duplicated once and copied on the GPU
+// into a CPU-readable staging texture that is kept between captures. A
+// capture maps it and copies out just the region's rows; when the desktop
+// has not changed since the last capture, no frame is acquired at all and
+// the staging copy is read as it is. The dirty and move rectangles DXGI
+// reports are accumulated, so a capture of the same region as last time
+// says what changed. Windows with WDA_EXCLUDEFROMCAPTURE are left out, as
+// with GDI.
+// Regions must lie on one monitor that is not rotated; duplication is also
+// unavailable in some remote sessions and on the secure desktop. Capture()
+// returns false in those cases so the caller can fall back to GDI.
+// -----------------------------------------------------------------------------
+
+class DxgiCaptureBackend : public CaptureBackend {
+public:
+  // `pool` may be null (then every capture allocates)
+  explicit DxgiCaptureBackend(FrameBufferPool *pool);
+  ~DxgiCaptureBackend() override;
+
+  // Disable copy
+  DxgiCaptureBackend(const DxgiCaptureBackend &) = delete;
+  DxgiCaptureBackend &operator=(const DxgiCaptureBackend &) = delete;
+
+  const char *GetName() const override { return "dxgi"; }
+  bool Capture(const ImageRect &region, CaptureFrame &frame) override;
+  CaptureBackendStats GetStats() const override;
+
+  // False once duplication turned out not to work on this machine
+  bool IsAvailable() const;
+
+private:
+  struct Output;
+
+  bool EnumerateOutputs();
+  bool OpenDuplication(Output &output);
+  void CloseDuplication(Output &output);
+
+  // Bring output's staging texture up to date with the desktop
+  HRESULT UpdateStaging(Output &output);
+
+  // Add the frame's dirty and move rectangles to output's tracker
+  void CollectDirtyRects(Output &output, const DXGI_OUTDUPL_FRAME_INFO &info);
+
+  FrameBufferPool *pool_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Output>> outputs_;
+  bool enumerated_ = false;
+  bool available_ = true;
+  CaptureBackendStats stats_;
+};
+
+} // namespace invisible
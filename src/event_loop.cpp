@@ -0,0 +1,209 @@
+#include "event_loop.h"
+#include <algorithm>
+
+namespace invisible {
+
+namespace {
+
+// The loop whose thread this is (set for the thread's lifetime)
+thread_local const EventLoop *tls_currentLoop = nullptr;
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Start / Stop
+// -----------------------------------------------------------------------------
+
+EventLoop::~EventLoop() { Stop(); }
+
+bool EventLoop::Start(size_t workers, size_t urgentWorkers) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_)
+    return !stopping_;
+
+  workers = std::max<size_t>(workers, 1);
+  workerCount_ = workers;
+  urgentWorkers_ = std::min(urgentWorkers, workers - 1);
+  running_ = true;
+  stats_ = EventLoopStats();
+  stats_.threads = workers + 1;
+
+  for (size_t i = 0; i < workers; ++i) {
+    workers_.emplace_back(&EventLoop::WorkerProc, this);
+  }
+  timerThread_ = std::thread(&EventLoop::TimerProc, this);
+  return true;
+}
+
+void EventLoop::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || stopping_)
+      return;
+    stopping_ = true;
+    stats_.timersCancelled += timers_.size();
+    timers_.clear();
+    schedule_.clear();
+  }
+
+  // The timer thread first: a timer task running now may still post
+  timerCV_.notify_all();
+  if (timerThread_.joinable())
+    timerThread_.join();
+
+  // Then the workers, which leave once the queue is empty
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    draining_ = true;
+  }
+  taskCV_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable())
+      worker.join();
+  }
+  workers_.clear();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  running_ = false;
+  stopping_ = false;
+  draining_ = false;
+  stats_.threads = 0;
+}
+
+bool EventLoop::IsRunning() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_ && !stopping_;
+}
+
+bool EventLoop::IsLoopThread() const { return tls_currentLoop == this; }
+
+// -----------------------------------------------------------------------------
+// Tasks and Timers
+// -----------------------------------------------------------------------------
+
+bool EventLoop::Post(Task task, TaskPriority priority) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // While Stop() drains the queue only the tasks being run may add to it
+    if (!running_ || (stopping_ && tls_currentLoop != this))
+      return false;
+    tasks_[static_cast<size_t>(priority)].push_back(std::move(task));
+    stats_.posted++;
+    stats_.queued++;
+    stats_.peakQueued = std::max(stats_.peakQueued, stats_.queued);
+  }
+  taskCV_.notify_one();
+  return true;
+}
+
+EventLoop::TimerId EventLoop::PostAfter(uint32_t delayMs, Task task) {
+  TimerId id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || stopping_)
+      return 0;
+    id = nextTimer_++;
+    timers_.emplace(id, std::move(task));
+    schedule_.emplace(Clock::now() + std::chrono::milliseconds(delayMs), id);
+  }
+  timerCV_.notify_one();
+  return id;
+}
+
+bool EventLoop::CancelTimer(TimerId id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!timers_.erase(id))
+    return false;
+  for (auto it = schedule_.begin(); it != schedule_.end(); ++it) {
+    if (it->second == id) {
+      schedule_.erase(it);
+      break;
+    }
+  }
+  stats_.timersCancelled++;
+  return true;
+}
+
+EventLoopStats EventLoop::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+// -----------------------------------------------------------------------------
+// Threads
+// -----------------------------------------------------------------------------
+
+void EventLoop::WorkerProc() {
+  tls_currentLoop = this;
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  for (;;) {
+    std::deque<Task> *queue = nullptr;
+    taskCV_.wait(lock, [this, &queue] {
+      queue = NextQueue();
+      return queue || draining_;
+    });
+    if (!queue)
+      break; // Stopping and nothing left to run
+
+    Task task = std::move(queue->front());
+    queue->pop_front();
+    stats_.queued--;
+    busy_++;
+
+    lock.unlock();
+    task();
+    task = nullptr; // Release captures before taking the lock again
+    lock.lock();
+
+    busy_--;
+    stats_.completed++;
+  }
+}
+
+// The queue to take the next task from, or null when none may start now.
+// While draining the reserved workers help run whatever is left.
+std::deque<EventLoop::Task> *EventLoop::NextQueue() {
+  for (size_t priority = 0; priority < kPriorities; ++priority) {
+    if (tasks_[priority].empty())
+      continue;
+    if (priority == static_cast<size_t>(TaskPriority::Urgent) || draining_ ||
+        busy_ + urgentWorkers_ < workerCount_)
+      return &tasks_[priority];
+    return nullptr; // Lower priorities wait for the same free worker
+  }
+  return nullptr;
+}
+
+void EventLoop::TimerProc() {
+  tls_currentLoop = this;
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (!stopping_) {
+    if (schedule_.empty()) {
+      timerCV_.wait(lock);
+      continue;
+    }
+
+    // A copy: CancelTimer() may erase the entry while this thread waits
+    auto next = schedule_.begin();
+    Clock::time_point due = next->first;
+    if (Clock::now() < due) {
+      timerCV_.wait_until(lock, due);
+      continue; // Re-check: cancelled, sooner timer, or stopping
+    }
+
+    auto timer = timers_.find(next->second);
+    Task task = std::move(timer->second);
+    timers_.erase(timer);
+    schedule_.erase(next);
+    stats_.timersFired++;
+
+    lock.unlock();
+    task();
+    task = nullptr;
+    lock.lock();
+  }
+}
+
+} // namespace invisible
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Task Priority
+// Queued tasks start highest priority first, in posting order within a
+// priority. Workers held back by Start() only ever run Urgent tasks.
+// -----------------------------------------------------------------------------
+
+enum class TaskPriority { Urgent, Normal, Background };
+
+// -----------------------------------------------------------------------------
+// Event Loop Statistics
+// -----------------------------------------------------------------------------
+
+struct EventLoopStats {
+  uint64_t posted = 0;     // Tasks queued with Post()
+  uint64_t completed = 0;  // Tasks that have run
+  uint64_t timersFired = 0;
+  uint64_t timersCancelled = 0;
+  size_t queued = 0;       // Waiting for a worker right now
+  size_t peakQueued = 0;
+  size_t threads = 0;      // Workers plus the timer thread
+};
+
+// -----------------------------------------------------------------------------
+// Event Loop
+// A fixed set of threads that services asynchronous work: Post() queues a
+// task for the next free worker, PostAfter() runs one on the timer thread
+// once a delay has passed (deadlines, retries). However many operations
+// are outstanding, the thread count stays what Start() was given; extra
+// tasks wait in the queue, Urgent ones ahead of the rest. The timer thread
+// never runs posted tasks, so a deadline still fires while every worker is
+// busy; timer tasks should only flip state and hand real work back to
+// Post().
+// -----------------------------------------------------------------------------
+
+class EventLoop {
+public:
+  using Task = std::function<void()>;
+  using TimerId = uint64_t; // 0 = none
+
+  EventLoop() = default;
+  ~EventLoop();
+
+  // Disable copy
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  // Start `workers` worker threads (at least one) and the timer thread.
+  // `urgentWorkers` of them (at most workers - 1) are kept for Urgent
+  // tasks: other tasks start only while more workers than that are free.
+  bool Start(size_t workers, size_t urgentWorkers = 0);
+
+  // Refuse new work, run the tasks already queued, drop pending timers and
+  // join every thread. Must not be called from a loop thread.
+  void Stop();
+
+  bool IsRunning() const;
+
+  // True on one of this loop's threads
+  bool IsLoopThread() const;
+
+  // Queue `task` for a worker; false (task dropped) when not running
+  bool Post(Task task, TaskPriority priority = TaskPriority::Normal);
+
+  // Run `task` on the timer thread after `delayMs`; 0 when not running
+  TimerId PostAfter(uint32_t delayMs, Task task);
+
+  // Drop a timer that has not fired yet; false if it already ran (or is
+  // running now) or is unknown
+  bool CancelTimer(TimerId id);
+
+  EventLoopStats GetStats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kPriorities = 3;
+
+  void WorkerProc();
+  void TimerProc();
+  std::deque<Task> *NextQueue();
+
+  mutable std::mutex mutex_;
+  std::condition_variable taskCV_;  // Workers wait for tasks
+  std::condition_variable timerCV_; // Timer thread waits for the next due
+  std::deque<Task> tasks_[kPriorities]; // By TaskPriority
+  std::map<TimerId, Task> timers_;
+  std::set<std::pair<Clock::time_point, TimerId>> schedule_; // Soonest first
+  TimerId nextTimer_ = 1;
+  size_t workerCount_ = 0;
+  size_t urgentWorkers_ = 0;
+  size_t busy_ = 0; // Workers running a task
+  bool running_ = false;
+  bool stopping_ = false; // No new tasks from outside, no new timers
+  bool draining_ = false; // Workers exit once the queue is empty
+  EventLoopStats stats_;
+
+  std::vector<std::thread> workers_;
+  std::thread timerThread_;
+};
+
+} // namespace invisible
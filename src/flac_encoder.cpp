@@ -0,0 +1,636 @@
+#include "flac_encoder.h"
+#include <algorithm>
+#include <cmath>
+
+namespace invisible {
+
+namespace {
+
+constexpr int kBitsPerSample = 16;
+constexpr int kMaxRiceParameter = 14; // 15 is the escape code
+constexpr int kMaxPartitionOrder = 8;
+constexpr int kMaxLpcOrder = 32;
+
+// -----------------------------------------------------------------------------
+// CRC-8 (poly 0x07, frame header) and CRC-16 (poly 0x8005, whole frame)
+// -----------------------------------------------------------------------------
+
+struct CrcTables {
+  uint8_t crc8[256];
+  uint16_t crc16[256];
+
+  CrcTables() {
+    for (int i = 0; i < 256; ++i) {
+      uint8_t c8 = static_cast<uint8_t>(i);
+      uint16_t c16 = static_cast<uint16_t>(i << 8);
+      for (int bit = 0; bit < 8; ++bit) {
+        c8 = static_cast<uint8_t>((c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1);
+        c16 = static_cast<uint16_t>((c16 & 0x8000) ? (c16 << 1) ^ 0x8005
+                                                   : c16 << 1);
+      }
+      crc8[i] = c8;
+      crc16[i] = c16;
+    }
+  }
+};
+
+const CrcTables &Crc() {
+  static const CrcTables tables;
+  return tables;
+}
+
+uint8_t Crc8(const uint8_t *data, size_t size) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    crc = Crc().crc8[crc ^ data[i]];
+  }
+  return crc;
+}
+
+uint16_t Crc16(const uint8_t *data, size_t size) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    crc = static_cast<uint16_t>((crc << 8) ^ Crc().crc16[(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+// -----------------------------------------------------------------------------
+// Bitstream Output (MSB first, no stuffing)
+// -----------------------------------------------------------------------------
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+  // Append the low `count` (0-32) bits of `bits`
+  void Put(uint32_t bits, int count) {
+    if (count == 0)
+      return;
+    uint64_t mask = (uint64_t(1) << count) - 1;
+    buffer_ = (buffer_ << count) | (bits & mask);
+    count_ += count;
+    while (count_ >= 8) {
+      count_ -= 8;
+      out_.push_back(static_cast<uint8_t>(buffer_ >> count_));
+    }
+  }
+
+  void PutSigned(int32_t value, int count) {
+    Put(static_cast<uint32_t>(value), count);
+  }
+
+  void PutZeros(uint32_t count) {
+    for (; count >= 32; count -= 32) {
+      Put(0, 32);
+    }
+    Put(0, static_cast<int>(count));
+  }
+
+  // Unary quotient (zeros closed by a one), then the low k bits
+  void PutRice(uint32_t folded, int k) {
+    uint32_t quotient = folded >> k;
+    uint32_t tail = (1u << k) | (folded & ((1u << k) - 1));
+    if (quotient + 1 + k <= 32) {
+      Put(tail, static_cast<int>(quotient) + 1 + k);
+    } else {
+      PutZeros(quotient);
+      Put(tail, k + 1);
+    }
+  }
+
+  // Frame number / sample number coding (extended UTF-8, up to 36 bits)
+  void PutUtf8(uint64_t value) {
+    if (value < 0x80) {
+      Put(static_cast<uint32_t>(value), 8);
+      return;
+    }
+    int bytes = 2;
+    while (bytes < 7 && value >= (uint64_t(1) << (5 * bytes + 1))) {
+      ++bytes;
+    }
+    uint32_t lead = (0xFF00u >> bytes) & 0xFF;
+    Put(lead | static_cast<uint32_t>(value >> (6 * (bytes - 1))), 8);
+    for (int i = bytes - 2; i >= 0; --i) {
+      Put(0x80 | static_cast<uint32_t>((value >> (6 * i)) & 0x3F), 8);
+    }
+  }
+
+  void AlignToByte() {
+    if (count_ > 0) {
+      Put(0, 8 - count_);
+    }
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint64_t buffer_ = 0;
+  int count_ = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Frame Header Codes
+// -----------------------------------------------------------------------------
+
+// 4-bit block size code; 6/7 mean "8/16-bit (size - 1) follows the header"
+int BlockSizeCode(uint32_t size) {
+  if (size == 192)
+    return 1;
+  for (int code = 2; code <= 5; ++code) {
+    if (size == 576u << (code - 2))
+      return code;
+  }
+  for (int code = 8; code <= 15; ++code) {
+    if (size == 256u << (code - 8))
+      return code;
+  }
+  return size <= 256 ? 6 : 7;
+}
+
+// 4-bit sample rate code; 12-14 carry the rate after the header, 0 defers
+// to STREAMINFO
+int SampleRateCode(uint32_t rate) {
+  static const uint32_t kRates[] = {0,     88200, 176400, 192000,
+                                    8000,  16000, 22050,  24000,
+                                    32000, 44100, 48000,  96000};
+  for (int code = 1; code < 12; ++code) {
+    if (rate == kRates[code])
+      return code;
+  }
+  if (rate % 1000 == 0 && rate / 1000 <= 255)
+    return 12;
+  if (rate <= 65535)
+    return 13;
+  if (rate % 10 == 0 && rate / 10 <= 65535)
+    return 14;
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Residual Coding Plan
+// -----------------------------------------------------------------------------
+
+inline uint32_t Fold(int32_t residual) {
+  return (static_cast<uint32_t>(residual) << 1) ^
+         static_cast<uint32_t>(residual >> 31);
+}
+
+struct ResidualPlan {
+  int partitionOrder = 0;
+  uint8_t parameters[1 << kMaxPartitionOrder] = {};
+  uint64_t bits = 0; // Coding method + order + every partition
+};
+
+// Cheapest Rice parameter for `count` folded values summing to `sum`.
+// Cost estimate: unary quotients (~sum >> k) plus a stop bit and k bits each.
+int ChooseRiceParameter(uint64_t sum, uint32_t count, uint64_t &bits) {
+  int guess = 0;
+  while (guess < kMaxRiceParameter && (uint64_t(count) << (guess + 1)) < sum) {
+    ++guess;
+  }
+
+  int best = guess;
+  bits = UINT64_MAX;
+  for (int k = std::max(guess - 1, 0);
+       k <= std::min(guess + 1, kMaxRiceParameter); ++k) {
+    uint64_t cost = uint64_t(count) * (k + 1) + (sum >> k);
+    if (cost < bits) {
+      bits = cost;
+      best = k;
+    }
+  }
+  return best;
+}
+
+// Pick the partition order (and Rice parameter per partition) with the
+// smallest estimated size. Partition 0 skips the `order` warm-up samples.
+void PlanResidual(const uint32_t *folded, uint32_t blockSize, int order,
+                  int maxPartitionOrder, uint64_t *sums, ResidualPlan &plan) {
+  int top = std::min(maxPartitionOrder, kMaxPartitionOrder);
+  while (top > 0 && ((blockSize & ((1u << top) - 1)) != 0 ||
+                     (blockSize >> top) <= static_cast<uint32_t>(order))) {
+    --top;
+  }
+
+  // Sums at the finest order; coarser orders merge neighbours
+  uint32_t partitions = 1u << top;
+  uint32_t length = blockSize >> top;
+  for (uint32_t p = 0; p < partitions; ++p) {
+    uint32_t begin = p == 0 ? static_cast<uint32_t>(order) : p * length;
+    uint32_t end = (p + 1) * length;
+    uint64_t sum = 0;
+    for (uint32_t i = begin; i < end; ++i) {
+      sum += folded[i];
+    }
+    sums[p] = sum;
+  }
+
+  plan.bits = UINT64_MAX;
+  for (int po = top; po >= 0; --po) {
+    partitions = 1u << po;
+    length = blockSize >> po;
+
+    uint64_t bits = 2 + 4;
+    uint8_t parameters[1 << kMaxPartitionOrder];
+    for (uint32_t p = 0; p < partitions; ++p) {
+      uint32_t count = p == 0 ? length - order : length;
+      uint64_t cost;
+      parameters[p] =
+          static_cast<uint8_t>(ChooseRiceParameter(sums[p], count, cost));
+      bits += 4 + cost;
+    }
+
+    if (bits < plan.bits) {
+      plan.bits = bits;
+      plan.partitionOrder = po;
+      std::copy(parameters, parameters + partitions, plan.parameters);
+    }
+
+    for (uint32_t p = 0; p < partitions / 2; ++p) {
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+  }
+}
+
+void WriteResidual(BitWriter &writer, const uint32_t *folded,
+                   uint32_t blockSize, int order, const ResidualPlan &plan) {
+  writer.Put(0, 2); // Rice, 4-bit parameters
+  writer.Put(static_cast<uint32_t>(plan.partitionOrder), 4);
+
+  uint32_t partitions = 1u << plan.partitionOrder;
+  uint32_t length = blockSize >> plan.partitionOrder;
+  for (uint32_t p = 0; p < partitions; ++p) {
+    int k = plan.parameters[p];
+    writer.Put(static_cast<uint32_t>(k), 4);
+    uint32_t begin = p == 0 ? static_cast<uint32_t>(order) : p * length;
+    uint32_t end = (p + 1) * length;
+    for (uint32_t i = begin; i < end; ++i) {
+      writer.PutRice(folded[i], k);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Prediction
+// -----------------------------------------------------------------------------
+
+// Fixed polynomial predictors of order 0-4 (binomial differences)
+void FixedResidual(const int32_t *x, uint32_t n, int order, uint32_t *folded) {
+  for (uint32_t i = order; i < n; ++i) {
+    int32_t r;
+    switch (order) {
+    case 0:
+      r = x[i];
+      break;
+    case 1:
+      r = x[i] - x[i - 1];
+      break;
+    case 2:
+      r = x[i] - 2 * x[i - 1] + x[i - 2];
+      break;
+    case 3:
+      r = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+      break;
+    default:
+      r = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+      break;
+    }
+    folded[i] = Fold(r);
+  }
+}
+
+// Tukey(0.5)-windowed autocorrelation for lags 0..maxLag
+void Autocorrelation(const int32_t *x, uint32_t n, int maxLag,
+                     std::vector<double> &windowed, double *autoc) {
+  windowed.resize(n);
+  const double pi = 3.14159265358979323846;
+  uint32_t taper = n / 4;
+  for (uint32_t i = 0; i < n; ++i) {
+    double w = 1.0;
+    if (i < taper) {
+      w = 0.5 - 0.5 * std::cos(pi * i / taper);
+    } else if (i >= n - taper) {
+      w = 0.5 - 0.5 * std::cos(pi * (n - 1 - i) / taper);
+    }
+    windowed[i] = x[i] * w;
+  }
+
+  for (int lag = 0; lag <= maxLag; ++lag) {
+    double sum = 0.0;
+    for (uint32_t i = lag; i < n; ++i) {
+      sum += windowed[i] * windowed[i - lag];
+    }
+    autoc[lag] = sum;
+  }
+}
+
+// Levinson-Durbin recursion. Row m-1 of `lpc` receives the order-m
+// predictor, x[i] ~= sum(lpc[j] * x[i-1-j]). Returns the highest order
+// reached before the prediction error vanished.
+int LevinsonDurbin(const double *autoc, int maxOrder,
+                   double lpc[kMaxLpcOrder][kMaxLpcOrder]) {
+  double a[kMaxLpcOrder] = {};
+  double error = autoc[0];
+
+  for (int m = 0; m < maxOrder; ++m) {
+    if (error <= 0.0)
+      return m;
+
+    double acc = autoc[m + 1];
+    for (int j = 0; j < m; ++j) {
+      acc -= a[j] * autoc[m - j];
+    }
+    double k = acc / error;
+
+    double previous[kMaxLpcOrder];
+    std::copy(a, a + m, previous);
+    for (int j = 0; j < m; ++j) {
+      a[j] = previous[j] - k * previous[m - 1 - j];
+    }
+    a[m] = k;
+    error *= 1.0 - k * k;
+
+    std::copy(a, a + m + 1, lpc[m]);
+  }
+  return maxOrder;
+}
+
+// Quantize to `precision`-bit coefficients with a common right shift,
+// carrying the rounding error forward (same scheme as the reference coder)
+bool QuantizeLpc(const double *lpc, int order, int precision, int32_t *qlp,
+                 int &shift) {
+  double cmax = 0.0;
+  for (int i = 0; i < order; ++i) {
+    cmax = std::max(cmax, std::fabs(lpc[i]));
+  }
+  if (cmax <= 0.0)
+    return false;
+
+  int log2cmax;
+  std::frexp(cmax, &log2cmax);
+  shift = (precision - 1) - log2cmax;
+  if (shift < 0)
+    return false; // Coefficients too large for a non-negative shift
+  shift = std::min(shift, 15);
+
+  const int32_t maxCoef = (1 << (precision - 1)) - 1;
+  const int32_t minCoef = -(1 << (precision - 1));
+  double error = 0.0;
+  for (int i = 0; i < order; ++i) {
+    error += lpc[i] * (1 << shift);
+    int32_t q = static_cast<int32_t>(std::lround(error));
+    q = std::max(minCoef, std::min(maxCoef, q));
+    error -= q;
+    qlp[i] = q;
+  }
+  return true;
+}
+
+bool LpcResidual(const int32_t *x, uint32_t n, const int32_t *qlp, int order,
+                 int shift, uint32_t *folded) {
+  for (uint32_t i = order; i < n; ++i) {
+    int64_t sum = 0;
+    for (int j = 0; j < order; ++j) {
+      sum += int64_t(qlp[j]) * x[i - 1 - j];
+    }
+    int64_t r = x[i] - (sum >> shift);
+    if (r > (1 << 30) || r < -(1 << 30))
+      return false;
+    folded[i] = Fold(static_cast<int32_t>(r));
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Subframe
+// -----------------------------------------------------------------------------
+
+struct SubframeScratch {
+  std::vector<uint32_t> folded;
+  std::vector<uint32_t> bestFolded;
+  std::vector<double> windowed;
+  uint64_t sums[1 << kMaxPartitionOrder];
+};
+
+void EncodeSubframe(BitWriter &writer, const int32_t *x, uint32_t n,
+                    const FlacEncoderConfig &config, SubframeScratch &s) {
+  // Constant (digital silence is common between utterances)
+  if (std::all_of(x, x + n, [&](int32_t v) { return v == x[0]; })) {
+    writer.Put(0x00, 8);
+    writer.PutSigned(x[0], kBitsPerSample);
+    return;
+  }
+
+  enum { VERBATIM, FIXED, LPC } bestType = VERBATIM;
+  uint64_t bestBits = uint64_t(n) * kBitsPerSample;
+  int bestOrder = 0;
+  int32_t bestQlp[kMaxLpcOrder] = {};
+  int bestShift = 0;
+  ResidualPlan bestPlan;
+  ResidualPlan plan;
+
+  s.folded.resize(n);
+  s.bestFolded.resize(n);
+
+  auto keep = [&](uint64_t bits, int order) {
+    bestBits = bits;
+    bestOrder = order;
+    bestPlan = plan;
+    s.folded.swap(s.bestFolded);
+  };
+
+  // Fixed polynomial predictors
+  for (int order = 0; order <= 4 && static_cast<uint32_t>(order) < n;
+       ++order) {
+    FixedResidual(x, n, order, s.folded.data());
+    PlanResidual(s.folded.data(), n, order, config.maxPartitionOrder, s.sums,
+                 plan);
+    uint64_t bits = uint64_t(order) * kBitsPerSample + plan.bits;
+    if (bits < bestBits) {
+      keep(bits, order);
+      bestType = FIXED;
+    }
+  }
+
+  // Quantized LPC from the windowed autocorrelation
+  int maxOrder = std::min(config.maxLpcOrder, kMaxLpcOrder);
+  if (maxOrder > 0 && n > static_cast<uint32_t>(maxOrder) * 2) {
+    double autoc[kMaxLpcOrder + 1];
+    double lpc[kMaxLpcOrder][kMaxLpcOrder];
+    Autocorrelation(x, n, maxOrder, s.windowed, autoc);
+    int reached = LevinsonDurbin(autoc, maxOrder, lpc);
+
+    const int precision = std::max(5, std::min(15, config.qlpPrecision));
+    for (int order = 1; order <= reached; ++order) {
+      int32_t qlp[kMaxLpcOrder];
+      int shift;
+      if (!QuantizeLpc(lpc[order - 1], order, precision, qlp, shift))
+        continue;
+      if (!LpcResidual(x, n, qlp, order, shift, s.folded.data()))
+        continue;
+      PlanResidual(s.folded.data(), n, order, config.maxPartitionOrder,
+                   s.sums, plan);
+      uint64_t bits = uint64_t(order) * kBitsPerSample + 4 + 5 +
+                      uint64_t(order) * precision + plan.bits;
+      if (bits < bestBits) {
+        keep(bits, order);
+        bestType = LPC;
+        std::copy(qlp, qlp + order, bestQlp);
+        bestShift = shift;
+      }
+    }
+  }
+
+  switch (bestType) {
+  case VERBATIM:
+    writer.Put(0x02, 8); // 0 | 000001 | no wasted bits
+    for (uint32_t i = 0; i < n; ++i) {
+      writer.PutSigned(x[i], kBitsPerSample);
+    }
+    break;
+
+  case FIXED:
+    writer.Put(0, 1);
+    writer.Put(0x08 | static_cast<uint32_t>(bestOrder), 6);
+    writer.Put(0, 1);
+    for (int i = 0; i < bestOrder; ++i) {
+      writer.PutSigned(x[i], kBitsPerSample);
+    }
+    WriteResidual(writer, s.bestFolded.data(), n, bestOrder, bestPlan);
+    break;
+
+  case LPC: {
+    const int precision = std::max(5, std::min(15, config.qlpPrecision));
+    writer.Put(0, 1);
+    writer.Put(0x20 | static_cast<uint32_t>(bestOrder - 1), 6);
+    writer.Put(0, 1);
+    for (int i = 0; i < bestOrder; ++i) {
+      writer.PutSigned(x[i], kBitsPerSample);
+    }
+    writer.Put(static_cast<uint32_t>(precision - 1), 4);
+    writer.PutSigned(bestShift, 5);
+    for (int i = 0; i < bestOrder; ++i) {
+      writer.PutSigned(bestQlp[i], precision);
+    }
+    WriteResidual(writer, s.bestFolded.data(), n, bestOrder, bestPlan);
+    break;
+  }
+  }
+}
+
+void PutU24(uint8_t *p, uint32_t value) {
+  p[0] = static_cast<uint8_t>(value >> 16);
+  p[1] = static_cast<uint8_t>(value >> 8);
+  p[2] = static_cast<uint8_t>(value);
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Constructor
+// -----------------------------------------------------------------------------
+
+FlacEncoder::FlacEncoder(const FlacEncoderConfig &config) : config_(config) {
+  config_.blockSize = std::max(16u, std::min(65535u, config_.blockSize));
+  config_.maxLpcOrder = std::max(0, std::min(kMaxLpcOrder, config_.maxLpcOrder));
+  config_.qlpPrecision = std::max(5, std::min(15, config_.qlpPrecision));
+  config_.maxPartitionOrder =
+      std::max(0, std::min(kMaxPartitionOrder, config_.maxPartitionOrder));
+}
+
+// -----------------------------------------------------------------------------
+// Encode
+// -----------------------------------------------------------------------------
+
+bool FlacEncoder::EncodePcm16(const int16_t *samples, size_t frames,
+                              uint32_t sampleRate, uint16_t channels,
+                              std::vector<uint8_t> &out) const {
+  if (!samples || frames == 0 || channels < 1 || channels > 8 ||
+      sampleRate == 0 || sampleRate > 655350 ||
+      frames >= (uint64_t(1) << 36)) {
+    return false;
+  }
+
+  const uint32_t blockSize = config_.blockSize;
+  out.reserve(out.size() + frames * channels + 64);
+
+  // "fLaC" + STREAMINFO (last metadata block); frame sizes patched below
+  const size_t streamInfo = out.size() + 8;
+  out.insert(out.end(), {'f', 'L', 'a', 'C', 0x80, 0x00, 0x00, 34});
+  {
+    BitWriter writer(out);
+    writer.Put(blockSize, 16); // Minimum block size (last block excepted)
+    writer.Put(blockSize, 16); // Maximum block size
+    writer.Put(0, 24);         // Minimum frame size
+    writer.Put(0, 24);         // Maximum frame size
+    writer.Put(sampleRate, 20);
+    writer.Put(channels - 1u, 3);
+    writer.Put(kBitsPerSample - 1, 5);
+    writer.Put(static_cast<uint32_t>(uint64_t(frames) >> 32), 4);
+    writer.Put(static_cast<uint32_t>(frames), 32);
+    for (int i = 0; i < 4; ++i) {
+      writer.Put(0, 32); // MD5 of the audio: not computed
+    }
+  }
+
+  const int rateCode = SampleRateCode(sampleRate);
+  std::vector<int32_t> channel(std::min<size_t>(frames, blockSize));
+  SubframeScratch scratch;
+  uint32_t minFrameBytes = UINT32_MAX;
+  uint32_t maxFrameBytes = 0;
+
+  uint64_t frameNumber = 0;
+  for (size_t start = 0; start < frames; start += blockSize, ++frameNumber) {
+    const uint32_t n =
+        static_cast<uint32_t>(std::min<size_t>(blockSize, frames - start));
+    const int sizeCode = BlockSizeCode(n);
+    const size_t frameStart = out.size();
+
+    BitWriter writer(out);
+    writer.Put(0x3FFE, 14); // Sync
+    writer.Put(0, 1);
+    writer.Put(0, 1); // Fixed block size: header carries the frame number
+    writer.Put(static_cast<uint32_t>(sizeCode), 4);
+    writer.Put(static_cast<uint32_t>(rateCode), 4);
+    writer.Put(channels - 1u, 4); // Independent channels
+    writer.Put(4, 3);             // 16 bits per sample
+    writer.Put(0, 1);
+    writer.PutUtf8(frameNumber);
+    if (sizeCode == 6) {
+      writer.Put(n - 1, 8);
+    } else if (sizeCode == 7) {
+      writer.Put(n - 1, 16);
+    }
+    if (rateCode == 12) {
+      writer.Put(sampleRate / 1000, 8);
+    } else if (rateCode == 13) {
+      writer.Put(sampleRate, 16);
+    } else if (rateCode == 14) {
+      writer.Put(sampleRate / 10, 16);
+    }
+    out.push_back(Crc8(out.data() + frameStart, out.size() - frameStart));
+
+    const int16_t *block = samples + start * channels;
+    for (uint16_t ch = 0; ch < channels; ++ch) {
+      for (uint32_t i = 0; i < n; ++i) {
+        channel[i] = block[static_cast<size_t>(i) * channels + ch];
+      }
+      EncodeSubframe(writer, channel.data(), n, config_, scratch);
+    }
+
+    writer.AlignToByte();
+    uint16_t crc = Crc16(out.data() + frameStart, out.size() - frameStart);
+    out.push_back(static_cast<uint8_t>(crc >> 8));
+    out.push_back(static_cast<uint8_t>(crc & 0xFF));
+
+    uint32_t frameBytes = static_cast<uint32_t>(out.size() - frameStart);
+    minFrameBytes = std::min(minFrameBytes, frameBytes);
+    maxFrameBytes = std::max(maxFrameBytes, frameBytes);
+  }
+
+  PutU24(&out[streamInfo + 4], minFrameBytes);
+  PutU24(&out[streamInfo + 7], maxFrameBytes);
+  return true;
+}
+
+} // namespace invisible
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// FLAC Encoder Configuration
+// -----------------------------------------------------------------------------
+
+struct FlacEncoderConfig {
+  uint32_t blockSize = 4096;  // Samples per channel per frame (16-65535)
+  int maxLpcOrder = 8;        // 0: fixed polynomial predictors only (max 32)
+  int qlpPrecision = 12;      // Bits per quantized LPC coefficient (5-15)
+  int maxPartitionOrder = 6;  // Rice partition search depth (0-8)
+};
+
+// -----------------------------------------------------------------------------
+// Lossless FLAC Encoder
+// Writes a standard .flac stream (fLaC marker, STREAMINFO, fixed-blocksize
+// frames) from interleaved 16-bit PCM. Each channel of each frame is coded
+// as the smallest of a constant, verbatim, fixed-order (0-4) or quantized
+// LPC subframe, with Rice-coded residuals split into the partition order
+// that costs the fewest bits. Channels are coded independently and the
+// STREAMINFO MD5 is left zero ("not computed"), which decoders accept.
+// -----------------------------------------------------------------------------
+
+class FlacEncoder {
+public:
+  explicit FlacEncoder(const FlacEncoderConfig &config = FlacEncoderConfig());
+
+  // Encode `frames` interleaved frames of `channels` (1-8) 16-bit samples.
+  // Appends the complete .flac file to `out`.
+  bool EncodePcm16(const int16_t *samples, size_t frames, uint32_t sampleRate,
+                   uint16_t channels, std::vector<uint8_t> &out) const;
+
+  const FlacEncoderConfig &GetConfig() const { return config_; }
+
+private:
+  FlacEncoderConfig config_;
+};
+
+} // namespace invisible
@@ -0,0 +1,346 @@
+#include "frame_index.h"
+#include "simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+constexpr int kMinTileSize = 8;
+constexpr int kMaxTileSize = 128;
+
+// One 16-byte key per 4 pixels of a row; wider blocks reuse them
+constexpr int kKeyVectors = 32;
+constexpr uint64_t kGolden = 0x9e3779b97f4a7c15ull;
+
+inline uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+struct HashKeys {
+  alignas(16) uint64_t words[kKeyVectors * 2];
+
+  HashKeys() {
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (uint64_t &word : words) {
+      state += kGolden;
+      word = Avalanche(state);
+    }
+  }
+};
+
+const HashKeys &GetHashKeys() {
+  static const HashKeys keys;
+  return keys;
+}
+
+// Every row gets its own salt, so swapping rows changes the hash
+inline uint64_t RowSalt(int y) {
+  return (static_cast<uint64_t>(y) + 1) * kGolden;
+}
+
+// Eight 64-bit lanes. Each 16 bytes of a row are XORed with their key and
+// the row salt; each 64-bit half adds the product of its two 32-bit words
+// to one lane and its unkeyed value to the other lane of the pair. Bytes
+// v * 16 of a row go to lane pair v % 4.
+#if INVISIBLE_HAVE_SSE2
+inline __m128i AccumulateVector(__m128i acc, const uint8_t *p, __m128i key,
+                                __m128i salt) {
+  const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+  __m128i data = _mm_and_si128(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), colorMask);
+  __m128i keyed = _mm_xor_si128(data, _mm_xor_si128(key, salt));
+  __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+  __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm_add_epi64(acc, _mm_add_epi64(product, swapped));
+}
+
+void AccumulateBlock(const uint8_t *pixels, int stride, int width, int height,
+                     uint64_t lanes[8]) {
+  const __m128i *keys =
+      reinterpret_cast<const __m128i *>(GetHashKeys().words);
+  const int vectors = width / 4;
+  const int rest = (width % 4) * 4;
+
+  __m128i a0 = _mm_setzero_si128();
+  __m128i a1 = _mm_setzero_si128();
+  __m128i a2 = _mm_setzero_si128();
+  __m128i a3 = _mm_setzero_si128();
+  alignas(16) uint8_t tail[16] = {};
+
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *row = pixels + static_cast<ptrdiff_t>(y) * stride;
+    const __m128i salt = _mm_set1_epi64x(static_cast<long long>(RowSalt(y)));
+    int v = 0;
+    for (; v + 4 <= vectors; v += 4) {
+      const uint8_t *p = row + v * 16;
+      a0 = AccumulateVector(a0, p, keys[v % kKeyVectors], salt);
+      a1 = AccumulateVector(a1, p + 16, keys[(v + 1) % kKeyVectors], salt);
+      a2 = AccumulateVector(a2, p + 32, keys[(v + 2) % kKeyVectors], salt);
+      a3 = AccumulateVector(a3, p + 48, keys[(v + 3) % kKeyVectors], salt);
+    }
+    for (; v < vectors + (rest ? 1 : 0); ++v) {
+      const uint8_t *p = row + v * 16;
+      if (v == vectors) {
+        memcpy(tail, p, rest); // Bytes past the block stay zero
+        p = tail;
+      }
+      __m128i key = keys[v % kKeyVectors];
+      switch (v % 4) {
+      case 0:
+        a0 = AccumulateVector(a0, p, key, salt);
+        break;
+      case 1:
+        a1 = AccumulateVector(a1, p, key, salt);
+        break;
+      case 2:
+        a2 = AccumulateVector(a2, p, key, salt);
+        break;
+      default:
+        a3 = AccumulateVector(a3, p, key, salt);
+        break;
+      }
+    }
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), a0);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + 2), a1);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + 4), a2);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + 6), a3);
+}
+#else
+constexpr uint64_t kColorMask = 0x00FFFFFF00FFFFFFull; // Alpha bytes cleared
+
+inline uint64_t Load64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, 8);
+  return value;
+}
+
+void AccumulateBlock(const uint8_t *pixels, int stride, int width, int height,
+                     uint64_t lanes[8]) {
+  const uint64_t *keys = GetHashKeys().words;
+  const int vectors = width / 4;
+  const int rest = (width % 4) * 4;
+  uint8_t tail[16] = {};
+
+  std::fill(lanes, lanes + 8, 0);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *row = pixels + static_cast<ptrdiff_t>(y) * stride;
+    const uint64_t salt = RowSalt(y);
+    for (int v = 0; v < vectors + (rest ? 1 : 0); ++v) {
+      const uint8_t *p = row + v * 16;
+      if (v == vectors) {
+        memcpy(tail, p, rest);
+        p = tail;
+      }
+      const uint64_t *key = keys + 2 * (v % kKeyVectors);
+      uint64_t d0 = Load64(p) & kColorMask;
+      uint64_t d1 = Load64(p + 8) & kColorMask;
+      uint64_t k0 = d0 ^ key[0] ^ salt;
+      uint64_t k1 = d1 ^ key[1] ^ salt;
+      uint64_t *pair = lanes + 2 * (v % 4);
+      pair[0] += (k0 & 0xFFFFFFFFu) * (k0 >> 32) + d1;
+      pair[1] += (k1 & 0xFFFFFFFFu) * (k1 >> 32) + d0;
+    }
+  }
+}
+#endif
+
+// Captured at the same place with the same size (tiles line up)
+bool SameView(const FrameSignature &a, const FrameSignature &b) {
+  return a.placement.x == b.placement.x && a.placement.y == b.placement.y &&
+         a.placement.width == b.placement.width &&
+         a.placement.height == b.placement.height &&
+         a.tileSize == b.tileSize;
+}
+
+} // namespace
+
+FrameIndex::FrameIndex(const FrameIndexConfig &config) : config_(config) {
+  config_.tileSize =
+      std::clamp((config_.tileSize + 3) / 4 * 4, kMinTileSize, kMaxTileSize);
+  config_.maxFrames = std::max<size_t>(config_.maxFrames, 1);
+  config_.deltaMargin = std::max(config_.deltaMargin, 0);
+}
+
+bool FrameIndex::HasSimd() { return INVISIBLE_HAVE_SSE2 != 0; }
+
+// -----------------------------------------------------------------------------
+// Hashing
+// -----------------------------------------------------------------------------
+
+uint64_t FrameIndex::HashBlock(const uint8_t *pixels, int stride, int width,
+                               int height) {
+  uint64_t lanes[8];
+  AccumulateBlock(pixels, stride, width, height, lanes);
+
+  uint64_t h = Avalanche((static_cast<uint64_t>(width) << 32) ^
+                         static_cast<uint64_t>(height) ^ kGolden);
+  for (int i = 0; i < 8; ++i) {
+    h ^= Avalanche(lanes[i] + static_cast<uint64_t>(i) * kGolden);
+    h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+  }
+  return Avalanche(h);
+}
+
+void FrameIndex::HashTiles(const uint8_t *pixels, int stride,
+                           const ImageRect &placement, int tileSize,
+                           FrameSignature &signature) {
+  signature.placement = placement;
+  signature.tileSize = tileSize;
+  signature.tilesX = (placement.width + tileSize - 1) / tileSize;
+  signature.tilesY = (placement.height + tileSize - 1) / tileSize;
+  signature.tiles.resize(static_cast<size_t>(signature.tilesX) *
+                         signature.tilesY);
+
+  // A tile at a time: its rows are a few cache lines each, and the hash
+  // state stays in registers
+  uint64_t *out = signature.tiles.data();
+  for (int y = 0; y < placement.height; y += tileSize) {
+    const int rows = std::min(tileSize, placement.height - y);
+    const uint8_t *band = pixels + static_cast<ptrdiff_t>(y) * stride;
+    for (int x = 0; x < placement.width; x += tileSize)
+      *out++ = HashBlock(band + x * 4, stride,
+                         std::min(tileSize, placement.width - x), rows);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Lookup / Remember
+// -----------------------------------------------------------------------------
+
+FrameMatch FrameIndex::Lookup(const uint8_t *pixels, int stride,
+                              const ImageRect &placement) {
+  FrameMatch match;
+  if (!pixels || placement.width <= 0 || placement.height <= 0)
+    return match;
+
+  auto start = std::chrono::steady_clock::now();
+  HashTiles(pixels, stride, placement, config_.tileSize, match.signature);
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+
+  const FrameSignature &signature = match.signature;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.lookups++;
+  stats_.hashedBytes += static_cast<uint64_t>(placement.width) *
+                        placement.height * 4;
+  stats_.hashMicros += static_cast<uint64_t>(micros);
+
+  // Any remembered frame of the view with the same pixels answers it;
+  // otherwise the newest one is what changed
+  const Entry *base = nullptr;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (!SameView(it->signature, signature))
+      continue;
+    if (it->signature.tiles == signature.tiles) {
+      entries_.splice(entries_.begin(), entries_, it);
+      match.kind = FrameMatch::UNCHANGED;
+      match.analysis = entries_.front().analysis;
+      stats_.unchanged++;
+      return match;
+    }
+    if (!base)
+      base = &*it;
+  }
+  if (!base)
+    return match;
+
+  int left = signature.tilesX, top = signature.tilesY, right = 0, bottom = 0;
+  for (int ty = 0; ty < signature.tilesY; ++ty) {
+    for (int tx = 0; tx < signature.tilesX; ++tx) {
+      size_t i = static_cast<size_t>(ty) * signature.tilesX + tx;
+      if (signature.tiles[i] == base->signature.tiles[i])
+        continue;
+      match.changedTiles++;
+      left = std::min(left, tx);
+      top = std::min(top, ty);
+      right = std::max(right, tx + 1);
+      bottom = std::max(bottom, ty + 1);
+    }
+  }
+
+  const int tile = signature.tileSize;
+  const int margin = config_.deltaMargin;
+  int x0 = std::max(left * tile - margin, 0);
+  int y0 = std::max(top * tile - margin, 0);
+  int x1 = std::min(right * tile + margin, placement.width);
+  int y1 = std::min(bottom * tile + margin, placement.height);
+
+  match.kind = FrameMatch::CHANGED;
+  match.analysis = base->analysis;
+  match.changed.x = x0;
+  match.changed.y = y0;
+  match.changed.width = x1 - x0;
+  match.changed.height = y1 - y0;
+  match.sendDelta =
+      static_cast<int64_t>(match.changed.width) * match.changed.height *
+          100 <=
+      static_cast<int64_t>(config_.maxDeltaPercent) * placement.width *
+          placement.height;
+  stats_.changed++;
+  stats_.deltas += match.sendDelta;
+  return match;
+}
+
+void FrameIndex::Remember(FrameSignature signature, std::string analysis) {
+  if (signature.tiles.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (SameView(it->signature, signature) &&
+        it->signature.tiles == signature.tiles) {
+      entries_.erase(it);
+      break;
+    }
+  }
+
+  Entry entry;
+  entry.signature = std::move(signature);
+  entry.analysis = std::move(analysis);
+  entries_.push_front(std::move(entry));
+  while (entries_.size() > config_.maxFrames)
+    entries_.pop_back();
+}
+
+void FrameIndex::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+FrameIndexStats FrameIndex::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FrameIndexStats stats = stats_;
+  stats.frames = entries_.size();
+  return stats;
+}
+
+// -----------------------------------------------------------------------------
+// Prompt
+// -----------------------------------------------------------------------------
+
+std::string FrameIndex::BuildDeltaPrompt(const std::string &previousAnswer) {
+  std::string prompt;
+  prompt.reserve(previousAnswer.size() + 512);
+  prompt += "You are an expert assistant. Earlier you answered the question "
+            "or problem shown in a screen region. Your answer was:\n\n";
+  prompt += previousAnswer;
+  prompt += "\n\nPart of that region has changed since, and this image shows "
+            "only the changed part. Read it together with your earlier "
+            "answer and give the DIRECT ANSWER for the region as it is now. "
+            "Do NOT describe what you see or mention that the image is a "
+            "part. If nothing relevant changed, repeat the earlier answer.";
+  return prompt;
+}
+
+} // namespace invisible
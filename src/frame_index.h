@@ -0,0 +1,119 @@
+#pragma once
+
+#include "image_preprocessor.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Frame Index Configuration
+// -----------------------------------------------------------------------------
+
+struct FrameIndexConfig {
+  int tileSize = 32;        // Tile edge in pixels (multiple of 4, 8-128)
+  size_t maxFrames = 16;    // Analysed frames remembered
+  int deltaMargin = 32;     // Unchanged pixels sent around a changed area
+  int maxDeltaPercent = 40; // Larger changed areas send the whole frame
+};
+
+struct FrameIndexStats {
+  uint64_t lookups = 0;
+  uint64_t unchanged = 0;   // Answered from a remembered analysis
+  uint64_t changed = 0;     // Differed from a remembered frame of the view
+  uint64_t deltas = 0;      // ...by little enough to send the change only
+  uint64_t hashedBytes = 0;
+  uint64_t hashMicros = 0;  // Time spent hashing
+  size_t frames = 0;        // Remembered now
+};
+
+// Tile hashes of one frame, row-major; edge tiles may be smaller
+struct FrameSignature {
+  ImageRect placement; // Where the frame was captured (screen coordinates)
+  int tileSize = 0;
+  int tilesX = 0;
+  int tilesY = 0;
+  std::vector<uint64_t> tiles;
+};
+
+struct FrameMatch {
+  enum Kind {
+    NEW,       // No remembered frame of this view
+    UNCHANGED, // Same pixels as a remembered frame: `analysis` answers it
+    CHANGED,   // A remembered frame of this view differs inside `changed`
+  };
+
+  Kind kind = NEW;
+  std::string analysis; // The remembered frame's answer (not NEW)
+  ImageRect changed;    // Frame pixels, margin included (CHANGED only)
+  bool sendDelta = false; // `changed` is small enough to send on its own
+  int changedTiles = 0;
+  FrameSignature signature; // Give back to Remember() with the new answer
+};
+
+// -----------------------------------------------------------------------------
+// Frame Index
+// Remembers the vision answers of recent captures by the hashes of their
+// tiles, so capturing the same view again costs one pass over its pixels
+// instead of an encode and an upload. A frame matches a remembered one when
+// it was captured at the same place with the same size; equal tile hashes
+// then mean the remembered answer still holds, and the differing tiles give
+// the bounding box of what changed. Tile hashes are 64-bit multiply-
+// accumulate hashes over the color bytes (alpha is ignored), computed with
+// SSE2 at several GB/s; the scalar path gives the same values. Thread-safe.
+// -----------------------------------------------------------------------------
+
+class FrameIndex {
+public:
+  explicit FrameIndex(const FrameIndexConfig &config = FrameIndexConfig());
+
+  // Disable copy
+  FrameIndex(const FrameIndex &) = delete;
+  FrameIndex &operator=(const FrameIndex &) = delete;
+
+  // Hash top-down BGRA rows spaced `stride` bytes apart, captured at
+  // `placement`, and compare them with the remembered frames of that view
+  FrameMatch Lookup(const uint8_t *pixels, int stride,
+                    const ImageRect &placement);
+
+  // Remember the answer for a frame (replaces an older frame of the view
+  // with the same pixels)
+  void Remember(FrameSignature signature, std::string analysis);
+
+  void Clear();
+
+  FrameIndexStats GetStats() const;
+
+  // Tile hashes of a frame (placement.width x placement.height pixels)
+  static void HashTiles(const uint8_t *pixels, int stride,
+                        const ImageRect &placement, int tileSize,
+                        FrameSignature &signature);
+
+  // Hash of one width x height block (width counted in pixels)
+  static uint64_t HashBlock(const uint8_t *pixels, int stride, int width,
+                            int height);
+
+  // Instructions for answering from an image of the changed part only
+  static std::string BuildDeltaPrompt(const std::string &previousAnswer);
+
+  // True when the SSE2 kernel is compiled in
+  static bool HasSimd();
+
+private:
+  struct Entry {
+    FrameSignature signature;
+    std::string analysis;
+  };
+
+  FrameIndexConfig config_;
+
+  mutable std::mutex mutex_;
+  std::list<Entry> entries_; // Most recently used first
+  FrameIndexStats stats_;
+};
+
+} // namespace invisible
@@ -0,0 +1,111 @@
+#include "gdi_capture.h"
+#include <algorithm>
+#include <chrono>
+
+namespace invisible {
+
+GdiCaptureBackend::GdiCaptureBackend(FrameBufferPool *pool) : pool_(pool) {}
+
+GdiCaptureBackend::~GdiCaptureBackend() { ReleaseSurface(); }
+
+bool GdiCaptureBackend::Capture(const ImageRect &region,
+                                CaptureFrame &frame) {
+  auto start = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (region.width <= 0 || region.height <= 0) {
+    stats_.failures++;
+    return false;
+  }
+
+  HDC screenDC = GetDC(nullptr);
+  bool ok = screenDC && EnsureSurface(screenDC, region.width, region.height);
+
+  // Note: BitBlt will NOT capture windows with WDA_EXCLUDEFROMCAPTURE
+  if (ok && !BitBlt(memDC_, 0, 0, region.width, region.height, screenDC,
+                    region.x, region.y, SRCCOPY)) {
+    LogError(L"BitBlt failed");
+    ok = false;
+  }
+  if (screenDC)
+    ReleaseDC(nullptr, screenDC);
+  if (!ok) {
+    stats_.failures++;
+    return false;
+  }
+
+  // GDI may batch the blit; finish it before reading the bits
+  GdiFlush();
+  CopySurfaceRegion(bits_, surfaceWidth_ * 4,
+                    ImageRect{0, 0, region.width, region.height}, pool_,
+                    frame);
+  frame.dirtyRects.clear();
+  frame.dirtyRectsValid = false;
+
+  stats_.captures++;
+  stats_.capturedBytes += frame.pixels.size();
+  stats_.captureMicros += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  return true;
+}
+
+CaptureBackendStats GdiCaptureBackend::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+bool GdiCaptureBackend::EnsureSurface(HDC screenDC, int width, int height) {
+  if (bits_ && width <= surfaceWidth_ && height <= surfaceHeight_)
+    return true;
+
+  width = std::max(width, surfaceWidth_);
+  height = std::max(height, surfaceHeight_);
+  ReleaseSurface();
+
+  memDC_ = CreateCompatibleDC(screenDC);
+  if (!memDC_) {
+    LogError(L"Failed to create compatible DC");
+    return false;
+  }
+
+  // Top-down 32-bit DIB: rows are width * 4 bytes, no padding
+  BITMAPINFO bmi = {};
+  bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+  bmi.bmiHeader.biWidth = width;
+  bmi.bmiHeader.biHeight = -height;
+  bmi.bmiHeader.biPlanes = 1;
+  bmi.bmiHeader.biBitCount = 32;
+  bmi.bmiHeader.biCompression = BI_RGB;
+
+  void *bits = nullptr;
+  bitmap_ = CreateDIBSection(memDC_, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+  if (!bitmap_ || !bits) {
+    LogError(L"Failed to create DIB section");
+    ReleaseSurface();
+    return false;
+  }
+
+  oldBitmap_ = SelectObject(memDC_, bitmap_);
+  bits_ = static_cast<BYTE *>(bits);
+  surfaceWidth_ = width;
+  surfaceHeight_ = height;
+  return true;
+}
+
+void GdiCaptureBackend::ReleaseSurface() {
+  if (memDC_ && oldBitmap_)
+    SelectObject(memDC_, oldBitmap_);
+  if (bitmap_)
+    DeleteObject(bitmap_);
+  if (memDC_)
+    DeleteDC(memDC_);
+  memDC_ = nullptr;
+  bitmap_ = nullptr;
+  oldBitmap_ = nullptr;
+  bits_ = nullptr;
+  surfaceWidth_ = 0;
+  surfaceHeight_ = 0;
+}
+
+} // namespace invisible
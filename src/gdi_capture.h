@@ -0,0 +1,49 @@
+#pragma once
+
+#include "capture_backend.h"
+#include "utils.h"
+#include <mutex>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// GDI Capture Backend (Windows)
+// BitBlt from the screen DC into a DIB section that is kept between
+// captures (grown to the largest region asked for) instead of creating and
+// destroying a memory DC, DIB section and bitmap every time. Works for any
+// region, including ones spanning monitors, but knows nothing about what
+// changed. Windows with WDA_EXCLUDEFROMCAPTURE are left out.
+// -----------------------------------------------------------------------------
+
+class GdiCaptureBackend : public CaptureBackend {
+public:
+  // `pool` may be null (then every capture allocates)
+  explicit GdiCaptureBackend(FrameBufferPool *pool);
+  ~GdiCaptureBackend() override;
+
+  // Disable copy
+  GdiCaptureBackend(const GdiCaptureBackend &) = delete;
+  GdiCaptureBackend &operator=(const GdiCaptureBackend &) = delete;
+
+  const char *GetName() const override { return "gdi"; }
+  bool Capture(const ImageRect &region, CaptureFrame &frame) override;
+  CaptureBackendStats GetStats() const override;
+
+private:
+  // Make the DIB section at least width x height
+  bool EnsureSurface(HDC screenDC, int width, int height);
+  void ReleaseSurface();
+
+  FrameBufferPool *pool_;
+
+  mutable std::mutex mutex_;
+  HDC memDC_ = nullptr;
+  HBITMAP bitmap_ = nullptr;
+  HGDIOBJ oldBitmap_ = nullptr;
+  BYTE *bits_ = nullptr;
+  int surfaceWidth_ = 0;
+  int surfaceHeight_ = 0;
+  CaptureBackendStats stats_;
+};
+
+} // namespace invisible
@@ -0,0 +1,497 @@
+#include "hpack.h"
+#include <algorithm>
+
+namespace invisible {
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Static Table (RFC 7541 Appendix A)
+// -----------------------------------------------------------------------------
+
+struct StaticEntry {
+  const char *name;
+  const char *value;
+};
+
+const StaticEntry kStaticTable[HpackTable::STATIC_ENTRIES] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// -----------------------------------------------------------------------------
+// Huffman Code (RFC 7541 Appendix B): {code, bit length} per symbol, with
+// EOS (256) last
+// -----------------------------------------------------------------------------
+
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t bits;
+};
+
+const HuffmanCode kHuffmanCodes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+
+};
+
+constexpr int kEosSymbol = 256;
+
+// Binary decoding tree over the codes, built once
+struct HuffmanTree {
+  struct Node {
+    int16_t child[2] = {-1, -1};
+    int16_t symbol = -1;
+  };
+  std::vector<Node> nodes;
+
+  HuffmanTree() {
+    nodes.reserve(513);
+    nodes.emplace_back();
+    for (int symbol = 0; symbol <= kEosSymbol; ++symbol) {
+      const HuffmanCode &code = kHuffmanCodes[symbol];
+      size_t node = 0;
+      for (int bit = code.bits - 1; bit >= 0; --bit) {
+        int branch = (code.code >> bit) & 1;
+        if (nodes[node].child[branch] < 0) {
+          nodes[node].child[branch] = static_cast<int16_t>(nodes.size());
+          nodes.emplace_back();
+        }
+        node = static_cast<size_t>(nodes[node].child[branch]);
+      }
+      nodes[node].symbol = static_cast<int16_t>(symbol);
+    }
+  }
+};
+
+const HuffmanTree &GetHuffmanTree() {
+  static const HuffmanTree tree;
+  return tree;
+}
+
+// Fields that differ on every request would only churn the dynamic table
+bool WorthIndexing(std::string_view name, std::string_view value) {
+  if (name == "content-length")
+    return false;
+  if (name == "content-type" && value.find("boundary=") != std::string::npos)
+    return false;
+  return name.size() + value.size() + HpackTable::ENTRY_OVERHEAD <= 1024;
+}
+
+void EncodeString(std::string_view text, std::string &out) {
+  size_t huffmanLength = HpackHuffmanLength(text);
+  if (huffmanLength < text.size()) {
+    HpackEncodeInteger(huffmanLength, 7, 0x80, out);
+    HpackHuffmanEncode(text, out);
+  } else {
+    HpackEncodeInteger(text.size(), 7, 0x00, out);
+    out.append(text.data(), text.size());
+  }
+}
+
+bool DecodeInteger(const uint8_t *&p, const uint8_t *end, int prefixBits,
+                   uint64_t &value) {
+  if (p == end)
+    return false;
+  const uint8_t mask = static_cast<uint8_t>((1u << prefixBits) - 1);
+  value = *p++ & mask;
+  if (value < mask)
+    return true;
+  for (int shift = 0; shift <= 28; shift += 7) {
+    if (p == end)
+      return false;
+    uint8_t byte = *p++;
+    value += static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false; // Longer than any sane length or index
+}
+
+bool DecodeString(const uint8_t *&p, const uint8_t *end, std::string &out) {
+  if (p == end)
+    return false;
+  bool huffman = (*p & 0x80) != 0;
+  uint64_t length = 0;
+  if (!DecodeInteger(p, end, 7, length) ||
+      length > static_cast<uint64_t>(end - p)) {
+    return false;
+  }
+  out.clear();
+  bool ok = true;
+  if (huffman) {
+    ok = HpackHuffmanDecode(p, static_cast<size_t>(length), out);
+  } else {
+    out.assign(reinterpret_cast<const char *>(p), static_cast<size_t>(length));
+  }
+  p += length;
+  return ok;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Table
+// -----------------------------------------------------------------------------
+
+bool HpackTable::Get(size_t index, std::string_view &name,
+                     std::string_view &value) const {
+  if (index == 0)
+    return false;
+  if (index <= STATIC_ENTRIES) {
+    name = kStaticTable[index - 1].name;
+    value = kStaticTable[index - 1].value;
+    return true;
+  }
+  index -= STATIC_ENTRIES + 1;
+  if (index >= entries_.size())
+    return false;
+  name = entries_[index].first;
+  value = entries_[index].second;
+  return true;
+}
+
+size_t HpackTable::Find(std::string_view name, std::string_view value,
+                        size_t &nameIndex) const {
+  nameIndex = 0;
+  for (size_t i = 0; i < STATIC_ENTRIES; ++i) {
+    if (name != kStaticTable[i].name)
+      continue;
+    if (value == kStaticTable[i].value)
+      return i + 1;
+    if (nameIndex == 0)
+      nameIndex = i + 1;
+  }
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (name != entries_[i].first)
+      continue;
+    if (value == entries_[i].second)
+      return STATIC_ENTRIES + 1 + i;
+    if (nameIndex == 0)
+      nameIndex = STATIC_ENTRIES + 1 + i;
+  }
+  return 0;
+}
+
+void HpackTable::Add(std::string_view name, std::string_view value) {
+  size_t entrySize = name.size() + value.size() + ENTRY_OVERHEAD;
+  if (entrySize > maxSize_) {
+    // Larger than the whole table: it empties the table (RFC 7541 4.4)
+    entries_.clear();
+    size_ = 0;
+    return;
+  }
+  Evict(entrySize);
+  entries_.emplace_front(std::string(name), std::string(value));
+  size_ += entrySize;
+}
+
+void HpackTable::SetMaxSize(size_t maxSize) {
+  maxSize_ = maxSize;
+  Evict(0);
+}
+
+void HpackTable::Evict(size_t room) {
+  while (!entries_.empty() && size_ + room > maxSize_) {
+    const auto &oldest = entries_.back();
+    size_ -= oldest.first.size() + oldest.second.size() + ENTRY_OVERHEAD;
+    entries_.pop_back();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Encoder
+// -----------------------------------------------------------------------------
+
+void HpackEncoder::SetMaxTableSize(size_t size) {
+  // Our table never grows past the default, whatever the peer allows
+  size = std::min<size_t>(size, 4096);
+  pendingMinSize_ = std::min(pendingMinSize_, size);
+  table_.SetMaxSize(size);
+  sizeUpdatePending_ = true;
+}
+
+void HpackEncoder::Encode(const HpackHeaderList &headers, std::string &out) {
+  if (sizeUpdatePending_) {
+    // A limit lowered and raised again between blocks is announced twice,
+    // so the peer evicts what it has to
+    if (pendingMinSize_ < table_.GetMaxSize())
+      HpackEncodeInteger(pendingMinSize_, 5, 0x20, out);
+    HpackEncodeInteger(table_.GetMaxSize(), 5, 0x20, out);
+    pendingMinSize_ = SIZE_MAX;
+    sizeUpdatePending_ = false;
+  }
+
+  for (const auto &header : headers) {
+    const std::string &name = header.first;
+    const std::string &value = header.second;
+
+    size_t nameIndex = 0;
+    size_t index = table_.Find(name, value, nameIndex);
+    if (index != 0) {
+      HpackEncodeInteger(index, 7, 0x80, out); // Indexed field
+      continue;
+    }
+
+    bool indexing = WorthIndexing(name, value);
+    if (indexing) {
+      HpackEncodeInteger(nameIndex, 6, 0x40, out); // Incremental indexing
+    } else {
+      HpackEncodeInteger(nameIndex, 4, 0x00, out); // Without indexing
+    }
+    if (nameIndex == 0)
+      EncodeString(name, out);
+    EncodeString(value, out);
+    if (indexing)
+      table_.Add(name, value);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Decoder
+// -----------------------------------------------------------------------------
+
+bool HpackDecoder::Decode(const uint8_t *data, size_t size,
+                          HpackHeaderList &headers) {
+  const uint8_t *p = data;
+  const uint8_t *end = data + size;
+  size_t listSize = 0;
+  bool fieldSeen = false;
+  std::string name;
+  std::string value;
+
+  while (p < end) {
+    uint8_t first = *p;
+    uint64_t index = 0;
+
+    if (first & 0x80) { // Indexed field
+      std::string_view tableName, tableValue;
+      if (!DecodeInteger(p, end, 7, index) ||
+          !table_.Get(static_cast<size_t>(index), tableName, tableValue)) {
+        return false;
+      }
+      name.assign(tableName.data(), tableName.size());
+      value.assign(tableValue.data(), tableValue.size());
+    } else if ((first & 0xe0) == 0x20) { // Dynamic table size update
+      if (fieldSeen || !DecodeInteger(p, end, 5, index) || index > 4096)
+        return false;
+      table_.SetMaxSize(static_cast<size_t>(index));
+      continue;
+    } else { // Literal, with / without / never indexed
+      bool indexing = (first & 0x40) != 0;
+      if (!DecodeInteger(p, end, indexing ? 6 : 4, index))
+        return false;
+      if (index != 0) {
+        std::string_view tableName, tableValue;
+        if (!table_.Get(static_cast<size_t>(index), tableName, tableValue))
+          return false;
+        name.assign(tableName.data(), tableName.size());
+      } else if (!DecodeString(p, end, name)) {
+        return false;
+      }
+      if (!DecodeString(p, end, value))
+        return false;
+      if (indexing)
+        table_.Add(name, value);
+    }
+
+    fieldSeen = true;
+    listSize += name.size() + value.size() + HpackTable::ENTRY_OVERHEAD;
+    if (listSize > MAX_HEADER_LIST_SIZE)
+      return false;
+    headers.emplace_back(name, value);
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Primitives
+// -----------------------------------------------------------------------------
+
+void HpackEncodeInteger(uint64_t value, int prefixBits, uint8_t first,
+                        std::string &out) {
+  const uint64_t mask = (1u << prefixBits) - 1;
+  if (value < mask) {
+    out += static_cast<char>(first | value);
+    return;
+  }
+  out += static_cast<char>(first | mask);
+  value -= mask;
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+size_t HpackHuffmanLength(std::string_view text) {
+  uint64_t bits = 0;
+  for (unsigned char c : text)
+    bits += kHuffmanCodes[c].bits;
+  return static_cast<size_t>((bits + 7) / 8);
+}
+
+void HpackHuffmanEncode(std::string_view text, std::string &out) {
+  uint64_t pending = 0; // Bits not yet written, right-aligned
+  int pendingBits = 0;
+  for (unsigned char c : text) {
+    const HuffmanCode &code = kHuffmanCodes[c];
+    pending = (pending << code.bits) | code.code;
+    pendingBits += code.bits;
+    while (pendingBits >= 8) {
+      pendingBits -= 8;
+      out += static_cast<char>(pending >> pendingBits);
+    }
+    pending &= (uint64_t(1) << pendingBits) - 1;
+  }
+  if (pendingBits > 0) {
+    // Pad with the most significant bits of EOS (all ones)
+    out += static_cast<char>((pending << (8 - pendingBits)) |
+                             (0xffu >> pendingBits));
+  }
+}
+
+bool HpackHuffmanDecode(const uint8_t *data, size_t size, std::string &out) {
+  const HuffmanTree &tree = GetHuffmanTree();
+  size_t node = 0;
+  int depth = 0;       // Bits since the last complete symbol
+  bool allOnes = true; // ...and whether they were all ones (padding)
+
+  for (size_t i = 0; i < size; ++i) {
+    for (int bit = 7; bit >= 0; --bit) {
+      int branch = (data[i] >> bit) & 1;
+      int16_t next = tree.nodes[node].child[branch];
+      if (next < 0)
+        return false;
+      node = static_cast<size_t>(next);
+      ++depth;
+      allOnes = allOnes && branch == 1;
+
+      int16_t symbol = tree.nodes[node].symbol;
+      if (symbol >= 0) {
+        if (symbol == kEosSymbol)
+          return false;
+        out += static_cast<char>(symbol);
+        node = 0;
+        depth = 0;
+        allOnes = true;
+      }
+    }
+  }
+  // Leftover bits must be a prefix of EOS shorter than a byte
+  return depth < 8 && allOnes;
+}
+
+} // namespace invisible
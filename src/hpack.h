@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// HPACK (RFC 7541)
+// Header compression for the HTTP/2 transport. Both directions keep a
+// dynamic table of recently sent fields, so the headers every API call
+// repeats (authority, path, authorization, user agent) shrink to an index
+// or two after the first request on a connection.
+// -----------------------------------------------------------------------------
+
+using HpackHeaderList = std::vector<std::pair<std::string, std::string>>;
+
+class HpackTable {
+public:
+  static constexpr size_t STATIC_ENTRIES = 61;
+  static constexpr size_t ENTRY_OVERHEAD = 32; // Per-entry size (RFC 7541 4.1)
+
+  explicit HpackTable(size_t maxSize = 4096) : maxSize_(maxSize) {}
+
+  // Field at a 1-based HPACK index (static entries first); false if out of
+  // range
+  bool Get(size_t index, std::string_view &name,
+           std::string_view &value) const;
+
+  // Index of an exact match (0 if none); `nameIndex` gets an index with
+  // the same name when only that matches
+  size_t Find(std::string_view name, std::string_view value,
+              size_t &nameIndex) const;
+
+  void Add(std::string_view name, std::string_view value);
+  void SetMaxSize(size_t maxSize);
+
+  size_t GetMaxSize() const { return maxSize_; }
+  size_t GetSize() const { return size_; }
+
+private:
+  void Evict(size_t room);
+
+  std::deque<std::pair<std::string, std::string>> entries_; // Newest first
+  size_t size_ = 0;
+  size_t maxSize_;
+};
+
+// -----------------------------------------------------------------------------
+// Encoder
+// -----------------------------------------------------------------------------
+
+class HpackEncoder {
+public:
+  // The peer's SETTINGS_HEADER_TABLE_SIZE; announced in the next block
+  void SetMaxTableSize(size_t size);
+
+  // Append the header block for `headers` (names lower-case) to `out`
+  void Encode(const HpackHeaderList &headers, std::string &out);
+
+private:
+  HpackTable table_;
+  size_t pendingMinSize_ = SIZE_MAX; // Smallest limit since the last block
+  bool sizeUpdatePending_ = false;
+};
+
+// -----------------------------------------------------------------------------
+// Decoder
+// -----------------------------------------------------------------------------
+
+class HpackDecoder {
+public:
+  // A decoded header list larger than this is refused
+  static constexpr size_t MAX_HEADER_LIST_SIZE = 256 * 1024;
+
+  // Decode one complete header block, appending the fields to `headers`.
+  // False on a compression error, after which the connection is unusable.
+  bool Decode(const uint8_t *data, size_t size, HpackHeaderList &headers);
+
+private:
+  HpackTable table_; // Our SETTINGS_HEADER_TABLE_SIZE stays the default
+};
+
+// -----------------------------------------------------------------------------
+// Primitives
+// -----------------------------------------------------------------------------
+
+// Append `value` as an HPACK integer with a `prefixBits` prefix; `first`
+// carries the pattern bits above the prefix
+void HpackEncodeInteger(uint64_t value, int prefixBits, uint8_t first,
+                        std::string &out);
+
+// Append `text` Huffman-coded (RFC 7541 Appendix B)
+void HpackHuffmanEncode(std::string_view text, std::string &out);
+size_t HpackHuffmanLength(std::string_view text);
+
+// Decode Huffman-coded bytes; false on invalid padding or an EOS symbol
+bool HpackHuffmanDecode(const uint8_t *data, size_t size, std::string &out);
+
+} // namespace invisible
@@ -0,0 +1,1375 @@
+#include "http2_transport.h"
+#include "hpack.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace invisible {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+constexpr size_t kFrameHeaderSize = 9;
+constexpr uint32_t kMaxFrameSize = 16384;       // Ours (the default)
+constexpr int64_t kDefaultWindow = 65535;       // Before any SETTINGS
+constexpr int64_t kStreamWindow = 1 << 20;      // Per response
+constexpr int64_t kConnectionWindow = 16 << 20; // All responses together
+constexpr int64_t kMaxWindow = 0x7fffffff;
+constexpr uint32_t kMaxStreamId = 0x7fffffff;
+constexpr size_t kReadBufferSize = 64 * 1024;
+constexpr int kUnsentLimit = 16 * 1024; // Kernel send queue not yet on the wire
+constexpr size_t kWriteBatch = kUnsentLimit; // Body data picked per write
+constexpr size_t kMaxHeaderBlock = 256 * 1024;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+enum FrameType : uint8_t {
+  kData = 0x0,
+  kHeaders = 0x1,
+  kPriority = 0x2,
+  kRstStream = 0x3,
+  kSettings = 0x4,
+  kPushPromise = 0x5,
+  kPing = 0x6,
+  kGoAway = 0x7,
+  kWindowUpdate = 0x8,
+  kContinuation = 0x9,
+};
+
+enum FrameFlag : uint8_t {
+  kEndStream = 0x1,
+  kAck = 0x1,
+  kEndHeaders = 0x4,
+  kPadded = 0x8,
+  kPriorityFlag = 0x20,
+};
+
+enum SettingId : uint16_t {
+  kHeaderTableSize = 0x1,
+  kEnablePush = 0x2,
+  kMaxConcurrentStreams = 0x3,
+  kInitialWindowSize = 0x4,
+  kMaxFrameSizeSetting = 0x5,
+  kNoRfc7540Priorities = 0x9,
+};
+
+enum ErrorCode : uint32_t {
+  kNoError = 0x0,
+  kProtocolError = 0x1,
+  kInternalError = 0x2,
+  kFlowControlError = 0x3,
+  kFrameSizeError = 0x6,
+  kRefusedStream = 0x7,
+  kCancel = 0x8,
+  kCompressionError = 0x9,
+};
+
+uint32_t ReadUint32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void AppendUint32(std::string &out, uint32_t value) {
+  out += static_cast<char>(value >> 24);
+  out += static_cast<char>(value >> 16);
+  out += static_cast<char>(value >> 8);
+  out += static_cast<char>(value);
+}
+
+void WriteFrameHeader(char *p, size_t length, uint8_t type, uint8_t flags,
+                      uint32_t stream) {
+  p[0] = static_cast<char>(length >> 16);
+  p[1] = static_cast<char>(length >> 8);
+  p[2] = static_cast<char>(length);
+  p[3] = static_cast<char>(type);
+  p[4] = static_cast<char>(flags);
+  p[5] = static_cast<char>(stream >> 24);
+  p[6] = static_cast<char>(stream >> 16);
+  p[7] = static_cast<char>(stream >> 8);
+  p[8] = static_cast<char>(stream);
+}
+
+void AppendFrameHeader(std::string &out, size_t length, uint8_t type,
+                       uint8_t flags, uint32_t stream) {
+  char header[kFrameHeaderSize];
+  WriteFrameHeader(header, length, type, flags, stream);
+  out.append(header, sizeof(header));
+}
+
+void AppendSetting(std::string &out, uint16_t id, uint32_t value) {
+  out += static_cast<char>(id >> 8);
+  out += static_cast<char>(id);
+  AppendUint32(out, value);
+}
+
+// Fields HTTP/2 forbids or replaces with pseudo-headers (RFC 9113 8.2.2)
+bool IsConnectionSpecific(const std::string &name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade" || name == "host" || name == "te";
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Connection
+// One HTTP/2 connection and the I/O thread that owns its socket. Callers
+// (Exchange, on their own threads) queue frames and wait on their stream;
+// the I/O thread writes queued frames, then request body frames in priority
+// order, and dispatches whatever the server sends.
+// -----------------------------------------------------------------------------
+
+class Http2Transport::Connection {
+public:
+  enum class Outcome {
+    Done,     // Response (or error) in `response`
+    Unusable, // Connection closing; nothing was sent
+    Refused,  // Server didn't process the request; safe to send again
+  };
+
+  Connection(int fd, std::unique_ptr<TlsSession> tls,
+             const HttpTransportConfig &config, const HttpUrl &url);
+  ~Connection();
+
+  // Disable copy
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  bool Start();
+  void Stop();
+
+  Outcome Exchange(const HttpRequest &request,
+                   const HttpChunkCallback &onChunk, HttpResponse &response);
+
+  bool IsUsable() const;
+  bool IsIdle() const;
+  bool IsFinished() const { return finished_; }
+  bool ClosedIdle() const { return closedIdle_; }
+  uint64_t GetWaits() const { return waits_; }
+  uint64_t GetTimeouts() const { return timeouts_; }
+
+private:
+  struct Stream;
+
+  void Run();
+  bool ReadFrames();
+  bool HandleFrame(uint8_t type, uint8_t flags, uint32_t id,
+                   const uint8_t *payload, size_t length);
+  bool HandleHeaderBlock();
+  bool FillOutput(std::string &out, bool withData);
+  Stream *NextSendable();
+  bool WriteAll(const std::string &out);
+
+  void QueueHeaders(const std::shared_ptr<Stream> &stream,
+                    const std::string &block);
+  void ResetStream(Stream &stream, uint32_t code);
+  void Consumed(Stream *stream, size_t size);
+  void Detach(const std::shared_ptr<Stream> &stream);
+  void Fail(const std::wstring &error);
+  void Wake();
+
+  const int fd_;
+  std::unique_ptr<TlsSession> tls_;
+  const HttpTransportConfig config_;
+  const bool secure_;
+  std::string authority_;
+  std::thread thread_;
+  int wakeRead_ = -1;
+  int wakeWrite_ = -1;
+
+  mutable std::mutex mutex_;
+  std::condition_variable slotFree_;
+  std::map<uint32_t, std::shared_ptr<Stream>> streams_;
+  std::deque<std::shared_ptr<Stream>> sendQueue_[3]; // By HttpPriority
+  std::vector<std::shared_ptr<Stream>> unsentHeaders_;
+  std::string control_; // Frames ahead of any request data
+  HpackEncoder encoder_;
+  uint32_t nextStreamId_ = 1;
+  size_t active_ = 0;
+  Clock::time_point lastActive_ = Clock::now();
+  bool wakePending_ = false;
+  bool closing_ = false; // No new streams (GOAWAY, ids used up, idle)
+  bool dead_ = false;
+  bool stopping_ = false;
+  uint64_t framesReceived_ = 0;
+
+  // Peer settings and send windows
+  uint32_t peerMaxStreams_ = 100; // If the server's SETTINGS don't say
+  int64_t peerInitialWindow_ = kDefaultWindow;
+  uint32_t peerMaxFrame_ = kMaxFrameSize;
+  int64_t connSendWindow_ = kDefaultWindow;
+
+  // Receive side (I/O thread, except the window credit)
+  HpackDecoder decoder_;
+  std::vector<uint8_t> input_ = std::vector<uint8_t>(kReadBufferSize);
+  size_t inputBegin_ = 0;
+  size_t inputEnd_ = 0;
+  std::string headerBlock_;
+  uint32_t headerStream_ = 0;
+  uint8_t headerFlags_ = 0;
+  bool settingsSeen_ = false;
+  int64_t connReceiveWindow_ = kConnectionWindow;
+  int64_t connUnacked_ = 0;
+  uint32_t goAwayCode_ = kNoError;
+
+  std::atomic<bool> finished_{false};
+  std::atomic<bool> closedIdle_{false};
+  std::atomic<uint64_t> waits_{0};
+  std::atomic<uint64_t> timeouts_{0};
+};
+
+struct Http2Transport::Connection::Stream {
+  uint32_t id = 0;
+  HttpPriority priority = HttpPriority::Normal;
+
+  // Request body not yet sent; body is cleared when the caller leaves
+  const HttpBody *body = nullptr;
+  size_t segment = 0;
+  uint64_t segmentOffset = 0;
+  uint64_t left = 0;
+  int64_t sendWindow = 0;
+  bool headersSent = false;
+  uint64_t framesAtStart = 0;
+
+  // Response, filled by the I/O thread and drained by the caller
+  int statusCode = 0;
+  std::map<std::string, std::string> headers;
+  bool headersReady = false; // Final (non-1xx) headers received
+  std::string inbox;
+  int64_t receiveWindow = kStreamWindow;
+  int64_t unacked = 0;
+  bool responded = false; // Any frame from the server for this stream
+  bool ended = false;     // END_STREAM received
+  bool reset = false;     // RST_STREAM sent
+  bool failed = false;
+  bool refused = false; // Not processed by the server
+  bool cancelled = false; // The request's token fired
+  std::wstring error;
+  std::condition_variable cv;
+};
+
+Http2Transport::Connection::Connection(int fd, std::unique_ptr<TlsSession> tls,
+                                       const HttpTransportConfig &config,
+                                       const HttpUrl &url)
+    : fd_(fd), tls_(std::move(tls)), config_(config), secure_(url.secure) {
+  if (url.host.find(':') != std::string::npos) {
+    authority_ = "[" + url.host + "]";
+  } else {
+    authority_ = url.host;
+  }
+  if (url.port != (url.secure ? 443 : 80))
+    authority_ += ":" + std::to_string(url.port);
+}
+
+Http2Transport::Connection::~Connection() {
+  Stop();
+  tls_.reset(); // Before the socket goes away
+  close(fd_);
+  if (wakeRead_ >= 0) {
+    close(wakeRead_);
+    close(wakeWrite_);
+  }
+}
+
+bool Http2Transport::Connection::Start() {
+  int pipeFds[2];
+  if (pipe(pipeFds) != 0)
+    return false;
+  wakeRead_ = pipeFds[0];
+  wakeWrite_ = pipeFds[1];
+  for (int fd : pipeFds) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  }
+
+#ifdef TCP_NOTSENT_LOWAT
+  // Hold body frames back until the socket has all but sent what it has, so
+  // a High request queued behind an upload overtakes it here rather than
+  // waiting out a send buffer full of upload data
+  int unsentLimit = kUnsentLimit;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &unsentLimit,
+             sizeof(unsentLimit));
+#endif
+
+  // Preface, our settings, and the connection window opened up front
+  control_.append(kPreface, sizeof(kPreface) - 1);
+  AppendFrameHeader(control_, 4 * 6, kSettings, 0, 0);
+  AppendSetting(control_, kEnablePush, 0);
+  AppendSetting(control_, kInitialWindowSize, kStreamWindow);
+  AppendSetting(control_, kMaxFrameSizeSetting, kMaxFrameSize);
+  AppendSetting(control_, kNoRfc7540Priorities, 1);
+  AppendFrameHeader(control_, 4, kWindowUpdate, 0, 0);
+  AppendUint32(control_, kConnectionWindow - kDefaultWindow);
+
+  thread_ = std::thread(&Connection::Run, this);
+  return true;
+}
+
+void Http2Transport::Connection::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    Wake();
+  }
+  if (thread_.joinable())
+    thread_.join();
+}
+
+bool Http2Transport::Connection::IsUsable() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !closing_ && !dead_;
+}
+
+bool Http2Transport::Connection::IsIdle() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return active_ == 0;
+}
+
+void Http2Transport::Connection::Wake() {
+  // mutex_ held
+  if (wakePending_ || wakeWrite_ < 0)
+    return;
+  wakePending_ = true;
+  char byte = 0;
+  ssize_t ignored = write(wakeWrite_, &byte, 1);
+  (void)ignored;
+}
+
+// -----------------------------------------------------------------------------
+// Exchange (caller thread)
+// -----------------------------------------------------------------------------
+
+Http2Transport::Connection::Outcome
+Http2Transport::Connection::Exchange(const HttpRequest &request,
+                                     const HttpChunkCallback &onChunk,
+                                     HttpResponse &response) {
+  // Pseudo-headers first, then the fields HTTP/1.1 would have sent
+  HpackHeaderList fields;
+  fields.reserve(request.headers.size() + 7);
+  fields.emplace_back(":method", request.method);
+  fields.emplace_back(":scheme", secure_ ? "https" : "http");
+  fields.emplace_back(":authority", authority_);
+  fields.emplace_back(":path", request.url.path);
+  fields.emplace_back("user-agent", config_.userAgent);
+  for (const auto &header : request.headers) {
+    std::string name = header.first;
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) {
+      return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    });
+    if (!IsConnectionSpecific(name))
+      fields.emplace_back(std::move(name), header.second);
+  }
+  if (!request.body.Empty() || request.method == "POST" ||
+      request.method == "PUT") {
+    fields.emplace_back("content-length",
+                        std::to_string(request.body.Size()));
+  }
+  if (const char *urgency = HttpPriorityField(request.priority))
+    fields.emplace_back("priority", urgency);
+
+  auto stream = std::make_shared<Stream>();
+  stream->priority = request.priority;
+
+  // Cancelling wakes this caller wherever it waits below
+  ScopedCancellation cancellation(request.cancel, [this, stream] {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream->cancelled = true;
+    stream->cv.notify_all();
+    slotFree_.notify_all();
+  });
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // Respect the server's limit on concurrent streams. Until its SETTINGS
+  // arrive the limit is unknown, so a new connection carries one request
+  // rather than risk streams the server would refuse.
+  const auto limit = [this] {
+    return settingsSeen_ ? peerMaxStreams_ : uint32_t(1);
+  };
+  if (active_ >= limit() && !closing_ && !dead_ && !stream->cancelled) {
+    ++waits_;
+    auto deadline =
+        Clock::now() + std::chrono::milliseconds(config_.connectTimeoutMs);
+    if (!slotFree_.wait_until(lock, deadline, [&] {
+          return closing_ || dead_ || stream->cancelled || active_ < limit();
+        })) {
+      ++timeouts_;
+      response.error = L"Failed to connect to server";
+      return Outcome::Done;
+    }
+  }
+  if (stream->cancelled) {
+    response.error = L"Cancelled";
+    return Outcome::Done;
+  }
+  if (closing_ || dead_)
+    return Outcome::Unusable;
+
+  stream->id = nextStreamId_;
+  nextStreamId_ += 2;
+  if (nextStreamId_ > kMaxStreamId)
+    closing_ = true; // Out of stream ids: later requests open a new one
+  stream->body = &request.body;
+  stream->left = request.body.Size();
+  stream->sendWindow = peerInitialWindow_;
+  stream->framesAtStart = framesReceived_;
+
+  std::string block;
+  encoder_.Encode(fields, block);
+  QueueHeaders(stream, block);
+  streams_[stream->id] = stream;
+  ++active_;
+  if (stream->left > 0)
+    sendQueue_[static_cast<int>(stream->priority)].push_back(stream);
+  Wake();
+
+  // Response: the body goes through the reader on this thread, so a slow
+  // streaming callback holds back only its own stream's window
+  std::optional<HttpBodyReader> reader;
+  std::string pending;
+  Outcome outcome = Outcome::Done;
+  const auto timeout = std::chrono::milliseconds(config_.receiveTimeoutMs);
+  auto deadline = Clock::now() + timeout;
+  for (;;) {
+    bool woken = stream->cv.wait_until(lock, deadline, [&] {
+      return stream->failed || stream->ended || stream->cancelled ||
+             (stream->headersReady && (!reader || !stream->inbox.empty()));
+    });
+    if (!woken) {
+      response.error = L"Failed to receive response";
+      ResetStream(*stream, kCancel);
+      break;
+    }
+    if (stream->cancelled) {
+      response.error = L"Cancelled";
+      // A stream closed in both directions takes no more frames
+      if (!stream->ended || stream->left > 0)
+        ResetStream(*stream, kCancel);
+      break;
+    }
+
+    if (stream->headersReady && !reader) {
+      response.statusCode = stream->statusCode;
+      response.headers = std::move(stream->headers);
+      reader.emplace(response, onChunk);
+      uint64_t contentLength = 0;
+      if (HttpContentLength(response, contentLength))
+        reader->Expect(contentLength);
+    }
+
+    if (reader && !stream->inbox.empty()) {
+      pending.swap(stream->inbox);
+      lock.unlock();
+      bool more = reader->Append(pending.data(), pending.size());
+      lock.lock();
+      Consumed(stream.get(), pending.size());
+      pending.clear();
+      deadline = Clock::now() + timeout;
+      if (!more) {
+        response.error = L"Cancelled";
+        ResetStream(*stream, kCancel);
+        break;
+      }
+      continue;
+    }
+
+    if (stream->failed) {
+      if (stream->refused && !reader)
+        outcome = Outcome::Refused;
+      response.error = stream->error;
+      break;
+    }
+    if (stream->ended) {
+      if (!reader)
+        response.error = L"Invalid response";
+      // The server answered before taking the whole request body
+      if (stream->left > 0)
+        ResetStream(*stream, kCancel);
+      break;
+    }
+  }
+
+  Detach(stream);
+  lock.unlock();
+  if (reader)
+    reader->Finish();
+  return outcome;
+}
+
+void Http2Transport::Connection::QueueHeaders(
+    const std::shared_ptr<Stream> &stream, const std::string &block) {
+  // mutex_ held. HEADERS, then CONTINUATION frames for a block over the
+  // frame size; a request without a body ends with its headers.
+  size_t offset = 0;
+  uint8_t type = kHeaders;
+  do {
+    size_t size = std::min<size_t>(block.size() - offset, peerMaxFrame_);
+    uint8_t flags = 0;
+    if (type == kHeaders && stream->left == 0)
+      flags |= kEndStream;
+    if (offset + size == block.size())
+      flags |= kEndHeaders;
+    AppendFrameHeader(control_, size, type, flags, stream->id);
+    control_.append(block, offset, size);
+    offset += size;
+    type = kContinuation;
+  } while (offset < block.size());
+  unsentHeaders_.push_back(stream);
+}
+
+void Http2Transport::Connection::ResetStream(Stream &stream, uint32_t code) {
+  // mutex_ held
+  if (stream.reset || dead_)
+    return;
+  stream.reset = true;
+  stream.body = nullptr;
+  AppendFrameHeader(control_, 4, kRstStream, 0, stream.id);
+  AppendUint32(control_, code);
+  Wake();
+}
+
+void Http2Transport::Connection::Consumed(Stream *stream, size_t size) {
+  // mutex_ held. Reopen the windows once half of them is used up.
+  connUnacked_ += static_cast<int64_t>(size);
+  if (connUnacked_ >= kConnectionWindow / 2 && !dead_) {
+    AppendFrameHeader(control_, 4, kWindowUpdate, 0, 0);
+    AppendUint32(control_, static_cast<uint32_t>(connUnacked_));
+    connReceiveWindow_ += connUnacked_;
+    connUnacked_ = 0;
+    Wake();
+  }
+  if (!stream)
+    return;
+  stream->unacked += static_cast<int64_t>(size);
+  if (stream->unacked >= kStreamWindow / 2 && !stream->ended &&
+      !stream->reset && !dead_) {
+    AppendFrameHeader(control_, 4, kWindowUpdate, 0, stream->id);
+    AppendUint32(control_, static_cast<uint32_t>(stream->unacked));
+    stream->receiveWindow += stream->unacked;
+    stream->unacked = 0;
+    Wake();
+  }
+}
+
+void Http2Transport::Connection::Detach(const std::shared_ptr<Stream> &stream) {
+  // mutex_ held. From here on nothing reads the caller's request body.
+  stream->body = nullptr;
+  if (!stream->inbox.empty()) {
+    Consumed(nullptr, stream->inbox.size());
+    stream->inbox.clear();
+  }
+  streams_.erase(stream->id);
+  --active_;
+  if (active_ == 0)
+    lastActive_ = Clock::now();
+  slotFree_.notify_one();
+  Wake(); // Idle timer, queued frames
+}
+
+// -----------------------------------------------------------------------------
+// I/O Thread
+// -----------------------------------------------------------------------------
+
+void Http2Transport::Connection::Run() {
+  std::string out;
+  out.reserve(kWriteBatch + kMaxFrameSize + kFrameHeaderSize);
+
+  // Body data is picked only when the socket reports room for it, so the
+  // priority order is decided as late as possible
+  bool writable = true;
+
+  for (;;) {
+    bool moreToSend = false;
+    bool finish = false;
+    int waitMs = -1;
+    std::vector<std::shared_ptr<Stream>> headersInBatch;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_ && !dead_) {
+        AppendFrameHeader(control_, 8, kGoAway, 0, 0);
+        AppendUint32(control_, 0);
+        AppendUint32(control_, kNoError);
+        Fail(L"Failed to receive response");
+        finish = true;
+      }
+      if (!dead_ && !closing_ && active_ == 0) {
+        auto idle = Clock::now() - lastActive_;
+        auto limit = std::chrono::milliseconds(config_.idleConnectionTimeoutMs);
+        if (idle >= limit) {
+          closing_ = true;
+          closedIdle_ = true;
+        } else {
+          waitMs = static_cast<int>(
+              std::chrono::duration_cast<std::chrono::milliseconds>(limit -
+                                                                    idle)
+                  .count() +
+              1);
+        }
+      }
+      if (closing_ && active_ == 0 && !dead_ && !finish) {
+        // Drained: say goodbye and end
+        AppendFrameHeader(control_, 8, kGoAway, 0, 0);
+        AppendUint32(control_, 0);
+        AppendUint32(control_, goAwayCode_);
+        finish = true;
+      }
+      moreToSend = FillOutput(out, writable);
+      headersInBatch.swap(unsentHeaders_);
+    }
+
+    if (!out.empty()) {
+      bool written = WriteAll(out);
+      out.clear();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!written) {
+        Fail(L"Failed to send request");
+        break;
+      }
+      for (const auto &stream : headersInBatch) {
+        if (stream)
+          stream->headersSent = true;
+      }
+    }
+    if (finish)
+      break;
+
+    pollfd fds[2] = {
+        {fd_, static_cast<short>(POLLIN | (moreToSend ? POLLOUT : 0)), 0},
+        {wakeRead_, POLLIN, 0}};
+    bool buffered = tls_ && tls_->Pending() > 0;
+    int ready = poll(fds, 2, buffered ? 0 : waitMs);
+    if (ready < 0 && errno != EINTR) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Fail(L"Failed to receive response");
+      break;
+    }
+    writable = ready > 0 && (fds[0].revents & POLLOUT);
+    if (ready > 0 && (fds[1].revents & POLLIN)) {
+      char drain[64];
+      while (read(wakeRead_, drain, sizeof(drain)) > 0) {
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      wakePending_ = false;
+    }
+    if (buffered || (ready > 0 && (fds[0].revents & (POLLIN | POLLHUP |
+                                                     POLLERR)))) {
+      if (!ReadFrames())
+        break;
+    }
+  }
+
+  shutdown(fd_, SHUT_RDWR);
+  finished_ = true;
+}
+
+bool Http2Transport::Connection::WriteAll(const std::string &out) {
+  const char *data = out.data();
+  size_t left = out.size();
+  while (left > 0) {
+    long n;
+    if (tls_) {
+      n = tls_->Write(data, left);
+    } else {
+      n = static_cast<long>(send(fd_, data, left, kSendFlags));
+      if (n < 0 && errno == EINTR)
+        continue;
+    }
+    if (n <= 0)
+      return false;
+    data += n;
+    left -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool Http2Transport::Connection::FillOutput(std::string &out,
+                                            bool withData) {
+  // mutex_ held. Queued frames first, then (once the socket has room) body
+  // data by priority until the batch is full or the flow-control windows
+  // are used up. True if there may be more data to send.
+  out += control_;
+  control_.clear();
+  if (dead_)
+    return false;
+  if (!withData)
+    return true;
+
+  while (out.size() < kWriteBatch && connSendWindow_ > 0) {
+    Stream *stream = NextSendable();
+    if (!stream)
+      return false;
+
+    size_t size = static_cast<size_t>(
+        std::min<int64_t>({static_cast<int64_t>(stream->left),
+                           stream->sendWindow, connSendWindow_,
+                           static_cast<int64_t>(peerMaxFrame_)}));
+    size_t frameStart = out.size();
+    out.resize(frameStart + kFrameHeaderSize + size);
+    char *data = &out[frameStart + kFrameHeaderSize];
+
+    const auto &segments = stream->body->Segments();
+    size_t filled = 0;
+    bool failed = false;
+    while (filled < size) {
+      if (stream->segmentOffset >= segments[stream->segment].size) {
+        ++stream->segment;
+        stream->segmentOffset = 0;
+        continue;
+      }
+      size_t take = static_cast<size_t>(std::min<uint64_t>(
+          size - filled,
+          segments[stream->segment].size - stream->segmentOffset));
+      size_t n = stream->body->Read(stream->segment, stream->segmentOffset,
+                                    data + filled, take);
+      if (n == 0) {
+        failed = true;
+        break;
+      }
+      filled += n;
+      stream->segmentOffset += n;
+    }
+    if (failed) {
+      out.resize(frameStart);
+      stream->failed = true;
+      stream->error = L"Failed to send request";
+      ResetStream(*stream, kInternalError);
+      out += control_;
+      control_.clear();
+      stream->cv.notify_all();
+      continue;
+    }
+
+    stream->left -= size;
+    stream->sendWindow -= static_cast<int64_t>(size);
+    connSendWindow_ -= static_cast<int64_t>(size);
+    WriteFrameHeader(&out[frameStart], size, kData,
+                     stream->left == 0 ? kEndStream : 0, stream->id);
+  }
+  return connSendWindow_ > 0;
+}
+
+Http2Transport::Connection::Stream *Http2Transport::Connection::NextSendable() {
+  // Strict priority between classes, round robin within one. Streams that
+  // are finished or detached drop out; ones waiting for window stay queued.
+  for (auto &queue : sendQueue_) {
+    for (size_t n = queue.size(); n > 0; --n) {
+      std::shared_ptr<Stream> stream = std::move(queue.front());
+      queue.pop_front();
+      if (!stream->body || stream->left == 0 || stream->failed)
+        continue;
+      Stream *candidate = stream->sendWindow > 0 ? stream.get() : nullptr;
+      queue.push_back(std::move(stream));
+      if (candidate)
+        return candidate;
+    }
+  }
+  return nullptr;
+}
+
+bool Http2Transport::Connection::ReadFrames() {
+  if (inputBegin_ > 0) {
+    memmove(input_.data(), input_.data() + inputBegin_,
+            inputEnd_ - inputBegin_);
+    inputEnd_ -= inputBegin_;
+    inputBegin_ = 0;
+  }
+  long n;
+  char *target = reinterpret_cast<char *>(input_.data()) + inputEnd_;
+  size_t room = input_.size() - inputEnd_;
+  if (tls_) {
+    n = tls_->Read(target, room);
+  } else {
+    do {
+      n = static_cast<long>(recv(fd_, target, room, 0));
+    } while (n < 0 && errno == EINTR);
+  }
+  if (n <= 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Fail(L"Failed to receive response");
+    return false;
+  }
+  inputEnd_ += static_cast<size_t>(n);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (inputEnd_ - inputBegin_ >= kFrameHeaderSize) {
+    const uint8_t *header = input_.data() + inputBegin_;
+    size_t length = (size_t(header[0]) << 16) | (size_t(header[1]) << 8) |
+                    size_t(header[2]);
+    uint8_t type = header[3];
+    uint8_t flags = header[4];
+    uint32_t id = ReadUint32(header + 5) & 0x7fffffff;
+
+    // The server's first frame must be its SETTINGS; anything else (an
+    // HTTP/1.1 status line, say) means it doesn't speak HTTP/2
+    bool valid = length <= kMaxFrameSize && (settingsSeen_ || type == kSettings);
+    if (!valid) {
+      goAwayCode_ = settingsSeen_ ? kFrameSizeError : kProtocolError;
+    } else if (inputEnd_ - inputBegin_ < kFrameHeaderSize + length) {
+      break;
+    }
+
+    ++framesReceived_;
+    if (!valid || !HandleFrame(type, flags, id, header + kFrameHeaderSize,
+                               length)) {
+      // Connection error: tell the server why, then fail every stream
+      AppendFrameHeader(control_, 8, kGoAway, 0, 0);
+      AppendUint32(control_, 0);
+      AppendUint32(control_, goAwayCode_);
+      std::string out;
+      out.swap(control_);
+      WriteAll(out);
+      Fail(L"Invalid response");
+      return false;
+    }
+    inputBegin_ += kFrameHeaderSize + length;
+  }
+  return true;
+}
+
+bool Http2Transport::Connection::HandleFrame(uint8_t type, uint8_t flags,
+                                             uint32_t id,
+                                             const uint8_t *payload,
+                                             size_t length) {
+  // mutex_ held; false is a connection error with goAwayCode_ set
+  goAwayCode_ = kProtocolError;
+  if (headerStream_ != 0 && (type != kContinuation || id != headerStream_))
+    return false; // A header block must not be interrupted
+
+  auto found = streams_.find(id);
+  Stream *stream = found != streams_.end() ? found->second.get() : nullptr;
+  if (stream)
+    stream->responded = true;
+
+  // Padding (DATA, HEADERS): pad length byte up front, padding at the end
+  size_t padding = 0;
+  if ((type == kData || type == kHeaders) && (flags & kPadded)) {
+    if (length < 1 || size_t(payload[0]) + 1 > length)
+      return false;
+    padding = payload[0];
+    ++payload;
+    length -= 1 + padding;
+  }
+
+  switch (type) {
+  case kData: {
+    if (id == 0)
+      return false;
+    size_t flowLength = length + (flags & kPadded ? padding + 1 : 0);
+    connReceiveWindow_ -= static_cast<int64_t>(flowLength);
+    if (connReceiveWindow_ < 0) {
+      goAwayCode_ = kFlowControlError;
+      return false;
+    }
+    if (!stream) {
+      if (id >= nextStreamId_)
+        return false; // A stream never opened
+      Consumed(nullptr, flowLength); // Late data for a stream we left
+      return true;
+    }
+    if (!stream->headersReady || stream->ended) {
+      stream->failed = true;
+      stream->error = L"Invalid response";
+      ResetStream(*stream, kProtocolError);
+      stream->cv.notify_all();
+      Consumed(nullptr, flowLength);
+      return true;
+    }
+    stream->receiveWindow -= static_cast<int64_t>(flowLength);
+    if (stream->receiveWindow < 0) {
+      stream->failed = true;
+      stream->error = L"Invalid response";
+      ResetStream(*stream, kFlowControlError);
+      stream->cv.notify_all();
+      Consumed(nullptr, flowLength);
+      return true;
+    }
+    stream->inbox.append(reinterpret_cast<const char *>(payload), length);
+    if (flowLength > length)
+      Consumed(stream, flowLength - length); // Padding is never read
+    if (flags & kEndStream)
+      stream->ended = true;
+    stream->cv.notify_all();
+    return true;
+  }
+
+  case kHeaders: {
+    if (id == 0)
+      return false;
+    if (flags & kPriorityFlag) {
+      if (length < 5)
+        return false;
+      payload += 5;
+      length -= 5;
+    }
+    headerBlock_.assign(reinterpret_cast<const char *>(payload), length);
+    headerStream_ = id;
+    headerFlags_ = flags;
+    return (flags & kEndHeaders) ? HandleHeaderBlock() : true;
+  }
+
+  case kContinuation:
+    if (headerStream_ == 0)
+      return false;
+    headerBlock_.append(reinterpret_cast<const char *>(payload), length);
+    if (headerBlock_.size() > kMaxHeaderBlock)
+      return false;
+    return (flags & kEndHeaders) ? HandleHeaderBlock() : true;
+
+  case kPriority:
+    if (length != 5) {
+      goAwayCode_ = kFrameSizeError;
+      return false;
+    }
+    return true;
+
+  case kRstStream: {
+    if (id == 0)
+      return false;
+    if (length != 4) {
+      goAwayCode_ = kFrameSizeError;
+      return false;
+    }
+    if (!stream)
+      return id < nextStreamId_;
+    uint32_t code = ReadUint32(payload);
+    stream->reset = true; // Closed: nothing more may be sent on it
+    stream->body = nullptr;
+    if (code == kNoError && stream->ended) {
+      stream->left = 0; // Complete response; the rest of the body isn't wanted
+    } else if (!stream->ended) {
+      stream->failed = true;
+      stream->refused = code == kRefusedStream;
+      stream->error = L"Failed to receive response";
+    }
+    stream->cv.notify_all();
+    return true;
+  }
+
+  case kSettings: {
+    if (id != 0)
+      return false;
+    if (flags & kAck) {
+      if (length != 0) {
+        goAwayCode_ = kFrameSizeError;
+        return false;
+      }
+      return true;
+    }
+    if (length % 6 != 0) {
+      goAwayCode_ = kFrameSizeError;
+      return false;
+    }
+    for (size_t i = 0; i < length; i += 6) {
+      uint16_t setting = static_cast<uint16_t>((payload[i] << 8) | payload[i + 1]);
+      uint32_t value = ReadUint32(payload + i + 2);
+      switch (setting) {
+      case kHeaderTableSize:
+        encoder_.SetMaxTableSize(value);
+        break;
+      case kMaxConcurrentStreams:
+        peerMaxStreams_ = value;
+        break;
+      case kInitialWindowSize: {
+        if (value > kMaxWindow) {
+          goAwayCode_ = kFlowControlError;
+          return false;
+        }
+        int64_t delta = static_cast<int64_t>(value) - peerInitialWindow_;
+        peerInitialWindow_ = value;
+        for (auto &entry : streams_) {
+          entry.second->sendWindow += delta;
+          if (entry.second->sendWindow > kMaxWindow) {
+            goAwayCode_ = kFlowControlError;
+            return false;
+          }
+        }
+        break;
+      }
+      case kMaxFrameSizeSetting:
+        if (value < kMaxFrameSize || value > 0xffffff)
+          return false;
+        peerMaxFrame_ = value;
+        break;
+      default:
+        break; // Push is ours to allow; unknown settings are ignored
+      }
+    }
+    settingsSeen_ = true;
+    slotFree_.notify_all();
+    AppendFrameHeader(control_, 0, kSettings, kAck, 0);
+    return true;
+  }
+
+  case kPushPromise:
+    return false; // Disabled in our SETTINGS
+
+  case kPing:
+    if (id != 0)
+      return false;
+    if (length != 8) {
+      goAwayCode_ = kFrameSizeError;
+      return false;
+    }
+    if (!(flags & kAck)) {
+      AppendFrameHeader(control_, 8, kPing, kAck, 0);
+      control_.append(reinterpret_cast<const char *>(payload), 8);
+    }
+    return true;
+
+  case kGoAway: {
+    if (id != 0 || length < 8)
+      return false;
+    // Streams above the last one the server took were never processed
+    uint32_t lastStream = ReadUint32(payload) & 0x7fffffff;
+    closing_ = true;
+    for (auto &entry : streams_) {
+      Stream &other = *entry.second;
+      if (other.id > lastStream && !other.ended && !other.failed) {
+        other.failed = true;
+        other.refused = true;
+        other.body = nullptr;
+        other.error = L"Failed to receive response";
+        other.cv.notify_all();
+      }
+    }
+    slotFree_.notify_all();
+    return true;
+  }
+
+  case kWindowUpdate: {
+    if (length != 4) {
+      goAwayCode_ = kFrameSizeError;
+      return false;
+    }
+    uint32_t increment = ReadUint32(payload) & 0x7fffffff;
+    if (id == 0) {
+      connSendWindow_ += increment;
+      if (increment == 0 || connSendWindow_ > kMaxWindow) {
+        goAwayCode_ = increment == 0 ? kProtocolError : kFlowControlError;
+        return false;
+      }
+    } else if (stream) {
+      stream->sendWindow += increment;
+      if (increment == 0 || stream->sendWindow > kMaxWindow) {
+        stream->failed = true;
+        stream->error = L"Invalid response";
+        ResetStream(*stream, increment == 0 ? kProtocolError
+                                            : kFlowControlError);
+        stream->cv.notify_all();
+      }
+    }
+    return true;
+  }
+
+  default:
+    return true; // Unknown frame types are ignored
+  }
+}
+
+bool Http2Transport::Connection::HandleHeaderBlock() {
+  // mutex_ held. Every block is decoded, even for a stream we have left,
+  // to keep the HPACK table in step with the server's.
+  uint32_t id = headerStream_;
+  bool endStream = (headerFlags_ & kEndStream) != 0;
+  headerStream_ = 0;
+
+  HpackHeaderList fields;
+  if (!decoder_.Decode(reinterpret_cast<const uint8_t *>(headerBlock_.data()),
+                       headerBlock_.size(), fields)) {
+    goAwayCode_ = kCompressionError;
+    return false;
+  }
+
+  auto found = streams_.find(id);
+  if (found == streams_.end())
+    return id < nextStreamId_;
+  Stream &stream = *found->second;
+
+  if (stream.headersReady) {
+    // Trailers: they carry nothing this client uses
+    if (endStream)
+      stream.ended = true;
+    stream.cv.notify_all();
+    return true;
+  }
+
+  int status = 0;
+  std::map<std::string, std::string> headers;
+  for (auto &field : fields) {
+    if (field.first == ":status") {
+      const std::string &value = field.second;
+      if (value.size() == 3 &&
+          value.find_first_not_of("0123456789") == std::string::npos) {
+        status = std::stoi(value);
+      }
+    } else if (!field.first.empty() && field.first[0] != ':') {
+      auto it = headers.find(field.first);
+      if (it == headers.end()) {
+        headers.emplace(std::move(field.first), std::move(field.second));
+      } else {
+        it->second += ", ";
+        it->second += field.second;
+      }
+    }
+  }
+
+  if (status == 0) {
+    stream.failed = true;
+    stream.error = L"Invalid response";
+    ResetStream(stream, kProtocolError);
+  } else if (status >= 200) {
+    stream.statusCode = status;
+    stream.headers = std::move(headers);
+    stream.headersReady = true;
+    if (endStream)
+      stream.ended = true;
+  } // 1xx: interim, the final headers follow
+  stream.cv.notify_all();
+  return true;
+}
+
+void Http2Transport::Connection::Fail(const std::wstring &error) {
+  // mutex_ held. A stream the server can't have seen, or one that heard
+  // nothing back before the connection died, may be sent again (as the
+  // HTTP/1.1 transport does for a stale keep-alive connection).
+  dead_ = true;
+  closing_ = true;
+  for (auto &entry : streams_) {
+    Stream &stream = *entry.second;
+    if (stream.ended || stream.failed)
+      continue;
+    stream.failed = true;
+    stream.refused = !stream.headersSent ||
+                     (!stream.responded &&
+                      framesReceived_ == stream.framesAtStart);
+    stream.body = nullptr;
+    stream.error = error;
+    stream.cv.notify_all();
+  }
+  slotFree_.notify_all();
+}
+
+// -----------------------------------------------------------------------------
+// Constructor / Destructor
+// -----------------------------------------------------------------------------
+
+Http2Transport::Http2Transport(std::shared_ptr<TlsProvider> tls)
+    : tls_(tls), http1_(std::move(tls)) {}
+
+Http2Transport::~Http2Transport() { Shutdown(); }
+
+// -----------------------------------------------------------------------------
+// Initialize / Shutdown
+// -----------------------------------------------------------------------------
+
+bool Http2Transport::Initialize(const HttpTransportConfig &config) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  config_ = config;
+  initialized_ = http1_.Initialize(config);
+  return initialized_;
+}
+
+void Http2Transport::Shutdown() {
+  std::vector<std::shared_ptr<Connection>> connections;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : connections_)
+      connections.push_back(std::move(entry.second));
+    connections_.clear();
+    connections.insert(connections.end(), retired_.begin(), retired_.end());
+    retired_.clear();
+    initialized_ = false;
+  }
+  for (auto &connection : connections)
+    connection->Stop();
+  http1_.Shutdown();
+}
+
+ConnectionPoolStats Http2Transport::GetPoolStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ConnectionPoolStats stats = stats_;
+  auto count = [&stats](const Connection &connection, bool live) {
+    stats.waits += connection.GetWaits();
+    stats.timeouts += connection.GetTimeouts();
+    if (live && connection.IsUsable()) {
+      ++stats.open;
+      stats.idle += connection.IsIdle() ? 1 : 0;
+    }
+  };
+  for (const auto &entry : connections_)
+    count(*entry.second, true);
+  for (const auto &connection : retired_)
+    count(*connection, false);
+
+  ConnectionPoolStats http1 = http1_.GetPoolStats();
+  stats.acquires += http1.acquires;
+  stats.hits += http1.hits;
+  stats.opened += http1.opened;
+  stats.openFailed += http1.openFailed;
+  stats.evicted += http1.evicted;
+  stats.discarded += http1.discarded;
+  stats.waits += http1.waits;
+  stats.timeouts += http1.timeouts;
+  stats.open += http1.open;
+  stats.idle += http1.idle;
+  return stats;
+}
+
+// -----------------------------------------------------------------------------
+// Connections
+// -----------------------------------------------------------------------------
+
+void Http2Transport::ReapRetired() {
+  for (auto it = retired_.begin(); it != retired_.end();) {
+    if (!(*it)->IsFinished()) {
+      ++it;
+      continue;
+    }
+    (*it)->Stop(); // Joins the (finished) thread
+    stats_.waits += (*it)->GetWaits();
+    stats_.timeouts += (*it)->GetTimeouts();
+    ++((*it)->ClosedIdle() ? stats_.evicted : stats_.discarded);
+    it = retired_.erase(it);
+  }
+}
+
+std::shared_ptr<Http2Transport::Connection>
+Http2Transport::Acquire(const HttpUrl &url, bool &http1) {
+  const std::string key = url.Origin();
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    ReapRetired();
+    if (http1Origins_.count(key)) {
+      http1 = true;
+      return nullptr;
+    }
+    auto it = connections_.find(key);
+    if (it != connections_.end()) {
+      if (it->second->IsUsable()) {
+        ++stats_.acquires;
+        ++stats_.hits;
+        return it->second;
+      }
+      retired_.push_back(std::move(it->second));
+      connections_.erase(it);
+      continue; // Reaped (and counted) now if its thread already ended
+    }
+    if (!opening_.count(key))
+      break;
+    opened_.wait(lock); // Share the connection another request is opening
+  }
+  opening_.insert(key);
+  lock.unlock();
+
+  // Connect outside the lock; other origins carry on meanwhile
+  std::shared_ptr<Connection> connection;
+  bool onlyHttp1 = false;
+  int fd = ConnectHttpSocket(url, config_);
+  std::unique_ptr<TlsSession> session;
+  if (fd >= 0 && url.secure) {
+    session = tls_->Connect(fd, url.host, {"h2", "http/1.1"});
+    onlyHttp1 = session && session->Protocol() != "h2";
+    if (!session || onlyHttp1) {
+      session.reset();
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0) {
+    connection = std::make_shared<Connection>(fd, std::move(session),
+                                              config_, url);
+    if (!connection->Start())
+      connection.reset();
+  }
+
+  lock.lock();
+  opening_.erase(key);
+  opened_.notify_all();
+  if (onlyHttp1) {
+    http1Origins_.insert(key); // Counted by the HTTP/1.1 transport
+    http1 = true;
+    return nullptr;
+  }
+  ++stats_.acquires;
+  if (!connection) {
+    ++stats_.openFailed;
+    return nullptr;
+  }
+  ++stats_.opened;
+  connections_[key] = connection;
+  return connection;
+}
+
+// -----------------------------------------------------------------------------
+// Send
+// -----------------------------------------------------------------------------
+
+HttpResponse Http2Transport::Send(const HttpRequest &request,
+                                  const HttpChunkCallback &onChunk) {
+  HttpResponse response;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!initialized_) {
+      response.error = L"HTTP transport not initialized";
+      return response;
+    }
+  }
+  if (request.url.secure && !tls_) {
+    response.error = L"HTTPS needs a TLS provider";
+    return response;
+  }
+  if (!request.url.secure && !config_.http2Cleartext)
+    return http1_.Send(request, onChunk);
+
+  bool retried = false;
+  for (;;) {
+    if (request.cancel && request.cancel->IsCancelled()) {
+      response = HttpResponse();
+      response.error = L"Cancelled";
+      return response;
+    }
+
+    bool http1 = false;
+    std::shared_ptr<Connection> connection = Acquire(request.url, http1);
+    if (http1)
+      return http1_.Send(request, onChunk);
+    if (!connection) {
+      response.error = L"Failed to connect to server";
+      return response;
+    }
+
+    response = HttpResponse();
+    Connection::Outcome outcome =
+        connection->Exchange(request, onChunk, response);
+
+    // A closing connection took nothing; a refused stream was never
+    // processed, so it goes out once more on a fresh connection
+    if (outcome == Connection::Outcome::Unusable)
+      continue;
+    if (outcome == Connection::Outcome::Refused && !retried) {
+      retried = true;
+      continue;
+    }
+    return response;
+  }
+}
+
+} // namespace invisible
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "socket_transport.h"
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// HTTP/2 Transport (POSIX)
+// All requests to a host share one connection, each as its own stream, so
+// transcription uploads, chat questions and image analyses that overlap
+// don't each need a connection (and a TLS handshake) of their own.
+// Request bodies go out frame by frame in HttpPriority order (High before
+// Normal before Low, round robin within a class), and each stream's
+// urgency is passed to the server (RFC 9218 "priority" field) to order the
+// responses. Headers are HPACK-compressed; per-stream flow control keeps a
+// slow streaming reader from holding up the other streams, and a cancelled
+// request resets only its own stream.
+//
+// https origins negotiate h2 through ALPN; one that doesn't offer it is
+// served over HTTP/1.1 by an embedded SocketTransport from then on. http://
+// origins speak h2c by prior knowledge when http2Cleartext is set, and
+// HTTP/1.1 otherwise.
+// -----------------------------------------------------------------------------
+
+class Http2Transport : public HttpTransport {
+public:
+  explicit Http2Transport(std::shared_ptr<TlsProvider> tls = nullptr);
+  ~Http2Transport() override;
+
+  // Disable copy
+  Http2Transport(const Http2Transport &) = delete;
+  Http2Transport &operator=(const Http2Transport &) = delete;
+
+  bool Initialize(const HttpTransportConfig &config) override;
+  void Shutdown() override;
+
+  HttpResponse Send(const HttpRequest &request,
+                    const HttpChunkCallback &onChunk) override;
+
+  // HTTP/2 and HTTP/1.1 connections together. hits counts requests that
+  // joined a connection already open; waits / timeouts count requests held
+  // back by the server's concurrent stream limit.
+  ConnectionPoolStats GetPoolStats() const override;
+
+private:
+  class Connection;
+
+  // The origin's live connection, opened if there is none. Returns nullptr
+  // with `http1` set when the server only speaks HTTP/1.1.
+  std::shared_ptr<Connection> Acquire(const HttpUrl &url, bool &http1);
+
+  // Join connections whose I/O thread has ended (mutex_ held)
+  void ReapRetired();
+
+  std::shared_ptr<TlsProvider> tls_;
+  HttpTransportConfig config_;
+  SocketTransport http1_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable opened_; // An origin's connect attempt finished
+  std::map<std::string, std::shared_ptr<Connection>> connections_;
+  std::vector<std::shared_ptr<Connection>> retired_; // Draining or dead
+  std::set<std::string> opening_;
+  std::set<std::string> http1Origins_;
+  ConnectionPoolStats stats_; // Counters of connections already reaped
+  bool initialized_ = false;
+};
+
+} // namespace invisible
@@ -1,10 +1,111 @@
 #include "http_client.h"
-#include <sstream>
-#include <winhttp.h>
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <random>
+
+#ifdef _WIN32
+#include "winhttp_transport.h"
+#else
+#include "http2_transport.h"
+#include "socket_transport.h"
+#ifdef INVISIBLE_HAVE_OPENSSL
+#include "openssl_tls.h"
+#endif
+#endif
 
 namespace invisible {
 
+namespace {
+
+std::unique_ptr<HttpTransport>
+CreatePlatformTransport(const HttpClientConfig &config) {
+#ifdef _WIN32
+  (void)config; // WinHTTP negotiates HTTP/2 itself when asked to
+  return std::make_unique<WinHttpTransport>();
+#else
+#ifdef INVISIBLE_HAVE_OPENSSL
+  std::shared_ptr<TlsProvider> tls = CreateOpenSslTlsProvider();
+#else
+  std::shared_ptr<TlsProvider> tls;
+#endif
+  if (config.http2)
+    return std::make_unique<Http2Transport>(tls);
+  return std::make_unique<SocketTransport>(tls);
+#endif
+}
+
+// Completion that hands the response to `future`
+HttpCompletion PromiseCompletion(std::future<HttpResponse> &future) {
+  auto promise = std::make_shared<std::promise<HttpResponse>>();
+  future = promise->get_future();
+  return [promise](HttpResponse response) {
+    promise->set_value(std::move(response));
+  };
+}
+
+// Where an attempt at `request` waits in the event loop's queue
+TaskPriority QueuePriority(const HttpRequest &request) {
+  switch (request.priority) {
+  case HttpPriority::High:
+    return TaskPriority::Urgent;
+  case HttpPriority::Low:
+    return TaskPriority::Background;
+  default:
+    return TaskPriority::Normal;
+  }
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Async Call
+// Held by the tasks and timers that will run it; the deadline and token
+// callbacks hold it weakly. A call sends one attempt at a time, plus any
+// hedges, each with its own token so a losing attempt can be cancelled
+// alone. The outcome is decided once (`finished`): by an attempt that
+// answered, by the last failed attempt, or from the timer thread when the
+// call is cancelled with nothing running. `done` runs when no attempt is
+// left in the transport, since they all borrow the call's body.
+// -----------------------------------------------------------------------------
+
+struct HttpClient::AsyncCall {
+  using Clock = std::chrono::steady_clock;
+
+  HttpRequest request; // Every attempt sends a borrowed copy of this
+  HttpChunkCallback onChunk;
+  HttpCompletion done;
+  HttpRetryPolicy retry;
+  EventLoop *loop = nullptr;
+
+  // Cancelled by the caller's token, the deadline or Shutdown()
+  std::shared_ptr<CancellationToken> token =
+      std::make_shared<CancellationToken>();
+  std::atomic<bool> timedOut{false};
+  std::atomic<uint32_t> streamOwner{0}; // Attempt whose body reached onChunk
+
+  // Everything below under `mutex`
+  std::mutex mutex;
+  EventLoop::TimerId deadline = 0;
+  EventLoop::TimerId retryTimer = 0;
+  EventLoop::TimerId hedgeTimer = 0;
+  Clock::time_point deadlineAt = Clock::time_point::max();
+  std::shared_ptr<CancellationToken> caller;
+  std::shared_ptr<CancellationToken> shutdown;
+  CancellationToken::SubscriptionId callerLink = 0;
+  CancellationToken::SubscriptionId shutdownLink = 0;
+
+  std::map<uint32_t, std::shared_ptr<CancellationToken>> running; // By id
+  uint32_t nextAttempt = 1;
+  uint32_t attempts = 0; // In a row (hedges not counted)
+  uint32_t hedges = 0;
+  uint32_t queued = 0;   // Posted or waiting out a retry delay
+  bool finished = false; // Outcome decided (in `result`)
+  bool completed = false;
+  HttpResponse result;
+};
+
 // -----------------------------------------------------------------------------
 // Constructor / Destructor
 // -----------------------------------------------------------------------------
@@ -21,71 +122,77 @@ bool HttpClient::Initialize(const HttpClientConfig &config) {
   if (initialized_) {
     return true;
   }
+  return Initialize(config, CreatePlatformTransport(config));
+}
 
-  config_ = config;
+bool HttpClient::Initialize(const HttpClientConfig &config,
+                            std::unique_ptr<HttpTransport> transport) {
+  if (initialized_ || !transport) {
+    return initialized_;
+  }
 
-  // Create WinHTTP session
-  hSession_ = WinHttpOpen(config_.userAgent.c_str(),
-                          WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
-                          WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+  config_ = config;
 
-  if (!hSession_) {
-    OutputDebugStringW(L"[HttpClient] Failed to create WinHTTP session\n");
+  HttpTransportConfig transportConfig;
+  transportConfig.userAgent = WideToUtf8(config_.userAgent);
+  transportConfig.connectTimeoutMs = config_.connectTimeoutMs;
+  transportConfig.sendTimeoutMs = config_.sendTimeoutMs;
+  transportConfig.receiveTimeoutMs = config_.receiveTimeoutMs;
+  transportConfig.maxConnectionsPerHost = config_.maxConnectionsPerHost;
+  transportConfig.idleConnectionTimeoutMs = config_.idleConnectionTimeoutMs;
+  transportConfig.http2 = config_.http2;
+  transportConfig.http2Cleartext = config_.http2Cleartext;
+
+  if (!transport->Initialize(transportConfig)) {
     return false;
   }
 
-  // Set timeouts
-  WinHttpSetTimeouts(hSession_,
-                     config_.connectTimeoutMs,  // DNS resolve timeout
-                     config_.connectTimeoutMs,  // Connect timeout
-                     config_.sendTimeoutMs,     // Send timeout
-                     config_.receiveTimeoutMs); // Receive timeout
-
+  transport_ = std::move(transport);
+  {
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    shutdown_ = std::make_shared<CancellationToken>();
+  }
   initialized_ = true;
-  OutputDebugStringW(L"[HttpClient] Initialized successfully\n");
   return true;
 }
 
 void HttpClient::Shutdown() {
-  if (hSession_) {
-    WinHttpCloseHandle(hSession_);
-    hSession_ = nullptr;
+  // Cancel the async calls still outstanding and wait for their
+  // completions, so none outlives the client
+  std::shared_ptr<CancellationToken> shutdown;
+  std::unique_ptr<EventLoop> loop;
+  {
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    shutdown = std::move(shutdown_);
+    loop = std::move(loop_);
   }
-  initialized_ = false;
-}
-
-// -----------------------------------------------------------------------------
-// URL Parsing
-// -----------------------------------------------------------------------------
-
-bool HttpClient::ParseUrl(const std::wstring &url, std::wstring &host,
-                          std::wstring &path, INTERNET_PORT &port,
-                          bool &useSSL) {
-  URL_COMPONENTS urlComp = {};
-  urlComp.dwStructSize = sizeof(urlComp);
-
-  wchar_t hostBuffer[256] = {};
-  wchar_t pathBuffer[2048] = {};
-
-  urlComp.lpszHostName = hostBuffer;
-  urlComp.dwHostNameLength = ARRAYSIZE(hostBuffer);
-  urlComp.lpszUrlPath = pathBuffer;
-  urlComp.dwUrlPathLength = ARRAYSIZE(pathBuffer);
+  if (shutdown) {
+    shutdown->Cancel();
+    std::unique_lock<std::mutex> lock(asyncMutex_);
+    asyncIdle_.wait(lock, [this] { return outstanding_ == 0; });
+  }
+  if (loop)
+    loop->Stop();
 
-  if (!WinHttpCrackUrl(url.c_str(), (DWORD)url.length(), 0, &urlComp)) {
-    return false;
+  if (transport_) {
+    transport_->Shutdown();
+    transport_.reset();
   }
+  initialized_ = false;
+}
 
-  host = hostBuffer;
-  path = pathBuffer;
-  port = urlComp.nPort;
-  useSSL = (urlComp.nScheme == INTERNET_SCHEME_HTTPS);
+ConnectionPoolStats HttpClient::GetPoolStats() const {
+  return transport_ ? transport_->GetPoolStats() : ConnectionPoolStats();
+}
 
-  if (path.empty()) {
-    path = L"/";
-  }
+HttpRetryStats HttpClient::GetRetryStats() const {
+  std::lock_guard<std::mutex> lock(statsMutex_);
+  return retryStats_;
+}
 
-  return true;
+EventLoopStats HttpClient::GetAsyncStats() const {
+  std::lock_guard<std::mutex> lock(asyncMutex_);
+  return loop_ ? loop_->GetStats() : EventLoopStats();
 }
 
 // -----------------------------------------------------------------------------
@@ -94,19 +201,9 @@ bool HttpClient::ParseUrl(const std::wstring &url, std::wstring &host,
 
 HttpResponse
 HttpClient::Get(const std::wstring &url,
-                const std::map<std::wstring, std::wstring> &headers) {
-  std::wstring host, path;
-  INTERNET_PORT port;
-  bool useSSL;
-
-  if (!ParseUrl(url, host, path, port, useSSL)) {
-    HttpResponse resp;
-    resp.error = L"Failed to parse URL";
-    return resp;
-  }
-
-  return SendRequest(host, port, useSSL, L"GET", path, headers, nullptr, 0,
-                     L"");
+                const std::map<std::wstring, std::wstring> &headers,
+                HttpPriority priority) {
+  return SendRequest(url, "GET", headers, HttpBody(), "", priority);
 }
 
 // -----------------------------------------------------------------------------
@@ -115,20 +212,22 @@ HttpClient::Get(const std::wstring &url,
 
 HttpResponse
 HttpClient::PostJson(const std::wstring &url, const std::string &jsonBody,
-                     const std::map<std::wstring, std::wstring> &headers) {
-  std::wstring host, path;
-  INTERNET_PORT port;
-  bool useSSL;
-
-  if (!ParseUrl(url, host, path, port, useSSL)) {
-    HttpResponse resp;
-    resp.error = L"Failed to parse URL";
-    return resp;
-  }
+                     const std::map<std::wstring, std::wstring> &headers,
+                     HttpPriority priority) {
+  HttpBody body;
+  body.Append(jsonBody.data(), jsonBody.size());
+  return SendRequest(url, "POST", headers, std::move(body),
+                     "application/json", priority);
+}
 
-  return SendRequest(host, port, useSSL, L"POST", path, headers,
-                     jsonBody.data(), (DWORD)jsonBody.size(),
-                     L"application/json");
+HttpResponse HttpClient::PostJsonStreaming(
+    const std::wstring &url, const std::string &jsonBody,
+    const std::map<std::wstring, std::wstring> &headers,
+    const HttpChunkCallback &onChunk, HttpPriority priority) {
+  HttpBody body;
+  body.Append(jsonBody.data(), jsonBody.size());
+  return SendRequest(url, "POST", headers, std::move(body), "application/json",
+                     priority, onChunk);
 }
 
 // -----------------------------------------------------------------------------
@@ -138,148 +237,516 @@ HttpClient::PostJson(const std::wstring &url, const std::string &jsonBody,
 HttpResponse HttpClient::PostMultipart(
     const std::wstring &url, const std::map<std::string, std::string> &fields,
     const std::string &fileName, const std::string &fileField,
-    const std::vector<BYTE> &fileData, const std::string &fileMimeType,
-    const std::map<std::wstring, std::wstring> &headers) {
-  std::wstring host, path;
-  INTERNET_PORT port;
-  bool useSSL;
+    const std::vector<uint8_t> &fileData, const std::string &fileMimeType,
+    const std::map<std::wstring, std::wstring> &headers,
+    HttpPriority priority) {
+  HttpBody file;
+  file.Append(fileData.data(), fileData.size());
+  return PostMultipart(url, fields, fileName, fileField, std::move(file),
+                       fileMimeType, headers, priority);
+}
 
-  if (!ParseUrl(url, host, path, port, useSSL)) {
-    HttpResponse resp;
-    resp.error = L"Failed to parse URL";
-    return resp;
-  }
+HttpResponse HttpClient::PostMultipart(
+    const std::wstring &url, const std::map<std::string, std::string> &fields,
+    const std::string &fileName, const std::string &fileField,
+    HttpBody &&file, const std::string &fileMimeType,
+    const std::map<std::wstring, std::wstring> &headers,
+    HttpPriority priority) {
+  std::string contentType;
+  HttpBody body = BuildMultipartBody(fields, fileName, fileField,
+                                     std::move(file), fileMimeType,
+                                     contentType);
+  return SendRequest(url, "POST", headers, std::move(body), contentType,
+                     priority);
+}
 
+HttpBody HttpClient::BuildMultipartBody(
+    const std::map<std::string, std::string> &fields,
+    const std::string &fileName, const std::string &fileField,
+    HttpBody &&file, const std::string &fileMimeType,
+    std::string &contentType) {
   // Generate boundary
   std::string boundary =
-      "----InvisibleOverlayBoundary" + std::to_string(GetTickCount64());
+      "----InvisibleOverlayBoundary" +
+      std::to_string(
+          std::chrono::steady_clock::now().time_since_epoch().count());
 
-  // Build multipart body
-  std::vector<BYTE> body;
-
-  // Add text fields
+  // Text fields and the file part's header go in one small string; the file
+  // content follows as its own pieces and the closing boundary after it
+  std::string head;
   for (const auto &field : fields) {
-    std::string part = "--" + boundary + "\r\n";
-    part +=
+    head += "--" + boundary + "\r\n";
+    head +=
         "Content-Disposition: form-data; name=\"" + field.first + "\"\r\n\r\n";
-    part += field.second + "\r\n";
-    body.insert(body.end(), part.begin(), part.end());
+    head += field.second + "\r\n";
   }
+  head += "--" + boundary + "\r\n";
+  head += "Content-Disposition: form-data; name=\"" + fileField +
+          "\"; filename=\"" + fileName + "\"\r\n";
+  head += "Content-Type: " + fileMimeType + "\r\n\r\n";
 
-  // Add file field
-  std::string filePart = "--" + boundary + "\r\n";
-  filePart += "Content-Disposition: form-data; name=\"" + fileField +
-              "\"; filename=\"" + fileName + "\"\r\n";
-  filePart += "Content-Type: " + fileMimeType + "\r\n\r\n";
-  body.insert(body.end(), filePart.begin(), filePart.end());
-  body.insert(body.end(), fileData.begin(), fileData.end());
-
-  std::string endPart = "\r\n--" + boundary + "--\r\n";
-  body.insert(body.end(), endPart.begin(), endPart.end());
+  HttpBody body;
+  body.Append(std::move(head));
+  body.Append(std::move(file));
+  body.Append("\r\n--" + boundary + "--\r\n");
 
   // Content type with boundary
-  std::wstring contentType = L"multipart/form-data; boundary=";
-  contentType += std::wstring(boundary.begin(), boundary.end());
+  contentType = "multipart/form-data; boundary=" + boundary;
+  return body;
+}
+
+// -----------------------------------------------------------------------------
+// Asynchronous Requests
+// -----------------------------------------------------------------------------
 
-  return SendRequest(host, port, useSSL, L"POST", path, headers, body.data(),
-                     (DWORD)body.size(), contentType);
+std::future<HttpResponse>
+HttpClient::GetAsync(const std::wstring &url,
+                     const std::map<std::wstring, std::wstring> &headers,
+                     const HttpAsyncOptions &options) {
+  std::future<HttpResponse> future;
+  GetAsync(url, headers, options, PromiseCompletion(future));
+  return future;
+}
+
+void HttpClient::GetAsync(const std::wstring &url,
+                          const std::map<std::wstring, std::wstring> &headers,
+                          const HttpAsyncOptions &options,
+                          HttpCompletion done) {
+  SendRequestAsync(url, "GET", headers, HttpBody(), "", options,
+                   std::move(done));
+}
+
+std::future<HttpResponse>
+HttpClient::PostJsonAsync(const std::wstring &url, std::string jsonBody,
+                          const std::map<std::wstring, std::wstring> &headers,
+                          const HttpAsyncOptions &options) {
+  std::future<HttpResponse> future;
+  PostJsonAsync(url, std::move(jsonBody), headers, options,
+                PromiseCompletion(future));
+  return future;
+}
+
+void HttpClient::PostJsonAsync(
+    const std::wstring &url, std::string jsonBody,
+    const std::map<std::wstring, std::wstring> &headers,
+    const HttpAsyncOptions &options, HttpCompletion done) {
+  HttpBody body;
+  body.Append(std::move(jsonBody));
+  SendRequestAsync(url, "POST", headers, std::move(body), "application/json",
+                   options, std::move(done));
+}
+
+std::future<HttpResponse> HttpClient::PostMultipartAsync(
+    const std::wstring &url, const std::map<std::string, std::string> &fields,
+    const std::string &fileName, const std::string &fileField,
+    HttpBody &&file, const std::string &fileMimeType,
+    const std::map<std::wstring, std::wstring> &headers,
+    const HttpAsyncOptions &options) {
+  std::future<HttpResponse> future;
+  PostMultipartAsync(url, fields, fileName, fileField, std::move(file),
+                     fileMimeType, headers, options, PromiseCompletion(future));
+  return future;
+}
+
+void HttpClient::PostMultipartAsync(
+    const std::wstring &url, const std::map<std::string, std::string> &fields,
+    const std::string &fileName, const std::string &fileField,
+    HttpBody &&file, const std::string &fileMimeType,
+    const std::map<std::wstring, std::wstring> &headers,
+    const HttpAsyncOptions &options, HttpCompletion done) {
+  std::string contentType;
+  HttpBody body = BuildMultipartBody(fields, fileName, fileField,
+                                     std::move(file), fileMimeType,
+                                     contentType);
+  SendRequestAsync(url, "POST", headers, std::move(body), contentType, options,
+                   std::move(done));
 }
 
 // -----------------------------------------------------------------------------
 // Internal: Send Request
 // -----------------------------------------------------------------------------
 
+bool HttpClient::BuildRequest(
+    const std::wstring &url, const char *method,
+    const std::map<std::wstring, std::wstring> &headers, HttpBody &&body,
+    const std::string &contentType, HttpPriority priority,
+    HttpRequest &request, HttpResponse &response) {
+  if (!ParseHttpUrl(WideToUtf8(url), request.url)) {
+    response.error = L"Failed to parse URL";
+    return false;
+  }
+  request.method = method;
+  request.body = std::move(body);
+  request.priority = priority;
+
+  // Custom headers, then the content type unless the caller set one
+  bool hasContentType = false;
+  request.headers.reserve(headers.size() + 1);
+  for (const auto &header : headers) {
+    request.headers.emplace_back(WideToUtf8(header.first),
+                                 WideToUtf8(header.second));
+    hasContentType |=
+        HttpEqualsIgnoreCase(request.headers.back().first, "Content-Type");
+  }
+  if (!contentType.empty() && !hasContentType) {
+    request.headers.emplace_back("Content-Type", contentType);
+  }
+  return true;
+}
+
 HttpResponse HttpClient::SendRequest(
-    const std::wstring &host, INTERNET_PORT port, bool useSSL,
-    const std::wstring &verb, const std::wstring &path,
-    const std::map<std::wstring, std::wstring> &headers, const void *body,
-    DWORD bodyLength, const std::wstring &contentType) {
+    const std::wstring &url, const char *method,
+    const std::map<std::wstring, std::wstring> &headers, HttpBody &&body,
+    const std::string &contentType, HttpPriority priority,
+    const HttpChunkCallback &onChunk) {
   HttpResponse response;
-  HINTERNET hConnect = nullptr;
-  HINTERNET hRequest = nullptr;
-
-  // Connect to server
-  hConnect = WinHttpConnect(hSession_, host.c_str(), port, 0);
-  if (!hConnect) {
-    response.error = L"Failed to connect to server";
+  if (!transport_) {
+    response.error = L"HTTP client not initialized";
     return response;
   }
 
-  // Create request
-  DWORD flags = useSSL ? WINHTTP_FLAG_SECURE : 0;
-  hRequest = WinHttpOpenRequest(hConnect, verb.c_str(), path.c_str(), nullptr,
-                                WINHTTP_NO_REFERER,
-                                WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
-  if (!hRequest) {
-    response.error = L"Failed to create request";
-    WinHttpCloseHandle(hConnect);
+  HttpRequest request;
+  if (!BuildRequest(url, method, headers, std::move(body), contentType,
+                    priority, request, response)) {
     return response;
   }
+  return transport_->Send(request, onChunk);
+}
 
-  // Add custom headers
-  for (const auto &header : headers) {
-    std::wstring headerLine = header.first + L": " + header.second;
-    WinHttpAddRequestHeaders(hRequest, headerLine.c_str(), (DWORD)-1,
-                             WINHTTP_ADDREQ_FLAG_ADD |
-                                 WINHTTP_ADDREQ_FLAG_REPLACE);
-  }
-
-  // Add content type if provided
-  if (!contentType.empty()) {
-    std::wstring ctHeader = L"Content-Type: " + contentType;
-    WinHttpAddRequestHeaders(hRequest, ctHeader.c_str(), (DWORD)-1,
-                             WINHTTP_ADDREQ_FLAG_ADD |
-                                 WINHTTP_ADDREQ_FLAG_REPLACE);
-  }
-
-  // Send request
-  BOOL result = WinHttpSendRequest(hRequest, WINHTTP_NO_ADDITIONAL_HEADERS, 0,
-                                   (LPVOID)body, bodyLength, bodyLength, 0);
-  if (!result) {
-    response.error = L"Failed to send request";
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    return response;
+// -----------------------------------------------------------------------------
+// Internal: Async Calls
+// -----------------------------------------------------------------------------
+
+void HttpClient::SendRequestAsync(
+    const std::wstring &url, const char *method,
+    const std::map<std::wstring, std::wstring> &headers, HttpBody &&body,
+    const std::string &contentType, const HttpAsyncOptions &options,
+    HttpCompletion done) {
+  auto call = std::make_shared<AsyncCall>();
+  call->onChunk = options.onChunk;
+  call->done = std::move(done);
+  call->retry = options.retry;
+  call->retry.maxAttempts = std::max<uint32_t>(call->retry.maxAttempts, 1);
+
+  HttpResponse response;
+  if (!BuildRequest(url, method, headers, std::move(body), contentType,
+                    options.priority, call->request, response)) {
+    call->done(std::move(response));
+    return;
   }
 
-  // Receive response
-  result = WinHttpReceiveResponse(hRequest, nullptr);
-  if (!result) {
-    response.error = L"Failed to receive response";
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    return response;
+  // The loop starts with the first async call
+  {
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    if (shutdown_ && transport_) {
+      if (!loop_) {
+        loop_ = std::make_unique<EventLoop>();
+        loop_->Start(config_.asyncThreads, config_.asyncHighThreads);
+      }
+      call->loop = loop_.get();
+      call->shutdown = shutdown_;
+      outstanding_++;
+    }
+  }
+  if (!call->loop) {
+    response.error = L"HTTP client not initialized";
+    call->done(std::move(response));
+    return;
+  }
+  call->caller = options.cancel;
+
+  if (call->retry.maxAttempts > 1 || call->retry.hedgeAfterMs > 0) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    retryStats_.calls++;
+  }
+
+  std::weak_ptr<AsyncCall> weak = call;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    call->queued = 1;
+
+    // Cancelled with nothing in the transport (queued, or waiting to
+    // retry): finish from the timer thread instead of waiting for a worker
+    call->token->Subscribe([this, weak] {
+      if (auto self = weak.lock()) {
+        self->loop->PostAfter(0, [this, weak] {
+          if (auto cancelled = weak.lock())
+            OnCancelled(cancelled);
+        });
+      }
+    });
+
+    if (options.timeoutMs > 0) {
+      call->deadlineAt = AsyncCall::Clock::now() +
+                         std::chrono::milliseconds(options.timeoutMs);
+      call->deadline = call->loop->PostAfter(options.timeoutMs, [weak] {
+        if (auto self = weak.lock()) {
+          self->timedOut = true;
+          self->token->Cancel();
+        }
+      });
+    }
+
+    // The caller's token and Shutdown() cancel the call's own token
+    auto link = [weak] {
+      if (auto self = weak.lock())
+        self->token->Cancel();
+    };
+    if (call->caller)
+      call->callerLink = call->caller->Subscribe(link);
+    call->shutdownLink = call->shutdown->Subscribe(link);
+  }
+
+  if (!call->loop->Post([this, call] { StartAttempt(call, false); },
+                        QueuePriority(call->request))) {
+    // The loop is stopping (Shutdown() on another thread)
+    call->token->Cancel();
+    {
+      std::lock_guard<std::mutex> lock(call->mutex);
+      call->queued = 0;
+    }
+    OnCancelled(call);
+  }
+}
+
+void HttpClient::StartAttempt(const std::shared_ptr<AsyncCall> &call,
+                              bool hedge) {
+  const HttpRetryPolicy &retry = call->retry;
+  auto token = std::make_shared<CancellationToken>();
+  uint32_t id = 0;
+  bool cancelled = false;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    call->queued--;
+    if (call->finished)
+      return;
+    if (call->token->IsCancelled()) {
+      // Not worth sending; if an attempt is running it reports instead
+      if (!call->running.empty())
+        return;
+      call->finished = true;
+      call->completed = true;
+      call->result.error = L"Cancelled";
+      cancelled = true;
+    } else {
+      id = call->nextAttempt++;
+      call->running.emplace(id, token);
+      if (hedge)
+        call->hedges++;
+      else
+        call->attempts++;
+
+      // A duplicate follows if this attempt is slow to answer
+      if (retry.hedgeAfterMs > 0 && call->hedges < retry.maxHedges &&
+          call->hedgeTimer == 0) {
+        call->hedgeTimer = call->loop->PostAfter(
+            retry.hedgeAfterMs, [this, call] { HedgeIfSlow(call); });
+      }
+    }
+  }
+  if (cancelled) {
+    Complete(call);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    retryStats_.attempts++;
+    if (hedge)
+      retryStats_.hedges++;
+    else if (id > 1)
+      retryStats_.retries++;
+  }
+
+  HttpRequest request;
+  request.method = call->request.method;
+  request.url = call->request.url;
+  request.headers = call->request.headers;
+  request.body = call->request.body.Borrow();
+  request.priority = call->request.priority;
+  request.cancel = token;
+
+  // The first attempt to stream a body keeps the stream; the rest lose
+  HttpChunkCallback onChunk;
+  if (call->onChunk) {
+    onChunk = [this, call, id](const char *data, size_t size) {
+      uint32_t owner = 0;
+      if (call->streamOwner.compare_exchange_strong(owner, id)) {
+        CancelOtherAttempts(call, id);
+      } else if (owner != id) {
+        return false;
+      }
+      return call->onChunk(data, size);
+    };
   }
 
-  // Get status code
-  DWORD statusCode = 0;
-  DWORD statusCodeSize = sizeof(statusCode);
-  WinHttpQueryHeaders(hRequest,
-                      WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
-                      WINHTTP_HEADER_NAME_BY_INDEX, &statusCode,
-                      &statusCodeSize, WINHTTP_NO_HEADER_INDEX);
-  response.statusCode = (int)statusCode;
-
-  // Read response body
-  std::vector<char> buffer;
-  DWORD bytesAvailable = 0;
-  DWORD bytesRead = 0;
-
-  while (WinHttpQueryDataAvailable(hRequest, &bytesAvailable) &&
-         bytesAvailable > 0) {
-    std::vector<char> chunk(bytesAvailable);
-    if (WinHttpReadData(hRequest, chunk.data(), bytesAvailable, &bytesRead)) {
-      buffer.insert(buffer.end(), chunk.begin(), chunk.begin() + bytesRead);
+  HttpResponse response;
+  {
+    ScopedCancellation link(call->token, [token] { token->Cancel(); });
+    response = transport_->Send(request, onChunk);
+  }
+  OnAttemptDone(call, id, hedge, std::move(response));
+}
+
+void HttpClient::OnAttemptDone(const std::shared_ptr<AsyncCall> &call,
+                               uint32_t id, bool hedge,
+                               HttpResponse response) {
+  std::vector<std::shared_ptr<CancellationToken>> losers;
+  bool complete = false;
+  bool hedgeWin = false;
+  bool exhausted = false;
+  bool retryAfter = false;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    call->running.erase(id);
+
+    uint32_t owner = call->streamOwner;
+    if (call->finished || (owner != 0 && owner != id)) {
+      // Decided already, or lost to an attempt that is streaming
+    } else if (call->token->IsCancelled() || owner == id ||
+               !IsRetryableResponse(response)) {
+      // An answer (or a stream that cannot be replayed): this is the result
+      call->finished = true;
+      call->result = std::move(response);
+      hedgeWin = hedge && call->result.IsSuccess();
+      for (const auto &attempt : call->running)
+        losers.push_back(attempt.second);
+    } else {
+      // Retryable failure; the latest one is reported if nothing better
+      // comes. Another attempt still running (or about to) decides next.
+      call->result = std::move(response);
+      if (call->running.empty() && call->queued == 0 &&
+          !ScheduleRetry(call, retryAfter)) {
+        call->finished = true;
+        exhausted = true;
+      }
     }
+
+    if (call->finished && call->running.empty() && !call->completed) {
+      call->completed = true;
+      complete = true;
+    }
+  }
+
+  if (hedgeWin || exhausted || retryAfter) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    retryStats_.hedgeWins += hedgeWin;
+    retryStats_.exhausted += exhausted;
+    retryStats_.retryAfterWaits += retryAfter;
+  }
+  for (const auto &loser : losers)
+    loser->Cancel();
+  if (complete)
+    Complete(call);
+}
+
+bool HttpClient::ScheduleRetry(const std::shared_ptr<AsyncCall> &call,
+                               bool &retryAfter) {
+  const HttpRetryPolicy &retry = call->retry;
+  if (call->attempts >= retry.maxAttempts)
+    return false;
+
+  // The server's Retry-After wins over our own backoff
+  uint32_t delayMs = 0;
+  retryAfter = ParseRetryAfter(call->result, std::time(nullptr), delayMs);
+  if (retryAfter) {
+    if (delayMs > retry.maxRetryAfterMs)
+      return false;
+  } else {
+    thread_local std::minstd_rand random(std::random_device{}());
+    delayMs = RetryBackoffMs(retry, call->attempts,
+                             std::uniform_real_distribution<>(0, 1)(random));
+  }
+
+  // A retry that could not finish before the deadline is not worth sending
+  if (AsyncCall::Clock::now() + std::chrono::milliseconds(delayMs) >=
+      call->deadlineAt) {
+    retryAfter = false;
+    return false;
+  }
+
+  // The retry gets its own hedge timer
+  call->loop->CancelTimer(call->hedgeTimer);
+  call->hedgeTimer = 0;
+
+  // (The timer thread may post even while the loop is stopping)
+  call->retryTimer = call->loop->PostAfter(delayMs, [this, call] {
+    call->loop->Post([this, call] { StartAttempt(call, false); },
+                     QueuePriority(call->request));
+  });
+  if (call->retryTimer == 0) {
+    retryAfter = false;
+    return false;
+  }
+  call->queued++;
+  return true;
+}
+
+void HttpClient::HedgeIfSlow(const std::shared_ptr<AsyncCall> &call) {
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    call->hedgeTimer = 0;
+    if (call->finished || call->running.empty() || call->streamOwner != 0 ||
+        call->hedges >= call->retry.maxHedges)
+      return;
+    call->queued++;
+  }
+  call->loop->Post([this, call] { StartAttempt(call, true); },
+                   QueuePriority(call->request));
+}
+
+void HttpClient::CancelOtherAttempts(const std::shared_ptr<AsyncCall> &call,
+                                     uint32_t winner) {
+  std::vector<std::shared_ptr<CancellationToken>> losers;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    for (const auto &attempt : call->running) {
+      if (attempt.first != winner)
+        losers.push_back(attempt.second);
+    }
+  }
+  for (const auto &loser : losers)
+    loser->Cancel();
+}
+
+void HttpClient::OnCancelled(const std::shared_ptr<AsyncCall> &call) {
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    if (call->finished || !call->running.empty())
+      return; // A running attempt reports the cancellation itself
+    call->finished = true;
+    call->completed = true;
+    call->result.error = L"Cancelled";
+  }
+  Complete(call);
+}
+
+void HttpClient::Complete(const std::shared_ptr<AsyncCall> &call) {
+  HttpResponse response;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    call->loop->CancelTimer(call->deadline);
+    call->loop->CancelTimer(call->retryTimer);
+    call->loop->CancelTimer(call->hedgeTimer);
+    if (call->caller)
+      call->caller->Unsubscribe(call->callerLink);
+    call->shutdown->Unsubscribe(call->shutdownLink);
+    response = std::move(call->result);
   }
 
-  response.body = std::string(buffer.begin(), buffer.end());
+  // A response that made it through despite a late cancel is kept
+  if (call->token->IsCancelled() && !response.error.empty())
+    response.error = call->timedOut ? L"Timed out" : L"Cancelled";
 
-  // Cleanup
-  WinHttpCloseHandle(hRequest);
-  WinHttpCloseHandle(hConnect);
+  call->request.body = HttpBody(); // Release borrowed memory before `done`
+  HttpCompletion done = std::move(call->done);
+  if (done)
+    done(std::move(response));
 
-  return response;
+  // Shutdown() waits for this
+  std::lock_guard<std::mutex> lock(asyncMutex_);
+  if (--outstanding_ == 0)
+    asyncIdle_.notify_all();
 }
 
 } // namespace invisible
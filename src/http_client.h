@@ -1,42 +1,74 @@
 #pragma once
 
-#include "utils.h"
+#include "cancellation_token.h"
+#include "event_loop.h"
+#include "http_transport.h"
+#include "retry_policy.h"
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
-#include <winhttp.h>
-
-#pragma comment(lib, "winhttp.lib")
 
 namespace invisible {
 
 // -----------------------------------------------------------------------------
-// HTTP Response
+// HTTP Client Configuration
 // -----------------------------------------------------------------------------
 
-struct HttpResponse {
-  int statusCode = 0;
-  std::string body;
-  std::map<std::string, std::string> headers;
-  std::wstring error;
-
-  bool IsSuccess() const { return statusCode >= 200 && statusCode < 300; }
+struct HttpClientConfig {
+  std::wstring userAgent = L"InvisibleOverlay/1.0";
+  uint32_t connectTimeoutMs = 30000;
+  uint32_t sendTimeoutMs = 30000;
+  uint32_t receiveTimeoutMs = 60000;
+  size_t maxConnectionsPerHost = 6; // Concurrent requests per host
+  uint32_t idleConnectionTimeoutMs = 50000; // Keep-alive before a fresh connect
+  bool http2 = false; // One multiplexed HTTP/2 connection per host, if offered
+  bool http2Cleartext = false; // Also for http:// URLs (h2c, e.g. a test server)
+  size_t asyncThreads = 4; // Event loop workers for *Async calls (more queue)
+  size_t asyncHighThreads = 1; // Of those, kept for High priority calls
 };
 
 // -----------------------------------------------------------------------------
-// HTTP Client Configuration
+// Asynchronous Requests
 // -----------------------------------------------------------------------------
 
-struct HttpClientConfig {
-  std::wstring userAgent = L"InvisibleOverlay/1.0";
-  DWORD connectTimeoutMs = 30000;
-  DWORD sendTimeoutMs = 30000;
-  DWORD receiveTimeoutMs = 60000;
+struct HttpAsyncOptions {
+  HttpPriority priority = HttpPriority::Normal;
+  uint32_t timeoutMs = 0; // Whole call, time in the queue included; 0 = none
+  std::shared_ptr<CancellationToken> cancel; // Caller's token (optional)
+  HttpChunkCallback onChunk; // Stream a successful body (on a loop thread)
+  HttpRetryPolicy retry;     // Retries and hedges (default: one attempt)
 };
 
+// Runs once per call on an event loop thread (on the calling thread only
+// if the loop could not take the call). error is L"Timed out" when the
+// deadline passed and L"Cancelled" when the token fired. After retries the
+// last attempt's response is reported.
+using HttpCompletion = std::function<void(HttpResponse response)>;
+
 // -----------------------------------------------------------------------------
-// HTTP Client (WinHTTP wrapper)
+// HTTP Client
+// Builds requests (URL parsing, headers, multipart bodies) and hands them to
+// a transport: WinHTTP on Windows, sockets elsewhere. Requests carry an
+// HttpPriority. The POSIX HTTP/2 transport also uses it to order the
+// frames of overlapping calls (tests only).
+//
+// The *Async calls return at once and finish on a small event loop that is
+// started on first use: a fixed set of asyncThreads workers plus a timer
+// thread, however many calls are in flight. Calls beyond the worker count
+// wait in its queue, High priority ones first, and asyncHighThreads of the
+// workers only take High priority calls, so a chat question never waits
+// behind uploads. Each call has its own cancellation token, cancelled by
+// the caller's token, by its deadline, or by Shutdown(), which also waits
+// for every outstanding completion. A call with a retry policy resends
+// after a 429/5xx or a dropped connection (backing off on the timer
+// thread, never past its deadline) and may race a hedged duplicate
+// against a slow first attempt.
 // -----------------------------------------------------------------------------
 
 class HttpClient {
@@ -48,47 +80,166 @@ public:
   HttpClient(const HttpClient &) = delete;
   HttpClient &operator=(const HttpClient &) = delete;
 
-  // Initialize the client
+  // Initialize the client with the platform's transport
   bool Initialize(const HttpClientConfig &config = HttpClientConfig());
 
+  // Initialize with a specific transport (e.g. sockets with a TLS provider)
+  bool Initialize(const HttpClientConfig &config,
+                  std::unique_ptr<HttpTransport> transport);
+
   // Shutdown and release resources
   void Shutdown();
 
   // Synchronous GET request
   HttpResponse Get(const std::wstring &url,
-                   const std::map<std::wstring, std::wstring> &headers = {});
+                   const std::map<std::wstring, std::wstring> &headers = {},
+                   HttpPriority priority = HttpPriority::Normal);
 
   // Synchronous POST request with JSON body
   HttpResponse
   PostJson(const std::wstring &url, const std::string &jsonBody,
-           const std::map<std::wstring, std::wstring> &headers = {});
+           const std::map<std::wstring, std::wstring> &headers = {},
+           HttpPriority priority = HttpPriority::Normal);
+
+  // POST with JSON body, streaming the response body to `onChunk` instead
+  // of buffering it (error responses are still buffered into `body`).
+  // Sets error to L"Cancelled" when the callback stops the transfer.
+  HttpResponse
+  PostJsonStreaming(const std::wstring &url, const std::string &jsonBody,
+                    const std::map<std::wstring, std::wstring> &headers,
+                    const HttpChunkCallback &onChunk,
+                    HttpPriority priority = HttpPriority::Normal);
+
+  // Synchronous POST request with multipart form data (for file uploads).
+  // The file is sent from `fileData` in place, not copied into the body.
+  HttpResponse PostMultipart(
+      const std::wstring &url, const std::map<std::string, std::string> &fields,
+      const std::string &fileName, const std::string &fileField,
+      const std::vector<uint8_t> &fileData, const std::string &fileMimeType,
+      const std::map<std::wstring, std::wstring> &headers = {},
+      HttpPriority priority = HttpPriority::Normal);
 
-  // Synchronous POST request with multipart form data (for file uploads)
+  // Multipart upload whose file content is an HttpBody: several buffers
+  // (e.g. a WAV header and the PCM behind it) or a file / ring reader
   HttpResponse PostMultipart(
       const std::wstring &url, const std::map<std::string, std::string> &fields,
       const std::string &fileName, const std::string &fileField,
-      const std::vector<BYTE> &fileData, const std::string &fileMimeType,
-      const std::map<std::wstring, std::wstring> &headers = {});
+      HttpBody &&file, const std::string &fileMimeType,
+      const std::map<std::wstring, std::wstring> &headers = {},
+      HttpPriority priority = HttpPriority::Normal);
+
+  // Asynchronous GET: the response through the future, or to `done`
+  std::future<HttpResponse>
+  GetAsync(const std::wstring &url,
+           const std::map<std::wstring, std::wstring> &headers = {},
+           const HttpAsyncOptions &options = HttpAsyncOptions());
+  void GetAsync(const std::wstring &url,
+                const std::map<std::wstring, std::wstring> &headers,
+                const HttpAsyncOptions &options, HttpCompletion done);
+
+  // Asynchronous POST with a JSON body (moved in, owned by the call)
+  std::future<HttpResponse>
+  PostJsonAsync(const std::wstring &url, std::string jsonBody,
+                const std::map<std::wstring, std::wstring> &headers = {},
+                const HttpAsyncOptions &options = HttpAsyncOptions());
+  void PostJsonAsync(const std::wstring &url, std::string jsonBody,
+                     const std::map<std::wstring, std::wstring> &headers,
+                     const HttpAsyncOptions &options, HttpCompletion done);
+
+  // Asynchronous multipart upload. Memory the file body borrows must stay
+  // valid until the call completes.
+  std::future<HttpResponse> PostMultipartAsync(
+      const std::wstring &url, const std::map<std::string, std::string> &fields,
+      const std::string &fileName, const std::string &fileField,
+      HttpBody &&file, const std::string &fileMimeType,
+      const std::map<std::wstring, std::wstring> &headers = {},
+      const HttpAsyncOptions &options = HttpAsyncOptions());
+  void PostMultipartAsync(
+      const std::wstring &url, const std::map<std::string, std::string> &fields,
+      const std::string &fileName, const std::string &fileField,
+      HttpBody &&file, const std::string &fileMimeType,
+      const std::map<std::wstring, std::wstring> &headers,
+      const HttpAsyncOptions &options, HttpCompletion done);
 
   // Check if initialized
   bool IsInitialized() const { return initialized_; }
 
+  // Keep-alive pool metrics (hits = requests that skipped a new connection)
+  ConnectionPoolStats GetPoolStats() const;
+
+  // Event loop metrics (all zero before the first async call)
+  EventLoopStats GetAsyncStats() const;
+
+  // Retry and hedging metrics of async calls
+  HttpRetryStats GetRetryStats() const;
+
 private:
-  // Parse URL into components
-  bool ParseUrl(const std::wstring &url, std::wstring &host, std::wstring &path,
-                INTERNET_PORT &port, bool &useSSL);
-
-  // Send request and receive response
-  HttpResponse SendRequest(const std::wstring &host, INTERNET_PORT port,
-                           bool useSSL, const std::wstring &verb,
-                           const std::wstring &path,
+  struct AsyncCall;
+
+  // Parse the URL and attach headers; sets response.error on failure
+  bool BuildRequest(const std::wstring &url, const char *method,
+                    const std::map<std::wstring, std::wstring> &headers,
+                    HttpBody &&body, const std::string &contentType,
+                    HttpPriority priority, HttpRequest &request,
+                    HttpResponse &response);
+
+  // Body and content type of a multipart upload
+  static HttpBody BuildMultipartBody(
+      const std::map<std::string, std::string> &fields,
+      const std::string &fileName, const std::string &fileField,
+      HttpBody &&file, const std::string &fileMimeType,
+      std::string &contentType);
+
+  // Build the request and hand it to the transport
+  HttpResponse SendRequest(const std::wstring &url, const char *method,
                            const std::map<std::wstring, std::wstring> &headers,
-                           const void *body, DWORD bodyLength,
-                           const std::wstring &contentType);
+                           HttpBody &&body, const std::string &contentType,
+                           HttpPriority priority,
+                           const HttpChunkCallback &onChunk = nullptr);
+
+  // Build the request and queue it on the event loop
+  void SendRequestAsync(const std::wstring &url, const char *method,
+                        const std::map<std::wstring, std::wstring> &headers,
+                        HttpBody &&body, const std::string &contentType,
+                        const HttpAsyncOptions &options, HttpCompletion done);
 
-  HINTERNET hSession_ = nullptr;
+  // Send one attempt of a call on a worker (`hedge`: a duplicate of a
+  // slow attempt), then decide: result, retry, or wait for another attempt
+  void StartAttempt(const std::shared_ptr<AsyncCall> &call, bool hedge);
+  void OnAttemptDone(const std::shared_ptr<AsyncCall> &call, uint32_t id,
+                     bool hedge, HttpResponse response);
+
+  // Arm the retry timer after a retryable failure (call->mutex held);
+  // false when the policy, Retry-After or the deadline rules it out
+  bool ScheduleRetry(const std::shared_ptr<AsyncCall> &call,
+                     bool &retryAfter);
+
+  // Timer thread: start a hedge if the call is still waiting
+  void HedgeIfSlow(const std::shared_ptr<AsyncCall> &call);
+
+  // An attempt won the stream; cancel the others
+  void CancelOtherAttempts(const std::shared_ptr<AsyncCall> &call,
+                           uint32_t winner);
+
+  // Finish a cancelled call that has no attempt running
+  void OnCancelled(const std::shared_ptr<AsyncCall> &call);
+
+  // Tear down timers and links, then run the completion
+  void Complete(const std::shared_ptr<AsyncCall> &call);
+
+  std::unique_ptr<HttpTransport> transport_;
   HttpClientConfig config_;
   bool initialized_ = false;
+
+  // Async calls
+  mutable std::mutex asyncMutex_;
+  std::condition_variable asyncIdle_; // outstanding_ dropped to zero
+  std::unique_ptr<EventLoop> loop_;
+  std::shared_ptr<CancellationToken> shutdown_; // Cancels every call
+  size_t outstanding_ = 0; // Calls whose completion has not run yet
+
+  mutable std::mutex statsMutex_;
+  HttpRetryStats retryStats_;
 };
 
 } // namespace invisible
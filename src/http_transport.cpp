@@ -0,0 +1,529 @@
+#include "http_transport.h"
+#include <algorithm>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+char ToLowerAscii(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+std::string_view TrimSpaces(std::string_view text) {
+  while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    text.remove_prefix(1);
+  while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+    text.remove_suffix(1);
+  return text;
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// URL Parsing
+// -----------------------------------------------------------------------------
+
+std::string HttpUrl::Origin() const {
+  std::string origin = secure ? "https://" : "http://";
+  if (host.find(':') != std::string::npos) {
+    origin += '[';
+    origin += host;
+    origin += ']';
+  } else {
+    origin += host;
+  }
+  origin += ':';
+  origin += std::to_string(port);
+  return origin;
+}
+
+bool ParseHttpUrl(std::string_view url, HttpUrl &out) {
+  size_t schemeEnd = url.find("://");
+  if (schemeEnd == std::string_view::npos)
+    return false;
+
+  std::string_view scheme = url.substr(0, schemeEnd);
+  if (HttpEqualsIgnoreCase(scheme, "https")) {
+    out.secure = true;
+    out.port = 443;
+  } else if (HttpEqualsIgnoreCase(scheme, "http")) {
+    out.secure = false;
+    out.port = 80;
+  } else {
+    return false;
+  }
+
+  std::string_view rest = url.substr(schemeEnd + 3);
+  size_t authorityEnd = rest.find_first_of("/?#");
+  std::string_view authority = rest.substr(0, authorityEnd);
+  std::string_view path = authorityEnd == std::string_view::npos
+                              ? std::string_view()
+                              : rest.substr(authorityEnd);
+
+  if (authority.find('@') != std::string_view::npos)
+    return false; // User info is never sent to the API hosts
+
+  std::string_view host = authority;
+  std::string_view port;
+  if (!authority.empty() && authority[0] == '[') {
+    size_t close = authority.find(']');
+    if (close == std::string_view::npos)
+      return false;
+    host = authority.substr(1, close - 1);
+    std::string_view after = authority.substr(close + 1);
+    if (!after.empty()) {
+      if (after[0] != ':')
+        return false;
+      port = after.substr(1);
+    }
+  } else {
+    size_t colon = authority.rfind(':');
+    if (colon != std::string_view::npos) {
+      host = authority.substr(0, colon);
+      port = authority.substr(colon + 1);
+    }
+  }
+  if (host.empty())
+    return false;
+
+  if (!port.empty()) {
+    uint32_t value = 0;
+    for (char c : port) {
+      if (c < '0' || c > '9')
+        return false;
+      value = value * 10 + static_cast<uint32_t>(c - '0');
+      if (value > 65535)
+        return false;
+    }
+    if (value == 0)
+      return false;
+    out.port = static_cast<uint16_t>(value);
+  }
+
+  out.host.assign(host.data(), host.size());
+  std::transform(out.host.begin(), out.host.end(), out.host.begin(),
+                 ToLowerAscii);
+
+  // The fragment never goes on the wire
+  size_t fragment = path.find('#');
+  if (fragment != std::string_view::npos)
+    path = path.substr(0, fragment);
+  if (path.empty()) {
+    out.path = "/";
+  } else if (path[0] == '?') {
+    out.path = "/";
+    out.path.append(path.data(), path.size());
+  } else {
+    out.path.assign(path.data(), path.size());
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Request Body
+// -----------------------------------------------------------------------------
+
+void HttpBody::Append(const void *data, size_t size) {
+  if (size == 0)
+    return;
+  Segment segment;
+  segment.data = static_cast<const char *>(data);
+  segment.size = size;
+  segments_.push_back(std::move(segment));
+  size_ += size;
+}
+
+void HttpBody::Append(std::string text) {
+  if (text.empty())
+    return;
+  owned_.push_back(std::make_unique<std::string>(std::move(text)));
+  Append(owned_.back()->data(), owned_.back()->size());
+}
+
+void HttpBody::Append(uint64_t size, HttpBodyReadFn read) {
+  if (size == 0)
+    return;
+  Segment segment;
+  segment.size = size;
+  segment.read = std::move(read);
+  segments_.push_back(std::move(segment));
+  size_ += size;
+}
+
+void HttpBody::Append(HttpBody &&other) {
+  for (auto &segment : other.segments_)
+    segments_.push_back(std::move(segment));
+  for (auto &text : other.owned_)
+    owned_.push_back(std::move(text));
+  size_ += other.size_;
+  other.segments_.clear();
+  other.owned_.clear();
+  other.size_ = 0;
+}
+
+HttpBody HttpBody::Borrow() const {
+  HttpBody body;
+  body.segments_ = segments_;
+  body.size_ = size_;
+  return body;
+}
+
+size_t HttpBody::Read(size_t index, uint64_t offset, void *buffer,
+                      size_t size) const {
+  const Segment &segment = segments_[index];
+  if (offset >= segment.size)
+    return 0;
+  size = static_cast<size_t>(std::min<uint64_t>(size, segment.size - offset));
+  if (segment.data) {
+    memcpy(buffer, segment.data + offset, size);
+    return size;
+  }
+  return segment.read ? segment.read(offset, buffer, size) : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Message Helpers
+// -----------------------------------------------------------------------------
+
+const char *HttpPriorityField(HttpPriority priority) {
+  switch (priority) {
+  case HttpPriority::High:
+    return "u=1";
+  case HttpPriority::Low:
+    return "u=5";
+  default:
+    return nullptr;
+  }
+}
+
+bool HttpContentLength(const HttpResponse &response, uint64_t &length) {
+  auto it = response.headers.find("content-length");
+  if (it == response.headers.end())
+    return false;
+  const std::string &value = it->second;
+  if (value.empty() || value.size() > 18 ||
+      value.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  length = std::stoull(value);
+  return true;
+}
+
+bool HttpEqualsIgnoreCase(std::string_view a, std::string_view b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (ToLowerAscii(a[i]) != ToLowerAscii(b[i]))
+      return false;
+  }
+  return true;
+}
+
+bool ParseHttpResponseHead(std::string_view head, HttpResponse &response) {
+  size_t lineEnd = head.find('\n');
+  std::string_view statusLine = head.substr(0, lineEnd);
+  if (!statusLine.empty() && statusLine.back() == '\r')
+    statusLine.remove_suffix(1);
+
+  // "HTTP/1.1 200 Reason"
+  if (statusLine.size() < 12 || statusLine.compare(0, 5, "HTTP/") != 0)
+    return false;
+  size_t space = statusLine.find(' ');
+  if (space == std::string_view::npos || space + 4 > statusLine.size())
+    return false;
+  int status = 0;
+  for (size_t i = space + 1; i < space + 4; ++i) {
+    char c = statusLine[i];
+    if (c < '0' || c > '9')
+      return false;
+    status = status * 10 + (c - '0');
+  }
+  if (space + 4 < statusLine.size() && statusLine[space + 4] != ' ')
+    return false;
+  response.statusCode = status;
+  response.headers.clear();
+
+  while (lineEnd != std::string_view::npos) {
+    size_t start = lineEnd + 1;
+    lineEnd = head.find('\n', start);
+    std::string_view line = head.substr(start, lineEnd == std::string_view::npos
+                                                   ? std::string_view::npos
+                                                   : lineEnd - start);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (line.empty())
+      break;
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0)
+      continue; // Obsolete line folding or junk: ignore
+
+    std::string name(line.substr(0, colon));
+    std::transform(name.begin(), name.end(), name.begin(), ToLowerAscii);
+    std::string_view value = TrimSpaces(line.substr(colon + 1));
+
+    auto it = response.headers.find(name);
+    if (it == response.headers.end()) {
+      response.headers.emplace(std::move(name), std::string(value));
+    } else {
+      it->second += ", ";
+      it->second.append(value.data(), value.size());
+    }
+  }
+  return true;
+}
+
+std::string WideToUtf8(std::wstring_view text) {
+  std::string out;
+  out.reserve(text.size());
+  for (size_t i = 0; i < text.size(); ++i) {
+    uint32_t c = static_cast<uint32_t>(text[i]);
+    if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF &&
+        i + 1 < text.size()) {
+      uint32_t low = static_cast<uint32_t>(text[i + 1]);
+      if (low >= 0xDC00 && low <= 0xDFFF) {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        ++i;
+      }
+    }
+    if (c >= 0xD800 && c <= 0xDFFF)
+      c = 0xFFFD; // Unpaired surrogate
+    if (c < 0x80) {
+      out += static_cast<char>(c);
+    } else if (c < 0x800) {
+      out += static_cast<char>(0xC0 | (c >> 6));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+      out += static_cast<char>(0xE0 | (c >> 12));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (c >> 18));
+      out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+  }
+  return out;
+}
+
+std::wstring Utf8ToWide(std::string_view text) {
+  std::wstring out;
+  out.reserve(text.size());
+  size_t i = 0;
+  while (i < text.size()) {
+    uint8_t lead = static_cast<uint8_t>(text[i]);
+    uint32_t c = 0xFFFD;
+    size_t length = 1;
+    if (lead < 0x80) {
+      c = lead;
+    } else if (lead >= 0xC2 && lead < 0xF5) {
+      size_t need = lead < 0xE0 ? 1 : lead < 0xF0 ? 2 : 3;
+      uint32_t value = lead & (0x3F >> need);
+      size_t j = 1;
+      for (; j <= need && i + j < text.size(); ++j) {
+        uint8_t next = static_cast<uint8_t>(text[i + j]);
+        if ((next & 0xC0) != 0x80)
+          break;
+        value = (value << 6) | (next & 0x3F);
+      }
+      if (j == need + 1) {
+        static const uint32_t kMin[] = {0, 0x80, 0x800, 0x10000};
+        if (value >= kMin[need] && value <= 0x10FFFF &&
+            !(value >= 0xD800 && value <= 0xDFFF))
+          c = value;
+        length = need + 1;
+      } else {
+        length = j; // Replace the truncated sequence as one character
+      }
+    }
+    if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+      c -= 0x10000;
+      out += static_cast<wchar_t>(0xD800 + (c >> 10));
+      out += static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+    } else {
+      out += static_cast<wchar_t>(c);
+    }
+    i += length;
+  }
+  return out;
+}
+
+// -----------------------------------------------------------------------------
+// Response Body Reader
+// -----------------------------------------------------------------------------
+
+HttpBodyReader::HttpBodyReader(HttpResponse &response,
+                               const HttpChunkCallback &onChunk)
+    : response_(response), onChunk_(onChunk),
+      streaming_(onChunk && response.IsSuccess()) {
+  used_ = response_.body.size();
+}
+
+void HttpBodyReader::Expect(uint64_t contentLength) {
+  if (streaming_)
+    return;
+  uint64_t total = used_ + std::min(contentLength, MAX_PREALLOCATION);
+  if (total > response_.body.size())
+    response_.body.resize(static_cast<size_t>(total));
+}
+
+char *HttpBodyReader::Prepare(size_t size) {
+  std::string &body = response_.body;
+  if (body.size() - used_ < size) {
+    // Double as data keeps coming without a Content-Length
+    body.resize(std::max(used_ + size, body.size() * 2));
+  }
+  return &body[used_];
+}
+
+bool HttpBodyReader::Append(const char *data, size_t size) {
+  if (cancelled_)
+    return false;
+  if (!streaming_) {
+    if (response_.body.size() == used_) {
+      response_.body.append(data, size); // No space set aside: plain append
+    } else {
+      memcpy(Prepare(size), data, size);
+    }
+    used_ += size;
+    return true;
+  }
+  if (!onChunk_(data, size)) {
+    cancelled_ = true;
+    return false;
+  }
+  return true;
+}
+
+void HttpBodyReader::Finish() {
+  if (!streaming_ && response_.body.size() != used_)
+    response_.body.resize(used_);
+}
+
+// -----------------------------------------------------------------------------
+// Chunked Transfer Decoder
+// -----------------------------------------------------------------------------
+
+size_t HttpChunkedDecoder::Feed(const char *data, size_t size,
+                                const OutputFn &output) {
+  size_t i = 0;
+  while (i < size) {
+    char c = data[i];
+    switch (state_) {
+    case State::Size: {
+      int digit = HexValue(c);
+      if (digit >= 0) {
+        if (++sizeDigits_ > 15) {
+          state_ = State::Error;
+          return i;
+        }
+        remaining_ = (remaining_ << 4) | static_cast<uint64_t>(digit);
+      } else if (sizeDigits_ == 0) {
+        state_ = State::Error;
+        return i;
+      } else if (c == ';' || c == ' ' || c == '\t') {
+        state_ = State::Extension;
+      } else if (c == '\r') {
+        state_ = State::SizeLF;
+      } else if (c == '\n') {
+        state_ = remaining_ ? State::Data : State::Trailer; // Bare LF
+      } else {
+        state_ = State::Error;
+        return i;
+      }
+      ++i;
+      break;
+    }
+    case State::Extension:
+      if (c == '\r')
+        state_ = State::SizeLF;
+      else if (c == '\n')
+        state_ = remaining_ ? State::Data : State::Trailer;
+      ++i;
+      break;
+    case State::SizeLF:
+      if (c != '\n') {
+        state_ = State::Error;
+        return i;
+      }
+      state_ = remaining_ ? State::Data : State::Trailer;
+      ++i;
+      break;
+    case State::Data: {
+      size_t take = static_cast<size_t>(
+          std::min<uint64_t>(remaining_, static_cast<uint64_t>(size - i)));
+      remaining_ -= take;
+      if (remaining_ == 0)
+        state_ = State::DataCR;
+      bool keepGoing = output ? output(data + i, take) : true;
+      i += take;
+      if (!keepGoing)
+        return i;
+      break;
+    }
+    case State::DataCR:
+      if (c == '\r') {
+        state_ = State::DataLF;
+      } else if (c == '\n') {
+        state_ = State::Size;
+        sizeDigits_ = 0;
+      } else {
+        state_ = State::Error;
+        return i;
+      }
+      ++i;
+      break;
+    case State::DataLF:
+      if (c != '\n') {
+        state_ = State::Error;
+        return i;
+      }
+      state_ = State::Size;
+      sizeDigits_ = 0;
+      ++i;
+      break;
+    case State::Trailer:
+    case State::TrailerLF:
+      if (c == '\r' && state_ == State::Trailer) {
+        state_ = State::TrailerLF;
+        ++i;
+        break;
+      }
+      if (c == '\n') {
+        ++i;
+        if (trailerEmpty_) {
+          state_ = State::Done;
+          return i;
+        }
+        trailerEmpty_ = true;
+        state_ = State::Trailer;
+        break;
+      }
+      if (state_ == State::TrailerLF) {
+        state_ = State::Error;
+        return i;
+      }
+      trailerEmpty_ = false;
+      ++i;
+      break;
+    case State::Done:
+    case State::Error:
+      return i;
+    }
+  }
+  return i;
+}
+
+} // namespace invisible
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "cancellation_token.h"
+#include "connection_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// HTTP Response
+// -----------------------------------------------------------------------------
+
+struct HttpResponse {
+  int statusCode = 0;
+  std::string body;
+  std::map<std::string, std::string> headers; // Names lower-cased
+  std::wstring error;
+
+  bool IsSuccess() const { return statusCode >= 200 && statusCode < 300; }
+};
+
+// Receives a successful response body piece by piece as it arrives.
+// Return false to cancel the request.
+using HttpChunkCallback = std::function<bool(const char *data, size_t size)>;
+
+// -----------------------------------------------------------------------------
+// URL
+// -----------------------------------------------------------------------------
+
+struct HttpUrl {
+  bool secure = false; // https
+  std::string host;    // Without brackets for IPv6 literals
+  uint16_t port = 0;
+  std::string path = "/"; // Path and query
+
+  // Pool key / origin, e.g. "https://api.groq.com:443"
+  std::string Origin() const;
+};
+
+// Parse an absolute http:// or https:// URL (no user info)
+bool ParseHttpUrl(std::string_view url, HttpUrl &out);
+
+// -----------------------------------------------------------------------------
+// HTTP Request Body
+// A body made of pieces that are sent in order without ever being joined:
+// spans of caller memory (which must outlive the request), small owned
+// strings (multipart framing), and sources read on demand (a file, a ring
+// buffer). Sources are read by offset, so a request can be replayed.
+// -----------------------------------------------------------------------------
+
+// Fill `buffer` with up to `size` bytes starting at `offset`; return the
+// count written (0 means the source failed)
+using HttpBodyReadFn =
+    std::function<size_t(uint64_t offset, void *buffer, size_t size)>;
+
+class HttpBody {
+public:
+  struct Segment {
+    const char *data = nullptr; // Null for a read source
+    uint64_t size = 0;
+    HttpBodyReadFn read;
+  };
+
+  HttpBody() = default;
+  HttpBody(HttpBody &&) = default;
+  HttpBody &operator=(HttpBody &&) = default;
+
+  // Borrow `size` bytes at `data`
+  void Append(const void *data, size_t size);
+
+  // Take ownership of `text`
+  void Append(std::string text);
+
+  // Read `size` bytes through `read` while sending
+  void Append(uint64_t size, HttpBodyReadFn read);
+
+  // Move another body's pieces onto the end of this one
+  void Append(HttpBody &&other);
+
+  // A body sending the same pieces, borrowing the ones this body owns;
+  // this body must outlive it (another attempt at the same request)
+  HttpBody Borrow() const;
+
+  uint64_t Size() const { return size_; }
+  bool Empty() const { return size_ == 0; }
+  const std::vector<Segment> &Segments() const { return segments_; }
+
+  // Fill `buffer` from segment `index` at `offset` (either kind of
+  // segment); returns the bytes written, 0 on a source failure
+  size_t Read(size_t index, uint64_t offset, void *buffer, size_t size) const;
+
+private:
+  std::vector<Segment> segments_;
+  std::vector<std::unique_ptr<std::string>> owned_; // Stable addresses
+  uint64_t size_ = 0;
+};
+
+// -----------------------------------------------------------------------------
+// HTTP Request (transport input)
+// -----------------------------------------------------------------------------
+
+using HttpHeaderList = std::vector<std::pair<std::string, std::string>>;
+
+// How urgent a request is next to others in flight to the same host. A
+// transport that multiplexes requests over one connection (HTTP/2) sends
+// higher classes first and passes the urgency on to the server; the others
+// ignore it.
+enum class HttpPriority { High, Normal, Low };
+
+// "priority" header value for the class (RFC 9218 urgency); nullptr for
+// Normal, which is the protocol default
+const char *HttpPriorityField(HttpPriority priority);
+
+struct HttpRequest {
+  std::string method = "GET";
+  HttpUrl url;
+  HttpHeaderList headers; // Caller headers, Content-Type included
+  HttpBody body;
+  HttpPriority priority = HttpPriority::Normal;
+
+  // Cancelling aborts the transfer wherever it is blocked (the response
+  // error becomes L"Cancelled"); may be null
+  std::shared_ptr<CancellationToken> cancel;
+};
+
+// -----------------------------------------------------------------------------
+// HTTP Transport
+// A backend that carries one request and its response over the network
+// (WinHTTP on Windows, sockets elsewhere). Backends own their connection
+// pooling; HttpClient builds the request and never sees a socket.
+// -----------------------------------------------------------------------------
+
+struct HttpTransportConfig {
+  std::string userAgent = "InvisibleOverlay/1.0";
+  uint32_t connectTimeoutMs = 30000;
+  uint32_t sendTimeoutMs = 30000;
+  uint32_t receiveTimeoutMs = 60000;
+  size_t maxConnectionsPerHost = 6;
+  uint32_t idleConnectionTimeoutMs = 50000;
+  bool http2 = false;          // Multiplex over HTTP/2 where the server offers it
+  bool http2Cleartext = false; // http:// URLs speak h2c (prior knowledge)
+};
+
+class HttpTransport {
+public:
+  virtual ~HttpTransport() = default;
+
+  virtual bool Initialize(const HttpTransportConfig &config) = 0;
+  virtual void Shutdown() = 0;
+
+  // Send `request` and read the response. A successful body goes to
+  // `onChunk` when one is given; error bodies are always buffered. Safe to
+  // call from several threads at once.
+  virtual HttpResponse Send(const HttpRequest &request,
+                            const HttpChunkCallback &onChunk) = 0;
+
+  // Keep-alive pool metrics
+  virtual ConnectionPoolStats GetPoolStats() const = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Message Helpers (shared by the backends)
+// -----------------------------------------------------------------------------
+
+// Parse "HTTP/1.1 200 OK\r\nName: value\r\n..." (the blank line optional)
+// into status code and lower-cased headers. Repeated headers are joined
+// with ", ". Returns false if the status line is malformed.
+bool ParseHttpResponseHead(std::string_view head, HttpResponse &response);
+
+// Content-Length of `response`; false if absent or malformed
+bool HttpContentLength(const HttpResponse &response, uint64_t &length);
+
+// Case-insensitive ASCII comparison
+bool HttpEqualsIgnoreCase(std::string_view a, std::string_view b);
+
+// UTF-8 <-> wide (UTF-16 on Windows, UTF-32 elsewhere)
+std::string WideToUtf8(std::wstring_view text);
+std::wstring Utf8ToWide(std::string_view text);
+
+// -----------------------------------------------------------------------------
+// Response Body Reader
+// Collects a response body for the backends. A buffered body is received
+// straight into response.body: the string is sized once from Content-Length
+// (or grown geometrically without one), the backend reads into the free
+// space at its end, and the size is trimmed once when done, so the bytes
+// are never staged in a scratch buffer and copied over. A streaming caller
+// (onChunk on a 2xx response) gets each slice instead.
+// -----------------------------------------------------------------------------
+
+class HttpBodyReader {
+public:
+  // A Content-Length beyond this is allocated as data arrives
+  static constexpr uint64_t MAX_PREALLOCATION = 32 * 1024 * 1024;
+
+  HttpBodyReader(HttpResponse &response, const HttpChunkCallback &onChunk);
+  ~HttpBodyReader() { Finish(); }
+
+  // Disable copy
+  HttpBodyReader(const HttpBodyReader &) = delete;
+  HttpBodyReader &operator=(const HttpBodyReader &) = delete;
+
+  bool IsStreaming() const { return streaming_; }
+
+  // Size the body for `contentLength` bytes (buffered mode)
+  void Expect(uint64_t contentLength);
+
+  // Free space of at least `size` bytes at the end of the body for a
+  // direct receive (buffered mode); follow with Commit()
+  char *Prepare(size_t size);
+  void Commit(size_t size) { used_ += size; }
+
+  // Bytes already in memory: copied into the body, or passed to the
+  // callback. Returns false once the callback has cancelled.
+  bool Append(const char *data, size_t size);
+
+  bool IsCancelled() const { return cancelled_; }
+
+  // Trim the body to the bytes received (also done on destruction)
+  void Finish();
+
+private:
+  HttpResponse &response_;
+  const HttpChunkCallback &onChunk_;
+  bool streaming_ = false;
+  bool cancelled_ = false;
+  size_t used_ = 0; // Received bytes at the front of response_.body
+};
+
+// -----------------------------------------------------------------------------
+// Chunked Transfer Decoder
+// Incremental "Transfer-Encoding: chunked" decoder: feed raw bytes in any
+// pieces, receive the payload slices without copying.
+// -----------------------------------------------------------------------------
+
+class HttpChunkedDecoder {
+public:
+  // Return false to stop decoding
+  using OutputFn = std::function<bool(const char *data, size_t size)>;
+
+  // Decode as much of `data` as possible. Returns the number of bytes used:
+  // less than `size` once the final chunk and trailers are done (the rest
+  // belongs to the next message) or when `output` stops it.
+  size_t Feed(const char *data, size_t size, const OutputFn &output);
+
+  bool IsDone() const { return state_ == State::Done; }
+  bool HasError() const { return state_ == State::Error; }
+
+private:
+  enum class State { Size, Extension, SizeLF, Data, DataCR, DataLF,
+                     Trailer, TrailerLF, Done, Error };
+
+  State state_ = State::Size;
+  uint64_t remaining_ = 0;
+  int sizeDigits_ = 0;
+  bool trailerEmpty_ = true; // Current trailer line has no content yet
+};
+
+} // namespace invisible
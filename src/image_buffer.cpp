@@ -0,0 +1,156 @@
+#include "image_buffer.h"
+#include <algorithm>
+
+namespace invisible {
+
+namespace {
+
+constexpr size_t kMinSizeClass = 4096;
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Image View
+// -----------------------------------------------------------------------------
+
+ImageView ImageView::Crop(const ImageRect &rect) const {
+  int x0 = std::max(rect.x, 0);
+  int y0 = std::max(rect.y, 0);
+  int x1 = std::min(rect.x + rect.width, width);
+  int y1 = std::min(rect.y + rect.height, height);
+
+  ImageView view;
+  if (!IsValid() || x1 <= x0 || y1 <= y0)
+    return view;
+  view.pixels = Row(y0) + static_cast<ptrdiff_t>(x0) * 4;
+  view.width = x1 - x0;
+  view.height = y1 - y0;
+  view.stride = stride;
+  return view;
+}
+
+// -----------------------------------------------------------------------------
+// Frame Buffer Pool
+// -----------------------------------------------------------------------------
+
+FrameBufferPool::FrameBufferPool(const FrameBufferPoolConfig &config)
+    : config_(config) {}
+
+size_t FrameBufferPool::SizeClass(size_t bytes) {
+  if (bytes <= kMinSizeClass)
+    return kMinSizeClass;
+  size_t top = kMinSizeClass;
+  while (top <= bytes / 2)
+    top *= 2;
+  const size_t step = top / 8;
+  return (bytes + step - 1) / step * step;
+}
+
+std::vector<uint8_t> FrameBufferPool::Acquire(size_t bytes) {
+  const size_t sizeClass = SizeClass(bytes);
+  std::vector<uint8_t> buffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.acquires++;
+
+    // Smallest buffer already holding `bytes` (shrinking writes nothing);
+    // failing that, the smallest that can grow to it without reallocating.
+    // Buffers of more than twice the class are left for larger requests.
+    size_t best = buffers_.size();
+    bool bestSized = false;
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+      const std::vector<uint8_t> &candidate = buffers_[i];
+      if (candidate.capacity() < bytes ||
+          candidate.capacity() > 2 * sizeClass)
+        continue;
+      bool sized = candidate.size() >= bytes;
+      if (best == buffers_.size() || (sized && !bestSized) ||
+          (sized == bestSized &&
+           candidate.capacity() < buffers_[best].capacity())) {
+        best = i;
+        bestSized = sized;
+      }
+    }
+
+    if (best != buffers_.size()) {
+      buffer = std::move(buffers_[best]);
+      buffers_[best] = std::move(buffers_.back());
+      buffers_.pop_back();
+      pooledBytes_ -= buffer.capacity();
+      stats_.reuses++;
+    } else {
+      stats_.allocations++;
+    }
+  }
+
+  if (buffer.capacity() == 0)
+    buffer.reserve(sizeClass);
+  buffer.resize(bytes);
+  return buffer;
+}
+
+void FrameBufferPool::Release(std::vector<uint8_t> &&buffer) {
+  if (buffer.capacity() == 0)
+    return;
+
+  std::vector<uint8_t> dropped;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.releases++;
+  if (buffers_.size() >= config_.maxBuffers ||
+      pooledBytes_ + buffer.capacity() > config_.maxPooledBytes) {
+    stats_.dropped++;
+    dropped = std::move(buffer); // Freed after the lock is released
+    return;
+  }
+  pooledBytes_ += buffer.capacity();
+  buffers_.push_back(std::move(buffer));
+}
+
+void FrameBufferPool::Trim() {
+  std::vector<std::vector<uint8_t>> buffers;
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffers.swap(buffers_);
+  pooledBytes_ = 0;
+}
+
+FrameBufferPoolStats FrameBufferPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FrameBufferPoolStats stats = stats_;
+  stats.pooledBuffers = buffers_.size();
+  stats.pooledBytes = pooledBytes_;
+  return stats;
+}
+
+// -----------------------------------------------------------------------------
+// Image Buffer
+// -----------------------------------------------------------------------------
+
+ImageBuffer::ImageBuffer(FrameBufferPool *pool, size_t bytes) : pool_(pool) {
+  if (pool_)
+    bytes_ = pool_->Acquire(bytes);
+  else
+    bytes_.resize(bytes);
+}
+
+ImageBuffer::ImageBuffer(ImageBuffer &&other) noexcept
+    : pool_(other.pool_), bytes_(std::move(other.bytes_)) {
+  other.bytes_.clear();
+}
+
+ImageBuffer &ImageBuffer::operator=(ImageBuffer &&other) noexcept {
+  if (this != &other) {
+    Reset();
+    pool_ = other.pool_;
+    bytes_ = std::move(other.bytes_);
+    other.bytes_.clear();
+  }
+  return *this;
+}
+
+void ImageBuffer::Reset() {
+  if (pool_)
+    pool_->Release(std::move(bytes_));
+  bytes_ = std::vector<uint8_t>();
+}
+
+} // namespace invisible
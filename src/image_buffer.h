@@ -0,0 +1,130 @@
+#pragma once
+
+#include "image_preprocessor.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Image View
+// Non-owning window onto top-down BGRA rows. Cropping a view only moves the
+// pointer, so a sub-rectangle of a capture can be hashed, scaled or encoded
+// without copying it out first. The pixels must outlive the view.
+// -----------------------------------------------------------------------------
+
+struct ImageView {
+  const uint8_t *pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  int stride = 0; // Bytes from one row to the next (at least width * 4)
+
+  bool IsValid() const { return pixels && width > 0 && height > 0; }
+
+  const uint8_t *Row(int y) const {
+    return pixels + static_cast<ptrdiff_t>(y) * stride;
+  }
+
+  // The part of the view inside `rect` (view coordinates, clipped to it;
+  // invalid if they do not meet)
+  ImageView Crop(const ImageRect &rect) const;
+};
+
+// -----------------------------------------------------------------------------
+// Frame Buffer Pool
+// Pixel buffers handed back after a capture is done with are given to the
+// next capture instead of being freed and allocated again: a 4K BGRA frame
+// is 33 MB, and a fresh allocation of that size means page faults on every
+// first touch. New buffers are reserved at the top of their size class (an
+// eighth of a power of two), so a slightly larger region next time still
+// fits, and a buffer is only handed out for requests of its own or the
+// class below; a thumbnail never takes the buffer a full screen needs.
+// Buffers keep their size while pooled, so one that is large enough comes
+// back without its bytes being cleared. Thread-safe.
+// -----------------------------------------------------------------------------
+
+struct FrameBufferPoolConfig {
+  size_t maxBuffers = 4;                    // Idle buffers kept
+  size_t maxPooledBytes = 64 * 1024 * 1024; // Idle bytes kept
+};
+
+struct FrameBufferPoolStats {
+  uint64_t acquires = 0;
+  uint64_t reuses = 0;      // Served from the pool
+  uint64_t allocations = 0; // Needed a new buffer
+  uint64_t releases = 0;
+  uint64_t dropped = 0;     // Released while the pool was full
+  size_t pooledBuffers = 0;
+  size_t pooledBytes = 0;
+};
+
+class FrameBufferPool {
+public:
+  explicit FrameBufferPool(
+      const FrameBufferPoolConfig &config = FrameBufferPoolConfig());
+
+  // Disable copy
+  FrameBufferPool(const FrameBufferPool &) = delete;
+  FrameBufferPool &operator=(const FrameBufferPool &) = delete;
+
+  // A buffer of `bytes` bytes (contents undefined)
+  std::vector<uint8_t> Acquire(size_t bytes);
+
+  // Give a buffer back for reuse (freed if the pool is full)
+  void Release(std::vector<uint8_t> &&buffer);
+
+  // Free every idle buffer
+  void Trim();
+
+  FrameBufferPoolStats GetStats() const;
+
+  // Capacity reserved for a request of `bytes` (at most 1/8 more)
+  static size_t SizeClass(size_t bytes);
+
+private:
+  FrameBufferPoolConfig config_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::vector<uint8_t>> buffers_;
+  size_t pooledBytes_ = 0; // Capacity of buffers_
+  FrameBufferPoolStats stats_;
+};
+
+// -----------------------------------------------------------------------------
+// Image Buffer
+// Move-only owner of a pixel buffer that goes back to its pool when it is
+// destroyed or replaced. Without a pool it is a plain allocation.
+// -----------------------------------------------------------------------------
+
+class ImageBuffer {
+public:
+  ImageBuffer() = default;
+  ImageBuffer(FrameBufferPool *pool, size_t bytes);
+  ~ImageBuffer() { Reset(); }
+
+  ImageBuffer(ImageBuffer &&other) noexcept;
+  ImageBuffer &operator=(ImageBuffer &&other) noexcept;
+
+  // Disable copy
+  ImageBuffer(const ImageBuffer &) = delete;
+  ImageBuffer &operator=(const ImageBuffer &) = delete;
+
+  uint8_t *data() { return bytes_.data(); }
+  const uint8_t *data() const { return bytes_.data(); }
+  size_t size() const { return bytes_.size(); }
+  bool empty() const { return bytes_.empty(); }
+
+  // The bytes themselves, for code that fills a vector (resizing is fine)
+  std::vector<uint8_t> &bytes() { return bytes_; }
+
+  // Hand the buffer back to its pool now
+  void Reset();
+
+private:
+  FrameBufferPool *pool_ = nullptr;
+  std::vector<uint8_t> bytes_;
+};
+
+} // namespace invisible
@@ -0,0 +1,353 @@
+#include "image_preprocessor.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+// Weights along each axis sum to this. Products stay inside 32 bits: a row
+// pass sum is at most 255 << 14, kept as 16 bits (>> 6), and the column
+// pass multiplies that by up to 1 << 14 again.
+constexpr int kWeightBits = 14;
+constexpr int32_t kWeightOne = 1 << kWeightBits;
+constexpr int kRowShift = 6;
+constexpr int kColumnShift = 2 * kWeightBits - kRowShift;
+
+inline uint32_t LoadPixel(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+inline bool PixelMatches(uint32_t a, uint32_t b, int tolerance) {
+  for (int shift = 0; shift < 24; shift += 8) { // B, G, R (not alpha)
+    int diff = static_cast<int>((a >> shift) & 0xFF) -
+               static_cast<int>((b >> shift) & 0xFF);
+    if (diff > tolerance || diff < -tolerance)
+      return false;
+  }
+  return true;
+}
+
+#if INVISIBLE_HAVE_SSE2
+// True if all four pixels at `p` match `refs`
+inline bool BlockMatches(const uint8_t *p, __m128i refs, __m128i tol) {
+  const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i diff = _mm_or_si128(_mm_subs_epu8(v, refs), _mm_subs_epu8(refs, v));
+  __m128i over = _mm_and_si128(_mm_subs_epu8(diff, tol), colorMask);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(over, _mm_setzero_si128())) ==
+         0xFFFF;
+}
+#endif
+
+// Index of the first pixel in [0, end) that differs from `ref`, or `end`
+int FirstMismatch(const uint8_t *row, int end, uint32_t ref, int tolerance) {
+  int x = 0;
+#if INVISIBLE_HAVE_SSE2
+  const __m128i refs = _mm_set1_epi32(static_cast<int>(ref));
+  const __m128i tol = _mm_set1_epi8(static_cast<char>(tolerance));
+  while (x + 4 <= end && BlockMatches(row + x * 4, refs, tol))
+    x += 4;
+#endif
+  while (x < end && PixelMatches(LoadPixel(row + x * 4), ref, tolerance))
+    ++x;
+  return x;
+}
+
+// One past the last pixel in [begin, width) that differs from `ref`, or
+// `begin`
+int LastMismatch(const uint8_t *row, int begin, int width, uint32_t ref,
+                 int tolerance) {
+  int x = width;
+#if INVISIBLE_HAVE_SSE2
+  const __m128i refs = _mm_set1_epi32(static_cast<int>(ref));
+  const __m128i tol = _mm_set1_epi8(static_cast<char>(tolerance));
+  while (x - 4 >= begin && BlockMatches(row + (x - 4) * 4, refs, tol))
+    x -= 4;
+#endif
+  while (x > begin &&
+         PixelMatches(LoadPixel(row + (x - 1) * 4), ref, tolerance))
+    --x;
+  return x;
+}
+
+// sums[i] += a[i] * wa + b[i] * wb over `bytes` channel bytes
+void AccumulateRows(const uint8_t *a, const uint8_t *b, int32_t wa, int32_t wb,
+                    uint32_t *sums, size_t bytes) {
+  size_t i = 0;
+#if INVISIBLE_HAVE_SSE2
+  // Interleave the rows as 16-bit pairs so one madd applies both weights
+  const __m128i weights = _mm_set1_epi32((wb << 16) | wa);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    __m128i aLo = _mm_unpacklo_epi8(pa, zero);
+    __m128i aHi = _mm_unpackhi_epi8(pa, zero);
+    __m128i bLo = _mm_unpacklo_epi8(pb, zero);
+    __m128i bHi = _mm_unpackhi_epi8(pb, zero);
+
+    __m128i *out = reinterpret_cast<__m128i *>(sums + i);
+    __m128i s0 = _mm_loadu_si128(out + 0);
+    __m128i s1 = _mm_loadu_si128(out + 1);
+    __m128i s2 = _mm_loadu_si128(out + 2);
+    __m128i s3 = _mm_loadu_si128(out + 3);
+    s0 = _mm_add_epi32(
+        s0, _mm_madd_epi16(_mm_unpacklo_epi16(aLo, bLo), weights));
+    s1 = _mm_add_epi32(
+        s1, _mm_madd_epi16(_mm_unpackhi_epi16(aLo, bLo), weights));
+    s2 = _mm_add_epi32(
+        s2, _mm_madd_epi16(_mm_unpacklo_epi16(aHi, bHi), weights));
+    s3 = _mm_add_epi32(
+        s3, _mm_madd_epi16(_mm_unpackhi_epi16(aHi, bHi), weights));
+    _mm_storeu_si128(out + 0, s0);
+    _mm_storeu_si128(out + 1, s1);
+    _mm_storeu_si128(out + 2, s2);
+    _mm_storeu_si128(out + 3, s3);
+  }
+#endif
+  for (; i < bytes; ++i) {
+    sums[i] += static_cast<uint32_t>(a[i] * wa + b[i] * wb);
+  }
+}
+
+} // namespace
+
+ImagePreprocessor::ImagePreprocessor(const ImagePreprocessorConfig &config)
+    : config_(config) {}
+
+bool ImagePreprocessor::HasSimd() { return INVISIBLE_HAVE_SSE2 != 0; }
+
+// -----------------------------------------------------------------------------
+// Process
+// -----------------------------------------------------------------------------
+
+bool ImagePreprocessor::Process(const uint8_t *pixels, int width, int height,
+                                int stride, std::vector<uint8_t> &out,
+                                int &outWidth, int &outHeight) {
+  if (!pixels || width <= 0 || height <= 0)
+    return false;
+
+  ImageRect content = {0, 0, width, height};
+  if (config_.trimBorders) {
+    content = FindContentBounds(pixels, width, height, stride,
+                                config_.borderTolerance);
+    int margin = std::max(config_.trimMargin, 0);
+    int right = std::min(content.x + content.width + margin, width);
+    int bottom = std::min(content.y + content.height + margin, height);
+    content.x = std::max(content.x - margin, 0);
+    content.y = std::max(content.y - margin, 0);
+    content.width = right - content.x;
+    content.height = bottom - content.y;
+  }
+
+  int targetWidth, targetHeight;
+  FitSize(content.width, content.height, config_.maxEdge, config_.maxPixels,
+          targetWidth, targetHeight);
+  if (content.width == width && content.height == height &&
+      targetWidth == width && targetHeight == height)
+    return false;
+
+  const uint8_t *src =
+      pixels + static_cast<size_t>(content.y) * stride + content.x * 4;
+  const size_t outStride = static_cast<size_t>(targetWidth) * 4;
+  out.resize(outStride * targetHeight);
+
+  if (targetWidth == content.width && targetHeight == content.height) {
+    // Cropped only
+    for (int y = 0; y < targetHeight; ++y)
+      memcpy(out.data() + y * outStride, src + static_cast<size_t>(y) * stride,
+             outStride);
+  } else {
+    Downscale(src, content.width, content.height, stride, out.data(),
+              targetWidth, targetHeight, static_cast<int>(outStride));
+  }
+
+  outWidth = targetWidth;
+  outHeight = targetHeight;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Border Trimming
+// -----------------------------------------------------------------------------
+
+ImageRect ImagePreprocessor::FindContentBounds(const uint8_t *pixels,
+                                               int width, int height,
+                                               int stride, int tolerance) {
+  ImageRect full = {0, 0, width, height};
+  if (!pixels || width <= 0 || height <= 0)
+    return full;
+  tolerance = std::min(std::max(tolerance, 0), 255);
+
+  // Top and left borders take the top-left color, bottom and right the
+  // bottom-right one (a title bar and a status bar may differ)
+  const uint8_t *last = pixels + static_cast<size_t>(height - 1) * stride;
+  const uint32_t topLeft = LoadPixel(pixels);
+  const uint32_t bottomRight = LoadPixel(last + (width - 1) * 4);
+
+  auto row = [&](int y) { return pixels + static_cast<size_t>(y) * stride; };
+
+  int top = 0;
+  while (top < height &&
+         FirstMismatch(row(top), width, topLeft, tolerance) == width)
+    ++top;
+  if (top == height)
+    return full; // Nothing but background
+
+  int bottom = height;
+  while (bottom > top &&
+         LastMismatch(row(bottom - 1), 0, width, bottomRight, tolerance) == 0)
+    --bottom;
+
+  // Side borders row by row (not column by column, which strides through
+  // memory); each row only scans what is still counted as border
+  int left = width;
+  int right = 0;
+  for (int y = top; y < bottom; ++y) {
+    left = FirstMismatch(row(y), left, topLeft, tolerance);
+    right = LastMismatch(row(y), right, width, bottomRight, tolerance);
+  }
+
+  if (right <= left || bottom <= top)
+    return full;
+  return {left, top, right - left, bottom - top};
+}
+
+// -----------------------------------------------------------------------------
+// Downscaling
+// -----------------------------------------------------------------------------
+
+void ImagePreprocessor::FitSize(int width, int height, int maxEdge,
+                                int maxPixels, int &outWidth,
+                                int &outHeight) {
+  double scale = 1.0;
+  if (maxEdge > 0 && std::max(width, height) > maxEdge)
+    scale = static_cast<double>(maxEdge) / std::max(width, height);
+  double area = static_cast<double>(width) * height * scale * scale;
+  if (maxPixels > 0 && area > maxPixels)
+    scale = std::sqrt(static_cast<double>(maxPixels) /
+                      (static_cast<double>(width) * height));
+
+  // Rounded down, so both limits still hold
+  outWidth = std::min(
+      width, std::max(1, static_cast<int>(std::floor(width * scale + 1e-9))));
+  outHeight = std::min(
+      height,
+      std::max(1, static_cast<int>(std::floor(height * scale + 1e-9))));
+}
+
+void ImagePreprocessor::BuildAxisWeights(int srcSize, int dstSize,
+                                         AxisWeights &axis) {
+  axis.first.resize(dstSize);
+  axis.count.resize(dstSize);
+  axis.offset.resize(dstSize);
+  axis.weights.clear();
+
+  // Output i covers source [i * srcSize, (i + 1) * srcSize) in units of
+  // 1 / dstSize source pixels; each source pixel is weighted by its overlap,
+  // rounded so every output's weights sum to exactly kWeightOne
+  for (int i = 0; i < dstSize; ++i) {
+    const int64_t start = static_cast<int64_t>(i) * srcSize;
+    const int64_t end = start + srcSize;
+    const int first = static_cast<int>(start / dstSize);
+    const int last = static_cast<int>((end + dstSize - 1) / dstSize);
+
+    axis.first[i] = first;
+    axis.count[i] = last - first;
+    axis.offset[i] = static_cast<int>(axis.weights.size());
+
+    int64_t covered = 0;
+    int32_t assigned = 0;
+    for (int j = first; j < last; ++j) {
+      int64_t from =
+          std::max<int64_t>(start, static_cast<int64_t>(j) * dstSize);
+      int64_t to =
+          std::min<int64_t>(end, static_cast<int64_t>(j + 1) * dstSize);
+      covered += to - from;
+      int32_t total = static_cast<int32_t>(
+          (covered * kWeightOne + srcSize / 2) / srcSize);
+      axis.weights.push_back(total - assigned);
+      assigned = total;
+    }
+  }
+}
+
+void ImagePreprocessor::Downscale(const uint8_t *src, int srcWidth,
+                                  int srcHeight, int srcStride, uint8_t *dst,
+                                  int dstWidth, int dstHeight,
+                                  int dstStride) {
+  BuildAxisWeights(srcWidth, dstWidth, columns_);
+  BuildAxisWeights(srcHeight, dstHeight, rows_);
+
+  const size_t rowBytes = static_cast<size_t>(srcWidth) * 4;
+  rowSums_.resize(rowBytes);
+
+  for (int y = 0; y < dstHeight; ++y) {
+    // Row pass: weighted sum of the source rows this output row covers,
+    // two rows per step
+    std::fill(rowSums_.begin(), rowSums_.end(), 0u);
+    const int first = rows_.first[y];
+    const int count = rows_.count[y];
+    const int32_t *weights = rows_.weights.data() + rows_.offset[y];
+    int k = 0;
+    for (; k + 2 <= count; k += 2) {
+      AccumulateRows(src + static_cast<size_t>(first + k) * srcStride,
+                     src + static_cast<size_t>(first + k + 1) * srcStride,
+                     weights[k], weights[k + 1], rowSums_.data(), rowBytes);
+    }
+    if (k < count) {
+      const uint8_t *row = src + static_cast<size_t>(first + k) * srcStride;
+      AccumulateRows(row, row, weights[k], 0, rowSums_.data(), rowBytes);
+    }
+
+    size_t i = 0;
+#if INVISIBLE_HAVE_SSE2
+    const __m128i rowRound = _mm_set1_epi32(1 << (kRowShift - 1));
+    for (; i + 4 <= rowBytes; i += 4) {
+      __m128i *p = reinterpret_cast<__m128i *>(rowSums_.data() + i);
+      __m128i v = _mm_loadu_si128(p);
+      _mm_storeu_si128(p,
+                       _mm_srli_epi32(_mm_add_epi32(v, rowRound), kRowShift));
+    }
+#endif
+    for (; i < rowBytes; ++i)
+      rowSums_[i] = (rowSums_[i] + (1u << (kRowShift - 1))) >> kRowShift;
+
+    // Column pass: the same over each output pixel's source columns
+    uint8_t *out = dst + static_cast<size_t>(y) * dstStride;
+    for (int x = 0; x < dstWidth; ++x) {
+      const uint32_t *sums = rowSums_.data() + columns_.first[x] * 4;
+      const int32_t *cw = columns_.weights.data() + columns_.offset[x];
+      const int n = columns_.count[x];
+#if INVISIBLE_HAVE_SSE2
+      __m128i total = _mm_set1_epi32(1 << (kColumnShift - 1));
+      for (int j = 0; j < n; ++j) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(sums + j * 4));
+        total = _mm_add_epi32(total, simd::MulLo32(v, _mm_set1_epi32(cw[j])));
+      }
+      total = _mm_srli_epi32(total, kColumnShift);
+      total = _mm_packs_epi32(total, total);
+      total = _mm_packus_epi16(total, total);
+      int32_t pixel = _mm_cvtsi128_si32(total);
+      memcpy(out + x * 4, &pixel, 4);
+#else
+      uint32_t total[4] = {};
+      for (int j = 0; j < n; ++j) {
+        for (int c = 0; c < 4; ++c)
+          total[c] += sums[j * 4 + c] * static_cast<uint32_t>(cw[j]);
+      }
+      for (int c = 0; c < 4; ++c)
+        out[x * 4 + c] = static_cast<uint8_t>(
+            (total[c] + (1u << (kColumnShift - 1))) >> kColumnShift);
+#endif
+    }
+  }
+}
+
+} // namespace invisible
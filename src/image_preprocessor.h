@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Image Preprocessor Configuration
+// -----------------------------------------------------------------------------
+
+struct ImagePreprocessorConfig {
+  // Vision models downsample large images themselves and bill by area, so
+  // anything beyond these limits only costs upload bytes and encode time
+  int maxEdge = 1568;       // Longest side after scaling (0 = no limit)
+  int maxPixels = 1150000;  // Width * height after scaling (0 = no limit)
+
+  // Crop away solid borders (editor gutters, letterboxing, desktop)
+  bool trimBorders = true;
+  int borderTolerance = 12; // Per-channel difference still counted as border
+  int trimMargin = 4;       // Border pixels kept around the content
+};
+
+struct ImageRect {
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Image Preprocessor
+// Prepares a BGRA capture for a vision upload: trims uniform borders, then
+// shrinks the rest to the size limits by area averaging (every source pixel
+// contributes in proportion to the area it covers, so text strokes thinner
+// than the scale factor fade instead of vanishing or aliasing). Fixed-point
+// arithmetic throughout, so the SSE2 and scalar paths give identical bytes.
+// Keeps scratch buffers between calls: one instance per thread.
+// -----------------------------------------------------------------------------
+
+class ImagePreprocessor {
+public:
+  explicit ImagePreprocessor(
+      const ImagePreprocessorConfig &config = ImagePreprocessorConfig());
+
+  // Trim and downscale top-down BGRA rows spaced `stride` bytes apart into
+  // `out` (packed, stride = outWidth * 4). Returns false, leaving `out`
+  // alone, when the image is already within limits and has no border.
+  bool Process(const uint8_t *pixels, int width, int height, int stride,
+               std::vector<uint8_t> &out, int &outWidth, int &outHeight);
+
+  // Region left after removing rows and columns that match the corner
+  // colors within `tolerance` (the whole image if it is uniform)
+  static ImageRect FindContentBounds(const uint8_t *pixels, int width,
+                                     int height, int stride, int tolerance);
+
+  // Largest size with the same aspect ratio within both limits (never
+  // larger than the input)
+  static void FitSize(int width, int height, int maxEdge, int maxPixels,
+                      int &outWidth, int &outHeight);
+
+  // Area-averaging shrink of `src` into `dst` (dstWidth <= srcWidth,
+  // dstHeight <= srcHeight)
+  void Downscale(const uint8_t *src, int srcWidth, int srcHeight,
+                 int srcStride, uint8_t *dst, int dstWidth, int dstHeight,
+                 int dstStride);
+
+  const ImagePreprocessorConfig &GetConfig() const { return config_; }
+
+  // True when the SSE2 kernels are compiled in
+  static bool HasSimd();
+
+private:
+  // Source span and weights (summing to kWeightOne) of each output
+  // coordinate along one axis
+  struct AxisWeights {
+    std::vector<int> first;     // First source index per output index
+    std::vector<int> count;     // Source indices per output index
+    std::vector<int> offset;    // Into weights
+    std::vector<int32_t> weights;
+  };
+
+  static void BuildAxisWeights(int srcSize, int dstSize, AxisWeights &axis);
+
+  ImagePreprocessorConfig config_;
+
+  // Scratch, reused between calls
+  AxisWeights columns_;
+  AxisWeights rows_;
+  std::vector<uint32_t> rowSums_; // One output row before the column pass
+};
+
+} // namespace invisible
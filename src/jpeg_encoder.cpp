@@ -0,0 +1,631 @@
+#include "jpeg_encoder.h"
+#include "simd.h"
+#include <algorithm>
+
+namespace invisible {
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Standard Tables (ITU-T T.81 Annex K)
+// -----------------------------------------------------------------------------
+
+// Zigzag position -> natural (row-major) index
+const uint8_t kZigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+const uint8_t kLumaQuantBase[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+
+const uint8_t kChromaQuantBase[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+const uint8_t kDcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t kDcLumaValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const uint8_t kDcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1,
+                                   1, 1, 1, 0, 0, 0, 0, 0};
+const uint8_t kDcChromaValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const uint8_t kAcLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3,
+                                 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t kAcLumaValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+    0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+const uint8_t kAcChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4,
+                                   7, 5, 4, 4, 0, 1, 2, 0x77};
+const uint8_t kAcChromaValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+    0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+    0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+// -----------------------------------------------------------------------------
+// Entropy Output
+// -----------------------------------------------------------------------------
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+  void Put(uint32_t bits, int count) {
+    buffer_ = (buffer_ << count) | (bits & ((1u << count) - 1));
+    count_ += count;
+    while (count_ >= 8) {
+      count_ -= 8;
+      uint8_t byte = static_cast<uint8_t>(buffer_ >> count_);
+      out_.push_back(byte);
+      if (byte == 0xFF) {
+        out_.push_back(0x00); // Byte stuffing
+      }
+    }
+  }
+
+  // Pad the final byte with 1-bits
+  void Flush() {
+    if (count_ > 0) {
+      Put(0x7F, 8 - count_);
+    }
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint64_t buffer_ = 0;
+  int count_ = 0;
+};
+
+void PutMarker(std::vector<uint8_t> &out, uint8_t marker, uint16_t length) {
+  out.push_back(0xFF);
+  out.push_back(marker);
+  if (length > 0) {
+    out.push_back(static_cast<uint8_t>(length >> 8));
+    out.push_back(static_cast<uint8_t>(length & 0xFF));
+  }
+}
+
+void PutU16(std::vector<uint8_t> &out, int value) {
+  out.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+  out.push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+// -----------------------------------------------------------------------------
+// Color Conversion: BGRA -> level-shifted Y/Cb/Cr (14-bit fixed point)
+// -----------------------------------------------------------------------------
+
+constexpr int kColorBits = 14;
+constexpr int kColorRound = 1 << (kColorBits - 1);
+
+// Coefficients sum to 16384 (Y) or 0 (Cb/Cr), so results stay in 8 bits
+constexpr int kYR = 4899, kYG = 9617, kYB = 1868;
+constexpr int kCbR = -2765, kCbG = -5427, kCbB = 8192;
+constexpr int kCrR = 8192, kCrG = -6860, kCrB = -1332;
+
+inline void ConvertPixel(const uint8_t *p, int16_t &y, int16_t &cb,
+                         int16_t &cr) {
+  int b = p[0], g = p[1], r = p[2];
+  y = static_cast<int16_t>(
+      ((kYB * b + kYG * g + kYR * r + kColorRound) >> kColorBits) - 128);
+  cb = static_cast<int16_t>((kCbB * b + kCbG * g + kCbR * r + kColorRound) >>
+                            kColorBits);
+  cr = static_cast<int16_t>((kCrB * b + kCrG * g + kCrR * r + kColorRound) >>
+                            kColorBits);
+}
+
+#if INVISIBLE_HAVE_SSE2
+
+// Weighted sum of B/G/R for four pixels held as two 16-bit BGRA pairs
+inline __m128i WeightedSum4(__m128i lo, __m128i hi, __m128i coef) {
+  __m128 a = _mm_castsi128_ps(_mm_madd_epi16(lo, coef));
+  __m128 b = _mm_castsi128_ps(_mm_madd_epi16(hi, coef));
+  __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+  __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  __m128i sum = _mm_add_epi32(_mm_add_epi32(even, odd),
+                              _mm_set1_epi32(kColorRound));
+  return _mm_srai_epi32(sum, kColorBits);
+}
+
+void ConvertRow(const uint8_t *src, int width, int16_t *y, int16_t *cb,
+                int16_t *cr) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i coefY = _mm_setr_epi16(kYB, kYG, kYR, 0, kYB, kYG, kYR, 0);
+  const __m128i coefCb =
+      _mm_setr_epi16(kCbB, kCbG, kCbR, 0, kCbB, kCbG, kCbR, 0);
+  const __m128i coefCr =
+      _mm_setr_epi16(kCrB, kCrG, kCrR, 0, kCrB, kCrG, kCrR, 0);
+  const __m128i levelShift = _mm_set1_epi16(128);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+    __m128i p1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 16));
+    __m128i p0lo = _mm_unpacklo_epi8(p0, zero);
+    __m128i p0hi = _mm_unpackhi_epi8(p0, zero);
+    __m128i p1lo = _mm_unpacklo_epi8(p1, zero);
+    __m128i p1hi = _mm_unpackhi_epi8(p1, zero);
+
+    __m128i yv = _mm_packs_epi32(WeightedSum4(p0lo, p0hi, coefY),
+                                 WeightedSum4(p1lo, p1hi, coefY));
+    __m128i cbv = _mm_packs_epi32(WeightedSum4(p0lo, p0hi, coefCb),
+                                  WeightedSum4(p1lo, p1hi, coefCb));
+    __m128i crv = _mm_packs_epi32(WeightedSum4(p0lo, p0hi, coefCr),
+                                  WeightedSum4(p1lo, p1hi, coefCr));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(y + x),
+                     _mm_sub_epi16(yv, levelShift));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(cb + x), cbv);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(cr + x), crv);
+  }
+
+  for (; x < width; ++x) {
+    ConvertPixel(src + x * 4, y[x], cb[x], cr[x]);
+  }
+}
+
+#else
+
+void ConvertRow(const uint8_t *src, int width, int16_t *y, int16_t *cb,
+                int16_t *cr) {
+  for (int x = 0; x < width; ++x) {
+    ConvertPixel(src + x * 4, y[x], cb[x], cr[x]);
+  }
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Forward DCT (islow integer algorithm, CONST_BITS = 13, PASS1_BITS = 2)
+// The 1-D kernel is a template so the scalar and SSE2 paths share every
+// arithmetic step and therefore produce identical coefficients.
+// -----------------------------------------------------------------------------
+
+constexpr int kConstBits = 13;
+constexpr int kPass1Bits = 2;
+
+constexpr int32_t FIX_0_298631336 = 2446;
+constexpr int32_t FIX_0_390180644 = 3196;
+constexpr int32_t FIX_0_541196100 = 4433;
+constexpr int32_t FIX_0_765366865 = 6270;
+constexpr int32_t FIX_0_899976223 = 7373;
+constexpr int32_t FIX_1_175875602 = 9633;
+constexpr int32_t FIX_1_501321110 = 12299;
+constexpr int32_t FIX_1_847759065 = 15137;
+constexpr int32_t FIX_1_961570560 = 16069;
+constexpr int32_t FIX_2_053119869 = 16819;
+constexpr int32_t FIX_2_562915447 = 20995;
+constexpr int32_t FIX_3_072711026 = 25172;
+
+inline int32_t Descale(int32_t x, int n) { return (x + (1 << (n - 1))) >> n; }
+inline int32_t ShiftLeft(int32_t x, int n) { return x * (1 << n); }
+
+#if INVISIBLE_HAVE_SSE2
+
+struct I32x4 {
+  __m128i v;
+};
+
+inline I32x4 operator+(I32x4 a, I32x4 b) { return {_mm_add_epi32(a.v, b.v)}; }
+inline I32x4 operator-(I32x4 a, I32x4 b) { return {_mm_sub_epi32(a.v, b.v)}; }
+inline I32x4 operator*(I32x4 a, int32_t c) {
+  return {simd::MulLo32(a.v, _mm_set1_epi32(c))};
+}
+inline I32x4 Descale(I32x4 x, int n) {
+  __m128i rounded = _mm_add_epi32(x.v, _mm_set1_epi32(1 << (n - 1)));
+  return {_mm_sra_epi32(rounded, _mm_cvtsi32_si128(n))};
+}
+inline I32x4 ShiftLeft(I32x4 x, int n) {
+  return {_mm_sll_epi32(x.v, _mm_cvtsi32_si128(n))};
+}
+
+#endif
+
+template <typename V, bool FirstPass> inline void ForwardDct8(V *d) {
+  constexpr int shift =
+      FirstPass ? kConstBits - kPass1Bits : kConstBits + kPass1Bits;
+
+  V tmp0 = d[0] + d[7];
+  V tmp7 = d[0] - d[7];
+  V tmp1 = d[1] + d[6];
+  V tmp6 = d[1] - d[6];
+  V tmp2 = d[2] + d[5];
+  V tmp5 = d[2] - d[5];
+  V tmp3 = d[3] + d[4];
+  V tmp4 = d[3] - d[4];
+
+  // Even part
+  V tmp10 = tmp0 + tmp3;
+  V tmp13 = tmp0 - tmp3;
+  V tmp11 = tmp1 + tmp2;
+  V tmp12 = tmp1 - tmp2;
+
+  if (FirstPass) {
+    d[0] = ShiftLeft(tmp10 + tmp11, kPass1Bits);
+    d[4] = ShiftLeft(tmp10 - tmp11, kPass1Bits);
+  } else {
+    d[0] = Descale(tmp10 + tmp11, kPass1Bits);
+    d[4] = Descale(tmp10 - tmp11, kPass1Bits);
+  }
+
+  V z1 = (tmp12 + tmp13) * FIX_0_541196100;
+  d[2] = Descale(z1 + tmp13 * FIX_0_765366865, shift);
+  d[6] = Descale(z1 - tmp12 * FIX_1_847759065, shift);
+
+  // Odd part
+  z1 = tmp4 + tmp7;
+  V z2 = tmp5 + tmp6;
+  V z3 = tmp4 + tmp6;
+  V z4 = tmp5 + tmp7;
+  V z5 = (z3 + z4) * FIX_1_175875602;
+
+  tmp4 = tmp4 * FIX_0_298631336;
+  tmp5 = tmp5 * FIX_2_053119869;
+  tmp6 = tmp6 * FIX_3_072711026;
+  tmp7 = tmp7 * FIX_1_501321110;
+  z1 = z1 * -FIX_0_899976223;
+  z2 = z2 * -FIX_2_562915447;
+  z3 = z3 * -FIX_1_961570560 + z5;
+  z4 = z4 * -FIX_0_390180644 + z5;
+
+  d[7] = Descale(tmp4 + z1 + z3, shift);
+  d[5] = Descale(tmp5 + z2 + z4, shift);
+  d[3] = Descale(tmp6 + z2 + z3, shift);
+  d[1] = Descale(tmp7 + z1 + z4, shift);
+}
+
+// Columns first, then rows. Output is scaled up by 8.
+#if INVISIBLE_HAVE_SSE2
+
+void ForwardDct(int32_t *block) {
+  I32x4 left[8], right[8];
+  for (int r = 0; r < 8; ++r) {
+    left[r].v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + r * 8));
+    right[r].v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + r * 8 + 4));
+  }
+
+  ForwardDct8<I32x4, true>(left);
+  ForwardDct8<I32x4, true>(right);
+
+  // Transpose the 8x8 as four 4x4 quadrants, swapping the off-diagonal pair
+  auto transpose = [&]() {
+    simd::Transpose4x4(left[0].v, left[1].v, left[2].v, left[3].v);
+    simd::Transpose4x4(right[0].v, right[1].v, right[2].v, right[3].v);
+    simd::Transpose4x4(left[4].v, left[5].v, left[6].v, left[7].v);
+    simd::Transpose4x4(right[4].v, right[5].v, right[6].v, right[7].v);
+    for (int i = 0; i < 4; ++i) {
+      std::swap(right[i], left[i + 4]);
+    }
+  };
+
+  transpose();
+  ForwardDct8<I32x4, false>(left);
+  ForwardDct8<I32x4, false>(right);
+  transpose();
+
+  for (int r = 0; r < 8; ++r) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(block + r * 8), left[r].v);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(block + r * 8 + 4),
+                     right[r].v);
+  }
+}
+
+#else
+
+void ForwardDct(int32_t *block) {
+  for (int c = 0; c < 8; ++c) {
+    int32_t column[8];
+    for (int r = 0; r < 8; ++r) {
+      column[r] = block[r * 8 + c];
+    }
+    ForwardDct8<int32_t, true>(column);
+    for (int r = 0; r < 8; ++r) {
+      block[r * 8 + c] = column[r];
+    }
+  }
+  for (int r = 0; r < 8; ++r) {
+    ForwardDct8<int32_t, false>(block + r * 8);
+  }
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Quantization + Huffman Coding
+// -----------------------------------------------------------------------------
+
+// Quantize DCT output (scaled by 8) into zigzag order with round-to-nearest
+void Quantize(const int32_t *block, const uint8_t *quant, int16_t *out) {
+  for (int i = 0; i < 64; ++i) {
+    int n = kZigzag[i];
+    int32_t divisor = static_cast<int32_t>(quant[n]) << 3;
+    int32_t x = block[n];
+    int32_t q = (x < 0) ? -((-x + (divisor >> 1)) / divisor)
+                        : (x + (divisor >> 1)) / divisor;
+    out[i] = static_cast<int16_t>(q);
+  }
+}
+
+inline int BitLength(int value) {
+  unsigned int magnitude = static_cast<unsigned int>(value < 0 ? -value : value);
+  int bits = 0;
+  while (magnitude) {
+    ++bits;
+    magnitude >>= 1;
+  }
+  return bits;
+}
+
+inline uint32_t MagnitudeBits(int value, int bits) {
+  if (value < 0) {
+    value -= 1; // One's complement for negatives
+  }
+  return static_cast<uint32_t>(value) & ((1u << bits) - 1);
+}
+
+// -----------------------------------------------------------------------------
+// Block Loading
+// -----------------------------------------------------------------------------
+
+void LoadBlock(const int16_t *plane, int planeStride, int x, int y,
+               int32_t *block) {
+  for (int r = 0; r < 8; ++r) {
+    const int16_t *row = plane + (y + r) * planeStride + x;
+    for (int c = 0; c < 8; ++c) {
+      block[r * 8 + c] = row[c];
+    }
+  }
+}
+
+// 2x2 box filter of a 16x16 region into one 8x8 block
+void LoadBlockDownsampled(const int16_t *plane, int planeStride, int x,
+                          int32_t *block) {
+  for (int r = 0; r < 8; ++r) {
+    const int16_t *row0 = plane + (r * 2) * planeStride + x;
+    const int16_t *row1 = row0 + planeStride;
+    for (int c = 0; c < 8; ++c) {
+      int sum = row0[c * 2] + row0[c * 2 + 1] + row1[c * 2] + row1[c * 2 + 1];
+      block[r * 8 + c] = (sum + 2) >> 2;
+    }
+  }
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Constructor
+// -----------------------------------------------------------------------------
+
+JpegEncoder::JpegEncoder(const JpegEncoderConfig &config) : config_(config) {
+  int quality = std::max(1, std::min(100, config_.quality));
+  config_.quality = quality;
+
+  int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+  for (int i = 0; i < 64; ++i) {
+    int luma = (kLumaQuantBase[i] * scale + 50) / 100;
+    int chroma = (kChromaQuantBase[i] * scale + 50) / 100;
+    lumaQuant_[i] = static_cast<uint8_t>(std::max(1, std::min(255, luma)));
+    chromaQuant_[i] = static_cast<uint8_t>(std::max(1, std::min(255, chroma)));
+  }
+
+  BuildHuffmanTable(kDcLumaBits, kDcLumaValues, dcLuma_);
+  BuildHuffmanTable(kAcLumaBits, kAcLumaValues, acLuma_);
+  BuildHuffmanTable(kDcChromaBits, kDcChromaValues, dcChroma_);
+  BuildHuffmanTable(kAcChromaBits, kAcChromaValues, acChroma_);
+}
+
+bool JpegEncoder::HasSimd() { return INVISIBLE_HAVE_SSE2 != 0; }
+
+void JpegEncoder::BuildHuffmanTable(const uint8_t *bits, const uint8_t *values,
+                                    HuffmanTable &table) {
+  // Canonical code assignment (T.81 Annex C)
+  int k = 0;
+  uint16_t code = 0;
+  for (int length = 1; length <= 16; ++length) {
+    for (int i = 0; i < bits[length - 1]; ++i) {
+      uint8_t symbol = values[k++];
+      table.code[symbol] = code++;
+      table.size[symbol] = static_cast<uint8_t>(length);
+    }
+    code <<= 1;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Encode
+// -----------------------------------------------------------------------------
+
+bool JpegEncoder::EncodeBgra(const uint8_t *pixels, int width, int height,
+                             int stride, std::vector<uint8_t> &out) const {
+  if (!pixels || width <= 0 || height <= 0 || width > 65535 ||
+      height > 65535 || stride < width * 4) {
+    return false;
+  }
+
+  const int sampling = config_.chromaSubsampling ? 2 : 1;
+  const int mcuSize = 8 * sampling;
+  const int paddedWidth = (width + mcuSize - 1) / mcuSize * mcuSize;
+
+  out.reserve(out.size() + static_cast<size_t>(width) * height / 4 + 1024);
+
+  // SOI + JFIF APP0
+  PutMarker(out, 0xD8, 0);
+  PutMarker(out, 0xE0, 16);
+  const uint8_t jfif[] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+  out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+  // DQT: both tables, zigzag order
+  PutMarker(out, 0xDB, 2 + 65 * 2);
+  out.push_back(0x00);
+  for (int i = 0; i < 64; ++i) {
+    out.push_back(lumaQuant_[kZigzag[i]]);
+  }
+  out.push_back(0x01);
+  for (int i = 0; i < 64; ++i) {
+    out.push_back(chromaQuant_[kZigzag[i]]);
+  }
+
+  // SOF0: baseline, 8-bit, three components
+  PutMarker(out, 0xC0, 17);
+  out.push_back(8);
+  PutU16(out, height);
+  PutU16(out, width);
+  out.push_back(3);
+  out.push_back(1);
+  out.push_back(static_cast<uint8_t>((sampling << 4) | sampling));
+  out.push_back(0);
+  out.push_back(2);
+  out.push_back(0x11);
+  out.push_back(1);
+  out.push_back(3);
+  out.push_back(0x11);
+  out.push_back(1);
+
+  // DHT: standard tables
+  struct TableSpec {
+    uint8_t classAndId;
+    const uint8_t *bits;
+    const uint8_t *values;
+    int count;
+  };
+  const TableSpec tables[] = {{0x00, kDcLumaBits, kDcLumaValues, 12},
+                              {0x10, kAcLumaBits, kAcLumaValues, 162},
+                              {0x01, kDcChromaBits, kDcChromaValues, 12},
+                              {0x11, kAcChromaBits, kAcChromaValues, 162}};
+  int dhtLength = 2;
+  for (const auto &t : tables) {
+    dhtLength += 1 + 16 + t.count;
+  }
+  PutMarker(out, 0xC4, static_cast<uint16_t>(dhtLength));
+  for (const auto &t : tables) {
+    out.push_back(t.classAndId);
+    out.insert(out.end(), t.bits, t.bits + 16);
+    out.insert(out.end(), t.values, t.values + t.count);
+  }
+
+  // SOS
+  PutMarker(out, 0xDA, 12);
+  const uint8_t sos[] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+  out.insert(out.end(), sos, sos + sizeof(sos));
+
+  // Scan data, one MCU row at a time. Planes are full resolution so the
+  // color conversion never branches on subsampling.
+  std::vector<int16_t> yPlane(static_cast<size_t>(paddedWidth) * mcuSize);
+  std::vector<int16_t> cbPlane(yPlane.size());
+  std::vector<int16_t> crPlane(yPlane.size());
+
+  BitWriter writer(out);
+  int prevDcY = 0, prevDcCb = 0, prevDcCr = 0;
+  int32_t block[64];
+  int16_t coefficients[64];
+
+  auto encodeBlock = [&](const uint8_t *quant, const HuffmanTable &dc,
+                         const HuffmanTable &ac, int &prevDc) {
+    ForwardDct(block);
+    Quantize(block, quant, coefficients);
+
+    int diff = coefficients[0] - prevDc;
+    prevDc = coefficients[0];
+    int bits = BitLength(diff);
+    writer.Put(dc.code[bits], dc.size[bits]);
+    if (bits) {
+      writer.Put(MagnitudeBits(diff, bits), bits);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; ++k) {
+      int value = coefficients[k];
+      if (value == 0) {
+        ++run;
+        continue;
+      }
+      while (run > 15) {
+        writer.Put(ac.code[0xF0], ac.size[0xF0]); // ZRL
+        run -= 16;
+      }
+      bits = BitLength(value);
+      int symbol = (run << 4) | bits;
+      writer.Put(ac.code[symbol], ac.size[symbol]);
+      writer.Put(MagnitudeBits(value, bits), bits);
+      run = 0;
+    }
+    if (run > 0) {
+      writer.Put(ac.code[0x00], ac.size[0x00]); // EOB
+    }
+  };
+
+  for (int mcuY = 0; mcuY < height; mcuY += mcuSize) {
+    for (int r = 0; r < mcuSize; ++r) {
+      int srcY = std::min(mcuY + r, height - 1);
+      size_t offset = static_cast<size_t>(r) * paddedWidth;
+      int16_t *y = yPlane.data() + offset;
+      int16_t *cb = cbPlane.data() + offset;
+      int16_t *cr = crPlane.data() + offset;
+
+      ConvertRow(pixels + static_cast<size_t>(srcY) * stride, width, y, cb, cr);
+      for (int x = width; x < paddedWidth; ++x) {
+        y[x] = y[width - 1];
+        cb[x] = cb[width - 1];
+        cr[x] = cr[width - 1];
+      }
+    }
+
+    for (int mcuX = 0; mcuX < paddedWidth; mcuX += mcuSize) {
+      for (int by = 0; by < sampling; ++by) {
+        for (int bx = 0; bx < sampling; ++bx) {
+          LoadBlock(yPlane.data(), paddedWidth, mcuX + bx * 8, by * 8, block);
+          encodeBlock(lumaQuant_, dcLuma_, acLuma_, prevDcY);
+        }
+      }
+
+      if (sampling == 2) {
+        LoadBlockDownsampled(cbPlane.data(), paddedWidth, mcuX, block);
+        encodeBlock(chromaQuant_, dcChroma_, acChroma_, prevDcCb);
+        LoadBlockDownsampled(crPlane.data(), paddedWidth, mcuX, block);
+        encodeBlock(chromaQuant_, dcChroma_, acChroma_, prevDcCr);
+      } else {
+        LoadBlock(cbPlane.data(), paddedWidth, mcuX, 0, block);
+        encodeBlock(chromaQuant_, dcChroma_, acChroma_, prevDcCb);
+        LoadBlock(crPlane.data(), paddedWidth, mcuX, 0, block);
+        encodeBlock(chromaQuant_, dcChroma_, acChroma_, prevDcCr);
+      }
+    }
+  }
+
+  writer.Flush();
+  PutMarker(out, 0xD9, 0);
+  return true;
+}
+
+} // namespace invisible
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// JPEG Encoder Configuration
+// -----------------------------------------------------------------------------
+
+struct JpegEncoderConfig {
+  int quality = 85;              // 1-100, IJG quality scaling
+  bool chromaSubsampling = true; // 4:2:0 when true, 4:4:4 otherwise
+};
+
+// -----------------------------------------------------------------------------
+// Baseline JPEG Encoder
+// Encodes BGRA pixels straight from a capture buffer into a JFIF stream.
+// All arithmetic is integer (fixed-point color conversion, islow DCT), so the
+// SSE2 and scalar paths produce identical bytes on every machine.
+// -----------------------------------------------------------------------------
+
+class JpegEncoder {
+public:
+  explicit JpegEncoder(const JpegEncoderConfig &config = JpegEncoderConfig());
+
+  // Encode top-down BGRA rows spaced `stride` bytes apart (alpha is ignored).
+  // Appends the complete JFIF file to `out`.
+  bool EncodeBgra(const uint8_t *pixels, int width, int height, int stride,
+                  std::vector<uint8_t> &out) const;
+
+  const JpegEncoderConfig &GetConfig() const { return config_; }
+
+  // True when the SSE2 color conversion / DCT kernels are compiled in
+  static bool HasSimd();
+
+private:
+  struct HuffmanTable {
+    uint16_t code[256] = {};
+    uint8_t size[256] = {};
+  };
+
+  static void BuildHuffmanTable(const uint8_t *bits, const uint8_t *values,
+                                HuffmanTable &table);
+
+  JpegEncoderConfig config_;
+  uint8_t lumaQuant_[64];   // Natural order
+  uint8_t chromaQuant_[64]; // Natural order
+  HuffmanTable dcLuma_, acLuma_, dcChroma_, acChroma_;
+};
+
+} // namespace invisible
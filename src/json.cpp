@@ -0,0 +1,598 @@
+#include "json.h"
+#include "simd.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace invisible {
+
+namespace {
+
+inline int CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+inline bool NeedsEscape(unsigned char c) {
+  return c == '"' || c == '\\' || c < 0x20;
+}
+
+// -----------------------------------------------------------------------------
+// String Scanning
+// Length of the leading run that contains no quote, backslash or control
+// character: the bytes that can be copied (or skipped) as-is.
+// -----------------------------------------------------------------------------
+
+size_t ScanSafeRun(const char *text, size_t length) {
+  size_t i = 0;
+
+#if INVISIBLE_HAVE_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= length; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                               _mm_cmpeq_epi8(v, backslash));
+    // Unsigned v <= 0x1F exactly when max(v, 0x1F) == 0x1F
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+    if (mask != 0) {
+      return i + CountTrailingZeros(mask);
+    }
+  }
+#endif
+
+  for (; i < length; ++i) {
+    if (NeedsEscape(static_cast<unsigned char>(text[i])))
+      return i;
+  }
+  return length;
+}
+
+inline int HexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Four hex digits at `p` (already validated by the scanner)
+inline uint32_t ParseHex4(const char *p) {
+  return (HexValue(p[0]) << 12) | (HexValue(p[1]) << 8) |
+         (HexValue(p[2]) << 4) | HexValue(p[3]);
+}
+
+void AppendUtf8(uint32_t codepoint, std::string &out) {
+  if (codepoint < 0x80) {
+    out += static_cast<char>(codepoint);
+  } else if (codepoint < 0x800) {
+    out += static_cast<char>(0xC0 | (codepoint >> 6));
+    out += static_cast<char>(0x80 | (codepoint & 0x3F));
+  } else if (codepoint < 0x10000) {
+    out += static_cast<char>(0xE0 | (codepoint >> 12));
+    out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codepoint & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (codepoint >> 18));
+    out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codepoint & 0x3F));
+  }
+}
+
+// Decode a validated string body (between the quotes) with escapes
+void Unescape(std::string_view raw, std::string &out) {
+  out.clear();
+  out.reserve(raw.size());
+
+  size_t i = 0;
+  while (i < raw.size()) {
+    size_t next = raw.find('\\', i);
+    if (next == std::string_view::npos) {
+      out.append(raw.data() + i, raw.size() - i);
+      break;
+    }
+    out.append(raw.data() + i, next - i);
+
+    char e = raw[next + 1];
+    i = next + 2;
+    switch (e) {
+    case 'b':
+      out += '\b';
+      break;
+    case 'f':
+      out += '\f';
+      break;
+    case 'n':
+      out += '\n';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'u': {
+      uint32_t codepoint = ParseHex4(raw.data() + i);
+      i += 4;
+      if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        // High surrogate: combine with a following low surrogate
+        if (i + 6 <= raw.size() && raw[i] == '\\' && raw[i + 1] == 'u') {
+          uint32_t low = ParseHex4(raw.data() + i + 2);
+          if (low >= 0xDC00 && low <= 0xDFFF) {
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+          } else {
+            codepoint = 0xFFFD;
+          }
+        } else {
+          codepoint = 0xFFFD;
+        }
+      } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+        codepoint = 0xFFFD; // Lone low surrogate
+      }
+      AppendUtf8(codepoint, out);
+      break;
+    }
+    default: // '"', '\\', '/'
+      out += e;
+      break;
+    }
+  }
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Reader
+// -----------------------------------------------------------------------------
+
+JsonReader::JsonReader(std::string_view text) : text_(text) {}
+
+JsonToken JsonReader::Fail(const char *message) {
+  if (!error_)
+    error_ = message;
+  return JsonToken::Error;
+}
+
+void JsonReader::SkipWhitespace() {
+  while (pos_ < text_.size()) {
+    char c = text_[pos_];
+    if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+      break;
+    ++pos_;
+  }
+}
+
+void JsonReader::AfterValue() {
+  expect_ = stack_.empty() ? Expect::Done : Expect::CommaOrEnd;
+}
+
+JsonToken JsonReader::Next() {
+  if (error_)
+    return JsonToken::Error;
+
+  SkipWhitespace();
+
+  if (expect_ == Expect::Done) {
+    return pos_ < text_.size() ? Fail("Trailing characters after document")
+                               : JsonToken::End;
+  }
+  if (pos_ >= text_.size())
+    return Fail("Unexpected end of input");
+
+  char c = text_[pos_];
+  switch (expect_) {
+  case Expect::Value:
+    return ReadValue();
+
+  case Expect::ValueOrEnd:
+    return c == ']' ? ReadClose(c) : ReadValue();
+
+  case Expect::KeyOrEnd:
+    return c == '}' ? ReadClose(c) : ReadKey();
+
+  case Expect::CommaOrEnd:
+    if (c != ',')
+      return ReadClose(c);
+    ++pos_;
+    SkipWhitespace();
+    if (pos_ >= text_.size())
+      return Fail("Unexpected end of input");
+    return stack_.back() == '{' ? ReadKey() : ReadValue();
+
+  case Expect::Done:
+    break;
+  }
+  return Fail("Invalid reader state");
+}
+
+JsonToken JsonReader::ReadValue() {
+  switch (text_[pos_]) {
+  case '{':
+  case '[':
+    if (stack_.size() >= MAX_DEPTH)
+      return Fail("Nesting too deep");
+    stack_.push_back(text_[pos_]);
+    expect_ = text_[pos_] == '{' ? Expect::KeyOrEnd : Expect::ValueOrEnd;
+    return text_[pos_++] == '{' ? JsonToken::BeginObject
+                                : JsonToken::BeginArray;
+  case '"':
+    if (!ScanString())
+      return JsonToken::Error;
+    AfterValue();
+    return JsonToken::String;
+  case 't':
+    return ReadLiteral("true", 4, JsonToken::True);
+  case 'f':
+    return ReadLiteral("false", 5, JsonToken::False);
+  case 'n':
+    return ReadLiteral("null", 4, JsonToken::Null);
+  default:
+    return ReadNumber();
+  }
+}
+
+JsonToken JsonReader::ReadKey() {
+  if (text_[pos_] != '"')
+    return Fail("Expected object key");
+  if (!ScanString())
+    return JsonToken::Error;
+
+  SkipWhitespace();
+  if (pos_ >= text_.size() || text_[pos_] != ':')
+    return Fail("Expected ':' after object key");
+  ++pos_;
+  expect_ = Expect::Value;
+  return JsonToken::Key;
+}
+
+JsonToken JsonReader::ReadClose(char c) {
+  if (stack_.empty() || (c != '}' && c != ']'))
+    return Fail("Expected ',' or closing bracket");
+  if ((c == '}') != (stack_.back() == '{'))
+    return Fail("Mismatched closing bracket");
+
+  stack_.pop_back();
+  ++pos_;
+  AfterValue();
+  return c == '}' ? JsonToken::EndObject : JsonToken::EndArray;
+}
+
+JsonToken JsonReader::ReadLiteral(const char *word, size_t length,
+                                  JsonToken token) {
+  if (text_.compare(pos_, length, word) != 0)
+    return Fail("Invalid literal");
+  pos_ += length;
+  AfterValue();
+  return token;
+}
+
+JsonToken JsonReader::ReadNumber() {
+  const size_t start = pos_;
+  auto digit = [this] {
+    return pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9';
+  };
+
+  if (pos_ < text_.size() && text_[pos_] == '-')
+    ++pos_;
+  if (pos_ < text_.size() && text_[pos_] == '0') {
+    ++pos_;
+  } else if (digit()) {
+    while (digit())
+      ++pos_;
+  } else {
+    return Fail("Invalid value");
+  }
+
+  if (pos_ < text_.size() && text_[pos_] == '.') {
+    ++pos_;
+    if (!digit())
+      return Fail("Invalid number");
+    while (digit())
+      ++pos_;
+  }
+
+  if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+    ++pos_;
+    if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-'))
+      ++pos_;
+    if (!digit())
+      return Fail("Invalid number");
+    while (digit())
+      ++pos_;
+  }
+
+  raw_ = text_.substr(start, pos_ - start);
+  AfterValue();
+  return JsonToken::Number;
+}
+
+bool JsonReader::ScanString() {
+  const size_t start = ++pos_; // Past the opening quote
+  escaped_ = false;
+
+  for (;;) {
+    pos_ += ScanSafeRun(text_.data() + pos_, text_.size() - pos_);
+    if (pos_ >= text_.size()) {
+      Fail("Unterminated string");
+      return false;
+    }
+
+    char c = text_[pos_];
+    if (c == '"') {
+      raw_ = text_.substr(start, pos_ - start);
+      ++pos_;
+      return true;
+    }
+    if (c != '\\') {
+      Fail("Control character in string");
+      return false;
+    }
+
+    // Validate the escape now; decoding waits until GetString()
+    escaped_ = true;
+    if (pos_ + 1 >= text_.size()) {
+      Fail("Unterminated string");
+      return false;
+    }
+    char e = text_[pos_ + 1];
+    if (e == 'u') {
+      if (pos_ + 6 > text_.size()) {
+        Fail("Truncated \\u escape");
+        return false;
+      }
+      for (size_t i = 2; i < 6; ++i) {
+        if (HexValue(text_[pos_ + i]) < 0) {
+          Fail("Invalid \\u escape");
+          return false;
+        }
+      }
+      pos_ += 6;
+    } else if (e == '"' || e == '\\' || e == '/' || e == 'b' || e == 'f' ||
+               e == 'n' || e == 'r' || e == 't') {
+      pos_ += 2;
+    } else {
+      Fail("Invalid escape");
+      return false;
+    }
+  }
+}
+
+std::string_view JsonReader::GetString() const {
+  if (!escaped_)
+    return raw_;
+  Unescape(raw_, decoded_);
+  return decoded_;
+}
+
+double JsonReader::GetNumber() const {
+  // strtod needs a terminator; numbers are short
+  char buffer[64];
+  if (raw_.size() < sizeof(buffer)) {
+    raw_.copy(buffer, raw_.size());
+    buffer[raw_.size()] = '\0';
+    return std::strtod(buffer, nullptr);
+  }
+  return std::strtod(std::string(raw_).c_str(), nullptr);
+}
+
+bool JsonReader::SkipValue(JsonToken first) {
+  switch (first) {
+  case JsonToken::BeginObject:
+  case JsonToken::BeginArray: {
+    // The container is already on the stack; pull until it is popped
+    const size_t depth = stack_.size();
+    while (stack_.size() >= depth) {
+      JsonToken token = Next();
+      if (token == JsonToken::Error || token == JsonToken::End)
+        return false;
+    }
+    return true;
+  }
+  case JsonToken::String:
+  case JsonToken::Number:
+  case JsonToken::True:
+  case JsonToken::False:
+  case JsonToken::Null:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Path Lookup
+// -----------------------------------------------------------------------------
+
+bool JsonGetString(std::string_view json,
+                   std::initializer_list<JsonPathStep> path,
+                   std::string &value) {
+  JsonReader reader(json);
+  JsonToken token = reader.Next();
+
+  for (const JsonPathStep &step : path) {
+    if (step.key) {
+      if (token != JsonToken::BeginObject)
+        return false;
+      for (;;) {
+        token = reader.Next();
+        if (token != JsonToken::Key)
+          return false; // End of object or malformed
+        bool match = reader.GetString() == step.key;
+        token = reader.Next();
+        if (match)
+          break;
+        if (!reader.SkipValue(token))
+          return false;
+      }
+    } else {
+      if (token != JsonToken::BeginArray)
+        return false;
+      for (size_t i = 0;; ++i) {
+        token = reader.Next();
+        if (token == JsonToken::EndArray || token == JsonToken::Error)
+          return false;
+        if (i == step.index)
+          break;
+        if (!reader.SkipValue(token))
+          return false;
+      }
+    }
+  }
+
+  if (token != JsonToken::String)
+    return false;
+  value.assign(reader.GetString());
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Writer
+// -----------------------------------------------------------------------------
+
+void JsonEscapeAppend(std::string_view value, std::string &out) {
+  const char *p = value.data();
+  size_t remaining = value.size();
+
+  while (remaining > 0) {
+    size_t run = ScanSafeRun(p, remaining);
+    out.append(p, run);
+    p += run;
+    remaining -= run;
+    if (remaining == 0)
+      break;
+
+    unsigned char c = static_cast<unsigned char>(*p++);
+    --remaining;
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\b':
+      out += "\\b";
+      break;
+    case '\f':
+      out += "\\f";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default: {
+      static const char kHex[] = "0123456789abcdef";
+      char escape[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+      out.append(escape, sizeof(escape));
+      break;
+    }
+    }
+  }
+}
+
+void JsonWriter::Separator() {
+  if (needComma_)
+    out_ += ',';
+}
+
+void JsonWriter::BeginObject() {
+  Separator();
+  out_ += '{';
+  needComma_ = false;
+}
+
+void JsonWriter::EndObject() {
+  out_ += '}';
+  needComma_ = true;
+}
+
+void JsonWriter::BeginArray() {
+  Separator();
+  out_ += '[';
+  needComma_ = false;
+}
+
+void JsonWriter::EndArray() {
+  out_ += ']';
+  needComma_ = true;
+}
+
+void JsonWriter::Key(std::string_view name) {
+  Separator();
+  out_ += '"';
+  JsonEscapeAppend(name, out_);
+  out_ += "\":";
+  needComma_ = false;
+}
+
+void JsonWriter::String(std::string_view value) {
+  Separator();
+  out_.reserve(out_.size() + value.size() + 2);
+  out_ += '"';
+  JsonEscapeAppend(value, out_);
+  out_ += '"';
+  needComma_ = true;
+}
+
+void JsonWriter::Int(int64_t value) {
+  Separator();
+  char buffer[24];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out_.append(buffer, result.ptr);
+  needComma_ = true;
+}
+
+void JsonWriter::Double(double value, int significantDigits) {
+  Separator();
+  if (!std::isfinite(value)) {
+    out_ += "null"; // JSON has no NaN/Infinity
+  } else {
+    char buffer[32];
+    int digits = significantDigits < 1 ? 1 : std::min(significantDigits, 17);
+    int length = std::snprintf(buffer, sizeof(buffer), "%.*g", digits, value);
+    out_.append(buffer, static_cast<size_t>(length));
+  }
+  needComma_ = true;
+}
+
+void JsonWriter::Bool(bool value) {
+  Separator();
+  out_ += value ? "true" : "false";
+  needComma_ = true;
+}
+
+void JsonWriter::Null() {
+  Separator();
+  out_ += "null";
+  needComma_ = true;
+}
+
+void JsonWriter::BeginRawString() {
+  Separator();
+  out_ += '"';
+}
+
+void JsonWriter::EndRawString() {
+  out_ += '"';
+  needComma_ = true;
+}
+
+} // namespace invisible
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// JSON Tokens
+// -----------------------------------------------------------------------------
+
+enum class JsonToken {
+  BeginObject,
+  EndObject,
+  BeginArray,
+  EndArray,
+  Key,    // Object member name; the value's first token follows
+  String,
+  Number,
+  True,
+  False,
+  Null,
+  End,    // Document complete
+  Error
+};
+
+// -----------------------------------------------------------------------------
+// JSON Pull Reader
+// Walks a UTF-8 document one token at a time without building a tree.
+// Strings are scanned 16 bytes at a time and returned as views into the
+// input; only strings that contain escapes are decoded (into one reused
+// buffer). The grammar is checked as tokens are pulled, so a caller that
+// stops early never pays for the rest of the document.
+// -----------------------------------------------------------------------------
+
+class JsonReader {
+public:
+  static constexpr size_t MAX_DEPTH = 256;
+
+  explicit JsonReader(std::string_view text);
+
+  // Next token; Error is sticky
+  JsonToken Next();
+
+  // Skip the value whose first token was just returned (a whole object or
+  // array after BeginObject/BeginArray, nothing for a scalar)
+  bool SkipValue(JsonToken first);
+
+  // Text of the last Key or String, unescaped. Valid until the next call.
+  std::string_view GetString() const;
+
+  // Last Number token, as written and converted
+  std::string_view GetRawNumber() const { return raw_; }
+  double GetNumber() const;
+
+  size_t GetDepth() const { return stack_.size(); }
+  size_t GetOffset() const { return pos_; }
+  const char *GetError() const { return error_; }
+
+private:
+  enum class Expect { Value, ValueOrEnd, KeyOrEnd, CommaOrEnd, Done };
+
+  JsonToken ReadValue();
+  JsonToken ReadKey();
+  JsonToken ReadClose(char c);
+  JsonToken ReadLiteral(const char *word, size_t length, JsonToken token);
+  JsonToken ReadNumber();
+  bool ScanString(); // Sets raw_/escaped_; pos_ starts at the opening quote
+  void SkipWhitespace();
+  void AfterValue();
+  JsonToken Fail(const char *message);
+
+  std::string_view text_;
+  size_t pos_ = 0;
+  Expect expect_ = Expect::Value;
+  std::vector<char> stack_; // '{' or '[' per open container
+  std::string_view raw_;    // Last string (between quotes) or number
+  bool escaped_ = false;
+  mutable std::string decoded_;
+  const char *error_ = nullptr;
+};
+
+// -----------------------------------------------------------------------------
+// JSON Path Lookup
+// -----------------------------------------------------------------------------
+
+struct JsonPathStep {
+  JsonPathStep(const char *name) : key(name) {}
+  JsonPathStep(int position) : index(static_cast<size_t>(position)) {}
+
+  const char *key = nullptr; // Object member, or null for an array index
+  size_t index = 0;
+};
+
+// Pull the string at `path`, e.g. {"choices", 0, "message", "content"}.
+// Only the first occurrence of each key is followed, siblings are skipped
+// without decoding, and reading stops as soon as the value is found.
+// Returns false if the path is missing, not a string, or malformed.
+bool JsonGetString(std::string_view json,
+                   std::initializer_list<JsonPathStep> path,
+                   std::string &value);
+
+// -----------------------------------------------------------------------------
+// JSON Writer
+// Appends compact JSON to a caller-owned string. Commas and colons are
+// placed automatically; string escaping copies safe runs in bulk.
+// -----------------------------------------------------------------------------
+
+class JsonWriter {
+public:
+  explicit JsonWriter(std::string &out) : out_(out) {}
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+
+  void Key(std::string_view name);
+  void String(std::string_view value);
+  void Int(int64_t value);
+  void Double(double value, int significantDigits = 6);
+  void Bool(bool value);
+  void Null();
+
+  // Open a string value whose content the caller appends straight to the
+  // output (it must need no escaping, e.g. base64), then close it
+  void BeginRawString();
+  void EndRawString();
+
+private:
+  void Separator();
+
+  std::string &out_;
+  bool needComma_ = false;
+};
+
+// Append `value` to `out` with JSON string escaping (no quotes)
+void JsonEscapeAppend(std::string_view value, std::string &out);
+
+} // namespace invisible
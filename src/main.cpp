@@ -20,11 +20,13 @@
  */
 
 #include "audio_capture.h"
+#include "frame_index.h"
 #include "meeting_assistant.h"
 #include "overlay_window.h"
 #include "screen_capture.h"
 #include "tray_icon.h"
 #include <deque>
+#include <filesystem>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -46,6 +48,9 @@ struct AppConfig {
   std::string openaiApiKey;
   std::string gptModel = "gpt-4o-mini";
   bool enableTTS = false; // Disabled by default - use --tts to enable
+  bool cacheResponses = true; // --no-cache to always ask the API
+  bool localOcr = false; // --ocr to read text-only captures on-device
+  std::filesystem::path responseCachePath;
 };
 
 // Additional hotkey IDs for AI features
@@ -83,6 +88,7 @@ private:
   std::unique_ptr<AudioCapture> audioCapture_;
   std::unique_ptr<AudioBufferQueue> audioQueue_;
   std::unique_ptr<RegionSelector> regionSelector_;
+  FrameIndex frameIndex_; // Vision answers of recent captures
   std::unique_ptr<MeetingAssistant> meetingAssistant_;
   TrayIcon trayIcon_;
 
@@ -191,6 +197,8 @@ bool InvisibleApp::Initialize(const AppConfig &config) {
     maConfig.gptModel = config_.gptModel;
     maConfig.enableTTS = config_.enableTTS;
     maConfig.transcriptionIntervalSec = 5.0f;
+    maConfig.cacheResponses = config_.cacheResponses;
+    maConfig.responseCachePath = config_.responseCachePath;
 
     if (meetingAssistant_->Initialize(maConfig)) {
       aiInitialized_ = true;
@@ -310,9 +318,13 @@ void InvisibleApp::OnMeetingAssistantEvent(const MeetingAssistantEvent &event) {
       }
 
       lastAIResponse_ = wtext;
-      statusText_ = (event.type == MeetingAssistantEvent::SUMMARY_READY)
-                        ? L"Summary generated!"
-                        : L"AI response received";
+      if (event.partial) {
+        statusText_ = L"AI responding...";
+      } else {
+        statusText_ = (event.type == MeetingAssistantEvent::SUMMARY_READY)
+                          ? L"Summary generated!"
+                          : L"AI response received";
+      }
     }
     break;
   }
@@ -364,12 +376,13 @@ void InvisibleApp::OnHotkey(int hotkeyId) {
 
   case AIHotkeys::HOTKEY_ASK_AI: {
     if (meetingAssistant_ && aiInitialized_) {
+      // Before the call: a cached answer is shown before it returns
+      statusText_ = L"Asking AI...";
       meetingAssistant_->AskQuestion(
           "Listen to the transcript carefully. If there is a question being "
           "asked, "
           "provide the DIRECT ANSWER to that question. Do not list key points "
           "or summarize.");
-      statusText_ = L"Asking AI...";
       if (overlay_)
         overlay_->Invalidate();
     } else {
@@ -382,8 +395,8 @@ void InvisibleApp::OnHotkey(int hotkeyId) {
 
   case AIHotkeys::HOTKEY_SUMMARY: {
     if (meetingAssistant_ && aiInitialized_) {
-      meetingAssistant_->GenerateSummary();
       statusText_ = L"Generating summary...";
+      meetingAssistant_->GenerateSummary();
       if (overlay_)
         overlay_->Invalidate();
     } else {
@@ -486,15 +499,79 @@ void InvisibleApp::OnRegionSelected(const Rect &region) {
 
   CapturedImage capture = ScreenCapture::CaptureRegion(region);
   if (capture.IsValid()) {
+    // The same view captured again: answer from memory if nothing changed
+    ImageRect placement{region.x, region.y, capture.width, capture.height};
+    FrameMatch match = frameIndex_.Lookup(capture.pixels.data(),
+                                          capture.stride, placement);
+    if (match.kind == FrameMatch::UNCHANGED) {
+      MeetingAssistantEvent event;
+      event.type = MeetingAssistantEvent::AI_RESPONSE;
+      event.text = match.analysis;
+      OnMeetingAssistantEvent(event);
+      statusText_ = L"Region unchanged - previous answer";
+      if (overlay_)
+        overlay_->Invalidate();
+      return;
+    }
+
+    // Text alone (code, a document, a question) is read on-device and
+    // asked as a short chat; anything else goes to the vision model
+    if (config_.localOcr && meetingAssistant_) {
+      RecognizedText ocr = ScreenCapture::RecognizeText(capture.View());
+      wchar_t msg[160];
+      swprintf_s(msg,
+                 L"[OCR] %d lines, %d symbols, %d unreadable, %llu us%s\n",
+                 ocr.lines, ocr.symbols, ocr.rejected, ocr.micros,
+                 ocr.usable ? L"" : L" - sending the image");
+      OutputDebugStringW(msg);
+      if (ocr.usable) {
+        capture = CapturedImage();
+        statusText_ = L"Analyzing screen text with AI...";
+        if (overlay_)
+          overlay_->Invalidate();
+        meetingAssistant_->AnalyzeScreenText(
+            ocr.text, "",
+            [this, signature = std::move(match.signature)](
+                const std::string &answer) {
+              frameIndex_.Remember(signature, answer);
+            });
+        return;
+      }
+    }
+
     statusText_ = L"Analyzing captured region with AI...";
     if (overlay_)
       overlay_->Invalidate();
 
-    // Convert to base64 and send to AI vision
-    std::string base64Data = ScreenCapture::ConvertToBase64Bmp(capture);
+    // Only a small part changed: send that with the earlier answer (a
+    // view into the capture, nothing is copied)
+    std::string prompt;
+    ImageView source = capture.View();
+    if (match.kind == FrameMatch::CHANGED && match.sendDelta) {
+      ImageView delta = source.Crop(match.changed);
+      if (delta.IsValid()) {
+        source = delta;
+        prompt = FrameIndex::BuildDeltaPrompt(match.analysis);
+      }
+    }
 
-    if (!base64Data.empty() && meetingAssistant_) {
-      meetingAssistant_->AnalyzeImage(base64Data);
+    // Crop solid borders and shrink to what the vision model looks at
+    // (a 4K grab is several times the bytes it needs), then encode to
+    // JPEG; base64 happens directly into the request payload
+    CapturedImage prepared;
+    ImageView upload = ScreenCapture::PrepareForVision(source, prepared)
+                           ? prepared.View()
+                           : source;
+    std::vector<BYTE> jpegData = ScreenCapture::EncodeJpeg(upload);
+    capture = CapturedImage(); // Its buffer serves the next capture
+
+    if (!jpegData.empty() && meetingAssistant_) {
+      meetingAssistant_->AnalyzeImage(
+          std::move(jpegData), prompt,
+          [this, signature = std::move(match.signature)](
+              const std::string &answer) {
+            frameIndex_.Remember(signature, answer);
+          });
     } else {
       statusText_ = L"Failed to encode image";
     }
@@ -770,6 +847,28 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
   if (cmdLine.find(L"--debug") != std::wstring::npos) {
     config.debugMode = true;
   }
+  if (cmdLine.find(L"--no-cache") != std::wstring::npos) {
+    config.cacheResponses = false;
+  }
+  if (cmdLine.find(L"--ocr") != std::wstring::npos) {
+    config.localOcr = true;
+  }
+
+  // Answers are kept between runs under %LOCALAPPDATA% (read wide: the
+  // narrow value is in the ANSI code page, not UTF-8)
+  wchar_t *appData = nullptr;
+  size_t appDataLen = 0;
+  if (config.cacheResponses &&
+      _wdupenv_s(&appData, &appDataLen, L"LOCALAPPDATA") == 0 && appData) {
+    std::filesystem::path dir =
+        std::filesystem::path(appData) / L"InvisibleOverlay";
+    free(appData);
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    if (!error) {
+      config.responseCachePath = dir / "response_cache.bin";
+    }
+  }
 
   // Create and run application
   InvisibleApp app;
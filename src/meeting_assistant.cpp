@@ -1,4 +1,5 @@
 #include "meeting_assistant.h"
+#include <algorithm>
 #include <chrono>
 
 namespace invisible {
@@ -22,11 +23,55 @@ bool MeetingAssistant::Initialize(const MeetingAssistantConfig &config) {
 
   config_ = config;
 
+  // Utterance segmentation of the converted 16kHz stream
+  SegmenterConfig segmenterConfig;
+  segmenterConfig.minChunkSec = config.minAudioLengthSec;
+  segmenterConfig.maxChunkSec = config.transcriptionIntervalSec;
+  segmenterConfig.pauseSec = config.pauseSec;
+  segmenterConfig.overlapSec = config.chunkOverlapSec;
+  segmenterConfig.useVad = config.enableVad;
+  segmenterConfig.vad.sampleRate = audioPreprocessor_.GetOutputRate();
+  segmenter_ = std::make_unique<UtteranceSegmenter>(segmenterConfig);
+
+  // Several uploads in flight so one slow request does not stall the rest
+  TranscriptionPipelineConfig pipelineConfig;
+  pipelineConfig.maxInFlight =
+      (size_t)std::max(config.maxConcurrentTranscriptions, 1);
+  transcriptionPipeline_ = std::make_unique<TranscriptionPipeline>(
+      pipelineConfig,
+      [this](AudioChunk &&chunk, TranscriptionPipeline::TranscribeDone done) {
+        TranscribeChunk(std::move(chunk), std::move(done));
+      },
+      [this](uint64_t sequence, const std::string &text) {
+        OnTranscriptionResult(sequence, text);
+      });
+
+  // Background summary of the transcript, folded a segment at a time
+  rollingSummary_.reset();
+  if (config.summarySegmentChars > 0) {
+    RollingSummaryConfig summaryConfig;
+    summaryConfig.segmentChars = (size_t)config.summarySegmentChars;
+    summaryConfig.maxSegmentChars = summaryConfig.segmentChars * 2;
+    summaryConfig.maxTailChars = summaryConfig.segmentChars * 8;
+    rollingSummary_ = std::make_unique<RollingSummary>(
+        summaryConfig,
+        [this](const std::string &prompt, RollingSummary::SummarizeDone done) {
+          // No fold prompt comes twice, so none is cached
+          aiService_.ChatAsync(
+              {{"user", prompt}},
+              [done = std::move(done)](const std::string &text,
+                                       const std::string &) { done(text); },
+              HttpPriority::Low, ChatCaching::Off);
+        });
+  }
+
   // Initialize AI Service
   AIServiceConfig aiConfig;
   aiConfig.apiKey = config.apiKey;
   aiConfig.model = config.gptModel;
   aiConfig.whisperModel = config.whisperModel;
+  aiConfig.cacheResponses = config.cacheResponses;
+  aiConfig.cachePath = config.responseCachePath;
 
   if (!aiService_.Initialize(aiConfig)) {
     OutputDebugStringW(L"[MeetingAssistant] Failed to initialize AI service\n");
@@ -59,6 +104,10 @@ bool MeetingAssistant::Initialize(const MeetingAssistantConfig &config) {
   }
 
   ttsEnabled_ = config.enableTTS;
+  {
+    std::lock_guard<std::mutex> lock(queryMutex_);
+    queriesStopped_ = false;
+  }
   initialized_ = true;
 
   OutputDebugStringW(L"[MeetingAssistant] Initialized successfully\n");
@@ -68,19 +117,35 @@ bool MeetingAssistant::Initialize(const MeetingAssistantConfig &config) {
 void MeetingAssistant::Shutdown() {
   StopListening();
 
+  // Drop queued AI queries and stop a streaming answer; the AI service's
+  // shutdown below cancels whatever is still in flight and waits for the
+  // completions
+  std::shared_ptr<CancellationToken> responseCancel;
+  {
+    std::lock_guard<std::mutex> lock(queryMutex_);
+    queriesStopped_ = true;
+    queryQueue_ = std::queue<AIQuery>();
+    responseCancel = responseCancel_;
+  }
+  if (responseCancel)
+    responseCancel->Cancel();
+
   // Wait for threads to finish
   shouldStop_ = true;
-  queryCV_.notify_all();
+  if (segmenter_)
+    segmenter_->Stop();
+  if (transcriptionPipeline_)
+    transcriptionPipeline_->Stop();
 
   if (transcriptionThread_.joinable()) {
     transcriptionThread_.join();
   }
-  if (aiThread_.joinable()) {
-    aiThread_.join();
-  }
 
-  tts_.Shutdown();
+  // The AI service's shutdown completed a running fold; start no more
   aiService_.Shutdown();
+  if (rollingSummary_)
+    rollingSummary_->Stop();
+  tts_.Shutdown();
 
   initialized_ = false;
 }
@@ -96,19 +161,22 @@ bool MeetingAssistant::StartListening() {
 
   shouldStop_ = false;
 
-  // Start worker threads
+  // New session: drop leftover audio and the previous filter/VAD state
+  audioPreprocessor_.Reset();
+  segmenter_->Reset();
+
+  // Start the transcription worker
+  transcriptionPipeline_->Start();
   transcriptionThread_ =
       std::thread(&MeetingAssistant::TranscriptionWorker, this);
-  aiThread_ = std::thread(&MeetingAssistant::AIWorker, this);
 
   // Start audio capture
   if (!audioCapture_.Start(this)) {
     shouldStop_ = true;
-    queryCV_.notify_all();
+    segmenter_->Stop();
+    transcriptionPipeline_->Stop();
     if (transcriptionThread_.joinable())
       transcriptionThread_.join();
-    if (aiThread_.joinable())
-      aiThread_.join();
     return false;
   }
 
@@ -125,15 +193,20 @@ void MeetingAssistant::StopListening() {
   audioCapture_.Stop();
   listening_ = false;
 
-  shouldStop_ = true;
-  queryCV_.notify_all();
-
+  // Capture has stopped, so the producer is idle: close the utterance in
+  // progress and let the worker submit every queued chunk before it exits
+  if (segmenter_) {
+    segmenter_->Flush();
+    segmenter_->Stop();
+  }
   if (transcriptionThread_.joinable()) {
     transcriptionThread_.join();
   }
-  if (aiThread_.joinable()) {
-    aiThread_.join();
-  }
+
+  // Uploads already running finish and are delivered
+  shouldStop_ = true;
+  if (transcriptionPipeline_)
+    transcriptionPipeline_->Stop();
 
   OutputDebugStringW(L"[MeetingAssistant] Stopped listening\n");
 }
@@ -149,13 +222,14 @@ void MeetingAssistant::SetEventCallback(MeetingAssistantCallback callback) {
 
 void MeetingAssistant::EmitEvent(MeetingAssistantEvent::Type type,
                                  const std::string &text,
-                                 const std::string &error) {
+                                 const std::string &error, bool partial) {
   std::lock_guard<std::mutex> lock(callbackMutex_);
   if (eventCallback_) {
     MeetingAssistantEvent event;
     event.type = type;
     event.text = text;
     event.error = error;
+    event.partial = partial;
     eventCallback_(event);
   }
 }
@@ -170,14 +244,22 @@ std::string MeetingAssistant::GetTranscript() const {
 }
 
 void MeetingAssistant::ClearTranscript() {
-  std::lock_guard<std::mutex> lock(transcriptMutex_);
-  transcript_.clear();
+  {
+    std::lock_guard<std::mutex> lock(transcriptMutex_);
+    transcript_.clear();
+  }
+  if (rollingSummary_)
+    rollingSummary_->Clear();
 }
 
 void MeetingAssistant::AppendTranscript(const std::string &text) {
   if (text.empty())
     return;
 
+  // Kept whole by the summary, whatever the trimming below drops
+  if (rollingSummary_)
+    rollingSummary_->Append(text);
+
   std::lock_guard<std::mutex> lock(transcriptMutex_);
 
   if (!transcript_.empty()) {
@@ -202,21 +284,25 @@ void MeetingAssistant::AppendTranscript(const std::string &text) {
 // -----------------------------------------------------------------------------
 
 void MeetingAssistant::AskQuestion(const std::string &question) {
-  std::lock_guard<std::mutex> lock(queryMutex_);
-  queryQueue_.push({AIQuery::QUESTION, question});
-  queryCV_.notify_one();
+  QueueQuery({AIQuery::QUESTION, question});
 }
 
 void MeetingAssistant::GenerateSummary() {
-  std::lock_guard<std::mutex> lock(queryMutex_);
-  queryQueue_.push({AIQuery::SUMMARY, ""});
-  queryCV_.notify_one();
+  QueueQuery({AIQuery::SUMMARY, ""});
 }
 
 void MeetingAssistant::ExtractActionItems() {
-  std::lock_guard<std::mutex> lock(queryMutex_);
-  queryQueue_.push({AIQuery::ACTION_ITEMS, ""});
-  queryCV_.notify_one();
+  QueueQuery({AIQuery::ACTION_ITEMS, ""});
+}
+
+void MeetingAssistant::CancelResponse() {
+  std::shared_ptr<CancellationToken> responseCancel;
+  {
+    std::lock_guard<std::mutex> lock(queryMutex_);
+    responseCancel = responseCancel_;
+  }
+  if (responseCancel)
+    responseCancel->Cancel();
 }
 
 // -----------------------------------------------------------------------------
@@ -237,14 +323,11 @@ void MeetingAssistant::StopSpeaking() {
 
 void MeetingAssistant::OnAudioData(const AudioBuffer &buffer,
                                    const AudioFormat &format) {
-  std::lock_guard<std::mutex> lock(audioMutex_);
-
-  // Store format info
-  audioFormat_ = format;
-
-  // Append audio data
-  audioBuffer_.insert(audioBuffer_.end(), buffer.data.begin(),
-                      buffer.data.end());
+  // Downmix, resample and convert this packet to 16kHz, then let the
+  // segmenter decide whether it closes an utterance (wakes the worker)
+  packetPcm_.clear();
+  audioPreprocessor_.Convert(buffer, format, packetPcm_);
+  segmenter_->Push(packetPcm_.data(), packetPcm_.size());
 }
 
 void MeetingAssistant::OnCaptureError(HRESULT hr, const wchar_t *context) {
@@ -260,85 +343,6 @@ void MeetingAssistant::OnCaptureError(HRESULT hr, const wchar_t *context) {
   EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "", errorMsg);
 }
 
-// -----------------------------------------------------------------------------
-// Audio Resampling: Convert to 16kHz mono 16-bit (Whisper's optimal format)
-// -----------------------------------------------------------------------------
-
-static std::vector<BYTE>
-ResampleTo16kMono16bit(const std::vector<BYTE> &audioData,
-                       const AudioFormat &format) {
-
-  size_t srcBytesPerSample = format.bitsPerSample / 8;
-  size_t srcFrameSize = srcBytesPerSample * format.channels;
-  size_t numSrcFrames = audioData.size() / srcFrameSize;
-
-  if (numSrcFrames == 0)
-    return {};
-
-  // Step 1: Convert to mono float samples
-  std::vector<float> monoSamples(numSrcFrames);
-
-  for (size_t i = 0; i < numSrcFrames; i++) {
-    float sum = 0.0f;
-    const BYTE *frame = audioData.data() + i * srcFrameSize;
-
-    for (UINT16 ch = 0; ch < format.channels; ch++) {
-      const BYTE *sample = frame + ch * srcBytesPerSample;
-      float value = 0.0f;
-
-      if (format.bitsPerSample == 32) {
-        // Float32 (WASAPI default)
-        value = *reinterpret_cast<const float *>(sample);
-      } else if (format.bitsPerSample == 16) {
-        // Int16
-        value = *reinterpret_cast<const INT16 *>(sample) / 32768.0f;
-      } else if (format.bitsPerSample == 24) {
-        // Int24
-        int32_t val = (sample[0]) | (sample[1] << 8) | (sample[2] << 16);
-        if (val & 0x800000)
-          val |= 0xFF000000; // sign extend
-        value = val / 8388608.0f;
-      }
-      sum += value;
-    }
-    monoSamples[i] = sum / format.channels;
-  }
-
-  // Step 2: Resample from source rate to 16000 Hz
-  const UINT32 targetRate = 16000;
-  double ratio = (double)targetRate / format.sampleRate;
-  size_t numDstFrames = (size_t)(numSrcFrames * ratio);
-
-  std::vector<INT16> resampled(numDstFrames);
-
-  for (size_t i = 0; i < numDstFrames; i++) {
-    double srcIdx = i / ratio;
-    size_t idx0 = (size_t)srcIdx;
-    size_t idx1 = idx0 + 1;
-    double frac = srcIdx - idx0;
-
-    if (idx1 >= numSrcFrames)
-      idx1 = numSrcFrames - 1;
-
-    // Linear interpolation
-    float value =
-        (float)(monoSamples[idx0] * (1.0 - frac) + monoSamples[idx1] * frac);
-
-    // Clamp and convert to int16
-    if (value > 1.0f)
-      value = 1.0f;
-    if (value < -1.0f)
-      value = -1.0f;
-    resampled[i] = (INT16)(value * 32767.0f);
-  }
-
-  // Step 3: Convert to byte vector
-  std::vector<BYTE> result(numDstFrames * 2);
-  memcpy(result.data(), resampled.data(), result.size());
-
-  return result;
-}
-
 // -----------------------------------------------------------------------------
 // Transcription Worker Thread
 // -----------------------------------------------------------------------------
@@ -346,181 +350,268 @@ ResampleTo16kMono16bit(const std::vector<BYTE> &audioData,
 void MeetingAssistant::TranscriptionWorker() {
   OutputDebugStringW(L"[MeetingAssistant] Transcription worker started\n");
 
-  while (!shouldStop_) {
-    // Sleep for transcription interval
-    auto sleepDuration = std::chrono::milliseconds(
-        (int)(config_.transcriptionIntervalSec * 1000));
-    std::this_thread::sleep_for(sleepDuration);
+  const UINT32 rate = segmenter_->GetSampleRate();
 
-    if (shouldStop_)
+  while (true) {
+    // Woken as soon as the segmenter closes an utterance at a pause. After
+    // Stop() the queued chunks are still handed out, then this returns
+    // false; Shutdown() sets shouldStop_ to abandon them instead.
+    AudioChunk chunk;
+    if (!segmenter_->WaitForChunk(chunk) || shouldStop_)
       break;
 
-    // Get accumulated audio data
-    std::vector<BYTE> audioData;
-    AudioFormat format;
-    {
-      std::lock_guard<std::mutex> lock(audioMutex_);
-      if (audioBuffer_.empty())
-        continue;
-
-      audioData = std::move(audioBuffer_);
-      audioBuffer_.clear();
-      format = audioFormat_;
-    }
-
-    // Skip if too little audio
-    size_t bytesPerSecond = format.avgBytesPerSec;
-    size_t minBytes = (size_t)(bytesPerSecond * config_.minAudioLengthSec);
-    if (bytesPerSecond > 0 && audioData.size() < minBytes) {
-      // Put data back for next iteration
-      std::lock_guard<std::mutex> lock(audioMutex_);
-      audioBuffer_.insert(audioBuffer_.begin(), audioData.begin(),
-                          audioData.end());
+    // Skip chunks with too little speech (silence makes Whisper invent text)
+    OutputDebugStringA(
+        ("[VAD] chunk " + std::to_string(chunk.sequence) + ": " +
+         std::to_string(chunk.samples.size() * 1000 / rate) + " ms, speech " +
+         std::to_string(chunk.speechSamples * 1000 / rate) + " ms" +
+         (chunk.forced ? " (forced cut)\n" : "\n"))
+            .c_str());
+    if (config_.enableVad &&
+        chunk.speechSamples < (size_t)(config_.minSpeechSec * rate))
       continue;
-    }
 
-    // Resample to 16kHz mono 16-bit for optimal Whisper performance
-    std::vector<BYTE> resampledData = ResampleTo16kMono16bit(audioData, format);
+    // Blocks while the upload window is full; meanwhile the segmenter's
+    // bounded queue absorbs (and if need be drops) new chunks
+    if (!transcriptionPipeline_->Submit(std::move(chunk)))
+      break;
+  }
 
-    if (resampledData.empty()) {
-      OutputDebugStringW(L"[MeetingAssistant] Resampling failed, skipping\n");
-      continue;
-    }
+  OutputDebugStringW(L"[MeetingAssistant] Transcription worker stopped\n");
+}
 
-    // Transcribe using resampled 16kHz mono 16-bit audio
-    std::string text = aiService_.Transcribe(resampledData, 16000, 1, 16);
+void MeetingAssistant::TranscribeChunk(
+    AudioChunk &&chunk, TranscriptionPipeline::TranscribeDone done) {
+  // Already 16kHz mono 16-bit (converted per packet as captured)
+  std::vector<BYTE> pcmData(chunk.samples.size() * sizeof(INT16));
+  memcpy(pcmData.data(), chunk.samples.data(), pcmData.size());
+
+  aiService_.TranscribeAsync(
+      std::move(pcmData), segmenter_->GetSampleRate(), 1, 16,
+      [done = std::move(done)](const std::string &text, const std::string &) {
+        done(text);
+      });
+}
 
-    if (!text.empty()) {
-      AppendTranscript(text);
-      EmitEvent(MeetingAssistantEvent::TRANSCRIPT_UPDATE, text);
-      OutputDebugStringA(("[Transcription] " + text + "\n").c_str());
-    }
-  }
+void MeetingAssistant::OnTranscriptionResult(uint64_t sequence,
+                                             const std::string &text) {
+  // Called in chunk order, one at a time, whichever upload finished first
+  if (text.empty())
+    return;
 
-  OutputDebugStringW(L"[MeetingAssistant] Transcription worker stopped\n");
+  AppendTranscript(text);
+  EmitEvent(MeetingAssistantEvent::TRANSCRIPT_UPDATE, text);
+  OutputDebugStringA(("[Transcription] #" + std::to_string(sequence) + " " +
+                      text + "\n")
+                         .c_str());
 }
 
 // -----------------------------------------------------------------------------
-// AI Worker Thread
+// AI Query Queue
 // -----------------------------------------------------------------------------
 
-void MeetingAssistant::AIWorker() {
-  OutputDebugStringW(L"[MeetingAssistant] AI worker started\n");
-
-  while (!shouldStop_) {
-    AIQuery query;
-
-    // Wait for a query
-    {
-      std::unique_lock<std::mutex> lock(queryMutex_);
-      queryCV_.wait(lock,
-                    [this] { return shouldStop_ || !queryQueue_.empty(); });
+void MeetingAssistant::QueueQuery(AIQuery query) {
+  {
+    std::lock_guard<std::mutex> lock(queryMutex_);
+    if (queriesStopped_)
+      return;
+    queryQueue_.push(std::move(query));
+  }
+  StartNextQuery();
+}
 
-      if (shouldStop_)
-        break;
-      if (queryQueue_.empty())
-        continue;
+void MeetingAssistant::StartNextQuery() {
+  AIQuery query;
+  std::shared_ptr<CancellationToken> cancel;
+  std::vector<std::pair<std::string, std::string>> history;
+  {
+    std::lock_guard<std::mutex> lock(queryMutex_);
+    if (queryActive_ || queriesStopped_ || queryQueue_.empty())
+      return;
+    query = std::move(queryQueue_.front());
+    queryQueue_.pop();
+    queryActive_ = true;
+
+    if (query.type == AIQuery::QUESTION) {
+      responseCancel_ = std::make_shared<CancellationToken>();
+      cancel = responseCancel_;
+      history = conversationHistory_;
+    }
+  }
 
-      query = queryQueue_.front();
-      queryQueue_.pop();
+  // Get current transcript
+  std::string transcript = GetTranscript();
+
+  switch (query.type) {
+  case AIQuery::QUESTION: {
+    // Build messages with conversation memory
+    std::vector<ChatMessage> messages;
+
+    // System prompt
+    messages.push_back({"system",
+                        "You are an expert interview and meeting assistant. "
+                        "Provide DIRECT ANSWERS to questions. Do NOT "
+                        "summarize unless asked. "
+                        "If there's a coding question, provide the solution. "
+                        "Be concise and accurate."});
+
+    // What was said before the transcript below was trimmed
+    std::string summary =
+        rollingSummary_ ? rollingSummary_->GetSummary() : std::string();
+    if (!summary.empty()) {
+      messages.push_back(
+          {"system", "Summary of the meeting so far:\n" + summary});
     }
 
-    // Get current transcript
-    std::string transcript = GetTranscript();
-
-    std::string response;
-    MeetingAssistantEvent::Type eventType;
-
-    switch (query.type) {
-    case AIQuery::QUESTION: {
-      // Build messages with conversation memory
-      std::vector<ChatMessage> messages;
-
-      // System prompt
-      messages.push_back({"system",
-                          "You are an expert interview and meeting assistant. "
-                          "Provide DIRECT ANSWERS to questions. Do NOT "
-                          "summarize unless asked. "
-                          "If there's a coding question, provide the solution. "
-                          "Be concise and accurate."});
-
-      // Transcript context
-      if (!transcript.empty()) {
-        messages.push_back(
-            {"system", "Current meeting/interview transcript:\n" + transcript});
-      }
+    // Transcript context
+    if (!transcript.empty()) {
+      messages.push_back(
+          {"system", "Current meeting/interview transcript:\n" + transcript});
+    }
 
-      // Previous conversation history (for follow-up context)
-      for (const auto &exchange : conversationHistory_) {
-        messages.push_back({"user", exchange.first});
-        messages.push_back({"assistant", exchange.second});
-      }
+    // Previous conversation history (for follow-up context)
+    for (const auto &exchange : history) {
+      messages.push_back({"user", exchange.first});
+      messages.push_back({"assistant", exchange.second});
+    }
 
-      // Current question
-      messages.push_back({"user", query.question});
+    // Current question
+    messages.push_back({"user", query.question});
+
+    // Stream the answer so the first words show within a few hundred ms;
+    // CancelResponse() stops the stream through the token
+    aiService_.ChatStreamAsync(
+        messages,
+        [this, cancel](const std::string &, const std::string &content) {
+          if (cancel->IsCancelled())
+            return false;
+          EmitEvent(MeetingAssistantEvent::AI_RESPONSE, content, "", true);
+          return true;
+        },
+        [this, query, cancel](const std::string &response,
+                              const std::string &error) {
+          OnQueryDone(query, response, error, cancel->IsCancelled());
+        },
+        cancel);
+    break;
+  }
 
-      response = aiService_.Chat(messages);
-      eventType = MeetingAssistantEvent::AI_RESPONSE;
+  // The running summary and the tail not yet folded into it, not the
+  // whole transcript
+  case AIQuery::SUMMARY:
+    aiService_.SummarizeAsync(
+        rollingSummary_ ? rollingSummary_->BuildContext() : transcript,
+        [this, query](const std::string &response, const std::string &error) {
+          OnQueryDone(query, response, error, false);
+        });
+    break;
+
+  case AIQuery::ACTION_ITEMS:
+    aiService_.ExtractActionItemsAsync(
+        rollingSummary_ ? rollingSummary_->BuildContext() : transcript,
+        [this, query](const std::string &response, const std::string &error) {
+          OnQueryDone(query, response, error, false);
+        });
+    break;
+  }
+}
 
-      // Store in conversation history
-      if (!response.empty()) {
-        conversationHistory_.push_back({query.question, response});
-        // Trim to max history
-        while ((int)conversationHistory_.size() > MAX_CONVERSATION_HISTORY) {
-          conversationHistory_.erase(conversationHistory_.begin());
-        }
+void MeetingAssistant::OnQueryDone(const AIQuery &query,
+                                   const std::string &response,
+                                   const std::string &error, bool cancelled) {
+  bool stopped;
+  {
+    std::lock_guard<std::mutex> lock(queryMutex_);
+    stopped = queriesStopped_;
+    queryActive_ = false;
+    responseCancel_.reset();
+
+    // Remember answered questions (not cancelled ones) for follow-ups
+    if (query.type == AIQuery::QUESTION && !cancelled && !response.empty()) {
+      conversationHistory_.push_back({query.question, response});
+      // Trim to max history
+      while ((int)conversationHistory_.size() > MAX_CONVERSATION_HISTORY) {
+        conversationHistory_.erase(conversationHistory_.begin());
       }
-      break;
-    }
-
-    case AIQuery::SUMMARY:
-      response = aiService_.Summarize(transcript);
-      eventType = MeetingAssistantEvent::SUMMARY_READY;
-      break;
-
-    case AIQuery::ACTION_ITEMS:
-      response = aiService_.ExtractActionItems(transcript);
-      eventType = MeetingAssistantEvent::ACTION_ITEMS_READY;
-      break;
     }
+  }
 
-    if (!response.empty()) {
+  MeetingAssistantEvent::Type eventType = MeetingAssistantEvent::AI_RESPONSE;
+  if (query.type == AIQuery::SUMMARY)
+    eventType = MeetingAssistantEvent::SUMMARY_READY;
+  else if (query.type == AIQuery::ACTION_ITEMS)
+    eventType = MeetingAssistantEvent::ACTION_ITEMS_READY;
+
+  if (stopped) {
+    // Shutting down: nothing is shown or spoken
+  } else if (cancelled) {
+    // Cancelled: keep what was shown, but don't remember or speak it
+    if (!response.empty())
       EmitEvent(eventType, response);
+  } else if (!response.empty()) {
+    EmitEvent(eventType, response);
 
-      // Speak response if TTS enabled
-      if (ttsEnabled_ && tts_.IsInitialized()) {
-        tts_.Speak(response);
-      }
-    } else {
-      EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
-                "Failed to get AI response: " + aiService_.GetLastError());
+    // Speak response if TTS enabled
+    if (ttsEnabled_ && tts_.IsInitialized()) {
+      tts_.Speak(response);
     }
+  } else {
+    EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
+              "Failed to get AI response: " + error);
   }
 
-  OutputDebugStringW(L"[MeetingAssistant] AI worker stopped\n");
+  StartNextQuery();
 }
 
-void MeetingAssistant::AnalyzeImage(const std::string &base64ImageData,
-                                    const std::string &prompt) {
+void MeetingAssistant::AnalyzeImage(std::vector<BYTE> jpegData,
+                                    const std::string &prompt,
+                                    VisionAnswerFn onAnswer) {
   if (!initialized_) {
     EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
               "Meeting assistant not initialized");
     return;
   }
 
-  // Run on a background thread to avoid blocking UI
-  std::thread([this, base64ImageData, prompt]() {
-    EmitEvent(MeetingAssistantEvent::AI_RESPONSE, "Analyzing image...");
+  // Returns at once; the answer arrives on the AI service's event loop
+  EmitEvent(MeetingAssistantEvent::AI_RESPONSE, "Analyzing image...");
+  aiService_.AnalyzeImageAsync(
+      std::move(jpegData), prompt,
+      [this, onAnswer = std::move(onAnswer)](const std::string &response,
+                                             const std::string &error) {
+        if (!response.empty()) {
+          if (onAnswer)
+            onAnswer(response);
+          EmitEvent(MeetingAssistantEvent::AI_RESPONSE, response);
+        } else {
+          EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
+                    "Vision analysis failed: " + error);
+        }
+      });
+}
 
-    std::string response = aiService_.AnalyzeImage(base64ImageData, prompt);
+void MeetingAssistant::AnalyzeScreenText(const std::string &screenText,
+                                         const std::string &prompt,
+                                         VisionAnswerFn onAnswer) {
+  if (!initialized_) {
+    EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
+              "Meeting assistant not initialized");
+    return;
+  }
 
-    if (!response.empty()) {
-      EmitEvent(MeetingAssistantEvent::AI_RESPONSE, response);
-    } else {
-      EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
-                "Vision analysis failed: " + aiService_.GetLastError());
-    }
-  }).detach();
+  EmitEvent(MeetingAssistantEvent::AI_RESPONSE, "Analyzing screen text...");
+  aiService_.AnalyzeScreenTextAsync(
+      screenText, prompt,
+      [this, onAnswer = std::move(onAnswer)](const std::string &response,
+                                             const std::string &error) {
+        if (!response.empty()) {
+          if (onAnswer)
+            onAnswer(response);
+          EmitEvent(MeetingAssistantEvent::AI_RESPONSE, response);
+        } else {
+          EmitEvent(MeetingAssistantEvent::EVENT_ERROR, "",
+                    "Screen text analysis failed: " + error);
+        }
+      });
 }
 
 } // namespace invisible
@@ -2,11 +2,16 @@
 
 #include "ai_service.h"
 #include "audio_capture.h"
+#include "audio_preprocessor.h"
+#include "rolling_summary.h"
 #include "text_to_speech.h"
+#include "transcription_pipeline.h"
 #include "utils.h"
+#include "utterance_segmenter.h"
 #include <atomic>
-#include <condition_variable>
+#include <filesystem>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <string>
@@ -30,11 +35,24 @@ struct MeetingAssistantConfig {
   std::string gptModel = "gpt-4o-mini";
   std::string whisperModel = "whisper-1";
 
-  // Transcription settings
-  float transcriptionIntervalSec =
-      15.0f; // Longer chunks = much better Whisper accuracy
+  // Transcription settings. Chunks close at the first pause once they hold
+  // minAudioLengthSec of audio, or are cut at transcriptionIntervalSec.
+  float transcriptionIntervalSec = 15.0f; // Longest chunk (forced cut)
   int maxTranscriptLength = 10000; // Max chars to keep in rolling transcript
-  float minAudioLengthSec = 3.0f;  // Minimum audio before transcribing
+  float minAudioLengthSec = 1.0f;  // Shortest chunk a pause may close
+  float pauseSec = 0.6f;           // Silence that ends an utterance
+  float chunkOverlapSec = 0.3f;    // Repeated across a forced cut
+  int maxConcurrentTranscriptions = 3; // Uploads in flight (results in order)
+
+  // Every summarySegmentChars of new transcript are folded into a running
+  // summary in the background; summaries and action items then send that
+  // plus the recent tail instead of the transcript (0 = send the transcript)
+  int summarySegmentChars = 4000;
+
+  // Voice activity detection: only speech spans are uploaded, and chunks
+  // with less speech than this are skipped (silence makes Whisper invent text)
+  bool enableVad = true;
+  float minSpeechSec = 0.6f;
 
   // TTS settings
   bool enableTTS = false;
@@ -44,6 +62,11 @@ struct MeetingAssistantConfig {
   // Behavior
   bool enableAutoSummary = false; // Auto-summarize every N minutes
   int autoSummaryIntervalMin = 5;
+
+  // Answer a question or summary that was already asked over the same
+  // transcript from memory; the answers survive a restart if a path is set
+  bool cacheResponses = true;
+  std::filesystem::path responseCachePath;
 };
 
 // -----------------------------------------------------------------------------
@@ -62,6 +85,7 @@ struct MeetingAssistantEvent {
   Type type;
   std::string text;
   std::string error;
+  bool partial = false; // AI_RESPONSE still streaming; text is the answer so far
 };
 
 using MeetingAssistantCallback =
@@ -69,6 +93,10 @@ using MeetingAssistantCallback =
 
 // -----------------------------------------------------------------------------
 // Meeting Assistant
+// Transcription uploads, AI queries and image analyses all run as
+// asynchronous calls on the AI service's HTTP event loop, so the threads
+// are the capture thread, one transcription worker feeding the upload
+// pipeline, and the loop's fixed pool, however many calls are in flight.
 // -----------------------------------------------------------------------------
 
 class MeetingAssistant : public IAudioCaptureHandler {
@@ -92,7 +120,8 @@ public:
   // Start listening to meeting audio
   bool StartListening();
 
-  // Stop listening
+  // Stop listening. The utterance in progress and any queued chunks are
+  // still transcribed; returns once their results have been delivered.
   void StopListening();
 
   // Check if listening
@@ -110,6 +139,9 @@ public:
   // Extract action items
   void ExtractActionItems();
 
+  // Stop the answer that is currently streaming (what arrived stays shown)
+  void CancelResponse();
+
   // Get current transcript
   std::string GetTranscript() const;
 
@@ -123,9 +155,17 @@ public:
   // Stop current TTS
   void StopSpeaking();
 
-  // Vision - analyze screen capture with AI
-  void AnalyzeImage(const std::string &base64ImageData,
-                    const std::string &prompt = "");
+  // Vision - analyze a JPEG-encoded screen capture with AI. `onAnswer`
+  // also gets a successful answer (on the AI service's event loop).
+  using VisionAnswerFn = std::function<void(const std::string &answer)>;
+  void AnalyzeImage(std::vector<BYTE> jpegData,
+                    const std::string &prompt = "",
+                    VisionAnswerFn onAnswer = nullptr);
+
+  // The same for a capture whose text was read on-device (sent as a chat)
+  void AnalyzeScreenText(const std::string &screenText,
+                         const std::string &prompt = "",
+                         VisionAnswerFn onAnswer = nullptr);
 
   // IAudioCaptureHandler implementation
   void OnAudioData(const AudioBuffer &buffer,
@@ -136,15 +176,26 @@ private:
   // Background processing thread
   void ProcessingThreadProc();
 
-  // Transcription worker
+  // Transcription worker (feeds the upload pipeline)
   void TranscriptionWorker();
 
-  // AI query worker
-  void AIWorker();
+  // Pipeline callbacks: start uploading one chunk, and publish its text in
+  // order
+  void TranscribeChunk(AudioChunk &&chunk,
+                       TranscriptionPipeline::TranscribeDone done);
+  void OnTranscriptionResult(uint64_t sequence, const std::string &text);
+
+  // AI queries run one at a time, in the order asked: each completion
+  // starts the next queued query
+  struct AIQuery;
+  void QueueQuery(AIQuery query);
+  void StartNextQuery();
+  void OnQueryDone(const AIQuery &query, const std::string &response,
+                   const std::string &error, bool cancelled);
 
   // Emit event to callback
   void EmitEvent(MeetingAssistantEvent::Type type, const std::string &text = "",
-                 const std::string &error = "");
+                 const std::string &error = "", bool partial = false);
 
   // Append to transcript with length limit
   void AppendTranscript(const std::string &text);
@@ -163,16 +214,23 @@ private:
   std::atomic<bool> ttsEnabled_{true};
   std::atomic<bool> shouldStop_{false};
 
-  // Audio buffer for transcription
-  std::vector<BYTE> audioBuffer_;
-  AudioFormat audioFormat_;
-  std::mutex audioMutex_;
+  // Captured audio, converted per packet to 16kHz mono 16-bit and split
+  // into utterances (capture thread produces, transcription worker consumes)
+  AudioPreprocessor audioPreprocessor_;
+  std::unique_ptr<UtteranceSegmenter> segmenter_;
+  std::vector<INT16> packetPcm_;
   UINT64 lastTranscriptionTime_ = 0;
 
+  // Concurrent Whisper uploads, delivered in chunk order
+  std::unique_ptr<TranscriptionPipeline> transcriptionPipeline_;
+
   // Transcript
   std::string transcript_;
   mutable std::mutex transcriptMutex_;
 
+  // Running summary of everything transcribed (null if disabled)
+  std::unique_ptr<RollingSummary> rollingSummary_;
+
   // AI query queue
   struct AIQuery {
     enum Type { QUESTION, SUMMARY, ACTION_ITEMS };
@@ -181,16 +239,17 @@ private:
   };
   std::queue<AIQuery> queryQueue_;
   std::mutex queryMutex_;
-  std::condition_variable queryCV_;
+  bool queryActive_ = false;   // A query's call is in flight
+  bool queriesStopped_ = false; // Shutting down: start no more
+  std::shared_ptr<CancellationToken> responseCancel_; // Streaming answer
 
   // Conversation memory (last N Q&A pairs for follow-up context)
   std::vector<std::pair<std::string, std::string>>
       conversationHistory_; // {question, answer}
   static constexpr int MAX_CONVERSATION_HISTORY = 10;
 
-  // Worker threads
+  // Worker thread
   std::thread transcriptionThread_;
-  std::thread aiThread_;
 
   // Event callback
   MeetingAssistantCallback eventCallback_;
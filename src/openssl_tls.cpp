@@ -0,0 +1,136 @@
+#include "openssl_tls.h"
+#include <csignal>
+#include <ctime>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+
+namespace invisible {
+
+namespace {
+
+// OpenSSL writes to the socket with write(), which raises SIGPIPE when the
+// peer has gone. Block it for the call and swallow one raised meanwhile,
+// rather than changing the process-wide disposition.
+class ScopedSigpipeBlock {
+public:
+  ScopedSigpipeBlock() {
+    sigemptyset(&pipe_);
+    sigaddset(&pipe_, SIGPIPE);
+    sigset_t pending;
+    sigpending(&pending);
+    wasPending_ = sigismember(&pending, SIGPIPE) == 1;
+    pthread_sigmask(SIG_BLOCK, &pipe_, &previous_);
+  }
+
+  ~ScopedSigpipeBlock() {
+    if (!wasPending_) {
+      timespec zero = {0, 0};
+      sigtimedwait(&pipe_, nullptr, &zero);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous_, nullptr);
+  }
+
+private:
+  sigset_t pipe_;
+  sigset_t previous_;
+  bool wasPending_ = false;
+};
+
+class OpenSslSession : public TlsSession {
+public:
+  explicit OpenSslSession(SSL *ssl) : ssl_(ssl) {}
+  ~OpenSslSession() override { SSL_free(ssl_); }
+
+  long Read(void *buffer, size_t size) override {
+    size_t bytes = 0;
+    if (SSL_read_ex(ssl_, buffer, size, &bytes) == 1)
+      return static_cast<long>(bytes);
+    return SSL_get_error(ssl_, 0) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+  }
+
+  long Write(const void *data, size_t size) override {
+    ScopedSigpipeBlock block;
+    size_t bytes = 0;
+    if (SSL_write_ex(ssl_, data, size, &bytes) == 1)
+      return static_cast<long>(bytes);
+    return -1;
+  }
+
+  size_t Pending() const override {
+    return static_cast<size_t>(SSL_pending(ssl_));
+  }
+
+  std::string Protocol() const override {
+    const unsigned char *protocol = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(ssl_, &protocol, &length);
+    return std::string(reinterpret_cast<const char *>(protocol), length);
+  }
+
+private:
+  SSL *ssl_;
+};
+
+class OpenSslProvider : public TlsProvider {
+public:
+  explicit OpenSslProvider(const std::string &caFile) {
+    context_ = SSL_CTX_new(TLS_client_method());
+    if (!context_)
+      return;
+    SSL_CTX_set_min_proto_version(context_, TLS1_2_VERSION);
+    SSL_CTX_set_verify(context_, SSL_VERIFY_PEER, nullptr);
+    SSL_CTX_set_mode(context_, SSL_MODE_AUTO_RETRY);
+    if (caFile.empty())
+      SSL_CTX_set_default_verify_paths(context_);
+    else
+      SSL_CTX_load_verify_locations(context_, caFile.c_str(), nullptr);
+  }
+
+  ~OpenSslProvider() override { SSL_CTX_free(context_); }
+
+  std::unique_ptr<TlsSession>
+  Connect(int socket, const std::string &host,
+          const std::vector<std::string> &protocols) override {
+    if (!context_)
+      return nullptr;
+    SSL *ssl = SSL_new(context_);
+    if (!ssl)
+      return nullptr;
+
+    // ALPN list in wire format: length-prefixed names
+    std::string alpn;
+    for (const std::string &protocol : protocols) {
+      alpn += static_cast<char>(protocol.size());
+      alpn += protocol;
+    }
+    if (!alpn.empty()) {
+      SSL_set_alpn_protos(ssl, reinterpret_cast<const unsigned char *>(
+                                   alpn.data()),
+                          static_cast<unsigned int>(alpn.size()));
+    }
+
+    SSL_set_fd(ssl, socket);
+    SSL_set_tlsext_host_name(ssl, host.c_str()); // SNI
+    SSL_set1_host(ssl, host.c_str());            // Certificate name check
+
+    ScopedSigpipeBlock block;
+    if (SSL_connect(ssl) != 1) {
+      ERR_clear_error();
+      SSL_free(ssl);
+      return nullptr;
+    }
+    return std::make_unique<OpenSslSession>(ssl);
+  }
+
+private:
+  SSL_CTX *context_ = nullptr;
+};
+
+} // namespace
+
+std::shared_ptr<TlsProvider> CreateOpenSslTlsProvider(const std::string &caFile) {
+  return std::make_shared<OpenSslProvider>(caFile);
+}
+
+} // namespace invisible
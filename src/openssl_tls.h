@@ -0,0 +1,19 @@
+#pragma once
+
+#include "socket_transport.h"
+#include <memory>
+#include <string>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// OpenSSL TLS Provider
+// Built only where CMake finds OpenSSL (INVISIBLE_HAVE_OPENSSL). Verifies the
+// server certificate against the system trust store, or against `caFile`
+// when one is given (e.g. a local test server's self-signed certificate).
+// -----------------------------------------------------------------------------
+
+std::shared_ptr<TlsProvider>
+CreateOpenSslTlsProvider(const std::string &caFile = std::string());
+
+} // namespace invisible
@@ -0,0 +1,412 @@
+#include "resampler.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace invisible {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Taps per phase are padded to a multiple of this so the SIMD kernels
+// never need a remainder loop
+constexpr size_t kTapAlignment = 8;
+
+uint32_t Gcd(uint32_t a, uint32_t b) {
+  while (b != 0) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind (power series)
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  double halfX = x / 2.0;
+  for (int k = 1; k < 64; ++k) {
+    term *= (halfX / k) * (halfX / k);
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+// -----------------------------------------------------------------------------
+// Dot-Product Kernels
+// `length` is always a multiple of kTapAlignment.
+// -----------------------------------------------------------------------------
+
+using DotFn = float (*)(const float *a, const float *b, size_t length);
+
+#if !INVISIBLE_HAVE_SSE2
+
+float DotScalar(const float *a, const float *b, size_t length) {
+  float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+  for (size_t i = 0; i < length; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+#else
+
+float DotSse(const float *a, const float *b, size_t length) {
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (size_t i = 0; i < length; i += 8) {
+    acc0 = _mm_add_ps(acc0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(
+        acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  __m128 sum = _mm_add_ps(acc0, acc1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+#endif
+
+#if INVISIBLE_HAVE_X86
+
+INVISIBLE_TARGET("avx")
+float DotAvx(const float *a, const float *b, size_t length) {
+  __m256 acc = _mm256_setzero_ps();
+  for (size_t i = 0; i < length; i += 8) {
+    acc = _mm256_add_ps(
+        acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  }
+  __m128 sum =
+      _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+#endif
+
+struct DotKernel {
+  DotFn dot;
+  const char *name;
+};
+
+const DotKernel &SelectKernel() {
+  static const DotKernel kernel = []() -> DotKernel {
+#if INVISIBLE_HAVE_X86
+    if (simd::GetCpuFeatures().avx) {
+      return {DotAvx, "avx"};
+    }
+#endif
+#if INVISIBLE_HAVE_SSE2
+    return {DotSse, "sse"};
+#else
+    return {DotScalar, "scalar"};
+#endif
+  }();
+  return kernel;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Filter Bank
+// -----------------------------------------------------------------------------
+
+struct Resampler::FilterBank {
+  uint32_t up = 1;     // L
+  uint32_t down = 1;   // M
+  size_t taps = 0;     // Per phase, padded to kTapAlignment
+  double delay = 0.0;  // Group delay in input samples
+
+  // `up` rows of `taps` coefficients, each reversed in time so row p is
+  // dotted against the input window oldest-first
+  std::vector<float> coeffs;
+};
+
+std::shared_ptr<const Resampler::FilterBank>
+Resampler::AcquireBank(uint32_t up, uint32_t down,
+                       const ResamplerConfig &config) {
+  using Key = std::tuple<uint32_t, uint32_t, int, float, float>;
+  static std::mutex cacheMutex;
+  static std::map<Key, std::shared_ptr<const FilterBank>> cache;
+
+  Key key(up, down, config.zeroCrossings, config.passbandFraction,
+          config.kaiserBeta);
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+
+  auto bank = std::make_shared<FilterBank>();
+  bank->up = up;
+  bank->down = down;
+
+  // The prototype runs at the upsampled rate (input * L). Its cutoff sits
+  // below the lower of the two Nyquist frequencies, and its length spans
+  // 2 * zeroCrossings periods of that cutoff.
+  double decimation = std::max(1.0, static_cast<double>(down) / up);
+  size_t activeTaps = static_cast<size_t>(
+      std::ceil(2.0 * config.zeroCrossings * decimation));
+  size_t taps = (activeTaps + kTapAlignment - 1) / kTapAlignment * kTapAlignment;
+  size_t length = activeTaps * up;
+  double cutoff = config.passbandFraction * 0.5 / std::max(up, down);
+  double center = (length - 1) / 2.0;
+  double norm = BesselI0(config.kaiserBeta);
+
+  std::vector<double> prototype(length);
+  for (size_t i = 0; i < length; ++i) {
+    double t = i - center;
+    double x = 2.0 * cutoff * t;
+    double sinc = (t == 0.0) ? 1.0 : std::sin(kPi * x) / (kPi * x);
+    double r = (center > 0.0) ? t / center : 0.0;
+    double window =
+        BesselI0(config.kaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) /
+        norm;
+    prototype[i] = 2.0 * cutoff * sinc * window;
+  }
+
+  bank->taps = taps;
+  bank->delay = center / up;
+  bank->coeffs.assign(up * taps, 0.0f);
+
+  for (uint32_t p = 0; p < up; ++p) {
+    // Normalize each phase to unity DC gain so constant input stays constant
+    double sum = 0.0;
+    for (size_t k = 0; k < activeTaps; ++k) {
+      sum += prototype[p + k * up];
+    }
+    double scale = (sum != 0.0) ? 1.0 / sum : 0.0;
+
+    float *row = &bank->coeffs[p * taps];
+    for (size_t k = 0; k < activeTaps; ++k) {
+      row[taps - 1 - k] = static_cast<float>(prototype[p + k * up] * scale);
+    }
+  }
+
+  cache.emplace(key, bank);
+  return bank;
+}
+
+// -----------------------------------------------------------------------------
+// Constructor / Destructor
+// -----------------------------------------------------------------------------
+
+Resampler::Resampler() = default;
+
+Resampler::~Resampler() = default;
+
+// -----------------------------------------------------------------------------
+// Initialize / Reset
+// -----------------------------------------------------------------------------
+
+bool Resampler::Initialize(uint32_t inputRate, uint32_t outputRate,
+                           const ResamplerConfig &config) {
+  if (inputRate == 0 || outputRate == 0 || config.zeroCrossings <= 0 ||
+      config.passbandFraction <= 0.0f || config.passbandFraction > 1.0f) {
+    return false;
+  }
+
+  uint32_t g = Gcd(inputRate, outputRate);
+  uint32_t up = outputRate / g;
+  uint32_t down = inputRate / g;
+
+  // Reject ratios whose phase table would be unreasonably large
+  // (e.g. 44100 -> 16001); every rate WASAPI reports reduces far below this
+  if (up > 1024) {
+    return false;
+  }
+
+  bank_ = AcquireBank(up, down, config);
+  inputRate_ = inputRate;
+  outputRate_ = outputRate;
+  Reset();
+  return true;
+}
+
+void Resampler::Reset() {
+  if (!bank_) {
+    return;
+  }
+  history_.assign(bank_->taps - 1, 0.0f);
+  position_ = bank_->taps - 1;
+  phase_ = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Processing
+// -----------------------------------------------------------------------------
+
+size_t Resampler::Process(const float *input, size_t count,
+                          std::vector<float> &output) {
+  if (!bank_) {
+    return 0;
+  }
+
+  const FilterBank &bank = *bank_;
+  const size_t window = bank.taps - 1;
+  history_.insert(history_.end(), input, input + count);
+
+  size_t offset = output.size();
+  output.resize(offset + GetMaxOutput(count));
+  float *dst = output.data() + offset;
+  size_t produced = 0;
+
+  DotFn dot = SelectKernel().dot;
+  const float *coeffs = bank.coeffs.data();
+  const float *samples = history_.data();
+
+  while (position_ < history_.size()) {
+    dst[produced++] =
+        dot(coeffs + phase_ * bank.taps, samples + position_ - window, bank.taps);
+    phase_ += bank.down;
+    position_ += phase_ / bank.up;
+    phase_ %= bank.up;
+  }
+  output.resize(offset + produced);
+
+  // Keep only the window the next output still needs
+  size_t consumed = std::min(position_ - window, history_.size());
+  history_.erase(history_.begin(), history_.begin() + consumed);
+  position_ -= consumed;
+
+  return produced;
+}
+
+size_t Resampler::Flush(std::vector<float> &output) {
+  if (!bank_) {
+    return 0;
+  }
+  std::vector<float> silence(static_cast<size_t>(std::ceil(bank_->delay)) + 1,
+                             0.0f);
+  size_t produced = Process(silence.data(), silence.size(), output);
+  Reset();
+  return produced;
+}
+
+size_t Resampler::GetMaxOutput(size_t count) const {
+  if (!bank_) {
+    return 0;
+  }
+  // Outputs still pending from previous calls plus those the new input adds
+  size_t pending = history_.size() > position_ ? history_.size() - position_ : 0;
+  return ((pending + count) * bank_->up) / bank_->down + 1;
+}
+
+double Resampler::GetDelay() const { return bank_ ? bank_->delay : 0.0; }
+
+const char *Resampler::GetKernelName() { return SelectKernel().name; }
+
+// -----------------------------------------------------------------------------
+// Sample Conversion
+// -----------------------------------------------------------------------------
+
+size_t DownmixToMono(const uint8_t *data, size_t bytes, int channels,
+                     int bitsPerSample, bool isFloat, float *out) {
+  if (channels <= 0 || (bitsPerSample != 16 && bitsPerSample != 24 &&
+                        bitsPerSample != 32) ||
+      (isFloat && bitsPerSample != 32)) {
+    return 0;
+  }
+
+  const size_t sampleSize = bitsPerSample / 8;
+  const size_t frameSize = sampleSize * channels;
+  const size_t frames = bytes / frameSize;
+  const float scale = 1.0f / channels;
+  size_t i = 0;
+
+  if (isFloat) {
+    // Float32 (WASAPI shared-mode default)
+    const float *src = reinterpret_cast<const float *>(data);
+#if INVISIBLE_HAVE_SSE2
+    if (channels == 2) {
+      const __m128 half = _mm_set1_ps(0.5f);
+      for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(src + i * 2);
+        __m128 b = _mm_loadu_ps(src + i * 2 + 4);
+        __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+      }
+    }
+#endif
+    for (; i < frames; ++i) {
+      float sum = 0.0f;
+      for (int ch = 0; ch < channels; ++ch) {
+        sum += src[i * channels + ch];
+      }
+      out[i] = sum * scale;
+    }
+  } else if (bitsPerSample == 32) {
+    const int32_t *src = reinterpret_cast<const int32_t *>(data);
+    for (; i < frames; ++i) {
+      double sum = 0.0;
+      for (int ch = 0; ch < channels; ++ch) {
+        sum += src[i * channels + ch];
+      }
+      out[i] = static_cast<float>(sum * (scale / 2147483648.0));
+    }
+  } else if (bitsPerSample == 16) {
+    const int16_t *src = reinterpret_cast<const int16_t *>(data);
+    for (; i < frames; ++i) {
+      int32_t sum = 0;
+      for (int ch = 0; ch < channels; ++ch) {
+        sum += src[i * channels + ch];
+      }
+      out[i] = sum * (scale / 32768.0f);
+    }
+  } else {
+    for (; i < frames; ++i) {
+      const uint8_t *frame = data + i * frameSize;
+      int32_t sum = 0;
+      for (int ch = 0; ch < channels; ++ch) {
+        const uint8_t *s = frame + ch * 3;
+        // Assemble in the top 24 bits, then arithmetic-shift to sign extend
+        int32_t v = static_cast<int32_t>((static_cast<uint32_t>(s[0]) << 8) |
+                                         (static_cast<uint32_t>(s[1]) << 16) |
+                                         (static_cast<uint32_t>(s[2]) << 24));
+        sum += v >> 8;
+      }
+      out[i] = sum * (scale / 8388608.0f);
+    }
+  }
+
+  return frames;
+}
+
+void ConvertFloatToInt16(const float *input, size_t count, int16_t *out) {
+  size_t i = 0;
+#if INVISIBLE_HAVE_SSE2
+  // Clamp before converting: out-of-range floats would become INT_MIN
+  const __m128 scale = _mm_set1_ps(32767.0f);
+  const __m128 lo = _mm_set1_ps(-32768.0f);
+  const __m128 hi = _mm_set1_ps(32767.0f);
+  for (; i + 8 <= count; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(input + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale);
+    a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+    b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), packed);
+  }
+#endif
+  for (; i < count; ++i) {
+    float v = std::min(std::max(input[i] * 32767.0f, -32768.0f), 32767.0f);
+    out[i] = static_cast<int16_t>(std::lrint(v));
+  }
+}
+
+} // namespace invisible
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Resampler Configuration
+// -----------------------------------------------------------------------------
+
+struct ResamplerConfig {
+  int zeroCrossings = 24;         // Filter half-length, in output-rate periods
+  float passbandFraction = 0.9f;  // Cutoff as a fraction of the lower Nyquist
+  float kaiserBeta = 8.6f;        // ~85 dB stopband attenuation
+};
+
+// -----------------------------------------------------------------------------
+// Polyphase Resampler
+// Rational L/M conversion of mono float audio with a Kaiser-windowed sinc
+// low-pass. Filter banks are built once per (rate pair, config) and shared
+// between instances; history carries across Process() calls so a stream can
+// be fed one capture packet at a time without seams.
+// -----------------------------------------------------------------------------
+
+class Resampler {
+public:
+  Resampler();
+  ~Resampler();
+
+  // Disable copy
+  Resampler(const Resampler &) = delete;
+  Resampler &operator=(const Resampler &) = delete;
+
+  // Select rates and build (or reuse) the filter bank. Resets stream state.
+  bool Initialize(uint32_t inputRate, uint32_t outputRate,
+                  const ResamplerConfig &config = ResamplerConfig());
+
+  // Drop history so the next call starts a fresh stream
+  void Reset();
+
+  // Resample `count` input samples and append the result to `output`.
+  // Returns the number of samples appended.
+  size_t Process(const float *input, size_t count, std::vector<float> &output);
+
+  // Push enough silence to drain the filter's group delay
+  size_t Flush(std::vector<float> &output);
+
+  // Upper bound on samples produced by Process() for `count` input samples
+  size_t GetMaxOutput(size_t count) const;
+
+  bool IsInitialized() const { return bank_ != nullptr; }
+  uint32_t GetInputRate() const { return inputRate_; }
+  uint32_t GetOutputRate() const { return outputRate_; }
+
+  // Filter group delay in input samples
+  double GetDelay() const;
+
+  // Name of the dot-product kernel selected for this CPU
+  static const char *GetKernelName();
+
+private:
+  struct FilterBank;
+
+  static std::shared_ptr<const FilterBank>
+  AcquireBank(uint32_t up, uint32_t down, const ResamplerConfig &config);
+
+  std::shared_ptr<const FilterBank> bank_;
+  uint32_t inputRate_ = 0;
+  uint32_t outputRate_ = 0;
+
+  std::vector<float> history_; // Last taps-1 inputs followed by pending input
+  size_t position_ = 0;        // Newest input sample under the next output
+  uint32_t phase_ = 0;         // Sub-sample phase of the next output, [0, L)
+};
+
+// -----------------------------------------------------------------------------
+// Sample Conversion
+// -----------------------------------------------------------------------------
+
+// Average interleaved PCM frames (32-bit float, 16/24/32-bit int) into mono
+// float. Writes `bytes / frameSize` samples to `out` and returns that count
+// (0 for unsupported layouts).
+size_t DownmixToMono(const uint8_t *data, size_t bytes, int channels,
+                     int bitsPerSample, bool isFloat, float *out);
+
+// Round, saturate and narrow [-1, 1] float samples to int16
+void ConvertFloatToInt16(const float *input, size_t count, int16_t *out);
+
+} // namespace invisible
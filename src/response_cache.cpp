@@ -0,0 +1,303 @@
+#include "response_cache.h"
+#include <cctype>
+#include <fstream>
+#include <system_error>
+
+namespace invisible {
+
+namespace {
+
+const char kMagic[4] = {'I', 'V', 'R', 'C'};
+const uint32_t kVersion = 1;
+
+// Upper bound on one saved answer, so a damaged file cannot make Load()
+// allocate gigabytes
+const uint32_t kMaxResponseBytes = 16 * 1024 * 1024;
+
+int64_t UnixNow() { return static_cast<int64_t>(std::time(nullptr)); }
+
+// Integers are stored in the machine's own byte order: the file never leaves
+// the machine that wrote it
+template <typename T> void Write(std::ostream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> bool Read(std::istream &in, T &value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(const ResponseCacheConfig &config)
+    : config_(config) {}
+
+// -----------------------------------------------------------------------------
+// Keys
+// -----------------------------------------------------------------------------
+
+ResponseCacheKey ResponseCache::MakeKey(std::string_view request) {
+  // Two unrelated 64-bit hashes: FNV-1a, and a multiply-rotate over 8-byte
+  // words. A false hit needs both to collide on the same pair of requests.
+  uint64_t fnv = 0xcbf29ce484222325ull;
+  for (unsigned char c : request) {
+    fnv ^= c;
+    fnv *= 0x100000001b3ull;
+  }
+
+  uint64_t mix = 0x9e3779b97f4a7c15ull ^ request.size();
+  size_t i = 0;
+  for (; i + 8 <= request.size(); i += 8) {
+    uint64_t word = 0;
+    for (size_t b = 0; b < 8; ++b)
+      word |= static_cast<uint64_t>(static_cast<unsigned char>(request[i + b]))
+              << (8 * b);
+    mix ^= word * 0xff51afd7ed558ccdull;
+    mix = (mix << 27) | (mix >> 37);
+    mix = mix * 5 + 0x52dce729;
+  }
+  uint64_t tail = 0;
+  for (size_t b = 0; i + b < request.size(); ++b)
+    tail |= static_cast<uint64_t>(static_cast<unsigned char>(request[i + b]))
+            << (8 * b);
+  mix ^= tail * 0xc4ceb9fe1a85ec53ull;
+  mix ^= mix >> 33;
+  mix *= 0xff51afd7ed558ccdull;
+  mix ^= mix >> 33;
+
+  ResponseCacheKey key;
+  key.high = fnv;
+  key.low = mix;
+  if (key.IsEmpty())
+    key.low = 1; // Zero means "no key"
+  return key;
+}
+
+std::string ResponseCache::NormalizeQuestion(std::string_view text) {
+  // Symbols stay: "C++" and "C#", or "x*y" and "x+y", are different
+  // questions
+  std::string normalized;
+  normalized.reserve(text.size());
+  bool space = false;
+  for (unsigned char c : text) {
+    if (std::isspace(c)) {
+      space = !normalized.empty();
+    } else {
+      // UTF-8 bytes pass through unchanged
+      if (space)
+        normalized += ' ';
+      space = false;
+      normalized += c < 0x80 ? static_cast<char>(std::tolower(c))
+                             : static_cast<char>(c);
+    }
+  }
+
+  // Closing punctuation: "mutex?", "mutex ?!" and "mutex" are one question
+  size_t end = normalized.size();
+  while (end > 0 && (normalized[end - 1] == '?' || normalized[end - 1] == '!' ||
+                     normalized[end - 1] == '.' || normalized[end - 1] == ' '))
+    --end;
+  normalized.resize(end);
+  return normalized;
+}
+
+// -----------------------------------------------------------------------------
+// Lookup / Insert
+// -----------------------------------------------------------------------------
+
+bool ResponseCache::Lookup(const ResponseCacheKey &key,
+                           const ResponseCacheKey &loose,
+                           std::string &response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.lookups++;
+
+  bool viaLoose = false;
+  auto it = byKey_.find(key);
+  EntryList::iterator entry;
+  if (it != byKey_.end()) {
+    entry = it->second;
+  } else if (!loose.IsEmpty() && (it = byLoose_.find(loose)) != byLoose_.end()) {
+    entry = it->second;
+    viaLoose = true;
+  } else {
+    return false;
+  }
+
+  if (IsExpired(*entry, UnixNow())) {
+    EraseLocked(entry);
+    stats_.evictions++;
+    return false;
+  }
+
+  entries_.splice(entries_.begin(), entries_, entry);
+  response = entry->response;
+  stats_.hits++;
+  stats_.looseHits += viaLoose;
+  stats_.savedMs += entry->latencyMs;
+  return true;
+}
+
+void ResponseCache::Insert(const ResponseCacheKey &key,
+                           const ResponseCacheKey &loose,
+                           std::string response, uint32_t latencyMs) {
+  // Would only push every other answer out
+  if (response.size() > config_.maxBytes)
+    return;
+
+  Entry entry;
+  entry.key = key;
+  entry.loose = loose;
+  entry.response = std::move(response);
+  entry.created = UnixNow();
+  entry.latencyMs = latencyMs;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.inserts++;
+  InsertLocked(std::move(entry));
+  TrimLocked();
+}
+
+void ResponseCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  byKey_.clear();
+  byLoose_.clear();
+  stats_.entries = 0;
+  stats_.bytes = 0;
+}
+
+ResponseCacheStats ResponseCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+// -----------------------------------------------------------------------------
+// Persistence
+// -----------------------------------------------------------------------------
+
+bool ResponseCache::Save(const std::filesystem::path &path) const {
+  std::filesystem::path temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int64_t now = UnixNow();
+    uint32_t count = 0;
+    for (const Entry &entry : entries_)
+      count += !IsExpired(entry, now);
+
+    out.write(kMagic, sizeof(kMagic));
+    Write(out, kVersion);
+    Write(out, count);
+
+    // Oldest first, so Load() rebuilds the same LRU order
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+      if (IsExpired(*it, now))
+        continue;
+      Write(out, it->key.high);
+      Write(out, it->key.low);
+      Write(out, it->loose.high);
+      Write(out, it->loose.low);
+      Write(out, it->created);
+      Write(out, it->latencyMs);
+      Write(out, static_cast<uint32_t>(it->response.size()));
+      out.write(it->response.data(),
+                static_cast<std::streamsize>(it->response.size()));
+    }
+    if (!out.flush())
+      return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp, path, error);
+  if (error) {
+    std::filesystem::remove(temp, error);
+    return false;
+  }
+  return true;
+}
+
+bool ResponseCache::Load(const std::filesystem::path &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+
+  char magic[sizeof(kMagic)];
+  uint32_t version = 0;
+  uint32_t count = 0;
+  if (!in.read(magic, sizeof(magic)) ||
+      std::char_traits<char>::compare(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !Read(in, version) || version != kVersion || !Read(in, count))
+    return false;
+
+  const int64_t now = UnixNow();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint32_t i = 0; i < count; ++i) {
+    Entry entry;
+    uint32_t size = 0;
+    if (!Read(in, entry.key.high) || !Read(in, entry.key.low) ||
+        !Read(in, entry.loose.high) || !Read(in, entry.loose.low) ||
+        !Read(in, entry.created) || !Read(in, entry.latencyMs) ||
+        !Read(in, size) || size > kMaxResponseBytes)
+      break; // Truncated or damaged: keep what was read
+
+    entry.response.resize(size);
+    if (!in.read(entry.response.data(), size))
+      break;
+    if (entry.key.IsEmpty() || IsExpired(entry, now))
+      continue;
+    InsertLocked(std::move(entry));
+  }
+  TrimLocked();
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Internal
+// -----------------------------------------------------------------------------
+
+void ResponseCache::InsertLocked(Entry entry) {
+  auto existing = byKey_.find(entry.key);
+  if (existing != byKey_.end())
+    EraseLocked(existing->second);
+
+  stats_.bytes += entry.response.size();
+  stats_.entries++;
+  entries_.push_front(std::move(entry));
+  auto it = entries_.begin();
+  byKey_[it->key] = it;
+
+  // The newest answer owns the loose key
+  if (!it->loose.IsEmpty())
+    byLoose_[it->loose] = it;
+}
+
+void ResponseCache::EraseLocked(EntryList::iterator it) {
+  byKey_.erase(it->key);
+  if (!it->loose.IsEmpty()) {
+    auto loose = byLoose_.find(it->loose);
+    if (loose != byLoose_.end() && loose->second == it)
+      byLoose_.erase(loose);
+  }
+  stats_.bytes -= it->response.size();
+  stats_.entries--;
+  entries_.erase(it);
+}
+
+void ResponseCache::TrimLocked() {
+  while (!entries_.empty() && (stats_.bytes > config_.maxBytes ||
+                               stats_.entries > config_.maxEntries)) {
+    EraseLocked(std::prev(entries_.end()));
+    stats_.evictions++;
+  }
+}
+
+bool ResponseCache::IsExpired(const Entry &entry, int64_t now) const {
+  return config_.maxAgeSec > 0 &&
+         now - entry.created >= static_cast<int64_t>(config_.maxAgeSec);
+}
+
+} // namespace invisible
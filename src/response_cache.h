@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Response Cache Configuration
+// -----------------------------------------------------------------------------
+
+struct ResponseCacheConfig {
+  size_t maxBytes = 4 * 1024 * 1024; // Cached answer text kept in memory
+  size_t maxEntries = 1024;
+  uint32_t maxAgeSec = 7 * 24 * 3600; // Older answers are never served
+};
+
+struct ResponseCacheStats {
+  uint64_t lookups = 0;
+  uint64_t hits = 0;      // Exact or normalized-key hits
+  uint64_t looseHits = 0; // Hits found only through the normalized key
+  uint64_t inserts = 0;
+  uint64_t evictions = 0; // Dropped for space or age
+  uint64_t savedMs = 0;   // Sum of the original call times of every hit
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// 128-bit hash of a request; all zero = none
+struct ResponseCacheKey {
+  uint64_t high = 0;
+  uint64_t low = 0;
+
+  bool IsEmpty() const { return high == 0 && low == 0; }
+  bool operator==(const ResponseCacheKey &other) const {
+    return high == other.high && low == other.low;
+  }
+};
+
+// -----------------------------------------------------------------------------
+// Response Cache
+// Answers of earlier API calls, keyed by a hash of the full request (model,
+// messages, parameters), so pressing the same hotkey over an unchanged
+// transcript costs nothing. An entry may also carry a loose key, a hash of
+// a looser form of the request (for chat, without the earlier exchanges and
+// with the question normalized), so "What's a mutex?" finds the answer to
+// "what's a mutex" asked before. Least recently used entries go first once
+// maxBytes or maxEntries is reached. Save() and Load() keep the cache in a
+// file between runs. Safe to use from several threads.
+// -----------------------------------------------------------------------------
+
+class ResponseCache {
+public:
+  explicit ResponseCache(const ResponseCacheConfig &config =
+                             ResponseCacheConfig());
+
+  // Disable copy
+  ResponseCache(const ResponseCache &) = delete;
+  ResponseCache &operator=(const ResponseCache &) = delete;
+
+  // Key of a serialized request
+  static ResponseCacheKey MakeKey(std::string_view request);
+
+  // ASCII lower case, runs of whitespace made one space, trailing "?!."
+  // dropped; other symbols are kept
+  static std::string NormalizeQuestion(std::string_view text);
+
+  // The answer stored under `key`, or else under `loose` (if not empty)
+  bool Lookup(const ResponseCacheKey &key, const ResponseCacheKey &loose,
+              std::string &response);
+
+  // Store an answer that took `latencyMs` to fetch; replaces an entry with
+  // the same key. An answer larger than maxBytes is not kept.
+  void Insert(const ResponseCacheKey &key, const ResponseCacheKey &loose,
+              std::string response, uint32_t latencyMs);
+
+  void Clear();
+
+  // Write every live entry to `path` (through a temporary file, so a crash
+  // never leaves half a cache); false on an I/O error
+  bool Save(const std::filesystem::path &path) const;
+
+  // Add the entries saved at `path`, skipping expired ones; false if the
+  // file is missing or not a cache file
+  bool Load(const std::filesystem::path &path);
+
+  ResponseCacheStats GetStats() const;
+
+private:
+  struct KeyHash {
+    size_t operator()(const ResponseCacheKey &key) const {
+      return static_cast<size_t>(key.low ^ (key.high >> 1));
+    }
+  };
+
+  struct Entry {
+    ResponseCacheKey key;
+    ResponseCacheKey loose;
+    std::string response;
+    int64_t created = 0; // Unix seconds
+    uint32_t latencyMs = 0;
+  };
+
+  using EntryList = std::list<Entry>; // Most recently used first
+
+  // Each with mutex_ held
+  void InsertLocked(Entry entry);
+  void EraseLocked(EntryList::iterator it);
+  void TrimLocked();
+  bool IsExpired(const Entry &entry, int64_t now) const;
+
+  ResponseCacheConfig config_;
+  mutable std::mutex mutex_;
+  EntryList entries_;
+  std::unordered_map<ResponseCacheKey, EntryList::iterator, KeyHash> byKey_;
+  std::unordered_map<ResponseCacheKey, EntryList::iterator, KeyHash> byLoose_;
+  ResponseCacheStats stats_;
+};
+
+} // namespace invisible
@@ -0,0 +1,113 @@
+#include "retry_policy.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+// Days from 1970-01-01 to a proleptic Gregorian date
+int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(year - era * 400);
+  const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") as seconds since the epoch
+bool ParseHttpDate(const std::string &value, int64_t &seconds) {
+  static const char *const kMonths[] = {"Jan", "Feb", "Mar", "Apr",
+                                        "May", "Jun", "Jul", "Aug",
+                                        "Sep", "Oct", "Nov", "Dec"};
+  size_t comma = value.find(',');
+  if (comma == std::string::npos)
+    return false;
+
+  int day, year, hour, minute, second;
+  char month[4] = {};
+  if (sscanf(value.c_str() + comma + 1, " %d %3s %d %d:%d:%d", &day, month,
+             &year, &hour, &minute, &second) != 6)
+    return false;
+
+  unsigned monthIndex = 0;
+  while (monthIndex < 12 && strcmp(month, kMonths[monthIndex]) != 0)
+    ++monthIndex;
+  if (monthIndex == 12 || day < 1 || day > 31 || hour > 23 || minute > 59 ||
+      second > 60)
+    return false;
+
+  seconds = DaysFromCivil(year, monthIndex + 1, day) * 86400 + hour * 3600 +
+            minute * 60 + second;
+  return true;
+}
+
+const std::string *FindHeader(const HttpResponse &response, const char *name) {
+  auto it = response.headers.find(name);
+  return it == response.headers.end() ? nullptr : &it->second;
+}
+
+} // namespace
+
+bool IsRetryableResponse(const HttpResponse &response) {
+  if (response.statusCode == 0) {
+    return !response.error.empty() && response.error != L"Cancelled" &&
+           response.error != L"Timed out";
+  }
+  return response.statusCode == 408 || response.statusCode == 429 ||
+         response.statusCode >= 500;
+}
+
+bool ParseRetryAfter(const HttpResponse &response, std::time_t now,
+                     uint32_t &delayMs) {
+  // OpenAI-style millisecond hint first, it is the more precise of the two
+  if (const std::string *value = FindHeader(response, "retry-after-ms")) {
+    char *end = nullptr;
+    double ms = strtod(value->c_str(), &end);
+    if (end != value->c_str() && ms >= 0) {
+      delayMs = static_cast<uint32_t>(std::min(ms, 4294967295.0));
+      return true;
+    }
+  }
+
+  const std::string *value = FindHeader(response, "retry-after");
+  if (!value || value->empty())
+    return false;
+
+  // Delay in seconds
+  char *end = nullptr;
+  unsigned long long seconds = strtoull(value->c_str(), &end, 10);
+  if (end != value->c_str() && (*end == '\0' || *end == ' ')) {
+    delayMs = static_cast<uint32_t>(std::min<unsigned long long>(
+        seconds * 1000ull, 4294967295ull));
+    return true;
+  }
+
+  // Or a date
+  int64_t at;
+  if (!ParseHttpDate(*value, at))
+    return false;
+  int64_t wait = at - static_cast<int64_t>(now);
+  delayMs = wait <= 0 ? 0
+                      : static_cast<uint32_t>(
+                            std::min<int64_t>(wait * 1000, 4294967295ll));
+  return true;
+}
+
+uint32_t RetryBackoffMs(const HttpRetryPolicy &policy, uint32_t retry,
+                        double random) {
+  uint64_t delay = policy.baseBackoffMs;
+  for (uint32_t i = 1; i < retry && delay < policy.maxBackoffMs; ++i)
+    delay *= 2;
+  delay = std::min<uint64_t>(delay, policy.maxBackoffMs);
+
+  random = std::min(std::max(random, 0.0), 1.0);
+  uint64_t half = delay / 2;
+  return static_cast<uint32_t>(delay - half +
+                               static_cast<uint64_t>(half * random));
+}
+
+} // namespace invisible
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "http_transport.h"
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Retry Policy
+// How an asynchronous call recovers from a failed or slow attempt. Only
+// failures that may pass on their own are retried: 408, 429 and 5xx
+// responses, and transport errors (no connection, reset, receive timeout).
+// Cancellation, the call's own deadline and other 4xx answers end the call.
+// -----------------------------------------------------------------------------
+
+struct HttpRetryPolicy {
+  uint32_t maxAttempts = 1;       // Attempts in a row (1 = no retries)
+  uint32_t baseBackoffMs = 500;   // Wait before the first retry
+  uint32_t maxBackoffMs = 8000;   // Cap on the doubling wait
+  uint32_t maxRetryAfterMs = 30000; // A longer Retry-After ends the call
+
+  // Start a duplicate attempt when the running one has neither answered
+  // nor begun streaming after this long; the first to answer wins and the
+  // others are cancelled (0 = no hedging)
+  uint32_t hedgeAfterMs = 0;
+  uint32_t maxHedges = 1;
+};
+
+struct HttpRetryStats {
+  uint64_t calls = 0;          // Async calls that had a retry policy
+  uint64_t attempts = 0;       // Requests sent for them (hedges included)
+  uint64_t retries = 0;        // Attempts started after a failure
+  uint64_t retryAfterWaits = 0; // Retries timed by the server's Retry-After
+  uint64_t hedges = 0;         // Duplicate attempts started
+  uint64_t hedgeWins = 0;      // Calls answered by a duplicate
+  uint64_t exhausted = 0;      // Calls that failed after their last attempt
+};
+
+// 408, 429, 5xx, or a transport failure that was not a cancellation
+bool IsRetryableResponse(const HttpResponse &response);
+
+// Server-requested delay from "retry-after-ms" or "retry-after" (seconds or
+// an HTTP date, compared with `now`); false if the response has none
+bool ParseRetryAfter(const HttpResponse &response, std::time_t now,
+                     uint32_t &delayMs);
+
+// Wait before retry number `retry` (1 = first): the doubled base delay,
+// capped, with its upper half randomized by `random` (0..1) so clients
+// that failed together do not retry together
+uint32_t RetryBackoffMs(const HttpRetryPolicy &policy, uint32_t retry,
+                        double random);
+
+} // namespace invisible
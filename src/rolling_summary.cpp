@@ -0,0 +1,192 @@
+#include "rolling_summary.h"
+#include <algorithm>
+
+namespace invisible {
+
+RollingSummary::RollingSummary(const RollingSummaryConfig &config,
+                               SummarizeFn summarize)
+    : config_(config), summarize_(std::move(summarize)) {
+  config_.segmentChars = std::max<size_t>(config_.segmentChars, 1);
+  config_.maxSegmentChars =
+      std::max(config_.maxSegmentChars, config_.segmentChars);
+  config_.maxTailChars =
+      std::max(config_.maxTailChars, config_.maxSegmentChars);
+  foldAt_ = config_.segmentChars;
+}
+
+RollingSummary::~RollingSummary() { Stop(); }
+
+// -----------------------------------------------------------------------------
+// Transcript
+// -----------------------------------------------------------------------------
+
+void RollingSummary::Append(const std::string &text) {
+  if (text.empty())
+    return;
+
+  std::string prompt;
+  uint64_t generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!tail_.empty())
+      tail_ += ' ';
+    tail_ += text;
+
+    // Folds keep failing: lose the oldest words rather than grow for ever
+    if (tail_.size() > config_.maxTailChars) {
+      size_t drop = tail_.size() - config_.maxTailChars;
+      size_t space = tail_.find(' ', drop);
+      drop = space == std::string::npos ? drop : space + 1;
+      tail_.erase(0, drop);
+      stats_.droppedChars += drop;
+      foldingChars_ -= std::min(foldingChars_, drop);
+      // The retry point moves with the text in front of it
+      foldAt_ = std::max(foldAt_ - std::min(foldAt_, drop),
+                         config_.segmentChars);
+    }
+
+    if (!PrepareFoldLocked(prompt, generation))
+      return;
+  }
+  StartFold(std::move(prompt), generation);
+}
+
+std::string RollingSummary::BuildContext() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (summary_.empty())
+    return tail_;
+
+  std::string context;
+  context.reserve(summary_.size() + tail_.size() + 64);
+  context += "Summary of the meeting so far:\n";
+  context += summary_;
+  if (!tail_.empty()) {
+    context += "\n\nTranscript since then:\n";
+    context += tail_;
+  }
+  return context;
+}
+
+std::string RollingSummary::GetSummary() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return summary_;
+}
+
+void RollingSummary::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  summary_.clear();
+  tail_.clear();
+  foldAt_ = config_.segmentChars;
+  foldingChars_ = 0;
+  generation_++;
+}
+
+void RollingSummary::Stop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  stopping_ = true;
+  foldCV_.wait(lock, [this] { return !folding_; });
+}
+
+RollingSummaryStats RollingSummary::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RollingSummaryStats stats = stats_;
+  stats.summaryChars = summary_.size();
+  stats.tailChars = tail_.size();
+  return stats;
+}
+
+// -----------------------------------------------------------------------------
+// Folding
+// -----------------------------------------------------------------------------
+
+std::string RollingSummary::BuildFoldPrompt(const std::string &summary,
+                                            const std::string &segment,
+                                            size_t summaryWords) {
+  std::string prompt;
+  prompt.reserve(summary.size() + segment.size() + 512);
+  prompt += "You keep a running summary of a meeting. Update it with the new "
+            "part of the transcript below. Keep two sections: \"Summary\", "
+            "the key discussion points and decisions as bullet points, and "
+            "\"Action items\", a numbered list with who is responsible if "
+            "mentioned. Merge repeated points, keep names, numbers and "
+            "decisions, and stay under ";
+  prompt += std::to_string(summaryWords);
+  prompt += " words. Reply with the updated summary only.\n\nCurrent "
+            "summary:\n";
+  prompt += summary.empty() ? "(none yet)" : summary;
+  prompt += "\n\nNew transcript:\n";
+  prompt += segment;
+  return prompt;
+}
+
+bool RollingSummary::PrepareFoldLocked(std::string &prompt,
+                                       uint64_t &generation) {
+  if (folding_ || stopping_ || tail_.size() < foldAt_)
+    return false;
+
+  // A backlog is folded a segment at a time, cut between words
+  size_t size = tail_.size();
+  if (size > config_.maxSegmentChars) {
+    size = config_.maxSegmentChars;
+    size_t space = tail_.rfind(' ', size);
+    if (space != std::string::npos && space > size / 2)
+      size = space;
+  }
+
+  folding_ = true;
+  foldingChars_ = size;
+  generation = generation_;
+  prompt = BuildFoldPrompt(summary_, tail_.substr(0, size),
+                           config_.summaryWords);
+  stats_.promptChars += prompt.size();
+  return true;
+}
+
+void RollingSummary::StartFold(std::string prompt, uint64_t generation) {
+  summarize_(prompt, [this, generation](const std::string &text) {
+    OnFolded(generation, text);
+  });
+}
+
+void RollingSummary::OnFolded(uint64_t generation, const std::string &text) {
+  std::string prompt;
+  uint64_t next = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    folding_ = false;
+
+    if (generation != generation_) {
+      // Cleared while folding: the result describes forgotten text
+    } else if (!text.empty()) {
+      summary_ = text;
+      size_t folded = std::min(foldingChars_, tail_.size());
+      while (folded < tail_.size() && tail_[folded] == ' ')
+        ++folded;
+      tail_.erase(0, folded);
+      stats_.folds++;
+      stats_.foldedChars += folded;
+      foldAt_ = config_.segmentChars;
+    } else {
+      // Try again once another segment has arrived (not on every append,
+      // and never straight away), but before the tail fills up and starts
+      // losing words if there is still room
+      stats_.failedFolds++;
+      size_t cap = std::max(config_.maxTailChars - config_.segmentChars,
+                            config_.segmentChars);
+      foldAt_ = tail_.size() + config_.segmentChars;
+      if (tail_.size() < cap)
+        foldAt_ = std::min(foldAt_, cap);
+    }
+    foldingChars_ = 0;
+
+    // The next fold starts before Stop() can return, or nothing more
+    // touches this object
+    if (!PrepareFoldLocked(prompt, next)) {
+      foldCV_.notify_all();
+      return;
+    }
+  }
+  StartFold(std::move(prompt), next);
+}
+
+} // namespace invisible
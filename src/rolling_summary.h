@@ -0,0 +1,111 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Rolling Summary Configuration
+// -----------------------------------------------------------------------------
+
+struct RollingSummaryConfig {
+  size_t segmentChars = 4000;    // Unfolded transcript that starts a fold
+  size_t maxSegmentChars = 8000; // Most transcript one fold takes in
+  size_t maxTailChars = 32000;   // Unfolded text kept while folds fail
+  size_t summaryWords = 300;     // Length the model is asked to stay under
+};
+
+struct RollingSummaryStats {
+  uint64_t folds = 0;        // Segments folded into the summary
+  uint64_t failedFolds = 0;  // The model returned nothing
+  uint64_t foldedChars = 0;  // Transcript text folded so far
+  uint64_t promptChars = 0;  // Sent to the model by folds
+  uint64_t droppedChars = 0; // Lost because folding fell too far behind
+  size_t summaryChars = 0;
+  size_t tailChars = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Rolling Summary
+// Keeps a meeting summary up to date while the meeting runs, so asking for
+// a summary sends a few thousand characters instead of the whole
+// transcript. Appended text collects in a tail; once the tail reaches
+// segmentChars it is folded into the summary in the background: the model
+// gets the current summary and the new segment and returns the updated
+// summary (key points, decisions and action items, kept under
+// summaryWords). The summary stays the same size however long the meeting
+// gets, and nothing is lost when the transcript itself is trimmed. Text is
+// taken off the tail only after its fold succeeded, so BuildContext() never
+// misses anything. One fold runs at a time; the class owns no threads.
+// -----------------------------------------------------------------------------
+
+class RollingSummary {
+public:
+  // Called exactly once per prompt, from any thread; empty text on failure
+  using SummarizeDone = std::function<void(const std::string &text)>;
+
+  // Starts summarizing `prompt` and returns (may complete before that)
+  using SummarizeFn =
+      std::function<void(const std::string &prompt, SummarizeDone done)>;
+
+  RollingSummary(const RollingSummaryConfig &config, SummarizeFn summarize);
+  ~RollingSummary();
+
+  // Disable copy
+  RollingSummary(const RollingSummary &) = delete;
+  RollingSummary &operator=(const RollingSummary &) = delete;
+
+  // Add transcript text; starts a fold if enough has collected
+  void Append(const std::string &text);
+
+  // What a summary or action item request needs: the summary so far and
+  // the transcript not yet folded into it (all of it while there is no
+  // summary yet)
+  std::string BuildContext() const;
+
+  std::string GetSummary() const;
+
+  // Forget the summary and tail; a running fold's result is dropped
+  void Clear();
+
+  // Start no more folds and wait for the running one to report. Cancel its
+  // call first (e.g. by shutting the AI service down) to not wait long.
+  // Must not be called from a SummarizeFn completion.
+  void Stop();
+
+  RollingSummaryStats GetStats() const;
+
+  // Instructions and input for folding `segment` into `summary`
+  static std::string BuildFoldPrompt(const std::string &summary,
+                                     const std::string &segment,
+                                     size_t summaryWords);
+
+private:
+  // With mutex_ held: if no fold runs and the tail is long enough, claim
+  // the next segment and build its prompt
+  bool PrepareFoldLocked(std::string &prompt, uint64_t &generation);
+
+  void StartFold(std::string prompt, uint64_t generation);
+  void OnFolded(uint64_t generation, const std::string &text);
+
+  RollingSummaryConfig config_;
+  SummarizeFn summarize_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable foldCV_; // Waits for a fold to report
+  std::string summary_;
+  std::string tail_;
+  size_t foldAt_ = 0;       // Tail length that starts the next fold
+  size_t foldingChars_ = 0; // Front of the tail the running fold took
+  uint64_t generation_ = 0; // Bumped by Clear()
+  bool folding_ = false;
+  bool stopping_ = false;
+  RollingSummaryStats stats_;
+};
+
+} // namespace invisible
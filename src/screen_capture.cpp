@@ -1,12 +1,34 @@
 #include "screen_capture.h"
+#include "base64.h"
+#include "dxgi_capture.h"
+#include "gdi_capture.h"
+#include "jpeg_encoder.h"
 #include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <wincodec.h>
-
-#pragma comment(lib, "windowscodecs.lib")
+#include <memory>
+#include <mutex>
 
 namespace invisible {
 
+namespace {
+
+// Capture backends and their buffer pool, shared by every capture and
+// created on first use
+struct CaptureBackends {
+  FrameBufferPool pool;
+  std::mutex mutex;
+  std::unique_ptr<DxgiCaptureBackend> dxgi;
+  std::unique_ptr<GdiCaptureBackend> gdi;
+};
+
+CaptureBackends &GetCaptureBackends() {
+  static CaptureBackends backends;
+  return backends;
+}
+
+} // namespace
+
 // -----------------------------------------------------------------------------
 // Screen Capture Implementation
 // -----------------------------------------------------------------------------
@@ -16,14 +38,35 @@ CapturedImage ScreenCapture::CaptureRegion(const Rect &region) {
     return CapturedImage();
   }
 
-  HDC screenDC = GetDC(nullptr);
-  CapturedImage result =
-      CaptureFromDC(screenDC, region.x, region.y, region.width, region.height);
-  ReleaseDC(nullptr, screenDC);
+  CaptureBackends &backends = GetCaptureBackends();
+  std::lock_guard<std::mutex> lock(backends.mutex);
+  if (!backends.dxgi) {
+    backends.dxgi = std::make_unique<DxgiCaptureBackend>(&backends.pool);
+    backends.gdi = std::make_unique<GdiCaptureBackend>(&backends.pool);
+  }
+
+  ImageRect rect{region.x, region.y, region.width, region.height};
+  CaptureFrame frame;
+  if (!backends.dxgi->Capture(rect, frame) &&
+      !backends.gdi->Capture(rect, frame)) {
+    return CapturedImage();
+  }
 
+  CapturedImage result;
+  result.pixels = std::move(frame.pixels);
+  result.width = frame.width;
+  result.height = frame.height;
+  result.stride = frame.stride;
+  result.bitsPerPixel = 32;
+  result.dirtyRects = std::move(frame.dirtyRects);
+  result.dirtyRectsValid = frame.dirtyRectsValid;
   return result;
 }
 
+FrameBufferPoolStats ScreenCapture::GetPoolStats() {
+  return GetCaptureBackends().pool.GetStats();
+}
+
 CapturedImage ScreenCapture::CapturePrimaryMonitor() {
   Rect primaryRect = GetPrimaryMonitorRect();
   return CaptureRegion(primaryRect);
@@ -113,8 +156,9 @@ CapturedImage ScreenCapture::CaptureFromDC(HDC srcDC, int srcX, int srcY,
   image.height = height;
   image.stride = stride;
   image.bitsPerPixel = 32;
-  image.pixels.resize(stride * height);
-  memcpy(image.pixels.data(), pixels, stride * height);
+  image.pixels = ImageBuffer(&GetCaptureBackends().pool,
+                             static_cast<size_t>(stride) * height);
+  memcpy(image.pixels.data(), pixels, image.pixels.size());
 
   // Cleanup
   SelectObject(memDC, oldBitmap);
@@ -124,7 +168,7 @@ CapturedImage ScreenCapture::CaptureFromDC(HDC srcDC, int srcX, int srcY,
   return image;
 }
 
-bool ScreenCapture::SaveToBmp(const CapturedImage &image,
+bool ScreenCapture::SaveToBmp(const ImageView &image,
                               const wchar_t *filePath) {
   if (!image.IsValid()) {
     return false;
@@ -138,8 +182,9 @@ bool ScreenCapture::SaveToBmp(const CapturedImage &image,
   // BMP file header
   BITMAPFILEHEADER bfh = {};
   bfh.bfType = 0x4D42; // "BM"
+  const int rowBytes = image.width * 4;
   bfh.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) +
-               image.stride * image.height;
+               rowBytes * image.height;
   bfh.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
 
   // BMP info header
@@ -150,17 +195,20 @@ bool ScreenCapture::SaveToBmp(const CapturedImage &image,
   bih.biPlanes = 1;
   bih.biBitCount = 32;
   bih.biCompression = BI_RGB;
-  bih.biSizeImage = image.stride * image.height;
+  bih.biSizeImage = rowBytes * image.height;
 
   file.write(reinterpret_cast<const char *>(&bfh), sizeof(bfh));
   file.write(reinterpret_cast<const char *>(&bih), sizeof(bih));
-  file.write(reinterpret_cast<const char *>(image.pixels.data()),
-             image.pixels.size());
+
+  // Row by row: a cropped view's rows are not contiguous
+  for (int y = 0; y < image.height; y++) {
+    file.write(reinterpret_cast<const char *>(image.Row(y)), rowBytes);
+  }
 
   return file.good();
 }
 
-bool ScreenCapture::SaveToPpm(const CapturedImage &image,
+bool ScreenCapture::SaveToPpm(const ImageView &image,
                               const wchar_t *filePath) {
   if (!image.IsValid()) {
     return false;
@@ -177,7 +225,7 @@ bool ScreenCapture::SaveToPpm(const CapturedImage &image,
   // Write RGB data (PPM doesn't support alpha)
   for (int y = 0; y < image.height; y++) {
     for (int x = 0; x < image.width; x++) {
-      const BYTE *p = image.pixels.data() + y * image.stride + x * 4;
+      const BYTE *p = image.Row(y) + x * 4;
       // BGRA to RGB
       file.put(p[2]); // R
       file.put(p[1]); // G
@@ -259,27 +307,6 @@ void RegionSelector::StartSelection(SelectionCallback callback) {
   // Hide this window from capture too (it's just UI)
   SetWindowDisplayAffinity(selectorHwnd_, WDA_EXCLUDEFROMCAPTURE);
 
-  // Create bitmap from snapshot for display
-  if (screenSnapshot_.IsValid()) {
-    HDC screenDC = GetDC(nullptr);
-    HDC memDC = CreateCompatibleDC(screenDC);
-
-    BITMAPINFO bmi = {};
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = screenSnapshot_.width;
-    bmi.bmiHeader.biHeight = -screenSnapshot_.height;
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 32;
-    bmi.bmiHeader.biCompression = BI_RGB;
-
-    snapshotBitmap_ =
-        CreateDIBitmap(screenDC, &bmi.bmiHeader, CBM_INIT,
-                       screenSnapshot_.pixels.data(), &bmi, DIB_RGB_COLORS);
-
-    DeleteDC(memDC);
-    ReleaseDC(nullptr, screenDC);
-  }
-
   selecting_ = true;
   ShowWindow(selectorHwnd_, SW_SHOW);
   SetCapture(selectorHwnd_);
@@ -294,12 +321,7 @@ void RegionSelector::CancelSelection() {
     selectorHwnd_ = nullptr;
   }
 
-  if (snapshotBitmap_) {
-    DeleteObject(snapshotBitmap_);
-    snapshotBitmap_ = nullptr;
-  }
-
-  screenSnapshot_ = CapturedImage();
+  screenSnapshot_ = CapturedImage(); // Its buffer serves the next capture
   selecting_ = false;
   isDragging_ = false;
 }
@@ -340,19 +362,21 @@ LRESULT RegionSelector::HandleSelectorMessage(HWND hwnd, UINT msg,
     RECT rc;
     GetClientRect(hwnd, &rc);
 
-    // Draw the screen snapshot as background
-    if (snapshotBitmap_) {
-      HDC memDC = CreateCompatibleDC(hdc);
-      HBITMAP oldBmp =
-          static_cast<HBITMAP>(SelectObject(memDC, snapshotBitmap_));
-
-      // Adjust for virtual screen offset
-      Rect virtualScreen = GetVirtualScreenRect();
-      BitBlt(hdc, 0, 0, rc.right, rc.bottom, memDC, -virtualScreen.x,
-             -virtualScreen.y, SRCCOPY);
-
-      SelectObject(memDC, oldBmp);
-      DeleteDC(memDC);
+    // Draw the screen snapshot as background. The window covers the
+    // virtual screen, so snapshot and client coordinates are the same.
+    if (screenSnapshot_.IsValid()) {
+      BITMAPINFO bmi = {};
+      bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+      bmi.bmiHeader.biWidth = screenSnapshot_.width;
+      bmi.bmiHeader.biHeight = -screenSnapshot_.height; // Top-down
+      bmi.bmiHeader.biPlanes = 1;
+      bmi.bmiHeader.biBitCount = 32;
+      bmi.bmiHeader.biCompression = BI_RGB;
+
+      SetDIBitsToDevice(hdc, 0, 0, screenSnapshot_.width,
+                        screenSnapshot_.height, 0, 0, 0,
+                        screenSnapshot_.height, screenSnapshot_.pixels.data(),
+                        &bmi, DIB_RGB_COLORS);
     } else {
       // Fallback: semi-transparent overlay
       HBRUSH darkBrush = CreateSolidBrush(RGB(0, 0, 0));
@@ -449,8 +473,16 @@ LRESULT RegionSelector::HandleSelectorMessage(HWND hwnd, UINT msg,
 
       Rect selection = GetSelectionRect();
 
+      // A click without a drag picks the previous region again, so
+      // repeated captures of one view line up pixel for pixel
+      if (selection.width < 4 && selection.height < 4 &&
+          lastSelection_.IsValid()) {
+        selection = lastSelection_;
+      }
+
       // Minimum selection size
       if (selection.width >= 10 && selection.height >= 10) {
+        lastSelection_ = selection;
         SelectionCallback cb = std::move(callback_);
         CancelSelection();
 
@@ -485,194 +517,163 @@ LRESULT RegionSelector::HandleSelectorMessage(HWND hwnd, UINT msg,
 }
 
 // -----------------------------------------------------------------------------
-// Base64 Encoding + JPEG Conversion for Vision AI
+// JPEG Conversion for Vision AI
 // -----------------------------------------------------------------------------
 
-static const char base64_chars[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static std::string Base64Encode(const BYTE *data, size_t len) {
-  std::string result;
-  result.reserve(((len + 2) / 3) * 4);
+bool ScreenCapture::PrepareForVision(const ImageView &image,
+                                     CapturedImage &prepared,
+                                     const ImagePreprocessorConfig &config) {
+  if (!image.IsValid()) {
+    return false;
+  }
 
-  for (size_t i = 0; i < len; i += 3) {
-    unsigned int b = (data[i] << 16);
-    if (i + 1 < len)
-      b |= (data[i + 1] << 8);
-    if (i + 2 < len)
-      b |= data[i + 2];
+  // The output is never larger than the input or the pixel limit; take a
+  // buffer of that size from the pool and let Process() shrink it
+  size_t limit = static_cast<size_t>(image.width) * image.height;
+  if (config.maxPixels > 0) {
+    limit = std::min(limit, static_cast<size_t>(config.maxPixels));
+  }
+  ImageBuffer pixels(&GetCaptureBackends().pool, limit * 4);
 
-    result.push_back(base64_chars[(b >> 18) & 0x3F]);
-    result.push_back(base64_chars[(b >> 12) & 0x3F]);
-    result.push_back((i + 1 < len) ? base64_chars[(b >> 6) & 0x3F] : '=');
-    result.push_back((i + 2 < len) ? base64_chars[b & 0x3F] : '=');
+  ImagePreprocessor preprocessor(config);
+  int width = 0, height = 0;
+  if (!preprocessor.Process(image.pixels, image.width, image.height,
+                            image.stride, pixels.bytes(), width, height)) {
+    return false;
   }
 
-  return result;
+  prepared.pixels = std::move(pixels);
+  prepared.width = width;
+  prepared.height = height;
+  prepared.stride = width * 4;
+  prepared.bitsPerPixel = 32;
+  return true;
 }
 
-std::string ScreenCapture::ConvertToBase64Bmp(const CapturedImage &image) {
-  if (!image.IsValid()) {
-    return "";
-  }
+// -----------------------------------------------------------------------------
+// Local Text Recognition
+// -----------------------------------------------------------------------------
 
-  // Build BMP in memory first
-  BITMAPFILEHEADER bfh = {};
-  bfh.bfType = 0x4D42;
-  bfh.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) +
-               image.stride * image.height;
-  bfh.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+namespace {
 
-  BITMAPINFOHEADER bih = {};
-  bih.biSize = sizeof(BITMAPINFOHEADER);
-  bih.biWidth = image.width;
-  bih.biHeight = -image.height;
-  bih.biPlanes = 1;
-  bih.biBitCount = 32;
-  bih.biCompression = BI_RGB;
-  bih.biSizeImage = image.stride * image.height;
-
-  // Convert BGRA pixels to simple RGB PPM-like format,
-  // then build a minimal JPEG-compatible format
-  // Actually, let's just send as PNG using raw pixel encoding trick
-
-  // For maximum compatibility, convert to simple PPM then base64
-  // But Groq needs JPEG/PNG. Let's build a minimal valid BMP and try
-  // with image/bmp mime type change to jpeg workaround:
-
-  // Use Windows WIC (Windows Imaging Component) to convert to JPEG
-  IStream *pStream = nullptr;
-  HRESULT hr = CreateStreamOnHGlobal(nullptr, TRUE, &pStream);
-  if (FAILED(hr) || !pStream) {
-    // Fallback: send raw BMP
-    size_t totalSize = sizeof(bfh) + sizeof(bih) + image.pixels.size();
-    std::vector<BYTE> bmpData(totalSize);
-    memcpy(bmpData.data(), &bfh, sizeof(bfh));
-    memcpy(bmpData.data() + sizeof(bfh), &bih, sizeof(bih));
-    memcpy(bmpData.data() + sizeof(bfh) + sizeof(bih), image.pixels.data(),
-           image.pixels.size());
-    return Base64Encode(bmpData.data(), bmpData.size());
-  }
-
-  // Write BMP to stream
-  ULONG written;
-  pStream->Write(&bfh, sizeof(bfh), &written);
-  pStream->Write(&bih, sizeof(bih), &written);
-  pStream->Write(image.pixels.data(), (ULONG)image.pixels.size(), &written);
-
-  // Reset stream position
-  LARGE_INTEGER zero = {};
-  pStream->Seek(zero, STREAM_SEEK_SET, nullptr);
-
-  // Use WIC to convert BMP stream to JPEG
-  IWICImagingFactory *pFactory = nullptr;
-  hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
-                        IID_IWICImagingFactory, (void **)&pFactory);
-
-  if (FAILED(hr) || !pFactory) {
-    pStream->Release();
-    // Fallback to BMP
-    size_t totalSize = sizeof(bfh) + sizeof(bih) + image.pixels.size();
-    std::vector<BYTE> bmpData(totalSize);
-    memcpy(bmpData.data(), &bfh, sizeof(bfh));
-    memcpy(bmpData.data() + sizeof(bfh), &bih, sizeof(bih));
-    memcpy(bmpData.data() + sizeof(bfh) + sizeof(bih), image.pixels.data(),
-           image.pixels.size());
-    return Base64Encode(bmpData.data(), bmpData.size());
-  }
-
-  // Decode BMP from stream
-  IWICBitmapDecoder *pDecoder = nullptr;
-  hr = pFactory->CreateDecoderFromStream(
-      pStream, nullptr, WICDecodeMetadataCacheOnDemand, &pDecoder);
-
-  if (FAILED(hr) || !pDecoder) {
-    pFactory->Release();
-    pStream->Release();
-    return "";
-  }
+// Fonts most screen text is set in (editors, Windows UI, Office, browsers),
+// at the pixel sizes it usually has; other sizes match their neighbours
+const wchar_t *const kTemplateFonts[] = {
+    L"Consolas",  L"Cascadia Mono", L"Courier New",    L"Segoe UI",
+    L"Calibri",   L"Arial",         L"Times New Roman"};
+const int kTemplateSizes[] = {13, 16, 22};
 
-  IWICBitmapFrameDecode *pFrame = nullptr;
-  pDecoder->GetFrame(0, &pFrame);
+// Canvas a template glyph is drawn on (room for the largest size with its
+// ascenders and descenders)
+constexpr int kGlyphCanvas = 64;
 
-  if (!pFrame) {
-    pDecoder->Release();
-    pFactory->Release();
-    pStream->Release();
-    return "";
-  }
+TextRecognizer BuildTextRecognizer() {
+  TextRecognizer recognizer;
 
-  // Create JPEG encoder
-  IStream *pOutStream = nullptr;
-  CreateStreamOnHGlobal(nullptr, TRUE, &pOutStream);
-
-  IWICBitmapEncoder *pEncoder = nullptr;
-  // GUID for JPEG encoder
-  GUID jpegGuid = {0x19e4a5aa,
-                   0x5662,
-                   0x4fc5,
-                   {0xa0, 0xc0, 0x17, 0x58, 0x02, 0x8e, 0x10, 0x57}};
-  hr = pFactory->CreateEncoder(jpegGuid, nullptr, &pEncoder);
-
-  if (FAILED(hr) || !pEncoder) {
-    pFrame->Release();
-    pDecoder->Release();
-    pFactory->Release();
-    pStream->Release();
-    if (pOutStream)
-      pOutStream->Release();
-    return "";
+  HDC dc = CreateCompatibleDC(nullptr);
+  if (!dc) {
+    LogError(L"Failed to create DC for glyph templates");
+    return recognizer;
   }
 
-  pEncoder->Initialize(pOutStream, WICBitmapEncoderNoCache);
+  BITMAPINFO bmi = {};
+  bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+  bmi.bmiHeader.biWidth = kGlyphCanvas;
+  bmi.bmiHeader.biHeight = -kGlyphCanvas; // Top-down
+  bmi.bmiHeader.biPlanes = 1;
+  bmi.bmiHeader.biBitCount = 32;
+  bmi.bmiHeader.biCompression = BI_RGB;
 
-  IWICBitmapFrameEncode *pFrameEncode = nullptr;
-  pEncoder->CreateNewFrame(&pFrameEncode, nullptr);
+  BYTE *pixels = nullptr;
+  HBITMAP bitmap =
+      CreateDIBSection(dc, &bmi, DIB_RGB_COLORS,
+                       reinterpret_cast<void **>(&pixels), nullptr, 0);
+  if (!bitmap || !pixels) {
+    LogError(L"Failed to create DIB section for glyph templates");
+    DeleteDC(dc);
+    return recognizer;
+  }
+  HGDIOBJ oldBitmap = SelectObject(dc, bitmap);
+
+  // Dark text on white, as the recognizer expects, with the same
+  // antialiasing as on screen
+  SetBkMode(dc, TRANSPARENT);
+  SetTextColor(dc, RGB(0, 0, 0));
+  RECT canvas = {0, 0, kGlyphCanvas, kGlyphCanvas};
+  const ImageView view{pixels, kGlyphCanvas, kGlyphCanvas, kGlyphCanvas * 4};
+
+  for (const wchar_t *face : kTemplateFonts) {
+    for (int size : kTemplateSizes) {
+      HFONT font = CreateFontW(-size, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                               DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                               CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY,
+                               DEFAULT_PITCH, face);
+      if (!font)
+        continue;
+      HGDIOBJ oldFont = SelectObject(dc, font);
+
+      // A missing font is substituted; skip it rather than learn the
+      // substitute again
+      wchar_t selected[LF_FACESIZE] = {};
+      GetTextFaceW(dc, LF_FACESIZE, selected);
+      if (_wcsicmp(selected, face) == 0) {
+        recognizer.AddFont(TextRecognizer::DefaultAlphabet(), [&](char c) {
+          FillRect(dc, &canvas,
+                   static_cast<HBRUSH>(GetStockObject(WHITE_BRUSH)));
+          wchar_t glyph = static_cast<wchar_t>(c);
+          TextOutW(dc, size / 2, size / 2, &glyph, 1);
+          GdiFlush();
+          return view;
+        });
+      }
+
+      SelectObject(dc, oldFont);
+      DeleteObject(font);
+    }
+  }
 
-  if (pFrameEncode) {
-    pFrameEncode->Initialize(nullptr);
-    pFrameEncode->SetSize(image.width, image.height);
+  SelectObject(dc, oldBitmap);
+  DeleteObject(bitmap);
+  DeleteDC(dc);
+  return recognizer;
+}
 
-    WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
-    pFrameEncode->SetPixelFormat(&format);
-    pFrameEncode->WriteSource(pFrame, nullptr);
-    pFrameEncode->Commit();
-    pEncoder->Commit();
+} // namespace
 
-    // Read JPEG data from output stream
-    STATSTG stat;
-    pOutStream->Stat(&stat, STATFLAG_NONAME);
-    ULONG jpegSize = (ULONG)stat.cbSize.QuadPart;
+RecognizedText ScreenCapture::RecognizeText(const ImageView &image) {
+  static const TextRecognizer recognizer = BuildTextRecognizer();
+  return recognizer.Recognize(image);
+}
 
-    std::vector<BYTE> jpegData(jpegSize);
-    LARGE_INTEGER seekZero = {};
-    pOutStream->Seek(seekZero, STREAM_SEEK_SET, nullptr);
-    pOutStream->Read(jpegData.data(), jpegSize, &written);
+std::vector<BYTE> ScreenCapture::EncodeJpeg(const ImageView &image,
+                                            int quality) {
+  std::vector<BYTE> jpegData;
+  if (!image.IsValid()) {
+    return jpegData;
+  }
 
-    // Cleanup
-    pFrameEncode->Release();
-    pEncoder->Release();
-    pFrame->Release();
-    pDecoder->Release();
-    pFactory->Release();
-    pOutStream->Release();
-    pStream->Release();
+  // Encode straight from the BGRA capture buffer (no BMP/WIC round-trip)
+  JpegEncoderConfig config;
+  config.quality = quality;
+  JpegEncoder encoder(config);
 
-    // Base64 encode the JPEG
-    return Base64Encode(jpegData.data(), jpegData.size());
+  if (!encoder.EncodeBgra(image.pixels, image.width, image.height,
+                          image.stride, jpegData)) {
+    LogError(L"JPEG encoding failed", ERROR_INVALID_DATA);
+    jpegData.clear();
   }
 
-  // Cleanup on failure
-  if (pEncoder)
-    pEncoder->Release();
-  pFrame->Release();
-  pDecoder->Release();
-  pFactory->Release();
-  if (pOutStream)
-    pOutStream->Release();
-  pStream->Release();
+  return jpegData;
+}
+
+std::string ScreenCapture::ConvertToBase64Jpeg(const ImageView &image,
+                                               int quality) {
+  std::vector<BYTE> jpegData = EncodeJpeg(image, quality);
+  if (jpegData.empty()) {
+    return "";
+  }
 
-  return "";
+  return Base64Encode(jpegData.data(), jpegData.size());
 }
 
 } // namespace invisible
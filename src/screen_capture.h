@@ -1,5 +1,8 @@
 #pragma once
 
+#include "capture_backend.h"
+#include "image_preprocessor.h"
+#include "text_recognizer.h"
 #include "utils.h"
 #include <vector>
 
@@ -7,17 +10,36 @@ namespace invisible {
 
 // -----------------------------------------------------------------------------
 // Captured Image Data
+// Move-only: the pixels are a pooled buffer that goes back to the capture
+// pool when the image is destroyed. Use View() to read (or crop) them.
 // -----------------------------------------------------------------------------
 
 struct CapturedImage {
-  std::vector<BYTE> pixels; // Raw pixel data (BGRA format)
+  CapturedImage() = default;
+  CapturedImage(CapturedImage &&) = default;
+  CapturedImage &operator=(CapturedImage &&) = default;
+
+  // Disable copy
+  CapturedImage(const CapturedImage &) = delete;
+  CapturedImage &operator=(const CapturedImage &) = delete;
+
+  ImageBuffer pixels; // Raw pixel data (BGRA format)
   int width = 0;
   int height = 0;
   int stride = 0; // Bytes per row
   int bitsPerPixel = 32;
 
+  // What changed since the previous capture of the same region (Desktop
+  // Duplication only; otherwise dirtyRectsValid is false)
+  std::vector<ImageRect> dirtyRects;
+  bool dirtyRectsValid = false;
+
   bool IsValid() const { return !pixels.empty() && width > 0 && height > 0; }
 
+  ImageView View() const {
+    return ImageView{pixels.data(), width, height, stride};
+  }
+
   // Get pixel at (x, y) - assumes BGRA format
   COLORREF GetPixel(int x, int y) const {
     if (x < 0 || x >= width || y < 0 || y >= height) {
@@ -37,11 +59,15 @@ public:
   ScreenCapture() = default;
   ~ScreenCapture() = default;
 
-  // Capture a region of the screen
+  // Capture a region of the screen, with Desktop Duplication when the
+  // region is on one monitor and it works there, otherwise with GDI
   // Note: If an overlay window with WDA_EXCLUDEFROMCAPTURE is present,
   // it will NOT appear in this capture (which is the intended behavior)
   static CapturedImage CaptureRegion(const Rect &region);
 
+  // Buffers of captures that have been dropped, kept for the next ones
+  static FrameBufferPoolStats GetPoolStats();
+
   // Capture the entire primary monitor
   static CapturedImage CapturePrimaryMonitor();
 
@@ -52,13 +78,30 @@ public:
   static CapturedImage CaptureWindow(HWND hwnd, bool clientAreaOnly = true);
 
   // Save captured image to file (BMP format)
-  static bool SaveToBmp(const CapturedImage &image, const wchar_t *filePath);
+  static bool SaveToBmp(const ImageView &image, const wchar_t *filePath);
 
   // Save captured image to file (PPM format - simple, portable)
-  static bool SaveToPpm(const CapturedImage &image, const wchar_t *filePath);
+  static bool SaveToPpm(const ImageView &image, const wchar_t *filePath);
+
+  // Trim uniform borders and shrink to the vision size limits before
+  // encoding, into a pooled buffer. Returns false (and leaves `prepared`
+  // alone) if the image is fine as it is.
+  static bool PrepareForVision(
+      const ImageView &image, CapturedImage &prepared,
+      const ImagePreprocessorConfig &config = ImagePreprocessorConfig());
+
+  // Read the text of a capture on-device (see TextRecognizer). Glyph
+  // templates for the common UI, document and code fonts are rendered
+  // with GDI on the first call. Thread-safe.
+  static RecognizedText RecognizeText(const ImageView &image);
+
+  // Encode captured image as baseline JPEG (quality 1-100)
+  static std::vector<BYTE> EncodeJpeg(const ImageView &image,
+                                      int quality = 85);
 
-  // Convert captured image to base64-encoded BMP data (for AI vision APIs)
-  static std::string ConvertToBase64Bmp(const CapturedImage &image);
+  // Convert captured image to base64-encoded JPEG data (for AI vision APIs)
+  static std::string ConvertToBase64Jpeg(const ImageView &image,
+                                         int quality = 85);
 
 private:
   // Internal capture implementation using GDI
@@ -107,10 +150,11 @@ private:
   bool isDragging_ = false;
   POINT startPoint_ = {0, 0};
   POINT currentPoint_ = {0, 0};
+  Rect lastSelection_; // Reused when the user just clicks
 
-  // Screen snapshot for display during selection
+  // Screen snapshot shown during selection, painted straight from the
+  // capture buffer
   CapturedImage screenSnapshot_;
-  HBITMAP snapshotBitmap_ = nullptr;
 
   // Calculate selection rectangle
   Rect GetSelectionRect() const;
@@ -0,0 +1,132 @@
+#pragma once
+
+// -----------------------------------------------------------------------------
+// SIMD Feature Detection
+// Platform-neutral; must not include Windows headers so the portable modules
+// (encoders, DSP) build on every target.
+// -----------------------------------------------------------------------------
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INVISIBLE_HAVE_SSE2 1
+#include <emmintrin.h>
+#else
+#define INVISIBLE_HAVE_SSE2 0
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) ||           \
+    defined(__i386__)
+#define INVISIBLE_HAVE_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#else
+#define INVISIBLE_HAVE_X86 0
+#endif
+
+// Per-function ISA opt-in so SSSE3/AVX2 kernels build without global flags
+// (MSVC accepts the intrinsics unconditionally)
+#if defined(__GNUC__) || defined(__clang__)
+#define INVISIBLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define INVISIBLE_TARGET(isa)
+#endif
+
+#include <cstdint>
+
+namespace invisible {
+namespace simd {
+
+// -----------------------------------------------------------------------------
+// Runtime CPU Feature Detection
+// -----------------------------------------------------------------------------
+
+struct CpuFeatures {
+  bool ssse3 = false;
+  bool avx = false;
+  bool avx2 = false;
+};
+
+inline CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features;
+#if INVISIBLE_HAVE_X86
+  unsigned int regs[4] = {};
+  auto cpuid = [&regs](unsigned int leaf, unsigned int subleaf) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i) {
+      regs[i] = static_cast<unsigned int>(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  };
+
+  cpuid(0, 0);
+  unsigned int maxLeaf = regs[0];
+  if (maxLeaf < 1) {
+    return features;
+  }
+
+  cpuid(1, 0);
+  features.ssse3 = (regs[2] & (1u << 9)) != 0;
+  bool osxsave = (regs[2] & (1u << 27)) != 0;
+  bool avx = (regs[2] & (1u << 28)) != 0;
+
+  // AVX state must be enabled by the OS (XCR0 bits 1 and 2)
+  bool osAvx = false;
+  if (osxsave && avx) {
+#if defined(_MSC_VER)
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int lo = 0, hi = 0;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    unsigned long long xcr0 = (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+    osAvx = (xcr0 & 0x6) == 0x6;
+  }
+  features.avx = osAvx;
+
+  if (osAvx && maxLeaf >= 7) {
+    cpuid(7, 0);
+    features.avx2 = (regs[1] & (1u << 5)) != 0;
+  }
+#endif
+  return features;
+}
+
+inline const CpuFeatures &GetCpuFeatures() {
+  static const CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
+
+#if INVISIBLE_HAVE_SSE2
+
+// Low 32 bits of a lane-wise 32x32 multiply (SSE4.1 _mm_mullo_epi32 on SSE2)
+inline __m128i MulLo32(__m128i a, __m128i b) {
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// In-place transpose of a 4x4 block of 32-bit lanes
+inline void Transpose4x4(__m128i &r0, __m128i &r1, __m128i &r2, __m128i &r3) {
+  __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+  __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+  __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+  __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+  r0 = _mm_unpacklo_epi64(t0, t1);
+  r1 = _mm_unpackhi_epi64(t0, t1);
+  r2 = _mm_unpacklo_epi64(t2, t3);
+  r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+#endif
+
+} // namespace simd
+} // namespace invisible
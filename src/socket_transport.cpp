@@ -0,0 +1,565 @@
+#include "socket_transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace invisible {
+
+namespace {
+
+constexpr size_t kBufferSize = 64 * 1024; // Also the response head limit
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+void SetTimeout(int fd, int option, uint32_t ms) {
+  timeval tv;
+  tv.tv_sec = static_cast<time_t>(ms / 1000);
+  tv.tv_usec = static_cast<suseconds_t>((ms % 1000) * 1000);
+  setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+}
+
+bool ConnectWithTimeout(int fd, const sockaddr *address, socklen_t length,
+                        uint32_t timeoutMs) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+  int result = connect(fd, address, length);
+  if (result != 0 && errno == EINPROGRESS) {
+    pollfd pfd = {fd, POLLOUT, 0};
+    do {
+      result = poll(&pfd, 1, static_cast<int>(timeoutMs));
+    } while (result < 0 && errno == EINTR);
+    if (result == 1) {
+      int error = 0;
+      socklen_t size = sizeof(error);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+      result = error == 0 ? 0 : -1;
+    } else {
+      result = -1; // Timed out
+    }
+  }
+
+  fcntl(fd, F_SETFL, flags);
+  return result == 0;
+}
+
+bool IsBodylessStatus(int status) {
+  return (status >= 100 && status < 200) || status == 204 || status == 304;
+}
+
+bool ContainsToken(const std::string &list, const char *token) {
+  // Comma-separated header value, compared case-insensitively
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t comma = list.find(',', start);
+    std::string_view item(list.data() + start,
+                          (comma == std::string::npos ? list.size() : comma) -
+                              start);
+    while (!item.empty() && item.front() == ' ')
+      item.remove_prefix(1);
+    while (!item.empty() && item.back() == ' ')
+      item.remove_suffix(1);
+    if (HttpEqualsIgnoreCase(item, token))
+      return true;
+    if (comma == std::string::npos)
+      break;
+    start = comma + 1;
+  }
+  return false;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Connection
+// -----------------------------------------------------------------------------
+
+struct SocketTransport::Connection {
+  int fd = -1;
+  std::unique_ptr<TlsSession> tls;
+  std::vector<char> buffer = std::vector<char>(kBufferSize);
+  size_t begin = 0; // Received but unconsumed bytes are [begin, end)
+  size_t end = 0;
+
+  long ReadSome(char *data, size_t size) {
+    if (tls)
+      return tls->Read(data, size);
+    for (;;) {
+      ssize_t n = recv(fd, data, size, 0);
+      if (n >= 0 || errno != EINTR)
+        return static_cast<long>(n);
+    }
+  }
+
+  // Append to the buffer, compacting first; -1 on error, 0 on close
+  long ReadMore() {
+    if (begin == end) {
+      begin = end = 0;
+    } else if (end == buffer.size() && begin > 0) {
+      memmove(buffer.data(), buffer.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+    if (end == buffer.size())
+      return -1; // Head does not fit
+    long n = ReadSome(buffer.data() + end, buffer.size() - end);
+    if (n > 0)
+      end += static_cast<size_t>(n);
+    return n;
+  }
+
+  // Head and body pieces leave in gather writes straight from where they
+  // live; only read sources pass through the connection buffer
+  bool WriteRequest(std::string &head, const HttpBody &body) {
+    constexpr int kMaxParts = 64;
+    iovec parts[kMaxParts];
+    int count = 0;
+    parts[count++] = {&head[0], head.size()};
+
+    const auto &segments = body.Segments();
+    for (size_t i = 0; i < segments.size(); ++i) {
+      const HttpBody::Segment &segment = segments[i];
+      if (segment.data) {
+        if (count == kMaxParts) {
+          if (!WriteAll(parts, count))
+            return false;
+          count = 0;
+        }
+        parts[count++] = {const_cast<char *>(segment.data),
+                          static_cast<size_t>(segment.size)};
+        continue;
+      }
+
+      if (count > 0 && !WriteAll(parts, count))
+        return false;
+      count = 0;
+      for (uint64_t offset = 0; offset < segment.size;) {
+        size_t n = body.Read(i, offset, buffer.data(), buffer.size());
+        if (n == 0)
+          return false;
+        iovec piece = {buffer.data(), n};
+        if (!WriteAll(&piece, 1))
+          return false;
+        offset += n;
+      }
+    }
+    return count == 0 || WriteAll(parts, count);
+  }
+
+  bool WriteAll(iovec *parts, int count) {
+    if (tls) {
+      for (int i = 0; i < count; ++i) {
+        const char *data = static_cast<const char *>(parts[i].iov_base);
+        size_t left = parts[i].iov_len;
+        while (left > 0) {
+          long n = tls->Write(data, left);
+          if (n <= 0)
+            return false;
+          data += n;
+          left -= static_cast<size_t>(n);
+        }
+      }
+      return true;
+    }
+
+    while (count > 0) {
+      msghdr message = {};
+      message.msg_iov = parts;
+      message.msg_iovlen = static_cast<decltype(message.msg_iovlen)>(count);
+      ssize_t n = sendmsg(fd, &message, kSendFlags);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      size_t sent = static_cast<size_t>(n);
+      while (count > 0 && sent >= parts->iov_len) {
+        sent -= parts->iov_len;
+        ++parts;
+        --count;
+      }
+      if (count > 0) {
+        parts->iov_base = static_cast<char *>(parts->iov_base) + sent;
+        parts->iov_len -= sent;
+      }
+    }
+    return true;
+  }
+};
+
+// -----------------------------------------------------------------------------
+// Constructor / Destructor
+// -----------------------------------------------------------------------------
+
+SocketTransport::SocketTransport(std::shared_ptr<TlsProvider> tls)
+    : tls_(std::move(tls)) {}
+
+SocketTransport::~SocketTransport() { Shutdown(); }
+
+// -----------------------------------------------------------------------------
+// Initialize / Shutdown
+// -----------------------------------------------------------------------------
+
+bool SocketTransport::Initialize(const HttpTransportConfig &config) {
+  config_ = config;
+
+  ConnectionPoolConfig poolConfig;
+  poolConfig.maxPerHost = config_.maxConnectionsPerHost;
+  poolConfig.idleTimeoutMs = config_.idleConnectionTimeoutMs;
+  poolConfig.acquireTimeoutMs = config_.connectTimeoutMs;
+  pool_ = std::make_unique<ConnectionPool>(
+      poolConfig, [](ConnectionPool::Connection connection) {
+        Close(static_cast<Connection *>(connection));
+      });
+  return true;
+}
+
+void SocketTransport::Shutdown() { pool_.reset(); }
+
+ConnectionPoolStats SocketTransport::GetPoolStats() const {
+  return pool_ ? pool_->GetStats() : ConnectionPoolStats();
+}
+
+// -----------------------------------------------------------------------------
+// Connections
+// -----------------------------------------------------------------------------
+
+int ConnectHttpSocket(const HttpUrl &url, const HttpTransportConfig &config) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  if (getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(), &hints,
+                  &addresses) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo *ai = addresses; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (ConnectWithTimeout(fd, ai->ai_addr, ai->ai_addrlen,
+                           config.connectTimeoutMs)) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0)
+    return -1;
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  SetTimeout(fd, SO_RCVTIMEO, config.receiveTimeoutMs);
+  SetTimeout(fd, SO_SNDTIMEO, config.sendTimeoutMs);
+  return fd;
+}
+
+SocketTransport::Connection *SocketTransport::Open(const HttpUrl &url) {
+  int fd = ConnectHttpSocket(url, config_);
+  if (fd < 0)
+    return nullptr;
+
+  auto connection = std::make_unique<Connection>();
+  connection->fd = fd;
+  if (url.secure) {
+    connection->tls =
+        tls_ ? tls_->Connect(fd, url.host, {"http/1.1"}) : nullptr;
+    if (!connection->tls) {
+      close(fd);
+      return nullptr;
+    }
+  }
+  return connection.release();
+}
+
+void SocketTransport::Close(Connection *connection) {
+  if (!connection)
+    return;
+  connection->tls.reset(); // Before the socket goes away
+  close(connection->fd);
+  delete connection;
+}
+
+bool SocketTransport::IsStale(Connection *connection) {
+  // An idle keep-alive connection has nothing to read; anything readable
+  // is the server's close (or junk), so the connection can't carry a request
+  if (connection->begin != connection->end)
+    return true;
+  pollfd pfd = {connection->fd, POLLIN, 0};
+  return poll(&pfd, 1, 0) != 0;
+}
+
+// -----------------------------------------------------------------------------
+// Send
+// -----------------------------------------------------------------------------
+
+HttpResponse SocketTransport::Send(const HttpRequest &request,
+                                   const HttpChunkCallback &onChunk) {
+  HttpResponse response;
+  if (!pool_) {
+    response.error = L"HTTP transport not initialized";
+    return response;
+  }
+  if (request.url.secure && !tls_) {
+    response.error = L"HTTPS needs a TLS provider";
+    return response;
+  }
+
+  const std::string key = request.url.Origin();
+  bool retried = false;
+  for (;;) {
+    if (request.cancel && request.cancel->IsCancelled()) {
+      response = HttpResponse();
+      response.error = L"Cancelled";
+      return response;
+    }
+
+    bool reused = false;
+    Connection *connection = static_cast<Connection *>(pool_->Acquire(
+        key,
+        [&] {
+          return static_cast<ConnectionPool::Connection>(Open(request.url));
+        },
+        &reused));
+    if (!connection) {
+      response.error = L"Failed to connect to server";
+      return response;
+    }
+    if (reused && IsStale(connection)) {
+      pool_->Release(key, connection, false);
+      continue;
+    }
+
+    // Cancelling shuts the socket down, failing whichever read or write is
+    // blocked on it
+    CancellationToken::SubscriptionId subscription = 0;
+    if (request.cancel) {
+      const int fd = connection->fd;
+      subscription =
+          request.cancel->Subscribe([fd] { shutdown(fd, SHUT_RDWR); });
+    }
+
+    response = HttpResponse();
+    Outcome outcome = Exchange(connection, request, onChunk, response);
+
+    if (request.cancel) {
+      request.cancel->Unsubscribe(subscription);
+      if (request.cancel->IsCancelled()) {
+        // The socket may be shut down: never pooled, never sent again
+        pool_->Release(key, connection, false);
+        if (!response.error.empty())
+          response.error = L"Cancelled";
+        return response;
+      }
+    }
+    pool_->Release(key, connection, outcome == Outcome::Reusable);
+
+    // The server closed a kept-alive connection before reading the
+    // request: nothing was processed, so send it again on a new one
+    if (outcome == Outcome::Stale && reused && !retried) {
+      retried = true;
+      continue;
+    }
+    return response;
+  }
+}
+
+SocketTransport::Outcome
+SocketTransport::Exchange(Connection *connection, const HttpRequest &request,
+                          const HttpChunkCallback &onChunk,
+                          HttpResponse &response) {
+  const HttpUrl &url = request.url;
+
+  // Request head
+  std::string head;
+  head.reserve(256);
+  head += request.method;
+  head += ' ';
+  head += url.path;
+  head += " HTTP/1.1\r\nHost: ";
+  if (url.host.find(':') != std::string::npos) {
+    head += '[';
+    head += url.host;
+    head += ']';
+  } else {
+    head += url.host;
+  }
+  if (url.port != (url.secure ? 443 : 80)) {
+    head += ':';
+    head += std::to_string(url.port);
+  }
+  head += "\r\nUser-Agent: ";
+  head += config_.userAgent;
+  head += "\r\n";
+  for (const auto &header : request.headers) {
+    head += header.first;
+    head += ": ";
+    head += header.second;
+    head += "\r\n";
+  }
+  if (!request.body.Empty() || request.method == "POST" ||
+      request.method == "PUT") {
+    head += "Content-Length: ";
+    head += std::to_string(request.body.Size());
+    head += "\r\n";
+  }
+  head += "\r\n";
+
+  if (!connection->WriteRequest(head, request.body)) {
+    response.error = L"Failed to send request";
+    return Outcome::Stale;
+  }
+
+  // Response head (skipping interim 1xx responses)
+  size_t headLength = 0;
+  bool http10 = false;
+  for (;;) {
+    size_t scanned = 0;
+    for (;;) {
+      std::string_view received(connection->buffer.data() + connection->begin,
+                                connection->end - connection->begin);
+      size_t found = received.find("\r\n\r\n", scanned > 3 ? scanned - 3 : 0);
+      if (found != std::string_view::npos) {
+        headLength = found + 4;
+        break;
+      }
+      scanned = received.size();
+
+      bool gotAny = scanned > 0;
+      long n = connection->ReadMore();
+      if (n <= 0) {
+        response.error = L"Failed to receive response";
+        return gotAny ? Outcome::Close : Outcome::Stale;
+      }
+    }
+
+    std::string_view headText(connection->buffer.data() + connection->begin,
+                              headLength);
+    if (!ParseHttpResponseHead(headText, response)) {
+      response.error = L"Invalid response";
+      return Outcome::Close;
+    }
+    http10 = headText.compare(0, 8, "HTTP/1.0") == 0;
+    connection->begin += headLength;
+    if (response.statusCode >= 200 || response.statusCode == 101)
+      break;
+  }
+
+  // Body framing. HTTP/1.1 keeps the connection unless told to close;
+  // HTTP/1.0 only when it says keep-alive.
+  auto connectionHeader = response.headers.find("connection");
+  bool keepAlive = !http10;
+  if (connectionHeader != response.headers.end()) {
+    keepAlive = http10 ? ContainsToken(connectionHeader->second, "keep-alive")
+                       : !ContainsToken(connectionHeader->second, "close");
+  }
+
+  enum class Framing { None, Length, Chunked, UntilClose } framing;
+  uint64_t remaining = 0;
+  auto transferEncoding = response.headers.find("transfer-encoding");
+  if (request.method == "HEAD" || IsBodylessStatus(response.statusCode)) {
+    framing = Framing::None;
+  } else if (transferEncoding != response.headers.end() &&
+             ContainsToken(transferEncoding->second, "chunked")) {
+    framing = Framing::Chunked;
+  } else if (response.headers.count("content-length")) {
+    if (!HttpContentLength(response, remaining)) {
+      response.error = L"Invalid response";
+      return Outcome::Close;
+    }
+    framing = remaining ? Framing::Length : Framing::None;
+  } else {
+    framing = Framing::UntilClose;
+    keepAlive = false;
+  }
+
+  // Body: streamed to the caller on success, buffered otherwise
+  HttpBodyReader reader(response, onChunk);
+  if (framing == Framing::Length)
+    reader.Expect(remaining);
+  auto sink = [&](const char *data, size_t size) {
+    return reader.Append(data, size);
+  };
+
+  HttpChunkedDecoder decoder;
+  bool complete = framing == Framing::None;
+  while (!complete) {
+    // A buffered body of known length is received straight into its place
+    // once the bytes that arrived with the head are used up
+    if (connection->begin == connection->end && !reader.IsStreaming() &&
+        framing == Framing::Length) {
+      size_t want = static_cast<size_t>(
+          std::min<uint64_t>(remaining, HttpBodyReader::MAX_PREALLOCATION));
+      long n = connection->ReadSome(reader.Prepare(want), want);
+      if (n <= 0) {
+        response.error = L"Failed to receive response";
+        return Outcome::Close;
+      }
+      reader.Commit(static_cast<size_t>(n));
+      remaining -= std::min<uint64_t>(remaining, static_cast<uint64_t>(n));
+      complete = remaining == 0;
+      continue;
+    }
+
+    if (connection->begin == connection->end) {
+      long n = connection->ReadMore();
+      if (n == 0 && framing == Framing::UntilClose)
+        break; // Close marks the end
+      if (n <= 0) {
+        response.error = L"Failed to receive response";
+        return Outcome::Close;
+      }
+    }
+
+    const char *data = connection->buffer.data() + connection->begin;
+    size_t available = connection->end - connection->begin;
+    if (framing == Framing::Chunked) {
+      connection->begin += decoder.Feed(data, available, sink);
+      if (decoder.HasError()) {
+        response.error = L"Invalid response";
+        return Outcome::Close;
+      }
+      complete = decoder.IsDone();
+    } else {
+      size_t take = available;
+      if (framing == Framing::Length)
+        take = static_cast<size_t>(std::min<uint64_t>(remaining, available));
+      connection->begin += take;
+      remaining -= std::min<uint64_t>(remaining, take);
+      sink(data, take);
+      complete = framing == Framing::Length && remaining == 0;
+    }
+
+    if (reader.IsCancelled()) {
+      response.error = L"Cancelled";
+      return Outcome::Close;
+    }
+  }
+
+  // Anything after the response would be out of step with the next one
+  if (!keepAlive || connection->begin != connection->end)
+    return Outcome::Close;
+  return Outcome::Reusable;
+}
+
+} // namespace invisible
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "http_transport.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// TLS Layer
+// The socket transport speaks plain TCP; https goes through a provider
+// plugged in at runtime, so the transport carries no TLS library of its own.
+// -----------------------------------------------------------------------------
+
+class TlsSession {
+public:
+  virtual ~TlsSession() = default;
+
+  // Bytes read (> 0), 0 on orderly close, < 0 on error
+  virtual long Read(void *buffer, size_t size) = 0;
+
+  // Bytes written (> 0) or < 0 on error
+  virtual long Write(const void *data, size_t size) = 0;
+
+  // Decrypted bytes buffered inside the session (readable without the
+  // socket becoming readable)
+  virtual size_t Pending() const { return 0; }
+
+  // Application protocol chosen through ALPN ("h2", "http/1.1"), or empty
+  virtual std::string Protocol() const { return std::string(); }
+};
+
+class TlsProvider {
+public:
+  virtual ~TlsProvider() = default;
+
+  // Run the client handshake on a connected socket and verify `host`,
+  // offering `protocols` through ALPN in order of preference. Returns
+  // nullptr on failure; the caller still owns and closes `socket`.
+  virtual std::unique_ptr<TlsSession>
+  Connect(int socket, const std::string &host,
+          const std::vector<std::string> &protocols) = 0;
+};
+
+// Open a TCP connection to `url` with the config's connect, send and
+// receive timeouts (TCP_NODELAY, close-on-exec); -1 on failure
+int ConnectHttpSocket(const HttpUrl &url, const HttpTransportConfig &config);
+
+// -----------------------------------------------------------------------------
+// Socket Transport (POSIX)
+// HTTP/1.1 over BSD sockets: persistent connections through the shared
+// ConnectionPool, Content-Length, chunked and read-until-close bodies, and
+// request head and body pieces written with gather calls (no joined copy). A pooled connection
+// the server has meanwhile closed is detected before use, and a request
+// whose reused connection fails before any response byte arrives is sent
+// once more on a fresh connection. Cancelling a request's token shuts its
+// socket down.
+// -----------------------------------------------------------------------------
+
+class SocketTransport : public HttpTransport {
+public:
+  explicit SocketTransport(std::shared_ptr<TlsProvider> tls = nullptr);
+  ~SocketTransport() override;
+
+  // Disable copy
+  SocketTransport(const SocketTransport &) = delete;
+  SocketTransport &operator=(const SocketTransport &) = delete;
+
+  bool Initialize(const HttpTransportConfig &config) override;
+  void Shutdown() override;
+
+  HttpResponse Send(const HttpRequest &request,
+                    const HttpChunkCallback &onChunk) override;
+
+  ConnectionPoolStats GetPoolStats() const override;
+
+private:
+  struct Connection;
+  enum class Outcome { Reusable, Close, Stale };
+
+  Connection *Open(const HttpUrl &url);
+  static void Close(Connection *connection);
+  static bool IsStale(Connection *connection);
+
+  Outcome Exchange(Connection *connection, const HttpRequest &request,
+                   const HttpChunkCallback &onChunk, HttpResponse &response);
+
+  std::shared_ptr<TlsProvider> tls_;
+  HttpTransportConfig config_;
+  std::unique_ptr<ConnectionPool> pool_;
+};
+
+} // namespace invisible
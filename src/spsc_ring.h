@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace invisible {
+
+// Separates producer- and consumer-owned indices so they never share a line
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4324) // Structure padded due to alignment specifier
+#endif
+
+// -----------------------------------------------------------------------------
+// Single-Producer / Single-Consumer Ring
+// Fixed capacity (rounded up to a power of two), slots preallocated up front.
+// Both sides are wait-free: each owns one index and keeps a cached copy of
+// the other's, so the shared line is only touched when the cache runs out.
+// Slots are filled and drained in place (BeginPush/CommitPush, Front/Pop),
+// so large elements are never copied through the ring.
+// -----------------------------------------------------------------------------
+
+template <typename T> class SpscRing {
+public:
+  explicit SpscRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.reset(new T[size]);
+    mask_ = size - 1;
+  }
+
+  // Disable copy
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // --- Producer side ---
+
+  // Next free slot, or nullptr when the ring is full
+  T *BeginPush() {
+    size_t tail = tail_.value.load(std::memory_order_relaxed);
+    if (tail - producer_.cachedHead > mask_) {
+      producer_.cachedHead = head_.value.load(std::memory_order_acquire);
+      if (tail - producer_.cachedHead > mask_) {
+        return nullptr;
+      }
+    }
+    return &slots_[tail & mask_];
+  }
+
+  // Publish the slot returned by BeginPush()
+  void CommitPush() {
+    tail_.value.store(tail_.value.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_release);
+  }
+
+  // Free slots as seen by the producer (may under-report, never over-report)
+  size_t FreeSlots() {
+    size_t tail = tail_.value.load(std::memory_order_relaxed);
+    producer_.cachedHead = head_.value.load(std::memory_order_acquire);
+    return Capacity() - (tail - producer_.cachedHead);
+  }
+
+  // --- Consumer side ---
+
+  // Oldest published slot, or nullptr when the ring is empty
+  T *Front() {
+    size_t head = head_.value.load(std::memory_order_relaxed);
+    if (head == consumer_.cachedTail) {
+      consumer_.cachedTail = tail_.value.load(std::memory_order_acquire);
+      if (head == consumer_.cachedTail) {
+        return nullptr;
+      }
+    }
+    return &slots_[head & mask_];
+  }
+
+  // Release the slot returned by Front()
+  void Pop() {
+    head_.value.store(head_.value.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_release);
+  }
+
+  // --- Either side (approximate while the other side is running) ---
+
+  size_t Size() const {
+    size_t head = head_.value.load(std::memory_order_acquire);
+    size_t tail = tail_.value.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  bool Empty() const { return Size() == 0; }
+  size_t Capacity() const { return mask_ + 1; }
+
+  // Direct slot access for preallocation (only before either side starts)
+  T &Slot(size_t index) { return slots_[index & mask_]; }
+
+private:
+  struct alignas(CACHE_LINE_SIZE) Index {
+    std::atomic<size_t> value{0};
+  };
+
+  struct alignas(CACHE_LINE_SIZE) ProducerCache {
+    size_t cachedHead = 0;
+  };
+
+  struct alignas(CACHE_LINE_SIZE) ConsumerCache {
+    size_t cachedTail = 0;
+  };
+
+  std::unique_ptr<T[]> slots_;
+  size_t mask_ = 0;
+
+  Index head_;              // Written by the consumer
+  ConsumerCache consumer_;
+  Index tail_;              // Written by the producer
+  ProducerCache producer_;
+};
+
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+} // namespace invisible
@@ -0,0 +1,156 @@
+#include "sse_parser.h"
+#include <cstring>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Constructor / Reset
+// -----------------------------------------------------------------------------
+
+SseParser::SseParser(EventCallback onEvent) : onEvent_(std::move(onEvent)) {}
+
+void SseParser::Reset() {
+  line_.clear();
+  event_ = SseEvent();
+  hasData_ = false;
+  skipLineFeed_ = false;
+  atStart_ = true;
+  stopped_ = false;
+  eventCount_ = 0;
+  retryMs_ = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Feed
+// -----------------------------------------------------------------------------
+
+bool SseParser::Feed(const char *data, size_t size) {
+  if (stopped_)
+    return false;
+
+  const char *p = data;
+  const char *end = data + size;
+
+  if (skipLineFeed_ && p < end) {
+    if (*p == '\n')
+      ++p;
+    skipLineFeed_ = false;
+  }
+
+  if (atStart_) {
+    // A BOM can itself arrive split; hold the bytes until it is decided
+    static const char kBom[] = "\xEF\xBB\xBF";
+    while (p < end && line_.size() < 3 && *p == kBom[line_.size()]) {
+      line_ += *p++;
+    }
+    if (line_.size() == 3) {
+      line_.clear();
+      atStart_ = false;
+    } else if (p < end) {
+      atStart_ = false; // Not a BOM: the held bytes are ordinary text
+    } else {
+      return true;
+    }
+  }
+
+  while (p < end) {
+    // Lines end at CR, LF or CRLF
+    const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+    const char *stop = lf ? lf : end;
+    const char *cr = static_cast<const char *>(memchr(p, '\r', stop - p));
+    const char *eol = cr ? cr : lf;
+
+    if (!eol) {
+      line_.append(p, end - p);
+      break;
+    }
+
+    bool ok;
+    if (line_.empty()) {
+      ok = ProcessLine(std::string_view(p, eol - p)); // No copy
+    } else {
+      line_.append(p, eol - p);
+      ok = ProcessLine(line_);
+      line_.clear();
+    }
+
+    p = eol + 1;
+    if (*eol == '\r') {
+      if (p < end) {
+        if (*p == '\n')
+          ++p;
+      } else {
+        skipLineFeed_ = true;
+      }
+    }
+
+    if (!ok) {
+      stopped_ = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Lines and Events
+// -----------------------------------------------------------------------------
+
+bool SseParser::ProcessLine(std::string_view line) {
+  if (line.empty())
+    return Dispatch();
+  if (line[0] == ':')
+    return true; // Comment / keep-alive
+
+  std::string_view field = line;
+  std::string_view value;
+  size_t colon = line.find(':');
+  if (colon != std::string_view::npos) {
+    field = line.substr(0, colon);
+    value = line.substr(colon + 1);
+    if (!value.empty() && value[0] == ' ')
+      value.remove_prefix(1);
+  }
+
+  if (field == "data") {
+    event_.data.append(value.data(), value.size());
+    event_.data += '\n';
+    hasData_ = true;
+  } else if (field == "event") {
+    event_.type.assign(value.data(), value.size());
+  } else if (field == "id") {
+    if (value.find('\0') == std::string_view::npos)
+      event_.lastEventId.assign(value.data(), value.size());
+  } else if (field == "retry") {
+    uint32_t ms = 0;
+    bool digits = !value.empty();
+    for (char c : value) {
+      if (c < '0' || c > '9') {
+        digits = false;
+        break;
+      }
+      ms = ms * 10 + static_cast<uint32_t>(c - '0');
+    }
+    if (digits)
+      retryMs_ = ms;
+  }
+  return true;
+}
+
+bool SseParser::Dispatch() {
+  if (!hasData_) {
+    event_.type = "message";
+    return true;
+  }
+
+  event_.data.pop_back(); // Trailing '\n' from the last data line
+  ++eventCount_;
+  bool keepGoing = onEvent_ ? onEvent_(event_) : true;
+
+  event_.type = "message";
+  event_.data.clear();
+  hasData_ = false;
+  return keepGoing;
+}
+
+} // namespace invisible
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Server-Sent Event
+// -----------------------------------------------------------------------------
+
+struct SseEvent {
+  std::string type = "message"; // "event:" field
+  std::string data;             // "data:" lines joined with '\n'
+  std::string lastEventId;      // "id:" field (persists across events)
+};
+
+// -----------------------------------------------------------------------------
+// Incremental SSE Parser (text/event-stream)
+// Accepts the response body in whatever pieces the network delivers, split
+// anywhere (including between CR and LF), and dispatches each event as soon
+// as its terminating blank line arrives. Follows the WHATWG parsing rules:
+// comments (":") are ignored, one space after the colon is dropped, and an
+// event without data lines is not dispatched.
+// -----------------------------------------------------------------------------
+
+class SseParser {
+public:
+  // Return false to stop parsing (e.g. on "[DONE]" or cancellation)
+  using EventCallback = std::function<bool(const SseEvent &event)>;
+
+  explicit SseParser(EventCallback onEvent);
+
+  // Feed more of the stream. Returns false once the callback has asked to
+  // stop; later calls are ignored until Reset().
+  bool Feed(const char *data, size_t size);
+
+  // Forget any partial line or event (a half-received event at end of
+  // stream is discarded, as the spec requires)
+  void Reset();
+
+  uint64_t GetEventCount() const { return eventCount_; }
+  uint32_t GetRetryMs() const { return retryMs_; }
+
+private:
+  bool ProcessLine(std::string_view line);
+  bool Dispatch();
+
+  EventCallback onEvent_;
+  std::string line_;        // Partial line carried between Feed() calls
+  SseEvent event_;
+  bool hasData_ = false;
+  bool skipLineFeed_ = false; // Previous piece ended in CR
+  bool atStart_ = true;       // A leading UTF-8 BOM is skipped
+  bool stopped_ = false;
+  uint64_t eventCount_ = 0;
+  uint32_t retryMs_ = 0;
+};
+
+} // namespace invisible
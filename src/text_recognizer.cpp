@@ -0,0 +1,978 @@
+#include "text_recognizer.h"
+#include "simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace invisible {
+
+namespace {
+
+constexpr int kGridCells = TextRecognizer::kGridSize * TextRecognizer::kGridSize;
+constexpr int kCoarseCells = kGridCells / 4;
+
+// Each coarse cell is the rounded-down mean of 2x2 grid cells, so four times
+// the coarse distance is within 3 per coarse cell of a lower bound on the
+// grid distance
+constexpr int kCoarseSlack = 3 * kCoarseCells;
+
+// Coverage (0-255) from which a pixel counts as ink
+constexpr int kInkLevel = 90;
+
+// Weight of size and placement against shape: one x-height of difference
+// in one of them costs as much as this much mean coverage difference
+constexpr int kPlaceWeight = 96;
+
+// Cost of each band of ink rows one symbol has more than the other, so a
+// broken stroke (! ; i) and a whole one (l | I) do not match on shape alone
+constexpr int kBandCost = 24;
+
+// Thin symbols are padded to this aspect ratio before gridding, so an 'l'
+// stays a bar instead of filling the grid
+constexpr int kMaxAspect = 3;
+
+// Lines with this many symbols give a dependable x-height
+constexpr size_t kSettledSymbols = 8;
+
+// A symbol whose closest glyph of another character is less than this
+// further away than its own is ambiguous; margins are only told apart up
+// to this, which lets the search stop early
+constexpr int kAmbiguousMargin = 8;
+
+// Symbols of a line read under each candidate baseline and x-height
+constexpr size_t kSampleSymbols = 12;
+
+// Glyphs that touch (rt, ry, ow in small or tight text) are read as one
+// unknown symbol. A wide symbol this far from every template is tried cut
+// at its thinnest columns, and the cut kept when both halves match better
+// by kSplitGain; halves are cut again up to kMaxSplitDepth.
+constexpr int kSplitDistance = 24;
+constexpr int kSplitGain = 8;
+constexpr int kMaxSplitDepth = 2;
+constexpr size_t kMaxCuts = 3;
+
+struct Component {
+  int left, top, right, bottom; // right/bottom exclusive
+  int pixels;
+};
+
+struct Symbol {
+  int left, top, right, bottom;
+  char c = '?';
+  int distance = 0;
+  int margin = 0; // To the closest glyph of another character
+};
+
+struct Line {
+  int top, bottom;
+  std::vector<Symbol> symbols;
+  int baseline = 0;
+  int xHeight = 0;
+};
+
+inline int Width(const Symbol &s) { return s.right - s.left; }
+inline int Height(const Symbol &s) { return s.bottom - s.top; }
+
+// BT.601 luma in 8 bits
+void ToLuma(const ImageView &image, std::vector<uint8_t> &luma) {
+  luma.resize(static_cast<size_t>(image.width) * image.height);
+  uint8_t *out = luma.data();
+  for (int y = 0; y < image.height; ++y) {
+    const uint8_t *p = image.Row(y);
+    for (int x = 0; x < image.width; ++x, p += 4)
+      *out++ = static_cast<uint8_t>((p[0] * 29 + p[1] * 150 + p[2] * 77) >> 8);
+  }
+}
+
+// Otsu's threshold: the level splitting the histogram into the two classes
+// with the largest between-class variance
+int OtsuThreshold(const uint64_t histogram[256]) {
+  uint64_t total = 0, sum = 0;
+  for (int i = 0; i < 256; ++i) {
+    total += histogram[i];
+    sum += static_cast<uint64_t>(i) * histogram[i];
+  }
+
+  uint64_t below = 0, sumBelow = 0;
+  double best = -1.0;
+  int threshold = 128;
+  for (int t = 0; t < 256; ++t) {
+    below += histogram[t];
+    sumBelow += static_cast<uint64_t>(t) * histogram[t];
+    if (below == 0 || below == total)
+      continue;
+    uint64_t above = total - below;
+    double meanBelow = static_cast<double>(sumBelow) / below;
+    double meanAbove = static_cast<double>(sum - sumBelow) / above;
+    double between = static_cast<double>(below) * above *
+                     (meanBelow - meanAbove) * (meanBelow - meanAbove);
+    if (between > best) {
+      best = between;
+      threshold = t;
+    }
+  }
+  return threshold;
+}
+
+// Most frequent level in [first, last]
+int HistogramMode(const uint64_t histogram[256], int first, int last) {
+  int mode = first;
+  for (int i = first; i <= last; ++i)
+    if (histogram[i] > histogram[mode])
+      mode = i;
+  return mode;
+}
+
+// Ink coverage of every pixel given the background and ink levels
+void ToCoverage(const std::vector<uint8_t> &luma, int background, int ink,
+                std::vector<uint8_t> &coverage) {
+  uint8_t table[256];
+  const int range = std::abs(ink - background);
+  for (int i = 0; i < 256; ++i) {
+    int toward = ink < background ? background - i : i - background;
+    table[i] = static_cast<uint8_t>(
+        std::clamp(toward * 255 / std::max(range, 1), 0, 255));
+  }
+  coverage.resize(luma.size());
+  for (size_t i = 0; i < luma.size(); ++i)
+    coverage[i] = table[luma[i]];
+}
+
+int FindRoot(std::vector<int> &parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+// 8-connected components of coverage >= kInkLevel, labelled by runs
+void FindComponents(const std::vector<uint8_t> &coverage, int width,
+                    int height, std::vector<Component> &components) {
+  struct Run {
+    int x0, x1; // x1 exclusive
+    int y;
+  };
+  std::vector<Run> runs;
+  std::vector<int> parent;
+  size_t previousBegin = 0, previousEnd = 0;
+
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *row = coverage.data() + static_cast<size_t>(y) * width;
+    const size_t rowBegin = runs.size();
+    for (int x = 0; x < width;) {
+      if (row[x] < kInkLevel) {
+        ++x;
+        continue;
+      }
+      int start = x;
+      while (x < width && row[x] >= kInkLevel)
+        ++x;
+      runs.push_back(Run{start, x, y});
+      parent.push_back(static_cast<int>(parent.size()));
+    }
+
+    // Join runs touching one of the previous row (diagonals included)
+    size_t p = previousBegin;
+    for (size_t r = rowBegin; r < runs.size(); ++r) {
+      while (p < previousEnd && runs[p].x1 < runs[r].x0)
+        ++p;
+      for (size_t q = p; q < previousEnd && runs[q].x0 <= runs[r].x1; ++q) {
+        int a = FindRoot(parent, static_cast<int>(q));
+        int b = FindRoot(parent, static_cast<int>(r));
+        if (a != b)
+          parent[std::max(a, b)] = std::min(a, b);
+      }
+    }
+    previousBegin = rowBegin;
+    previousEnd = runs.size();
+  }
+
+  components.clear();
+  std::vector<int> index(runs.size(), -1);
+  for (size_t r = 0; r < runs.size(); ++r) {
+    int root = FindRoot(parent, static_cast<int>(r));
+    const Run &run = runs[r];
+    if (index[root] < 0) {
+      index[root] = static_cast<int>(components.size());
+      components.push_back(Component{run.x0, run.y, run.x1, run.y + 1, 0});
+    }
+    Component &c = components[index[root]];
+    c.left = std::min(c.left, run.x0);
+    c.right = std::max(c.right, run.x1);
+    c.bottom = std::max(c.bottom, run.y + 1);
+    c.pixels += run.x1 - run.x0;
+  }
+}
+
+int Percentile(std::vector<int> values, int percent) {
+  if (values.empty())
+    return 0;
+  size_t k = (values.size() - 1) * percent / 100;
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+// Runs of rows where `count` (components starting minus components ending
+// on each row) adds up to some ink
+std::vector<Line> InkBands(const std::vector<int> &count, int height) {
+  std::vector<Line> bands;
+  int running = 0;
+  for (int y = 0; y < height; ++y) {
+    int before = running;
+    running += count[y];
+    if (running > 0 && before == 0)
+      bands.push_back(Line{y, y + 1, {}, 0, 0});
+    else if (running > 0)
+      bands.back().bottom = y + 1;
+  }
+  return bands;
+}
+
+// Bands of rows holding ink, with bands much shorter than a neighbor they
+// nearly touch (the dots of a line of i's) joined to it. Only components
+// of ordinary height count: braces and bars may reach into the next line.
+// A tall component between bands (a '}' closing a block on its own line)
+// makes a band of its own.
+std::vector<Line> FindLines(const std::vector<Component> &components,
+                            int height) {
+  std::vector<int> heights;
+  for (const Component &c : components)
+    heights.push_back(c.bottom - c.top);
+  const int tall = Percentile(heights, 50) * 9 / 5;
+
+  std::vector<int> count(static_cast<size_t>(height) + 1, 0);
+  for (const Component &c : components) {
+    if (c.bottom - c.top > tall)
+      continue;
+    count[c.top]++;
+    count[c.bottom]--;
+  }
+  std::vector<Line> bands = InkBands(count, height);
+
+  bool alone = false;
+  for (const Component &c : components) {
+    const int middle = (c.top + c.bottom) / 2;
+    if (c.bottom - c.top <= tall ||
+        std::any_of(bands.begin(), bands.end(), [&](const Line &band) {
+          return middle >= band.top && middle < band.bottom;
+        }))
+      continue;
+    count[c.top]++;
+    count[c.bottom]--;
+    alone = true;
+  }
+  if (alone)
+    bands = InkBands(count, height);
+
+  std::vector<Line> lines;
+  for (size_t i = 0; i < bands.size(); ++i) {
+    Line band = bands[i];
+    int h = band.bottom - band.top;
+    if (i + 1 < bands.size()) {
+      const Line &next = bands[i + 1];
+      int nextHeight = next.bottom - next.top;
+      if (h * 2 < nextHeight && next.top - band.bottom <= nextHeight / 3 + 1) {
+        bands[i + 1].top = band.top;
+        continue;
+      }
+    }
+    if (!lines.empty()) {
+      Line &last = lines.back();
+      int lastHeight = last.bottom - last.top;
+      if (h * 2 < lastHeight && band.top - last.bottom <= lastHeight / 3 + 1) {
+        last.bottom = band.bottom;
+        continue;
+      }
+    }
+    lines.push_back(band);
+  }
+  return lines;
+}
+
+// The line whose band holds (or is nearest to) a component's middle row,
+// if it is no further away than the band is tall
+int NearestLine(const std::vector<Line> &lines, const Component &c) {
+  const int middle = (c.top + c.bottom) / 2;
+  auto it = std::upper_bound(
+      lines.begin(), lines.end(), middle,
+      [](int y, const Line &line) { return y < line.bottom; });
+  int best = -1, bestDistance = 0;
+  for (auto candidate : {it - 1, it}) {
+    if (candidate < lines.begin() || candidate >= lines.end())
+      continue;
+    int distance = std::max({candidate->top - middle,
+                             middle + 1 - candidate->bottom, 0});
+    if (distance > candidate->bottom - candidate->top)
+      continue;
+    if (best < 0 || distance < bestDistance) {
+      best = static_cast<int>(candidate - lines.begin());
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+// Components of one line in reading order, with those stacked over one
+// another (i, j, :, =, %, !) joined into one symbol
+void GroupSymbols(std::vector<Component> &members, Line &line) {
+  std::sort(members.begin(), members.end(),
+            [](const Component &a, const Component &b) {
+              return a.left < b.left;
+            });
+  for (const Component &c : members) {
+    if (!line.symbols.empty()) {
+      Symbol &s = line.symbols.back();
+      int overlap = std::min(s.right, c.right) - std::max(s.left, c.left);
+      int narrower = std::min(Width(s), c.right - c.left);
+      bool stacked = c.top >= s.bottom || c.bottom <= s.top;
+      if (overlap * 5 >= narrower * 4 ||
+          (stacked && overlap * 2 >= narrower)) {
+        s.left = std::min(s.left, c.left);
+        s.top = std::min(s.top, c.top);
+        s.right = std::max(s.right, c.right);
+        s.bottom = std::max(s.bottom, c.bottom);
+        continue;
+      }
+    }
+    Symbol s;
+    s.left = c.left;
+    s.top = c.top;
+    s.right = c.right;
+    s.bottom = c.bottom;
+    line.symbols.push_back(s);
+  }
+}
+
+// Shrink a symbol's box to the ink inside it; false if there is none
+bool TrimToInk(const std::vector<uint8_t> &coverage, int mapWidth,
+               Symbol &s) {
+  int left = s.right, top = s.bottom, right = s.left, bottom = s.top;
+  for (int y = s.top; y < s.bottom; ++y) {
+    const uint8_t *row = coverage.data() + static_cast<size_t>(y) * mapWidth;
+    for (int x = s.left; x < s.right; ++x) {
+      if (row[x] >= kInkLevel) {
+        left = std::min(left, x);
+        right = std::max(right, x + 1);
+        top = std::min(top, y);
+        bottom = std::max(bottom, y + 1);
+      }
+    }
+  }
+  if (left >= right)
+    return false;
+  s.left = left;
+  s.top = top;
+  s.right = right;
+  s.bottom = bottom;
+  return true;
+}
+
+// Columns of a symbol where two touching glyphs may meet: the ones with
+// the least ink, at least `margin` from either side
+void CutCandidates(const std::vector<uint8_t> &coverage, int mapWidth,
+                   const Symbol &s, int margin, std::vector<int> &cuts) {
+  cuts.clear();
+  std::vector<std::pair<int, int>> columns; // (ink, x)
+  for (int x = s.left + margin; x <= s.right - margin; ++x) {
+    int ink = 0;
+    for (int y = s.top; y < s.bottom; ++y)
+      ink += coverage[static_cast<size_t>(y) * mapWidth + x];
+    columns.emplace_back(ink, x);
+  }
+  std::sort(columns.begin(), columns.end());
+  for (const auto &column : columns) {
+    bool near = false;
+    for (int cut : cuts)
+      near = near || std::abs(cut - column.second) < 2;
+    if (!near)
+      cuts.push_back(column.second);
+    if (cuts.size() == kMaxCuts)
+      break;
+  }
+}
+
+// Where the line's baseline may be: the most common bottoms of full-size
+// symbols, most common first. A short line of brackets and digits has as
+// many bottoms below the baseline as on it, so more than one is tried.
+void BaselineCandidates(const Line &line, std::vector<int> &baselines) {
+  baselines.clear();
+  const int bandHeight = line.bottom - line.top;
+  const int tolerance = std::max(1, bandHeight / 16);
+  std::vector<int> bottoms;
+  for (const Symbol &s : line.symbols)
+    if (Height(s) * 10 >= bandHeight * 3)
+      bottoms.push_back(s.bottom);
+  if (bottoms.empty())
+    for (const Symbol &s : line.symbols)
+      bottoms.push_back(s.bottom);
+  std::sort(bottoms.begin(), bottoms.end());
+
+  // Clusters of bottoms within the tolerance, by size
+  std::vector<std::pair<int, int>> clusters; // (-count, median bottom)
+  for (size_t i = 0; i < bottoms.size();) {
+    size_t j = i;
+    while (j < bottoms.size() && bottoms[j] - bottoms[i] <= tolerance)
+      ++j;
+    clusters.emplace_back(-static_cast<int>(j - i), bottoms[(i + j) / 2]);
+    i = j;
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const std::pair<int, int> &a,
+                      const std::pair<int, int> &b) {
+                     return a.first < b.first;
+                   });
+  for (size_t i = 0; i < clusters.size() && i < 3; ++i)
+    baselines.push_back(clusters[i].second);
+}
+
+// Lowercase height for a baseline: the short letters' height when the line
+// has both short and tall letters on it, otherwise the tall letters'
+int XHeightFor(const Line &line, int baseline) {
+  const int bandHeight = line.bottom - line.top;
+  const int tolerance = std::max(1, bandHeight / 16);
+  std::vector<int> heights;
+  for (const Symbol &s : line.symbols)
+    if (std::abs(s.bottom - baseline) <= tolerance &&
+        Height(s) * 10 >= bandHeight * 3)
+      heights.push_back(Height(s));
+  if (heights.empty())
+    return std::max(1, bandHeight / 2);
+  int low = Percentile(heights, 25);
+  int high = Percentile(heights, 90);
+  return std::max(1, high * 4 >= low * 5 ? low : high);
+}
+
+// Whether nearly all centre-to-centre steps fall on multiples of one
+// pitch (1/64 pixel), as in monospaced text
+bool FindPitch(const std::vector<Line> &lines, int &pitch64) {
+  std::vector<int> steps; // In 1/64 pixel
+  for (const Line &line : lines) {
+    for (size_t i = 1; i < line.symbols.size(); ++i) {
+      const Symbol &a = line.symbols[i - 1];
+      const Symbol &b = line.symbols[i];
+      steps.push_back((b.left + b.right - a.left - a.right) * 32);
+    }
+  }
+  if (steps.size() < 8)
+    return false;
+
+  // Candidate: a typical step (most are one pitch; word gaps and narrow
+  // neighbours pull the others up or down), refined as the mean near it
+  int guess = Percentile(steps, 40);
+  if (guess <= 0)
+    return false;
+  int64_t sum = 0, n = 0;
+  for (int step : steps) {
+    if (std::abs(step - guess) * 6 <= guess) {
+      sum += step;
+      n++;
+    }
+  }
+  if (n == 0)
+    return false;
+  pitch64 = static_cast<int>(sum / n);
+
+  int onGrid = 0;
+  for (int step : steps) {
+    int k = (step + pitch64 / 2) / pitch64;
+    if (k >= 1 && std::abs(step - k * pitch64) * 5 <= pitch64)
+      onGrid++;
+  }
+  return onGrid * 10 >= static_cast<int>(steps.size()) * 9;
+}
+
+// Sum of absolute differences of `count` bytes (a multiple of 16, aligned)
+#if INVISIBLE_HAVE_SSE2
+int Sad(const uint8_t *a, const uint8_t *b, int count) {
+  __m128i sum = _mm_setzero_si128();
+  for (int i = 0; i < count; i += 16) {
+    __m128i va = _mm_load_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_load_si128(reinterpret_cast<const __m128i *>(b + i));
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+  }
+  return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+#else
+int Sad(const uint8_t *a, const uint8_t *b, int count) {
+  int sum = 0;
+  for (int i = 0; i < count; ++i)
+    sum += std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+  return sum;
+}
+#endif
+
+// Size and placement part of the distance
+// (of Features or templates, which keep the same fields)
+template <typename A, typename B>
+inline int PlaceDistance(const A &a, const B &b) {
+  int sum = std::abs(a.width - b.width) + std::abs(a.height - b.height) +
+            std::abs(a.top - b.top) + std::abs(a.bottom - b.bottom);
+  return sum * kPlaceWeight / 64 + std::abs(a.bands - b.bands) * kBandCost;
+}
+
+} // namespace
+
+TextRecognizer::TextRecognizer(const TextRecognizerConfig &config)
+    : config_(config) {}
+
+const char *TextRecognizer::DefaultAlphabet() {
+  return "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+         "[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~";
+}
+
+bool TextRecognizer::HasSimd() { return INVISIBLE_HAVE_SSE2 != 0; }
+
+// -----------------------------------------------------------------------------
+// Features
+// -----------------------------------------------------------------------------
+
+void TextRecognizer::ExtractFeatures(const uint8_t *coverage, int mapWidth,
+                                     const ImageRect &box, int baseline,
+                                     int xHeight, Features &features) {
+  constexpr int G = kGridSize;
+
+  // Thin boxes are padded so they keep their shape in the grid
+  int w = std::max(box.width, (box.height + kMaxAspect - 1) / kMaxAspect);
+  int h = std::max(box.height, (box.width + kMaxAspect - 1) / kMaxAspect);
+
+  int peak = 1;
+  int64_t total = 0, sumX = 0, sumY = 0;
+  features.bands = 0;
+  bool inBand = false;
+  for (int y = 0; y < box.height; ++y) {
+    const uint8_t *row =
+        coverage + static_cast<size_t>(box.y + y) * mapWidth + box.x;
+    int rowPeak = 0;
+    for (int x = 0; x < box.width; ++x) {
+      rowPeak = std::max(rowPeak, static_cast<int>(row[x]));
+      total += row[x];
+      sumX += static_cast<int64_t>(row[x]) * (2 * x + 1);
+      sumY += static_cast<int64_t>(row[x]) * (2 * y + 1);
+    }
+    peak = std::max(peak, rowPeak);
+    bool ink = rowPeak >= kInkLevel;
+    if (ink && !inBand)
+      features.bands++;
+    inBand = ink;
+  }
+
+  // The padding puts the ink's centre of mass in the middle (in 1/G pixel):
+  // a stem's antialiased edges fall differently at every size, and
+  // centring the box instead would move the stem around the grid
+  auto padding = [&](int size, int padded, int64_t sum) {
+    if (padded == size || total == 0)
+      return 0;
+    int64_t centre = sum * G / (2 * total);
+    int64_t pad = static_cast<int64_t>(padded) * G / 2 - centre;
+    return static_cast<int>(
+        std::min<int64_t>(std::max<int64_t>(pad, 0), (padded - size) * G));
+  };
+  const int padX = padding(box.width, w, sumX);
+  const int padY = padding(box.height, h, sumY);
+
+  // Exact area resampling: in units of 1/kGridSize pixel, source pixel s
+  // spans [s * G, s * G + G) and grid cell k spans [k * w, k * w + w)
+  int64_t cells[kGridCells] = {};
+  int64_t rowCells[G];
+  for (int y = 0; y < box.height; ++y) {
+    const uint8_t *row =
+        coverage + static_cast<size_t>(box.y + y) * mapWidth + box.x;
+    std::fill(rowCells, rowCells + G, 0);
+    for (int x = 0; x < box.width; ++x) {
+      if (!row[x])
+        continue;
+      int s0 = x * G + padX, s1 = s0 + G;
+      for (int k = s0 / w; k < G && k * w < s1; ++k) {
+        int overlap = std::min(s1, (k + 1) * w) - std::max(s0, k * w);
+        rowCells[k] += static_cast<int64_t>(row[x]) * overlap;
+      }
+    }
+    int s0 = y * G + padY, s1 = s0 + G;
+    for (int k = s0 / h; k < G && k * h < s1; ++k) {
+      int overlap = std::min(s1, (k + 1) * h) - std::max(s0, k * h);
+      for (int i = 0; i < G; ++i)
+        cells[k * G + i] += rowCells[i] * overlap;
+    }
+  }
+
+  // Cell average over w * h area units, scaled so the darkest ink is 255
+  const int64_t area = static_cast<int64_t>(w) * h;
+  int grid[kGridCells];
+  for (int i = 0; i < kGridCells; ++i)
+    grid[i] = static_cast<int>(
+        std::min<int64_t>(cells[i] * 255 / (area * peak), 255));
+
+  // Soften with a [1 2 1] kernel both ways, so a stroke that lands half a
+  // pixel over (a 2 pixel stem grids very differently from a 3 pixel one)
+  // costs little
+  int soft[kGridCells];
+  for (int y = 0; y < G; ++y) {
+    for (int x = 0; x < G; ++x) {
+      int left = grid[y * G + std::max(x - 1, 0)];
+      int right = grid[y * G + std::min(x + 1, G - 1)];
+      soft[y * G + x] = left + 2 * grid[y * G + x] + right;
+    }
+  }
+  for (int y = 0; y < G; ++y) {
+    for (int x = 0; x < G; ++x) {
+      int up = soft[std::max(y - 1, 0) * G + x];
+      int down = soft[std::min(y + 1, G - 1) * G + x];
+      features.grid[y * G + x] =
+          static_cast<uint8_t>((up + 2 * soft[y * G + x] + down + 8) / 16);
+    }
+  }
+  for (int y = 0; y < G / 2; ++y) {
+    for (int x = 0; x < G / 2; ++x) {
+      const uint8_t *cell = features.grid + 2 * y * G + 2 * x;
+      features.coarse[y * G / 2 + x] =
+          static_cast<uint8_t>((cell[0] + cell[1] + cell[G] + cell[G + 1]) / 4);
+    }
+  }
+
+  const int x = std::max(xHeight, 1);
+  features.width = box.width * 64 / x;
+  features.height = box.height * 64 / x;
+  features.top = (baseline - box.y) * 64 / x;
+  features.bottom = (baseline - box.y - box.height) * 64 / x;
+}
+
+int TextRecognizer::Distance(const Features &a, const Features &b) {
+  return Sad(a.grid, b.grid, kGridCells) / kGridCells + PlaceDistance(a, b);
+}
+
+const TextRecognizer::Template *
+TextRecognizer::Classify(const Features &features, int &distance,
+                         int &runnerUp) const {
+  const Template *best = nullptr;
+  distance = runnerUp = 1 << 30;
+  int cutoff = runnerUp; // Templates this far away cannot change the answer
+
+  for (const Template &t : templates_) {
+    // Placement alone, or with the coarse grids' lower bound on the grid
+    // distance, already worse than the runner-up: skip the grid
+    int place = PlaceDistance(features, t);
+    if (place >= cutoff)
+      continue;
+    int bound = 4 * Sad(features.coarse, t.coarse, kCoarseCells) -
+                kCoarseSlack;
+    if (place + std::max(bound, 0) / kGridCells >= cutoff)
+      continue;
+    int d = place + Sad(features.grid, grids_[t.grid].cells, kGridCells) /
+                        kGridCells;
+    if (d < distance) {
+      if (best && best->c != t.c)
+        runnerUp = distance;
+      distance = d;
+      best = &t;
+    } else if (d < runnerUp && t.c != best->c) {
+      runnerUp = d;
+    }
+    cutoff = std::min(runnerUp, distance + kAmbiguousMargin);
+  }
+  runnerUp = std::min(runnerUp, distance + kAmbiguousMargin);
+  return best;
+}
+
+// -----------------------------------------------------------------------------
+// Training
+// -----------------------------------------------------------------------------
+
+int TextRecognizer::AddFont(const std::string &alphabet,
+                            const GlyphRenderer &render) {
+  std::vector<uint8_t> luma, coverage;
+
+  // Ink box of a rendering (dark on light)
+  auto inkBox = [&](const ImageView &view, ImageRect &box) {
+    if (!view.IsValid())
+      return false;
+    ToLuma(view, luma);
+    ToCoverage(luma, 255, 0, coverage);
+    int x0 = view.width, y0 = view.height, x1 = 0, y1 = 0;
+    for (int y = 0; y < view.height; ++y) {
+      const uint8_t *row = coverage.data() + static_cast<size_t>(y) * view.width;
+      for (int x = 0; x < view.width; ++x) {
+        if (row[x] >= kInkLevel) {
+          x0 = std::min(x0, x);
+          x1 = std::max(x1, x + 1);
+          y0 = std::min(y0, y);
+          y1 = std::max(y1, y + 1);
+        }
+      }
+    }
+    box = ImageRect{x0, y0, x1 - x0, y1 - y0};
+    return x1 > x0;
+  };
+
+  ImageRect xBox;
+  if (!inkBox(render('x'), xBox))
+    return 0;
+  const int baseline = xBox.y + xBox.height;
+  const int xHeight = xBox.height;
+
+  int added = 0;
+  for (char c : alphabet) {
+    ImageView view = render(c);
+    ImageRect box;
+    if (!inkBox(view, box))
+      continue;
+    Features features;
+    ExtractFeatures(coverage.data(), view.width, box, baseline, xHeight,
+                    features);
+    Template t;
+    std::memcpy(t.coarse, features.coarse, sizeof(t.coarse));
+    t.width = static_cast<int16_t>(features.width);
+    t.height = static_cast<int16_t>(features.height);
+    t.top = static_cast<int16_t>(features.top);
+    t.bottom = static_cast<int16_t>(features.bottom);
+    t.bands = static_cast<int16_t>(features.bands);
+    t.c = c;
+    t.grid = static_cast<uint32_t>(grids_.size());
+    grids_.emplace_back();
+    std::memcpy(grids_.back().cells, features.grid, sizeof(features.grid));
+    templates_.push_back(t);
+    added++;
+  }
+  return added;
+}
+
+// -----------------------------------------------------------------------------
+// Recognition
+// -----------------------------------------------------------------------------
+
+RecognizedText TextRecognizer::Recognize(const ImageView &image) const {
+  RecognizedText result;
+  if (!image.IsValid() || templates_.empty())
+    return result;
+  auto start = std::chrono::steady_clock::now();
+  auto finish = [&]() {
+    result.micros = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    return result;
+  };
+
+  // Background is the larger Otsu class; levels are each class's mode
+  std::vector<uint8_t> luma;
+  ToLuma(image, luma);
+  uint64_t histogram[256] = {};
+  for (uint8_t v : luma)
+    histogram[v]++;
+  const int threshold = OtsuThreshold(histogram);
+  uint64_t dark = 0;
+  for (int i = 0; i <= threshold; ++i)
+    dark += histogram[i];
+  const bool darkBackground = dark * 2 > luma.size();
+  const int background = darkBackground
+                             ? HistogramMode(histogram, 0, threshold)
+                             : HistogramMode(histogram, threshold + 1, 255);
+  const int ink = darkBackground
+                      ? HistogramMode(histogram, threshold + 1, 255)
+                      : HistogramMode(histogram, 0, threshold);
+  if (std::abs(ink - background) < config_.minContrast)
+    return finish();
+
+  std::vector<uint8_t> coverage;
+  ToCoverage(luma, background, ink, coverage);
+  luma = std::vector<uint8_t>();
+
+  std::vector<Component> components;
+  FindComponents(coverage, image.width, image.height, components);
+
+  // Shapes too tall for a line, or large both ways (no glyph is), are
+  // pictures, boxes or the axes of a chart
+  int64_t pictureArea = 0;
+  std::vector<Component> text;
+  const int solidSize = config_.maxLineHeight / 2;
+  for (const Component &c : components) {
+    int w = c.right - c.left, h = c.bottom - c.top;
+    if (h > config_.maxLineHeight || (w >= solidSize && h >= solidSize)) {
+      pictureArea += static_cast<int64_t>(w) * h;
+      continue;
+    }
+    text.push_back(c);
+  }
+  result.pictureFraction = std::min(
+      1.0f, static_cast<float>(pictureArea) /
+                (static_cast<float>(image.width) * image.height));
+
+  std::vector<Line> lines = FindLines(text, image.height);
+  {
+    std::vector<std::vector<Component>> members(lines.size());
+    for (const Component &c : text) {
+      int line = NearestLine(lines, c);
+      if (line >= 0)
+        members[line].push_back(c);
+    }
+    for (size_t i = 0; i < lines.size(); ++i)
+      GroupSymbols(members[i], lines[i]);
+  }
+
+  // Classify a line's symbols for one baseline and x-height; the score is
+  // the total distance, with unreadable symbols counted alike
+  Features features;
+  std::vector<int> cuts;
+  auto classifySymbol = [&](Symbol &s, int baseline, int xHeight) {
+    ImageRect box{s.left, s.top, Width(s), Height(s)};
+    ExtractFeatures(coverage.data(), image.width, box, baseline, xHeight,
+                    features);
+    int runnerUp;
+    const Template *t = Classify(features, s.distance, runnerUp);
+    s.c = t ? t->c : '?';
+    s.margin = runnerUp - s.distance;
+  };
+  auto classifyLine = [&](Line &line, int baseline, int xHeight,
+                          size_t sample) {
+    int score = 0;
+    const size_t n = line.symbols.size();
+    const size_t step = sample < n ? n / sample : 1;
+    for (size_t i = 0; i < n; i += step) {
+      Symbol &s = line.symbols[i];
+      classifySymbol(s, baseline, xHeight);
+      score += std::min(s.distance, config_.rejectDistance * 2);
+    }
+    return score;
+  };
+
+  // Long lines settle their own metrics. Short lines are read with each
+  // likely baseline, with their own x-height and with that of the long
+  // lines (they may hold no lowercase letter at all), and the reading that
+  // matches best is kept.
+  std::vector<std::vector<int>> baselines(lines.size());
+  std::vector<int> xHeights;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    BaselineCandidates(lines[i], baselines[i]);
+    if (lines[i].symbols.size() >= kSettledSymbols)
+      xHeights.push_back(XHeightFor(lines[i], baselines[i][0]));
+  }
+  const int commonXHeight = Percentile(xHeights, 50);
+
+  for (size_t i = 0; i < lines.size(); ++i) {
+    Line &line = lines[i];
+    const size_t n = line.symbols.size();
+    std::vector<std::pair<int, int>> metrics; // (baseline, x-height)
+    for (int baseline : baselines[i]) {
+      metrics.emplace_back(baseline, XHeightFor(line, baseline));
+      if (commonXHeight > 0 && commonXHeight != metrics.back().second)
+        metrics.emplace_back(baseline, commonXHeight);
+    }
+    int best = -1;
+    for (size_t m = 0; m < metrics.size(); ++m) {
+      int score = classifyLine(line, metrics[m].first, metrics[m].second,
+                               metrics.size() > 1 ? kSampleSymbols : n);
+      if (best < 0 || score < best) {
+        best = score;
+        line.baseline = metrics[m].first;
+        line.xHeight = metrics[m].second;
+      }
+    }
+    if (metrics.size() > 1)
+      classifyLine(line, line.baseline, line.xHeight, n);
+
+    // Cut touching glyphs apart
+    std::vector<Symbol> symbols;
+    std::vector<std::pair<Symbol, int>> pending; // (symbol, depth), a stack
+    for (auto it = line.symbols.rbegin(); it != line.symbols.rend(); ++it)
+      pending.emplace_back(*it, 0);
+    while (!pending.empty()) {
+      Symbol s = pending.back().first;
+      int depth = pending.back().second;
+      pending.pop_back();
+      if (s.distance <= kSplitDistance || depth >= kMaxSplitDepth ||
+          Width(s) * 5 < line.xHeight * 4) {
+        symbols.push_back(s);
+        continue;
+      }
+      Symbol bestLeft, bestRight;
+      int bestDistance = s.distance - kSplitGain;
+      // Halves narrower than this would be read as punctuation far too
+      // easily (the tail of a t matches a period)
+      const int margin = std::max(2, line.xHeight * 2 / 5);
+      CutCandidates(coverage, image.width, s, margin, cuts);
+      for (int cut : cuts) {
+        Symbol left = s, right = s;
+        left.right = cut;
+        right.left = cut;
+        if (!TrimToInk(coverage, image.width, left) ||
+            !TrimToInk(coverage, image.width, right) ||
+            Width(left) < margin || Width(right) < margin)
+          continue;
+        classifySymbol(left, line.baseline, line.xHeight);
+        classifySymbol(right, line.baseline, line.xHeight);
+        int distance = std::max(left.distance, right.distance);
+        if (distance < bestDistance) {
+          bestDistance = distance;
+          bestLeft = left;
+          bestRight = right;
+        }
+      }
+      if (bestDistance == s.distance - kSplitGain) {
+        symbols.push_back(s);
+        continue;
+      }
+      pending.emplace_back(bestRight, depth + 1);
+      pending.emplace_back(bestLeft, depth + 1);
+    }
+    line.symbols.swap(symbols);
+  }
+
+  for (const Line &line : lines) {
+    for (const Symbol &s : line.symbols) {
+      result.symbols++;
+      // Too far from every glyph, or nearly as close to another character
+      if (s.distance > config_.rejectDistance || s.margin < kAmbiguousMargin)
+        result.rejected++;
+    }
+  }
+
+  // Lay out the text: by the pitch when monospaced, by word gaps otherwise
+  int pitch64 = 0;
+  result.monospace = FindPitch(lines, pitch64);
+  int firstCenter = 1 << 30;
+  if (result.monospace)
+    for (const Line &line : lines)
+      if (!line.symbols.empty())
+        firstCenter = std::min(firstCenter, line.symbols.front().left +
+                                                line.symbols.front().right);
+
+  for (const Line &line : lines) {
+    if (line.symbols.empty())
+      continue;
+    if (result.lines++ > 0)
+      result.text += '\n';
+    for (size_t i = 0; i < line.symbols.size(); ++i) {
+      const Symbol &s = line.symbols[i];
+      int spaces = 0;
+      if (result.monospace) {
+        int from = i == 0 ? firstCenter
+                          : line.symbols[i - 1].left + line.symbols[i - 1].right;
+        int step = (s.left + s.right - from) * 32;
+        spaces = (step + pitch64 / 2) / pitch64 - (i == 0 ? 0 : 1);
+      } else if (i > 0) {
+        int gap = s.left - line.symbols[i - 1].right;
+        spaces = gap * 5 > line.xHeight * 2 ? 1 : 0;
+      }
+      result.text.append(static_cast<size_t>(std::max(spaces, 0)), ' ');
+
+      // Two ticks side by side are a double quote
+      if (s.c == '\'' && !result.text.empty() && result.text.back() == '\'' &&
+          spaces == 0) {
+        result.text.back() = '"';
+        continue;
+      }
+      result.text += s.c;
+    }
+  }
+
+  if (result.symbols > 0)
+    result.confidence =
+        static_cast<float>(result.symbols - result.rejected) / result.symbols;
+  result.usable = result.symbols >= config_.minSymbols &&
+                  result.confidence >= config_.minConfidence &&
+                  result.pictureFraction <= config_.maxPictureFraction;
+  return finish();
+}
+
+} // namespace invisible
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "image_buffer.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Text Recognizer Configuration
+// -----------------------------------------------------------------------------
+
+struct TextRecognizerConfig {
+  // Ink must differ from the background by this much (0-255 luma)
+  int minContrast = 48;
+
+  // Ink bands taller than this (pixels) are pictures, not text
+  int maxLineHeight = 160;
+
+  // A symbol whose closest glyph is further away than this is counted as
+  // unreadable (mean absolute difference per grid cell, 0-255)
+  int rejectDistance = 60;
+
+  // When the text may stand in for the image: enough symbols, nearly all
+  // of them readable, and little of the image covered by non-text
+  int minSymbols = 12;
+  float minConfidence = 0.93f;
+  float maxPictureFraction = 0.2f;
+};
+
+// -----------------------------------------------------------------------------
+// Recognized Text
+// -----------------------------------------------------------------------------
+
+struct RecognizedText {
+  std::string text;      // Lines separated by '\n'
+  int lines = 0;
+  int symbols = 0;       // Symbols classified
+  int rejected = 0;      // Symbols no glyph matched well
+  float confidence = 0;  // Share of symbols matched well
+  float pictureFraction = 0; // Image area covered by non-text shapes
+  bool monospace = false;    // Spaces and indentation come from the pitch
+  bool usable = false;       // Confident enough to replace the image
+  uint64_t micros = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Text Recognizer
+// On-device OCR for screenshots of rendered text (code, slides, documents).
+// The image is reduced to luma and binarized with Otsu's threshold (light
+// or dark background), ink is split into connected components, components
+// are grouped into lines (by rows free of ink) and symbols (by horizontal
+// overlap, so the dot joins its i), and each symbol is matched against
+// glyph templates: a softened 16x16 grid of ink coverage plus its size,
+// its place relative to the line's baseline and x-height, and its number
+// of stacked parts. Screen text comes from a handful of fonts, so templates
+// rendered from those fonts match closely; nearest-neighbor search over
+// them uses SSE2 sums of absolute differences, with 8x8 grids ruling most
+// templates out first. Short lines try each likely baseline and x-height,
+// and symbols that match nothing well are tried cut in two (touching
+// glyphs). A symbol is unreadable when it is far from every glyph or
+// nearly as close to another character as to its own.
+// Spacing follows the character pitch when the text is monospaced (keeping
+// indentation), and word gaps otherwise.
+// Add fonts first; Recognize() is then const and may run on several
+// threads at once.
+// -----------------------------------------------------------------------------
+
+class TextRecognizer {
+public:
+  explicit TextRecognizer(
+      const TextRecognizerConfig &config = TextRecognizerConfig());
+
+  // Renders one character alone, in dark ink on a light background, at the
+  // same position every time. The view must stay valid until the next call.
+  using GlyphRenderer = std::function<ImageView(char c)>;
+
+  // Learn the glyphs of `alphabet` in one font. The baseline and x-height
+  // are taken from the renderer's 'x'. Returns the number of glyphs learned.
+  int AddFont(const std::string &alphabet, const GlyphRenderer &render);
+
+  size_t GetGlyphCount() const { return templates_.size(); }
+
+  RecognizedText Recognize(const ImageView &image) const;
+
+  const TextRecognizerConfig &GetConfig() const { return config_; }
+
+  // Printable ASCII without the space
+  static const char *DefaultAlphabet();
+
+  // True when the SSE2 matcher is compiled in
+  static bool HasSimd();
+
+  static constexpr int kGridSize = 16;
+
+  // Shape and placement of one symbol. Sizes and offsets are in x-heights
+  // scaled by 64.
+  struct Features {
+    alignas(16) uint8_t grid[kGridSize * kGridSize]; // Ink coverage
+    alignas(16) uint8_t coarse[kGridSize * kGridSize / 4]; // 2x2 means
+    int width = 0;
+    int height = 0;
+    int top = 0;    // Baseline to the top of the ink (up is positive)
+    int bottom = 0; // Baseline to the bottom of the ink
+    int bands = 0;  // Runs of rows with ink, top to bottom (2 for i and =)
+  };
+
+  // Symbol features from an ink coverage map (0 = background, 255 = ink)
+  // of `mapWidth` columns, for the box `box` on a line with `baseline` and
+  // `xHeight` (map rows)
+  static void ExtractFeatures(const uint8_t *coverage, int mapWidth,
+                              const ImageRect &box, int baseline,
+                              int xHeight, Features &features);
+
+  // Distance between two symbols (shape plus weighted size and placement)
+  static int Distance(const Features &a, const Features &b);
+
+private:
+  // A glyph's coarse grid, size and placement (as in Features) and its
+  // character. The full grids are kept apart, so the search over templates
+  // streams through 80 bytes a glyph and rarely needs the other 256.
+  struct Template {
+    alignas(16) uint8_t coarse[kGridSize * kGridSize / 4];
+    int16_t width, height, top, bottom, bands;
+    char c;
+    uint32_t grid; // Index into grids_
+  };
+
+  struct Grid {
+    alignas(16) uint8_t cells[kGridSize * kGridSize];
+  };
+
+  // Closest template to `features`, its distance, and the distance of the
+  // closest template of another character
+  const Template *Classify(const Features &features, int &distance,
+                           int &runnerUp) const;
+
+  TextRecognizerConfig config_;
+  std::vector<Template> templates_;
+  std::vector<Grid> grids_;
+};
+
+} // namespace invisible
@@ -0,0 +1,131 @@
+#include "transcription_pipeline.h"
+#include <algorithm>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Constructor / Destructor
+// -----------------------------------------------------------------------------
+
+TranscriptionPipeline::TranscriptionPipeline(
+    const TranscriptionPipelineConfig &config, TranscribeFn transcribe,
+    ResultFn onResult)
+    : config_(config), transcribe_(std::move(transcribe)),
+      onResult_(std::move(onResult)) {
+  config_.maxInFlight = std::max<size_t>(config_.maxInFlight, 1);
+}
+
+TranscriptionPipeline::~TranscriptionPipeline() { Stop(); }
+
+// -----------------------------------------------------------------------------
+// Start / Stop
+// -----------------------------------------------------------------------------
+
+void TranscriptionPipeline::Start() {
+  Stop();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ready_.clear();
+  nextSequence_ = 0;
+  nextDeliver_ = 0;
+  delivering_ = false;
+  stopping_ = false;
+  stats_ = TranscriptionPipelineStats();
+}
+
+void TranscriptionPipeline::Stop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  stopping_ = true;
+  slotCV_.notify_all();
+
+  // Every started request completes, so this ends once they have
+  slotCV_.wait(lock, [this] { return nextDeliver_ == nextSequence_; });
+}
+
+// -----------------------------------------------------------------------------
+// Producer
+// -----------------------------------------------------------------------------
+
+bool TranscriptionPipeline::Submit(AudioChunk &&chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // Backpressure: the window counts chunks until they are delivered, so
+  // results held for reordering are bounded as well
+  auto hasSlot = [this] {
+    return stopping_ || nextSequence_ - nextDeliver_ < config_.maxInFlight;
+  };
+  if (!hasSlot()) {
+    stats_.blockedSubmits++;
+    slotCV_.wait(lock, hasSlot);
+  }
+  if (stopping_)
+    return false;
+
+  uint64_t sequence = nextSequence_++;
+  stats_.submitted++;
+  stats_.peakInFlight = std::max<size_t>(
+      stats_.peakInFlight, static_cast<size_t>(nextSequence_ - nextDeliver_));
+  lock.unlock();
+
+  transcribe_(std::move(chunk), [this, sequence](std::string text) {
+    OnTranscribed(sequence, std::move(text));
+  });
+  return true;
+}
+
+void TranscriptionPipeline::Drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  slotCV_.wait(lock, [this] { return nextDeliver_ == nextSequence_; });
+}
+
+size_t TranscriptionPipeline::GetInFlight() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<size_t>(nextSequence_ - nextDeliver_);
+}
+
+TranscriptionPipelineStats TranscriptionPipeline::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+// -----------------------------------------------------------------------------
+// Completions
+// -----------------------------------------------------------------------------
+
+void TranscriptionPipeline::OnTranscribed(uint64_t sequence, std::string text) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (text.empty())
+    stats_.failed++;
+  ready_.emplace(sequence, std::move(text));
+  DeliverReady(lock);
+}
+
+void TranscriptionPipeline::DeliverReady(std::unique_lock<std::mutex> &lock) {
+  // Another completion is already delivering; it will pick up ours too
+  if (delivering_)
+    return;
+  delivering_ = true;
+
+  for (;;) {
+    auto it = ready_.find(nextDeliver_);
+    if (it == ready_.end())
+      break;
+
+    uint64_t sequence = it->first;
+    std::string text = std::move(it->second);
+    ready_.erase(it);
+
+    lock.unlock();
+    if (onResult_)
+      onResult_(sequence, text);
+    lock.lock();
+
+    nextDeliver_++;
+    stats_.delivered++;
+    slotCV_.notify_all();
+  }
+
+  delivering_ = false;
+}
+
+} // namespace invisible
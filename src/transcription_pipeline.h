@@ -0,0 +1,105 @@
+#pragma once
+
+#include "utterance_segmenter.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Transcription Pipeline Configuration
+// -----------------------------------------------------------------------------
+
+struct TranscriptionPipelineConfig {
+  size_t maxInFlight = 3; // Chunks submitted but not yet delivered
+};
+
+struct TranscriptionPipelineStats {
+  uint64_t submitted = 0;
+  uint64_t delivered = 0;
+  uint64_t failed = 0;       // Transcriber returned no text
+  size_t peakInFlight = 0;
+  uint64_t blockedSubmits = 0; // Submit() had to wait for a free slot
+};
+
+// -----------------------------------------------------------------------------
+// Transcription Pipeline
+// Keeps up to maxInFlight transcription requests running at once, so a slow
+// upload no longer holds back the chunks behind it. The pipeline owns no
+// threads: each chunk is handed to an asynchronous transcriber as soon as
+// it is submitted, and the transcriber reports back through a completion.
+// Every submitted chunk gets a sequence number and results are delivered
+// strictly in that order, one at a time, whichever request finishes first.
+// When the window is full Submit() blocks, which pushes back on the caller
+// (and from there on the segmenter's bounded queue) instead of letting
+// audio pile up without limit.
+// -----------------------------------------------------------------------------
+
+class TranscriptionPipeline {
+public:
+  // Called exactly once per chunk, from any thread; empty text on failure
+  using TranscribeDone = std::function<void(std::string text)>;
+
+  // Starts transcribing `chunk` and returns; runs on the submitting thread
+  using TranscribeFn =
+      std::function<void(AudioChunk &&chunk, TranscribeDone done)>;
+
+  // Runs on the thread of a completion, serialized and in submission
+  // order. Failed chunks are delivered too (with empty text) so the order
+  // can advance.
+  using ResultFn =
+      std::function<void(uint64_t sequence, const std::string &text)>;
+
+  TranscriptionPipeline(const TranscriptionPipelineConfig &config,
+                        TranscribeFn transcribe, ResultFn onResult);
+  ~TranscriptionPipeline();
+
+  // Disable copy
+  TranscriptionPipeline(const TranscriptionPipeline &) = delete;
+  TranscriptionPipeline &operator=(const TranscriptionPipeline &) = delete;
+
+  // Restart sequence numbers at zero and accept chunks again
+  void Start();
+
+  // Start transcribing a chunk, blocking while maxInFlight chunks are
+  // outstanding. Returns false once Stop() has been called.
+  bool Submit(AudioChunk &&chunk);
+
+  // Block until every submitted chunk has been delivered
+  void Drain();
+
+  // Refuse new chunks, then wait until the running requests have finished
+  // and been delivered. Must not be called from a completion.
+  void Stop();
+
+  size_t GetInFlight() const;
+  TranscriptionPipelineStats GetStats() const;
+
+private:
+  // A transcriber finished `sequence`
+  void OnTranscribed(uint64_t sequence, std::string text);
+
+  // Deliver ready results in order; called with the lock held, releases it
+  // around each callback. Only one thread delivers at a time.
+  void DeliverReady(std::unique_lock<std::mutex> &lock);
+
+  TranscriptionPipelineConfig config_;
+  TranscribeFn transcribe_;
+  ResultFn onResult_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable slotCV_; // Waits for deliveries
+  std::map<uint64_t, std::string> ready_; // Finished out of order
+  uint64_t nextSequence_ = 0;  // Assigned to the next submitted chunk
+  uint64_t nextDeliver_ = 0;   // Next sequence the callback expects
+  bool delivering_ = false;
+  bool stopping_ = false;
+  TranscriptionPipelineStats stats_;
+};
+
+} // namespace invisible
@@ -0,0 +1,209 @@
+#include "utterance_segmenter.h"
+#include <algorithm>
+#include <chrono>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Constructor / Reset
+// -----------------------------------------------------------------------------
+
+UtteranceSegmenter::UtteranceSegmenter(const SegmenterConfig &config)
+    : config_(config), vad_(config.vad) {
+  frameSize_ = vad_.GetFrameSize();
+}
+
+void UtteranceSegmenter::Reset() {
+  vad_.Reset();
+  pending_.clear();
+  preroll_.clear();
+  open_ = AudioChunk();
+  inChunk_ = false;
+  speechRun_ = 0;
+  silenceSamples_ = 0;
+  silenceRun_ = 0;
+  position_ = 0;
+  nextSequence_ = 0;
+
+  std::lock_guard<std::mutex> lock(queueMutex_);
+  queue_.clear();
+  droppedChunks_ = 0;
+  stopped_ = false;
+}
+
+size_t UtteranceSegmenter::SecondsToSamples(float seconds) const {
+  return static_cast<size_t>(std::max(seconds, 0.0f) * config_.vad.sampleRate);
+}
+
+// -----------------------------------------------------------------------------
+// Producer
+// -----------------------------------------------------------------------------
+
+void UtteranceSegmenter::Push(const int16_t *samples, size_t count) {
+  size_t offset = 0;
+
+  if (!pending_.empty()) {
+    size_t take = std::min(frameSize_ - pending_.size(), count);
+    pending_.insert(pending_.end(), samples, samples + take);
+    offset = take;
+    if (pending_.size() == frameSize_) {
+      ProcessFrame(pending_.data());
+      pending_.clear();
+    }
+  }
+
+  for (; offset + frameSize_ <= count; offset += frameSize_) {
+    ProcessFrame(samples + offset);
+  }
+  pending_.insert(pending_.end(), samples + offset, samples + count);
+}
+
+void UtteranceSegmenter::ProcessFrame(const int16_t *frame) {
+  bool speech = config_.useVad ? vad_.IsSpeechFrame(frame) : true;
+  position_ += frameSize_;
+
+  if (!inChunk_) {
+    // Waiting for onset: keep a short preroll so word attacks survive
+    speechRun_ = speech ? speechRun_ + 1 : 0;
+
+    size_t prerollFrames = static_cast<size_t>(
+        std::max(config_.vad.prerollFrames, config_.vad.onsetFrames));
+    if (preroll_.size() + frameSize_ > prerollFrames * frameSize_ &&
+        !preroll_.empty()) {
+      preroll_.erase(preroll_.begin(), preroll_.begin() + frameSize_);
+    }
+    preroll_.insert(preroll_.end(), frame, frame + frameSize_);
+
+    if (speechRun_ >= std::max(config_.vad.onsetFrames, 1)) {
+      open_ = AudioChunk();
+      open_.startSample = position_ - preroll_.size();
+      open_.samples.swap(preroll_);
+      open_.speechSamples = speechRun_ * frameSize_;
+      preroll_.clear();
+      inChunk_ = true;
+      silenceSamples_ = 0;
+      silenceRun_ = 0;
+    }
+    return;
+  }
+
+  if (speech) {
+    open_.samples.insert(open_.samples.end(), frame, frame + frameSize_);
+    open_.speechSamples += frameSize_;
+    silenceSamples_ = 0;
+    silenceRun_ = 0;
+  } else {
+    // Pauses longer than pauseSec are collapsed rather than stored
+    silenceRun_ += frameSize_;
+    if (silenceRun_ <= SecondsToSamples(config_.pauseSec)) {
+      open_.samples.insert(open_.samples.end(), frame, frame + frameSize_);
+      silenceSamples_ += frameSize_;
+    }
+  }
+
+  size_t voiced = open_.samples.size() - silenceSamples_;
+  if (silenceRun_ >= SecondsToSamples(config_.pauseSec) &&
+      voiced >= SecondsToSamples(config_.minChunkSec)) {
+    CloseChunk(false);
+  } else if (silenceRun_ >= SecondsToSamples(config_.flushSilenceSec)) {
+    // A short utterance followed by a long silence should not wait for more
+    CloseChunk(false);
+  } else if (open_.samples.size() >= SecondsToSamples(config_.maxChunkSec)) {
+    CloseChunk(true);
+  }
+}
+
+void UtteranceSegmenter::CloseChunk(bool forced) {
+  AudioChunk next;
+
+  if (forced) {
+    size_t overlap = std::min(SecondsToSamples(config_.overlapSec),
+                              open_.samples.size());
+    next.samples.assign(open_.samples.end() - overlap, open_.samples.end());
+    next.startSample = open_.startSample + open_.samples.size() - overlap;
+  } else {
+    size_t tail = std::min(silenceSamples_, SecondsToSamples(config_.tailSec));
+    open_.samples.resize(open_.samples.size() - (silenceSamples_ - tail));
+  }
+
+  open_.forced = forced;
+  open_.sequence = nextSequence_++;
+  Enqueue(std::move(open_));
+
+  open_ = std::move(next);
+  silenceSamples_ = 0;
+  if (!forced) {
+    inChunk_ = false;
+    speechRun_ = 0;
+    silenceRun_ = 0;
+  }
+}
+
+void UtteranceSegmenter::Flush() {
+  if (inChunk_ && open_.speechSamples > 0) {
+    CloseChunk(false);
+  }
+  inChunk_ = false;
+  open_ = AudioChunk();
+  pending_.clear();
+  preroll_.clear();
+  speechRun_ = 0;
+  silenceSamples_ = 0;
+  silenceRun_ = 0;
+}
+
+void UtteranceSegmenter::Enqueue(AudioChunk &&chunk) {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    if (config_.maxQueuedChunks > 0 &&
+        queue_.size() >= config_.maxQueuedChunks) {
+      queue_.pop_front();
+      ++droppedChunks_;
+    }
+    queue_.push_back(std::move(chunk));
+  }
+  queueCV_.notify_one();
+}
+
+// -----------------------------------------------------------------------------
+// Consumer
+// -----------------------------------------------------------------------------
+
+bool UtteranceSegmenter::WaitForChunk(AudioChunk &chunk, uint32_t timeoutMs) {
+  std::unique_lock<std::mutex> lock(queueMutex_);
+  auto ready = [this] { return stopped_ || !queue_.empty(); };
+
+  if (timeoutMs == WAIT_FOREVER) {
+    queueCV_.wait(lock, ready);
+  } else if (!queueCV_.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                ready)) {
+    return false;
+  }
+
+  if (queue_.empty()) {
+    return false;
+  }
+  chunk = std::move(queue_.front());
+  queue_.pop_front();
+  return true;
+}
+
+void UtteranceSegmenter::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    stopped_ = true;
+  }
+  queueCV_.notify_all();
+}
+
+size_t UtteranceSegmenter::GetQueuedChunks() const {
+  std::lock_guard<std::mutex> lock(queueMutex_);
+  return queue_.size();
+}
+
+uint64_t UtteranceSegmenter::GetDroppedChunks() const {
+  std::lock_guard<std::mutex> lock(queueMutex_);
+  return droppedChunks_;
+}
+
+} // namespace invisible
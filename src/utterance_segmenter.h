@@ -0,0 +1,120 @@
+#pragma once
+
+#include "vad.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Utterance Segmenter Configuration
+// -----------------------------------------------------------------------------
+
+struct SegmenterConfig {
+  float minChunkSec = 1.0f;      // A pause closes the chunk only after this
+  float maxChunkSec = 15.0f;     // Forced cut when nobody pauses
+  float pauseSec = 0.6f;         // Silence that ends an utterance
+  float flushSilenceSec = 2.0f;  // Silence that closes even a short chunk
+  float tailSec = 0.2f;          // Trailing silence kept on a closed chunk
+  float overlapSec = 0.3f;       // Repeated at the start after a forced cut
+  size_t maxQueuedChunks = 8;    // Oldest chunk dropped beyond this
+  bool useVad = true;            // false: every frame counts as speech
+  VadConfig vad;                 // vad.sampleRate sets the stream rate
+};
+
+// -----------------------------------------------------------------------------
+// Audio Chunk
+// -----------------------------------------------------------------------------
+
+struct AudioChunk {
+  uint64_t sequence = 0;
+  uint64_t startSample = 0;  // Stream position of samples[0]
+  std::vector<int16_t> samples;
+  size_t speechSamples = 0;  // Samples in speech-like frames
+  bool forced = false;       // Cut at maxChunkSec rather than at a pause
+};
+
+// -----------------------------------------------------------------------------
+// Utterance Segmenter
+// Splits the 16 kHz mono stream into chunks that end at natural pauses, so a
+// sentence reaches the transcriber as soon as the speaker stops instead of
+// when a fixed timer fires. Leading silence is dropped (a short preroll is
+// kept), long pauses inside a chunk are collapsed, and a chunk that hits
+// maxChunkSec is cut with a short overlap so the split word appears in both.
+// Push()/Flush() belong to one producer thread; WaitForChunk() wakes the
+// consumer through a condition variable as soon as a chunk closes.
+// -----------------------------------------------------------------------------
+
+class UtteranceSegmenter {
+public:
+  static constexpr uint32_t WAIT_FOREVER = 0xFFFFFFFF;
+
+  explicit UtteranceSegmenter(
+      const SegmenterConfig &config = SegmenterConfig());
+
+  // Disable copy
+  UtteranceSegmenter(const UtteranceSegmenter &) = delete;
+  UtteranceSegmenter &operator=(const UtteranceSegmenter &) = delete;
+
+  // Drop all state and queued chunks and clear the stop flag.
+  // Call while the producer is idle.
+  void Reset();
+
+  // Producer: feed samples (any count; partial frames are held)
+  void Push(const int16_t *samples, size_t count);
+
+  // Producer: close the open chunk now, e.g. at end of stream
+  void Flush();
+
+  // Consumer: wait for the next closed chunk. Returns false on timeout or
+  // once Stop() has been called and the queue is empty.
+  bool WaitForChunk(AudioChunk &chunk, uint32_t timeoutMs = WAIT_FOREVER);
+
+  // Wake every waiter; WaitForChunk() returns false until Reset()
+  void Stop();
+
+  size_t GetQueuedChunks() const;
+  uint64_t GetDroppedChunks() const;
+  uint32_t GetSampleRate() const { return config_.vad.sampleRate; }
+  const SegmenterConfig &GetConfig() const { return config_; }
+
+private:
+  void ProcessFrame(const int16_t *frame);
+
+  // Hand the open chunk to the consumer. A pause close trims trailing
+  // silence to tailSec; a forced close starts the next chunk with the last
+  // overlapSec of this one and keeps it open.
+  void CloseChunk(bool forced);
+
+  void Enqueue(AudioChunk &&chunk);
+
+  size_t SecondsToSamples(float seconds) const;
+
+  SegmenterConfig config_;
+  VoiceActivityDetector vad_;
+  size_t frameSize_ = 0;
+
+  // Producer state
+  std::vector<int16_t> pending_; // Partial frame
+  std::vector<int16_t> preroll_; // Recent frames before onset
+  AudioChunk open_;
+  bool inChunk_ = false;
+  int speechRun_ = 0;
+  size_t silenceSamples_ = 0;    // Trailing silence in the open chunk
+  size_t silenceRun_ = 0;        // Silence since the last speech frame
+  uint64_t position_ = 0;        // Samples consumed so far
+  uint64_t nextSequence_ = 0;
+
+  // Closed chunks
+  mutable std::mutex queueMutex_;
+  std::condition_variable queueCV_;
+  std::deque<AudioChunk> queue_;
+  uint64_t droppedChunks_ = 0;
+  bool stopped_ = false;
+};
+
+} // namespace invisible
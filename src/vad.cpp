@@ -0,0 +1,242 @@
+#include "vad.h"
+#include <algorithm>
+#include <cmath>
+
+namespace invisible {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Digital silence sits far below any real noise floor; clamp so a run of
+// zero-filled packets cannot drag the tracked floor out of range
+constexpr float kMinFloorDb = -90.0f;
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Constructor / Reset
+// -----------------------------------------------------------------------------
+
+VoiceActivityDetector::VoiceActivityDetector(const VadConfig &config)
+    : config_(config) {
+  frameSize_ = std::max<size_t>(
+      1, static_cast<size_t>(config_.sampleRate) * config_.frameMs / 1000);
+
+  fftSize_ = 1;
+  while (fftSize_ < frameSize_) {
+    fftSize_ <<= 1;
+  }
+
+  // Hann window over the frame; the rest of the FFT input is zero padding
+  window_.resize(frameSize_);
+  for (size_t i = 0; i < frameSize_; ++i) {
+    double phase = 2.0 * kPi * i / std::max<size_t>(frameSize_ - 1, 1);
+    window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(phase));
+  }
+
+  cosTable_.resize(fftSize_ / 2);
+  sinTable_.resize(fftSize_ / 2);
+  for (size_t i = 0; i < fftSize_ / 2; ++i) {
+    cosTable_[i] = static_cast<float>(std::cos(2.0 * kPi * i / fftSize_));
+    sinTable_[i] = static_cast<float>(-std::sin(2.0 * kPi * i / fftSize_));
+  }
+
+  int bits = 0;
+  while ((size_t(1) << bits) < fftSize_) {
+    ++bits;
+  }
+  bitReverse_.resize(fftSize_);
+  for (size_t i = 0; i < fftSize_; ++i) {
+    uint32_t r = 0;
+    for (int b = 0; b < bits; ++b) {
+      r |= ((i >> b) & 1u) << (bits - 1 - b);
+    }
+    bitReverse_[i] = r;
+  }
+
+  re_.resize(fftSize_);
+  im_.resize(fftSize_);
+
+  double binHz = static_cast<double>(config_.sampleRate) / fftSize_;
+  bandLow_ = std::max<size_t>(
+      1, static_cast<size_t>(std::ceil(config_.bandLowHz / binHz)));
+  bandHigh_ = std::min(fftSize_ / 2,
+                       static_cast<size_t>(config_.bandHighHz / binHz));
+  if (bandHigh_ < bandLow_) {
+    bandHigh_ = bandLow_;
+  }
+
+  Reset();
+}
+
+void VoiceActivityDetector::Reset() {
+  pending_.clear();
+  preroll_.clear();
+  noiseFloorDb_ = -60.0f;
+  speechRun_ = 0;
+  hangover_ = 0;
+  inSpeech_ = false;
+  lastEnergyDb_ = -120.0f;
+  lastFlatness_ = 1.0f;
+}
+
+// -----------------------------------------------------------------------------
+// Processing
+// -----------------------------------------------------------------------------
+
+VadResult VoiceActivityDetector::Process(const int16_t *samples, size_t count,
+                                         std::vector<int16_t> *speech) {
+  VadResult result;
+  size_t before = speech ? speech->size() : 0;
+  size_t offset = 0;
+
+  // Complete the frame left over from the previous call
+  if (!pending_.empty()) {
+    size_t take = std::min(frameSize_ - pending_.size(), count);
+    pending_.insert(pending_.end(), samples, samples + take);
+    offset = take;
+    if (pending_.size() == frameSize_) {
+      ProcessFrame(pending_.data(), result, speech);
+      pending_.clear();
+    }
+  }
+
+  for (; offset + frameSize_ <= count; offset += frameSize_) {
+    ProcessFrame(samples + offset, result, speech);
+  }
+  pending_.insert(pending_.end(), samples + offset, samples + count);
+
+  result.keptSamples = speech ? speech->size() - before : 0;
+  result.speechRatio =
+      result.frames > 0
+          ? static_cast<float>(result.speechFrames) / result.frames
+          : 0.0f;
+  return result;
+}
+
+void VoiceActivityDetector::ProcessFrame(const int16_t *frame,
+                                         VadResult &result,
+                                         std::vector<int16_t> *speech) {
+  ++result.frames;
+  bool speechLike = IsSpeechLike(frame);
+  speechRun_ = speechLike ? speechRun_ + 1 : 0;
+
+  if (!inSpeech_ && speechRun_ >= config_.onsetFrames) {
+    // Onset: the preroll holds the frames just before it (including the
+    // first onset frames), so word attacks are not clipped
+    inSpeech_ = true;
+    hangover_ = config_.hangoverFrames;
+    result.speechFrames += preroll_.size() / frameSize_;
+    if (speech) {
+      speech->insert(speech->end(), preroll_.begin(), preroll_.end());
+    }
+    preroll_.clear();
+  } else if (inSpeech_) {
+    if (speechLike) {
+      hangover_ = config_.hangoverFrames;
+    } else if (hangover_ > 0) {
+      --hangover_;
+    } else {
+      inSpeech_ = false;
+    }
+  }
+
+  if (inSpeech_) {
+    ++result.speechFrames;
+    if (speech) {
+      speech->insert(speech->end(), frame, frame + frameSize_);
+    }
+    return;
+  }
+
+  size_t limit = static_cast<size_t>(std::max(config_.prerollFrames, 0)) *
+                 frameSize_;
+  if (limit == 0) {
+    return;
+  }
+  if (preroll_.size() + frameSize_ > limit) {
+    preroll_.erase(preroll_.begin(), preroll_.begin() + frameSize_);
+  }
+  preroll_.insert(preroll_.end(), frame, frame + frameSize_);
+}
+
+bool VoiceActivityDetector::IsSpeechLike(const int16_t *frame) {
+  double sum = 0.0;
+  for (size_t i = 0; i < frameSize_; ++i) {
+    double v = frame[i];
+    sum += v * v;
+  }
+  double meanSquare = sum / frameSize_ / (32768.0 * 32768.0);
+  float energyDb = static_cast<float>(10.0 * std::log10(meanSquare + 1e-12));
+  lastEnergyDb_ = energyDb;
+
+  bool loud = energyDb > config_.minEnergyDb &&
+              energyDb > noiseFloorDb_ + config_.noiseMarginDb;
+
+  // Flatness needs an FFT, so only measure frames that are loud enough
+  bool speechLike = false;
+  if (loud) {
+    lastFlatness_ = MeasureFlatness(frame);
+    speechLike = lastFlatness_ < config_.maxFlatness;
+  } else {
+    lastFlatness_ = 1.0f;
+  }
+
+  // Track the noise floor on non-speech frames: drop quickly, rise slowly,
+  // so steady background noise raises the bar without swallowing speech
+  if (!speechLike) {
+    float rate = (energyDb < noiseFloorDb_) ? 0.3f : 0.02f;
+    noiseFloorDb_ += rate * (energyDb - noiseFloorDb_);
+    noiseFloorDb_ = std::max(noiseFloorDb_, kMinFloorDb);
+  }
+
+  return speechLike;
+}
+
+float VoiceActivityDetector::MeasureFlatness(const int16_t *frame) {
+  const size_t n = fftSize_;
+  for (size_t i = 0; i < n; ++i) {
+    re_[i] = 0.0f;
+    im_[i] = 0.0f;
+  }
+  for (size_t i = 0; i < frameSize_; ++i) {
+    re_[bitReverse_[i]] = frame[i] * window_[i];
+  }
+
+  // Iterative radix-2 decimation-in-time FFT
+  for (size_t len = 2; len <= n; len <<= 1) {
+    size_t half = len / 2;
+    size_t step = n / len;
+    for (size_t start = 0; start < n; start += len) {
+      for (size_t k = 0; k < half; ++k) {
+        float wr = cosTable_[k * step];
+        float wi = sinTable_[k * step];
+        size_t a = start + k;
+        size_t b = a + half;
+        float tr = re_[b] * wr - im_[b] * wi;
+        float ti = re_[b] * wi + im_[b] * wr;
+        re_[b] = re_[a] - tr;
+        im_[b] = im_[a] - ti;
+        re_[a] += tr;
+        im_[a] += ti;
+      }
+    }
+  }
+
+  // Geometric over arithmetic mean of the band power spectrum
+  double logSum = 0.0;
+  double sum = 0.0;
+  size_t bins = bandHigh_ - bandLow_ + 1;
+  for (size_t k = bandLow_; k <= bandHigh_; ++k) {
+    double power = static_cast<double>(re_[k]) * re_[k] +
+                   static_cast<double>(im_[k]) * im_[k] + 1e-3;
+    logSum += std::log(power);
+    sum += power;
+  }
+  double geometric = std::exp(logSum / bins);
+  double arithmetic = sum / bins;
+  return static_cast<float>(geometric / arithmetic);
+}
+
+} // namespace invisible
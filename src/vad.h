@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// Voice Activity Detector Configuration
+// -----------------------------------------------------------------------------
+
+struct VadConfig {
+  uint32_t sampleRate = 16000;
+  int frameMs = 20;
+
+  // A frame is speech-like when it is loud enough and spectrally peaky
+  float minEnergyDb = -50.0f;      // Absolute floor, dBFS
+  float noiseMarginDb = 9.0f;      // Required rise over the tracked noise floor
+  float maxFlatness = 0.45f;       // Spectral flatness (0 = tonal, 1 = noise)
+  float bandLowHz = 250.0f;        // Flatness is measured over the voice band
+  float bandHighHz = 4000.0f;
+
+  int onsetFrames = 2;      // Consecutive speech-like frames to open speech
+  int hangoverFrames = 15;  // Frames kept after the last speech-like frame
+  int prerollFrames = 8;    // Frames kept before onset (word attacks)
+};
+
+struct VadResult {
+  size_t frames = 0;       // Frames classified in this call
+  size_t speechFrames = 0; // Frames kept as speech (incl. hangover/preroll)
+  size_t keptSamples = 0;  // Samples appended to the speech output
+  float speechRatio = 0.0f;
+};
+
+// -----------------------------------------------------------------------------
+// Voice Activity Detector
+// Streaming energy + spectral-flatness gate for 16-bit mono PCM. State
+// (noise floor, hangover, preroll, partial frame) carries across calls, so
+// consecutive chunks of one stream are gated as if they were contiguous.
+// -----------------------------------------------------------------------------
+
+class VoiceActivityDetector {
+public:
+  explicit VoiceActivityDetector(const VadConfig &config = VadConfig());
+
+  // Forget the stream (noise floor, hangover, buffered samples)
+  void Reset();
+
+  // Classify `count` samples. Speech spans are appended to `speech` when it
+  // is non-null; everything else is dropped. A trailing partial frame is
+  // held until the next call.
+  VadResult Process(const int16_t *samples, size_t count,
+                    std::vector<int16_t> *speech);
+
+  // Raw decision for one frame of GetFrameSize() samples, without onset,
+  // hangover or preroll smoothing (for callers that segment on their own).
+  // Updates the noise floor like Process() does.
+  bool IsSpeechFrame(const int16_t *frame) { return IsSpeechLike(frame); }
+
+  size_t GetFrameSize() const { return frameSize_; }
+
+  // Per-frame features of the most recent frame (diagnostics)
+  float GetLastEnergyDb() const { return lastEnergyDb_; }
+  float GetLastFlatness() const { return lastFlatness_; }
+  float GetNoiseFloorDb() const { return noiseFloorDb_; }
+
+  const VadConfig &GetConfig() const { return config_; }
+
+private:
+  // Classify one full frame and route it to `speech` or the preroll
+  void ProcessFrame(const int16_t *frame, VadResult &result,
+                    std::vector<int16_t> *speech);
+
+  // Raw per-frame decision before onset/hangover smoothing
+  bool IsSpeechLike(const int16_t *frame);
+
+  // Spectral flatness of one frame over the configured band
+  float MeasureFlatness(const int16_t *frame);
+
+  VadConfig config_;
+  size_t frameSize_ = 0;
+  size_t fftSize_ = 0;
+
+  // FFT tables
+  std::vector<float> window_;
+  std::vector<float> cosTable_;
+  std::vector<float> sinTable_;
+  std::vector<uint32_t> bitReverse_;
+  std::vector<float> re_;
+  std::vector<float> im_;
+  size_t bandLow_ = 0;
+  size_t bandHigh_ = 0;
+
+  // Stream state
+  std::vector<int16_t> pending_; // Partial frame from the last call
+  std::vector<int16_t> preroll_; // Up to prerollFrames recent non-speech frames
+  float noiseFloorDb_ = -60.0f;
+  int speechRun_ = 0;
+  int hangover_ = 0;
+  bool inSpeech_ = false;
+  float lastEnergyDb_ = -120.0f;
+  float lastFlatness_ = 1.0f;
+};
+
+} // namespace invisible
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "http_transport.h"
+#include "utils.h"
+#include <memory>
+#include <winhttp.h>
+
+#pragma comment(lib, "winhttp.lib")
+
+namespace invisible {
+
+// -----------------------------------------------------------------------------
+// WinHTTP Transport (Windows)
+// WinHTTP owns the sockets, TLS and proxy handling; connect handles are
+// pooled per host so a request reuses the session's kept-alive connection.
+// With config.http2 WinHTTP negotiates HTTP/2 and multiplexes requests
+// itself; the Http2Transport's send scheduling is POSIX-only. Cancelling a
+// request's token closes its request handle, which WinHTTP answers by
+// failing the blocked call.
+// -----------------------------------------------------------------------------
+
+class WinHttpTransport : public HttpTransport {
+public:
+  WinHttpTransport();
+  ~WinHttpTransport() override;
+
+  // Disable copy
+  WinHttpTransport(const WinHttpTransport &) = delete;
+  WinHttpTransport &operator=(const WinHttpTransport &) = delete;
+
+  bool Initialize(const HttpTransportConfig &config) override;
+  void Shutdown() override;
+
+  HttpResponse Send(const HttpRequest &request,
+                    const HttpChunkCallback &onChunk) override;
+
+  ConnectionPoolStats GetPoolStats() const override;
+
+private:
+  HINTERNET hSession_ = nullptr;
+  std::unique_ptr<ConnectionPool> pool_; // Connect handles per host
+  bool http2_ = false;
+};
+
+} // namespace invisible
@@ -0,0 +1,69 @@
+#include "alloc_counter.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+struct Tally {
+  bool on = false;
+  size_t bytes = 0;
+  size_t count = 0;
+  size_t largest = 0;
+};
+
+thread_local Tally tTally;
+
+void *Allocate(size_t size) {
+  if (tTally.on) {
+    tTally.bytes += size;
+    ++tTally.count;
+    if (size > tTally.largest)
+      tTally.largest = size;
+  }
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+void *operator new(size_t size) { return Allocate(size); }
+void *operator new[](size_t size) { return Allocate(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+namespace invisible {
+namespace test {
+
+void AllocationCounter::Start() {
+  tTally = Tally();
+  tTally.on = true;
+  running_ = true;
+}
+
+void AllocationCounter::Stop() {
+  if (!running_)
+    return;
+  tTally.on = false;
+  bytes_ = tTally.bytes;
+  count_ = tTally.count;
+  largest_ = tTally.largest;
+  running_ = false;
+}
+
+size_t AllocationCounter::Bytes() const {
+  return running_ ? tTally.bytes : bytes_;
+}
+
+size_t AllocationCounter::Count() const {
+  return running_ ? tTally.count : count_;
+}
+
+size_t AllocationCounter::Largest() const {
+  return running_ ? tTally.largest : largest_;
+}
+
+} // namespace test
+} // namespace invisible
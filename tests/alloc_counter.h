@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// Allocation Counter
+// Linking alloc_counter.cpp replaces the global operator new/delete with
+// malloc/free plus a per-thread tally. A counter counts the allocations its
+// own thread makes while it is running, so server or worker threads in the
+// same process do not blur the figure.
+// -----------------------------------------------------------------------------
+
+class AllocationCounter {
+public:
+  AllocationCounter() { Start(); }
+  ~AllocationCounter() { Stop(); }
+
+  // Disable copy
+  AllocationCounter(const AllocationCounter &) = delete;
+  AllocationCounter &operator=(const AllocationCounter &) = delete;
+
+  // Reset the tally and count from now on
+  void Start();
+  void Stop();
+
+  size_t Bytes() const;
+  size_t Count() const;
+  size_t Largest() const; // Size of the biggest single allocation
+
+private:
+  bool running_ = false;
+  size_t bytes_ = 0; // Tallies at Stop()
+  size_t count_ = 0;
+  size_t largest_ = 0;
+};
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,288 @@
+#include "http_client.h"
+#include "stub_server.h"
+#include "test.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <poll.h>
+#include <thread>
+#include <vector>
+
+// HttpClient's *Async calls over the socket transport against a loopback
+// server that can hold a response back: futures and completions, a fixed
+// thread count however many calls are in flight, a worker kept for High
+// priority calls, deadlines, caller cancellation (also of a call still in
+// the queue) and Shutdown().
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// "/hold/<ms>" answers after <ms> (sooner if the client goes away),
+// "/chunked" in three chunks, anything else at once. Counts the requests
+// the server is working on.
+class Server {
+public:
+  Server()
+      : server_(StubServer::Http([this](const StubRequest &request,
+                                        StubConnection &connection) {
+          return Handle(request, connection);
+        })) {}
+
+  bool IsListening() const { return server_->IsListening(); }
+  std::wstring Url(const std::string &path) const {
+    return server_->WideUrl(path);
+  }
+  int Peak() const { return peak_; }
+
+private:
+  bool Handle(const StubRequest &request, StubConnection &connection) {
+    int now = ++active_;
+    int seen = peak_;
+    while (now > seen && !peak_.compare_exchange_weak(seen, now)) {
+    }
+
+    bool keep = true;
+    if (request.path.compare(0, 6, "/hold/") == 0) {
+      // A readable socket here means the client closed it
+      pollfd descriptor{connection.Socket(), POLLIN, 0};
+      int ms = std::stoi(request.path.substr(6));
+      keep = poll(&descriptor, 1, ms) == 0;
+    }
+    if (keep && request.path == "/chunked") {
+      keep = connection.Write(test::StubChunkedHead(200) +
+                              test::StubChunk("one ") +
+                              test::StubChunk("two ") +
+                              test::StubChunk("three") + test::StubChunk(""));
+    } else if (keep) {
+      keep = connection.Write(test::StubResponse(200, request.path));
+    }
+    --active_;
+    return keep;
+  }
+
+  std::atomic<int> active_{0};
+  std::atomic<int> peak_{0};
+  std::unique_ptr<StubServer> server_; // Last: joined first
+};
+
+HttpClientConfig Config(size_t asyncThreads = 4) {
+  HttpClientConfig config;
+  config.asyncThreads = asyncThreads;
+  config.maxConnectionsPerHost = 16;
+  return config;
+}
+
+HttpAsyncOptions Timeout(uint32_t ms) {
+  HttpAsyncOptions options;
+  options.timeoutMs = ms;
+  return options;
+}
+
+double Ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+TEST(FuturesAndCompletions) {
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+  CHECK_EQ(client.GetAsyncStats().threads, 0u); // Started on first use
+
+  std::future<HttpResponse> future = client.GetAsync(server.Url("/a"));
+  HttpResponse response = future.get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK_EQ(response.body, std::string("/a"));
+
+  std::promise<HttpResponse> done;
+  client.PostJsonAsync(server.Url("/b"), "{}", {}, HttpAsyncOptions(),
+                       [&](HttpResponse response) {
+                         done.set_value(std::move(response));
+                       });
+  response = done.get_future().get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK_EQ(response.body, std::string("/b"));
+
+  std::vector<uint8_t> file(100000, 7);
+  HttpBody body;
+  body.Append(file.data(), file.size());
+  response = client
+                 .PostMultipartAsync(server.Url("/c"), {{"model", "m"}},
+                                     "audio.wav", "file", std::move(body),
+                                     "audio/wav")
+                 .get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK_EQ(client.GetAsyncStats().threads, 5u);
+}
+
+TEST(StreamedBodiesArriveOnTheLoop) {
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+
+  std::string streamed;
+  std::atomic<int> slices{0};
+  HttpAsyncOptions options;
+  options.onChunk = [&](const char *data, size_t size) {
+    streamed.append(data, size);
+    ++slices;
+    return true;
+  };
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/chunked"), "{}", {}, options).get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK(response.body.empty());
+  CHECK_EQ(streamed, std::string("one two three"));
+  CHECK_GE(slices.load(), 1);
+}
+
+TEST(ThreadCountStaysFixed) {
+  // 64 calls in flight, each held 20 ms by the server, on 4 workers
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config(4)));
+
+  std::vector<std::future<HttpResponse>> calls;
+  for (int i = 0; i < 64; ++i)
+    calls.push_back(client.GetAsync(server.Url("/hold/20")));
+  int ok = 0;
+  for (auto &call : calls)
+    ok += call.get().statusCode == 200;
+
+  CHECK_EQ(ok, 64);
+  CHECK_LE(server.Peak(), 4);
+  EventLoopStats stats = client.GetAsyncStats();
+  CHECK_EQ(stats.threads, 5u);
+  CHECK_GE(stats.peakQueued, 32u);
+  CHECK_LE(client.GetPoolStats().opened, 4u);
+}
+
+TEST(HighPriorityCallsKeepAWorker) {
+  // Three transcriptions and a summary fold hold every worker they may
+  // have; a question still starts at once
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config(4)));
+
+  HttpAsyncOptions normal, low, high;
+  low.priority = HttpPriority::Low;
+  high.priority = HttpPriority::High;
+  std::vector<std::future<HttpResponse>> calls;
+  for (int i = 0; i < 3; ++i)
+    calls.push_back(client.GetAsync(server.Url("/hold/500"), {}, normal));
+  calls.push_back(client.GetAsync(server.Url("/hold/500"), {}, low));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto start = Clock::now();
+  HttpResponse question =
+      client.GetAsync(server.Url("/question"), {}, high).get();
+  CHECK_EQ(question.statusCode, 200);
+  CHECK(Ms(start) < 300);
+  for (auto &call : calls)
+    CHECK_EQ(call.get().statusCode, 200);
+  CHECK_LE(server.Peak(), 4);
+}
+
+TEST(DeadlineEndsASlowCall) {
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+
+  auto start = Clock::now();
+  HttpResponse response =
+      client.GetAsync(server.Url("/hold/5000"), {}, Timeout(100)).get();
+  double ms = Ms(start);
+  CHECK(response.error == L"Timed out");
+  CHECK_EQ(response.statusCode, 0);
+  CHECK(ms >= 95 && ms < 1000);
+
+  // A deadline the call beats changes nothing
+  response = client.GetAsync(server.Url("/fast"), {}, Timeout(5000)).get();
+  CHECK_EQ(response.statusCode, 200);
+}
+
+TEST(CallerTokenCancels) {
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+
+  HttpAsyncOptions options;
+  options.cancel = std::make_shared<CancellationToken>();
+  auto start = Clock::now();
+  std::future<HttpResponse> call =
+      client.GetAsync(server.Url("/hold/5000"), {}, options);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  options.cancel->Cancel();
+  HttpResponse response = call.get();
+  CHECK(response.error == L"Cancelled");
+  CHECK(Ms(start) < 1000);
+
+  // A token cancelled up front never reaches the server
+  response = client.GetAsync(server.Url("/never"), {}, options).get();
+  CHECK(response.error == L"Cancelled");
+}
+
+TEST(QueuedCallsTimeOutWithoutAWorker) {
+  // One worker, busy for 500 ms: the queued call's deadline fires anyway
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config(1)));
+
+  std::future<HttpResponse> busy = client.GetAsync(server.Url("/hold/500"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  auto start = Clock::now();
+  HttpResponse queued =
+      client.GetAsync(server.Url("/queued"), {}, Timeout(50)).get();
+  double ms = Ms(start);
+  CHECK(queued.error == L"Timed out");
+  CHECK(ms < 300);
+  CHECK_EQ(busy.get().statusCode, 200);
+}
+
+TEST(ShutdownCancelsEveryCall) {
+  Server server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config(4)));
+
+  std::mutex mutex;
+  std::vector<std::wstring> errors;
+  for (int i = 0; i < 20; ++i) {
+    client.GetAsync(server.Url("/hold/3000"), {}, HttpAsyncOptions(),
+                    [&](HttpResponse response) {
+                      std::lock_guard<std::mutex> lock(mutex);
+                      errors.push_back(response.error);
+                    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto start = Clock::now();
+  client.Shutdown();
+  CHECK(Ms(start) < 1000);
+
+  // Every completion has run by the time Shutdown() returns
+  std::lock_guard<std::mutex> lock(mutex);
+  CHECK_EQ(errors.size(), 20u);
+  CHECK(std::all_of(errors.begin(), errors.end(), [](const std::wstring &e) {
+    return e == L"Cancelled";
+  }));
+
+  // Calls after Shutdown() complete at once with an error
+  HttpResponse late = client.GetAsync(server.Url("/late")).get();
+  CHECK(!late.error.empty());
+}
@@ -0,0 +1,197 @@
+#include "audio_preprocessor.h"
+#include "test.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace invisible;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+AudioFormat Format(uint32_t rate, uint16_t channels, uint16_t bits,
+                   bool isFloat) {
+  AudioFormat format;
+  format.sampleRate = rate;
+  format.channels = channels;
+  format.bitsPerSample = bits;
+  format.isFloat = isFloat;
+  format.blockAlign = channels * bits / 8;
+  format.avgBytesPerSec = rate * format.blockAlign;
+  return format;
+}
+
+// Interleaved capture data: a tone on the left channel and a different
+// one on the right, in the sample type the format describes
+std::vector<uint8_t> Capture(const AudioFormat &format, size_t frames,
+                             size_t firstFrame = 0) {
+  std::vector<uint8_t> bytes(frames * format.blockAlign);
+  uint8_t *out = bytes.data();
+  for (size_t i = 0; i < frames; ++i) {
+    double t = static_cast<double>(firstFrame + i) / format.sampleRate;
+    for (int ch = 0; ch < format.channels; ++ch) {
+      double value = 0.4 * std::sin(2 * kPi * (ch == 0 ? 440 : 1000) * t);
+      if (format.isFloat) {
+        float sample = static_cast<float>(value);
+        memcpy(out, &sample, sizeof(sample));
+        out += sizeof(sample);
+      } else {
+        int16_t sample = static_cast<int16_t>(std::lround(value * 32767));
+        memcpy(out, &sample, sizeof(sample));
+        out += sizeof(sample);
+      }
+    }
+  }
+  return bytes;
+}
+
+AudioBuffer Packet(const std::vector<uint8_t> &bytes, size_t offset,
+                   size_t size, const AudioFormat &format) {
+  return AudioBuffer(bytes.data() + offset, size,
+                     static_cast<uint32_t>(size / format.blockAlign), 0);
+}
+
+// Reference conversion: the same stages run once over the whole capture
+std::vector<int16_t> OneShot(const std::vector<uint8_t> &bytes,
+                             const AudioFormat &format) {
+  std::vector<float> mono(bytes.size() / format.blockAlign);
+  size_t frames =
+      DownmixToMono(bytes.data(), bytes.size(), format.channels,
+                    format.bitsPerSample, format.isFloat, mono.data());
+  Resampler resampler;
+  resampler.Initialize(format.sampleRate, 16000);
+  std::vector<float> resampled;
+  resampler.Process(mono.data(), frames, resampled);
+  std::vector<int16_t> pcm(resampled.size());
+  ConvertFloatToInt16(resampled.data(), resampled.size(), pcm.data());
+  return pcm;
+}
+
+} // namespace
+
+TEST(PacketsMatchOneShotConversion) {
+  // 10 ms WASAPI-sized packets, and ragged ones, for the shared-mode formats
+  const AudioFormat formats[] = {Format(48000, 2, 32, true),
+                                 Format(44100, 2, 16, false),
+                                 Format(48000, 6, 32, true),
+                                 Format(16000, 1, 16, false)};
+  std::mt19937 rng(7);
+  for (const AudioFormat &format : formats) {
+    std::vector<uint8_t> bytes = Capture(format, format.sampleRate * 2);
+    std::vector<int16_t> expected = OneShot(bytes, format);
+
+    for (bool ragged : {false, true}) {
+      AudioPreprocessor preprocessor;
+      std::vector<int16_t> pcm;
+      std::uniform_int_distribution<size_t> frames(1, 2000);
+      size_t offset = 0;
+      while (offset < bytes.size()) {
+        size_t size = (ragged ? frames(rng) : format.sampleRate / 100) *
+                      format.blockAlign;
+        size = std::min(size, bytes.size() - offset);
+        preprocessor.Convert(Packet(bytes, offset, size, format), format, pcm);
+        offset += size;
+      }
+      REQUIRE(pcm.size() == expected.size());
+      CHECK(memcmp(pcm.data(), expected.data(),
+                   pcm.size() * sizeof(int16_t)) == 0);
+    }
+  }
+}
+
+TEST(ConvertAppendsAndReportsCount) {
+  AudioFormat format = Format(48000, 2, 32, true);
+  std::vector<uint8_t> bytes = Capture(format, 4800);
+  AudioPreprocessor preprocessor;
+  std::vector<int16_t> pcm = {1, 2, 3};
+
+  size_t total = 0;
+  for (size_t offset = 0; offset < bytes.size(); offset += 480 * 8)
+    total += preprocessor.Convert(Packet(bytes, offset, 480 * 8, format),
+                                  format, pcm);
+  CHECK_EQ(pcm.size(), total + 3);
+  CHECK_EQ(pcm[0], 1);
+  CHECK_EQ(pcm[2], 3);
+  // 0.1 s at 16 kHz, less what the filter still holds back
+  CHECK_GT(total, 1500u);
+  CHECK_LE(total, 1600u);
+}
+
+TEST(ToneKeepsFrequencyAndLevel) {
+  // A tone on both channels survives the downmix at its own frequency
+  AudioFormat format = Format(44100, 2, 16, false);
+  std::vector<uint8_t> bytes(44100 * format.blockAlign);
+  for (size_t i = 0; i < 44100; ++i) {
+    int16_t sample = static_cast<int16_t>(
+        std::lround(0.5 * 32767 * std::sin(2 * kPi * 1000 * i / 44100.0)));
+    memcpy(&bytes[i * 4], &sample, 2);
+    memcpy(&bytes[i * 4 + 2], &sample, 2);
+  }
+  AudioPreprocessor preprocessor;
+  std::vector<int16_t> pcm;
+  preprocessor.Convert(Packet(bytes, 0, bytes.size(), format), format, pcm);
+
+  // Count rising zero crossings over the settled middle of the output
+  size_t crossings = 0;
+  for (size_t i = 2001; i < 14001; ++i)
+    crossings += pcm[i - 1] < 0 && pcm[i] >= 0;
+  CHECK_NEAR(crossings, 750, 1); // 1 kHz over 0.75 s
+
+  int16_t peak = 0;
+  for (size_t i = 2000; i < 14000; ++i)
+    peak = std::max<int16_t>(peak, pcm[i]);
+  CHECK_NEAR(peak, 16384, 200);
+}
+
+TEST(RateChangeRestartsTheFilter) {
+  AudioFormat first = Format(48000, 2, 32, true);
+  AudioFormat second = Format(44100, 2, 32, true);
+  std::vector<uint8_t> a = Capture(first, 48000);
+  std::vector<uint8_t> b = Capture(second, 44100);
+
+  AudioPreprocessor preprocessor;
+  std::vector<int16_t> pcm;
+  preprocessor.Convert(Packet(a, 0, a.size(), first), first, pcm);
+  pcm.clear();
+  preprocessor.Convert(Packet(b, 0, b.size(), second), second, pcm);
+
+  // After the switch the output is what a fresh 44.1 kHz stream produces
+  std::vector<int16_t> expected = OneShot(b, second);
+  REQUIRE(pcm.size() == expected.size());
+  CHECK(memcmp(pcm.data(), expected.data(), pcm.size() * sizeof(int16_t)) ==
+        0);
+  CHECK_EQ(preprocessor.GetOutputRate(), 16000u);
+}
+
+TEST(ResetDropsFilterHistory) {
+  AudioFormat format = Format(48000, 1, 16, false);
+  std::vector<uint8_t> bytes = Capture(format, 9600);
+
+  AudioPreprocessor preprocessor;
+  std::vector<int16_t> first, second;
+  preprocessor.Convert(Packet(bytes, 0, bytes.size(), format), format, first);
+  preprocessor.Reset();
+  preprocessor.Convert(Packet(bytes, 0, bytes.size(), format), format, second);
+  REQUIRE(first.size() == second.size());
+  CHECK(first == second);
+}
+
+TEST(UnsupportedInputProducesNothing) {
+  AudioPreprocessor preprocessor;
+  std::vector<int16_t> pcm;
+  std::vector<uint8_t> bytes(960, 0);
+
+  CHECK_EQ(preprocessor.Convert(AudioBuffer(), Format(48000, 2, 16, false),
+                                pcm),
+           0u);
+  CHECK_EQ(preprocessor.Convert(Packet(bytes, 0, bytes.size(),
+                                       Format(48000, 1, 16, false)),
+                                Format(48000, 0, 16, false), pcm),
+           0u);
+  CHECK_EQ(preprocessor.Convert(Packet(bytes, 0, bytes.size(),
+                                       Format(48000, 1, 16, false)),
+                                Format(48000, 1, 4, false), pcm),
+           0u);
+  CHECK(pcm.empty());
+}
@@ -0,0 +1,111 @@
+#include "audio_ring.h"
+#include "bench.h"
+#include <thread>
+
+// Capture-to-consumer handoff through AudioRing: push-to-pop latency as a
+// histogram with the consumer blocked in Pop() (the transcription thread's
+// case), and raw packet throughput with both sides spinning.
+
+using namespace invisible;
+
+namespace {
+
+uint64_t NowNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          bench::Clock::now().time_since_epoch())
+          .count());
+}
+
+AudioFormat StereoFloat() {
+  AudioFormat format;
+  format.sampleRate = 48000;
+  format.channels = 2;
+  format.bitsPerSample = 32;
+  format.blockAlign = 8;
+  format.isFloat = true;
+  return format;
+}
+
+void Latency(size_t packets, std::chrono::microseconds period) {
+  AudioRing ring;
+  std::vector<uint8_t> packet(480 * 8); // 10 ms at 48 kHz stereo float
+
+  std::thread producer([&] {
+    for (size_t i = 0; i < packets; ++i) {
+      std::this_thread::sleep_for(period);
+      ring.Push(packet.data(), packet.size(), 480, NowNs(), StereoFloat());
+    }
+  });
+
+  // Buckets: < 1 us, < 2 us, < 4 us, ... < 32 ms, and the rest
+  constexpr int kBuckets = 17;
+  size_t histogram[kBuckets] = {};
+  std::vector<uint64_t> samples;
+  AudioBuffer buffer;
+  AudioFormat format;
+  for (size_t i = 0; i < packets && ring.Pop(buffer, format, 1000); ++i) {
+    uint64_t latency = NowNs() - buffer.timestamp;
+    samples.push_back(latency);
+    int bucket = 0;
+    while (bucket + 1 < kBuckets && latency >= (1000ull << bucket))
+      ++bucket;
+    ++histogram[bucket];
+  }
+  producer.join();
+
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double p) {
+    return samples.empty()
+               ? 0.0
+               : samples[static_cast<size_t>(p * (samples.size() - 1))] /
+                     1000.0;
+  };
+  printf("push-to-pop latency, %zu packets every %lld us (blocking Pop):\n",
+         samples.size(), static_cast<long long>(period.count()));
+  printf("  p50 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+         percentile(0.5), percentile(0.99), percentile(0.999),
+         percentile(1.0));
+  for (int b = 0; b < kBuckets; ++b) {
+    if (histogram[b] == 0)
+      continue;
+    if (b + 1 < kBuckets)
+      printf("  < %6llu us  %8zu\n", 1ull << b, histogram[b]);
+    else
+      printf("  >= %5llu us  %8zu\n", 1ull << (b - 1), histogram[b]);
+  }
+}
+
+void Throughput(size_t packets) {
+  AudioRing ring;
+  std::vector<uint8_t> packet(480 * 8);
+
+  double seconds = bench::BestOf(bench::Runs(3), [&] {
+    std::thread producer([&] {
+      for (size_t i = 0; i < packets; ++i) {
+        while (!ring.Push(packet.data(), packet.size(), 480, i,
+                          StereoFloat()))
+          std::this_thread::yield();
+      }
+    });
+    AudioBuffer buffer;
+    AudioFormat format;
+    for (size_t i = 0; i < packets; ++i) {
+      while (!ring.Pop(buffer, format, 0))
+        std::this_thread::yield();
+    }
+    producer.join();
+  });
+
+  printf("throughput: %.2f M packets/s, %.0f MB/s (%zu x %zu-byte packets)\n",
+         packets / seconds / 1e6, packets * packet.size() / seconds / 1e6,
+         packets, packet.size());
+}
+
+} // namespace
+
+int main() {
+  Latency(2000, std::chrono::microseconds(1000));
+  Throughput(200000);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "base64.h"
+#include "bench.h"
+#include <random>
+#include <string>
+#include <vector>
+
+// Encode throughput of each kernel against the byte-at-a-time loop the
+// codec replaced, and decode throughput, on an image-sized buffer.
+
+using namespace invisible;
+
+namespace {
+
+// The encoder screen_capture.cpp used before the codec
+std::string OldBase64Encode(const uint8_t *data, size_t len) {
+  static const char base64_chars[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string result;
+  result.reserve(((len + 2) / 3) * 4);
+  for (size_t i = 0; i < len; i += 3) {
+    unsigned int b = (data[i] << 16);
+    if (i + 1 < len)
+      b |= (data[i + 1] << 8);
+    if (i + 2 < len)
+      b |= data[i + 2];
+    result.push_back(base64_chars[(b >> 18) & 0x3F]);
+    result.push_back(base64_chars[(b >> 12) & 0x3F]);
+    result.push_back((i + 1 < len) ? base64_chars[(b >> 6) & 0x3F] : '=');
+    result.push_back((i + 2 < len) ? base64_chars[b & 0x3F] : '=');
+  }
+  return result;
+}
+
+} // namespace
+
+int main() {
+  const size_t size = 8 * 1024 * 1024;
+  const int runs = bench::Runs(5);
+  std::vector<uint8_t> data(size);
+  std::mt19937 rng(1);
+  for (uint8_t &b : data)
+    b = static_cast<uint8_t>(rng());
+  const double gb = size / 1e9;
+
+  std::printf("base64 encode, %zu MB input, best of %d\n", size >> 20, runs);
+  double old = bench::BestOf(runs, [&] {
+    std::string text = OldBase64Encode(data.data(), data.size());
+    bench::Consume(text);
+  });
+  std::printf("  %-8s %6.2f GB/s\n", "old", gb / old);
+
+  std::string out(Base64EncodedLength(size), '\0');
+  for (const char *kernel : Base64EncoderNames()) {
+    double t = bench::BestOf(runs, [&] {
+      Base64EncodeWith(kernel, data.data(), data.size(), &out[0]);
+      bench::Consume(out);
+    });
+    std::printf("  %-8s %6.2f GB/s  (%.1fx old)\n", kernel, gb / t, old / t);
+  }
+
+  std::vector<uint8_t> decoded;
+  decoded.reserve(size);
+  double t = bench::BestOf(runs, [&] {
+    decoded.clear();
+    Base64Decode(out.data(), out.size(), decoded);
+  });
+  std::printf("base64 decode: %.2f GB/s of output\n", gb / t);
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "base64.h"
+#include "test.h"
+#include <cstring>
+#include <random>
+
+using namespace invisible;
+
+namespace {
+
+// RFC 4648 reference encoder, one byte at a time
+std::string Reference(const std::vector<uint8_t> &data) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < data.size())
+      v |= static_cast<uint32_t>(data[i + 1]) << 8;
+    if (i + 2 < data.size())
+      v |= data[i + 2];
+    out += alphabet[(v >> 18) & 63];
+    out += alphabet[(v >> 12) & 63];
+    out += i + 1 < data.size() ? alphabet[(v >> 6) & 63] : '=';
+    out += i + 2 < data.size() ? alphabet[v & 63] : '=';
+  }
+  return out;
+}
+
+std::vector<uint8_t> RandomBytes(size_t size, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> data(size);
+  for (uint8_t &b : data)
+    b = static_cast<uint8_t>(rng());
+  return data;
+}
+
+} // namespace
+
+TEST(Rfc4648Vectors) {
+  const char *vectors[][2] = {{"", ""},
+                              {"f", "Zg=="},
+                              {"fo", "Zm8="},
+                              {"foo", "Zm9v"},
+                              {"foob", "Zm9vYg=="},
+                              {"fooba", "Zm9vYmE="},
+                              {"foobar", "Zm9vYmFy"}};
+  for (const auto &v : vectors) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(v[0]);
+    CHECK_EQ(Base64Encode(bytes, strlen(v[0])), std::string(v[1]));
+    std::vector<uint8_t> decoded;
+    CHECK(Base64Decode(v[1], strlen(v[1]), decoded));
+    CHECK_EQ(std::string(decoded.begin(), decoded.end()), std::string(v[0]));
+  }
+}
+
+// Every kernel, at every length around its block sizes (12 and 24 input
+// bytes per vector step) and at offsets that misalign the input
+TEST(EveryKernelMatchesTheReference) {
+  std::vector<const char *> kernels = Base64EncoderNames();
+  REQUIRE(!kernels.empty());
+  CHECK_EQ(std::string(kernels.back()), std::string("scalar"));
+  std::printf("kernels:");
+  for (const char *name : kernels)
+    std::printf(" %s", name);
+  std::printf("\n");
+
+  std::vector<uint8_t> pool = RandomBytes(4096 + 64, 1);
+  for (const char *kernel : kernels) {
+    for (size_t length = 0; length <= 200; ++length) {
+      for (size_t offset : {0, 1, 7}) {
+        std::vector<uint8_t> data(pool.begin() + offset,
+                                  pool.begin() + offset + length);
+        std::string out(Base64EncodedLength(length) + 1, '#');
+        REQUIRE(Base64EncodeWith(kernel, pool.data() + offset, length,
+                                 &out[0]));
+        CHECK_EQ(out.back(), '#'); // Nothing written past the end
+        out.pop_back();
+        if (out != Reference(data)) {
+          CHECK_EQ(out, Reference(data));
+          return;
+        }
+      }
+    }
+    std::vector<uint8_t> big(pool.begin(), pool.begin() + 4096);
+    std::string out(Base64EncodedLength(big.size()), '\0');
+    REQUIRE(Base64EncodeWith(kernel, big.data(), big.size(), &out[0]));
+    CHECK(out == Reference(big));
+  }
+  CHECK(!Base64EncodeWith("neon", pool.data(), 3, nullptr));
+}
+
+TEST(RoundTripsRandomData) {
+  for (size_t length : {1u, 2u, 3u, 47u, 48u, 1000u, 65537u}) {
+    std::vector<uint8_t> data =
+        RandomBytes(length, static_cast<uint32_t>(length));
+    std::string text = Base64Encode(data.data(), data.size());
+    std::vector<uint8_t> decoded = {9}; // Decoding appends
+    REQUIRE(Base64Decode(text.data(), text.size(), decoded));
+    CHECK_EQ(decoded.size(), data.size() + 1);
+    CHECK(std::equal(data.begin(), data.end(), decoded.begin() + 1));
+  }
+}
+
+TEST(DecodeRejectsMalformedInput) {
+  std::vector<uint8_t> out = {1, 2};
+  CHECK(!Base64Decode("Zm9", 3, out));       // Not a multiple of 4
+  CHECK(!Base64Decode("Zm9*", 4, out));      // Outside the alphabet
+  CHECK(!Base64Decode("Z=9v", 4, out));      // Padding in the middle
+  CHECK(!Base64Decode("Zg==Zm9v", 8, out));  // Padding before the end
+  CHECK_EQ(out.size(), 2u);                  // Left as it was
+}
+
+TEST(StreamingMatchesOneShot) {
+  std::vector<uint8_t> data = RandomBytes(50000, 7);
+  const std::string expected = Base64Encode(data.data(), data.size());
+
+  std::mt19937 rng(3);
+  for (int round = 0; round < 3; ++round) {
+    std::string streamed;
+    size_t largest = 0;
+    Base64StreamEncoder encoder([&](const char *text, size_t length) {
+      streamed.append(text, length);
+      largest = std::max(largest, length);
+    });
+    for (size_t pos = 0; pos < data.size();) {
+      size_t piece = std::min<size_t>(rng() % 20000, data.size() - pos);
+      encoder.Update(data.data() + pos, piece);
+      pos += piece;
+    }
+    encoder.Finish();
+    CHECK(streamed == expected);
+    CHECK_EQ(encoder.GetOutputLength(), expected.size());
+    CHECK_LE(largest, 16384u);
+  }
+}
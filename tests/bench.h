@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// -----------------------------------------------------------------------------
+// Benchmark Helpers
+// Benchmarks are plain executables that print a table; they are built with
+// the tests but not run by CTest. Each figure is the best of several runs,
+// which is the most repeatable number on a busy machine.
+// -----------------------------------------------------------------------------
+
+namespace invisible {
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Best wall time of `runs` calls of `fn`, in seconds
+template <typename Fn> double BestOf(int runs, Fn &&fn) {
+  double best = 1e30;
+  for (int i = 0; i < runs; ++i) {
+    auto start = Clock::now();
+    fn();
+    best = std::min(best, Seconds(start));
+  }
+  return best;
+}
+
+// Runs from the BENCH_RUNS environment variable, else `fallback`
+inline int Runs(int fallback) {
+  const char *value = std::getenv("BENCH_RUNS");
+  int runs = value ? std::atoi(value) : 0;
+  return runs > 0 ? runs : fallback;
+}
+
+// Keeps the compiler from discarding a result
+template <typename T> inline void Consume(const T &value) {
+  static volatile const void *sink;
+  sink = &value;
+}
+
+} // namespace bench
+} // namespace invisible
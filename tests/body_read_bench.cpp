@@ -0,0 +1,114 @@
+#include "alloc_counter.h"
+#include "bench.h"
+#include "http_client.h"
+#include "stub_server.h"
+#include <map>
+
+// Reading multi-MB response bodies from a loopback server, per framing
+// (Content-Length, chunked, read until close). "buffered" is PostJson,
+// where HttpBodyReader receives into the body it sized from the header;
+// "append" streams the same response to a callback that appends each
+// slice to a string, which is how bodies were collected before. Heap
+// bytes are counted on the reading thread and shown per body byte.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+
+namespace {
+
+const size_t kSizesMb[] = {1, 4, 16, 64};
+
+// Whole responses, built once: "/<framing>/<MB>"
+std::map<std::string, std::string> BuildResponses() {
+  std::map<std::string, std::string> responses;
+  for (size_t mb : kSizesMb) {
+    std::string body(mb << 20, 'x');
+    std::string key = "/" + std::to_string(mb);
+    responses["/length" + key] = test::StubResponse(200, body);
+
+    std::string chunked = test::StubChunkedHead(200);
+    for (size_t at = 0; at < body.size(); at += 65536)
+      chunked += test::StubChunk(std::string_view(body).substr(at, 65536));
+    chunked += test::StubChunk("");
+    responses["/chunked" + key] = std::move(chunked);
+
+    responses["/close" + key] =
+        "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n" + body;
+  }
+  return responses;
+}
+
+struct Result {
+  double mbPerSecond = 0;
+  double heapPerByte = 0;
+  bool ok = true;
+};
+
+template <typename Fn> Result Measure(size_t bytes, int runs, Fn &&read) {
+  Result result;
+  test::AllocationCounter counter;
+  double best = bench::BestOf(runs, [&] {
+    counter.Start();
+    result.ok = read() == bytes && result.ok;
+    counter.Stop();
+  });
+  result.mbPerSecond = bytes / best / 1e6;
+  result.heapPerByte = static_cast<double>(counter.Bytes()) / bytes;
+  return result;
+}
+
+} // namespace
+
+int main() {
+  const int runs = bench::Runs(5);
+  const std::map<std::string, std::string> responses = BuildResponses();
+  auto server = StubServer::Http(
+      [&responses](const StubRequest &request, StubConnection &connection) {
+        auto response = responses.find(request.path);
+        if (response == responses.end())
+          return connection.Write(test::StubResponse(404, ""));
+        return connection.Write(response->second) &&
+               request.path.compare(0, 6, "/close") != 0;
+      });
+  if (!server->IsListening()) {
+    std::printf("cannot listen on loopback\n");
+    return 1;
+  }
+
+  HttpClient client;
+  client.Initialize();
+
+  std::printf("response body reads, best of %d (MB/s, heap bytes per body "
+              "byte)\n",
+              runs);
+  std::printf("  %-9s %5s %18s %18s\n", "framing", "MB", "buffered",
+              "append");
+  for (const char *framing : {"length", "chunked", "close"}) {
+    for (size_t mb : kSizesMb) {
+      std::wstring url = server->WideUrl(
+          "/" + std::string(framing) + "/" + std::to_string(mb));
+      size_t bytes = mb << 20;
+
+      Result buffered = Measure(bytes, runs, [&] {
+        return client.PostJson(url, "{}").body.size();
+      });
+      Result append = Measure(bytes, runs, [&] {
+        std::string body;
+        client.PostJsonStreaming(url, "{}", {},
+                                 [&](const char *data, size_t size) {
+                                   body.append(data, size);
+                                   return true;
+                                 });
+        return body.size();
+      });
+
+      std::printf("  %-9s %5zu %9.0f %6.2fx %s %9.0f %6.2fx %s\n", framing,
+                  mb, buffered.mbPerSecond, buffered.heapPerByte,
+                  buffered.ok ? " " : "!", append.mbPerSecond,
+                  append.heapPerByte, append.ok ? " " : "!");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "synthetic_capture_backend.h"
+
+// Capture throughput of a fresh frame per capture (as CaptureRegion hands
+// them out), with the frame buffer pool and without it: without the pool
+// every capture allocates and page-faults its buffer in again.
+
+using namespace invisible;
+using invisible::test::SyntheticCaptureBackend;
+
+int main() {
+  const int runs = bench::Runs(5);
+  const int captures = 20;
+  std::printf("synthetic captures, %d per run, best of %d\n", captures, runs);
+  struct Region {
+    const char *name;
+    int width, height;
+  } regions[] = {{"800x600", 800, 600},
+                 {"1080p", 1920, 1080},
+                 {"4K", 3840, 2160}};
+  for (const Region &r : regions) {
+    const double bytes = static_cast<double>(r.width) * r.height * 4;
+    double seconds[2];
+    for (int pooled = 0; pooled < 2; ++pooled) {
+      FrameBufferPool pool;
+      SyntheticCaptureBackend backend(r.width, r.height,
+                                      pooled ? &pool : nullptr);
+      backend.Fill({0, 0, r.width, r.height}, 0xFF336699u);
+      seconds[pooled] = bench::BestOf(runs, [&] {
+        for (int i = 0; i < captures; ++i) {
+          CaptureFrame frame;
+          backend.Capture({0, 0, r.width, r.height}, frame);
+          bench::Consume(frame.pixels.data());
+        }
+      });
+    }
+    std::printf("  %-8s unpooled %7.2f ms (%5.1f GB/s), pooled %7.2f ms "
+                "(%5.1f GB/s), %.1fx\n",
+                r.name, seconds[0] / captures * 1e3,
+                bytes * captures / seconds[0] / 1e9,
+                seconds[1] / captures * 1e3,
+                bytes * captures / seconds[1] / 1e9, seconds[0] / seconds[1]);
+  }
+  return 0;
+}
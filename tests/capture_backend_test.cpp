@@ -0,0 +1,222 @@
+#include "synthetic_capture_backend.h"
+#include "test.h"
+#include <algorithm>
+#include <cstring>
+
+// The capture path without a display: SyntheticCaptureBackend stands in for
+// the DXGI and GDI backends, so region copies, dirty rectangles and the
+// reuse of pooled frame buffers between captures can be checked on any
+// platform.
+
+using namespace invisible;
+using invisible::test::SyntheticCaptureBackend;
+
+namespace {
+
+constexpr uint32_t kRed = 0xFFFF0000;
+
+// Every pixel of `frame` equals the desktop under `region`
+bool MatchesDesktop(const CaptureFrame &frame,
+                    const SyntheticCaptureBackend &backend,
+                    const ImageRect &region) {
+  if (frame.width != region.width || frame.height != region.height ||
+      frame.stride != region.width * 4)
+    return false;
+  for (int y = 0; y < region.height; ++y) {
+    if (memcmp(frame.View().Row(y), backend.Pixel(region.x, region.y + y),
+               static_cast<size_t>(region.width) * 4) != 0)
+      return false;
+  }
+  return true;
+}
+
+// A desktop with a different colour in every pixel
+void Paint(SyntheticCaptureBackend &backend) {
+  const int width = backend.GetWidth();
+  const int height = backend.GetHeight();
+  std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+  for (size_t i = 0; i < pixels.size(); ++i)
+    pixels[i] = static_cast<uint8_t>(i * 31 + i / 4093);
+  backend.Draw({0, 0, width, height}, pixels.data(), width * 4);
+}
+
+bool SameRect(const ImageRect &a, const ImageRect &b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+} // namespace
+
+// --- Capture -----------------------------------------------------------------
+
+TEST(CapturesCopyTheRegion) {
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend(640, 480, &pool);
+  Paint(backend);
+
+  CaptureFrame frame;
+  for (ImageRect region : {ImageRect{0, 0, 640, 480},
+                           ImageRect{13, 7, 101, 55},
+                           ImageRect{639, 479, 1, 1}}) {
+    REQUIRE(backend.Capture(region, frame));
+    CHECK(MatchesDesktop(frame, backend, region));
+  }
+  CaptureBackendStats stats = backend.GetStats();
+  CHECK_EQ(stats.captures, 3u);
+  CHECK_EQ(stats.capturedBytes, 640u * 480 * 4 + 101 * 55 * 4 + 4);
+}
+
+TEST(RegionsOffTheDesktopFail) {
+  SyntheticCaptureBackend backend(200, 100, nullptr);
+  CaptureFrame frame;
+  CHECK(!backend.Capture({-1, 0, 10, 10}, frame));
+  CHECK(!backend.Capture({195, 0, 10, 10}, frame));
+  CHECK(!backend.Capture({0, 0, 0, 10}, frame));
+  CHECK(frame.pixels.empty());
+  CHECK_EQ(backend.GetStats().failures, 3u);
+
+  // Without a pool captures still work, as plain allocations
+  CHECK(backend.Capture({0, 0, 200, 100}, frame));
+  CHECK_EQ(frame.pixels.size(), 200u * 100 * 4);
+}
+
+// --- Buffer reuse ------------------------------------------------------------
+
+TEST(RepeatCapturesKeepTheirBuffer) {
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend(1920, 1080, &pool);
+  CaptureFrame frame;
+  REQUIRE(backend.Capture({100, 100, 800, 600}, frame));
+  const uint8_t *first = frame.pixels.data();
+  for (int i = 0; i < 20; ++i) {
+    backend.Fill({0, 0, 1920, 1080}, 0xFF000000u + i);
+    REQUIRE(backend.Capture({100, 100, 800, 600}, frame));
+    CHECK(frame.pixels.data() == first);
+    CHECK_EQ(frame.View().Row(599)[0], static_cast<uint8_t>(i));
+  }
+  FrameBufferPoolStats stats = pool.GetStats();
+  CHECK_EQ(stats.allocations, 1u);
+  CHECK_EQ(stats.acquires, 1u);
+}
+
+TEST(ReleasedFramesGoBackToThePool) {
+  // One capture at a time, each frame dropped before the next (as
+  // CaptureRegion hands frames out): one allocation in all
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend(1920, 1080, &pool);
+  const uint8_t *first = nullptr;
+  for (int i = 0; i < 50; ++i) {
+    CaptureFrame frame;
+    REQUIRE(backend.Capture({0, 0, 1920, 1080}, frame));
+    if (!first)
+      first = frame.pixels.data();
+    CHECK(frame.pixels.data() == first);
+  }
+  FrameBufferPoolStats stats = pool.GetStats();
+  CHECK_EQ(stats.allocations, 1u);
+  CHECK_EQ(stats.reuses, 49u);
+  CHECK_EQ(stats.pooledBuffers, 1u);
+}
+
+TEST(NearbySizesShareABuffer) {
+  // A slightly different drag fits the size class reserved last time; a
+  // thumbnail does not take the full-screen buffer
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend(1920, 1080, &pool);
+  CaptureFrame frame;
+  REQUIRE(backend.Capture({0, 0, 1000, 1000}, frame));
+  REQUIRE(backend.Capture({0, 0, 1010, 1002}, frame));
+  REQUIRE(backend.Capture({5, 5, 990, 995}, frame));
+  CHECK(MatchesDesktop(frame, backend, {5, 5, 990, 995}));
+  FrameBufferPoolStats stats = pool.GetStats();
+  CHECK_EQ(stats.allocations, 1u);
+  CHECK_EQ(stats.reuses, 2u);
+
+  CaptureFrame thumbnail;
+  REQUIRE(backend.Capture({0, 0, 64, 64}, thumbnail));
+  CHECK_EQ(pool.GetStats().allocations, 2u);
+  CHECK(thumbnail.pixels.data() != frame.pixels.data());
+}
+
+TEST(ConcurrentFramesTakeSeparateBuffers) {
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend(800, 600, &pool);
+  std::vector<CaptureFrame> frames(4);
+  for (int round = 0; round < 3; ++round) {
+    for (CaptureFrame &frame : frames) {
+      frame = CaptureFrame(); // Released, then captured again
+      REQUIRE(backend.Capture({0, 0, 800, 600}, frame));
+    }
+    for (size_t i = 1; i < frames.size(); ++i)
+      CHECK(frames[i].pixels.data() != frames[i - 1].pixels.data());
+  }
+  CHECK_LE(pool.GetStats().allocations, 5u);
+}
+
+// --- Dirty rectangles --------------------------------------------------------
+
+TEST(DirtyRectsFollowDrawing) {
+  SyntheticCaptureBackend backend(1000, 800, nullptr);
+  const ImageRect region{100, 100, 400, 300};
+  CaptureFrame frame;
+  REQUIRE(backend.Capture(region, frame));
+  CHECK(!frame.dirtyRectsValid); // Nothing to compare with yet
+
+  REQUIRE(backend.Capture(region, frame));
+  CHECK(frame.dirtyRectsValid);
+  CHECK(frame.dirtyRects.empty()); // Nothing drawn
+
+  backend.Fill({150, 120, 20, 10}, kRed);   // Inside
+  backend.Fill({480, 390, 100, 100}, kRed); // Across the corner
+  backend.Fill({700, 700, 50, 50}, kRed);   // Outside
+  REQUIRE(backend.Capture(region, frame));
+  CHECK(frame.dirtyRectsValid);
+  REQUIRE(frame.dirtyRects.size() == 2);
+  CHECK(SameRect(frame.dirtyRects[0], {50, 20, 20, 10}));
+  CHECK(SameRect(frame.dirtyRects[1], {380, 290, 20, 10}));
+
+  // Another region has no history
+  REQUIRE(backend.Capture({0, 0, 100, 100}, frame));
+  CHECK(!frame.dirtyRectsValid);
+}
+
+TEST(ManyDirtyRectsMergeIntoTheirBounds) {
+  DirtyRegionTracker tracker(4);
+  CaptureFrame frame;
+  const ImageRect region{0, 0, 500, 500};
+  tracker.Report(region, frame);
+  for (int i = 0; i < 10; ++i)
+    tracker.Add({i * 40, i * 30, 10, 10});
+  tracker.Report(region, frame);
+  REQUIRE(frame.dirtyRects.size() <= 4);
+  int x1 = 0, y1 = 0;
+  for (const ImageRect &rect : frame.dirtyRects) {
+    x1 = std::max(x1, rect.x + rect.width);
+    y1 = std::max(y1, rect.y + rect.height);
+  }
+  CHECK_EQ(x1, 370); // Nothing was lost in merging
+  CHECK_EQ(y1, 280);
+
+  tracker.Invalidate();
+  tracker.Report(region, frame);
+  CHECK(!frame.dirtyRectsValid);
+}
+
+TEST(RectHelpers) {
+  CHECK(SameRect(IntersectRects({0, 0, 10, 10}, {5, 5, 10, 10}),
+                 {5, 5, 5, 5}));
+  ImageRect none = IntersectRects({0, 0, 10, 10}, {20, 0, 5, 5});
+  CHECK_EQ(none.width, 0);
+  CHECK_EQ(none.height, 0);
+
+  // CopySurfaceRegion honours the surface stride
+  std::vector<uint8_t> surface(64 * 8 * 4 + 64, 0);
+  const int stride = 64 * 4 + 8;
+  for (int y = 0; y < 8; ++y)
+    surface[static_cast<size_t>(y) * stride + 10 * 4] = static_cast<uint8_t>(y);
+  CaptureFrame frame;
+  CopySurfaceRegion(surface.data(), stride, {10, 0, 4, 8}, nullptr, frame);
+  REQUIRE(frame.pixels.size() == 4u * 8 * 4);
+  for (int y = 0; y < 8; ++y)
+    CHECK_EQ(frame.View().Row(y)[0], static_cast<uint8_t>(y));
+}
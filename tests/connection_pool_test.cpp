@@ -0,0 +1,232 @@
+#include "connection_pool.h"
+#include "test.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+// ConnectionPool's bookkeeping with counted fake handles: reuse order,
+// per-host limits, waiting and timing out for a slot, idle eviction and
+// failed opens. Handshakes against a real server are in keep_alive_test.
+
+using namespace invisible;
+
+namespace {
+
+// Hands out numbered handles and records which were closed
+class FakeBackend {
+public:
+  ConnectionPool::OpenFn Opener(bool fail = false) {
+    return [this, fail]() -> ConnectionPool::Connection {
+      if (fail)
+        return nullptr;
+      std::lock_guard<std::mutex> lock(mutex_);
+      return reinterpret_cast<ConnectionPool::Connection>(++opened_);
+    };
+  }
+
+  ConnectionPool::CloseFn Closer() {
+    return [this](ConnectionPool::Connection connection) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_.insert(reinterpret_cast<uintptr_t>(connection));
+    };
+  }
+
+  uintptr_t Opened() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return opened_;
+  }
+
+  std::set<uintptr_t> Closed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+  }
+
+private:
+  std::mutex mutex_;
+  uintptr_t opened_ = 0;
+  std::set<uintptr_t> closed_;
+};
+
+uintptr_t Id(ConnectionPool::Connection connection) {
+  return reinterpret_cast<uintptr_t>(connection);
+}
+
+} // namespace
+
+TEST(ReusesTheMostRecentlyReleased) {
+  FakeBackend backend;
+  ConnectionPool pool(ConnectionPoolConfig(), backend.Closer());
+  bool reused = true;
+  auto a = pool.Acquire("h", backend.Opener(), &reused);
+  CHECK(!reused);
+  auto b = pool.Acquire("h", backend.Opener());
+  pool.Release("h", a, true);
+  pool.Release("h", b, true);
+
+  auto next = pool.Acquire("h", backend.Opener(), &reused);
+  CHECK(reused);
+  CHECK_EQ(Id(next), Id(b));
+  pool.Release("h", next, true);
+
+  ConnectionPoolStats stats = pool.GetStats();
+  CHECK_EQ(stats.acquires, 3u);
+  CHECK_EQ(stats.hits, 1u);
+  CHECK_EQ(stats.opened, 2u);
+  CHECK_EQ(stats.open, 2u);
+  CHECK_EQ(stats.idle, 2u);
+}
+
+TEST(HostsDoNotShareConnections) {
+  FakeBackend backend;
+  ConnectionPool pool(ConnectionPoolConfig(), backend.Closer());
+  auto a = pool.Acquire("https://a:443", backend.Opener());
+  pool.Release("https://a:443", a, true);
+  bool reused = true;
+  auto b = pool.Acquire("https://b:443", backend.Opener(), &reused);
+  CHECK(!reused);
+  CHECK_NE(Id(a), Id(b));
+  pool.Release("https://b:443", b, true);
+}
+
+TEST(UnreusableReleasesAreClosed) {
+  FakeBackend backend;
+  ConnectionPool pool(ConnectionPoolConfig(), backend.Closer());
+  auto a = pool.Acquire("h", backend.Opener());
+  pool.Release("h", a, false);
+  CHECK_EQ(backend.Closed().count(Id(a)), 1u);
+  CHECK_EQ(pool.GetStats().discarded, 1u);
+  CHECK_EQ(pool.GetStats().open, 0u);
+
+  bool reused = true;
+  pool.Release("h", pool.Acquire("h", backend.Opener(), &reused), true);
+  CHECK(!reused);
+}
+
+TEST(FailedOpensFreeTheirSlot) {
+  FakeBackend backend;
+  ConnectionPoolConfig config;
+  config.maxPerHost = 1;
+  ConnectionPool pool(config, backend.Closer());
+  CHECK(pool.Acquire("h", backend.Opener(true)) == nullptr);
+  CHECK(pool.Acquire("h", backend.Opener(true)) == nullptr);
+  auto a = pool.Acquire("h", backend.Opener());
+  CHECK(a != nullptr);
+  CHECK_EQ(pool.GetStats().openFailed, 2u);
+  CHECK_EQ(pool.GetStats().open, 1u);
+  pool.Release("h", a, true);
+}
+
+TEST(IdleConnectionsExpire) {
+  FakeBackend backend;
+  ConnectionPoolConfig config;
+  config.idleTimeoutMs = 30;
+  ConnectionPool pool(config, backend.Closer());
+  auto a = pool.Acquire("h", backend.Opener());
+  auto b = pool.Acquire("h", backend.Opener());
+  pool.Release("h", a, true);
+  pool.Release("h", b, true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+
+  // Acquire() drops the expired ones rather than handing them out
+  bool reused = true;
+  auto c = pool.Acquire("h", backend.Opener(), &reused);
+  CHECK(!reused);
+  CHECK_EQ(backend.Closed().size(), 2u);
+  CHECK_EQ(pool.GetStats().evicted, 2u);
+  pool.Release("h", c, true);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  pool.EvictIdle();
+  CHECK_EQ(backend.Closed().count(Id(c)), 1u);
+  CHECK_EQ(pool.GetStats().open, 0u);
+}
+
+TEST(LimitBlocksUntilARelease) {
+  FakeBackend backend;
+  ConnectionPoolConfig config;
+  config.maxPerHost = 2;
+  ConnectionPool pool(config, backend.Closer());
+  auto a = pool.Acquire("h", backend.Opener());
+  auto b = pool.Acquire("h", backend.Opener());
+
+  std::atomic<bool> got{false};
+  ConnectionPool::Connection waited = nullptr;
+  std::thread waiter([&] {
+    waited = pool.Acquire("h", backend.Opener());
+    got = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!got);
+  pool.Release("h", a, true);
+  waiter.join();
+  CHECK_EQ(Id(waited), Id(a));
+  CHECK_EQ(backend.Opened(), 2u);
+  CHECK_EQ(pool.GetStats().waits, 1u);
+  pool.Release("h", b, true);
+  pool.Release("h", waited, true);
+}
+
+TEST(LimitTimesOut) {
+  FakeBackend backend;
+  ConnectionPoolConfig config;
+  config.maxPerHost = 1;
+  config.acquireTimeoutMs = 40;
+  ConnectionPool pool(config, backend.Closer());
+  auto a = pool.Acquire("h", backend.Opener());
+  auto start = std::chrono::steady_clock::now();
+  CHECK(pool.Acquire("h", backend.Opener()) == nullptr);
+  CHECK(std::chrono::steady_clock::now() - start >=
+        std::chrono::milliseconds(40));
+  CHECK_EQ(pool.GetStats().timeouts, 1u);
+  pool.Release("h", a, true);
+}
+
+TEST(ManyThreadsStayWithinTheLimit) {
+  FakeBackend backend;
+  ConnectionPoolConfig config;
+  config.maxPerHost = 3;
+  ConnectionPool pool(config, backend.Closer());
+  std::atomic<int> busy{0};
+  std::atomic<int> peak{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 200; ++i) {
+        auto connection = pool.Acquire("h", backend.Opener());
+        int now = ++busy;
+        int seen = peak;
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::yield();
+        --busy;
+        pool.Release("h", connection, i % 50 != 0);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  ConnectionPoolStats stats = pool.GetStats();
+  CHECK_LE(peak.load(), 3);
+  CHECK_EQ(stats.acquires, 1600u);
+  CHECK_EQ(stats.hits + stats.opened, 1600u);
+  CHECK_EQ(stats.discarded, 32u); // Every 50th release
+  CHECK_LE(stats.open, 3u);
+  CHECK_EQ(backend.Opened() - backend.Closed().size(), stats.open);
+}
+
+TEST(ClearClosesIdleConnections) {
+  FakeBackend backend;
+  ConnectionPool pool(ConnectionPoolConfig(), backend.Closer());
+  auto a = pool.Acquire("h", backend.Opener());
+  auto b = pool.Acquire("h", backend.Opener());
+  pool.Release("h", a, true);
+  pool.Clear();
+  CHECK_EQ(backend.Closed().size(), 1u);
+  CHECK_EQ(pool.GetStats().open, 1u); // b is still busy
+  pool.Release("h", b, true);
+}
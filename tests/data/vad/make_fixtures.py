@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Regenerates the VAD test fixtures (16 kHz mono 16-bit WAV).
+
+Speech is a formant-synthesised voice: a glottal pulse train with pitch
+drift and jitter, filtered through F1-F3 resonators that step between
+vowels at syllable rate. It is deterministic (fixed seed), so the files
+only change when this script does. The speech spans are mirrored in
+vad_test.cpp.
+"""
+
+import math
+import os
+import random
+import struct
+import wave
+
+RATE = 16000
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+VOWELS = [  # F1, F2, F3 (Hz)
+    (730, 1090, 2440),  # a
+    (270, 2290, 3010),  # i
+    (530, 1840, 2480),  # e
+    (300, 870, 2240),   # u
+    (570, 840, 2410),   # o
+]
+
+
+def resonator(signal, freq, bandwidth):
+    r = math.exp(-math.pi * bandwidth / RATE)
+    a1 = 2 * r * math.cos(2 * math.pi * freq / RATE)
+    a2 = -r * r
+    gain = 1 - r
+    y1 = y2 = 0.0
+    out = []
+    for x in signal:
+        y = gain * x + a1 * y1 + a2 * y2
+        out.append(y)
+        y2, y1 = y1, y
+    return out
+
+
+def voice(seconds, rng):
+    n = int(seconds * RATE)
+    # Glottal source: pulse train with slow pitch drift and jitter,
+    # low-passed for the usual -12 dB/octave source tilt
+    source = []
+    phase = 0.0
+    lp1 = lp2 = 0.0
+    for i in range(n):
+        f0 = 120 + 20 * math.sin(2 * math.pi * 0.7 * i / RATE)
+        f0 *= 1 + 0.01 * rng.uniform(-1, 1)
+        phase += f0 / RATE
+        pulse = 1.0 if phase >= 1.0 else 0.0
+        phase -= math.floor(phase)
+        lp1 += 0.25 * (pulse - lp1)
+        lp2 += 0.25 * (lp1 - lp2)
+        source.append(lp2)
+
+    # Vowel per syllable (~180 ms), each with an attack/decay envelope
+    out = [0.0] * n
+    syllable = int(0.18 * RATE)
+    for start in range(0, n, syllable):
+        end = min(n, start + syllable)
+        f1, f2, f3 = rng.choice(VOWELS)
+        piece = source[start:end]
+        shaped = [0.0] * len(piece)
+        for freq, bw, weight in ((f1, 80, 1.0), (f2, 100, 0.6),
+                                 (f3, 150, 0.3)):
+            band = resonator(piece, freq, bw)
+            shaped = [s + weight * b for s, b in zip(shaped, band)]
+        for k, s in enumerate(shaped):
+            t = k / len(shaped)
+            envelope = min(1.0, t / 0.15) * min(1.0, (1 - t) / 0.25)
+            out[start + k] = s * (0.3 + 0.7 * envelope)
+    peak = max(abs(s) for s in out) or 1.0
+    return [s / peak for s in out]
+
+
+def noise(seconds, level_db, rng):
+    amplitude = 10 ** (level_db / 20) * math.sqrt(3)  # uniform RMS -> level
+    return [rng.uniform(-amplitude, amplitude)
+            for _ in range(int(seconds * RATE))]
+
+
+def mix(background, spans, level_db, rng):
+    out = list(background)
+    gain = 10 ** (level_db / 20)
+    for start, end in spans:
+        speech = voice(end - start, rng)
+        offset = int(start * RATE)
+        for k, s in enumerate(speech):
+            out[offset + k] += gain * s
+    return out
+
+
+def write(name, samples):
+    path = os.path.join(HERE, name)
+    with wave.open(path, 'wb') as f:
+        f.setnchannels(1)
+        f.setsampwidth(2)
+        f.setframerate(RATE)
+        f.writeframes(b''.join(
+            struct.pack('<h', max(-32768, min(32767, round(s * 32767))))
+            for s in samples))
+
+
+def main():
+    rng = random.Random(2024)
+    spans = [(1.0, 2.0), (2.5, 3.2)]
+    write('speech_quiet.wav',
+          mix(noise(4.0, -65, rng), spans, -10, rng))
+    write('speech_noisy.wav',
+          mix(noise(4.0, -35, rng), spans, -20, rng))
+    # Steady hiss that steps up 10 dB halfway: no speech anywhere
+    write('noise_only.wav', noise(1.5, -45, rng) + noise(1.5, -35, rng))
+    write('silence.wav', [0.0] * RATE)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,358 @@
+#include "cancellation_token.h"
+#include "event_loop.h"
+#include "test.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+// EventLoop's workers, timers and shutdown, and the CancellationToken the
+// async calls share with their deadline timers.
+
+using namespace invisible;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Blocks the threads that Wait() until Open()
+class Gate {
+public:
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return open_; });
+  }
+  void Open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = true;
+    cv_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool open_ = false;
+};
+
+// Spin (politely) until `done` or a second has passed
+template <typename Fn> bool WaitFor(Fn &&done) {
+  auto deadline = Clock::now() + std::chrono::seconds(1);
+  while (!done()) {
+    if (Clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+} // namespace
+
+// --- Workers -----------------------------------------------------------------
+
+TEST(PostedTasksRunOnTheWorkers) {
+  EventLoop loop;
+  REQUIRE(loop.Start(3));
+  CHECK(loop.IsRunning());
+  CHECK(!loop.IsLoopThread());
+
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  std::atomic<int> ran{0};
+  std::atomic<int> offLoop{0};
+  for (int i = 0; i < 200; ++i) {
+    CHECK(loop.Post([&] {
+      if (!loop.IsLoopThread())
+        ++offLoop;
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.insert(std::this_thread::get_id());
+      ++ran;
+    }));
+  }
+  CHECK(WaitFor([&] { return ran == 200; }));
+  CHECK_EQ(offLoop.load(), 0);
+  CHECK_LE(threads.size(), 3u);
+  CHECK(threads.count(std::this_thread::get_id()) == 0);
+
+  EventLoopStats stats = loop.GetStats();
+  CHECK_EQ(stats.threads, 4u); // Three workers and the timer thread
+  CHECK_EQ(stats.posted, 200u);
+}
+
+TEST(ConcurrencyNeverExceedsTheWorkers) {
+  EventLoop loop;
+  REQUIRE(loop.Start(4));
+
+  std::atomic<int> running{0};
+  std::atomic<int> peak{0};
+  std::atomic<int> done{0};
+  for (int i = 0; i < 40; ++i) {
+    loop.Post([&] {
+      int now = ++running;
+      int seen = peak;
+      while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      --running;
+      ++done;
+    });
+  }
+  CHECK(WaitFor([&] { return done == 40; }));
+  CHECK_EQ(peak.load(), 4);
+
+  EventLoopStats stats = loop.GetStats();
+  CHECK_GT(stats.peakQueued, 30u); // The rest waited in the queue
+  CHECK_EQ(stats.queued, 0u);
+  CHECK_EQ(stats.threads, 5u);
+}
+
+TEST(QueuedTasksStartByPriority) {
+  EventLoop loop;
+  REQUIRE(loop.Start(1));
+  Gate gate;
+  std::atomic<bool> blocked{false};
+  loop.Post([&] {
+    blocked = true;
+    gate.Wait();
+  });
+  REQUIRE(WaitFor([&] { return blocked.load(); }));
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto record = [&](int id) {
+    return [&, id] {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(id);
+    };
+  };
+  loop.Post(record(5), TaskPriority::Background);
+  loop.Post(record(3), TaskPriority::Normal);
+  loop.Post(record(1), TaskPriority::Urgent);
+  loop.Post(record(4)); // Normal by default
+  loop.Post(record(2), TaskPriority::Urgent);
+  CHECK_EQ(loop.GetStats().queued, 5u);
+
+  gate.Open();
+  CHECK(WaitFor([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size() == 5;
+  }));
+  std::lock_guard<std::mutex> lock(mutex);
+  CHECK(order == std::vector<int>({1, 2, 3, 4, 5}));
+}
+
+TEST(ReservedWorkersOnlyRunUrgentTasks) {
+  // Three of four workers held by uploads: the fourth waits for a question
+  EventLoop loop;
+  REQUIRE(loop.Start(4, 1));
+  Gate gate;
+  std::atomic<int> running{0};
+  for (TaskPriority priority : {TaskPriority::Normal, TaskPriority::Normal,
+                                TaskPriority::Background}) {
+    loop.Post(
+        [&] {
+          ++running;
+          gate.Wait();
+        },
+        priority);
+  }
+  REQUIRE(WaitFor([&] { return running == 3; }));
+
+  std::atomic<bool> normalRan{false}, urgentRan{false};
+  loop.Post([&] { normalRan = true; }, TaskPriority::Background);
+  loop.Post([&] { normalRan = true; });
+  loop.Post([&] { urgentRan = true; }, TaskPriority::Urgent);
+  CHECK(WaitFor([&] { return urgentRan.load(); }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  CHECK(!normalRan);
+  CHECK_EQ(loop.GetStats().queued, 2u);
+
+  gate.Open();
+  CHECK(WaitFor([&] { return loop.GetStats().queued == 0; }));
+  CHECK(normalRan);
+
+  // A single worker is never reserved
+  EventLoop single;
+  REQUIRE(single.Start(1, 1));
+  std::atomic<bool> ran{false};
+  single.Post([&] { ran = true; }, TaskPriority::Background);
+  CHECK(WaitFor([&] { return ran.load(); }));
+}
+
+// --- Timers ------------------------------------------------------------------
+
+TEST(TimersFireInDueOrder) {
+  EventLoop loop;
+  REQUIRE(loop.Start(1));
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto start = Clock::now();
+  for (int delay : {30, 10, 20}) {
+    CHECK(loop.PostAfter(delay, [&, delay] {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(delay);
+    }) != 0);
+  }
+  CHECK(WaitFor([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size() == 3;
+  }));
+  CHECK(Clock::now() - start >= std::chrono::milliseconds(30));
+  CHECK(order == std::vector<int>({10, 20, 30}));
+  CHECK_EQ(loop.GetStats().timersFired, 3u);
+}
+
+TEST(CancelledTimersNeverRun) {
+  EventLoop loop;
+  REQUIRE(loop.Start(1));
+
+  std::atomic<bool> cancelledRan{false};
+  std::atomic<bool> firedRan{false};
+  EventLoop::TimerId cancelled =
+      loop.PostAfter(20, [&] { cancelledRan = true; });
+  EventLoop::TimerId fired = loop.PostAfter(5, [&] { firedRan = true; });
+  CHECK(loop.CancelTimer(cancelled));
+  CHECK(!loop.CancelTimer(cancelled)); // Already gone
+
+  CHECK(WaitFor([&] { return firedRan.load(); }));
+  CHECK(!loop.CancelTimer(fired)); // Already ran
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+  CHECK(!cancelledRan);
+  CHECK_EQ(loop.GetStats().timersCancelled, 1u);
+  CHECK(!loop.CancelTimer(0));
+}
+
+TEST(TimersFireWhileEveryWorkerIsBusy) {
+  // The deadline of a queued call must not wait for a free worker
+  EventLoop loop;
+  REQUIRE(loop.Start(2));
+  Gate gate;
+  loop.Post([&] { gate.Wait(); });
+  loop.Post([&] { gate.Wait(); });
+
+  std::atomic<bool> fired{false};
+  auto start = Clock::now();
+  loop.PostAfter(10, [&] { fired = true; });
+  CHECK(WaitFor([&] { return fired.load(); }));
+  CHECK(Clock::now() - start < std::chrono::milliseconds(500));
+  gate.Open();
+}
+
+// --- Stop --------------------------------------------------------------------
+
+TEST(StopRunsQueuedTasksAndDropsTimers) {
+  EventLoop loop;
+  REQUIRE(loop.Start(1));
+  Gate gate;
+  loop.Post([&] { gate.Wait(); });
+
+  std::atomic<int> ran{0};
+  for (int i = 0; i < 10; ++i)
+    loop.Post([&] { ++ran; });
+  std::atomic<bool> timerRan{false};
+  loop.PostAfter(10000, [&] { timerRan = true; });
+
+  std::thread stopper([&] { loop.Stop(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(!loop.Post([] {})); // Refused while draining
+  gate.Open();
+  stopper.join();
+
+  CHECK_EQ(ran.load(), 10);
+  CHECK(!timerRan);
+  CHECK(!loop.IsRunning());
+  CHECK_EQ(loop.PostAfter(1, [] {}), 0u);
+  CHECK_EQ(loop.GetStats().threads, 0u);
+}
+
+TEST(TasksMayPostWhileStopping) {
+  // A completion running during Stop() can still hand work on
+  EventLoop loop;
+  REQUIRE(loop.Start(1));
+  Gate gate;
+  std::atomic<bool> followUp{false};
+  loop.Post([&] {
+    gate.Wait();
+    CHECK(loop.Post([&] { followUp = true; }));
+  });
+  std::thread stopper([&] { loop.Stop(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  gate.Open();
+  stopper.join();
+  CHECK(followUp);
+}
+
+TEST(LoopRestarts) {
+  EventLoop loop;
+  REQUIRE(loop.Start(1));
+  loop.Stop();
+  REQUIRE(loop.Start(2));
+  std::atomic<bool> ran{false};
+  loop.Post([&] { ran = true; });
+  CHECK(WaitFor([&] { return ran.load(); }));
+  CHECK_EQ(loop.GetStats().threads, 3u);
+}
+
+// --- Cancellation token ------------------------------------------------------
+
+TEST(CancelRunsEachCallbackOnce) {
+  CancellationToken token;
+  int a = 0;
+  int b = 0;
+  token.Subscribe([&] { ++a; });
+  CancellationToken::SubscriptionId id = token.Subscribe([&] { ++b; });
+  CHECK(id != 0);
+  CHECK(!token.IsCancelled());
+
+  token.Cancel();
+  token.Cancel();
+  CHECK(token.IsCancelled());
+  CHECK_EQ(a, 1);
+  CHECK_EQ(b, 1);
+
+  // Late subscribers run at once
+  int late = 0;
+  CHECK_EQ(token.Subscribe([&] { ++late; }), 0u);
+  CHECK_EQ(late, 1);
+}
+
+TEST(UnsubscribedCallbacksDoNotRun) {
+  CancellationToken token;
+  int ran = 0;
+  CancellationToken::SubscriptionId id = token.Subscribe([&] { ++ran; });
+  token.Unsubscribe(id);
+  token.Unsubscribe(0);
+  token.Cancel();
+  CHECK_EQ(ran, 0);
+
+  auto shared = std::make_shared<CancellationToken>();
+  {
+    ScopedCancellation scoped(shared, [&] { ++ran; });
+  }
+  shared->Cancel();
+  CHECK_EQ(ran, 0);
+  ScopedCancellation none(nullptr, [&] { ++ran; }); // Null token: nothing
+}
+
+TEST(UnsubscribeWaitsForARunningCallback) {
+  // Once Unsubscribe() returns, the callback is done with what it touches
+  CancellationToken token;
+  Gate entered;
+  Gate release;
+  std::atomic<bool> finished{false};
+  CancellationToken::SubscriptionId id = token.Subscribe([&] {
+    entered.Open();
+    release.Wait();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    finished = true;
+  });
+  std::thread canceller([&] { token.Cancel(); });
+  entered.Wait();
+  release.Open();
+  token.Unsubscribe(id);
+  CHECK(finished);
+  canceller.join();
+}
@@ -0,0 +1,419 @@
+#include "flac_decoder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace invisible {
+namespace test {
+
+namespace {
+
+// Bit-at-a-time CRCs straight from the RFC's polynomials, deliberately not
+// sharing the encoder's table code
+uint8_t Crc8(const uint8_t *data, size_t size) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; ++bit)
+      crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+  }
+  return crc;
+}
+
+uint16_t Crc16(const uint8_t *data, size_t size) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= static_cast<uint16_t>(data[i] << 8);
+    for (int bit = 0; bit < 8; ++bit)
+      crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x8005
+                                                 : crc << 1);
+  }
+  return crc;
+}
+
+// MSB-first reader; reading past the end sets a flag and returns zeros
+class BitReader {
+public:
+  BitReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+  uint64_t Get(int count) {
+    uint64_t value = 0;
+    for (int i = 0; i < count; ++i) {
+      size_t byte = bit_ >> 3;
+      if (byte >= size_) {
+        overrun_ = true;
+        return 0;
+      }
+      value = (value << 1) | ((data_[byte] >> (7 - (bit_ & 7))) & 1);
+      ++bit_;
+    }
+    return value;
+  }
+
+  int64_t GetSigned(int count) {
+    if (count == 0)
+      return 0;
+    uint64_t value = Get(count);
+    if (value >> (count - 1) & 1)
+      return static_cast<int64_t>(value) - (int64_t(1) << count);
+    return static_cast<int64_t>(value);
+  }
+
+  // Zeros closed by a one
+  uint32_t GetUnary() {
+    uint32_t zeros = 0;
+    while (!overrun_ && Get(1) == 0)
+      ++zeros;
+    return zeros;
+  }
+
+  void AlignToByte() { bit_ = (bit_ + 7) & ~size_t(7); }
+
+  size_t BytePosition() const { return bit_ >> 3; }
+  bool Overrun() const { return overrun_; }
+
+private:
+  const uint8_t *data_;
+  size_t size_;
+  size_t bit_ = 0;
+  bool overrun_ = false;
+};
+
+bool ReadUtf8Number(BitReader &bits, uint64_t &value) {
+  uint32_t lead = static_cast<uint32_t>(bits.Get(8));
+  int extra = 0;
+  while (extra < 7 && (lead & (0x80u >> extra)))
+    ++extra;
+  if (extra == 0) {
+    value = lead;
+    return true;
+  }
+  if (extra == 1 || extra > 7)
+    return false;
+  value = lead & (0x7Fu >> extra);
+  for (int i = 1; i < extra; ++i) {
+    uint32_t next = static_cast<uint32_t>(bits.Get(8));
+    if ((next & 0xC0) != 0x80)
+      return false;
+    value = (value << 6) | (next & 0x3F);
+  }
+  return true;
+}
+
+bool ReadResidual(BitReader &bits, uint32_t blockSize, int order,
+                  int64_t *residual, std::string &error) {
+  int method = static_cast<int>(bits.Get(2));
+  if (method > 1) {
+    error = "reserved residual coding method";
+    return false;
+  }
+  int paramBits = method == 0 ? 4 : 5;
+  uint32_t escape = method == 0 ? 15 : 31;
+  int partitionOrder = static_cast<int>(bits.Get(4));
+  uint32_t partitions = 1u << partitionOrder;
+  if (blockSize % partitions != 0 || (blockSize >> partitionOrder) <
+                                         static_cast<uint32_t>(order)) {
+    error = "bad partition order";
+    return false;
+  }
+
+  size_t n = 0;
+  for (uint32_t p = 0; p < partitions; ++p) {
+    uint32_t count = (blockSize >> partitionOrder) - (p == 0 ? order : 0);
+    uint32_t k = static_cast<uint32_t>(bits.Get(paramBits));
+    if (k == escape) {
+      int raw = static_cast<int>(bits.Get(5));
+      for (uint32_t i = 0; i < count; ++i)
+        residual[n++] = bits.GetSigned(raw);
+    } else {
+      for (uint32_t i = 0; i < count; ++i) {
+        uint64_t folded = (uint64_t(bits.GetUnary()) << k) | bits.Get(k);
+        residual[n++] = (folded & 1) ? -static_cast<int64_t>(folded >> 1) - 1
+                                     : static_cast<int64_t>(folded >> 1);
+      }
+    }
+    if (bits.Overrun()) {
+      error = "residual runs past the end";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReadSubframe(BitReader &bits, uint32_t blockSize, int sampleBits,
+                  int64_t *out, DecodedFlac &flac, std::string &error) {
+  if (bits.Get(1) != 0) {
+    error = "subframe padding bit set";
+    return false;
+  }
+  int type = static_cast<int>(bits.Get(6));
+  int wasted = 0;
+  if (bits.Get(1))
+    wasted = static_cast<int>(bits.GetUnary()) + 1;
+  sampleBits -= wasted;
+  if (sampleBits <= 0) {
+    error = "wasted bits exceed the sample size";
+    return false;
+  }
+
+  if (type == 0) {
+    int64_t value = bits.GetSigned(sampleBits);
+    std::fill(out, out + blockSize, value);
+    flac.subframeTypes[0]++;
+  } else if (type == 1) {
+    for (uint32_t i = 0; i < blockSize; ++i)
+      out[i] = bits.GetSigned(sampleBits);
+    flac.subframeTypes[1]++;
+  } else if (type >= 8 && type <= 12) {
+    int order = type - 8;
+    if (static_cast<uint32_t>(order) > blockSize) {
+      error = "fixed order exceeds the block";
+      return false;
+    }
+    for (int i = 0; i < order; ++i)
+      out[i] = bits.GetSigned(sampleBits);
+    if (!ReadResidual(bits, blockSize, order, out + order, error))
+      return false;
+    // Fixed predictors are repeated differencing; undo it in place
+    static const int kCoefs[5][4] = {
+        {0, 0, 0, 0}, {1, 0, 0, 0}, {2, -1, 0, 0}, {3, -3, 1, 0},
+        {4, -6, 4, -1}};
+    for (uint32_t i = order; i < blockSize; ++i) {
+      int64_t prediction = 0;
+      for (int j = 0; j < order; ++j)
+        prediction += kCoefs[order][j] * out[i - 1 - j];
+      out[i] += prediction;
+    }
+    flac.subframeTypes[2]++;
+  } else if (type >= 32) {
+    int order = type - 31;
+    if (static_cast<uint32_t>(order) > blockSize) {
+      error = "LPC order exceeds the block";
+      return false;
+    }
+    for (int i = 0; i < order; ++i)
+      out[i] = bits.GetSigned(sampleBits);
+    int precision = static_cast<int>(bits.Get(4)) + 1;
+    if (precision == 16) {
+      error = "invalid LPC precision";
+      return false;
+    }
+    int shift = static_cast<int>(bits.GetSigned(5));
+    if (shift < 0) {
+      error = "negative LPC shift";
+      return false;
+    }
+    int64_t coefs[32];
+    for (int i = 0; i < order; ++i)
+      coefs[i] = bits.GetSigned(precision);
+    if (!ReadResidual(bits, blockSize, order, out + order, error))
+      return false;
+    for (uint32_t i = order; i < blockSize; ++i) {
+      int64_t sum = 0;
+      for (int j = 0; j < order; ++j)
+        sum += coefs[j] * out[i - 1 - j];
+      out[i] += sum >> shift;
+    }
+    flac.subframeTypes[3]++;
+  } else {
+    error = "reserved subframe type " + std::to_string(type);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < blockSize; ++i)
+    out[i] <<= wasted;
+  return !bits.Overrun();
+}
+
+bool ReadFrame(const uint8_t *data, size_t size, DecodedFlac &flac,
+               size_t &frameBytes, std::string &error) {
+  BitReader bits(data, size);
+  if (bits.Get(14) != 0x3FFE || bits.Get(1) != 0) {
+    error = "lost frame sync";
+    return false;
+  }
+  bits.Get(1); // Blocking strategy: only the number's meaning changes
+  int sizeCode = static_cast<int>(bits.Get(4));
+  int rateCode = static_cast<int>(bits.Get(4));
+  int assignment = static_cast<int>(bits.Get(4));
+  int depthCode = static_cast<int>(bits.Get(3));
+  if (bits.Get(1) != 0) {
+    error = "reserved header bit set";
+    return false;
+  }
+  uint64_t number;
+  if (!ReadUtf8Number(bits, number)) {
+    error = "bad frame number coding";
+    return false;
+  }
+
+  uint32_t blockSize = 0;
+  if (sizeCode == 1)
+    blockSize = 192;
+  else if (sizeCode >= 2 && sizeCode <= 5)
+    blockSize = 576u << (sizeCode - 2);
+  else if (sizeCode == 6)
+    blockSize = static_cast<uint32_t>(bits.Get(8)) + 1;
+  else if (sizeCode == 7)
+    blockSize = static_cast<uint32_t>(bits.Get(16)) + 1;
+  else if (sizeCode >= 8)
+    blockSize = 256u << (sizeCode - 8);
+  if (blockSize == 0 || blockSize > 65535) {
+    error = "bad block size code";
+    return false;
+  }
+
+  static const uint32_t kRates[] = {0,     88200, 176400, 192000,
+                                    8000,  16000, 22050,  24000,
+                                    32000, 44100, 48000,  96000};
+  uint32_t rate = flac.sampleRate;
+  if (rateCode >= 1 && rateCode <= 11)
+    rate = kRates[rateCode];
+  else if (rateCode == 12)
+    rate = static_cast<uint32_t>(bits.Get(8)) * 1000;
+  else if (rateCode == 13)
+    rate = static_cast<uint32_t>(bits.Get(16));
+  else if (rateCode == 14)
+    rate = static_cast<uint32_t>(bits.Get(16)) * 10;
+  else if (rateCode == 15) {
+    error = "invalid sample rate code";
+    return false;
+  }
+  if (rate != flac.sampleRate) {
+    error = "frame sample rate differs from STREAMINFO";
+    return false;
+  }
+
+  static const int kDepths[] = {0, 8, 12, -1, 16, 20, 24, 32};
+  int depth = depthCode == 0 ? static_cast<int>(flac.bitsPerSample)
+                             : kDepths[depthCode];
+  if (depth != 16) {
+    error = "only 16-bit streams are supported";
+    return false;
+  }
+
+  uint32_t channels = assignment < 8 ? assignment + 1 : 2;
+  if (assignment > 10 || channels != flac.channels) {
+    error = "channel assignment does not match STREAMINFO";
+    return false;
+  }
+
+  size_t headerBytes = bits.BytePosition();
+  if (bits.Overrun() ||
+      bits.Get(8) != Crc8(data, headerBytes)) {
+    error = "frame header CRC-8 mismatch";
+    return false;
+  }
+
+  std::vector<int64_t> decoded(size_t(blockSize) * channels);
+  for (uint32_t ch = 0; ch < channels; ++ch) {
+    // The side channel of a stereo pair carries one extra bit
+    bool side = (assignment == 8 && ch == 1) || (assignment == 9 && ch == 0) ||
+                (assignment == 10 && ch == 1);
+    if (!ReadSubframe(bits, blockSize, depth + (side ? 1 : 0),
+                      &decoded[size_t(ch) * blockSize], flac, error))
+      return false;
+  }
+
+  bits.AlignToByte();
+  size_t bodyBytes = bits.BytePosition();
+  if (bits.Get(16) != Crc16(data, bodyBytes) || bits.Overrun()) {
+    error = "frame CRC-16 mismatch";
+    return false;
+  }
+  frameBytes = bits.BytePosition();
+
+  int64_t *a = decoded.data();
+  int64_t *b = decoded.data() + blockSize;
+  for (uint32_t i = 0; i < blockSize && assignment >= 8; ++i) {
+    if (assignment == 8) {
+      b[i] = a[i] - b[i]; // Left/side
+    } else if (assignment == 9) {
+      a[i] += b[i]; // Side/right
+    } else {
+      int64_t mid = (a[i] << 1) | (b[i] & 1); // Mid/side
+      a[i] = (mid + b[i]) >> 1;
+      b[i] = (mid - b[i]) >> 1;
+    }
+  }
+
+  size_t offset = flac.samples.size();
+  flac.samples.resize(offset + size_t(blockSize) * channels);
+  for (uint32_t i = 0; i < blockSize; ++i) {
+    for (uint32_t ch = 0; ch < channels; ++ch) {
+      int64_t value = decoded[size_t(ch) * blockSize + i];
+      if (value < -32768 || value > 32767) {
+        error = "decoded sample out of 16-bit range";
+        return false;
+      }
+      flac.samples[offset + size_t(i) * channels + ch] =
+          static_cast<int16_t>(value);
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool DecodeFlac(const uint8_t *data, size_t size, DecodedFlac &flac,
+                std::string &error) {
+  flac = DecodedFlac();
+  if (size < 4 || memcmp(data, "fLaC", 4) != 0) {
+    error = "missing fLaC marker";
+    return false;
+  }
+
+  // Metadata blocks; STREAMINFO must come first
+  size_t pos = 4;
+  bool first = true;
+  for (bool last = false; !last;) {
+    if (pos + 4 > size) {
+      error = "truncated metadata";
+      return false;
+    }
+    last = (data[pos] & 0x80) != 0;
+    int type = data[pos] & 0x7F;
+    size_t length = (size_t(data[pos + 1]) << 16) | (data[pos + 2] << 8) |
+                    data[pos + 3];
+    pos += 4;
+    if (pos + length > size || (first && (type != 0 || length != 34))) {
+      error = "bad STREAMINFO";
+      return false;
+    }
+    if (type == 0) {
+      BitReader info(data + pos, length);
+      flac.minBlockSize = static_cast<uint32_t>(info.Get(16));
+      flac.maxBlockSize = static_cast<uint32_t>(info.Get(16));
+      flac.minFrameSize = static_cast<uint32_t>(info.Get(24));
+      flac.maxFrameSize = static_cast<uint32_t>(info.Get(24));
+      flac.sampleRate = static_cast<uint32_t>(info.Get(20));
+      flac.channels = static_cast<uint32_t>(info.Get(3)) + 1;
+      flac.bitsPerSample = static_cast<uint32_t>(info.Get(5)) + 1;
+      flac.totalSamples = info.Get(36);
+    }
+    first = false;
+    pos += length;
+  }
+
+  while (pos < size) {
+    size_t frameBytes = 0;
+    if (!ReadFrame(data + pos, size - pos, flac, frameBytes, error)) {
+      error = "frame " + std::to_string(flac.frames) + ": " + error;
+      return false;
+    }
+    uint32_t bytes = static_cast<uint32_t>(frameBytes);
+    flac.smallestFrame =
+        flac.frames == 0 ? bytes : std::min(flac.smallestFrame, bytes);
+    flac.largestFrame = std::max(flac.largestFrame, bytes);
+    flac.frames++;
+    pos += frameBytes;
+  }
+
+  if (flac.samples.size() != flac.totalSamples * flac.channels) {
+    error = "sample count differs from STREAMINFO";
+    return false;
+  }
+  return true;
+}
+
+} // namespace test
+} // namespace invisible
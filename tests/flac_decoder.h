@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// FLAC Decoder (test support)
+// An independent reading of RFC 9639 for checking FlacEncoder: STREAMINFO,
+// fixed or variable block sizes, every subframe type (constant, verbatim,
+// fixed, LPC, wasted bits), Rice and Rice2 residuals with escapes, and all
+// stereo decorrelation modes. Frame header CRC-8 and frame CRC-16 are
+// verified. Output is limited to 16-bit samples, all the encoder writes.
+// -----------------------------------------------------------------------------
+
+struct DecodedFlac {
+  // STREAMINFO
+  uint32_t minBlockSize = 0;
+  uint32_t maxBlockSize = 0;
+  uint32_t minFrameSize = 0;
+  uint32_t maxFrameSize = 0;
+  uint32_t sampleRate = 0;
+  uint32_t channels = 0;
+  uint32_t bitsPerSample = 0;
+  uint64_t totalSamples = 0;
+
+  // Measured while decoding
+  size_t frames = 0;
+  uint32_t smallestFrame = 0; // Bytes, including header and CRC
+  uint32_t largestFrame = 0;
+  uint32_t subframeTypes[4] = {}; // Constant, verbatim, fixed, LPC counts
+
+  std::vector<int16_t> samples; // Interleaved
+};
+
+// False (with a reason in `error`) if the stream is malformed or uses
+// something outside the scope above
+bool DecodeFlac(const uint8_t *data, size_t size, DecodedFlac &flac,
+                std::string &error);
+
+} // namespace test
+} // namespace invisible
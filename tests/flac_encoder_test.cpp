@@ -0,0 +1,229 @@
+#include "flac_decoder.h"
+#include "flac_encoder.h"
+#include "test.h"
+#include "test_data.h"
+#include <cmath>
+#include <random>
+
+// Every stream FlacEncoder writes is decoded by the independent decoder in
+// flac_decoder.cpp (CRCs, STREAMINFO, every subframe) and must give back
+// the input sample for sample.
+
+using namespace invisible;
+using invisible::test::DecodedFlac;
+using invisible::test::DecodeFlac;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+int16_t Clamp(double value) {
+  return static_cast<int16_t>(
+      std::max(-32768.0, std::min(32767.0, std::round(value))));
+}
+
+// Named interleaved test signals
+std::vector<int16_t> Signal(const std::string &kind, size_t frames,
+                            int channels, uint32_t seed = 1) {
+  std::vector<int16_t> out(frames * channels);
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> full(-32768, 32767);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  for (size_t i = 0; i < frames; ++i) {
+    for (int ch = 0; ch < channels; ++ch) {
+      double t = static_cast<double>(i) / 16000;
+      double value = 0;
+      if (kind == "silence") {
+        value = 0;
+      } else if (kind == "dc") {
+        value = -1234 + ch;
+      } else if (kind == "sine") {
+        value = 12000 * std::sin(2 * kPi * (300 + 100 * ch) * t);
+      } else if (kind == "chirp") {
+        value = 20000 * std::sin(2 * kPi * (50 + 3000 * t) * t);
+      } else if (kind == "square") {
+        value = (i / (37 + ch)) % 2 ? 30000 : -30000;
+      } else if (kind == "clipped") {
+        value = 60000 * std::sin(2 * kPi * 440 * t);
+      } else if (kind == "noise") {
+        value = full(rng); // Incompressible: verbatim or escape codes
+      } else if (kind == "alternating") {
+        value = (i + ch) % 2 ? 32767 : -32768; // Widest fixed residuals
+      } else if (kind == "quiet") {
+        value = 3 * gauss(rng);
+      } else if (kind == "even") {
+        value = 2 * std::round(4000 * std::sin(2 * kPi * 220 * t)); // LSB 0
+      }
+      out[i * channels + ch] = Clamp(value);
+    }
+  }
+  return out;
+}
+
+// Encode, decode, compare. Returns the encoded size (0 on failure).
+size_t RoundTrip(const std::vector<int16_t> &pcm, uint32_t rate,
+                 uint16_t channels,
+                 const FlacEncoderConfig &config = FlacEncoderConfig(),
+                 DecodedFlac *decodedOut = nullptr) {
+  size_t frames = pcm.size() / channels;
+  std::vector<uint8_t> flac;
+  FlacEncoder encoder(config);
+  if (!encoder.EncodePcm16(pcm.data(), frames, rate, channels, flac)) {
+    CHECK(!"EncodePcm16 failed");
+    return 0;
+  }
+
+  DecodedFlac decoded;
+  std::string error;
+  if (!DecodeFlac(flac.data(), flac.size(), decoded, error)) {
+    ::invisible::test::Fail(__FILE__, __LINE__, "decode: " + error);
+    return 0;
+  }
+  CHECK_EQ(decoded.sampleRate, rate);
+  CHECK_EQ(decoded.channels, channels);
+  CHECK_EQ(decoded.bitsPerSample, 16u);
+  CHECK_EQ(decoded.totalSamples, frames);
+  CHECK_EQ(decoded.maxBlockSize, config.blockSize);
+  CHECK_EQ(decoded.minFrameSize, decoded.smallestFrame);
+  CHECK_EQ(decoded.maxFrameSize, decoded.largestFrame);
+  CHECK_EQ(decoded.frames, (frames + config.blockSize - 1) / config.blockSize);
+  CHECK(decoded.samples == pcm);
+  if (decodedOut)
+    *decodedOut = decoded;
+  return flac.size();
+}
+
+} // namespace
+
+TEST(SignalsRoundTrip) {
+  for (const char *kind : {"silence", "dc", "sine", "chirp", "square",
+                           "clipped", "noise", "alternating", "quiet",
+                           "even"}) {
+    for (uint16_t channels : {1, 2}) {
+      std::vector<int16_t> pcm = Signal(kind, 20000, channels);
+      size_t bytes = RoundTrip(pcm, 16000, channels);
+      CHECK_GT(bytes, 0u);
+    }
+  }
+}
+
+TEST(EveryBlockSizeCodeRoundTrips) {
+  // 192, 576 << n, 256 << n, and the 8- and 16-bit explicit sizes, with a
+  // short final block each time
+  std::vector<int16_t> pcm = Signal("chirp", 40000, 1);
+  for (uint32_t blockSize : {16u, 100u, 192u, 256u, 576u, 1000u, 1152u,
+                             2304u, 4096u, 4608u, 8192u, 16384u, 32768u}) {
+    FlacEncoderConfig config;
+    config.blockSize = blockSize;
+    CHECK_GT(RoundTrip(pcm, 16000, 1, config), 0u);
+  }
+}
+
+TEST(EverySampleRateCodeRoundTrips) {
+  // Table rates, kHz (code 12), Hz (13) and tens of Hz (14)
+  std::vector<int16_t> pcm = Signal("sine", 5000, 2);
+  for (uint32_t rate : {8000u, 16000u, 22050u, 44100u, 48000u, 96000u,
+                        192000u, 7000u, 11025u, 12345u, 100000u, 655350u}) {
+    CHECK_GT(RoundTrip(pcm, rate, 2), 0u);
+  }
+}
+
+TEST(PredictorSettingsRoundTrip) {
+  std::vector<int16_t> pcm = Signal("chirp", 30000, 2);
+  for (int order : {0, 1, 4, 8, 12, 32}) {
+    for (int precision : {5, 12, 15}) {
+      for (int partitions : {0, 3, 8}) {
+        FlacEncoderConfig config;
+        config.maxLpcOrder = order;
+        config.qlpPrecision = precision;
+        config.maxPartitionOrder = partitions;
+        CHECK_GT(RoundTrip(pcm, 16000, 2, config), 0u);
+      }
+    }
+  }
+}
+
+TEST(UsesEverySubframeType) {
+  // Silence -> constant, noise -> verbatim, a square wave -> fixed, and a
+  // resonant tone -> LPC
+  DecodedFlac decoded;
+  RoundTrip(Signal("silence", 4096, 1), 16000, 1, FlacEncoderConfig(),
+            &decoded);
+  CHECK_EQ(decoded.subframeTypes[0], 1u);
+  RoundTrip(Signal("noise", 4096, 1), 16000, 1, FlacEncoderConfig(),
+            &decoded);
+  CHECK_EQ(decoded.subframeTypes[1], 1u);
+  RoundTrip(Signal("square", 4096, 1), 16000, 1, FlacEncoderConfig(),
+            &decoded);
+  CHECK_EQ(decoded.subframeTypes[2], 1u);
+  RoundTrip(Signal("chirp", 4096, 1), 16000, 1, FlacEncoderConfig(),
+            &decoded);
+  CHECK_EQ(decoded.subframeTypes[3], 1u);
+}
+
+TEST(MultichannelAndOddLengthsRoundTrip) {
+  for (uint16_t channels = 1; channels <= 8; ++channels) {
+    for (size_t frames : {size_t(1), size_t(2), size_t(33), size_t(4097)}) {
+      std::vector<int16_t> pcm = Signal("chirp", frames, channels, channels);
+      CHECK_GT(RoundTrip(pcm, 48000, channels), 0u);
+    }
+  }
+}
+
+TEST(RandomInputsRoundTrip) {
+  // Random mixtures of the signals in random block sizes and orders
+  std::mt19937 rng(42);
+  const char *kinds[] = {"sine", "chirp", "noise", "quiet", "square",
+                         "alternating"};
+  for (int round = 0; round < 40; ++round) {
+    FlacEncoderConfig config;
+    config.blockSize = 16 + rng() % 6000;
+    config.maxLpcOrder = rng() % 33;
+    config.qlpPrecision = 5 + rng() % 11;
+    config.maxPartitionOrder = rng() % 9;
+    uint16_t channels = 1 + rng() % 3;
+
+    std::vector<int16_t> pcm;
+    for (int piece = 0; piece < 4; ++piece) {
+      uint32_t seed = static_cast<uint32_t>(rng());
+      std::vector<int16_t> part =
+          Signal(kinds[rng() % 6], 500 + rng() % 4000, channels, seed);
+      pcm.insert(pcm.end(), part.begin(), part.end());
+    }
+    CHECK_GT(RoundTrip(pcm, 16000, channels, config), 0u);
+  }
+}
+
+TEST(SpeechFixtureRoundTripsAndCompresses) {
+  test::WavAudio wav;
+  REQUIRE(test::ReadWav(test::DataPath("vad/speech_noisy.wav"), wav));
+  size_t bytes = RoundTrip(wav.samples, wav.sampleRate, wav.channels);
+  double ratio = static_cast<double>(bytes) / (wav.samples.size() * 2);
+  CHECK_LT(ratio, 0.75);
+}
+
+TEST(RejectsBadInput) {
+  FlacEncoder encoder;
+  std::vector<int16_t> pcm(100);
+  std::vector<uint8_t> out;
+  CHECK(!encoder.EncodePcm16(pcm.data(), 100, 16000, 0, out));
+  CHECK(!encoder.EncodePcm16(pcm.data(), 10, 16000, 9, out));
+  CHECK(!encoder.EncodePcm16(pcm.data(), 100, 0, 1, out));
+}
+
+TEST(DecoderCatchesCorruption) {
+  // The round trips above mean something only if the decoder really checks
+  std::vector<int16_t> pcm = Signal("sine", 8192, 1);
+  std::vector<uint8_t> flac;
+  REQUIRE(FlacEncoder().EncodePcm16(pcm.data(), 8192, 16000, 1, flac));
+
+  DecodedFlac decoded;
+  std::string error;
+  REQUIRE(DecodeFlac(flac.data(), flac.size(), decoded, error));
+  for (size_t pos : {size_t(50), flac.size() / 2, flac.size() - 1}) {
+    std::vector<uint8_t> broken = flac;
+    broken[pos] ^= 0x10;
+    CHECK(!DecodeFlac(broken.data(), broken.size(), decoded, error));
+  }
+  CHECK(!DecodeFlac(flac.data(), flac.size() - 3, decoded, error));
+}
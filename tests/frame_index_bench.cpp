@@ -0,0 +1,217 @@
+#include "bench.h"
+#include "frame_index.h"
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// FrameIndex tile-hash throughput by region and tile size, then the share
+// of captures it answers, sends as a delta or sends whole over synthetic
+// capture sequences, fed the way the region hotkey feeds it (Lookup, then
+// Remember with the new answer). Every remembered answer is checked
+// against the pixels it was given for, so a hash collision would show.
+
+using namespace invisible;
+
+namespace {
+
+// An editor: text-like strokes on white, one 16 px line of text per row,
+// with `scroll` lines scrolled off the top and `edits` characters typed at
+// the end of line 12
+struct Screen {
+  int width, height;
+  std::vector<uint8_t> bgra;
+};
+
+void DrawEditor(Screen &s, int scroll, int edits, bool cursor) {
+  for (int y = 0; y < s.height; ++y) {
+    int line = y / 16 + scroll;
+    int inLine = y % 16;
+    for (int x = 0; x < s.width; ++x) {
+      int column = x / 8;
+      bool ink = inLine >= 3 && inLine < 13 && column < 20 + line * 7 % 60 &&
+                 ((x * 5 + y * 3 + line * 11) % 7 < 2);
+      if (line == 12 + scroll && column >= 80 && column < 80 + edits)
+        ink = (x + y) % 3 == 0;
+      if (cursor && line == 12 + scroll && column == 80 + edits)
+        ink = x % 8 < 2;
+      uint8_t *px = s.bgra.data() + (static_cast<size_t>(y) * s.width + x) * 4;
+      uint8_t value = ink ? 30 : 250;
+      px[0] = px[1] = px[2] = value;
+      px[3] = 255;
+    }
+  }
+}
+
+void DrawNoise(Screen &s, std::mt19937 &random) {
+  for (uint8_t &byte : s.bgra)
+    byte = static_cast<uint8_t>(random());
+}
+
+struct Outcome {
+  int captures = 0;
+  int unchanged = 0;
+  int deltas = 0;
+  int whole = 0; // NEW, or CHANGED too much for a delta
+  double deltaArea = 0;
+  int falseHits = 0;
+};
+
+// One capture through the index; `pixels` keeps what each answer was for
+class Session {
+public:
+  Session(int width, int height) : placement_{100, 200, width, height} {}
+
+  void Capture(const Screen &s, Outcome &outcome) {
+    outcome.captures++;
+    FrameMatch match = index_.Lookup(s.bgra.data(), s.width * 4, placement_);
+    if (match.kind == FrameMatch::UNCHANGED) {
+      outcome.unchanged++;
+      outcome.falseHits += !SameColors(pixels_[match.analysis], s.bgra);
+      return;
+    }
+    if (match.kind == FrameMatch::CHANGED && match.sendDelta) {
+      outcome.deltas++;
+      outcome.deltaArea += static_cast<double>(match.changed.width) *
+                           match.changed.height /
+                           (static_cast<double>(s.width) * s.height);
+    } else {
+      outcome.whole++;
+    }
+    std::string answer = "answer " + std::to_string(next_++);
+    pixels_[answer] = s.bgra;
+    index_.Remember(std::move(match.signature), std::move(answer));
+  }
+
+private:
+  static bool SameColors(const std::vector<uint8_t> &a,
+                         const std::vector<uint8_t> &b) {
+    if (a.size() != b.size())
+      return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (i % 4 != 3 && a[i] != b[i])
+        return false;
+    }
+    return true;
+  }
+
+  FrameIndex index_;
+  ImageRect placement_;
+  std::map<std::string, std::vector<uint8_t>> pixels_;
+  int next_ = 0;
+};
+
+void Report(const char *name, const Outcome &o) {
+  std::printf("  %-24s %4d captures: %5.1f%% answered, %5.1f%% delta "
+              "(%4.1f%% of the area), %5.1f%% whole, %d false hits\n",
+              name, o.captures, 100.0 * o.unchanged / o.captures,
+              100.0 * o.deltas / o.captures,
+              o.deltas ? 100.0 * o.deltaArea / o.deltas : 0.0,
+              100.0 * o.whole / o.captures, o.falseHits);
+}
+
+} // namespace
+
+int main() {
+  const int runs = bench::Runs(10);
+  std::printf("frame index tile hashing (%s), best of %d\n",
+              FrameIndex::HasSimd() ? "SSE2" : "scalar", runs);
+  struct Region {
+    const char *name;
+    int width, height;
+  } regions[] = {{"800x600", 800, 600},
+                 {"1080p", 1920, 1080},
+                 {"4K", 3840, 2160},
+                 {"odd 1001x333", 1001, 333}};
+  for (const Region &r : regions) {
+    Screen s{r.width, r.height,
+             std::vector<uint8_t>(static_cast<size_t>(r.width) * r.height *
+                                  4)};
+    DrawEditor(s, 0, 0, false);
+    const double bytes = static_cast<double>(s.bgra.size());
+    std::printf("  %-13s", r.name);
+    for (int tile : {16, 32, 64}) {
+      FrameSignature signature;
+      double seconds = bench::BestOf(runs, [&] {
+        FrameIndex::HashTiles(s.bgra.data(), r.width * 4,
+                              {0, 0, r.width, r.height}, tile, signature);
+        bench::Consume(signature.tiles);
+      });
+      std::printf("  %2d px: %5.2f GB/s %6.2f ms", tile, bytes / seconds / 1e9,
+                  seconds * 1e3);
+    }
+    std::printf("\n");
+  }
+
+  const int width = 1280, height = 720, captures = 200;
+  std::printf("\nhit rates, %dx%d region, %d captures each\n", width, height,
+              captures);
+  Screen s{width, height,
+           std::vector<uint8_t>(static_cast<size_t>(width) * height * 4)};
+  std::mt19937 random(7);
+
+  {
+    // The same slide or problem captured again and again
+    Session session(width, height);
+    Outcome outcome;
+    DrawEditor(s, 0, 0, false);
+    for (int i = 0; i < captures; ++i)
+      session.Capture(s, outcome);
+    Report("static view", outcome);
+  }
+  {
+    // A blinking cursor: two states, both remembered after two captures
+    Session session(width, height);
+    Outcome outcome;
+    for (int i = 0; i < captures; ++i) {
+      DrawEditor(s, 0, 0, i % 2 == 0);
+      session.Capture(s, outcome);
+    }
+    Report("blinking cursor", outcome);
+  }
+  {
+    // Typing: one more character on one line between captures
+    Session session(width, height);
+    Outcome outcome;
+    for (int i = 0; i < captures; ++i) {
+      DrawEditor(s, 0, i % 60, true);
+      session.Capture(s, outcome);
+    }
+    Report("typing", outcome);
+  }
+  {
+    // Asking about a few views in turn: more views than remembered frames
+    // lose their answers
+    for (int views : {8, 24}) {
+      Session session(width, height);
+      Outcome outcome;
+      for (int i = 0; i < captures; ++i) {
+        DrawEditor(s, (i % views) * 16, 0, false);
+        session.Capture(s, outcome);
+      }
+      Report(views == 8 ? "cycling 8 views" : "cycling 24 views", outcome);
+    }
+  }
+  {
+    // Scrolling by a line: every row of tiles moves
+    Session session(width, height);
+    Outcome outcome;
+    for (int i = 0; i < captures; ++i) {
+      DrawEditor(s, i, 0, false);
+      session.Capture(s, outcome);
+    }
+    Report("scrolling", outcome);
+  }
+  {
+    // Video: nothing repeats
+    Session session(width, height);
+    Outcome outcome;
+    for (int i = 0; i < captures; ++i) {
+      DrawNoise(s, random);
+      session.Capture(s, outcome);
+    }
+    Report("video", outcome);
+  }
+  return 0;
+}
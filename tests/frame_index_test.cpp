@@ -0,0 +1,258 @@
+#include "frame_index.h"
+#include "test.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+// FrameIndex::Lookup and Remember on synthetic BGRA frames: repeats that
+// are answered from memory, small edits that become deltas with the right
+// bounding box, views and edits that need the whole frame, and eviction.
+
+using namespace invisible;
+
+namespace {
+
+// A noisy frame (every tile differs from every other), with `padding`
+// spare bytes at the end of every row
+struct Frame {
+  int width, height, stride;
+  std::vector<uint8_t> bgra;
+
+  Frame(int w, int h, uint32_t seed, int padding = 0)
+      : width(w), height(h), stride(w * 4 + padding),
+        bgra(static_cast<size_t>(stride) * h, 0xCD) {
+    uint32_t state = seed * 2654435761u + 1;
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        state = state * 1664525u + 1013904223u;
+        std::memcpy(Pixel(x, y), &state, 4);
+      }
+    }
+  }
+
+  uint8_t *Pixel(int x, int y) {
+    return bgra.data() + static_cast<size_t>(y) * stride + x * 4;
+  }
+
+  // Flip the colour of a width x height block
+  void Edit(int x, int y, int w, int h) {
+    for (int row = y; row < y + h; ++row) {
+      for (int column = x; column < x + w; ++column)
+        Pixel(column, row)[1] ^= 0x80;
+    }
+  }
+};
+
+FrameMatch Lookup(FrameIndex &index, const Frame &frame,
+                  const ImageRect &placement) {
+  return index.Lookup(frame.bgra.data(), frame.stride, placement);
+}
+
+bool SameRect(const ImageRect &a, const ImageRect &b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+// Frame pixels are placed at (100, 200) on the screen. 330 x 250 leaves
+// partial tiles along the right (10 px) and bottom (26 px) edges.
+const ImageRect kView{100, 200, 330, 250};
+
+} // namespace
+
+// --- Unchanged ---------------------------------------------------------------
+
+TEST(IdenticalFramesAreUnchanged) {
+  FrameIndex index;
+  Frame frame(kView.width, kView.height, 1);
+  FrameMatch first = Lookup(index, frame, kView);
+  CHECK(first.kind == FrameMatch::NEW);
+  CHECK(first.analysis.empty());
+  CHECK_EQ(first.signature.tilesX, 11);
+  CHECK_EQ(first.signature.tilesY, 8);
+  index.Remember(first.signature, "the answer");
+
+  FrameMatch again = Lookup(index, frame, kView);
+  CHECK(again.kind == FrameMatch::UNCHANGED);
+  CHECK(again.analysis == "the answer");
+  CHECK_EQ(again.changedTiles, 0);
+
+  // The same pixels in another buffer, with other row padding and alpha
+  Frame copy(kView.width, kView.height, 1, 12);
+  for (int y = 0; y < copy.height; ++y) {
+    for (int x = 0; x < copy.width; ++x)
+      copy.Pixel(x, y)[3] = 255;
+  }
+  CHECK(Lookup(index, copy, kView).kind == FrameMatch::UNCHANGED);
+
+  FrameIndexStats stats = index.GetStats();
+  CHECK_EQ(stats.lookups, 3u);
+  CHECK_EQ(stats.unchanged, 2u);
+  CHECK_EQ(stats.changed, 0u);
+  CHECK_EQ(stats.frames, 1u);
+  CHECK_EQ(stats.hashedBytes, 3u * kView.width * kView.height * 4);
+
+  // Nothing to hash
+  CHECK(index.Lookup(nullptr, 0, kView).kind == FrameMatch::NEW);
+  CHECK(index.Lookup(frame.bgra.data(), frame.stride, {0, 0, 0, 10}).kind ==
+        FrameMatch::NEW);
+  CHECK_EQ(index.GetStats().lookups, 3u);
+}
+
+// --- Deltas ------------------------------------------------------------------
+
+TEST(OneTileEditIsADelta) {
+  // 32 px tiles with a 32 px margin
+  FrameIndex index;
+  Frame frame(kView.width, kView.height, 2);
+  index.Remember(Lookup(index, frame, kView).signature, "before");
+
+  // Inside tile (3, 2): pixels 96-127 x 64-95, 32-159 x 32-127 with margin
+  Frame edited = frame;
+  edited.Edit(100, 70, 11, 6);
+  FrameMatch match = Lookup(index, edited, kView);
+  CHECK(match.kind == FrameMatch::CHANGED);
+  CHECK(match.analysis == "before");
+  CHECK_EQ(match.changedTiles, 1);
+  CHECK(SameRect(match.changed, {64, 32, 96, 96}));
+  CHECK(match.sendDelta);
+
+  // A corner tile: the margin stops at the frame's edges
+  Frame corner = frame;
+  corner.Edit(0, 0, 1, 1);
+  match = Lookup(index, corner, kView);
+  CHECK_EQ(match.changedTiles, 1);
+  CHECK(SameRect(match.changed, {0, 0, 64, 64}));
+
+  // The partial tile at the bottom right
+  Frame edge = frame;
+  edge.Edit(kView.width - 1, kView.height - 1, 1, 1);
+  match = Lookup(index, edge, kView);
+  CHECK_EQ(match.changedTiles, 1);
+  CHECK(SameRect(match.changed, {288, 192, 42, 58}));
+
+  // Two edits: the box around both
+  Frame two = frame;
+  two.Edit(40, 40, 2, 2);   // Tile (1, 1)
+  two.Edit(150, 100, 2, 2); // Tile (4, 3)
+  match = Lookup(index, two, kView);
+  CHECK_EQ(match.changedTiles, 2);
+  CHECK(SameRect(match.changed, {0, 0, 192, 160}));
+  CHECK(match.sendDelta);
+
+  // Remembered with the new answer, the edited frame is a repeat and the
+  // next edit is measured against it
+  index.Remember(Lookup(index, edited, kView).signature, "after");
+  match = Lookup(index, edited, kView);
+  CHECK(match.kind == FrameMatch::UNCHANGED);
+  CHECK(match.analysis == "after");
+  Frame again = edited;
+  again.Edit(300, 10, 1, 1); // Tile (9, 0)
+  match = Lookup(index, again, kView);
+  CHECK(match.analysis == "after");
+  CHECK_EQ(match.changedTiles, 1);
+
+  FrameIndexStats stats = index.GetStats();
+  CHECK_EQ(stats.changed, 6u);
+  CHECK_EQ(stats.deltas, 6u);
+}
+
+// --- Full misses -------------------------------------------------------------
+
+TEST(OtherViewsAndLargeChangesSendTheWholeFrame) {
+  FrameIndex index;
+  Frame frame(kView.width, kView.height, 3);
+  index.Remember(Lookup(index, frame, kView).signature, "answer");
+
+  // The same pixels captured elsewhere, or a different size, are a new view
+  ImageRect moved = kView;
+  moved.x += 1;
+  CHECK(Lookup(index, frame, moved).kind == FrameMatch::NEW);
+  ImageRect smaller = kView;
+  smaller.width -= 32;
+  FrameMatch match = Lookup(index, frame, smaller);
+  CHECK(match.kind == FrameMatch::NEW);
+  CHECK(match.analysis.empty());
+  Frame larger(kView.width + 32, kView.height, 3);
+  ImageRect wider = kView;
+  wider.width += 32;
+  CHECK(Lookup(index, larger, wider).kind == FrameMatch::NEW);
+
+  // Another tile size hashes another grid
+  FrameIndexConfig config;
+  config.tileSize = 64;
+  FrameIndex coarse(config);
+  coarse.Remember(Lookup(coarse, frame, kView).signature, "answer");
+  CHECK(Lookup(coarse, frame, kView).kind == FrameMatch::UNCHANGED);
+
+  // Everything changed
+  Frame other(kView.width, kView.height, 4);
+  match = Lookup(index, other, kView);
+  CHECK(match.kind == FrameMatch::CHANGED);
+  CHECK_EQ(match.changedTiles, 11 * 8);
+  CHECK(SameRect(match.changed, {0, 0, kView.width, kView.height}));
+  CHECK(!match.sendDelta);
+
+  // Most of it changed: the top half, then only a delta's worth of rows
+  Frame top = frame;
+  top.Edit(0, 0, kView.width, kView.height / 2);
+  match = Lookup(index, top, kView);
+  CHECK(match.kind == FrameMatch::CHANGED);
+  CHECK(!match.sendDelta);
+  Frame band = frame;
+  band.Edit(0, 96, kView.width, 1); // Rows 64-159 with margin: 38%
+  match = Lookup(index, band, kView);
+  CHECK(SameRect(match.changed, {0, 64, kView.width, 96}));
+  CHECK(match.sendDelta);
+
+  FrameIndexStats stats = index.GetStats();
+  CHECK_EQ(stats.changed, 3u);
+  CHECK_EQ(stats.deltas, 1u);
+}
+
+// --- Eviction ----------------------------------------------------------------
+
+TEST(RememberEvictsTheLeastRecentlyUsed) {
+  FrameIndexConfig config;
+  config.maxFrames = 2;
+  FrameIndex index(config);
+  const ImageRect views[] = {{0, 0, 96, 64}, {200, 0, 96, 64},
+                             {400, 0, 96, 64}};
+  std::vector<Frame> frames;
+  for (uint32_t i = 0; i < 3; ++i)
+    frames.emplace_back(96, 64, 10 + i);
+
+  // A, B, C: A is forgotten
+  for (int i = 0; i < 3; ++i) {
+    index.Remember(Lookup(index, frames[i], views[i]).signature,
+                   std::string(1, 'A' + i));
+  }
+  CHECK_EQ(index.GetStats().frames, 2u);
+  FrameMatch a = Lookup(index, frames[0], views[0]);
+  CHECK(a.kind == FrameMatch::NEW);
+  CHECK(Lookup(index, frames[2], views[2]).analysis == "C");
+  CHECK(Lookup(index, frames[1], views[1]).analysis == "B");
+
+  // B was used last, so remembering A again drops C
+  index.Remember(a.signature, "A again");
+  CHECK_EQ(index.GetStats().frames, 2u);
+  CHECK(Lookup(index, frames[2], views[2]).kind == FrameMatch::NEW);
+  FrameMatch match = Lookup(index, frames[0], views[0]);
+  CHECK(match.kind == FrameMatch::UNCHANGED);
+  CHECK(match.analysis == "A again");
+  CHECK(Lookup(index, frames[1], views[1]).kind == FrameMatch::UNCHANGED);
+
+  // The same pixels remembered again replace their entry
+  index.Remember(match.signature, "A once more");
+  CHECK_EQ(index.GetStats().frames, 2u);
+  CHECK(Lookup(index, frames[0], views[0]).analysis == "A once more");
+  CHECK(Lookup(index, frames[1], views[1]).analysis == "B");
+
+  // An evicted view's edit has nothing to be a delta of
+  Frame edited = frames[2];
+  edited.Edit(0, 0, 1, 1);
+  CHECK(Lookup(index, edited, views[2]).kind == FrameMatch::NEW);
+
+  index.Clear();
+  CHECK_EQ(index.GetStats().frames, 0u);
+  CHECK(Lookup(index, frames[0], views[0]).kind == FrameMatch::NEW);
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Standalone Fuzz Driver
+// Stands in for libFuzzer where it is unavailable (MSVC, GCC): replays every
+// corpus file through LLVMFuzzerTestOneInput, then runs seeded random
+// mutations of the corpus (byte flips, inserts, deletes, splices, and
+// dictionary tokens). Deterministic for a given seed, so CTest can run it.
+//
+//   json_fuzz [-runs=N] [-seed=S] [-max_len=L] <corpus file or dir>...
+// -----------------------------------------------------------------------------
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+namespace {
+
+using Input = std::vector<uint8_t>;
+
+// Fragments that take a mutation across grammar boundaries quickly
+const char *const kDictionary[] = {
+    "{",     "}",      "[",      "]",      ",",       ":",      "\"",
+    "\\",    "\\u",    "\\ud83d", "\\ude00", "\\\"",    "true",   "false",
+    "null",  "-0",     "1e308",   "1e-400", "0.5",     "-",      "e+",
+    " ",     "\t\n",   "\"\":",   "{\"a\":", "[[[[",   "]]]]",   "\xC3\xA9",
+    "\x00",  "\x1F",   "\x7F",    "\xFF"};
+
+void AddFile(const std::filesystem::path &path, std::vector<Input> &corpus) {
+  std::ifstream file(path, std::ios::binary);
+  corpus.emplace_back(std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>());
+}
+
+void Mutate(Input &input, const std::vector<Input> &corpus,
+            std::mt19937 &rng, size_t maxLength) {
+  int edits = 1 + static_cast<int>(rng() % 4);
+  for (int e = 0; e < edits; ++e) {
+    size_t pos = input.empty() ? 0 : rng() % (input.size() + 1);
+    switch (rng() % 6) {
+    case 0: // Flip a bit
+      if (!input.empty())
+        input[rng() % input.size()] ^=
+            static_cast<uint8_t>(1u << (rng() % 8));
+      break;
+    case 1: // Random byte
+      input.insert(input.begin() + pos, static_cast<uint8_t>(rng()));
+      break;
+    case 2: { // Delete a run
+      if (input.empty())
+        break;
+      size_t start = rng() % input.size();
+      size_t count = 1 + rng() % std::min<size_t>(16, input.size() - start);
+      input.erase(input.begin() + start, input.begin() + start + count);
+      break;
+    }
+    case 3: { // Dictionary token
+      const char *token =
+          kDictionary[rng() % (sizeof(kDictionary) / sizeof(kDictionary[0]))];
+      size_t length = token[0] ? std::strlen(token) : 1;
+      input.insert(input.begin() + pos, token, token + length);
+      break;
+    }
+    case 4: { // Splice in a slice of another corpus entry
+      const Input &other = corpus[rng() % corpus.size()];
+      if (other.empty())
+        break;
+      size_t start = rng() % other.size();
+      size_t count = 1 + rng() % (other.size() - start);
+      input.insert(input.begin() + pos, other.begin() + start,
+                   other.begin() + start + count);
+      break;
+    }
+    default: { // Duplicate a run (deep nesting, long strings)
+      if (input.empty())
+        break;
+      size_t start = rng() % input.size();
+      size_t count = 1 + rng() % std::min<size_t>(8, input.size() - start);
+      Input run(input.begin() + start, input.begin() + start + count);
+      for (int r = 0, n = 1 + rng() % 64; r < n; ++r)
+        input.insert(input.begin() + pos, run.begin(), run.end());
+      break;
+    }
+    }
+  }
+  if (input.size() > maxLength)
+    input.resize(maxLength);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  long runs = 0;
+  unsigned seed = 1;
+  size_t maxLength = 4096;
+  std::vector<std::filesystem::path> files;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "-runs=", 6) == 0) {
+      runs = std::atol(argv[i] + 6);
+    } else if (std::strncmp(argv[i], "-seed=", 6) == 0) {
+      seed = static_cast<unsigned>(std::strtoul(argv[i] + 6, nullptr, 10));
+    } else if (std::strncmp(argv[i], "-max_len=", 9) == 0) {
+      maxLength = static_cast<size_t>(std::atol(argv[i] + 9));
+    } else if (std::filesystem::is_directory(argv[i])) {
+      for (const auto &entry : std::filesystem::directory_iterator(argv[i]))
+        if (entry.is_regular_file())
+          files.push_back(entry.path());
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+
+  // Directory order varies; sort so a seed always means the same inputs
+  std::sort(files.begin(), files.end());
+  std::vector<Input> corpus;
+  for (const auto &file : files)
+    AddFile(file, corpus);
+  if (corpus.empty())
+    corpus.emplace_back();
+
+  for (const Input &input : corpus)
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+
+  std::mt19937 rng(seed);
+  for (long run = 0; run < runs; ++run) {
+    Input input = corpus[rng() % corpus.size()];
+    Mutate(input, corpus, rng, maxLength);
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+
+  std::printf("%zu corpus inputs, %ld mutations, seed %u: ok\n",
+              corpus.size(), runs, seed);
+  return 0;
+}
@@ -0,0 +1,290 @@
+#include "glyph_font.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace invisible {
+namespace test {
+
+namespace {
+
+constexpr char kMagic[4] = {'I', 'G', 'F', '1'};
+
+void PutU16(std::vector<uint8_t> &out, int value) {
+  out.push_back(static_cast<uint8_t>(value & 0xFF));
+  out.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+}
+
+struct Reader {
+  const std::vector<uint8_t> &bytes;
+  size_t pos = 0;
+  bool ok = true;
+
+  int U16() {
+    if (pos + 2 > bytes.size()) {
+      ok = false;
+      return 0;
+    }
+    int value = bytes[pos] | (bytes[pos + 1] << 8);
+    pos += 2;
+    return value;
+  }
+  int I16() { return static_cast<int16_t>(U16()); }
+};
+
+} // namespace
+
+Canvas::Canvas(int width, int height, uint32_t color)
+    : width(width), height(height),
+      bgra(static_cast<size_t>(width) * height * 4) {
+  for (size_t i = 0; i < bgra.size(); i += 4)
+    memcpy(&bgra[i], &color, 4);
+}
+
+// -----------------------------------------------------------------------------
+// File Format
+// -----------------------------------------------------------------------------
+
+bool GlyphFont::Load(const std::string &path) {
+  std::vector<uint8_t> bytes;
+  if (FILE *file = std::fopen(path.c_str(), "rb")) {
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+      bytes.insert(bytes.end(), chunk, chunk + n);
+    std::fclose(file);
+  }
+  return Parse(bytes);
+}
+
+bool GlyphFont::Save(const std::string &path) const {
+  const std::vector<uint8_t> bytes = Serialize();
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) ==
+                 bytes.size();
+  return std::fclose(file) == 0 && written;
+}
+
+std::vector<uint8_t> GlyphFont::Serialize() const {
+  std::vector<uint8_t> out(kMagic, kMagic + 4);
+  PutU16(out, size);
+  PutU16(out, ascender);
+  PutU16(out, lineHeight);
+  PutU16(out, static_cast<int>(glyphs.size()));
+  for (const Glyph &glyph : glyphs) {
+    out.push_back(static_cast<uint8_t>(glyph.c));
+    PutU16(out, glyph.advance);
+    PutU16(out, glyph.left);
+    PutU16(out, glyph.top);
+    PutU16(out, glyph.width);
+    PutU16(out, glyph.rows);
+    out.insert(out.end(), glyph.coverage.begin(), glyph.coverage.end());
+  }
+  return out;
+}
+
+bool GlyphFont::Parse(const std::vector<uint8_t> &bytes) {
+  glyphs.clear();
+  if (bytes.size() < 12 || memcmp(bytes.data(), kMagic, 4) != 0)
+    return false;
+
+  Reader reader{bytes, 4};
+  size = reader.U16();
+  ascender = reader.U16();
+  lineHeight = reader.U16();
+  const int count = reader.U16();
+  for (int i = 0; i < count && reader.ok; ++i) {
+    if (reader.pos >= bytes.size())
+      return false;
+    Glyph glyph;
+    glyph.c = static_cast<char>(bytes[reader.pos++]);
+    glyph.advance = reader.I16();
+    glyph.left = reader.I16();
+    glyph.top = reader.I16();
+    glyph.width = reader.U16();
+    glyph.rows = reader.U16();
+    const size_t cells = static_cast<size_t>(glyph.width) * glyph.rows;
+    if (!reader.ok || reader.pos + cells > bytes.size())
+      return false;
+    glyph.coverage.assign(bytes.begin() + reader.pos,
+                          bytes.begin() + reader.pos + cells);
+    reader.pos += cells;
+    glyphs.push_back(std::move(glyph));
+  }
+  return reader.ok && !glyphs.empty() && size > 0 && lineHeight > 0;
+}
+
+const Glyph *GlyphFont::Find(char c) const {
+  for (const Glyph &glyph : glyphs) {
+    if (glyph.c == c)
+      return &glyph;
+  }
+  return nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// Rendering
+// -----------------------------------------------------------------------------
+
+void GlyphFont::Draw(Canvas &canvas, const Glyph &glyph, int penX,
+                     int baseline, uint32_t ink) const {
+  const int x0 = penX + glyph.left;
+  const int y0 = baseline - glyph.top;
+  for (int y = 0; y < glyph.rows; ++y) {
+    for (int x = 0; x < glyph.width; ++x) {
+      const int cx = x0 + x;
+      const int cy = y0 + y;
+      if (cx < 0 || cy < 0 || cx >= canvas.width || cy >= canvas.height)
+        continue;
+      const int alpha =
+          glyph.coverage[static_cast<size_t>(y) * glyph.width + x];
+      uint8_t *p = canvas.bgra.data() +
+                   (static_cast<size_t>(cy) * canvas.width + cx) * 4;
+      for (int k = 0; k < 3; ++k) {
+        const int target = (ink >> (8 * k)) & 0xFF;
+        p[k] = static_cast<uint8_t>(p[k] + (target - p[k]) * alpha / 255);
+      }
+    }
+  }
+}
+
+Canvas GlyphFont::Render(const std::string &text, uint32_t ink,
+                         uint32_t background, int margin) const {
+  int lines = 1, width = 0, lineWidth = 0;
+  for (char c : text) {
+    if (c == '\n') {
+      ++lines;
+      lineWidth = 0;
+      continue;
+    }
+    const Glyph *glyph = Find(c);
+    lineWidth += glyph ? glyph->advance : size / 2;
+    width = std::max(width, lineWidth);
+  }
+
+  Canvas canvas(width + 2 * margin, lines * lineHeight + 2 * margin,
+                background);
+  int penX = margin;
+  int baseline = margin + ascender;
+  for (char c : text) {
+    if (c == '\n') {
+      penX = margin;
+      baseline += lineHeight;
+      continue;
+    }
+    const Glyph *glyph = Find(c);
+    if (!glyph) {
+      penX += size / 2;
+      continue;
+    }
+    Draw(canvas, *glyph, penX, baseline, ink);
+    penX += glyph->advance;
+  }
+  return canvas;
+}
+
+ImageView GlyphFont::RenderGlyph(char c) {
+  cell_ = Canvas(size * 2 + 8, size * 2 + 8, 0xFFFFFFFF);
+  if (const Glyph *glyph = Find(c))
+    Draw(cell_, *glyph, 4, 4 + ascender, 0xFF000000);
+  return cell_.View();
+}
+
+// -----------------------------------------------------------------------------
+// Recognizer Samples
+// -----------------------------------------------------------------------------
+
+const char *const kCodeSample =
+    "class Solution {\n"
+    "public:\n"
+    "    int maxProfit(vector<int>& prices) {\n"
+    "        int best = 0, low = INT_MAX;\n"
+    "        for (int p : prices) {\n"
+    "            low = min(low, p);\n"
+    "            best = max(best, p - low); // sell today\n"
+    "        }\n"
+    "        return best;\n"
+    "    }\n"
+    "};\n"
+    "def merge(a, b):\n"
+    "    if not a or not b:\n"
+    "        return a + b  # 50% done!\n"
+    "    x = {'key': [1, 2, 3], \"q\": a[0] ^ b[-1]}\n"
+    "    return sorted(x, key=lambda k: k.upper()) @ ~y | z & w";
+
+const char *const kProseSample =
+    "Question 4: Which data structure gives O(1) average lookup?\n"
+    "A) Binary search tree     B) Hash table\n"
+    "C) Linked list            D) Sorted array\n"
+    "The quick brown fox jumps over the lazy dog, then rests.\n"
+    "Explain why the answer is correct; give an example (with code).\n"
+    "Pack my box with five dozen liquor jugs? Yes - 100% sure.";
+
+double CharacterAccuracy(const std::string &read, const std::string &truth,
+                         bool spaces) {
+  std::string a, b;
+  for (char c : read) {
+    if (spaces || c != ' ')
+      a += c;
+  }
+  for (char c : truth) {
+    if (spaces || c != ' ')
+      b += c;
+  }
+  if (b.empty())
+    return a.empty() ? 1.0 : 0.0;
+
+  // Levenshtein distance, one row at a time
+  std::vector<size_t> previous(b.size() + 1), current(b.size() + 1);
+  for (size_t j = 0; j <= b.size(); ++j)
+    previous[j] = j;
+  for (size_t i = 1; i <= a.size(); ++i) {
+    current[0] = i;
+    for (size_t j = 1; j <= b.size(); ++j) {
+      current[j] = std::min({previous[j] + 1, current[j - 1] + 1,
+                             previous[j - 1] + (a[i - 1] != b[j - 1])});
+    }
+    std::swap(previous, current);
+  }
+  return 1.0 - static_cast<double>(previous[b.size()]) / b.size();
+}
+
+void AddClutter(Canvas &canvas, const ImageRect &area, Clutter clutter,
+                uint32_t seed) {
+  std::mt19937 random(seed);
+  const int x1 = std::min(area.x + area.width, canvas.width);
+  const int y1 = std::min(area.y + area.height, canvas.height);
+  for (int y = std::max(area.y, 0); y < y1; ++y) {
+    for (int x = std::max(area.x, 0); x < x1; ++x) {
+      uint8_t *p = canvas.bgra.data() +
+                   (static_cast<size_t>(y) * canvas.width + x) * 4;
+      switch (clutter) {
+      case Clutter::kNoise:
+        for (int k = 0; k < 3; ++k)
+          p[k] = static_cast<uint8_t>(random());
+        break;
+      case Clutter::kSpeckle:
+        p[0] = p[1] = p[2] = (random() & 1) ? 0 : 255;
+        break;
+      case Clutter::kChart:
+        p[0] = p[1] = p[2] = static_cast<uint8_t>(x * 3 + y * 2);
+        break;
+      case Clutter::kPhoto: {
+        const int v = (x + y) / 5 + ((x / 37 + y / 23) % 3) * 40 +
+                      static_cast<int>(random() % 30);
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v * 3 / 4);
+        p[2] = static_cast<uint8_t>(255 - v / 2);
+        break;
+      }
+      }
+      p[3] = 255;
+    }
+  }
+}
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "image_buffer.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// Glyph Font Fixtures
+// Pre-rendered fonts for the text recognizer's tests: every printable ASCII
+// glyph of one font at one pixel size, as an antialiased coverage bitmap
+// with its advance and bearings, so text can be laid out the way a screen
+// draws it without a font rasterizer at test time. ocr_fixture_gen writes
+// them from font files with FreeType, as tests/data/ocr/<name>-<size>.glyphs.
+//
+// File layout (little-endian): "IGF1", then u16 pixel size, ascender, line
+// height and glyph count; per glyph u8 character, i16 advance, i16 left
+// bearing, i16 top bearing (baseline to the top row, up is positive), u16
+// width, u16 rows and width * rows coverage bytes, row by row.
+// -----------------------------------------------------------------------------
+
+struct Glyph {
+  char c = 0;
+  int advance = 0;
+  int left = 0;
+  int top = 0;
+  int width = 0;
+  int rows = 0;
+  std::vector<uint8_t> coverage;
+};
+
+// A BGRA image that owns its pixels
+struct Canvas {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> bgra;
+
+  Canvas() = default;
+  Canvas(int width, int height, uint32_t color);
+
+  ImageView View() const {
+    return ImageView{bgra.data(), width, height, width * 4};
+  }
+};
+
+class GlyphFont {
+public:
+  // Read or write a fixture file; Load() is false if it is missing or
+  // malformed
+  bool Load(const std::string &path);
+  bool Save(const std::string &path) const;
+
+  // Encode / decode the file layout above
+  std::vector<uint8_t> Serialize() const;
+  bool Parse(const std::vector<uint8_t> &bytes);
+
+  // Draw `text` (lines split at '\n') in `ink` on `background`, starting
+  // `margin` pixels from the top-left corner
+  Canvas Render(const std::string &text, uint32_t ink, uint32_t background,
+                int margin = 15) const;
+
+  // One character alone, dark on white, the baseline at the same place
+  // every time (a TextRecognizer::GlyphRenderer; valid until the next call)
+  ImageView RenderGlyph(char c);
+
+  const Glyph *Find(char c) const;
+
+  int size = 0;
+  int ascender = 0;
+  int lineHeight = 0;
+  std::vector<Glyph> glyphs;
+
+private:
+  void Draw(Canvas &canvas, const Glyph &glyph, int penX, int baseline,
+            uint32_t ink) const;
+
+  Canvas cell_;
+};
+
+// -----------------------------------------------------------------------------
+// Recognizer Samples
+// What the accuracy test and benchmark read: source code (for monospace
+// fonts) and a quiz question in prose, and the clutter that makes a
+// capture more than text.
+// -----------------------------------------------------------------------------
+
+extern const char *const kCodeSample;
+extern const char *const kProseSample;
+
+// 1 - edit distance / length of `truth`, ignoring spaces unless `spaces`
+double CharacterAccuracy(const std::string &read, const std::string &truth,
+                         bool spaces);
+
+enum class Clutter {
+  kNoise,   // Random colours in every pixel
+  kSpeckle, // Random black and white pixels
+  kChart,   // A grey gradient, like a filled plot
+  kPhoto,   // Coloured shading with blocks and grain
+};
+
+// Paint `area` of `canvas` over with `clutter` (seeded, so repeatable)
+void AddClutter(Canvas &canvas, const ImageRect &area, Clutter clutter,
+                uint32_t seed = 1);
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,648 @@
+#include "hpack.h"
+#include "http_client.h"
+#include "stub_server.h"
+#include "test.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+// HttpClient with http2Cleartext against a stand-in h2c server on
+// loopback: a small frame loop over the test StubServer that speaks just
+// enough HTTP/2 (SETTINGS, PING, WINDOW_UPDATE, HEADERS / CONTINUATION
+// through HPACK, DATA both ways within the flow control windows,
+// RST_STREAM) to check that calls share one connection, that the priority
+// field goes out, that large bodies cross every window, that repeated
+// headers compress, that the server's stream limit holds and that a
+// cancelled stream is reset on its own.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t kFrameHeaderSize = 9;
+constexpr size_t kMaxFrame = 16384;
+constexpr int64_t kDefaultWindow = 65535;
+
+enum : uint8_t {
+  kData = 0x0,
+  kHeaders = 0x1,
+  kRstStream = 0x3,
+  kSettings = 0x4,
+  kPing = 0x6,
+  kGoAway = 0x7,
+  kWindowUpdate = 0x8,
+  kContinuation = 0x9,
+};
+
+enum : uint8_t {
+  kEndStream = 0x1,
+  kAck = 0x1,
+  kEndHeaders = 0x4,
+  kPadded = 0x8,
+  kPriorityFlag = 0x20,
+};
+
+uint32_t ReadUint32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void AppendUint32(std::string &out, uint32_t value) {
+  out += static_cast<char>(value >> 24);
+  out += static_cast<char>(value >> 16);
+  out += static_cast<char>(value >> 8);
+  out += static_cast<char>(value);
+}
+
+void AppendFrame(std::string &out, uint8_t type, uint8_t flags,
+                 uint32_t stream, std::string_view payload) {
+  out += static_cast<char>(payload.size() >> 16);
+  out += static_cast<char>(payload.size() >> 8);
+  out += static_cast<char>(payload.size());
+  out += static_cast<char>(type);
+  out += static_cast<char>(flags);
+  AppendUint32(out, stream);
+  out.append(payload);
+}
+
+std::string Uint32(uint32_t value) {
+  std::string out;
+  AppendUint32(out, value);
+  return out;
+}
+
+// The stand-in server's answer to one request
+struct H2cReply {
+  int status = 200;
+  std::string body;
+  int delayMs = 0; // Hold the response back this long
+};
+
+using H2cHandler = std::function<H2cReply(const StubRequest &request)>;
+
+// What the server saw, for the checks
+struct H2cRecord {
+  StubRequest request;
+  uint32_t stream = 0;
+  size_t headerBlock = 0; // HPACK bytes of the request headers
+};
+
+// -----------------------------------------------------------------------------
+// Stand-in h2c server
+// One thread per connection runs a poll() loop: parse whatever frames have
+// arrived, then send the response data that the windows allow.
+// -----------------------------------------------------------------------------
+
+class H2cServer {
+public:
+  explicit H2cServer(H2cHandler handler, uint32_t maxStreams = 0)
+      : handler_(std::move(handler)), maxStreams_(maxStreams),
+        server_(std::make_unique<StubServer>(
+            [this](StubConnection &connection) { Serve(connection); })) {}
+
+  bool IsListening() const { return server_->IsListening(); }
+  std::wstring WideUrl(const std::string &path) const {
+    return server_->WideUrl(path);
+  }
+  size_t Connections() const { return server_->Connections(); }
+
+  std::vector<H2cRecord> Records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+  }
+  std::set<uint32_t> Resets() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resets_;
+  }
+  size_t PeakStreams() const { return peakStreams_; }
+  bool ProtocolError() const { return protocolError_; }
+
+private:
+  struct Stream {
+    std::string block; // Header block until END_HEADERS
+    StubRequest request;
+    size_t headerBlock = 0;
+    bool requestDone = false;
+    int64_t sendWindow = 0;
+    int status = 0;
+    bool replying = false; // Response headers sent
+    std::string reply;     // Response body still to send
+    size_t replyAt = 0;
+    Clock::time_point readyAt;
+    bool reset = false;
+  };
+
+  // One connection's state, owned by its thread
+  struct Peer {
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+    std::map<uint32_t, Stream> streams;
+    int64_t connWindow = kDefaultWindow;
+    int64_t initialWindow = kDefaultWindow;
+    uint32_t continuing = 0; // Stream whose header block is unfinished
+    std::string out;         // Frames to write
+  };
+
+  void Serve(StubConnection &connection);
+  bool OnFrame(Peer &peer, uint8_t type, uint8_t flags, uint32_t id,
+               const uint8_t *payload, size_t length);
+  void OnHeaders(Peer &peer, Stream &stream);
+  void OnRequestDone(uint32_t id, Stream &stream);
+  void Flush(Peer &peer);
+  void Fail() { protocolError_ = true; }
+
+  H2cHandler handler_;
+  uint32_t maxStreams_;
+
+  mutable std::mutex mutex_;
+  std::vector<H2cRecord> records_;
+  std::set<uint32_t> resets_;
+  std::atomic<size_t> peakStreams_{0};
+  std::atomic<bool> protocolError_{false};
+
+  std::unique_ptr<StubServer> server_; // Last: joined before the rest goes
+};
+
+void H2cServer::Serve(StubConnection &connection) {
+  // The socket is read directly rather than through StubConnection, whose
+  // buffer poll() can't see
+  Peer peer;
+  std::string settings;
+  if (maxStreams_ > 0) {
+    settings += '\0';
+    settings += '\x03'; // MAX_CONCURRENT_STREAMS
+    AppendUint32(settings, maxStreams_);
+  }
+  AppendFrame(peer.out, kSettings, 0, 0, settings);
+
+  const size_t prefaceSize = sizeof(kPreface) - 1;
+  bool prefaceSeen = false;
+  std::string in;
+  for (;;) {
+    if (!peer.out.empty() && !connection.Write(peer.out))
+      return;
+    peer.out.clear();
+
+    // Sleep until a frame arrives or the next held response is due
+    int timeout = -1;
+    for (const auto &entry : peer.streams) {
+      const Stream &stream = entry.second;
+      if (stream.requestDone && !stream.replying && !stream.reset) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        stream.readyAt - Clock::now())
+                        .count();
+        int ms = static_cast<int>(std::max<int64_t>(wait, 0));
+        timeout = timeout < 0 ? ms : std::min(timeout, ms);
+      }
+    }
+    pollfd descriptor{connection.Socket(), POLLIN, 0};
+    int ready = poll(&descriptor, 1, timeout);
+    if (ready < 0 && errno != EINTR)
+      return;
+    if (ready > 0) {
+      char chunk[65536];
+      ssize_t n = recv(connection.Socket(), chunk, sizeof(chunk), 0);
+      if (n <= 0)
+        return;
+      in.append(chunk, static_cast<size_t>(n));
+    }
+
+    size_t at = 0;
+    if (!prefaceSeen) {
+      if (in.size() < prefaceSize)
+        continue;
+      if (in.compare(0, prefaceSize, kPreface) != 0) {
+        Fail();
+        return;
+      }
+      prefaceSeen = true;
+      at = prefaceSize;
+    }
+    while (in.size() - at >= kFrameHeaderSize) {
+      const uint8_t *p = reinterpret_cast<const uint8_t *>(in.data() + at);
+      size_t length = (size_t(p[0]) << 16) | (size_t(p[1]) << 8) | p[2];
+      if (length > kMaxFrame) {
+        Fail();
+        return;
+      }
+      if (in.size() - at < kFrameHeaderSize + length)
+        break;
+      uint32_t id = ReadUint32(p + 5) & 0x7fffffff;
+      if (!OnFrame(peer, p[3], p[4], id, p + kFrameHeaderSize, length))
+        return;
+      at += kFrameHeaderSize + length;
+    }
+    in.erase(0, at);
+    Flush(peer);
+  }
+}
+
+bool H2cServer::OnFrame(Peer &peer, uint8_t type, uint8_t flags,
+                        uint32_t id, const uint8_t *payload, size_t length) {
+  if (peer.continuing != 0 &&
+      (type != kContinuation || id != peer.continuing)) {
+    Fail();
+    return false;
+  }
+
+  switch (type) {
+  case kSettings:
+    if (flags & kAck)
+      return true;
+    for (size_t i = 0; i + 6 <= length; i += 6) {
+      uint16_t setting = static_cast<uint16_t>(payload[i] << 8 |
+                                               payload[i + 1]);
+      uint32_t value = ReadUint32(payload + i + 2);
+      if (setting == 0x4) { // INITIAL_WINDOW_SIZE moves every stream
+        for (auto &entry : peer.streams)
+          entry.second.sendWindow += int64_t(value) - peer.initialWindow;
+        peer.initialWindow = value;
+      }
+    }
+    AppendFrame(peer.out, kSettings, kAck, 0, "");
+    return true;
+
+  case kPing:
+    if (!(flags & kAck)) {
+      AppendFrame(peer.out, kPing, kAck, 0,
+                  std::string_view(reinterpret_cast<const char *>(payload),
+                                   length));
+    }
+    return true;
+
+  case kWindowUpdate: {
+    int64_t increment = ReadUint32(payload) & 0x7fffffff;
+    if (id == 0) {
+      peer.connWindow += increment;
+    } else {
+      auto stream = peer.streams.find(id);
+      if (stream != peer.streams.end())
+        stream->second.sendWindow += increment;
+    }
+    return true;
+  }
+
+  case kHeaders:
+  case kContinuation: {
+    if (type == kHeaders) {
+      if (peer.streams.count(id) || id % 2 == 0) {
+        Fail();
+        return false;
+      }
+      Stream &stream = peer.streams[id];
+      stream.sendWindow = peer.initialWindow;
+      stream.requestDone = (flags & kEndStream) != 0;
+      size_t open = 0;
+      for (const auto &entry : peer.streams)
+        open += !entry.second.reset;
+      peakStreams_ = std::max<size_t>(peakStreams_, open);
+    }
+    Stream &stream = peer.streams[id];
+    size_t skip = 0;
+    size_t padding = 0;
+    if (type == kHeaders && (flags & kPadded)) {
+      padding = payload[0];
+      skip = 1;
+    }
+    if (type == kHeaders && (flags & kPriorityFlag))
+      skip += 5;
+    stream.block.append(reinterpret_cast<const char *>(payload) + skip,
+                        length - skip - padding);
+    if (!(flags & kEndHeaders)) {
+      peer.continuing = id;
+      return true;
+    }
+    peer.continuing = 0;
+    OnHeaders(peer, stream);
+    if (stream.requestDone)
+      OnRequestDone(id, stream);
+    return !protocolError_;
+  }
+
+  case kData: {
+    auto found = peer.streams.find(id);
+    if (found == peer.streams.end()) {
+      Fail();
+      return false;
+    }
+    Stream &stream = found->second;
+    size_t skip = 0;
+    size_t padding = 0;
+    if (flags & kPadded) {
+      padding = payload[0];
+      skip = 1;
+    }
+    stream.request.body.append(reinterpret_cast<const char *>(payload) + skip,
+                               length - skip - padding);
+    if (length > 0) { // Give the window straight back
+      AppendFrame(peer.out, kWindowUpdate, 0, 0, Uint32(uint32_t(length)));
+      if (!(flags & kEndStream))
+        AppendFrame(peer.out, kWindowUpdate, 0, id, Uint32(uint32_t(length)));
+    }
+    if (flags & kEndStream) {
+      stream.requestDone = true;
+      OnRequestDone(id, stream);
+    }
+    return true;
+  }
+
+  case kRstStream: {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      resets_.insert(id);
+    }
+    auto stream = peer.streams.find(id);
+    if (stream != peer.streams.end())
+      stream->second.reset = true;
+    return true;
+  }
+
+  case kGoAway:
+    return false;
+
+  default:
+    return true; // PRIORITY and unknown types are ignored
+  }
+}
+
+void H2cServer::OnHeaders(Peer &peer, Stream &stream) {
+  HpackHeaderList fields;
+  const auto *block = reinterpret_cast<const uint8_t *>(stream.block.data());
+  if (!peer.decoder.Decode(block, stream.block.size(), fields)) {
+    Fail();
+    return;
+  }
+  stream.headerBlock = stream.block.size();
+  stream.block.clear();
+  for (auto &field : fields) {
+    if (field.first == ":method")
+      stream.request.method = field.second;
+    else if (field.first == ":path")
+      stream.request.path = field.second;
+    else if (field.first[0] != ':')
+      stream.request.headers[field.first] = field.second;
+  }
+}
+
+void H2cServer::OnRequestDone(uint32_t id, Stream &stream) {
+  H2cReply reply = handler_(stream.request);
+  stream.status = reply.status;
+  stream.reply = std::move(reply.body);
+  stream.readyAt = Clock::now() + std::chrono::milliseconds(reply.delayMs);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_.push_back({stream.request, id, stream.headerBlock});
+}
+
+void H2cServer::Flush(Peer &peer) {
+  auto now = Clock::now();
+  for (auto entry = peer.streams.begin(); entry != peer.streams.end();) {
+    uint32_t id = entry->first;
+    Stream &stream = entry->second;
+    if (stream.reset) {
+      entry = peer.streams.erase(entry);
+      continue;
+    }
+    if (!stream.requestDone || now < stream.readyAt) {
+      ++entry;
+      continue;
+    }
+    if (!stream.replying) {
+      std::string block;
+      std::string length = std::to_string(stream.reply.size());
+      peer.encoder.Encode({{":status", std::to_string(stream.status)},
+                           {"content-length", length}},
+                          block);
+      AppendFrame(peer.out, kHeaders,
+                  kEndHeaders | (stream.reply.empty() ? kEndStream : 0), id,
+                  block);
+      stream.replying = true;
+    }
+    while (stream.replyAt < stream.reply.size()) {
+      int64_t room = std::min({peer.connWindow, stream.sendWindow,
+                               int64_t(kMaxFrame)});
+      if (room <= 0)
+        break;
+      size_t size = std::min<size_t>(room, stream.reply.size() -
+                                               stream.replyAt);
+      bool last = stream.replyAt + size == stream.reply.size();
+      AppendFrame(peer.out, kData, last ? kEndStream : 0, id,
+                  std::string_view(stream.reply).substr(stream.replyAt, size));
+      stream.replyAt += size;
+      peer.connWindow -= size;
+      stream.sendWindow -= size;
+    }
+    if (stream.replyAt == stream.reply.size())
+      entry = peer.streams.erase(entry);
+    else
+      ++entry;
+  }
+}
+
+HttpClientConfig H2cConfig() {
+  HttpClientConfig config;
+  config.http2 = true;
+  config.http2Cleartext = true;
+  config.receiveTimeoutMs = 10000;
+  return config;
+}
+
+// "<method> <path> <body bytes>"
+H2cReply Echo(const StubRequest &request) {
+  H2cReply reply;
+  reply.body = request.method + " " + request.path + " " +
+               std::to_string(request.body.size());
+  return reply;
+}
+
+} // namespace
+
+TEST(RequestsShareOneConnection) {
+  H2cServer server([](const StubRequest &request) {
+    H2cReply reply = Echo(request);
+    reply.delayMs = 20; // Keep streams open side by side
+    return reply;
+  });
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(H2cConfig()));
+
+  // The first request learns the server's SETTINGS
+  CHECK_EQ(client.Get(server.WideUrl("/warm")).statusCode, 200);
+
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 5; ++i) {
+        std::string path = "/" + std::to_string(t) + "/" + std::to_string(i);
+        HttpResponse response = client.PostJson(server.WideUrl(path), "{}");
+        if (response.statusCode != 200 ||
+            response.body != "POST " + path + " 2")
+          ++failures;
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  CHECK_EQ(failures.load(), 0);
+  CHECK_EQ(server.Connections(), 1u);
+  CHECK_EQ(server.Records().size(), 41u);
+  CHECK_GT(server.PeakStreams(), 1u);
+  CHECK(!server.ProtocolError());
+}
+
+TEST(PriorityFieldIsSent) {
+  H2cServer server(Echo);
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(H2cConfig()));
+
+  CHECK_EQ(client.PostJson(server.WideUrl("/high"), "{}", {},
+                           HttpPriority::High).statusCode, 200);
+  CHECK_EQ(client.PostJson(server.WideUrl("/normal"), "{}").statusCode, 200);
+  CHECK_EQ(client.PostJson(server.WideUrl("/low"), "{}", {},
+                           HttpPriority::Low).statusCode, 200);
+
+  std::vector<H2cRecord> records = server.Records();
+  REQUIRE(records.size() == 3);
+  CHECK_EQ(records[0].request.headers["priority"], std::string("u=1"));
+  CHECK(records[1].request.headers.count("priority") == 0);
+  CHECK_EQ(records[2].request.headers["priority"], std::string("u=5"));
+}
+
+TEST(LargeBodiesCrossEveryWindow) {
+  // 3 MB each way: beyond the 64 KB default window the client starts
+  // with, its 1 MB stream window and the server's frame size
+  const std::string big(3 << 20, 'z');
+  H2cServer server([&big](const StubRequest &request) {
+    H2cReply reply;
+    reply.body = request.body == big ? big : "mismatch";
+    return reply;
+  });
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(H2cConfig()));
+
+  for (int i = 0; i < 2; ++i) {
+    HttpResponse response = client.PostJson(server.WideUrl("/echo"), big);
+    CHECK_EQ(response.statusCode, 200);
+    CHECK_EQ(response.body.size(), big.size());
+    CHECK(response.body == big);
+  }
+  CHECK_EQ(server.Connections(), 1u);
+  CHECK(!server.ProtocolError());
+}
+
+TEST(RepeatedHeadersCompress) {
+  H2cServer server(Echo);
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(H2cConfig()));
+
+  std::map<std::wstring, std::wstring> headers = {
+      {L"Authorization", L"Bearer gsk_0123456789abcdefghijklmnopqrstuvwxyz"}};
+  for (int i = 0; i < 3; ++i) {
+    CHECK_EQ(client.PostJson(server.WideUrl("/v1/chat/completions"), "{}",
+                             headers).statusCode, 200);
+  }
+
+  std::vector<H2cRecord> records = server.Records();
+  REQUIRE(records.size() == 3);
+  CHECK_EQ(records[0].request.headers["authorization"],
+           std::string("Bearer gsk_0123456789abcdefghijklmnopqrstuvwxyz"));
+  // Everything is in the dynamic table after the first request
+  CHECK_LT(records[1].headerBlock * 4, records[0].headerBlock);
+  CHECK_EQ(records[2].headerBlock, records[1].headerBlock);
+}
+
+TEST(ServerStreamLimitIsRespected) {
+  H2cServer server(
+      [](const StubRequest &request) {
+        H2cReply reply = Echo(request);
+        reply.delayMs = 15;
+        return reply;
+      },
+      2);
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(H2cConfig()));
+
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 6; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 4; ++i) {
+        if (client.Get(server.WideUrl("/")).statusCode != 200)
+          ++failures;
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  CHECK_EQ(failures.load(), 0);
+  CHECK_EQ(server.Records().size(), 24u);
+  CHECK_EQ(server.PeakStreams(), 2u);
+  CHECK_EQ(server.Connections(), 1u);
+  CHECK(client.GetPoolStats().waits > 0);
+}
+
+TEST(CancelledStreamIsResetAlone) {
+  H2cServer server([](const StubRequest &request) {
+    H2cReply reply = Echo(request);
+    if (request.path == "/big")
+      reply.body.assign(4 << 20, 'b'); // More than one stream window
+    if (request.path == "/slow")
+      reply.delayMs = 100;
+    return reply;
+  });
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(H2cConfig()));
+  CHECK_EQ(client.Get(server.WideUrl("/warm")).statusCode, 200);
+
+  // A slow call is in flight on the same connection while the streaming
+  // one stops after its first slice
+  HttpResponse slow;
+  std::thread other([&] { slow = client.Get(server.WideUrl("/slow")); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  HttpResponse cancelled = client.PostJsonStreaming(
+      server.WideUrl("/big"), "{}", {},
+      [](const char *, size_t) { return false; });
+  other.join();
+
+  CHECK(cancelled.error == L"Cancelled");
+  CHECK_EQ(slow.statusCode, 200);
+  CHECK_EQ(slow.body, std::string("GET /slow 0"));
+
+  // Still the same connection afterwards
+  CHECK_EQ(client.Get(server.WideUrl("/after")).statusCode, 200);
+  CHECK_EQ(server.Connections(), 1u);
+
+  uint32_t bigStream = 0;
+  for (const H2cRecord &record : server.Records()) {
+    if (record.request.path == "/big")
+      bigStream = record.stream;
+  }
+  REQUIRE(bigStream != 0);
+  std::set<uint32_t> resets = server.Resets();
+  CHECK_EQ(resets.size(), 1u);
+  CHECK(resets.count(bigStream) == 1);
+  CHECK(!server.ProtocolError());
+}
@@ -0,0 +1,127 @@
+#include "bench.h"
+#include "http_client.h"
+#include "stub_server.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+
+// HttpClient over the socket transport against a loopback server: PostJson
+// latency percentiles with and without keep-alive, request throughput from
+// several threads, and PostMultipart upload rate for transcription-sized
+// files. The server answers as soon as it has read the request, so the
+// figures are the client's and the transport's own cost.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+
+namespace {
+
+std::unique_ptr<StubServer> Server() {
+  return StubServer::Http(
+      [](const StubRequest &request, StubConnection &connection) {
+        return connection.Write(test::StubResponse(
+            200, "{\"text\":\"" + std::to_string(request.body.size()) + "\"}",
+            "Content-Type: application/json\r\n"));
+      });
+}
+
+HttpClientConfig Config(bool keepAlive) {
+  HttpClientConfig config;
+  config.idleConnectionTimeoutMs = keepAlive ? 50000 : 0; // 0: never reused
+  return config;
+}
+
+void Latency(const StubServer &server, bool keepAlive, int requests) {
+  HttpClient client;
+  client.Initialize(Config(keepAlive));
+  std::string body(1024, 'x');
+  std::wstring url = server.WideUrl("/v1/chat/completions");
+  client.PostJson(url, body); // Warm up
+
+  std::vector<double> us;
+  for (int i = 0; i < requests; ++i) {
+    auto start = bench::Clock::now();
+    HttpResponse response = client.PostJson(url, body);
+    us.push_back(bench::Seconds(start) * 1e6);
+    bench::Consume(response);
+  }
+  std::sort(us.begin(), us.end());
+  auto at = [&](double p) {
+    return us[static_cast<size_t>(p * (us.size() - 1))];
+  };
+  std::printf("  %-18s %8.1f %8.1f %8.1f   %llu handshakes\n",
+              keepAlive ? "keep-alive" : "new connection", at(0.5), at(0.9),
+              at(0.99),
+              static_cast<unsigned long long>(client.GetPoolStats().opened));
+}
+
+void Throughput(const StubServer &server, int threads, int perThread) {
+  HttpClient client;
+  client.Initialize(Config(true));
+  std::string body(1024, 'x');
+  std::wstring url = server.WideUrl("/v1/chat/completions");
+  std::atomic<int> failed{0};
+
+  auto start = bench::Clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      for (int i = 0; i < perThread; ++i) {
+        if (client.PostJson(url, body).statusCode != 200)
+          ++failed;
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  double seconds = bench::Seconds(start);
+  std::printf("  %2d threads %10.0f req/s%s\n", threads,
+              threads * perThread / seconds, failed ? "  (FAILURES)" : "");
+}
+
+void Upload(const StubServer &server, size_t bytes, int runs) {
+  HttpClient client;
+  client.Initialize(Config(true));
+  std::vector<uint8_t> wav(bytes, 0x55);
+  std::wstring url = server.WideUrl("/v1/audio/transcriptions");
+  std::map<std::string, std::string> fields = {{"model", "whisper-large-v3"},
+                                               {"language", "en"}};
+
+  int status = 0;
+  double best = bench::BestOf(runs, [&] {
+    HttpResponse response = client.PostMultipart(
+        url, fields, "audio.wav", "file", wav, "audio/wav");
+    status = response.statusCode;
+  });
+  std::printf("  %6zu KB %9.2f ms %9.0f MB/s%s\n", bytes >> 10, best * 1e3,
+              bytes / best / 1e6, status == 200 ? "" : "  (FAILED)");
+}
+
+} // namespace
+
+int main() {
+  const int runs = bench::Runs(5);
+  auto server = Server();
+  if (!server->IsListening()) {
+    std::printf("cannot listen on loopback\n");
+    return 1;
+  }
+
+  std::printf("PostJson latency, 1 KB body (us)\n");
+  std::printf("  %-18s %8s %8s %8s\n", "", "p50", "p90", "p99");
+  Latency(*server, true, 2000);
+  Latency(*server, false, 2000);
+
+  std::printf("PostJson throughput, 1 KB body, one client\n");
+  for (int threads : {1, 4, 8})
+    Throughput(*server, threads, 4000 / threads);
+
+  std::printf("PostMultipart upload, best of %d\n", runs);
+  for (size_t kb : {64, 1024, 8192})
+    Upload(*server, kb << 10, runs);
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include "alloc_counter.h"
+#include "image_buffer.h"
+#include "jpeg_encoder.h"
+#include "synthetic_capture_backend.h"
+#include "test.h"
+#include <type_traits>
+
+// Heap allocations of the capture path, counted through the replaced
+// operator new in alloc_counter.cpp: pooled buffers come back without
+// allocating, views crop without copying, and a warmed-up capture, crop,
+// preprocess and encode cycle allocates nothing the size of an image.
+
+using namespace invisible;
+using invisible::test::AllocationCounter;
+using invisible::test::SyntheticCaptureBackend;
+
+static_assert(!std::is_copy_constructible<ImageBuffer>::value &&
+                  !std::is_copy_assignable<ImageBuffer>::value,
+              "ImageBuffer is move-only");
+static_assert(std::is_nothrow_move_constructible<ImageBuffer>::value &&
+                  std::is_nothrow_move_assignable<ImageBuffer>::value,
+              "ImageBuffer moves without allocating");
+static_assert(!std::is_copy_constructible<CaptureFrame>::value,
+              "CaptureFrame is move-only");
+
+namespace {
+
+// A 4K desktop with text-like rows, so the encoder has real work
+void Paint(SyntheticCaptureBackend &backend) {
+  const int width = backend.GetWidth();
+  const int height = backend.GetHeight();
+  std::vector<uint8_t> row(static_cast<size_t>(width) * 4);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      bool ink = (y / 4) % 5 == 1 && (x * 7 + y) % 11 < 5;
+      uint8_t value = ink ? 30 : 245;
+      row[x * 4 + 0] = value;
+      row[x * 4 + 1] = value;
+      row[x * 4 + 2] = static_cast<uint8_t>(value ^ (x >> 4));
+      row[x * 4 + 3] = 255;
+    }
+    backend.Draw({0, y, width, 1}, row.data(), width * 4);
+  }
+}
+
+// One region hotkey press: capture a slightly different drag each time,
+// take the part that changed as a view, shrink it into a pooled buffer and
+// encode it into `jpeg`
+struct Pipeline {
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend{3840, 2160, &pool};
+  ImagePreprocessor preprocessor;
+  JpegEncoder encoder;
+  std::vector<uint8_t> jpeg;
+
+  Pipeline() { Paint(backend); }
+
+  bool Run(int i) {
+    CaptureFrame frame;
+    const ImageRect region{100 + i % 7, 200, 1900 + (i % 5) * 8,
+                           1000 + (i % 3) * 6};
+    if (!backend.Capture(region, frame))
+      return false;
+    ImageView changed = frame.View().Crop({64, 32, 1400, 900});
+
+    size_t limit = static_cast<size_t>(changed.width) * changed.height;
+    ImageBuffer prepared(&pool, limit * 4);
+    int width = 0, height = 0;
+    const uint8_t *pixels = changed.pixels;
+    int stride = changed.stride;
+    if (preprocessor.Process(changed.pixels, changed.width, changed.height,
+                             changed.stride, prepared.bytes(), width,
+                             height)) {
+      pixels = prepared.data();
+      stride = width * 4;
+    } else {
+      width = changed.width;
+      height = changed.height;
+    }
+    jpeg.clear();
+    return encoder.EncodeBgra(pixels, width, height, stride, jpeg);
+  }
+};
+
+} // namespace
+
+// --- Buffers -----------------------------------------------------------------
+
+TEST(PooledBuffersComeBackWithoutAllocating) {
+  FrameBufferPool pool;
+  { ImageBuffer warm(&pool, 1 << 20); }
+
+  AllocationCounter counter;
+  for (int i = 0; i < 100; ++i) {
+    ImageBuffer buffer(&pool, (1 << 20) - i * 64);
+    buffer.data()[0] = 1;
+  }
+  counter.Stop();
+  CHECK_EQ(counter.Count(), 0u);
+  CHECK_EQ(pool.GetStats().reuses, 100u);
+}
+
+TEST(UnpooledBuffersAllocateEveryTime) {
+  // The counter sees what the pool saves
+  AllocationCounter counter;
+  for (int i = 0; i < 10; ++i) {
+    ImageBuffer buffer(nullptr, 1 << 20);
+    buffer.data()[0] = 1;
+  }
+  counter.Stop();
+  CHECK_EQ(counter.Count(), 10u);
+  CHECK_EQ(counter.Bytes(), 10u << 20);
+}
+
+TEST(MovesAndViewsDoNotCopy) {
+  FrameBufferPool pool;
+  ImageBuffer a(&pool, 640 * 480 * 4);
+  const uint8_t *pixels = a.data();
+
+  AllocationCounter counter;
+  ImageBuffer b(std::move(a));
+  ImageBuffer c;
+  c = std::move(b);
+  ImageView view{c.data(), 640, 480, 640 * 4};
+  ImageView crop = view.Crop({10, 20, 100, 50}).Crop({5, 5, 10, 10});
+  counter.Stop();
+
+  CHECK_EQ(counter.Count(), 0u);
+  CHECK(c.data() == pixels);
+  CHECK(a.empty());
+  CHECK(b.empty());
+  CHECK(crop.pixels == view.Row(25) + 15 * 4);
+  CHECK_EQ(crop.stride, 640 * 4);
+  CHECK_EQ(crop.width, 10);
+}
+
+TEST(ReplacedBuffersGoBackToThePool) {
+  FrameBufferPool pool;
+  ImageBuffer buffer(&pool, 4096 * 4);
+  buffer = ImageBuffer(&pool, 4096 * 4); // The first is released
+  buffer.Reset();
+  FrameBufferPoolStats stats = pool.GetStats();
+  CHECK_EQ(stats.releases, 2u);
+  CHECK_EQ(stats.pooledBuffers, 2u);
+  buffer.Reset(); // Once only
+  CHECK_EQ(pool.GetStats().releases, 2u);
+}
+
+// --- Capture path ------------------------------------------------------------
+
+TEST(CaptureAllocatesOnlyUntilThePoolIsWarm) {
+  FrameBufferPool pool;
+  SyntheticCaptureBackend backend(3840, 2160, &pool);
+  {
+    CaptureFrame frame;
+    backend.Capture({0, 0, 1920, 1080}, frame);
+  }
+
+  AllocationCounter counter;
+  for (int i = 0; i < 30; ++i) {
+    CaptureFrame frame;
+    CHECK(backend.Capture({i, i, 1920 - i * 4, 1080 - i}, frame));
+  }
+  counter.Stop();
+  CHECK_EQ(counter.Count(), 0u);
+  CHECK_EQ(pool.GetStats().allocations, 1u);
+}
+
+TEST(WarmPipelineCopiesNoPixels) {
+  Pipeline pipeline;
+  // Until every buffer has reached the largest size it will need
+  for (int i = 0; i < 30; ++i)
+    REQUIRE(pipeline.Run(i));
+  FrameBufferPoolStats warm = pipeline.pool.GetStats();
+
+  AllocationCounter counter;
+  bool ok = true;
+  for (int i = 0; i < 30; ++i)
+    ok = pipeline.Run(i) && ok;
+  counter.Stop();
+  CHECK(ok);
+  std::printf("  30 capture, crop, preprocess and encode cycles: %zu "
+              "allocations (%zu bytes, largest %zu); %u buffers allocated "
+              "while warming\n",
+              counter.Count(), counter.Bytes(), counter.Largest(),
+              static_cast<unsigned>(warm.allocations));
+  CHECK_LE(warm.allocations, 3u); // The capture and the prepared image
+  CHECK_EQ(pipeline.pool.GetStats().allocations, warm.allocations);
+
+  // All that is left is the encoder's working rows (three planes of one
+  // 16-row MCU band, at most 1408 wide): no image-sized allocation
+  CHECK_EQ(counter.Count(), 3u * 30);
+  CHECK_LE(counter.Largest(), 1408u * 16 * sizeof(int16_t));
+}
@@ -0,0 +1,62 @@
+#include "bench.h"
+#include "image_preprocessor.h"
+#include <vector>
+
+// Preprocessing time for region captures the size of common displays: a
+// full-screen editor (downscale only) and a window on a desktop (trim,
+// then downscale), as PrepareForVision runs them.
+
+using namespace invisible;
+
+namespace {
+
+// Desktop colour around a window of text-like strokes on white
+std::vector<uint8_t> MakeCapture(int width, int height, int border) {
+  std::vector<uint8_t> bgra(static_cast<size_t>(width) * height * 4);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint8_t *px = bgra.data() + (static_cast<size_t>(y) * width + x) * 4;
+      bool window = x >= border && y >= border && x < width - border &&
+                    y < height - border;
+      bool ink = window && (y / 3) % 6 == 1 && (x * 7 + y * 3) % 11 < 6;
+      uint8_t value = ink ? 20 : 255;
+      px[0] = window ? value : 160;
+      px[1] = window ? value : 96;
+      px[2] = window ? value : 32;
+      px[3] = 255;
+    }
+  }
+  return bgra;
+}
+
+} // namespace
+
+int main() {
+  const int runs = bench::Runs(10);
+  std::printf("image preprocessor (%s), best of %d\n",
+              ImagePreprocessor::HasSimd() ? "SSE2" : "scalar", runs);
+  struct Display {
+    const char *name;
+    int width, height;
+  } displays[] = {{"1080p", 1920, 1080}, {"1440p", 2560, 1440},
+                  {"4K", 3840, 2160}, {"5K", 5120, 2880}};
+
+  ImagePreprocessor preprocessor;
+  std::vector<uint8_t> out;
+  for (const Display &d : displays) {
+    for (int border : {0, d.width / 8}) {
+      std::vector<uint8_t> capture = MakeCapture(d.width, d.height, border);
+      int w = 0, h = 0;
+      double seconds = bench::BestOf(runs, [&] {
+        preprocessor.Process(capture.data(), d.width, d.height, d.width * 4,
+                             out, w, h);
+        bench::Consume(out);
+      });
+      double megapixels = static_cast<double>(d.width) * d.height / 1e6;
+      std::printf("  %-5s %-8s -> %4dx%-4d: %6.2f ms, %6.0f MP/s\n", d.name,
+                  border ? "windowed" : "full", w, h, seconds * 1e3,
+                  megapixels / seconds);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,319 @@
+#include "image_preprocessor.h"
+#include "test.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// ImagePreprocessor on synthetic BGRA screens: the fixed-point downscale
+// against an exact double-precision area average (PSNR), the size limits,
+// border trimming and row strides.
+
+using namespace invisible;
+
+namespace {
+
+// A screen-like frame: a desktop-coloured border of `border` pixels around
+// a window with a title bar, a gradient panel and lines of 1 px text-like
+// strokes, with `padding` spare bytes at the end of every row
+struct Frame {
+  int width, height, stride;
+  std::vector<uint8_t> bgra;
+
+  const uint8_t *Pixel(int x, int y) const {
+    return bgra.data() + static_cast<size_t>(y) * stride + x * 4;
+  }
+};
+
+Frame MakeFrame(int width, int height, int border = 0, int padding = 0) {
+  Frame f{width, height, width * 4 + padding, {}};
+  f.bgra.assign(static_cast<size_t>(f.stride) * height, 0xCD);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int r = 32, g = 96, b = 160; // Desktop
+      int wx = x - border;
+      int wy = y - border;
+      if (wx >= 0 && wy >= 0 && x < width - border && y < height - border) {
+        if (wy < 24) { // Title bar
+          r = g = b = 220;
+        } else if (wx < (width - 2 * border) / 3) { // Gradient panel
+          r = wx * 255 / std::max(width, 1);
+          g = wy * 255 / std::max(height, 1);
+          b = 200;
+        } else { // Text on white
+          r = g = b = 255;
+          bool line = (wy / 3) % 6 == 1 && wy % 3 == 0;
+          bool glyph = (wx * 7 + wy * 3) % 11 < 6;
+          if ((line && glyph) || (wx % 9 == 0 && (wy / 3) % 6 < 3))
+            r = g = b = 20;
+        }
+      }
+      uint8_t *px = f.bgra.data() + static_cast<size_t>(y) * f.stride + x * 4;
+      px[0] = static_cast<uint8_t>(b);
+      px[1] = static_cast<uint8_t>(g);
+      px[2] = static_cast<uint8_t>(r);
+      px[3] = 255;
+    }
+  }
+  return f;
+}
+
+// Weight of every source index in each output index along one axis: the
+// overlap of the two intervals, as a fraction of the output interval
+std::vector<std::vector<std::pair<int, double>>> AreaWeights(int src,
+                                                             int dst) {
+  std::vector<std::vector<std::pair<int, double>>> axis(dst);
+  const double scale = static_cast<double>(src) / dst;
+  for (int i = 0; i < dst; ++i) {
+    double start = i * scale;
+    double end = start + scale;
+    for (int j = static_cast<int>(start); j < src && j < end; ++j) {
+      double overlap =
+          std::min<double>(end, j + 1) - std::max<double>(start, j);
+      if (overlap > 0)
+        axis[i].push_back({j, overlap / scale});
+    }
+  }
+  return axis;
+}
+
+// Exact area average of `f` at dstWidth x dstHeight, unrounded
+std::vector<double> ReferenceDownscale(const Frame &f, int dstWidth,
+                                       int dstHeight) {
+  auto columns = AreaWeights(f.width, dstWidth);
+  auto rows = AreaWeights(f.height, dstHeight);
+  std::vector<double> out(static_cast<size_t>(dstWidth) * dstHeight * 4);
+  std::vector<double> row(static_cast<size_t>(f.width) * 4);
+  for (int y = 0; y < dstHeight; ++y) {
+    std::fill(row.begin(), row.end(), 0.0);
+    for (auto &[sy, wy] : rows[y]) {
+      for (int x = 0; x < f.width * 4; ++x)
+        row[x] += wy * f.Pixel(0, sy)[x];
+    }
+    for (int x = 0; x < dstWidth; ++x) {
+      for (auto &[sx, wx] : columns[x]) {
+        for (int c = 0; c < 4; ++c)
+          out[(static_cast<size_t>(y) * dstWidth + x) * 4 + c] +=
+              wx * row[sx * 4 + c];
+      }
+    }
+  }
+  return out;
+}
+
+// PSNR over B, G and R of packed `actual` against the reference, and the
+// largest single-channel difference
+double Psnr(const std::vector<uint8_t> &actual,
+            const std::vector<double> &expected, double *maxError = nullptr) {
+  double error = 0;
+  double worst = 0;
+  size_t n = 0;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (i % 4 == 3)
+      continue;
+    double d = actual[i] - expected[i];
+    error += d * d;
+    worst = std::max(worst, std::fabs(d));
+    ++n;
+  }
+  if (maxError)
+    *maxError = worst;
+  double mse = error / std::max<size_t>(n, 1);
+  return mse == 0 ? 99.0 : 10 * std::log10(255.0 * 255.0 / mse);
+}
+
+} // namespace
+
+// --- Downscaling -------------------------------------------------------------
+
+TEST(DownscaleMatchesTheExactAreaAverage) {
+  // Integer and fractional factors, capture sizes and odd ones
+  struct Case {
+    int width, height, dstWidth, dstHeight;
+  } cases[] = {
+      {640, 360, 320, 180},   {1920, 1080, 1429, 804},
+      {1000, 700, 333, 233},  {2560, 1440, 1429, 804},
+      {257, 129, 100, 100},   {3840, 2160, 1429, 804},
+      {1568, 40, 1567, 39},
+  };
+  for (const Case &c : cases) {
+    Frame f = MakeFrame(c.width, c.height, 17);
+    std::vector<uint8_t> out(static_cast<size_t>(c.dstWidth) * c.dstHeight *
+                             4);
+    ImagePreprocessor preprocessor;
+    preprocessor.Downscale(f.bgra.data(), f.width, f.height, f.stride,
+                           out.data(), c.dstWidth, c.dstHeight,
+                           c.dstWidth * 4);
+    double maxError = 0;
+    double psnr =
+        Psnr(out, ReferenceDownscale(f, c.dstWidth, c.dstHeight), &maxError);
+    std::printf("  %4dx%-4d -> %4dx%-4d: %.1f dB, max error %.2f (%s)\n",
+                c.width, c.height, c.dstWidth, c.dstHeight, psnr, maxError,
+                ImagePreprocessor::HasSimd() ? "SSE2" : "scalar");
+    CHECK_GT(psnr, 55.0);
+    CHECK_LT(maxError, 1.5); // Rounding, never a misplaced weight
+  }
+}
+
+TEST(FlatColoursSurviveDownscaling) {
+  // Weights sum to exactly one, so a uniform image keeps its exact value
+  for (uint8_t value : {0, 1, 128, 254, 255}) {
+    Frame f{301, 211, 301 * 4, {}};
+    f.bgra.assign(static_cast<size_t>(f.stride) * f.height, value);
+    std::vector<uint8_t> out(97 * 61 * 4, 0x55);
+    ImagePreprocessor preprocessor;
+    preprocessor.Downscale(f.bgra.data(), f.width, f.height, f.stride,
+                           out.data(), 97, 61, 97 * 4);
+    CHECK(std::all_of(out.begin(), out.end(),
+                      [&](uint8_t v) { return v == value; }));
+  }
+}
+
+TEST(HalvingAveragesEachBlockOfFour) {
+  Frame f = MakeFrame(64, 48);
+  std::vector<uint8_t> out(32 * 24 * 4);
+  ImagePreprocessor preprocessor;
+  preprocessor.Downscale(f.bgra.data(), 64, 48, f.stride, out.data(), 32, 24,
+                         32 * 4);
+  int off = 0;
+  for (int y = 0; y < 24; ++y) {
+    for (int x = 0; x < 32; ++x) {
+      for (int c = 0; c < 4; ++c) {
+        int sum = f.Pixel(2 * x, 2 * y)[c] + f.Pixel(2 * x + 1, 2 * y)[c] +
+                  f.Pixel(2 * x, 2 * y + 1)[c] +
+                  f.Pixel(2 * x + 1, 2 * y + 1)[c];
+        int got = out[(y * 32 + x) * 4 + c];
+        off += std::abs(got * 4 - sum) > 2; // More than rounding
+      }
+    }
+  }
+  CHECK_EQ(off, 0);
+}
+
+TEST(ScratchIsReusedAcrossSizes) {
+  // One instance, shrinking and growing: every call matches a fresh one
+  ImagePreprocessor shared;
+  for (int size : {400, 120, 900, 64}) {
+    Frame f = MakeFrame(size, size * 3 / 4, 5);
+    int w = size / 3, h = size / 4;
+    std::vector<uint8_t> a(static_cast<size_t>(w) * h * 4);
+    std::vector<uint8_t> b(a.size());
+    shared.Downscale(f.bgra.data(), f.width, f.height, f.stride, a.data(), w,
+                     h, w * 4);
+    ImagePreprocessor fresh;
+    fresh.Downscale(f.bgra.data(), f.width, f.height, f.stride, b.data(), w,
+                    h, w * 4);
+    CHECK(a == b);
+  }
+}
+
+// --- Limits ------------------------------------------------------------------
+
+TEST(FitSizeKeepsTheAspectWithinBothLimits) {
+  int w = 0, h = 0;
+  ImagePreprocessor::FitSize(3840, 2160, 1568, 1150000, w, h);
+  CHECK_LE(std::max(w, h), 1568);
+  CHECK_LE(w * h, 1150000);
+  CHECK_EQ(w, 1429); // The pixel limit binds for 16:9
+  CHECK_EQ(h, 804);
+
+  ImagePreprocessor::FitSize(4000, 500, 1568, 1150000, w, h);
+  CHECK_EQ(w, 1568); // The edge limit binds for a strip
+  CHECK_EQ(h, 196);
+
+  ImagePreprocessor::FitSize(800, 600, 1568, 1150000, w, h);
+  CHECK_EQ(w, 800); // Never enlarged
+  CHECK_EQ(h, 600);
+
+  ImagePreprocessor::FitSize(100000, 3, 1568, 0, w, h);
+  CHECK_EQ(w, 1568);
+  CHECK_EQ(h, 1); // Never below one pixel
+
+  ImagePreprocessor::FitSize(5000, 5000, 0, 0, w, h);
+  CHECK_EQ(w, 5000); // No limits
+}
+
+// --- Process -----------------------------------------------------------------
+
+TEST(BordersAreTrimmedWithAMargin) {
+  Frame f = MakeFrame(600, 400, 50);
+  ImageRect bounds = ImagePreprocessor::FindContentBounds(
+      f.bgra.data(), f.width, f.height, f.stride, 12);
+  CHECK_EQ(bounds.x, 50);
+  CHECK_EQ(bounds.y, 50);
+  CHECK_EQ(bounds.width, 500);
+  CHECK_EQ(bounds.height, 300);
+
+  ImagePreprocessor preprocessor;
+  std::vector<uint8_t> out;
+  int w = 0, h = 0;
+  REQUIRE(preprocessor.Process(f.bgra.data(), f.width, f.height, f.stride, out,
+                               w, h));
+  CHECK_EQ(w, 508); // 4 px kept on each side
+  CHECK_EQ(h, 308);
+  REQUIRE(out.size() == static_cast<size_t>(w) * h * 4);
+  // Cropped only: the bytes are the source's
+  CHECK(memcmp(out.data(), f.Pixel(46, 46), static_cast<size_t>(w) * 4) == 0);
+  CHECK(memcmp(out.data() + static_cast<size_t>(h - 1) * w * 4,
+               f.Pixel(46, 46 + h - 1), static_cast<size_t>(w) * 4) == 0);
+}
+
+TEST(UniformAndSmallFramesAreLeftAlone) {
+  ImagePreprocessor preprocessor;
+  std::vector<uint8_t> out = {1, 2, 3};
+  int w = 7, h = 7;
+
+  // Within limits, and no row or column matches a corner
+  Frame small{320, 200, 320 * 4, std::vector<uint8_t>(320 * 200 * 4)};
+  for (size_t i = 0; i < small.bgra.size(); ++i)
+    small.bgra[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+  CHECK(!preprocessor.Process(small.bgra.data(), small.width, small.height,
+                              small.stride, out, w, h));
+
+  Frame flat{200, 100, 800, std::vector<uint8_t>(800 * 100, 90)};
+  ImageRect bounds = ImagePreprocessor::FindContentBounds(
+      flat.bgra.data(), flat.width, flat.height, flat.stride, 12);
+  CHECK_EQ(bounds.width, 200); // Nothing but background: kept whole
+  CHECK(!preprocessor.Process(flat.bgra.data(), flat.width, flat.height,
+                              flat.stride, out, w, h));
+
+  CHECK(!preprocessor.Process(nullptr, 10, 10, 40, out, w, h));
+  CHECK_EQ(out.size(), 3u); // Untouched
+  CHECK_EQ(w, 7);
+}
+
+TEST(LargeCapturesAreTrimmedThenShrunk) {
+  Frame f = MakeFrame(3840, 2160, 200, 64);
+  ImagePreprocessor preprocessor;
+  std::vector<uint8_t> out;
+  int w = 0, h = 0;
+  REQUIRE(preprocessor.Process(f.bgra.data(), f.width, f.height, f.stride, out,
+                               w, h));
+  int expectedW = 0, expectedH = 0;
+  ImagePreprocessor::FitSize(3448, 1768, 1568, 1150000, expectedW, expectedH);
+  CHECK_EQ(w, expectedW);
+  CHECK_EQ(h, expectedH);
+
+  // The same as downscaling the trimmed region by hand
+  Frame trimmed{3448, 1768, f.stride, {}};
+  trimmed.bgra.assign(f.bgra.begin() + (f.Pixel(196, 196) - f.bgra.data()),
+                      f.bgra.end());
+  double psnr = Psnr(out, ReferenceDownscale(trimmed, w, h));
+  CHECK_GT(psnr, 55.0);
+}
+
+TEST(PaddedStridesGiveTheSameResult) {
+  Frame packed = MakeFrame(500, 300, 9);
+  Frame padded = MakeFrame(500, 300, 9, 52);
+  ImagePreprocessorConfig config;
+  config.maxPixels = 40000;
+  ImagePreprocessor preprocessor(config);
+  std::vector<uint8_t> a, b;
+  int aw = 0, ah = 0, bw = 0, bh = 0;
+  REQUIRE(preprocessor.Process(packed.bgra.data(), 500, 300, packed.stride, a,
+                               aw, ah));
+  REQUIRE(preprocessor.Process(padded.bgra.data(), 500, 300, padded.stride, b,
+                               bw, bh));
+  CHECK_EQ(aw, bw);
+  CHECK_EQ(ah, bh);
+  CHECK(a == b); // The padding bytes never leak in
+}
@@ -0,0 +1,323 @@
+#include "jpeg_decoder.h"
+#include <algorithm>
+#include <cmath>
+
+namespace invisible {
+namespace test {
+
+namespace {
+
+const uint8_t kZigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+struct Huffman {
+  bool defined = false;
+  // Canonical code ranges per length (T.81 F.2.2.3)
+  int maxCode[17];
+  int valueOffset[17];
+  std::vector<uint8_t> values;
+
+  void Build(const uint8_t *bits, const uint8_t *symbols, int count) {
+    values.assign(symbols, symbols + count);
+    int code = 0, k = 0;
+    for (int length = 1; length <= 16; ++length) {
+      valueOffset[length] = k - code;
+      code += bits[length - 1];
+      k += bits[length - 1];
+      maxCode[length] = bits[length - 1] ? code - 1 : -1;
+      code <<= 1;
+    }
+    defined = true;
+  }
+};
+
+struct Component {
+  int id, h, v, quant;
+  int dcTable = 0, acTable = 0;
+  int dcPredictor = 0;
+  int blocksWide = 0, blocksHigh = 0;
+  std::vector<uint8_t> plane; // blocksWide * 8 by blocksHigh * 8
+};
+
+class BitReader {
+public:
+  BitReader(const uint8_t *data, size_t size, size_t pos)
+      : data_(data), size_(size), pos_(pos) {}
+
+  int Bit() {
+    if (count_ == 0) {
+      if (pos_ >= size_)
+        return -1;
+      uint8_t byte = data_[pos_++];
+      if (byte == 0xFF) {
+        uint8_t next = pos_ < size_ ? data_[pos_] : 0;
+        if (next == 0x00)
+          pos_++; // Stuffed byte
+        else
+          return -1; // A marker inside the scan
+      }
+      buffer_ = byte;
+      count_ = 8;
+    }
+    count_--;
+    return (buffer_ >> count_) & 1;
+  }
+
+  int Bits(int n) {
+    int value = 0;
+    for (int i = 0; i < n; ++i) {
+      int bit = Bit();
+      if (bit < 0)
+        return -1;
+      value = (value << 1) | bit;
+    }
+    return value;
+  }
+
+  int Decode(const Huffman &table) {
+    int code = 0;
+    for (int length = 1; length <= 16; ++length) {
+      int bit = Bit();
+      if (bit < 0)
+        return -1;
+      code = (code << 1) | bit;
+      if (code <= table.maxCode[length]) {
+        size_t index = static_cast<size_t>(code + table.valueOffset[length]);
+        return index < table.values.size() ? table.values[index] : -1;
+      }
+    }
+    return -1;
+  }
+
+  // Skip to just after the next RSTn marker
+  bool Restart() {
+    count_ = 0;
+    while (pos_ + 1 < size_) {
+      if (data_[pos_] == 0xFF && data_[pos_ + 1] >= 0xD0 &&
+          data_[pos_ + 1] <= 0xD7) {
+        pos_ += 2;
+        return true;
+      }
+      pos_++;
+    }
+    return false;
+  }
+
+private:
+  const uint8_t *data_;
+  size_t size_;
+  size_t pos_;
+  uint32_t buffer_ = 0;
+  int count_ = 0;
+};
+
+int Extend(int value, int bits) {
+  return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+}
+
+void InverseDct(const int coefficients[64], uint8_t *out, int stride) {
+  static double cosines[8][8];
+  static bool ready = false;
+  if (!ready) {
+    for (int x = 0; x < 8; ++x)
+      for (int u = 0; u < 8; ++u)
+        cosines[x][u] = (u == 0 ? std::sqrt(0.5) : 1.0) *
+                        std::cos((2 * x + 1) * u * 3.14159265358979 / 16);
+    ready = true;
+  }
+  double rows[64];
+  for (int y = 0; y < 8; ++y)
+    for (int u = 0; u < 8; ++u) {
+      double sum = 0;
+      for (int v = 0; v < 8; ++v)
+        sum += cosines[y][v] * coefficients[v * 8 + u];
+      rows[y * 8 + u] = sum / 2;
+    }
+  for (int y = 0; y < 8; ++y)
+    for (int x = 0; x < 8; ++x) {
+      double sum = 0;
+      for (int u = 0; u < 8; ++u)
+        sum += cosines[x][u] * rows[y * 8 + u];
+      int value = static_cast<int>(std::lround(sum / 2 + 128));
+      out[y * stride + x] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+    }
+}
+
+int U16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+} // namespace
+
+bool DecodeJpeg(const uint8_t *data, size_t size, DecodedImage &image) {
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    return false;
+
+  int quant[4][64] = {};
+  Huffman dc[4], ac[4];
+  std::vector<Component> components;
+  int width = 0, height = 0, restartInterval = 0;
+  size_t pos = 2;
+
+  while (pos + 4 <= size) {
+    if (data[pos] != 0xFF)
+      return false;
+    const uint8_t marker = data[pos + 1];
+    const size_t length = static_cast<size_t>(U16(data + pos + 2));
+    const uint8_t *segment = data + pos + 4;
+    if (pos + 2 + length > size || length < 2)
+      return false;
+    const size_t end = pos + 2 + length;
+
+    if (marker == 0xDB) { // DQT
+      for (const uint8_t *p = segment; p < data + end; p += 65) {
+        if ((p[0] >> 4) != 0 || (p[0] & 15) > 3)
+          return false; // 16-bit tables are not baseline
+        for (int k = 0; k < 64; ++k)
+          quant[p[0] & 15][kZigzag[k]] = p[1 + k];
+      }
+    } else if (marker == 0xC4) { // DHT
+      for (const uint8_t *p = segment; p < data + end;) {
+        int count = 0;
+        for (int i = 0; i < 16; ++i)
+          count += p[1 + i];
+        Huffman &table = (p[0] >> 4) ? ac[p[0] & 3] : dc[p[0] & 3];
+        table.Build(p + 1, p + 17, count);
+        p += 17 + count;
+      }
+    } else if (marker == 0xC0) { // SOF0
+      if (segment[0] != 8)
+        return false;
+      height = U16(segment + 1);
+      width = U16(segment + 3);
+      for (int i = 0; i < segment[5]; ++i) {
+        const uint8_t *c = segment + 6 + i * 3;
+        components.push_back(Component{c[0], c[1] >> 4, c[1] & 15, c[2]});
+      }
+    } else if (marker >= 0xC1 && marker <= 0xCF && marker != 0xC4 &&
+               marker != 0xC8 && marker != 0xCC) {
+      return false; // Progressive, lossless, arithmetic...
+    } else if (marker == 0xDD) { // DRI
+      restartInterval = U16(segment);
+    } else if (marker == 0xDA) { // SOS
+      if (components.empty() || width <= 0 || height <= 0)
+        return false;
+      const int scanCount = segment[0];
+      if (scanCount != static_cast<int>(components.size()))
+        return false; // Only interleaved single scans
+      for (int i = 0; i < scanCount; ++i) {
+        const uint8_t *s = segment + 1 + i * 2;
+        for (Component &c : components) {
+          if (c.id == s[0]) {
+            c.dcTable = s[1] >> 4;
+            c.acTable = s[1] & 15;
+          }
+        }
+      }
+
+      int hMax = 1, vMax = 1;
+      for (const Component &c : components) {
+        hMax = std::max(hMax, c.h);
+        vMax = std::max(vMax, c.v);
+      }
+      const int mcusWide = (width + 8 * hMax - 1) / (8 * hMax);
+      const int mcusHigh = (height + 8 * vMax - 1) / (8 * vMax);
+      for (Component &c : components) {
+        c.blocksWide = mcusWide * c.h;
+        c.blocksHigh = mcusHigh * c.v;
+        c.plane.assign(static_cast<size_t>(c.blocksWide) * c.blocksHigh * 64,
+                       0);
+      }
+
+      BitReader reader(data, size, end);
+      int coefficients[64];
+      for (int mcu = 0; mcu < mcusWide * mcusHigh; ++mcu) {
+        if (restartInterval && mcu > 0 && mcu % restartInterval == 0) {
+          if (!reader.Restart())
+            return false;
+          for (Component &c : components)
+            c.dcPredictor = 0;
+        }
+        const int mcuX = mcu % mcusWide, mcuY = mcu / mcusWide;
+        for (Component &c : components) {
+          if (!dc[c.dcTable].defined || !ac[c.acTable].defined)
+            return false;
+          for (int by = 0; by < c.v; ++by) {
+            for (int bx = 0; bx < c.h; ++bx) {
+              std::fill(coefficients, coefficients + 64, 0);
+              int bits = reader.Decode(dc[c.dcTable]);
+              if (bits < 0)
+                return false;
+              int diff = 0;
+              if (bits > 0) {
+                int raw = reader.Bits(bits);
+                if (raw < 0)
+                  return false;
+                diff = Extend(raw, bits);
+              }
+              c.dcPredictor += diff;
+              coefficients[0] = c.dcPredictor * quant[c.quant][0];
+              for (int k = 1; k < 64;) {
+                int symbol = reader.Decode(ac[c.acTable]);
+                if (symbol < 0)
+                  return false;
+                int run = symbol >> 4, magnitude = symbol & 15;
+                if (magnitude == 0) {
+                  if (run != 15)
+                    break; // EOB
+                  k += 16;  // ZRL
+                  continue;
+                }
+                k += run;
+                int raw = reader.Bits(magnitude);
+                if (k > 63 || raw < 0)
+                  return false;
+                coefficients[kZigzag[k]] =
+                    Extend(raw, magnitude) * quant[c.quant][kZigzag[k]];
+                k++;
+              }
+              const int blockX = mcuX * c.h + bx, blockY = mcuY * c.v + by;
+              const int stride = c.blocksWide * 8;
+              InverseDct(coefficients,
+                         c.plane.data() +
+                             static_cast<size_t>(blockY) * 8 * stride +
+                             blockX * 8,
+                         stride);
+            }
+          }
+        }
+      }
+
+      // Colour conversion, chroma sampled at the nearest position
+      image.width = width;
+      image.height = height;
+      image.rgb.assign(static_cast<size_t>(width) * height * 3, 0);
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+          double sample[3] = {0, 128, 128};
+          for (size_t i = 0; i < components.size() && i < 3; ++i) {
+            const Component &c = components[i];
+            int sx = x * c.h / hMax, sy = y * c.v / vMax;
+            sample[i] = c.plane[static_cast<size_t>(sy) * c.blocksWide * 8 +
+                                sx];
+          }
+          double yy = sample[0], cb = sample[1] - 128, cr = sample[2] - 128;
+          double rgb[3] = {yy + 1.402 * cr, yy - 0.344136 * cb - 0.714136 * cr,
+                           yy + 1.772 * cb};
+          uint8_t *out = image.rgb.data() +
+                         (static_cast<size_t>(y) * width + x) * 3;
+          for (int i = 0; i < 3; ++i)
+            out[i] = static_cast<uint8_t>(
+                std::clamp(static_cast<int>(std::lround(rgb[i])), 0, 255));
+        }
+      }
+      return true;
+    }
+    pos = end;
+  }
+  return false;
+}
+
+} // namespace test
+} // namespace invisible
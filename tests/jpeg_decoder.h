@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// Baseline JPEG Decoder (test support)
+// Decodes what JpegEncoder writes (and other plain baseline JFIF files):
+// Huffman-coded 8-bit YCbCr or grayscale, any sampling factors, restart
+// markers. Written for checking the encoder, so it favours being obviously
+// right over being fast: a float IDCT and nearest-neighbour chroma.
+// -----------------------------------------------------------------------------
+
+struct DecodedImage {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> rgb; // Top-down, 3 bytes per pixel
+};
+
+// False if the data is not a baseline JPEG this decoder understands
+bool DecodeJpeg(const uint8_t *data, size_t size, DecodedImage &image);
+
+} // namespace test
+} // namespace invisible
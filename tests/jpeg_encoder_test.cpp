@@ -0,0 +1,140 @@
+#include "jpeg_decoder.h"
+#include "jpeg_encoder.h"
+#include "test.h"
+#include <cmath>
+
+using namespace invisible;
+
+namespace {
+
+// A screen-like test card: smooth gradients, flat panels and dark text-like
+// strokes, in BGRA with `padding` spare bytes at the end of every row
+struct Picture {
+  int width, height, stride;
+  std::vector<uint8_t> bgra;
+};
+
+Picture MakePicture(int width, int height, int padding = 0) {
+  Picture p{width, height, width * 4 + padding, {}};
+  p.bgra.assign(static_cast<size_t>(p.stride) * height, 0xAB);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint8_t *px = p.bgra.data() + static_cast<size_t>(y) * p.stride + x * 4;
+      int r = x * 255 / std::max(width - 1, 1);
+      int g = y * 255 / std::max(height - 1, 1);
+      int b = 160;
+      if (x > width / 2 && y > height / 2) // Flat panel
+        r = g = b = 240;
+      if ((y / 4) % 5 == 0 && (x / 3) % 4 != 0) // Strokes
+        r = g = b = 30;
+      px[0] = static_cast<uint8_t>(b);
+      px[1] = static_cast<uint8_t>(g);
+      px[2] = static_cast<uint8_t>(r);
+      px[3] = 255;
+    }
+  }
+  return p;
+}
+
+// PSNR over RGB, or over luma alone: 4:2:0 halves the chroma resolution on
+// purpose, so its colour error says nothing about the encoder being right
+double Psnr(const Picture &p, const test::DecodedImage &image, bool luma) {
+  double error = 0;
+  for (int y = 0; y < p.height; ++y) {
+    for (int x = 0; x < p.width; ++x) {
+      const uint8_t *a = p.bgra.data() + static_cast<size_t>(y) * p.stride +
+                         x * 4;
+      const uint8_t *b = image.rgb.data() +
+                         (static_cast<size_t>(y) * image.width + x) * 3;
+      if (luma) {
+        double d = (0.299 * a[2] + 0.587 * a[1] + 0.114 * a[0]) -
+                   (0.299 * b[0] + 0.587 * b[1] + 0.114 * b[2]);
+        error += d * d * 3;
+        continue;
+      }
+      for (int c = 0; c < 3; ++c) {
+        double d = static_cast<double>(a[2 - c]) - b[c];
+        error += d * d;
+      }
+    }
+  }
+  double mse = error / (3.0 * p.width * p.height);
+  return mse == 0 ? 99.0 : 10 * std::log10(255.0 * 255.0 / mse);
+}
+
+double RoundTrip(const Picture &p, const JpegEncoderConfig &config,
+                 size_t *bytes = nullptr) {
+  std::vector<uint8_t> jpeg;
+  JpegEncoder encoder(config);
+  if (!encoder.EncodeBgra(p.bgra.data(), p.width, p.height, p.stride, jpeg))
+    return 0;
+  if (bytes)
+    *bytes = jpeg.size();
+  test::DecodedImage image;
+  if (!test::DecodeJpeg(jpeg.data(), jpeg.size(), image) ||
+      image.width != p.width || image.height != p.height)
+    return 0;
+  return Psnr(p, image, config.chromaSubsampling);
+}
+
+} // namespace
+
+TEST(DecodesWithBothSamplingModes) {
+  Picture p = MakePicture(96, 64);
+  JpegEncoderConfig config;
+  config.quality = 90;
+  config.chromaSubsampling = false;
+  CHECK_GT(RoundTrip(p, config), 36.0);
+  config.chromaSubsampling = true;
+  CHECK_GT(RoundTrip(p, config), 30.0);
+}
+
+TEST(HandlesSizesThatAreNotWholeBlocks) {
+  for (int size : {1, 7, 9, 17, 33}) {
+    Picture p = MakePicture(size, size + 3, 12);
+    JpegEncoderConfig config;
+    config.quality = 95;
+    CHECK_GT(RoundTrip(p, config), 28.0);
+    config.chromaSubsampling = false;
+    CHECK_GT(RoundTrip(p, config), 30.0);
+  }
+}
+
+TEST(QualityTradesSizeForFidelity) {
+  Picture p = MakePicture(128, 96);
+  JpegEncoderConfig config;
+  size_t small = 0, large = 0;
+  config.quality = 30;
+  double low = RoundTrip(p, config, &small);
+  config.quality = 95;
+  double high = RoundTrip(p, config, &large);
+  CHECK_GT(low, 24.0);
+  CHECK_GT(high, low + 3.0);
+  CHECK_GT(large, small);
+}
+
+TEST(OutputIsAppendedAndDeterministic) {
+  Picture p = MakePicture(40, 24);
+  JpegEncoder encoder;
+  std::vector<uint8_t> first = {1, 2, 3}, second;
+  REQUIRE(encoder.EncodeBgra(p.bgra.data(), p.width, p.height, p.stride,
+                             first));
+  REQUIRE(encoder.EncodeBgra(p.bgra.data(), p.width, p.height, p.stride,
+                             second));
+  REQUIRE(first.size() == second.size() + 3);
+  CHECK(std::equal(second.begin(), second.end(), first.begin() + 3));
+  CHECK_EQ(second[0], 0xFF);
+  CHECK_EQ(second[1], 0xD8);
+  CHECK_EQ(second[second.size() - 2], 0xFF);
+  CHECK_EQ(second.back(), 0xD9);
+}
+
+TEST(RejectsBadInput) {
+  JpegEncoder encoder;
+  std::vector<uint8_t> out;
+  uint8_t pixel[4] = {};
+  CHECK(!encoder.EncodeBgra(nullptr, 1, 1, 4, out));
+  CHECK(!encoder.EncodeBgra(pixel, 0, 1, 4, out));
+  CHECK(!encoder.EncodeBgra(pixel, 2, 1, 4, out)); // Stride too short
+  CHECK(out.empty());
+}
@@ -0,0 +1,230 @@
+#include "bench.h"
+#include "json.h"
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+
+// The JSON layer against the code it replaced in ai_service.cpp: pulling
+// the answer out of a chat response (string search versus path lookup),
+// walking a whole response token by token, and escaping a long transcript
+// into a request (ostringstream versus JsonWriter).
+
+using namespace invisible;
+
+namespace {
+
+// --- The replaced code, as it was -------------------------------------------
+
+std::string OldEscapeJson(const std::string &str) {
+  std::ostringstream escaped;
+  for (char c : str) {
+    switch (c) {
+    case '"':
+      escaped << "\\\"";
+      break;
+    case '\\':
+      escaped << "\\\\";
+      break;
+    case '\b':
+      escaped << "\\b";
+      break;
+    case '\f':
+      escaped << "\\f";
+      break;
+    case '\n':
+      escaped << "\\n";
+      break;
+    case '\r':
+      escaped << "\\r";
+      break;
+    case '\t':
+      escaped << "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                << (int)c;
+      } else {
+        escaped << c;
+      }
+    }
+  }
+  return escaped.str();
+}
+
+// find("\"content\":") and a hand-written unescape loop (\u handling
+// trimmed; the inputs here have none in the answer)
+std::string OldParseChatResponse(const std::string &response) {
+  size_t contentPos = response.find("\"content\":");
+  if (contentPos == std::string::npos)
+    return "";
+  size_t start = response.find('"', contentPos + 10) + 1;
+  std::string result;
+  bool escaped = false;
+  for (size_t i = start; i < response.length(); ++i) {
+    char c = response[i];
+    if (escaped) {
+      switch (c) {
+      case 'n':
+        result += '\n';
+        break;
+      case 'r':
+        result += '\r';
+        break;
+      case 't':
+        result += '\t';
+        break;
+      default:
+        result += c;
+      }
+      escaped = false;
+    } else if (c == '\\') {
+      escaped = true;
+    } else if (c == '"') {
+      break;
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+// --- Inputs -----------------------------------------------------------------
+
+std::string Words(size_t bytes, std::mt19937 &rng) {
+  static const char *const kWords[] = {
+      "the",  "quarterly", "roadmap", "\"beta\"", "ship",  "August",
+      "we",   "need",      "a",       "plan",     "for",   "latency",
+      "C:\\", "tests",     "and",     "review",   "path/", "line\n"};
+  std::string text;
+  while (text.size() < bytes) {
+    text += kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))];
+    text += ' ';
+  }
+  return text;
+}
+
+// A chat completion in the API's field order, with the per-token logprobs
+// (whose array is also keyed "content") after the message
+std::string ChatResponse(size_t logprobTokens, std::mt19937 &rng) {
+  std::string out;
+  JsonWriter w(out);
+  w.BeginObject();
+  w.Key("id");
+  w.String("chatcmpl-bench");
+  w.Key("choices");
+  w.BeginArray();
+  w.BeginObject();
+  w.Key("index");
+  w.Int(0);
+  w.Key("message");
+  w.BeginObject();
+  w.Key("role");
+  w.String("assistant");
+  w.Key("content");
+  w.String(Words(2000, rng));
+  w.EndObject();
+  w.Key("logprobs");
+  w.BeginObject();
+  w.Key("content");
+  w.BeginArray();
+  for (size_t i = 0; i < logprobTokens; ++i) {
+    w.BeginObject();
+    w.Key("token");
+    w.String(Words(6, rng));
+    w.Key("logprob");
+    w.Double(-0.001 * (rng() % 5000));
+    w.EndObject();
+  }
+  w.EndArray();
+  w.EndObject();
+  w.EndObject();
+  w.EndArray();
+  w.EndObject();
+  return out;
+}
+
+} // namespace
+
+int main() {
+  const int runs = bench::Runs(5);
+  std::mt19937 rng(7);
+
+  // --- Response parsing ---
+  std::string response = ChatResponse(1000, rng);
+  const int reps = 200;
+  const double mb = response.size() * reps / 1e6;
+  std::printf("chat response, %zu KB with logprobs, best of %d\n",
+              response.size() >> 10, runs);
+
+  std::string answer;
+  double old = bench::BestOf(runs, [&] {
+    for (int i = 0; i < reps; ++i) {
+      answer = OldParseChatResponse(response);
+      bench::Consume(answer);
+    }
+  });
+  // Both lookups stop at the message, so these are per call, not MB/s
+  const double us = 1e6 / reps;
+  std::printf("  %-22s %7.2f us/call\n", "old find(\"content\")", old * us);
+
+  double path = bench::BestOf(runs, [&] {
+    for (int i = 0; i < reps; ++i) {
+      JsonGetString(response, {"choices", 0, "message", "content"}, answer);
+      bench::Consume(answer);
+    }
+  });
+  std::printf("  %-22s %7.2f us/call  (%.1fx old)\n", "JsonGetString",
+              path * us, old / path);
+
+  size_t tokens = 0;
+  double walk = bench::BestOf(runs, [&] {
+    for (int i = 0; i < reps; ++i) {
+      JsonReader reader(response);
+      for (JsonToken t = reader.Next();
+           t != JsonToken::End && t != JsonToken::Error; t = reader.Next()) {
+        if (t == JsonToken::String || t == JsonToken::Key)
+          bench::Consume(reader.GetString());
+        ++tokens;
+      }
+    }
+  });
+  std::printf("  %-22s %7.0f MB/s     (%zu tokens)\n", "full token walk",
+              mb / walk, tokens / (reps * static_cast<size_t>(runs)));
+
+  // Both stop at the message; a "content" key anywhere earlier (a tool
+  // call, an echoed prompt) sends the old search to the wrong string
+  std::string correct;
+  JsonGetString(response, {"choices", 0, "message", "content"}, correct);
+  std::printf("  old parser's answer is %s\n",
+              OldParseChatResponse(response) == correct ? "correct"
+                                                        : "WRONG");
+
+  // --- Request escaping ---
+  std::string transcript = Words(80 * 1024, rng);
+  const double tmb = transcript.size() * reps / 1e6;
+  std::printf("escaping an %zu KB transcript, best of %d\n",
+              transcript.size() >> 10, runs);
+
+  double oldEscape = bench::BestOf(runs, [&] {
+    for (int i = 0; i < reps; ++i) {
+      std::string body = "\"" + OldEscapeJson(transcript) + "\"";
+      bench::Consume(body);
+    }
+  });
+  std::printf("  %-22s %7.0f MB/s\n", "old ostringstream", tmb / oldEscape);
+
+  std::string body;
+  double writer = bench::BestOf(runs, [&] {
+    for (int i = 0; i < reps; ++i) {
+      body.clear();
+      JsonWriter w(body);
+      w.String(transcript);
+      bench::Consume(body);
+    }
+  });
+  std::printf("  %-22s %7.0f MB/s  (%.1fx old)\n", "JsonWriter", tmb / writer,
+              oldEscape / writer);
+  return 0;
+}
@@ -0,0 +1,313 @@
+#include "json.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Fuzz target for the JSON layer (libFuzzer entry point; fuzz_main.cpp
+// drives it where libFuzzer is unavailable). For every input:
+//   - JsonReader's valid/invalid verdict must match a deliberately naive
+//     recursive-descent validator of the same grammar (RFC 8259, depth
+//     limit MAX_DEPTH, bytes >= 0x80 passed through unchecked)
+//   - a valid document re-serialized through JsonWriter must read back as
+//     the same token stream, strings byte for byte
+//   - SkipValue() on the root must land exactly on End
+//   - JsonGetString() must not misbehave on any path
+
+using namespace invisible;
+
+namespace {
+
+[[noreturn]] void Abort(const char *what, const uint8_t *data, size_t size) {
+  std::fprintf(stderr, "json_fuzz: %s\ninput (%zu bytes): ", what, size);
+  std::fwrite(data, 1, size, stderr);
+  std::fprintf(stderr, "\n");
+  std::abort();
+}
+
+// --- Reference validator -----------------------------------------------------
+
+class Reference {
+public:
+  explicit Reference(std::string_view text) : s_(text) {}
+
+  bool Valid() {
+    SkipSpace();
+    if (!Value(0))
+      return false;
+    SkipSpace();
+    return i_ == s_.size();
+  }
+
+private:
+  bool At(char c) const { return i_ < s_.size() && s_[i_] == c; }
+  bool Digit() const {
+    return i_ < s_.size() && s_[i_] >= '0' && s_[i_] <= '9';
+  }
+
+  void SkipSpace() {
+    while (At(' ') || At('\t') || At('\n') || At('\r'))
+      ++i_;
+  }
+
+  bool Value(size_t depth) {
+    if (i_ >= s_.size())
+      return false;
+    switch (s_[i_]) {
+    case '{':
+      return depth < JsonReader::MAX_DEPTH && Object(depth + 1);
+    case '[':
+      return depth < JsonReader::MAX_DEPTH && Array(depth + 1);
+    case '"':
+      return String();
+    case 't':
+      return Word("true");
+    case 'f':
+      return Word("false");
+    case 'n':
+      return Word("null");
+    default:
+      return Number();
+    }
+  }
+
+  bool Object(size_t depth) {
+    ++i_;
+    SkipSpace();
+    if (At('}')) {
+      ++i_;
+      return true;
+    }
+    for (;;) {
+      SkipSpace();
+      if (!At('"') || !String())
+        return false;
+      SkipSpace();
+      if (!At(':'))
+        return false;
+      ++i_;
+      SkipSpace();
+      if (!Value(depth))
+        return false;
+      SkipSpace();
+      if (At('}')) {
+        ++i_;
+        return true;
+      }
+      if (!At(','))
+        return false;
+      ++i_;
+    }
+  }
+
+  bool Array(size_t depth) {
+    ++i_;
+    SkipSpace();
+    if (At(']')) {
+      ++i_;
+      return true;
+    }
+    for (;;) {
+      SkipSpace();
+      if (!Value(depth))
+        return false;
+      SkipSpace();
+      if (At(']')) {
+        ++i_;
+        return true;
+      }
+      if (!At(','))
+        return false;
+      ++i_;
+    }
+  }
+
+  bool String() {
+    ++i_;
+    while (i_ < s_.size()) {
+      unsigned char c = static_cast<unsigned char>(s_[i_++]);
+      if (c == '"')
+        return true;
+      if (c < 0x20)
+        return false;
+      if (c != '\\')
+        continue;
+      if (i_ >= s_.size())
+        return false;
+      char e = s_[i_++];
+      if (e == 'u') {
+        for (int k = 0; k < 4; ++k, ++i_) {
+          if (i_ >= s_.size() ||
+              !std::isxdigit(static_cast<unsigned char>(s_[i_])))
+            return false;
+        }
+      } else if (std::string_view("\"\\/bfnrt").find(e) ==
+                 std::string_view::npos) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  bool Word(const char *word) {
+    std::string_view w(word);
+    if (s_.substr(i_, w.size()) != w)
+      return false;
+    i_ += w.size();
+    return true;
+  }
+
+  bool Number() {
+    if (At('-'))
+      ++i_;
+    if (At('0')) {
+      ++i_;
+    } else if (Digit()) {
+      while (Digit())
+        ++i_;
+    } else {
+      return false;
+    }
+    if (At('.')) {
+      ++i_;
+      if (!Digit())
+        return false;
+      while (Digit())
+        ++i_;
+    }
+    if (At('e') || At('E')) {
+      ++i_;
+      if (At('+') || At('-'))
+        ++i_;
+      if (!Digit())
+        return false;
+      while (Digit())
+        ++i_;
+    }
+    return true;
+  }
+
+  std::string_view s_;
+  size_t i_ = 0;
+};
+
+// --- Token stream ------------------------------------------------------------
+
+struct Token {
+  JsonToken type;
+  std::string text; // Key/String bytes
+  double number = 0;
+};
+
+// Pull every token; true when the document ended cleanly
+bool ReadAll(std::string_view text, std::vector<Token> &tokens) {
+  JsonReader reader(text);
+  for (;;) {
+    JsonToken type = reader.Next();
+    if (reader.GetDepth() > JsonReader::MAX_DEPTH ||
+        reader.GetOffset() > text.size())
+      return false;
+    if (type == JsonToken::End)
+      return true;
+    if (type == JsonToken::Error)
+      return false;
+    Token token{type, {}, 0};
+    if (type == JsonToken::Key || type == JsonToken::String)
+      token.text.assign(reader.GetString());
+    if (type == JsonToken::Number)
+      token.number = reader.GetNumber();
+    tokens.push_back(std::move(token));
+  }
+}
+
+std::string Rewrite(const std::vector<Token> &tokens) {
+  std::string out;
+  JsonWriter writer(out);
+  for (const Token &token : tokens) {
+    switch (token.type) {
+    case JsonToken::BeginObject:
+      writer.BeginObject();
+      break;
+    case JsonToken::EndObject:
+      writer.EndObject();
+      break;
+    case JsonToken::BeginArray:
+      writer.BeginArray();
+      break;
+    case JsonToken::EndArray:
+      writer.EndArray();
+      break;
+    case JsonToken::Key:
+      writer.Key(token.text);
+      break;
+    case JsonToken::String:
+      writer.String(token.text);
+      break;
+    case JsonToken::Number:
+      writer.Double(token.number, 17);
+      break;
+    case JsonToken::True:
+      writer.Bool(true);
+      break;
+    case JsonToken::False:
+      writer.Bool(false);
+      break;
+    default:
+      writer.Null();
+      break;
+    }
+  }
+  return out;
+}
+
+bool SameTokens(const std::vector<Token> &a, const std::vector<Token> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    // Out-of-range numbers are written as null (JSON has no infinity)
+    if (a[i].type == JsonToken::Number && !std::isfinite(a[i].number)) {
+      if (b[i].type != JsonToken::Null)
+        return false;
+      continue;
+    }
+    if (a[i].type != b[i].type || a[i].text != b[i].text ||
+        a[i].number != b[i].number)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  std::string_view text(reinterpret_cast<const char *>(data), size);
+
+  std::vector<Token> tokens;
+  bool valid = ReadAll(text, tokens);
+  if (valid != Reference(text).Valid())
+    Abort(valid ? "reader accepted an invalid document"
+                : "reader rejected a valid document",
+          data, size);
+
+  if (valid) {
+    std::string rewritten = Rewrite(tokens);
+    std::vector<Token> again;
+    if (!ReadAll(rewritten, again) || !SameTokens(tokens, again))
+      Abort("re-serialized document reads back differently", data, size);
+
+    JsonReader reader(text);
+    if (!reader.SkipValue(reader.Next()) || reader.Next() != JsonToken::End)
+      Abort("SkipValue did not consume the document", data, size);
+  }
+
+  // The paths the API responses are read with
+  std::string value;
+  JsonGetString(text, {"choices", 0, "message", "content"}, value);
+  JsonGetString(text, {"choices", 0, "delta", "content"}, value);
+  JsonGetString(text, {"error", "message"}, value);
+  JsonGetString(text, {"text"}, value);
+  JsonGetString(text, {1, 0}, value);
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include "http_client.h"
+#include "stub_server.h"
+#include "test.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// HttpClient's keep-alive pool over the socket transport, counting the TCP
+// handshakes a loopback server actually accepts.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+
+namespace {
+
+// "ok" for every request; "/close" answers with Connection: close, "/big"
+// with a 1 MB body
+std::unique_ptr<StubServer> Server() {
+  return StubServer::Http([](const StubRequest &request,
+                             StubConnection &connection) {
+    if (request.path == "/close") {
+      connection.Write(test::StubResponse(200, "ok", "Connection: close\r\n"));
+      return false;
+    }
+    if (request.path == "/big") {
+      return connection.Write(
+          test::StubResponse(200, std::string(1 << 20, 'x')));
+    }
+    return connection.Write(test::StubResponse(200, "ok"));
+  });
+}
+
+HttpClientConfig Config(size_t maxPerHost = 6, uint32_t idleMs = 50000) {
+  HttpClientConfig config;
+  config.maxConnectionsPerHost = maxPerHost;
+  config.idleConnectionTimeoutMs = idleMs;
+  return config;
+}
+
+} // namespace
+
+TEST(SequentialRequestsShareOneHandshake) {
+  auto server = Server();
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+
+  for (int i = 0; i < 20; ++i) {
+    HttpResponse response = client.Get(server->WideUrl("/"));
+    CHECK_EQ(response.statusCode, 200);
+    CHECK_EQ(response.body, std::string("ok"));
+  }
+  CHECK_EQ(server->Connections(), 1u);
+  CHECK_EQ(server->Requests(), 20u);
+  ConnectionPoolStats stats = client.GetPoolStats();
+  CHECK_EQ(stats.opened, 1u);
+  CHECK_EQ(stats.hits, 19u);
+}
+
+TEST(ConcurrentRequestsStayWithinTheLimit) {
+  auto server = Server();
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config(4)));
+
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 10; ++i) {
+        if (client.PostJson(server->WideUrl("/"), "{}").statusCode != 200)
+          ++failures;
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  CHECK_EQ(failures.load(), 0);
+  CHECK_EQ(server->Requests(), 80u);
+  CHECK_LE(server->Connections(), 4u);
+  CHECK_EQ(client.GetPoolStats().opened, server->Connections());
+}
+
+TEST(IdleConnectionsAreNotReused) {
+  auto server = Server();
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config(6, 50)));
+
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(server->Connections(), 1u);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(server->Connections(), 2u);
+  CHECK_EQ(client.GetPoolStats().evicted, 1u);
+}
+
+TEST(ServerCloseMeansANewConnection) {
+  auto server = Server();
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+
+  CHECK_EQ(client.Get(server->WideUrl("/close")).statusCode, 200);
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(server->Connections(), 2u);
+  CHECK_EQ(client.GetPoolStats().discarded, 1u);
+}
+
+TEST(UnreadBodiesAreNotReused) {
+  auto server = Server();
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize(Config()));
+
+  // Stop after the first slice of a 1 MB body: the rest is still in
+  // flight, so the connection cannot carry another request
+  HttpResponse response = client.PostJsonStreaming(
+      server->WideUrl("/big"), "{}", {},
+      [](const char *, size_t) { return false; });
+  CHECK(response.error == L"Cancelled");
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(server->Connections(), 2u);
+
+  CHECK_EQ(client.Get(server->WideUrl("/big")).body.size(), 1u << 20);
+  CHECK_EQ(client.Get(server->WideUrl("/")).statusCode, 200);
+  CHECK_EQ(server->Connections(), 2u);
+}
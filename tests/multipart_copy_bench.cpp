@@ -0,0 +1,154 @@
+#include "alloc_counter.h"
+#include "bench.h"
+#include "http_client.h"
+#include "socket_transport.h"
+#include "stub_server.h"
+#include <cstring>
+#include <map>
+
+// Heap bytes per transcription upload, counted on the uploading thread
+// (alloc_counter.cpp), for the path the app used to take (the PCM copied
+// into a WAV buffer, then every part joined into one body) and for
+// PostMultipart with the WAV header and the caller's PCM as body pieces.
+// Both send to a loopback server; the upload rate is shown alongside.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+
+namespace {
+
+struct Counted {
+  size_t bytes = 0;
+  size_t allocations = 0;
+  double seconds = 0;
+  bool ok = true;
+};
+
+template <typename Fn> Counted Count(int runs, Fn &&fn) {
+  Counted counted;
+  test::AllocationCounter counter;
+  counted.seconds = bench::BestOf(runs, [&] {
+    counter.Start();
+    counted.ok = fn() && counted.ok;
+    counter.Stop();
+  });
+  counted.bytes = counter.Bytes(); // Last run; every run allocates the same
+  counted.allocations = counter.Count();
+  return counted;
+}
+
+const std::map<std::string, std::string> kFields = {
+    {"model", "whisper-large-v3-turbo"}, {"language", "en"}};
+
+std::string WavHeader(size_t dataSize) {
+  std::string header(44, '\0');
+  auto put32 = [&](size_t at, uint32_t v) { std::memcpy(&header[at], &v, 4); };
+  auto put16 = [&](size_t at, uint16_t v) { std::memcpy(&header[at], &v, 2); };
+  std::memcpy(&header[0], "RIFF", 4);
+  put32(4, static_cast<uint32_t>(36 + dataSize));
+  std::memcpy(&header[8], "WAVEfmt ", 8);
+  put32(16, 16);
+  put16(20, 1);
+  put16(22, 1);
+  put32(24, 16000);
+  put32(28, 32000);
+  put16(32, 2);
+  put16(34, 16);
+  std::memcpy(&header[36], "data", 4);
+  put32(40, static_cast<uint32_t>(dataSize));
+  return header;
+}
+
+// The replaced path as it was: ConvertToWav's reserved copy, then the
+// multipart body joined in a vector grown by insert()
+bool JoinedUpload(SocketTransport &transport, const StubServer &server,
+                  const std::vector<uint8_t> &pcm) {
+  std::string header = WavHeader(pcm.size());
+  std::vector<uint8_t> wav;
+  wav.reserve(header.size() + pcm.size());
+  wav.insert(wav.end(), header.begin(), header.end());
+  wav.insert(wav.end(), pcm.begin(), pcm.end());
+
+  std::string boundary = "----InvisibleOverlayBoundary1234567890";
+  std::vector<uint8_t> body;
+  auto add = [&](const std::string &text) {
+    body.insert(body.end(), text.begin(), text.end());
+  };
+  for (const auto &field : kFields) {
+    add("--" + boundary + "\r\n");
+    add("Content-Disposition: form-data; name=\"" + field.first +
+        "\"\r\n\r\n");
+    add(field.second + "\r\n");
+  }
+  add("--" + boundary + "\r\n");
+  add("Content-Disposition: form-data; name=\"file\"; "
+      "filename=\"audio.wav\"\r\n");
+  add("Content-Type: audio/wav\r\n\r\n");
+  body.insert(body.end(), wav.begin(), wav.end());
+  add("\r\n--" + boundary + "--\r\n");
+
+  HttpRequest request;
+  request.method = "POST";
+  ParseHttpUrl(server.Url("/v1/audio/transcriptions"), request.url);
+  request.headers.push_back(
+      {"Content-Type", "multipart/form-data; boundary=" + boundary});
+  request.body.Append(body.data(), body.size());
+  return transport.Send(request, nullptr).statusCode == 200;
+}
+
+// Today's path: header and PCM as pieces of the file part
+bool PieceUpload(HttpClient &client, const StubServer &server,
+                 const std::vector<uint8_t> &pcm) {
+  HttpBody file;
+  file.Append(WavHeader(pcm.size()));
+  file.Append(pcm.data(), pcm.size());
+  return client
+             .PostMultipart(server.WideUrl("/v1/audio/transcriptions"),
+                            kFields, "audio.wav", "file", std::move(file),
+                            "audio/wav")
+             .statusCode == 200;
+}
+
+void Row(const char *name, size_t fileBytes, const Counted &counted) {
+  std::printf("  %-16s %10.1f KB %6.2fx %6zu allocs %8.0f uploads/s%s\n",
+              name, counted.bytes / 1024.0,
+              static_cast<double>(counted.bytes) / fileBytes,
+              counted.allocations, 1 / counted.seconds,
+              counted.ok ? "" : "  (FAILED)");
+}
+
+} // namespace
+
+int main() {
+  const int runs = bench::Runs(7);
+  auto server = StubServer::Http(
+      [](const StubRequest &, StubConnection &connection) {
+        return connection.Write(test::StubResponse(200, "{\"text\":\"\"}"));
+      });
+  if (!server->IsListening()) {
+    std::printf("cannot listen on loopback\n");
+    return 1;
+  }
+
+  SocketTransport transport;
+  transport.Initialize(HttpTransportConfig());
+  HttpClient client;
+  client.Initialize();
+
+  std::printf("heap allocated per upload on the sending thread, best of %d\n",
+              runs);
+  for (double seconds : {7.5, 15.0, 150.0}) {
+    std::vector<uint8_t> pcm(static_cast<size_t>(seconds * 32000), 0x2A);
+    std::printf("%.1f s of 16 kHz mono (%zu KB)\n", seconds,
+                pcm.size() >> 10);
+    Row("joined (old)", pcm.size(), Count(runs, [&] {
+          return JoinedUpload(transport, *server, pcm);
+        }));
+    Row("pieces (now)", pcm.size(), Count(runs, [&] {
+          return PieceUpload(client, *server, pcm);
+        }));
+  }
+  return 0;
+}
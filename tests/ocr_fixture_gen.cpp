@@ -0,0 +1,72 @@
+#include "glyph_font.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// Writes the glyph font fixtures under tests/data/ocr from a font file:
+//
+//   ocr_fixture_gen <font.ttf> <name> <out dir> <pixel size>...
+//
+// Glyphs are rendered by FreeType with its default (light) hinting and
+// grayscale antialiasing, which is close to what ClearType-free screens
+// show. Only built when CMake finds FreeType; the fixtures are checked in.
+
+using namespace invisible;
+
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    std::fprintf(stderr,
+                 "usage: %s <font.ttf> <name> <out dir> <pixel size>...\n",
+                 argv[0]);
+    return 2;
+  }
+
+  FT_Library library;
+  FT_Face face;
+  if (FT_Init_FreeType(&library) || FT_New_Face(library, argv[1], 0, &face)) {
+    std::fprintf(stderr, "cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  for (int arg = 4; arg < argc; ++arg) {
+    const int size = std::atoi(argv[arg]);
+    if (size <= 0 || FT_Set_Pixel_Sizes(face, 0, size))
+      continue;
+
+    test::GlyphFont font;
+    font.size = size;
+    font.ascender = static_cast<int>(face->size->metrics.ascender >> 6);
+    font.lineHeight = static_cast<int>(face->size->metrics.height >> 6) + 2;
+    for (int c = 32; c < 127; ++c) {
+      if (FT_Load_Char(face, static_cast<FT_ULong>(c), FT_LOAD_RENDER))
+        continue;
+      const FT_GlyphSlot slot = face->glyph;
+      test::Glyph glyph;
+      glyph.c = static_cast<char>(c);
+      glyph.advance = static_cast<int>(slot->advance.x >> 6);
+      glyph.left = slot->bitmap_left;
+      glyph.top = slot->bitmap_top;
+      glyph.width = static_cast<int>(slot->bitmap.width);
+      glyph.rows = static_cast<int>(slot->bitmap.rows);
+      for (int y = 0; y < glyph.rows; ++y) {
+        const unsigned char *row =
+            slot->bitmap.buffer + y * slot->bitmap.pitch;
+        glyph.coverage.insert(glyph.coverage.end(), row, row + glyph.width);
+      }
+      font.glyphs.push_back(std::move(glyph));
+    }
+
+    const std::string path = std::string(argv[3]) + "/" + argv[2] + "-" +
+                             std::to_string(size) + ".glyphs";
+    if (!font.Save(path)) {
+      std::fprintf(stderr, "cannot write %s\n", path.c_str());
+      return 1;
+    }
+    std::printf("%s: %zu glyphs\n", path.c_str(), font.glyphs.size());
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+  return 0;
+}
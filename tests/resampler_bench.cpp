@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "resampler.h"
+#include <cmath>
+#include <vector>
+
+// Resampling throughput for the capture rates the app sees, fed the way
+// OnAudioData feeds it (10 ms packets) and in one call.
+
+using namespace invisible;
+
+int main() {
+  const int runs = bench::Runs(5);
+  std::printf("resampler to 16 kHz (%s kernel), best of %d\n",
+              Resampler::GetKernelName(), runs);
+  for (uint32_t rate : {44100u, 48000u, 96000u}) {
+    std::vector<float> input(static_cast<size_t>(rate) * 10);
+    for (size_t n = 0; n < input.size(); ++n)
+      input[n] = 0.5f * std::sin(0.05f * static_cast<float>(n));
+
+    Resampler resampler;
+    resampler.Initialize(rate, 16000);
+    std::vector<float> output;
+    output.reserve(resampler.GetMaxOutput(input.size()) + 1024);
+
+    double whole = bench::BestOf(runs, [&] {
+      resampler.Reset();
+      output.clear();
+      resampler.Process(input.data(), input.size(), output);
+    });
+    const size_t packet = rate / 100;
+    double packets = bench::BestOf(runs, [&] {
+      resampler.Reset();
+      output.clear();
+      for (size_t pos = 0; pos < input.size(); pos += packet)
+        resampler.Process(input.data() + pos,
+                          std::min(packet, input.size() - pos), output);
+    });
+    double seconds = static_cast<double>(input.size()) / rate;
+    std::printf("  %6u Hz: %7.1f Msamples/s one-shot, %7.1f in 10 ms "
+                "packets (%.0fx realtime)\n",
+                rate, input.size() / whole / 1e6, input.size() / packets / 1e6,
+                seconds / packets);
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include "resampler.h"
+#include "test.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace invisible;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+std::vector<float> Tone(double frequency, uint32_t rate, size_t count,
+                        double amplitude = 0.5) {
+  std::vector<float> samples(count);
+  for (size_t n = 0; n < count; ++n)
+    samples[n] = static_cast<float>(
+        amplitude * std::sin(2 * kPi * frequency * n / rate));
+  return samples;
+}
+
+// SNR of a resampled tone against the analytic tone at the output times,
+// shifted by the filter delay; the start and end (filter ramp) are skipped
+double ToneSnr(const Resampler &resampler, const std::vector<float> &output,
+               double frequency, double amplitude = 0.5) {
+  const double ratio = static_cast<double>(resampler.GetInputRate()) /
+                       resampler.GetOutputRate();
+  double signal = 0, noise = 0;
+  for (size_t k = 2000; k + 2000 < output.size(); ++k) {
+    double t = (k * ratio - resampler.GetDelay()) / resampler.GetInputRate();
+    double expected = amplitude * std::sin(2 * kPi * frequency * t);
+    signal += expected * expected;
+    noise += (output[k] - expected) * (output[k] - expected);
+  }
+  return 10 * std::log10(signal / std::max(noise, 1e-30));
+}
+
+double Rms(const std::vector<float> &samples, size_t skip) {
+  double sum = 0;
+  size_t n = 0;
+  for (size_t i = skip; i + skip < samples.size(); ++i, ++n)
+    sum += samples[i] * samples[i];
+  return n ? std::sqrt(sum / n) : 0;
+}
+
+} // namespace
+
+TEST(PassbandTonesKeepHighSnr) {
+  for (uint32_t rate : {44100u, 48000u, 96000u}) {
+    for (double frequency : {440.0, 3000.0, 6000.0}) {
+      Resampler resampler;
+      REQUIRE(resampler.Initialize(rate, 16000));
+      std::vector<float> input = Tone(frequency, rate, rate);
+      std::vector<float> output;
+      resampler.Process(input.data(), input.size(), output);
+      double snr = ToneSnr(resampler, output, frequency);
+      CHECK_GT(snr, 80.0);
+    }
+  }
+}
+
+// What the old linear interpolation folded into the speech band: a tone
+// above the output Nyquist must come out as (nearly) nothing
+TEST(StopbandIsRejected) {
+  for (double frequency : {8600.0, 10000.0, 15000.0, 20000.0}) {
+    Resampler resampler;
+    REQUIRE(resampler.Initialize(48000, 16000));
+    std::vector<float> input = Tone(frequency, 48000, 48000);
+    std::vector<float> output;
+    resampler.Process(input.data(), input.size(), output);
+    double attenuation = 20 * std::log10(Rms(output, 2000) / Rms(input, 0));
+    CHECK_LT(attenuation, -80.0);
+  }
+}
+
+TEST(ChunkedOutputIsBitIdenticalToOneShot) {
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+  std::vector<float> input(48000 * 2);
+  for (float &s : input)
+    s = noise(rng);
+
+  for (uint32_t rate : {44100u, 48000u}) {
+    Resampler oneShot, chunked;
+    REQUIRE(oneShot.Initialize(rate, 16000));
+    REQUIRE(chunked.Initialize(rate, 16000));
+    std::vector<float> expected, actual;
+    oneShot.Process(input.data(), input.size(), expected);
+    oneShot.Flush(expected);
+
+    for (size_t pos = 0; pos < input.size();) {
+      size_t piece = std::min<size_t>(1 + rng() % 1500, input.size() - pos);
+      size_t before = actual.size();
+      size_t added = chunked.Process(input.data() + pos, piece, actual);
+      CHECK_EQ(added, actual.size() - before);
+      CHECK_LE(added, chunked.GetMaxOutput(piece));
+      pos += piece;
+    }
+    chunked.Flush(actual);
+
+    REQUIRE(actual.size() == expected.size());
+    CHECK(std::memcmp(actual.data(), expected.data(),
+                      actual.size() * sizeof(float)) == 0);
+  }
+}
+
+TEST(OutputLengthFollowsTheRateRatio) {
+  Resampler resampler;
+  REQUIRE(resampler.Initialize(48000, 16000));
+  std::vector<float> input(48000, 0.0f), output;
+  resampler.Process(input.data(), input.size(), output);
+  CHECK_NEAR(static_cast<double>(output.size()), 16000.0, 2.0);
+
+  // Reset starts a new stream: the same input gives the same output again
+  std::vector<float> again;
+  resampler.Reset();
+  resampler.Process(input.data(), input.size(), again);
+  CHECK_EQ(again.size(), output.size());
+  CHECK(!resampler.Initialize(0, 16000));
+}
+
+TEST(DownmixAveragesChannels) {
+  const int16_t pcm16[] = {1000, 3000, -32768, -32768, 32767, 32767};
+  float mono[3];
+  REQUIRE(DownmixToMono(reinterpret_cast<const uint8_t *>(pcm16),
+                        sizeof(pcm16), 2, 16, false, mono) == 3);
+  CHECK_NEAR(mono[0], 2000.0 / 32768, 1e-6);
+  CHECK_NEAR(mono[1], -1.0, 1e-6);
+  CHECK_NEAR(mono[2], 32767.0 / 32768, 1e-6);
+
+  const float stereo[] = {0.5f, -0.5f, 0.25f, 0.75f, 1.0f, 1.0f, -1.0f, 0.0f};
+  float out[4];
+  REQUIRE(DownmixToMono(reinterpret_cast<const uint8_t *>(stereo),
+                        sizeof(stereo), 2, 32, true, out) == 4);
+  CHECK_NEAR(out[0], 0.0, 1e-7);
+  CHECK_NEAR(out[1], 0.5, 1e-7);
+  CHECK_NEAR(out[2], 1.0, 1e-7);
+  CHECK_NEAR(out[3], -0.5, 1e-7);
+
+  CHECK_EQ(DownmixToMono(reinterpret_cast<const uint8_t *>(pcm16),
+                         sizeof(pcm16), 2, 12, false, out),
+           0u);
+}
+
+TEST(Int16ConversionRoundsAndSaturates) {
+  const float input[] = {0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 2.0f, -2.0f,
+                         3.0f / 65536};
+  const int16_t expected[] = {0, 16384, -16384, 32767, -32767, 32767, -32768,
+                              1};
+  int16_t out[8];
+  ConvertFloatToInt16(input, 8, out); // Vector path where there is one
+  for (int i = 0; i < 8; ++i)
+    CHECK_EQ(out[i], expected[i]);
+  for (int i = 0; i < 8; ++i) { // Scalar tail
+    ConvertFloatToInt16(input + i, 1, out + i);
+    CHECK_EQ(out[i], expected[i]);
+  }
+}
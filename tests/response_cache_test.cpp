@@ -0,0 +1,270 @@
+#include "response_cache.h"
+#include "test.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+// ResponseCache keys, eviction, statistics and the cache file. Requests are
+// built the way the AI service builds them: an exact key over the whole
+// request, and a loose key over the same request with the question
+// normalized.
+
+using namespace invisible;
+
+namespace {
+
+const char kContext[] = "model=gpt-4o-mini|system=answer directly|";
+
+ResponseCacheKey ExactKey(const std::string &question) {
+  return ResponseCache::MakeKey(kContext + question);
+}
+
+ResponseCacheKey LooseKey(const std::string &question) {
+  return ResponseCache::MakeKey(kContext +
+                                ResponseCache::NormalizeQuestion(question));
+}
+
+void Ask(ResponseCache &cache, const std::string &question,
+         const std::string &answer, uint32_t latencyMs = 100) {
+  cache.Insert(ExactKey(question), LooseKey(question), answer, latencyMs);
+}
+
+bool Lookup(ResponseCache &cache, const std::string &question,
+            std::string &answer) {
+  return cache.Lookup(ExactKey(question), LooseKey(question), answer);
+}
+
+// A file under the system's temporary directory, removed with its ".tmp"
+// sibling when the test is done
+struct TempFile {
+  std::filesystem::path path;
+
+  TempFile() {
+    std::random_device random;
+    path = std::filesystem::temp_directory_path() /
+           ("response_cache_test_" + std::to_string(random()) + ".bin");
+  }
+  ~TempFile() {
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    std::filesystem::remove(path.string() + ".tmp", error);
+  }
+
+  std::string Read() const {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+  }
+  void Write(const std::string &bytes) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << bytes;
+  }
+};
+
+} // namespace
+
+// --- Keys --------------------------------------------------------------------
+
+TEST(ExactKeyHitsAndOthersMiss) {
+  ResponseCache cache;
+  const ResponseCacheKey key = ResponseCache::MakeKey("request one");
+  cache.Insert(key, ResponseCacheKey(), "answer one", 250);
+
+  std::string answer;
+  REQUIRE(cache.Lookup(key, ResponseCacheKey(), answer));
+  CHECK(answer == "answer one");
+  CHECK(!cache.Lookup(ResponseCache::MakeKey("request one "),
+                      ResponseCacheKey(), answer));
+  CHECK(!cache.Lookup(ResponseCache::MakeKey("request two"),
+                      ResponseCacheKey(), answer));
+  CHECK(!ResponseCache::MakeKey("").IsEmpty()); // Empty means "no key"
+}
+
+TEST(LooseKeyMatchesTheSameQuestion) {
+  ResponseCache cache;
+  Ask(cache, "What's a mutex?", "A lock.");
+
+  std::string answer;
+  for (const char *question :
+       {"what's a mutex", "WHAT'S A MUTEX?!", "  What's   a\tmutex ? ",
+        "What's a mutex..."}) {
+    answer.clear();
+    CHECK(Lookup(cache, question, answer));
+    CHECK(answer == "A lock.");
+  }
+
+  // Symbols and words still count
+  CHECK(!Lookup(cache, "What's a mutex*?", answer));
+  CHECK(!Lookup(cache, "What's a semaphore?", answer));
+  Ask(cache, "Is C++ faster?", "Often.");
+  CHECK(!Lookup(cache, "Is C faster?", answer));
+  CHECK(!Lookup(cache, "Is C# faster?", answer));
+  CHECK(Lookup(cache, "is c++ faster", answer));
+  CHECK(answer == "Often.");
+
+  // Without a loose key only the exact request matches
+  CHECK(!cache.Lookup(ExactKey("what's a mutex"), ResponseCacheKey(),
+                      answer));
+}
+
+TEST(NormalizedQuestions) {
+  CHECK(ResponseCache::NormalizeQuestion("  Hello,   World?! ") ==
+        "hello, world");
+  CHECK(ResponseCache::NormalizeQuestion("x*y + 1.") == "x*y + 1");
+  CHECK(ResponseCache::NormalizeQuestion("C++") == "c++");
+  CHECK(ResponseCache::NormalizeQuestion("?!.") == "");
+  CHECK(ResponseCache::NormalizeQuestion("caf\xC3\xA9?") == "caf\xC3\xA9");
+}
+
+// --- Eviction ----------------------------------------------------------------
+
+TEST(LeastRecentlyUsedGoFirstBeyondTheByteBudget) {
+  ResponseCacheConfig config;
+  config.maxBytes = 1000;
+  ResponseCache cache(config);
+  for (int i = 0; i < 4; ++i)
+    Ask(cache, "question " + std::to_string(i), std::string(300, 'a' + i));
+
+  // 1200 bytes: the oldest had to go
+  std::string answer;
+  CHECK(!Lookup(cache, "question 0", answer));
+  ResponseCacheStats stats = cache.GetStats();
+  CHECK_EQ(stats.entries, 3u);
+  CHECK_EQ(stats.bytes, 900u);
+  CHECK_EQ(stats.evictions, 1u);
+
+  // A lookup makes question 1 the newest, so question 2 goes next
+  CHECK(Lookup(cache, "question 1", answer));
+  Ask(cache, "question 4", std::string(300, 'e'));
+  CHECK(!Lookup(cache, "question 2", answer));
+  CHECK(Lookup(cache, "question 1", answer));
+  CHECK(Lookup(cache, "question 3", answer));
+  CHECK(Lookup(cache, "question 4", answer));
+  CHECK_LE(cache.GetStats().bytes, config.maxBytes);
+
+  // An answer bigger than the whole budget is not kept at all
+  Ask(cache, "question 5", std::string(1001, 'f'));
+  CHECK(!Lookup(cache, "question 5", answer));
+  CHECK_EQ(cache.GetStats().entries, 3u);
+}
+
+TEST(EntryLimitAndReplacement) {
+  ResponseCacheConfig config;
+  config.maxEntries = 2;
+  ResponseCache cache(config);
+  Ask(cache, "a", "1");
+  Ask(cache, "a", "2"); // Replaces, does not add
+  CHECK_EQ(cache.GetStats().entries, 1u);
+  Ask(cache, "b", "3");
+  Ask(cache, "c", "4");
+
+  std::string answer;
+  CHECK(!Lookup(cache, "a", answer));
+  CHECK(Lookup(cache, "c", answer));
+  CHECK(answer == "4");
+  CHECK_EQ(cache.GetStats().entries, 2u);
+
+  cache.Clear();
+  CHECK(!Lookup(cache, "c", answer));
+  CHECK_EQ(cache.GetStats().bytes, 0u);
+}
+
+// --- Statistics --------------------------------------------------------------
+
+TEST(StatsCountHitsAndSavedTime) {
+  ResponseCache cache;
+  Ask(cache, "What is RAII?", "Scope-bound resources.", 800);
+  Ask(cache, "What is SFINAE?", "A substitution rule.", 1200);
+
+  std::string answer;
+  CHECK(Lookup(cache, "What is RAII?", answer));   // Exact
+  CHECK(Lookup(cache, "what is raii", answer));    // Loose
+  CHECK(Lookup(cache, "WHAT IS SFINAE", answer));  // Loose
+  CHECK(!Lookup(cache, "What is ADL?", answer));   // Miss
+
+  ResponseCacheStats stats = cache.GetStats();
+  CHECK_EQ(stats.lookups, 4u);
+  CHECK_EQ(stats.hits, 3u);
+  CHECK_EQ(stats.looseHits, 2u);
+  CHECK_EQ(stats.inserts, 2u);
+  CHECK_EQ(stats.savedMs, 800u + 800 + 1200);
+  CHECK_EQ(stats.entries, 2u);
+  CHECK_EQ(stats.bytes,
+           sizeof("Scope-bound resources.") - 1 +
+               sizeof("A substitution rule.") - 1);
+  CHECK_EQ(stats.evictions, 0u);
+}
+
+// --- Persistence -------------------------------------------------------------
+
+TEST(SaveAndLoadRoundTrip) {
+  TempFile file;
+  ResponseCache saved;
+  Ask(saved, "first?", "one", 10);
+  Ask(saved, "second?", "two", 20);
+  Ask(saved, "third?", std::string("th\0ree", 6), 30); // Any bytes
+  std::string answer;
+  CHECK(Lookup(saved, "first?", answer)); // Now the newest
+  REQUIRE(saved.Save(file.path));
+  CHECK(!std::filesystem::exists(file.path.string() + ".tmp"));
+
+  ResponseCacheConfig config;
+  config.maxEntries = 2;
+  ResponseCache loaded(config);
+  REQUIRE(loaded.Load(file.path));
+
+  // The same LRU order: with room for two, "second" (the oldest) is gone
+  CHECK(!Lookup(loaded, "second?", answer));
+  CHECK(Lookup(loaded, "third", answer)); // Loose keys survive too
+  CHECK(answer == std::string("th\0ree", 6));
+  CHECK(Lookup(loaded, "first?", answer));
+  CHECK(answer == "one");
+  CHECK_EQ(loaded.GetStats().savedMs, 30u + 10);
+}
+
+TEST(LoadRejectsDamagedFiles) {
+  TempFile file;
+  ResponseCache cache;
+  CHECK(!cache.Load(file.path)); // Missing
+
+  file.Write("not a cache file at all");
+  CHECK(!cache.Load(file.path));
+  file.Write("");
+  CHECK(!cache.Load(file.path));
+
+  ResponseCache saved;
+  for (int i = 0; i < 5; ++i)
+    Ask(saved, "question " + std::to_string(i), std::string(50, 'a' + i));
+  REQUIRE(saved.Save(file.path));
+  const std::string bytes = file.Read();
+  REQUIRE(bytes.size() > 12);
+
+  // Another version
+  std::string versioned = bytes;
+  versioned[4] ^= 0x7F;
+  file.Write(versioned);
+  CHECK(!cache.Load(file.path));
+  CHECK_EQ(cache.GetStats().entries, 0u);
+
+  // Cut anywhere: whole entries before the cut are kept, never more
+  for (size_t cut = 12; cut < bytes.size(); cut += 7) {
+    file.Write(bytes.substr(0, cut));
+    ResponseCache truncated;
+    CHECK(truncated.Load(file.path));
+    CHECK_LT(truncated.GetStats().entries, 5u);
+  }
+
+  // A damaged length cannot make it allocate or read past the end
+  std::mt19937 random(7);
+  for (int i = 0; i < 200; ++i) {
+    std::string damaged = bytes;
+    for (int k = 0; k < 4; ++k)
+      damaged[12 + random() % (damaged.size() - 12)] =
+          static_cast<char>(random());
+    file.Write(damaged);
+    ResponseCache corrupt;
+    corrupt.Load(file.path);
+    CHECK_LE(corrupt.GetStats().entries, 5u);
+  }
+}
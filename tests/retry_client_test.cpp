@@ -0,0 +1,302 @@
+#include "http_client.h"
+#include "stub_server.h"
+#include "test.h"
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <poll.h>
+
+// HttpClient's retry, backoff and hedging against a fault-injecting
+// loopback server: each path plays a script of faults (error statuses,
+// Retry-After, reset and dropped connections, held responses) one per
+// request, and answers 200 once the script runs out.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Fault {
+  enum Kind { Status, Reset, Drop, Hold, MidStreamReset } kind = Status;
+  int status = 200;
+  std::string headers; // "Name: value\r\n" lines with a status
+  int holdMs = 0;
+};
+
+Fault Status(int status, std::string headers = "") {
+  Fault fault;
+  fault.status = status;
+  fault.headers = std::move(headers);
+  return fault;
+}
+
+Fault Kind(Fault::Kind kind, int holdMs = 0) {
+  Fault fault;
+  fault.kind = kind;
+  fault.holdMs = holdMs;
+  return fault;
+}
+
+class FaultServer {
+public:
+  FaultServer()
+      : server_(StubServer::Http([this](const StubRequest &request,
+                                        StubConnection &connection) {
+          return Handle(request, connection);
+        })) {}
+
+  bool IsListening() const { return server_->IsListening(); }
+  std::wstring Url(const std::string &path) const {
+    return server_->WideUrl(path);
+  }
+
+  void Script(const std::string &path, std::deque<Fault> faults) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scripts_[path] = std::move(faults);
+  }
+
+  // Requests `path` has received
+  int Hits(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_[path];
+  }
+
+private:
+  bool Handle(const StubRequest &request, StubConnection &connection) {
+    Fault fault;
+    int hit;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      hit = ++hits_[request.path];
+      auto &script = scripts_[request.path];
+      if (!script.empty()) {
+        fault = script.front();
+        script.pop_front();
+      }
+    }
+    std::string body = "attempt " + std::to_string(hit);
+
+    switch (fault.kind) {
+    case Fault::Reset:
+      connection.Reset();
+      return false;
+    case Fault::Drop:
+      return false; // FIN without a response
+    case Fault::Hold: {
+      pollfd descriptor{connection.Socket(), POLLIN, 0};
+      if (poll(&descriptor, 1, fault.holdMs) != 0)
+        return false; // The client gave up
+      break;
+    }
+    case Fault::MidStreamReset:
+      connection.Write(test::StubChunkedHead(200) + test::StubChunk(body));
+      connection.Reset();
+      return false;
+    case Fault::Status:
+      break;
+    }
+    return connection.Write(
+        test::StubResponse(fault.status, body, fault.headers));
+  }
+
+  std::mutex mutex_;
+  std::map<std::string, std::deque<Fault>> scripts_;
+  std::map<std::string, int> hits_;
+  std::unique_ptr<StubServer> server_; // Last: joined first
+};
+
+HttpAsyncOptions Retries(uint32_t attempts, uint32_t backoffMs = 10) {
+  HttpAsyncOptions options;
+  options.retry.maxAttempts = attempts;
+  options.retry.baseBackoffMs = backoffMs;
+  options.retry.maxBackoffMs = backoffMs * 4;
+  return options;
+}
+
+double Ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+TEST(ServerErrorsAreRetried) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/chat", {Status(503), Status(502)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/chat"), "{}", {}, Retries(3)).get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK_EQ(response.body, std::string("attempt 3"));
+  CHECK_EQ(server.Hits("/chat"), 3);
+
+  HttpRetryStats stats = client.GetRetryStats();
+  CHECK_EQ(stats.calls, 1u);
+  CHECK_EQ(stats.attempts, 3u);
+  CHECK_EQ(stats.retries, 2u);
+  CHECK_EQ(stats.exhausted, 0u);
+}
+
+TEST(DroppedConnectionsAreRetried) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/upload", {Kind(Fault::Reset), Kind(Fault::Drop)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/upload"), "{}", {}, Retries(4))
+          .get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK(response.error.empty());
+  CHECK_GE(client.GetRetryStats().retries, 1u);
+}
+
+TEST(ClientErrorsAreNotRetried) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/bad", {Status(400)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/bad"), "{}", {}, Retries(3)).get();
+  CHECK_EQ(response.statusCode, 400);
+  CHECK_EQ(server.Hits("/bad"), 1);
+  CHECK_EQ(client.GetRetryStats().retries, 0u);
+}
+
+TEST(LastErrorIsReportedWhenAttemptsRunOut) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/down", {Status(500), Status(503), Status(504)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/down"), "{}", {}, Retries(3)).get();
+  CHECK_EQ(response.statusCode, 504);
+  CHECK_EQ(server.Hits("/down"), 3);
+  CHECK_EQ(client.GetRetryStats().exhausted, 1u);
+}
+
+TEST(RetryAfterTimesTheRetry) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/limited", {Status(429, "retry-after-ms: 150\r\n")});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  auto start = Clock::now();
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/limited"), "{}", {}, Retries(2))
+          .get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK(Ms(start) >= 145); // Not the 10 ms backoff
+  CHECK_EQ(client.GetRetryStats().retryAfterWaits, 1u);
+}
+
+TEST(LongRetryAfterEndsTheCall) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/limited", {Status(429, "Retry-After: 120\r\n")});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  auto start = Clock::now();
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/limited"), "{}", {}, Retries(3))
+          .get();
+  CHECK_EQ(response.statusCode, 429);
+  CHECK(Ms(start) < 1000);
+  CHECK_EQ(server.Hits("/limited"), 1);
+  CHECK_EQ(client.GetRetryStats().exhausted, 1u);
+}
+
+TEST(NoRetryPastTheDeadline) {
+  // The backoff would end after the deadline: the 503 stands rather than
+  // a "Timed out" that hides it
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/busy", {Status(503), Status(503)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpAsyncOptions options = Retries(3, 400);
+  options.timeoutMs = 150;
+  auto start = Clock::now();
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/busy"), "{}", {}, options).get();
+  CHECK_EQ(response.statusCode, 503);
+  CHECK(Ms(start) < 150);
+  CHECK_EQ(server.Hits("/busy"), 1);
+}
+
+TEST(HedgeAnswersForASlowAttempt) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/chat", {Kind(Fault::Hold, 3000)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpAsyncOptions options;
+  options.retry.hedgeAfterMs = 50;
+  auto start = Clock::now();
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/chat"), "{}", {}, options).get();
+  CHECK_EQ(response.statusCode, 200);
+  CHECK_EQ(response.body, std::string("attempt 2"));
+  CHECK(Ms(start) < 1000); // The held attempt was cancelled, not awaited
+
+  HttpRetryStats stats = client.GetRetryStats();
+  CHECK_EQ(stats.hedges, 1u);
+  CHECK_EQ(stats.hedgeWins, 1u);
+  CHECK_EQ(stats.attempts, 2u);
+}
+
+TEST(FastAnswersStartNoHedge) {
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  HttpAsyncOptions options;
+  options.retry.hedgeAfterMs = 500;
+  for (int i = 0; i < 5; ++i) {
+    CHECK_EQ(client.PostJsonAsync(server.Url("/chat"), "{}", {}, options)
+                 .get()
+                 .statusCode,
+             200);
+  }
+  CHECK_EQ(client.GetRetryStats().hedges, 0u);
+  CHECK_EQ(server.Hits("/chat"), 5);
+}
+
+TEST(StreamsAreNotReplayed) {
+  // Once a body has reached onChunk a failure ends the call: a retry would
+  // deliver the start of the stream twice
+  FaultServer server;
+  REQUIRE(server.IsListening());
+  server.Script("/stream", {Kind(Fault::MidStreamReset)});
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  std::string streamed;
+  HttpAsyncOptions options = Retries(3);
+  options.onChunk = [&](const char *data, size_t size) {
+    streamed.append(data, size);
+    return true;
+  };
+  HttpResponse response =
+      client.PostJsonAsync(server.Url("/stream"), "{}", {}, options).get();
+  CHECK(!response.error.empty());
+  CHECK_EQ(streamed, std::string("attempt 1"));
+  CHECK_EQ(server.Hits("/stream"), 1);
+}
@@ -0,0 +1,117 @@
+#include "retry_policy.h"
+#include "test.h"
+
+// The retry rules on their own: which answers are worth another attempt,
+// Retry-After in its three spellings, and the jittered exponential backoff.
+
+using namespace invisible;
+
+namespace {
+
+HttpResponse Status(int code) {
+  HttpResponse response;
+  response.statusCode = code;
+  return response;
+}
+
+HttpResponse Failure(const wchar_t *error) {
+  HttpResponse response;
+  response.error = error;
+  return response;
+}
+
+HttpResponse WithHeader(const std::string &name, const std::string &value) {
+  HttpResponse response = Status(429);
+  response.headers[name] = value;
+  return response;
+}
+
+} // namespace
+
+TEST(RetryableAnswers) {
+  CHECK(IsRetryableResponse(Status(408)));
+  CHECK(IsRetryableResponse(Status(429)));
+  CHECK(IsRetryableResponse(Status(500)));
+  CHECK(IsRetryableResponse(Status(503)));
+  CHECK(IsRetryableResponse(Failure(L"Failed to connect to server")));
+  CHECK(IsRetryableResponse(Failure(L"Failed to receive response")));
+
+  CHECK(!IsRetryableResponse(Status(200)));
+  CHECK(!IsRetryableResponse(Status(400)));
+  CHECK(!IsRetryableResponse(Status(401)));
+  CHECK(!IsRetryableResponse(Status(404)));
+  CHECK(!IsRetryableResponse(Failure(L"Cancelled")));
+  CHECK(!IsRetryableResponse(Failure(L"Timed out")));
+  CHECK(!IsRetryableResponse(HttpResponse())); // No status, no error
+}
+
+TEST(RetryAfterSeconds) {
+  uint32_t delay = 0;
+  CHECK(ParseRetryAfter(WithHeader("retry-after", "7"), 0, delay));
+  CHECK_EQ(delay, 7000u);
+  CHECK(ParseRetryAfter(WithHeader("retry-after", "0"), 0, delay));
+  CHECK_EQ(delay, 0u);
+  CHECK(ParseRetryAfter(WithHeader("retry-after", "99999999999"), 0, delay));
+  CHECK_EQ(delay, 4294967295u); // Clamped
+}
+
+TEST(RetryAfterMilliseconds) {
+  // Preferred over retry-after when both are sent
+  HttpResponse response = WithHeader("retry-after-ms", "250.5");
+  response.headers["retry-after"] = "3";
+  uint32_t delay = 0;
+  CHECK(ParseRetryAfter(response, 0, delay));
+  CHECK_EQ(delay, 250u);
+}
+
+TEST(RetryAfterDate) {
+  // Sun, 06 Nov 1994 08:49:37 GMT = 784111777
+  const std::time_t kThen = 784111777;
+  HttpResponse response =
+      WithHeader("retry-after", "Sun, 06 Nov 1994 08:49:37 GMT");
+  uint32_t delay = 1;
+  CHECK(ParseRetryAfter(response, kThen - 12, delay));
+  CHECK_EQ(delay, 12000u);
+  CHECK(ParseRetryAfter(response, kThen + 5, delay)); // Already past
+  CHECK_EQ(delay, 0u);
+
+  response = WithHeader("retry-after", "Tue, 29 Feb 2028 23:59:60 GMT");
+  CHECK(ParseRetryAfter(response, 0, delay)); // Leap day, leap second
+}
+
+TEST(RetryAfterAbsentOrMalformed) {
+  uint32_t delay = 0;
+  CHECK(!ParseRetryAfter(Status(503), 0, delay));
+  CHECK(!ParseRetryAfter(WithHeader("retry-after", ""), 0, delay));
+  CHECK(!ParseRetryAfter(WithHeader("retry-after", "soon"), 0, delay));
+  CHECK(!ParseRetryAfter(WithHeader("retry-after", "Sun, 06 Foo 1994"), 0,
+                         delay));
+  CHECK(!ParseRetryAfter(
+      WithHeader("retry-after", "Sun, 06 Nov 1994 25:49:37 GMT"), 0, delay));
+  CHECK(!ParseRetryAfter(WithHeader("retry-after-ms", "-5"), 0, delay));
+}
+
+TEST(BackoffDoublesUpToTheCap) {
+  HttpRetryPolicy policy;
+  policy.baseBackoffMs = 100;
+  policy.maxBackoffMs = 1000;
+  // random = 1: the full delay
+  CHECK_EQ(RetryBackoffMs(policy, 1, 1.0), 100u);
+  CHECK_EQ(RetryBackoffMs(policy, 2, 1.0), 200u);
+  CHECK_EQ(RetryBackoffMs(policy, 3, 1.0), 400u);
+  CHECK_EQ(RetryBackoffMs(policy, 4, 1.0), 800u);
+  CHECK_EQ(RetryBackoffMs(policy, 5, 1.0), 1000u);
+  CHECK_EQ(RetryBackoffMs(policy, 40, 1.0), 1000u);
+}
+
+TEST(BackoffJitterKeepsTheLowerHalf) {
+  HttpRetryPolicy policy;
+  policy.baseBackoffMs = 400;
+  policy.maxBackoffMs = 8000;
+  CHECK_EQ(RetryBackoffMs(policy, 1, 0.0), 200u);
+  CHECK_EQ(RetryBackoffMs(policy, 1, 0.5), 300u);
+  CHECK_EQ(RetryBackoffMs(policy, 3, 0.0), 800u);
+  // Out-of-range randoms are clamped
+  CHECK_EQ(RetryBackoffMs(policy, 1, -3.0), 200u);
+  CHECK_EQ(RetryBackoffMs(policy, 1, 7.0), 400u);
+}
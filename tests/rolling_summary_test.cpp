@@ -0,0 +1,366 @@
+#include "rolling_summary.h"
+#include "test.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// RollingSummary against a fake model that counts the tokens of every fold
+// prompt (4 characters a token, the usual estimate for English) and answers
+// with a summary of fixed size naming the words it was given, so the tests
+// can tell which transcript made it into the summary.
+
+using namespace invisible;
+
+namespace {
+
+size_t Tokens(const std::string &text) { return (text.size() + 3) / 4; }
+
+// "w00000 w00001 ..." from `first`, `count` words
+std::string Word(size_t i) {
+  char word[16];
+  std::snprintf(word, sizeof(word), "w%05zu", i);
+  return word;
+}
+
+std::string Words(size_t first, size_t count) {
+  std::string text;
+  for (size_t i = first; i < first + count; ++i) {
+    if (!text.empty())
+      text += ' ';
+    text += Word(i);
+  }
+  return text;
+}
+
+std::vector<std::string> Split(const std::string &text) {
+  std::vector<std::string> words;
+  std::istringstream in(text);
+  for (std::string word; in >> word;)
+    words.push_back(word);
+  return words;
+}
+
+class FakeModel {
+public:
+  enum class Mode { Answer, Fail, Defer };
+  Mode mode = Mode::Answer;
+
+  ~FakeModel() { Flush(); }
+
+  RollingSummary::SummarizeFn Fn() {
+    return [this](const std::string &prompt,
+                  RollingSummary::SummarizeDone done) {
+      std::string answer;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        prompts_.push_back(prompt);
+        maxPromptTokens_ = std::max(maxPromptTokens_, Tokens(prompt));
+        totalTokens_ += Tokens(prompt);
+        if (++running_ > 1)
+          overlapped_ = true;
+
+        // The words of the new segment count as summarized
+        std::string segment =
+            prompt.substr(prompt.find("New transcript:\n") + 16);
+        for (const std::string &word : Split(segment))
+          summarized_.insert(word);
+        if (mode == Mode::Defer) {
+          deferred_.push_back({std::move(done), Summary(segment)});
+          return;
+        }
+        answer = mode == Mode::Fail ? "" : Summary(segment);
+        if (mode == Mode::Fail) {
+          for (const std::string &word : Split(segment))
+            summarized_.erase(word);
+        }
+        --running_;
+      }
+      done(answer);
+    };
+  }
+
+  // Answer the deferred calls from another thread, one after another
+  void Flush() {
+    for (;;) {
+      Deferred next;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (deferred_.empty())
+          return;
+        next = std::move(deferred_.front());
+        deferred_.erase(deferred_.begin());
+        --running_;
+      }
+      std::thread([&] { next.done(next.answer); }).join();
+    }
+  }
+
+  size_t Calls() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return prompts_.size();
+  }
+  std::string Prompt(size_t i) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return prompts_[i];
+  }
+  size_t MaxPromptTokens() const { return maxPromptTokens_; }
+  size_t TotalTokens() const { return totalTokens_; }
+  bool Overlapped() const { return overlapped_; }
+  std::set<std::string> Summarized() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return summarized_;
+  }
+
+private:
+  struct Deferred {
+    RollingSummary::SummarizeDone done;
+    std::string answer;
+  };
+
+  // About 100 tokens, however much went in
+  static std::string Summary(const std::string &segment) {
+    std::vector<std::string> words = Split(segment);
+    std::string summary = "Summary: discussed " +
+                          std::to_string(words.size()) + " words up to " +
+                          (words.empty() ? "" : words.back()) + ".";
+    summary.resize(400, '.');
+    return summary;
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<std::string> prompts_;
+  std::vector<Deferred> deferred_;
+  std::set<std::string> summarized_;
+  size_t maxPromptTokens_ = 0;
+  size_t totalTokens_ = 0;
+  int running_ = 0;
+  bool overlapped_ = false;
+};
+
+RollingSummaryConfig SmallConfig() {
+  RollingSummaryConfig config;
+  config.segmentChars = 400;
+  config.maxSegmentChars = 800;
+  config.maxTailChars = 3200;
+  config.summaryWords = 80;
+  return config;
+}
+
+// The unfolded transcript in BuildContext()
+std::string Tail(const RollingSummary &summary) {
+  std::string context = summary.BuildContext();
+  if (summary.GetSummary().empty())
+    return context;
+  size_t at = context.find("Transcript since then:\n");
+  return at == std::string::npos ? std::string() : context.substr(at + 23);
+}
+
+// `count` utterances of 10 words (70 characters with the joining space),
+// numbered on from `first`
+void Speak(RollingSummary &summary, size_t first, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    summary.Append(Words(first + i * 10, 10));
+}
+
+} // namespace
+
+TEST(NoFoldBeforeASegment) {
+  FakeModel model;
+  RollingSummary summary(SmallConfig(), model.Fn());
+  summary.Append("hello there");
+  summary.Append("");
+  CHECK_EQ(model.Calls(), 0u);
+  CHECK_EQ(summary.BuildContext(), std::string("hello there"));
+  CHECK(summary.GetSummary().empty());
+}
+
+TEST(FoldReplacesTheTail) {
+  FakeModel model;
+  RollingSummary summary(SmallConfig(), model.Fn());
+  Speak(summary, 0, 6); // 60 words, 419 characters
+
+  REQUIRE(model.Calls() == 1);
+  std::string prompt = model.Prompt(0);
+  CHECK(prompt.find("(none yet)") != std::string::npos);
+  CHECK(prompt.find("under 80 words") != std::string::npos);
+  CHECK(prompt.find(Words(0, 60)) != std::string::npos);
+
+  CHECK(summary.GetSummary().find("up to w00059.") != std::string::npos);
+  RollingSummaryStats stats = summary.GetStats();
+  CHECK_EQ(stats.folds, 1u);
+  CHECK_EQ(stats.tailChars, 0u);
+  CHECK_EQ(stats.summaryChars, 400u);
+
+  // The next fold gets the summary with the new segment
+  Speak(summary, 60, 6);
+  REQUIRE(model.Calls() == 2);
+  CHECK(model.Prompt(1).find("up to w00059.") != std::string::npos);
+  CHECK(model.Prompt(1).find(Words(60, 60)) != std::string::npos);
+}
+
+TEST(ContextHasTheSummaryAndTheUnfoldedTail) {
+  FakeModel model;
+  RollingSummary summary(SmallConfig(), model.Fn());
+  Speak(summary, 0, 6);
+  summary.Append(Words(60, 2));
+  std::string context = summary.BuildContext();
+  CHECK(context.find("Summary of the meeting so far:\nSummary:") == 0);
+  CHECK(context.find("Transcript since then:\n" + Words(60, 2)) !=
+        std::string::npos);
+}
+
+TEST(LongMeetingsCostTheSameTokensPerFold) {
+  // Two hours at about 150 words a minute. The fold prompt stays the same
+  // size, and so does what a summary request sends, however long it gets.
+  RollingSummaryConfig config; // Production sizes
+  FakeModel model;
+  RollingSummary summary(config, model.Fn());
+
+  const size_t kWords = 2 * 60 * 150;
+  size_t transcriptChars = 0;
+  size_t maxContextTokens = 0;
+  for (size_t i = 0; i < kWords; i += 10) {
+    std::string utterance = Words(i, 10);
+    transcriptChars += utterance.size() + 1;
+    summary.Append(utterance);
+    maxContextTokens =
+        std::max(maxContextTokens, Tokens(summary.BuildContext()));
+  }
+
+  size_t transcriptTokens = transcriptChars / 4;
+  std::printf("  %zu transcript tokens: %zu folds, %zu prompt tokens at "
+              "most, %zu in all; summary context at most %zu tokens\n",
+              transcriptTokens, model.Calls(), model.MaxPromptTokens(),
+              model.TotalTokens(), maxContextTokens);
+
+  // Summary, instructions and one segment at most
+  CHECK_LE(model.MaxPromptTokens(),
+           (400 + config.maxSegmentChars + 1024) / 4);
+  CHECK_LE(maxContextTokens, (400 + config.segmentChars + 256) / 4 + 32);
+  CHECK_LT(maxContextTokens * 20, transcriptTokens);
+  // Every word is folded once: the prompts add up to the transcript plus a
+  // fixed overhead per fold
+  CHECK_LE(model.TotalTokens(),
+           transcriptTokens + model.Calls() * (400 + 1024) / 4);
+  CHECK_EQ(summary.GetStats().droppedChars, 0u);
+}
+
+TEST(NothingIsLostBetweenSummaryAndTail) {
+  FakeModel model;
+  RollingSummary summary(SmallConfig(), model.Fn());
+  Speak(summary, 0, 137);
+
+  std::set<std::string> covered = model.Summarized();
+  for (const std::string &word : Split(Tail(summary)))
+    covered.insert(word);
+  CHECK_EQ(covered.size(), 1370u);
+  for (size_t i = 0; i < 1370; ++i)
+    CHECK(covered.count(Word(i)) == 1);
+}
+
+TEST(FailedFoldsKeepTheTextAndRetryLater) {
+  FakeModel model;
+  model.mode = FakeModel::Mode::Fail;
+  RollingSummary summary(SmallConfig(), model.Fn());
+
+  Speak(summary, 0, 6);
+  CHECK_EQ(model.Calls(), 1u);
+  CHECK_EQ(summary.BuildContext(), Words(0, 60));
+
+  // Not on every append: only once another segment has arrived
+  Speak(summary, 60, 5);
+  CHECK_EQ(model.Calls(), 1u);
+  Speak(summary, 110, 1);
+  CHECK_EQ(model.Calls(), 2u);
+
+  model.mode = FakeModel::Mode::Answer;
+  Speak(summary, 120, 6);
+  RollingSummaryStats stats = summary.GetStats();
+  CHECK_EQ(stats.failedFolds, 2u);
+  CHECK_GE(stats.folds, 1u);
+  CHECK_EQ(stats.droppedChars, 0u);
+  CHECK(model.Summarized().count(Word(0)) == 1);
+}
+
+TEST(TailIsCappedWhileFoldsFail) {
+  FakeModel model;
+  model.mode = FakeModel::Mode::Fail;
+  RollingSummaryConfig config = SmallConfig();
+  RollingSummary summary(config, model.Fn());
+
+  Speak(summary, 0, 200); // 14 KB against a 3.2 KB cap
+  RollingSummaryStats stats = summary.GetStats();
+  CHECK_LE(stats.tailChars, config.maxTailChars);
+  CHECK_GT(stats.droppedChars, 0u);
+  // The newest words are the ones kept, cut at a word boundary
+  std::string context = summary.BuildContext();
+  CHECK(context.find(Word(1999)) != std::string::npos);
+  CHECK_EQ(context[0], 'w');
+  // One retry per segment of new text, not one per append (200)
+  CHECK_LE(model.Calls(), 200 * 70 / config.segmentChars + 1);
+}
+
+TEST(OneFoldAtATimeWithABacklog) {
+  // The model answers late: text keeps arriving meanwhile and is folded a
+  // segment at a time once it does
+  FakeModel model;
+  model.mode = FakeModel::Mode::Defer;
+  RollingSummaryConfig config = SmallConfig();
+  RollingSummary summary(config, model.Fn());
+
+  Speak(summary, 0, 6);
+  Speak(summary, 60, 30);
+  CHECK_EQ(model.Calls(), 1u);
+  model.Flush();
+
+  CHECK(!model.Overlapped());
+  CHECK_GT(model.Calls(), 2u);
+  for (size_t i = 1; i < model.Calls(); ++i) {
+    std::string prompt = model.Prompt(i);
+    std::string segment = prompt.substr(prompt.find("New transcript:\n") + 16);
+    CHECK_LE(segment.size(), config.maxSegmentChars);
+  }
+  CHECK_LT(summary.GetStats().tailChars, config.segmentChars);
+}
+
+TEST(ClearDropsARunningFold) {
+  FakeModel model;
+  model.mode = FakeModel::Mode::Defer;
+  RollingSummary summary(SmallConfig(), model.Fn());
+  Speak(summary, 0, 6);
+  summary.Clear();
+  summary.Append("fresh start");
+  model.Flush();
+
+  CHECK(summary.GetSummary().empty());
+  CHECK_EQ(summary.BuildContext(), std::string("fresh start"));
+  CHECK_EQ(summary.GetStats().folds, 0u);
+}
+
+TEST(StopWaitsForTheRunningFold) {
+  FakeModel model;
+  model.mode = FakeModel::Mode::Defer;
+  RollingSummary summary(SmallConfig(), model.Fn());
+  Speak(summary, 0, 6);
+
+  std::atomic<bool> stopped{false};
+  std::thread stopper([&] {
+    summary.Stop();
+    stopped = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  CHECK(!stopped);
+  model.Flush();
+  stopper.join();
+  CHECK(stopped);
+
+  // No fold starts after Stop()
+  Speak(summary, 60, 20);
+  CHECK_EQ(model.Calls(), 1u);
+}
@@ -0,0 +1,186 @@
+#include "sse_parser.h"
+#include "test.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// SseParser fed the same stream whole, byte by byte and in random pieces
+// (splitting CRLF pairs, the BOM and field names) must dispatch the same
+// events, and those must be what the WHATWG rules say.
+
+using namespace invisible;
+
+namespace {
+
+struct Parsed {
+  std::vector<SseEvent> events;
+  uint32_t retryMs = 0;
+};
+
+bool Same(const std::vector<SseEvent> &a, const std::vector<SseEvent> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].type != b[i].type || a[i].data != b[i].data ||
+        a[i].lastEventId != b[i].lastEventId)
+      return false;
+  }
+  return true;
+}
+
+// Feed `stream` cut at `cuts` (sorted offsets)
+Parsed Parse(const std::string &stream, const std::vector<size_t> &cuts) {
+  Parsed parsed;
+  SseParser parser([&](const SseEvent &event) {
+    parsed.events.push_back(event);
+    return true;
+  });
+  size_t start = 0;
+  for (size_t cut : cuts) {
+    parser.Feed(stream.data() + start, cut - start);
+    start = cut;
+  }
+  parser.Feed(stream.data() + start, stream.size() - start);
+  parsed.retryMs = parser.GetRetryMs();
+  return parsed;
+}
+
+// Every line ending, the BOM, comments, id/retry/event fields, multi-line
+// data, a data-less event and an unterminated event at the end
+const std::string kStream = "\xEF\xBB\xBF"
+                            ": keep-alive\r\n"
+                            "retry: 2500\n"
+                            "data: first\r\n"
+                            "\r\n"
+                            "event: delta\r"
+                            "id: 7\r"
+                            "data:no space\r"
+                            "data:  two spaces\r"
+                            "\r"
+                            "event: ignored\n"
+                            "\n"
+                            "data\n"
+                            "data: x:y\n"
+                            "\n"
+                            "retry: 12a\n"
+                            "id: 8\r\n"
+                            "data: {\"choices\":[{\"delta\":{}}]}\r\n"
+                            "unknown: field\r\n"
+                            "\r\n"
+                            "data: cut off";
+
+std::vector<SseEvent> Expected() {
+  std::vector<SseEvent> events(4);
+  events[0].data = "first";
+  events[1].type = "delta";
+  events[1].data = "no space\n two spaces";
+  events[1].lastEventId = "7";
+  events[2].data = "\nx:y";
+  events[2].lastEventId = "7";
+  events[3].data = "{\"choices\":[{\"delta\":{}}]}";
+  events[3].lastEventId = "8";
+  return events;
+}
+
+} // namespace
+
+TEST(WholeStreamFollowsTheSpec) {
+  Parsed parsed = Parse(kStream, {});
+  std::vector<SseEvent> expected = Expected();
+  REQUIRE(parsed.events.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    CHECK_EQ(parsed.events[i].type, expected[i].type);
+    CHECK_EQ(parsed.events[i].data, expected[i].data);
+    CHECK_EQ(parsed.events[i].lastEventId, expected[i].lastEventId);
+  }
+  CHECK_EQ(parsed.retryMs, 2500u); // "12a" is not a number
+}
+
+TEST(ByteByByteMatchesWhole) {
+  std::vector<size_t> cuts;
+  for (size_t i = 1; i < kStream.size(); ++i)
+    cuts.push_back(i);
+  Parsed parsed = Parse(kStream, cuts);
+  CHECK(Same(parsed.events, Expected()));
+  CHECK_EQ(parsed.retryMs, 2500u);
+}
+
+TEST(RandomSplitsMatchWhole) {
+  std::mt19937 rng(11);
+  std::vector<SseEvent> expected = Expected();
+  for (int round = 0; round < 20000; ++round) {
+    std::vector<size_t> cuts;
+    int pieces = static_cast<int>(rng() % 12);
+    for (int i = 0; i < pieces; ++i)
+      cuts.push_back(rng() % (kStream.size() + 1));
+    std::sort(cuts.begin(), cuts.end());
+    Parsed parsed = Parse(kStream, cuts);
+    if (!Same(parsed.events, expected) || parsed.retryMs != 2500u) {
+      std::string where;
+      for (size_t cut : cuts)
+        where += " " + std::to_string(cut);
+      ::invisible::test::Fail(__FILE__, __LINE__,
+                              "events differ with cuts at" + where);
+      return;
+    }
+  }
+}
+
+TEST(EveryCrLfSplitIsOneLineEnd) {
+  // "a\r" | "\ndata: b\r" | "\n\r" | "\n": a CR ending one piece and its LF
+  // starting the next must not make an extra blank line
+  std::vector<std::string> events;
+  SseParser parser([&](const SseEvent &event) {
+    events.push_back(event.data);
+    return true;
+  });
+  parser.Feed("data: a\r", 8);
+  parser.Feed("\ndata: b\r", 9);
+  CHECK(events.empty());
+  parser.Feed("\n\r", 2);
+  parser.Feed("\n", 1);
+  REQUIRE(events.size() == 1u);
+  CHECK_EQ(events[0], std::string("a\nb"));
+}
+
+TEST(SplitBomIsSkippedAndFalseBomIsText) {
+  std::vector<std::string> events;
+  SseParser parser([&](const SseEvent &event) {
+    events.push_back(event.data);
+    return true;
+  });
+  parser.Feed("\xEF", 1);
+  parser.Feed("\xBB", 1);
+  parser.Feed("\xBF" "data: x\n\n", 10);
+  REQUIRE(events.size() == 1u);
+  CHECK_EQ(events[0], std::string("x"));
+
+  // Only a BOM at the very start is skipped
+  parser.Feed("\xEF\xBB\xBF" "data: y\n\n", 12);
+  CHECK_EQ(events.size(), 1u); // Field "\xEF\xBB\xBFdata" is unknown
+
+  parser.Reset();
+  events.clear();
+  parser.Feed("\xEF\xBB", 2);
+  parser.Feed("data: z\n\n", 9); // "\xEF\xBBdata" is an unknown field
+  CHECK(events.empty());
+}
+
+TEST(StopsWhenTheCallbackSaysSo) {
+  int seen = 0;
+  SseParser parser([&](const SseEvent &event) {
+    ++seen;
+    return event.data != "[DONE]";
+  });
+  std::string stream = "data: a\n\ndata: [DONE]\n\ndata: after\n\n";
+  CHECK(!parser.Feed(stream.data(), stream.size()));
+  CHECK_EQ(seen, 2);
+  CHECK(!parser.Feed("data: more\n\n", 12));
+  CHECK_EQ(seen, 2);
+  CHECK_EQ(parser.GetEventCount(), 2u);
+
+  parser.Reset();
+  CHECK(parser.Feed("data: again\n\n", 13));
+  CHECK_EQ(seen, 3);
+}
@@ -0,0 +1,193 @@
+#include "http_client.h"
+#include "json.h"
+#include "sse_parser.h"
+#include "stub_server.h"
+#include "test.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// PostJsonStreaming() and SseParser against a loopback server streaming a
+// chat completion the way the API does: chunked, one event per write, with
+// the model's pauses in between. Deltas must reach the caller as they are
+// sent, not when the response ends.
+
+using namespace invisible;
+using invisible::test::StubConnection;
+using invisible::test::StubRequest;
+using invisible::test::StubServer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int kEvents = 20;
+constexpr auto kGap = std::chrono::milliseconds(15);
+
+std::string DeltaEvent(int index) {
+  std::string json;
+  JsonWriter w(json);
+  w.BeginObject();
+  w.Key("choices");
+  w.BeginArray();
+  w.BeginObject();
+  w.Key("delta");
+  w.BeginObject();
+  w.Key("content");
+  w.String("t" + std::to_string(index) + " ");
+  w.EndObject();
+  w.EndObject();
+  w.EndArray();
+  w.EndObject();
+  return "data: " + json + "\n\n";
+}
+
+std::string ExpectedAnswer() {
+  std::string answer;
+  for (int i = 0; i < kEvents; ++i)
+    answer += "t" + std::to_string(i) + " ";
+  return answer;
+}
+
+// Streams kEvents deltas kGap apart, then [DONE]; `/error` answers 429
+std::unique_ptr<StubServer> StreamingServer(std::atomic<bool> *writeFailed) {
+  return StubServer::Http([writeFailed](const StubRequest &request,
+                                        StubConnection &connection) {
+    if (request.path == "/error") {
+      return connection.Write(test::StubResponse(
+          429, "{\"error\":{\"message\":\"slow down\"}}",
+          "Content-Type: application/json\r\n"));
+    }
+    connection.Write(test::StubChunkedHead(
+        200, "Content-Type: text/event-stream\r\n"));
+    for (int i = 0; i < kEvents; ++i) {
+      std::this_thread::sleep_for(kGap);
+      if (!connection.Write(test::StubChunk(DeltaEvent(i)))) {
+        *writeFailed = true;
+        return false;
+      }
+    }
+    return connection.Write(test::StubChunk("data: [DONE]\n\n")) &&
+           connection.Write(test::StubChunk(""));
+  });
+}
+
+// The answer assembled the way the chat stream reader does it
+struct Reader {
+  std::string answer;
+  int deltas = 0;
+  bool done = false;
+  int stopAfter = -1; // Cancel after this many deltas
+  Clock::time_point first;
+
+  SseParser parser{[this](const SseEvent &event) {
+    if (event.data == "[DONE]") {
+      done = true;
+      return false;
+    }
+    std::string delta;
+    if (!JsonGetString(event.data, {"choices", 0, "delta", "content"}, delta))
+      return false;
+    if (deltas++ == 0)
+      first = Clock::now();
+    answer += delta;
+    return deltas != stopAfter;
+  }};
+
+  HttpChunkCallback Callback() {
+    return [this](const char *data, size_t size) {
+      return parser.Feed(data, size) || done;
+    };
+  }
+};
+
+} // namespace
+
+TEST(DeltasArriveAsTheyAreSent) {
+  std::atomic<bool> writeFailed{false};
+  auto server = StreamingServer(&writeFailed);
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  Reader reader;
+  Clock::time_point start = Clock::now();
+  HttpResponse response = client.PostJsonStreaming(
+      server->WideUrl("/chat"), "{\"stream\":true}", {}, reader.Callback());
+  Clock::time_point end = Clock::now();
+
+  CHECK_EQ(response.statusCode, 200);
+  CHECK(response.error.empty());
+  CHECK(response.body.empty()); // Streamed, not buffered
+  CHECK(reader.done);
+  CHECK_EQ(reader.deltas, kEvents);
+  CHECK_EQ(reader.answer, ExpectedAnswer());
+
+  // The first delta lands about one gap in, long before the last one
+  auto firstMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     reader.first - start)
+                     .count();
+  auto totalMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+          .count();
+  CHECK_GE(totalMs, kEvents * kGap.count());
+  CHECK_LT(firstMs, totalMs / 4);
+}
+
+TEST(StoppingTheCallbackCancelsTheRequest) {
+  std::atomic<bool> writeFailed{false};
+  auto server = StreamingServer(&writeFailed);
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  Reader reader;
+  reader.stopAfter = 3;
+  HttpResponse response = client.PostJsonStreaming(
+      server->WideUrl("/chat"), "{\"stream\":true}", {}, reader.Callback());
+  CHECK(response.error == L"Cancelled");
+  CHECK_EQ(reader.deltas, 3);
+  CHECK_EQ(reader.answer, std::string("t0 t1 t2 "));
+
+  // The connection was dropped, so the server's next writes fail
+  for (int i = 0; i < 100 && !writeFailed; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(writeFailed);
+}
+
+TEST(ErrorBodiesAreBufferedNotStreamed) {
+  std::atomic<bool> writeFailed{false};
+  auto server = StreamingServer(&writeFailed);
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  int chunks = 0;
+  HttpResponse response = client.PostJsonStreaming(
+      server->WideUrl("/error"), "{}", {}, [&](const char *, size_t) {
+        ++chunks;
+        return true;
+      });
+  CHECK_EQ(response.statusCode, 429);
+  CHECK_EQ(chunks, 0);
+  std::string message;
+  CHECK(JsonGetString(response.body, {"error", "message"}, message));
+  CHECK_EQ(message, std::string("slow down"));
+}
+
+TEST(OneConnectionServesConsecutiveStreams) {
+  std::atomic<bool> writeFailed{false};
+  auto server = StreamingServer(&writeFailed);
+  REQUIRE(server->IsListening());
+  HttpClient client;
+  REQUIRE(client.Initialize());
+
+  for (int i = 0; i < 3; ++i) {
+    Reader reader;
+    HttpResponse response = client.PostJsonStreaming(
+        server->WideUrl("/chat"), "{}", {}, reader.Callback());
+    CHECK_EQ(response.statusCode, 200);
+    CHECK_EQ(reader.answer, ExpectedAnswer());
+  }
+  CHECK_EQ(server->Requests(), 3u);
+  CHECK_EQ(server->Connections(), 1u);
+}
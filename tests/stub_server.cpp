@@ -0,0 +1,296 @@
+#include "stub_server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// StubConnection
+// -----------------------------------------------------------------------------
+
+bool StubConnection::Fill() {
+  char chunk[16384];
+  for (;;) {
+    ssize_t n = recv(socket_, chunk, sizeof(chunk), 0);
+    if (n > 0) {
+      buffer_.append(chunk, static_cast<size_t>(n));
+      return true;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    return false;
+  }
+}
+
+size_t StubConnection::Read(void *buffer, size_t size) {
+  if (buffer_.empty() && !Fill())
+    return 0;
+  size_t n = std::min(size, buffer_.size());
+  buffer_.copy(static_cast<char *>(buffer), n);
+  buffer_.erase(0, n);
+  return n;
+}
+
+bool StubConnection::ReadExact(void *buffer, size_t size) {
+  char *out = static_cast<char *>(buffer);
+  while (size > 0) {
+    size_t n = Read(out, size);
+    if (n == 0)
+      return false;
+    out += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool StubConnection::ReadRequest(StubRequest &request) {
+  request = StubRequest();
+
+  size_t headEnd;
+  while ((headEnd = buffer_.find("\r\n\r\n")) == std::string::npos) {
+    if (!Fill())
+      return false;
+  }
+  std::string head = buffer_.substr(0, headEnd + 2);
+  buffer_.erase(0, headEnd + 4);
+
+  // Request line
+  size_t lineEnd = head.find("\r\n");
+  std::string line = head.substr(0, lineEnd);
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.find(' ', sp1 + 1);
+  if (sp1 == std::string::npos || sp2 == std::string::npos)
+    return false;
+  request.method = line.substr(0, sp1);
+  request.path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+  // Headers
+  for (size_t pos = lineEnd + 2; pos < head.size();) {
+    size_t end = head.find("\r\n", pos);
+    std::string field = head.substr(pos, end - pos);
+    pos = end + 2;
+    size_t colon = field.find(':');
+    if (colon == std::string::npos)
+      return false;
+    std::string name = field.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    size_t value = field.find_first_not_of(' ', colon + 1);
+    request.headers[name] =
+        value == std::string::npos ? std::string() : field.substr(value);
+  }
+
+  // Body
+  auto length = request.headers.find("content-length");
+  if (length != request.headers.end()) {
+    request.body.resize(std::strtoull(length->second.c_str(), nullptr, 10));
+    return ReadExact(&request.body[0], request.body.size());
+  }
+  auto encoding = request.headers.find("transfer-encoding");
+  if (encoding != request.headers.end() && encoding->second == "chunked") {
+    for (;;) {
+      size_t eol;
+      while ((eol = buffer_.find("\r\n")) == std::string::npos) {
+        if (!Fill())
+          return false;
+      }
+      size_t size = std::strtoull(buffer_.c_str(), nullptr, 16);
+      buffer_.erase(0, eol + 2);
+      std::string chunk(size + 2, '\0');
+      if (!ReadExact(&chunk[0], chunk.size()))
+        return false;
+      if (size == 0)
+        return true; // No trailers from our clients
+      request.body.append(chunk, 0, size);
+    }
+  }
+  return true;
+}
+
+bool StubConnection::Write(std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = send(socket_, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data.remove_prefix(static_cast<size_t>(n));
+  }
+  return true;
+}
+
+void StubConnection::ShutdownWrite() { shutdown(socket_, SHUT_WR); }
+
+void StubConnection::Reset() {
+  linger option{1, 0};
+  setsockopt(socket_, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+}
+
+// -----------------------------------------------------------------------------
+// StubServer
+// -----------------------------------------------------------------------------
+
+StubServer::StubServer(ConnectionHandler handler) {
+  Start(std::move(handler));
+}
+
+std::unique_ptr<StubServer> StubServer::Http(RequestHandler handler) {
+  std::unique_ptr<StubServer> server(new StubServer());
+  StubServer *self = server.get();
+  server->Start([self, handler](StubConnection &connection) {
+    StubRequest request;
+    while (connection.ReadRequest(request)) {
+      ++self->requests_;
+      if (!handler(request, connection))
+        break;
+    }
+  });
+  return server;
+}
+
+void StubServer::Start(ConnectionHandler handler) {
+  handler_ = std::move(handler);
+
+  int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0)
+    return;
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listener, reinterpret_cast<sockaddr *>(&address), length) != 0 ||
+      listen(listener, 64) != 0 ||
+      getsockname(listener, reinterpret_cast<sockaddr *>(&address),
+                  &length) != 0) {
+    close(listener);
+    return;
+  }
+  listener_ = listener;
+  port_ = ntohs(address.sin_port);
+  acceptThread_ = std::thread(&StubServer::AcceptLoop, this);
+}
+
+StubServer::~StubServer() {
+  stopping_ = true;
+  if (listener_ >= 0) {
+    shutdown(listener_, SHUT_RDWR); // Wakes accept()
+    acceptThread_.join();
+    close(listener_);
+  }
+
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int socket : sockets_)
+      shutdown(socket, SHUT_RDWR);
+    threads.swap(threads_);
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+void StubServer::AcceptLoop() {
+  while (!stopping_) {
+    int socket = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (socket < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      return;
+    }
+    int one = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ++connections_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      close(socket);
+      return;
+    }
+    sockets_.push_back(socket);
+    threads_.emplace_back([this, socket] {
+      StubConnection connection(socket);
+      handler_(connection);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sockets_.erase(std::find(sockets_.begin(), sockets_.end(), socket));
+      }
+      close(socket);
+    });
+  }
+}
+
+std::string StubServer::Url(const std::string &path) const {
+  return "http://127.0.0.1:" + std::to_string(port_) + path;
+}
+
+std::wstring StubServer::WideUrl(const std::string &path) const {
+  std::string url = Url(path);
+  return std::wstring(url.begin(), url.end());
+}
+
+// -----------------------------------------------------------------------------
+// Response Helpers
+// -----------------------------------------------------------------------------
+
+namespace {
+
+const char *Reason(int status) {
+  switch (status) {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 429:
+    return "Too Many Requests";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Status";
+  }
+}
+
+} // namespace
+
+std::string StubResponse(int status, std::string_view body,
+                         std::string_view headers) {
+  std::string out = "HTTP/1.1 " + std::to_string(status) + " " +
+                    Reason(status) + "\r\nContent-Length: " +
+                    std::to_string(body.size()) + "\r\n";
+  out.append(headers.data(), headers.size());
+  out += "\r\n";
+  out.append(body.data(), body.size());
+  return out;
+}
+
+std::string StubChunkedHead(int status, std::string_view headers) {
+  std::string out = "HTTP/1.1 " + std::to_string(status) + " " +
+                    Reason(status) + "\r\nTransfer-Encoding: chunked\r\n";
+  out.append(headers.data(), headers.size());
+  out += "\r\n";
+  return out;
+}
+
+std::string StubChunk(std::string_view data) {
+  char size[20];
+  std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+  std::string out = size;
+  out.append(data.data(), data.size());
+  out += "\r\n";
+  return out;
+}
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// Loopback Stub Server (POSIX)
+// A TCP server on 127.0.0.1 with an ephemeral port for tests that need a
+// real peer: every accepted connection runs the handler on its own thread.
+// Counts connections (TCP handshakes) and, in HTTP mode, requests. The
+// destructor shuts every socket down and joins the threads.
+// -----------------------------------------------------------------------------
+
+struct StubRequest {
+  std::string method;
+  std::string path;
+  std::map<std::string, std::string> headers; // Names lower-cased
+  std::string body;
+};
+
+class StubConnection {
+public:
+  explicit StubConnection(int socket) : socket_(socket) {}
+
+  int Socket() const { return socket_; }
+
+  // Read up to `size` bytes (buffered bytes first); 0 on close or error
+  size_t Read(void *buffer, size_t size);
+
+  // Read exactly `size` bytes; false if the peer closed first
+  bool ReadExact(void *buffer, size_t size);
+
+  // Read one HTTP/1.1 request with its Content-Length or chunked body;
+  // false on close or a malformed request
+  bool ReadRequest(StubRequest &request);
+
+  // Write everything; false if the peer has gone
+  bool Write(std::string_view data);
+
+  // Send FIN (half close)
+  void ShutdownWrite();
+
+  // Make the close after the handler returns a reset (RST) instead of FIN
+  void Reset();
+
+private:
+  bool Fill(); // Append more bytes to buffer_
+
+  int socket_;
+  std::string buffer_; // Read but not yet consumed
+};
+
+class StubServer {
+public:
+  // Runs once per connection; the connection closes when it returns
+  using ConnectionHandler = std::function<void(StubConnection &connection)>;
+
+  // Runs once per HTTP request; return false to close the connection
+  // (whatever was written is the response)
+  using RequestHandler = std::function<bool(const StubRequest &request,
+                                            StubConnection &connection)>;
+
+  explicit StubServer(ConnectionHandler handler);
+  ~StubServer();
+
+  // Disable copy
+  StubServer(const StubServer &) = delete;
+  StubServer &operator=(const StubServer &) = delete;
+
+  // Keep-alive HTTP/1.1 server calling `handler` for each request
+  static std::unique_ptr<StubServer> Http(RequestHandler handler);
+
+  bool IsListening() const { return listener_ >= 0; }
+  uint16_t Port() const { return port_; }
+
+  // "http://127.0.0.1:<port><path>"
+  std::string Url(const std::string &path = "/") const;
+  std::wstring WideUrl(const std::string &path = "/") const;
+
+  size_t Connections() const { return connections_; }
+  size_t Requests() const { return requests_; }
+
+private:
+  StubServer() = default;
+  void Start(ConnectionHandler handler);
+  void AcceptLoop();
+
+  ConnectionHandler handler_;
+  int listener_ = -1;
+  uint16_t port_ = 0;
+  std::atomic<size_t> connections_{0};
+  std::atomic<size_t> requests_{0};
+  std::atomic<bool> stopping_{false};
+
+  std::mutex mutex_;
+  std::vector<int> sockets_; // Open connections, shut down on destruction
+  std::vector<std::thread> threads_;
+  std::thread acceptThread_;
+};
+
+// "HTTP/1.1 <status> <reason>" with Content-Length and `headers`
+// ("Name: value\r\n" lines)
+std::string StubResponse(int status, std::string_view body,
+                         std::string_view headers = "");
+
+// Head of a chunked response; follow with StubChunk() pieces and
+// StubChunk("") to end it
+std::string StubChunkedHead(int status, std::string_view headers = "");
+std::string StubChunk(std::string_view data);
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,73 @@
+#include "synthetic_capture_backend.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace invisible {
+namespace test {
+
+SyntheticCaptureBackend::SyntheticCaptureBackend(int width, int height,
+                                                 FrameBufferPool *pool)
+    : width_(std::max(width, 1)), height_(std::max(height, 1)), pool_(pool),
+      desktop_(static_cast<size_t>(width_) * height_ * 4, 0) {}
+
+bool SyntheticCaptureBackend::Capture(const ImageRect &region,
+                                      CaptureFrame &frame) {
+  auto start = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  ImageRect clipped = IntersectRects(region, ImageRect{0, 0, width_, height_});
+  if (region.width <= 0 || region.height <= 0 ||
+      clipped.width != region.width || clipped.height != region.height) {
+    stats_.failures++;
+    return false;
+  }
+
+  CopySurfaceRegion(desktop_.data(), width_ * 4, region, pool_, frame);
+  dirty_.Report(region, frame);
+
+  stats_.captures++;
+  stats_.capturedBytes += frame.pixels.size();
+  stats_.captureMicros += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  return true;
+}
+
+CaptureBackendStats SyntheticCaptureBackend::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void SyntheticCaptureBackend::Fill(const ImageRect &rect, uint32_t bgra) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ImageRect clipped = IntersectRects(rect, ImageRect{0, 0, width_, height_});
+  for (int y = 0; y < clipped.height; ++y) {
+    uint8_t *row = desktop_.data() +
+                   (static_cast<size_t>(clipped.y + y) * width_ + clipped.x) *
+                       4;
+    for (int x = 0; x < clipped.width; ++x)
+      memcpy(row + x * 4, &bgra, 4);
+  }
+  dirty_.Add(clipped);
+}
+
+void SyntheticCaptureBackend::Draw(const ImageRect &rect,
+                                   const uint8_t *pixels, int stride) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ImageRect clipped = IntersectRects(rect, ImageRect{0, 0, width_, height_});
+  for (int y = 0; y < clipped.height; ++y) {
+    const uint8_t *src = pixels +
+                         static_cast<ptrdiff_t>(clipped.y - rect.y + y) *
+                             stride +
+                         static_cast<ptrdiff_t>(clipped.x - rect.x) * 4;
+    memcpy(desktop_.data() +
+               (static_cast<size_t>(clipped.y + y) * width_ + clipped.x) * 4,
+           src, static_cast<size_t>(clipped.width) * 4);
+  }
+  dirty_.Add(clipped);
+}
+
+} // namespace test
+} // namespace invisible
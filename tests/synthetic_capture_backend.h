@@ -0,0 +1,52 @@
+#pragma once
+
+#include "capture_backend.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace invisible {
+namespace test {
+
+// -----------------------------------------------------------------------------
+// Synthetic Capture Backend
+// An in-memory desktop for exercising the pool and the consumers of
+// captures without a display. Drawing marks the touched area dirty.
+// -----------------------------------------------------------------------------
+
+class SyntheticCaptureBackend : public CaptureBackend {
+public:
+  // `pool` may be null (then every capture allocates)
+  SyntheticCaptureBackend(int width, int height, FrameBufferPool *pool);
+
+  const char *GetName() const override { return "synthetic"; }
+  bool Capture(const ImageRect &region, CaptureFrame &frame) override;
+  CaptureBackendStats GetStats() const override;
+
+  // Fill `rect` (desktop coordinates) with one BGRA color
+  void Fill(const ImageRect &rect, uint32_t bgra);
+
+  // Copy BGRA rows spaced `stride` bytes apart to `rect`
+  void Draw(const ImageRect &rect, const uint8_t *pixels, int stride);
+
+  int GetWidth() const { return width_; }
+  int GetHeight() const { return height_; }
+
+  // Desktop pixel at (x, y)
+  const uint8_t *Pixel(int x, int y) const {
+    return desktop_.data() + (static_cast<size_t>(y) * width_ + x) * 4;
+  }
+
+private:
+  int width_;
+  int height_;
+  FrameBufferPool *pool_;
+
+  mutable std::mutex mutex_;
+  std::vector<uint8_t> desktop_;
+  DirtyRegionTracker dirty_;
+  CaptureBackendStats stats_;
+};
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Test Harness
+// Each test file builds into one executable. TEST() registers a function,
+// CHECK*() report a failure and carry on, REQUIRE() also leaves the test.
+// The executable runs every test (or those whose name contains argv[1])
+// and exits non-zero if any check failed, which is all CTest looks at.
+// -----------------------------------------------------------------------------
+
+namespace invisible {
+namespace test {
+
+using TestFn = void (*)();
+
+struct TestCase {
+  const char *name;
+  TestFn fn;
+};
+
+std::vector<TestCase> &Registry();
+
+// Record a failed check (printed at once, counted for the exit code)
+void Fail(const char *file, int line, const std::string &what);
+
+struct Registrar {
+  Registrar(const char *name, TestFn fn) { Registry().push_back({name, fn}); }
+};
+
+template <typename T> std::string Describe(const T &value) {
+  std::ostringstream out;
+  out << value;
+  return out.str();
+}
+
+inline std::string Describe(const std::string &value) {
+  return "\"" + value + "\"";
+}
+
+inline std::string Describe(const char *value) {
+  return value ? Describe(std::string(value)) : "null";
+}
+
+inline std::string Describe(unsigned char value) {
+  return std::to_string(static_cast<int>(value));
+}
+
+inline std::string Describe(signed char value) {
+  return std::to_string(static_cast<int>(value));
+}
+
+} // namespace test
+} // namespace invisible
+
+#define TEST(name)                                                             \
+  static void name();                                                          \
+  static ::invisible::test::Registrar name##Registrar(#name, name);            \
+  static void name()
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition))                                                          \
+      ::invisible::test::Fail(__FILE__, __LINE__, #condition);                 \
+  } while (0)
+
+#define REQUIRE(condition)                                                     \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      ::invisible::test::Fail(__FILE__, __LINE__, #condition);                 \
+      return;                                                                  \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_OP(a, op, b)                                                     \
+  do {                                                                         \
+    const auto &checkA = (a);                                                  \
+    const auto &checkB = (b);                                                  \
+    if (!(checkA op checkB))                                                   \
+      ::invisible::test::Fail(__FILE__, __LINE__,                              \
+                              #a " " #op " " #b " (" +                         \
+                                  ::invisible::test::Describe(checkA) +        \
+                                  " vs " +                                     \
+                                  ::invisible::test::Describe(checkB) + ")");  \
+  } while (0)
+
+#define CHECK_EQ(a, b) CHECK_OP(a, ==, b)
+#define CHECK_NE(a, b) CHECK_OP(a, !=, b)
+#define CHECK_LT(a, b) CHECK_OP(a, <, b)
+#define CHECK_LE(a, b) CHECK_OP(a, <=, b)
+#define CHECK_GT(a, b) CHECK_OP(a, >, b)
+#define CHECK_GE(a, b) CHECK_OP(a, >=, b)
+
+#define CHECK_NEAR(a, b, tolerance)                                            \
+  do {                                                                         \
+    const double checkA = (a), checkB = (b);                                   \
+    if (!(std::fabs(checkA - checkB) <= (tolerance)))                          \
+      ::invisible::test::Fail(__FILE__, __LINE__,                              \
+                              #a " ~= " #b " (" +                              \
+                                  ::invisible::test::Describe(checkA) +        \
+                                  " vs " +                                     \
+                                  ::invisible::test::Describe(checkB) + ")");  \
+  } while (0)
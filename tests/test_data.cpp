@@ -0,0 +1,70 @@
+#include "test_data.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace invisible {
+namespace test {
+
+namespace {
+
+uint32_t ReadLe32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint16_t ReadLe16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+} // namespace
+
+std::string DataPath(const std::string &relative) {
+  return std::string(INVISIBLE_TEST_DATA_DIR) + "/" + relative;
+}
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return {};
+  }
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+}
+
+bool ReadWav(const std::string &path, WavAudio &wav) {
+  std::vector<uint8_t> bytes = ReadFile(path);
+  if (bytes.size() < 12 || memcmp(bytes.data(), "RIFF", 4) != 0 ||
+      memcmp(bytes.data() + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+
+  bool haveFormat = false;
+  size_t pos = 12;
+  while (pos + 8 <= bytes.size()) {
+    const uint8_t *chunk = bytes.data() + pos;
+    size_t size = ReadLe32(chunk + 4);
+    if (pos + 8 + size > bytes.size()) {
+      return false;
+    }
+    if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+      // PCM, 16 bits per sample
+      if (ReadLe16(chunk + 8) != 1 || ReadLe16(chunk + 22) != 16) {
+        return false;
+      }
+      wav.channels = ReadLe16(chunk + 10);
+      wav.sampleRate = ReadLe32(chunk + 12);
+      haveFormat = true;
+    } else if (memcmp(chunk, "data", 4) == 0 && haveFormat) {
+      wav.samples.resize(size / 2);
+      for (size_t i = 0; i < wav.samples.size(); ++i) {
+        wav.samples[i] = static_cast<int16_t>(ReadLe16(chunk + 8 + i * 2));
+      }
+      return wav.channels > 0;
+    }
+    pos += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+} // namespace test
+} // namespace invisible
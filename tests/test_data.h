@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Test Fixtures
+// Files under tests/data, located through the source path baked in at
+// configure time so the tests run from any working directory.
+// -----------------------------------------------------------------------------
+
+namespace invisible {
+namespace test {
+
+// Absolute path of tests/data/<relative>
+std::string DataPath(const std::string &relative);
+
+// Whole file, or empty when it cannot be read
+std::vector<uint8_t> ReadFile(const std::string &path);
+
+struct WavAudio {
+  uint32_t sampleRate = 0;
+  uint16_t channels = 0;
+  std::vector<int16_t> samples; // Interleaved
+};
+
+// 16-bit PCM WAV only; false for anything else
+bool ReadWav(const std::string &path, WavAudio &wav);
+
+} // namespace test
+} // namespace invisible
@@ -0,0 +1,48 @@
+#include "test.h"
+#include <chrono>
+#include <cstring>
+
+namespace invisible {
+namespace test {
+
+namespace {
+
+int failures = 0;
+
+} // namespace
+
+std::vector<TestCase> &Registry() {
+  static std::vector<TestCase> tests;
+  return tests;
+}
+
+void Fail(const char *file, int line, const std::string &what) {
+  std::fprintf(stderr, "%s:%d: FAILED: %s\n", file, line, what.c_str());
+  failures++;
+}
+
+} // namespace test
+} // namespace invisible
+
+int main(int argc, char **argv) {
+  using namespace invisible::test;
+  const char *filter = argc > 1 ? argv[1] : nullptr;
+
+  int run = 0, failed = 0;
+  for (const TestCase &test : Registry()) {
+    if (filter && !std::strstr(test.name, filter))
+      continue;
+    const int before = failures;
+    auto start = std::chrono::steady_clock::now();
+    test.fn();
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    const bool ok = failures == before;
+    std::printf("[%s] %s (%.1f ms)\n", ok ? " OK " : "FAIL", test.name, ms);
+    run++;
+    failed += ok ? 0 : 1;
+  }
+  std::printf("%d tests, %d failed\n", run, failed);
+  return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include "bench.h"
+#include "glyph_font.h"
+#include "test_data.h"
+#include "text_recognizer.h"
+#include <iterator>
+#include <string>
+#include <vector>
+
+// TextRecognizer accuracy and speed on text laid out from the glyph font
+// fixtures (tests/data/ocr): templates from every font at 13, 16 and 22 px,
+// read back at 12 to 24 px in a light and a dark theme. Accuracy is one
+// minus the edit distance to the text drawn, without spaces and with them;
+// "usable" is the recognizer's own verdict on whether the text may stand in
+// for the image, so a usable row with low accuracy is a misreading it did
+// not notice. Then captures that are more than text, of which only the
+// plain text should be usable. OCR_REJECT_DISTANCE and OCR_MIN_CONFIDENCE
+// override the gate's settings.
+
+using namespace invisible;
+using invisible::test::Canvas;
+using invisible::test::Clutter;
+using invisible::test::GlyphFont;
+
+namespace {
+
+struct FontFixture {
+  const char *name;
+  bool monospace;
+};
+
+constexpr FontFixture kFonts[] = {
+    {"dejavu-sans-mono", true}, {"dejavu-sans", false},
+    {"dejavu-serif", false},    {"source-code-pro", true},
+    {"lato", false},
+};
+
+constexpr int kTrainedSizes[] = {13, 16, 22};
+constexpr int kReadSizes[] = {12, 14, 16, 18, 20, 24};
+
+struct Theme {
+  const char *name;
+  uint32_t ink, background;
+};
+
+constexpr Theme kThemes[] = {{"light", 0xFF202020, 0xFFFFFFFE},
+                             {"dark", 0xFFD4D4D4, 0xFF1E1E1E}};
+
+bool LoadFont(const char *name, int size, GlyphFont &font) {
+  std::string path = test::DataPath("ocr/" + std::string(name) + "-" +
+                                    std::to_string(size) + ".glyphs");
+  if (font.Load(path))
+    return true;
+  std::printf("missing %s\n", path.c_str());
+  return false;
+}
+
+// Best time of several reads of `canvas`, in milliseconds, and one result
+double TimeRecognize(const TextRecognizer &recognizer, const Canvas &canvas,
+                     RecognizedText &result) {
+  const ImageView view = canvas.View();
+  return bench::BestOf(bench::Runs(5), [&] {
+           result = recognizer.Recognize(view);
+           bench::Consume(result);
+         }) *
+         1e3;
+}
+
+} // namespace
+
+int main() {
+  // The gate can be swept from the environment, as BENCH_RUNS sets runs
+  TextRecognizerConfig config;
+  if (const char *value = std::getenv("OCR_REJECT_DISTANCE"))
+    config.rejectDistance = std::atoi(value);
+  if (const char *value = std::getenv("OCR_MIN_CONFIDENCE"))
+    config.minConfidence = static_cast<float>(std::atof(value));
+  TextRecognizer recognizer(config);
+  auto start = bench::Clock::now();
+  for (const FontFixture &fixture : kFonts) {
+    for (int size : kTrainedSizes) {
+      GlyphFont font;
+      if (!LoadFont(fixture.name, size, font))
+        return 1;
+      recognizer.AddFont(TextRecognizer::DefaultAlphabet(),
+                         [&](char c) { return font.RenderGlyph(c); });
+    }
+  }
+  std::printf("%zu templates from %zu fonts in %.1f ms, SIMD %s; reject "
+              "distance %d, minimum confidence %.2f\n\n",
+              recognizer.GetGlyphCount(), std::size(kFonts),
+              bench::Seconds(start) * 1e3,
+              TextRecognizer::HasSimd() ? "on" : "off", config.rejectDistance,
+              config.minConfidence);
+
+  std::printf("%-17s %-5s %4s %-5s %7s %7s %5s %9s %4s %6s %8s\n", "font",
+              "text", "px", "theme", "chars", "spaces", "conf", "rejected",
+              "mono", "usable", "ms");
+  int rows = 0, usable = 0, misread = 0;
+  double usableAccuracy = 0, worstUsable = 1;
+  for (const FontFixture &fixture : kFonts) {
+    for (int size : kReadSizes) {
+      GlyphFont font;
+      if (!LoadFont(fixture.name, size, font))
+        return 1;
+      for (const char *text : {test::kCodeSample, test::kProseSample}) {
+        if (text == test::kCodeSample && !fixture.monospace)
+          continue; // Nobody codes in a proportional font
+        for (const Theme &theme : kThemes) {
+          Canvas canvas = font.Render(text, theme.ink, theme.background);
+          RecognizedText result;
+          double ms = TimeRecognize(recognizer, canvas, result);
+          double chars = test::CharacterAccuracy(result.text, text, false);
+          double spaces = test::CharacterAccuracy(result.text, text, true);
+          std::printf("%-17s %-5s %4d %-5s %6.1f%% %6.1f%% %5.2f %4d/%4d "
+                      "%4s %6s %8.2f\n",
+                      fixture.name,
+                      text == test::kCodeSample ? "code" : "prose", size,
+                      theme.name, chars * 100, spaces * 100,
+                      result.confidence, result.rejected, result.symbols,
+                      result.monospace ? "yes" : "no",
+                      result.usable ? "yes" : "no", ms);
+          ++rows;
+          if (result.usable) {
+            ++usable;
+            usableAccuracy += chars;
+            worstUsable = std::min(worstUsable, chars);
+            misread += chars < 0.97;
+          }
+        }
+      }
+    }
+  }
+  std::printf("\n%d of %d usable, %.1f%% of characters right on average, "
+              "worst %.1f%%; %d usable below 97%%\n",
+              usable, rows, usable ? usableAccuracy / usable * 100 : 0.0,
+              worstUsable * 100, misread);
+
+  std::printf("\n%-12s %8s %9s %5s %8s %6s %8s\n", "capture", "symbols",
+              "rejected", "conf", "picture", "usable", "ms");
+  // Plain text, the same text with clutter over its top-left part, and no
+  // text at all
+  GlyphFont font;
+  if (!LoadFont("dejavu-sans", 16, font))
+    return 1;
+  const Canvas text =
+      font.Render(test::kProseSample, 0xFF202020, 0xFFFFFFFE);
+  const ImageRect corner{0, 0, text.width / 2, text.height * 3 / 4};
+  struct Negative {
+    const char *name;
+    Canvas canvas;
+  };
+  std::vector<Negative> negatives = {
+      {"text", text},
+      {"text+chart", text},
+      {"text+speckle", text},
+      {"text+photo", text},
+      {"noise", Canvas(800, 400, 0xFF000000)},
+      {"photo", Canvas(800, 400, 0xFF000000)},
+  };
+  test::AddClutter(negatives[1].canvas, corner, Clutter::kChart);
+  test::AddClutter(negatives[2].canvas, corner, Clutter::kSpeckle);
+  test::AddClutter(negatives[3].canvas, corner, Clutter::kPhoto);
+  test::AddClutter(negatives[4].canvas, {0, 0, 800, 400}, Clutter::kNoise);
+  test::AddClutter(negatives[5].canvas, {0, 0, 800, 400}, Clutter::kPhoto);
+  for (const Negative &negative : negatives) {
+    RecognizedText result;
+    double ms = TimeRecognize(recognizer, negative.canvas, result);
+    std::printf("%-12s %8d %9d %5.2f %8.2f %6s %8.2f\n", negative.name,
+                result.symbols, result.rejected, result.confidence,
+                result.pictureFraction, result.usable ? "yes" : "no", ms);
+  }
+  return 0;
+}
@@ -0,0 +1,217 @@
+#include "glyph_font.h"
+#include "test.h"
+#include "test_data.h"
+#include "text_recognizer.h"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+// Fixtures are generated by ocr_fixture_gen from DejaVu Sans Mono, DejaVu
+// Sans, DejaVu Serif, Source Code Pro and Lato (tests/data/ocr). Templates
+// come from every font at 13, 16 and 22 px, as on Windows; text is laid
+// out from the fixtures in a light and a dark theme and read back.
+
+using namespace invisible;
+using invisible::test::Canvas;
+using invisible::test::Clutter;
+using invisible::test::GlyphFont;
+
+namespace {
+
+const char *const kFonts[] = {"dejavu-sans-mono", "dejavu-sans",
+                              "dejavu-serif", "source-code-pro", "lato"};
+const char *const kMonospaceFonts[] = {"dejavu-sans-mono", "source-code-pro"};
+
+const int kTrainedSizes[] = {13, 16, 22};
+const int kReadSizes[] = {12, 13, 14, 16, 18, 20, 22, 24};
+
+const uint32_t kThemes[][2] = {{0xFF202020, 0xFFFFFFFE},  // Light
+                               {0xFFD4D4D4, 0xFF1E1E1E}}; // Dark
+
+GlyphFont LoadFont(const char *name, int size) {
+  GlyphFont font;
+  font.Load(test::DataPath("ocr/" + std::string(name) + "-" +
+                           std::to_string(size) + ".glyphs"));
+  return font;
+}
+
+const TextRecognizer &Recognizer() {
+  static const TextRecognizer recognizer = [] {
+    TextRecognizer r;
+    for (const char *name : kFonts) {
+      for (int size : kTrainedSizes) {
+        GlyphFont font = LoadFont(name, size);
+        r.AddFont(TextRecognizer::DefaultAlphabet(),
+                  [&](char c) { return font.RenderGlyph(c); });
+      }
+    }
+    return r;
+  }();
+  return recognizer;
+}
+
+RecognizedText Read(const GlyphFont &font, const char *text,
+                    const uint32_t theme[2]) {
+  return Recognizer().Recognize(font.Render(text, theme[0], theme[1]).View());
+}
+
+std::vector<std::string> Lines(const std::string &text) {
+  std::vector<std::string> lines;
+  std::istringstream stream(text);
+  for (std::string line; std::getline(stream, line);)
+    lines.push_back(line);
+  return lines;
+}
+
+size_t Indent(const std::string &line) {
+  return std::min(line.find_first_not_of(' '), line.size());
+}
+
+} // namespace
+
+// --- Fixtures ----------------------------------------------------------------
+
+TEST(FixturesLoad) {
+  for (const char *name : kFonts) {
+    for (int size : kReadSizes) {
+      GlyphFont font = LoadFont(name, size);
+      CHECK_EQ(font.size, size);
+      CHECK_EQ(font.glyphs.size(), 95u); // Printable ASCII and the space
+      CHECK(font.Find('x') != nullptr);
+    }
+  }
+  CHECK_EQ(Recognizer().GetGlyphCount(),
+           std::size(kFonts) * std::size(kTrainedSizes) * 94);
+}
+
+TEST(FixturesRoundTrip) {
+  GlyphFont font = LoadFont("lato", 16);
+  std::vector<uint8_t> bytes = font.Serialize();
+  CHECK(bytes == test::ReadFile(test::DataPath("ocr/lato-16.glyphs")));
+
+  GlyphFont copy;
+  REQUIRE(copy.Parse(bytes));
+  CHECK(copy.Serialize() == bytes);
+  bytes.resize(bytes.size() - 1);
+  CHECK(!copy.Parse(bytes));
+  CHECK(!copy.Load(test::DataPath("ocr/missing-16.glyphs")));
+}
+
+// --- Accuracy ----------------------------------------------------------------
+
+TEST(CodeReadsAtTrainedSizes) {
+  for (const char *name : kMonospaceFonts) {
+    for (int size : kTrainedSizes) {
+      GlyphFont font = LoadFont(name, size);
+      for (const auto &theme : kThemes) {
+        RecognizedText result = Read(font, test::kCodeSample, theme);
+        double accuracy =
+            test::CharacterAccuracy(result.text, test::kCodeSample, false);
+        std::printf("  %s %d px: %.1f%%\n", name, size, accuracy * 100);
+        CHECK_GE(accuracy, 0.96);
+        CHECK(result.monospace);
+        CHECK(result.usable);
+      }
+    }
+  }
+}
+
+TEST(CodeKeepsItsIndentation) {
+  // Python and C++ both need the leading spaces
+  const std::vector<std::string> truth = Lines(test::kCodeSample);
+  for (const char *name : kMonospaceFonts) {
+    GlyphFont font = LoadFont(name, 16);
+    RecognizedText result = Read(font, test::kCodeSample, kThemes[0]);
+    const std::vector<std::string> lines = Lines(result.text);
+    REQUIRE(lines.size() == truth.size());
+    for (size_t i = 0; i < lines.size(); ++i)
+      CHECK_EQ(Indent(lines[i]), Indent(truth[i]));
+  }
+}
+
+TEST(ProseReadsAtTrainedSizes) {
+  // Small serif text runs letters together (fi, ar) into one symbol that
+  // passes for another (h, m), so single reads are held to less than the
+  // average
+  int reads = 0;
+  double total = 0;
+  for (const char *name : kFonts) {
+    for (int size : kTrainedSizes) {
+      GlyphFont font = LoadFont(name, size);
+      for (const auto &theme : kThemes) {
+        RecognizedText result = Read(font, test::kProseSample, theme);
+        double accuracy =
+            test::CharacterAccuracy(result.text, test::kProseSample, false);
+        std::printf("  %s %d px: %.1f%%\n", name, size, accuracy * 100);
+        CHECK_GE(accuracy, 0.9);
+        CHECK_EQ(result.lines, 6);
+        ++reads;
+        total += accuracy;
+      }
+    }
+  }
+  CHECK_GE(total / reads, 0.97);
+}
+
+TEST(UsableReadsAreMostlyRight) {
+  // What `usable` lets through at sizes between and beyond the templates'.
+  // Consistent misreadings (o for u, h for li) match a template well and
+  // are not caught, which is why local OCR is opt-in.
+  int reads = 0, usable = 0;
+  double total = 0, worst = 1;
+  for (const char *name : kFonts) {
+    for (int size : kReadSizes) {
+      GlyphFont font = LoadFont(name, size);
+      RecognizedText result = Read(font, test::kProseSample, kThemes[0]);
+      ++reads;
+      if (!result.usable)
+        continue;
+      double accuracy =
+          test::CharacterAccuracy(result.text, test::kProseSample, false);
+      ++usable;
+      total += accuracy;
+      worst = std::min(worst, accuracy);
+    }
+  }
+  std::printf("  %d of %d usable, %.1f%% right on average, worst %.1f%%\n",
+              usable, reads, total / std::max(usable, 1) * 100, worst * 100);
+  CHECK_GE(usable, reads * 3 / 4);
+  CHECK_GE(total / usable, 0.97);
+  CHECK_GE(worst, 0.9);
+}
+
+// --- Not text ----------------------------------------------------------------
+
+TEST(ClutteredCapturesAreNotUsable) {
+  GlyphFont font = LoadFont("dejavu-sans", 16);
+  const Canvas text = font.Render(test::kProseSample, kThemes[0][0],
+                                  kThemes[0][1]);
+  CHECK(Recognizer().Recognize(text.View()).usable);
+
+  // A chart, a screenshot of a photo or noise beside the text
+  const ImageRect corner{0, 0, text.width / 2, text.height * 3 / 4};
+  for (Clutter clutter : {Clutter::kChart, Clutter::kSpeckle,
+                          Clutter::kPhoto, Clutter::kNoise}) {
+    Canvas canvas = text;
+    test::AddClutter(canvas, corner, clutter);
+    RecognizedText result = Recognizer().Recognize(canvas.View());
+    CHECK(!result.usable);
+  }
+
+  // No text at all
+  for (Clutter clutter : {Clutter::kNoise, Clutter::kPhoto}) {
+    Canvas canvas(800, 400, 0xFF000000);
+    test::AddClutter(canvas, {0, 0, 800, 400}, clutter);
+    RecognizedText result = Recognizer().Recognize(canvas.View());
+    CHECK(!result.usable);
+    CHECK_EQ(result.symbols, 0);
+  }
+}
+
+TEST(BlankCapturesReadNothing) {
+  Canvas canvas(640, 480, 0xFFFFFFFF);
+  RecognizedText result = Recognizer().Recognize(canvas.View());
+  CHECK(result.text.empty());
+  CHECK_EQ(result.lines, 0);
+  CHECK(!result.usable);
+}
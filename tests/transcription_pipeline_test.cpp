@@ -0,0 +1,234 @@
+#include "test.h"
+#include "transcription_pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// The pipeline against a fake transcriber that answers each chunk from its
+// own thread after an injected latency, standing in for the upload.
+
+using namespace invisible;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Answers "chunk <first sample>" after latency(chunk), or "" to fail it
+class FakeTranscriber {
+public:
+  using LatencyFn = std::function<std::chrono::milliseconds(uint64_t id)>;
+
+  explicit FakeTranscriber(LatencyFn latency) : latency_(std::move(latency)) {}
+
+  ~FakeTranscriber() { Join(); }
+
+  // Chunks whose id is in `failing` complete with empty text
+  std::vector<uint64_t> failing;
+
+  TranscriptionPipeline::TranscribeFn Fn() {
+    return [this](AudioChunk &&chunk,
+                  TranscriptionPipeline::TranscribeDone done) {
+      uint64_t id = chunk.startSample;
+      auto delay = latency_(id);
+      bool fail = std::find(failing.begin(), failing.end(), id) !=
+                  failing.end();
+      std::lock_guard<std::mutex> lock(mutex_);
+      threads_.emplace_back([id, delay, fail, done = std::move(done)] {
+        std::this_thread::sleep_for(delay);
+        done(fail ? std::string() : "chunk " + std::to_string(id));
+      });
+    };
+  }
+
+  void Join() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::thread &thread : threads_)
+      thread.join();
+    threads_.clear();
+  }
+
+private:
+  LatencyFn latency_;
+  std::mutex mutex_;
+  std::vector<std::thread> threads_;
+};
+
+struct Result {
+  uint64_t sequence;
+  std::string text;
+};
+
+AudioChunk Chunk(uint64_t id) {
+  AudioChunk chunk;
+  chunk.startSample = id; // Identifies the chunk in the fake's answer
+  chunk.samples.assign(160, 0);
+  return chunk;
+}
+
+// Submit `count` chunks and drain; returns the wall time in seconds
+double Run(size_t maxInFlight, size_t count, FakeTranscriber &fake,
+           std::vector<Result> &results,
+           TranscriptionPipelineStats *stats = nullptr) {
+  std::mutex resultMutex;
+  TranscriptionPipelineConfig config;
+  config.maxInFlight = maxInFlight;
+  TranscriptionPipeline pipeline(
+      config, fake.Fn(), [&](uint64_t sequence, const std::string &text) {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        results.push_back({sequence, text});
+      });
+  pipeline.Start();
+
+  auto start = Clock::now();
+  for (uint64_t id = 0; id < count; ++id)
+    pipeline.Submit(Chunk(id));
+  pipeline.Drain();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  if (stats)
+    *stats = pipeline.GetStats();
+  pipeline.Stop();
+  fake.Join();
+  return seconds;
+}
+
+bool InOrder(const std::vector<Result> &results, size_t count) {
+  if (results.size() != count)
+    return false;
+  for (size_t i = 0; i < count; ++i)
+    if (results[i].sequence != i)
+      return false;
+  return true;
+}
+
+} // namespace
+
+TEST(DeliversInOrderDespiteRandomLatency) {
+  std::mt19937 rng(9);
+  std::uniform_int_distribution<int> jitter(0, 25);
+  std::vector<std::chrono::milliseconds> latency(40);
+  for (auto &value : latency)
+    value = std::chrono::milliseconds(jitter(rng));
+  FakeTranscriber fake([&](uint64_t id) { return latency[id]; });
+
+  std::vector<Result> results;
+  TranscriptionPipelineStats stats;
+  Run(4, latency.size(), fake, results, &stats);
+
+  REQUIRE(InOrder(results, latency.size()));
+  for (size_t i = 0; i < results.size(); ++i)
+    CHECK_EQ(results[i].text, "chunk " + std::to_string(i));
+  CHECK_EQ(stats.submitted, 40u);
+  CHECK_EQ(stats.delivered, 40u);
+  CHECK_EQ(stats.failed, 0u);
+  CHECK_LE(stats.peakInFlight, 4u);
+}
+
+TEST(ThroughputScalesWithTheWindow) {
+  // Fixed 40 ms uploads: a window of N should take about 1/N of the serial
+  // time, because the waits overlap rather than queue
+  constexpr size_t kChunks = 12;
+  FakeTranscriber fake([](uint64_t) { return std::chrono::milliseconds(40); });
+
+  double seconds[4] = {};
+  const size_t windows[] = {1, 2, 3, 6};
+  for (int i = 0; i < 4; ++i) {
+    std::vector<Result> results;
+    seconds[i] = Run(windows[i], kChunks, fake, results);
+    CHECK(InOrder(results, kChunks));
+    printf("  window %zu: %5.0f ms for %zu x 40 ms chunks (%.1fx)\n",
+           windows[i], seconds[i] * 1000, kChunks, seconds[0] / seconds[i]);
+  }
+
+  CHECK_GE(seconds[0], kChunks * 0.040);
+  CHECK_GE(seconds[0] / seconds[1], 1.6);
+  CHECK_GE(seconds[0] / seconds[2], 2.2);
+  CHECK_GE(seconds[0] / seconds[3], 3.5);
+}
+
+TEST(SlowHeadHoldsBackLaterResults) {
+  // Chunk 0 takes longest; 1-3 finish first but must wait for it
+  FakeTranscriber fake([](uint64_t id) {
+    return std::chrono::milliseconds(id == 0 ? 80 : 5);
+  });
+  std::vector<Result> results;
+  TranscriptionPipelineStats stats;
+  Run(4, 4, fake, results, &stats);
+  CHECK(InOrder(results, 4));
+  CHECK_EQ(stats.peakInFlight, 4u);
+}
+
+TEST(FullWindowBlocksSubmit) {
+  FakeTranscriber fake([](uint64_t) { return std::chrono::milliseconds(10); });
+  std::vector<Result> results;
+  TranscriptionPipelineStats stats;
+  Run(2, 10, fake, results, &stats);
+  CHECK(InOrder(results, 10));
+  CHECK_EQ(stats.peakInFlight, 2u);
+  CHECK_GT(stats.blockedSubmits, 0u);
+}
+
+TEST(FailuresAreDeliveredEmptyAndCounted) {
+  FakeTranscriber fake([](uint64_t id) {
+    return std::chrono::milliseconds(id % 3 * 5);
+  });
+  fake.failing = {1, 4};
+  std::vector<Result> results;
+  TranscriptionPipelineStats stats;
+  Run(3, 6, fake, results, &stats);
+  REQUIRE(InOrder(results, 6));
+  CHECK(results[1].text.empty());
+  CHECK(results[4].text.empty());
+  CHECK_EQ(results[5].text, "chunk 5");
+  CHECK_EQ(stats.failed, 2u);
+  CHECK_EQ(stats.delivered, 6u);
+}
+
+TEST(SynchronousTranscriberDoesNotDeadlock) {
+  std::vector<Result> results;
+  TranscriptionPipeline pipeline(
+      TranscriptionPipelineConfig(),
+      [](AudioChunk &&chunk, TranscriptionPipeline::TranscribeDone done) {
+        done(std::to_string(chunk.startSample));
+      },
+      [&](uint64_t sequence, const std::string &text) {
+        results.push_back({sequence, text});
+      });
+  pipeline.Start();
+  for (uint64_t id = 0; id < 5; ++id)
+    CHECK(pipeline.Submit(Chunk(id)));
+  CHECK_EQ(pipeline.GetInFlight(), 0u);
+  CHECK(InOrder(results, 5));
+}
+
+TEST(StopWaitsForRunningRequestsThenRefuses) {
+  FakeTranscriber fake([](uint64_t) { return std::chrono::milliseconds(30); });
+  std::vector<Result> results;
+  std::mutex resultMutex;
+  TranscriptionPipeline pipeline(
+      TranscriptionPipelineConfig(), fake.Fn(),
+      [&](uint64_t sequence, const std::string &text) {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        results.push_back({sequence, text});
+      });
+  pipeline.Start();
+  for (uint64_t id = 0; id < 3; ++id)
+    pipeline.Submit(Chunk(id));
+
+  pipeline.Stop();
+  CHECK(InOrder(results, 3));
+  CHECK(!pipeline.Submit(Chunk(3)));
+  fake.Join();
+
+  // Start() accepts chunks again, numbering from zero
+  results.clear();
+  pipeline.Start();
+  CHECK(pipeline.Submit(Chunk(7)));
+  pipeline.Drain();
+  fake.Join();
+  REQUIRE(results.size() == 1);
+  CHECK_EQ(results[0].sequence, 0u);
+  CHECK_EQ(results[0].text, "chunk 7");
+}
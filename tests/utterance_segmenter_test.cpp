@@ -0,0 +1,256 @@
+#include "test.h"
+#include "test_data.h"
+#include "utterance_segmenter.h"
+#include <algorithm>
+#include <random>
+
+// Replays streams stitched together from the VAD fixtures through the
+// segmenter, polling WaitForChunk(.., 0) after every packet the way the
+// capture thread would feed it, and checks where each chunk is cut.
+
+using namespace invisible;
+
+namespace {
+
+constexpr size_t kRate = 16000;
+
+size_t Samples(double seconds) { return static_cast<size_t>(seconds * kRate); }
+
+// speech_quiet.wav: hiss for the first second, voice from 1.0 s to 2.0 s
+struct Fixture {
+  std::vector<int16_t> hiss;
+  std::vector<int16_t> voice;
+};
+
+const Fixture &LoadFixture() {
+  static Fixture fixture = [] {
+    Fixture f;
+    test::WavAudio wav;
+    if (test::ReadWav(test::DataPath("vad/speech_quiet.wav"), wav) &&
+        wav.samples.size() >= Samples(2.0)) {
+      f.hiss.assign(wav.samples.begin(), wav.samples.begin() + Samples(1.0));
+      f.voice.assign(wav.samples.begin() + Samples(1.0),
+                     wav.samples.begin() + Samples(2.0));
+    }
+    return f;
+  }();
+  return fixture;
+}
+
+// A stream built from hiss and voice sections of given lengths
+class Stream {
+public:
+  Stream &Hiss(double seconds) { return Append(LoadFixture().hiss, seconds); }
+  Stream &Voice(double seconds) {
+    return Append(LoadFixture().voice, seconds);
+  }
+
+  size_t Position() const { return samples.size(); }
+
+  std::vector<int16_t> samples;
+
+private:
+  Stream &Append(const std::vector<int16_t> &source, double seconds) {
+    for (size_t i = 0, n = Samples(seconds); i < n && !source.empty(); ++i)
+      samples.push_back(source[i % source.size()]);
+    return *this;
+  }
+};
+
+struct Emitted {
+  AudioChunk chunk;
+  size_t pushedWhenReady = 0; // Stream samples pushed when it appeared
+};
+
+// Push the stream in `packet`-sized pieces (0: random 1..2000), polling
+// for closed chunks after each one
+std::vector<Emitted> Replay(UtteranceSegmenter &segmenter,
+                            const std::vector<int16_t> &samples,
+                            size_t packet = Samples(0.01)) {
+  std::vector<Emitted> out;
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<size_t> sizes(1, 2000);
+  for (size_t offset = 0; offset < samples.size();) {
+    size_t count = std::min(packet ? packet : sizes(rng),
+                            samples.size() - offset);
+    segmenter.Push(&samples[offset], count);
+    offset += count;
+
+    Emitted emitted;
+    while (segmenter.WaitForChunk(emitted.chunk, 0)) {
+      emitted.pushedWhenReady = offset;
+      out.push_back(std::move(emitted));
+      emitted = Emitted();
+    }
+  }
+  return out;
+}
+
+double Sec(size_t samples) { return static_cast<double>(samples) / kRate; }
+
+} // namespace
+
+TEST(FixtureLoads) {
+  REQUIRE(LoadFixture().voice.size() == Samples(1.0));
+  CHECK_EQ(LoadFixture().hiss.size(), Samples(1.0));
+}
+
+TEST(ClosesEachUtteranceAtItsPause) {
+  Stream stream;
+  stream.Hiss(1.0);
+  size_t firstStart = stream.Position();
+  stream.Voice(1.5);
+  size_t firstEnd = stream.Position();
+  stream.Hiss(1.0);
+  size_t secondStart = stream.Position();
+  stream.Voice(1.5);
+  size_t secondEnd = stream.Position();
+  stream.Hiss(1.0);
+
+  UtteranceSegmenter segmenter;
+  std::vector<Emitted> chunks = Replay(segmenter, stream.samples);
+  REQUIRE(chunks.size() == 2);
+
+  const size_t starts[] = {firstStart, secondStart};
+  const size_t ends[] = {firstEnd, secondEnd};
+  for (size_t i = 0; i < 2; ++i) {
+    const AudioChunk &chunk = chunks[i].chunk;
+    CHECK_EQ(chunk.sequence, i);
+    CHECK(!chunk.forced);
+
+    // Closed once the pause reaches pauseSec, not before and not later
+    CHECK_NEAR(Sec(chunks[i].pushedWhenReady), Sec(ends[i]) + 0.6, 0.05);
+
+    // Starts a preroll before the voice; ends tailSec after it
+    CHECK_NEAR(Sec(chunk.startSample), Sec(starts[i]) - 0.12, 0.05);
+    CHECK_NEAR(Sec(chunk.startSample + chunk.samples.size()),
+               Sec(ends[i]) + 0.2, 0.05);
+    CHECK_NEAR(Sec(chunk.speechSamples), 1.5, 0.05);
+
+    // Samples are the stream's own, from startSample on
+    REQUIRE(chunk.startSample + chunk.samples.size() <= stream.Position());
+    CHECK(std::equal(chunk.samples.begin(), chunk.samples.end(),
+                     stream.samples.begin() + chunk.startSample));
+  }
+}
+
+TEST(LongSpeechIsCutWithOverlap) {
+  Stream stream;
+  stream.Hiss(0.5).Voice(20.0).Hiss(1.0);
+
+  UtteranceSegmenter segmenter;
+  std::vector<Emitted> chunks = Replay(segmenter, stream.samples);
+  REQUIRE(chunks.size() == 2);
+
+  const AudioChunk &first = chunks[0].chunk;
+  const AudioChunk &second = chunks[1].chunk;
+  CHECK(first.forced);
+  CHECK(!second.forced);
+  CHECK_EQ(first.samples.size(), Samples(15.0));
+
+  // The second chunk repeats the last overlapSec of the first
+  size_t overlap = Samples(0.3);
+  CHECK_EQ(second.startSample,
+           first.startSample + first.samples.size() - overlap);
+  REQUIRE(second.samples.size() > overlap);
+  CHECK(std::equal(first.samples.end() - overlap, first.samples.end(),
+                   second.samples.begin()));
+  CHECK_NEAR(Sec(second.startSample + second.samples.size()), 20.5 + 0.2,
+             0.05);
+}
+
+TEST(ShortUtteranceWaitsForTheFlushSilence) {
+  Stream stream;
+  stream.Hiss(1.0).Voice(0.5);
+  size_t end = stream.Position();
+  stream.Hiss(3.0);
+
+  UtteranceSegmenter segmenter;
+  std::vector<Emitted> chunks = Replay(segmenter, stream.samples);
+  REQUIRE(chunks.size() == 1);
+
+  // Too short to close at the pause; closed by flushSilenceSec instead
+  CHECK_NEAR(Sec(chunks[0].pushedWhenReady), Sec(end) + 2.0, 0.05);
+  CHECK_NEAR(Sec(chunks[0].chunk.speechSamples), 0.5, 0.05);
+}
+
+TEST(HissAloneProducesNoChunks) {
+  Stream stream;
+  stream.Hiss(10.0);
+  UtteranceSegmenter segmenter;
+  CHECK(Replay(segmenter, stream.samples).empty());
+  segmenter.Flush();
+  AudioChunk chunk;
+  CHECK(!segmenter.WaitForChunk(chunk, 0));
+}
+
+TEST(PacketSizeDoesNotMoveBoundaries) {
+  Stream stream;
+  stream.Hiss(0.7).Voice(2.0).Hiss(0.8).Voice(16.0).Hiss(1.0).Voice(0.4)
+      .Hiss(2.5);
+
+  UtteranceSegmenter tenMs, ragged;
+  std::vector<Emitted> a = Replay(tenMs, stream.samples);
+  std::vector<Emitted> b = Replay(ragged, stream.samples, 0);
+  REQUIRE(a.size() == b.size());
+  CHECK_EQ(a.size(), 4u);
+  for (size_t i = 0; i < a.size(); ++i) {
+    CHECK_EQ(a[i].chunk.sequence, b[i].chunk.sequence);
+    CHECK_EQ(a[i].chunk.startSample, b[i].chunk.startSample);
+    CHECK_EQ(a[i].chunk.forced, b[i].chunk.forced);
+    CHECK(a[i].chunk.samples == b[i].chunk.samples);
+  }
+}
+
+TEST(FlushClosesTheOpenChunk) {
+  Stream stream;
+  stream.Hiss(1.0).Voice(1.0);
+
+  UtteranceSegmenter segmenter;
+  CHECK(Replay(segmenter, stream.samples).empty());
+
+  segmenter.Flush();
+  AudioChunk chunk;
+  REQUIRE(segmenter.WaitForChunk(chunk, 0));
+  CHECK_NEAR(Sec(chunk.startSample + chunk.samples.size()), 2.0, 0.05);
+  CHECK(!segmenter.WaitForChunk(chunk, 0));
+}
+
+TEST(StopStillHandsOutQueuedChunks) {
+  Stream stream;
+  stream.Hiss(1.0).Voice(1.5).Hiss(1.0).Voice(1.5).Hiss(1.0);
+
+  UtteranceSegmenter segmenter;
+  segmenter.Push(stream.samples.data(), stream.samples.size());
+  segmenter.Stop();
+
+  AudioChunk chunk;
+  CHECK(segmenter.WaitForChunk(chunk));
+  CHECK_EQ(chunk.sequence, 0u);
+  CHECK(segmenter.WaitForChunk(chunk));
+  CHECK_EQ(chunk.sequence, 1u);
+  CHECK(!segmenter.WaitForChunk(chunk));
+
+  segmenter.Reset();
+  CHECK(!segmenter.WaitForChunk(chunk, 0));
+}
+
+TEST(FullQueueDropsOldestChunk) {
+  Stream stream;
+  for (int i = 0; i < 4; ++i)
+    stream.Hiss(1.0).Voice(1.2);
+  stream.Hiss(1.0);
+
+  SegmenterConfig config;
+  config.maxQueuedChunks = 2;
+  UtteranceSegmenter segmenter(config);
+  segmenter.Push(stream.samples.data(), stream.samples.size());
+
+  CHECK_EQ(segmenter.GetQueuedChunks(), 2u);
+  CHECK_EQ(segmenter.GetDroppedChunks(), 2u);
+  AudioChunk chunk;
+  REQUIRE(segmenter.WaitForChunk(chunk, 0));
+  CHECK_EQ(chunk.sequence, 2u);
+  REQUIRE(segmenter.WaitForChunk(chunk, 0));
+  CHECK_EQ(chunk.sequence, 3u);
+}
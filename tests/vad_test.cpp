@@ -0,0 +1,180 @@
+#include "test.h"
+#include "test_data.h"
+#include "vad.h"
+#include <random>
+
+// Fixtures are generated by tests/data/vad/make_fixtures.py: a formant-
+// synthesised voice over hiss at two levels, hiss alone, and silence.
+
+using namespace invisible;
+using invisible::test::DataPath;
+using invisible::test::ReadWav;
+using invisible::test::WavAudio;
+
+namespace {
+
+// Speech spans of speech_quiet.wav and speech_noisy.wav, in seconds
+const double kSpeechSpans[][2] = {{1.0, 2.0}, {2.5, 3.2}};
+
+// Per-frame keep decisions, reconstructed by feeding one frame per call:
+// an onset reports the preroll frames it releases along with its own
+struct FrameDecisions {
+  std::vector<bool> kept;
+  std::vector<int16_t> speech;
+};
+
+FrameDecisions Classify(VoiceActivityDetector &vad,
+                        const std::vector<int16_t> &samples) {
+  FrameDecisions out;
+  const size_t frame = vad.GetFrameSize();
+  for (size_t offset = 0; offset + frame <= samples.size(); offset += frame) {
+    VadResult result = vad.Process(&samples[offset], frame, &out.speech);
+    out.kept.push_back(false);
+    for (size_t k = 0; k < result.speechFrames; ++k)
+      out.kept[out.kept.size() - 1 - k] = true;
+  }
+  return out;
+}
+
+bool InSpeech(size_t frameIndex, size_t frameSize, double slackSec) {
+  double t = (frameIndex + 0.5) * frameSize / 16000.0;
+  for (const auto &span : kSpeechSpans)
+    if (t >= span[0] - slackSec && t < span[1] + slackSec)
+      return true;
+  return false;
+}
+
+struct Scores {
+  double speechKept = 0;  // Fraction of speech frames kept
+  double silenceKept = 0; // Fraction of frames well clear of speech kept
+};
+
+Scores Score(const FrameDecisions &decisions, size_t frameSize) {
+  // Preroll (8 frames) and hangover (15 frames) legitimately keep audio
+  // around each span, so "clear of speech" starts 0.4 s away from it
+  size_t speech = 0, speechKept = 0, clear = 0, clearKept = 0;
+  for (size_t i = 0; i < decisions.kept.size(); ++i) {
+    if (InSpeech(i, frameSize, 0.0)) {
+      ++speech;
+      speechKept += decisions.kept[i];
+    } else if (!InSpeech(i, frameSize, 0.4)) {
+      ++clear;
+      clearKept += decisions.kept[i];
+    }
+  }
+  Scores scores;
+  scores.speechKept = speech ? double(speechKept) / speech : 0;
+  scores.silenceKept = clear ? double(clearKept) / clear : 0;
+  return scores;
+}
+
+WavAudio LoadFixture(const char *name) {
+  WavAudio wav;
+  ReadWav(DataPath(std::string("vad/") + name), wav);
+  return wav;
+}
+
+} // namespace
+
+TEST(FixturesLoad) {
+  for (const char *name : {"speech_quiet.wav", "speech_noisy.wav",
+                           "noise_only.wav", "silence.wav"}) {
+    WavAudio wav = LoadFixture(name);
+    CHECK_EQ(wav.sampleRate, 16000u);
+    CHECK_EQ(wav.channels, 1);
+    CHECK(!wav.samples.empty());
+  }
+}
+
+TEST(KeepsSpeechInQuietRoom) {
+  WavAudio wav = LoadFixture("speech_quiet.wav");
+  REQUIRE(!wav.samples.empty());
+  VoiceActivityDetector vad;
+  Scores scores = Score(Classify(vad, wav.samples), vad.GetFrameSize());
+  CHECK_GE(scores.speechKept, 0.97);
+  CHECK_LE(scores.silenceKept, 0.02);
+}
+
+TEST(KeepsSpeechOverHiss) {
+  WavAudio wav = LoadFixture("speech_noisy.wav");
+  REQUIRE(!wav.samples.empty());
+  VoiceActivityDetector vad;
+  Scores scores = Score(Classify(vad, wav.samples), vad.GetFrameSize());
+  CHECK_GE(scores.speechKept, 0.9);
+  CHECK_LE(scores.silenceKept, 0.05);
+}
+
+TEST(DropsSteadyNoiseEvenWhenItGetsLouder) {
+  // The hiss steps up 10 dB halfway; the floor tracker must absorb it and
+  // flatness must reject it while it does
+  WavAudio wav = LoadFixture("noise_only.wav");
+  REQUIRE(!wav.samples.empty());
+  VoiceActivityDetector vad;
+  std::vector<int16_t> speech;
+  VadResult result = vad.Process(wav.samples.data(), wav.samples.size(),
+                                 &speech);
+  CHECK_EQ(result.frames, wav.samples.size() / vad.GetFrameSize());
+  CHECK_LE(result.speechRatio, 0.02f);
+  CHECK_LE(vad.GetNoiseFloorDb(), -30.0f);
+  CHECK_GE(vad.GetNoiseFloorDb(), -40.0f);
+}
+
+TEST(DropsDigitalSilence) {
+  WavAudio wav = LoadFixture("silence.wav");
+  REQUIRE(!wav.samples.empty());
+  VoiceActivityDetector vad;
+  std::vector<int16_t> speech;
+  VadResult result = vad.Process(wav.samples.data(), wav.samples.size(),
+                                 &speech);
+  CHECK_EQ(result.speechFrames, 0u);
+  CHECK(speech.empty());
+  CHECK_GE(vad.GetNoiseFloorDb(), -90.0f);
+}
+
+TEST(SpeechOutputIsWholeKeptFrames) {
+  WavAudio wav = LoadFixture("speech_quiet.wav");
+  REQUIRE(!wav.samples.empty());
+  VoiceActivityDetector vad;
+  FrameDecisions decisions = Classify(vad, wav.samples);
+
+  // The output is exactly the kept frames, in order
+  std::vector<int16_t> expected;
+  const size_t frame = vad.GetFrameSize();
+  for (size_t i = 0; i < decisions.kept.size(); ++i)
+    if (decisions.kept[i])
+      expected.insert(expected.end(), &wav.samples[i * frame],
+                      &wav.samples[i * frame] + frame);
+  CHECK(decisions.speech == expected);
+}
+
+TEST(ChunkingDoesNotChangeTheOutput) {
+  WavAudio wav = LoadFixture("speech_noisy.wav");
+  REQUIRE(!wav.samples.empty());
+
+  VoiceActivityDetector whole;
+  std::vector<int16_t> expected;
+  whole.Process(wav.samples.data(), wav.samples.size(), &expected);
+
+  VoiceActivityDetector chunked;
+  std::vector<int16_t> speech;
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<size_t> sizes(1, 1000);
+  for (size_t offset = 0; offset < wav.samples.size();) {
+    size_t count = std::min(sizes(rng), wav.samples.size() - offset);
+    chunked.Process(&wav.samples[offset], count, &speech);
+    offset += count;
+  }
+  CHECK(speech == expected);
+  CHECK(!expected.empty());
+}
+
+TEST(ResetForgetsTheStream) {
+  WavAudio wav = LoadFixture("speech_quiet.wav");
+  REQUIRE(!wav.samples.empty());
+  VoiceActivityDetector vad;
+  std::vector<int16_t> first, second;
+  vad.Process(wav.samples.data(), wav.samples.size() - 7, &first);
+  vad.Reset();
+  vad.Process(wav.samples.data(), wav.samples.size() - 7, &second);
+  CHECK(first == second);
+}